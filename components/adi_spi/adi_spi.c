@@ -6,20 +6,45 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <assert.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "driver/spi_master.h"
+#include "driver/gpio.h"
 
 
 #include "adi_spi.h"
 #include "utils.h"
+#include "trace.h"
 #include "hw_setup.h"
+#include "omar_tasks.h"
+#include "omar_postmortem.h"
 
 static spi_device_handle_t m_spi_master;
 
+/*
+ * spi_read_reg() and spi_write_reg() share m_rx_data and the
+ * command packets, and the console, the rpc server and the
+ * telemetry stream can all call them. The lock is recursive so
+ * adi_read_snapshot() can hold it across a whole set of reads.
+ * The stream task (app cpu) and the console (pro cpu) both take it,
+ * so the task monitor watches it for cross-core waits.
+ */
+static SemaphoreHandle_t m_spi_lock = NULL;
+static omar_lock_stats_t m_spi_lock_stats = { .name = "spi" };
+
+/*
+ * The energy registers clear when they're read (LCYCMODE's RSTREAD,
+ * which is on out of reset), so two readers would each see only
+ * part of the energy. adi_read_energy() adds every read into these
+ * running totals instead, and each reader works out its own deltas.
+ */
+static adi_energy_t m_energy;
+
 
 
 /*
@@ -569,6 +594,8 @@ void adi_spi_init(void)
     // Next, configure the SPI bus:
     adi_spi_setup();
 
+    // The totals carry on across a crash (the ADE7953 kept counting), though not a power cycle:
+    omar_postmortem_restore_energy(&m_energy);
 
 }
 
@@ -638,6 +665,7 @@ void lcd_get_id(void)
 
 uint32_t spi_read_reg(SpiCmdNameT reg, uint8_t *buff)
 {
+    omar_task_take_recursive(m_spi_lock, &m_spi_lock_stats);
 
     SpiCmdT cmd = m_spi_commands[reg];
 
@@ -666,19 +694,91 @@ uint32_t spi_read_reg(SpiCmdNameT reg, uint8_t *buff)
     // us how many bits were read, so we need to convert
     // to bytes
     uint8_t rxbytes = (t.rxlength >> 3);    // convert bits to bytes
-    printf("\n%s(): read %d bytes\n", __func__, rxbytes);
-    memcpy(buff, m_rx_data + 3, rxbytes - 3);
-    
-    if (rxbytes < 3) {
-      return 0;
-    } else {
-      return rxbytes - 3;
+    TRACE2(TRACE_SPI_READ, reg, rxbytes);
+
+    uint32_t count = 0;
+
+    if (rxbytes > 3) {
+      count = rxbytes - 3;
+      memcpy(buff, m_rx_data + 3, count);
+    }
+
+    xSemaphoreGiveRecursive(m_spi_lock);
+
+    return count;
+}
+
+/*
+ * adi_read_snapshot - reads the rms and power registers back to back
+ * under the spi lock, so nothing else gets onto the bus in between.
+ */
+esp_err_t adi_read_snapshot(adi_snapshot_t *snapshot)
+{
+    static const SpiCmdNameT regs[] = {VRMS, IRMSA, IRMSB, AWATT, BWATT, AVAR, BVAR, AVA, BVA};
+    int32_t *values[] = {
+        &snapshot->vrms, &snapshot->irmsa, &snapshot->irmsb,
+        &snapshot->awatt, &snapshot->bwatt,
+        &snapshot->avar, &snapshot->bvar,
+        &snapshot->ava, &snapshot->bva,
+    };
+    uint8_t buff[4];
+    esp_err_t ret = ESP_OK;
+
+    omar_task_take_recursive(m_spi_lock, &m_spi_lock_stats);
+
+    for (unsigned i = 0; i < sizeof(regs)/sizeof(regs[0]); i++) {
+        if (spi_read_reg(regs[i], buff) != 3) {
+            ret = ESP_FAIL;
+            break;
+        }
+        *values[i] = adi_3byte_to_int(buff);
+    }
+
+    xSemaphoreGiveRecursive(m_spi_lock);
+
+    return ret;
+}
+
+esp_err_t adi_read_energy(adi_energy_t *energy)
+{
+    static const SpiCmdNameT regs[] = {AENERGYA, AENERGYB, RENERGYA, RENERGYB};
+    int64_t *totals[] = {&m_energy.aenergy, &m_energy.benergy, &m_energy.renergya, &m_energy.renergyb};
+    uint8_t buff[4];
+    esp_err_t ret = ESP_OK;
+
+    omar_task_take_recursive(m_spi_lock, &m_spi_lock_stats);
+
+    // A failed read leaves that total where it was; the energy turns up in the next one:
+    for (unsigned i = 0; i < sizeof(regs)/sizeof(regs[0]); i++) {
+        if (spi_read_reg(regs[i], buff) == 3) {
+            *totals[i] += adi_3byte_to_int(buff);
+        } else {
+            ret = ESP_FAIL;
+        }
     }
+    *energy = m_energy;
+    omar_postmortem_save_energy(&m_energy);
 
+    xSemaphoreGiveRecursive(m_spi_lock);
+
+    return ret;
+}
+
+esp_err_t adi_read_vpeak(int32_t *vpeak)
+{
+    uint8_t buff[4];
+
+    if (spi_read_reg(RSTVPEAK, buff) != 3) {
+        return ESP_FAIL;
+    }
+    *vpeak = adi_3byte_to_int(buff);
+    return ESP_OK;
 }
 
 void spi_write_reg(SpiCmdNameT reg, uint8_t *buff)
 {
+    omar_task_take_recursive(m_spi_lock, &m_spi_lock_stats);
+
     SpiCmdT cmd = m_spi_commands[reg];
 
     uint16_t len = cmd.pkt_size;
@@ -707,8 +807,9 @@ void spi_write_reg(SpiCmdNameT reg, uint8_t *buff)
     // us how many bits were read, so we need to convert
     // to bytes
     uint8_t rxbytes = (t.rxlength >> 3);    // convert bits to bytes
-    printf("\n%s(): read %d bytes\n", __func__, rxbytes);
+    TRACE2(TRACE_SPI_WRITE, reg, rxbytes);
 
+    xSemaphoreGiveRecursive(m_spi_lock);
 }
 
 
@@ -1063,6 +1164,11 @@ void adi_spi_setup(void)
     //printf("%s(): 04\n", __func__);
 
     m_spi_master = spi;
+
+    m_spi_lock = xSemaphoreCreateRecursiveMutex();
+    assert(m_spi_lock != NULL);
+    omar_task_watch_lock(&m_spi_lock_stats);
+
     //Initialize the AD7953:
     //ad7953_init(spi); // (vjc) add this later
 
@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "esp_err.h"
+
 
 typedef enum {
     UNLOCK,
@@ -83,6 +85,23 @@ typedef enum {
 void adi_spi_init(void);
 void factory_7953(void);
 
+/*
+ * One coherent set of ADE7953 measurements; the values are the raw
+ * (sign-extended 24-bit) register contents, scaling is up to the
+ * caller:
+ */
+typedef struct {
+    int32_t vrms;
+    int32_t irmsa;
+    int32_t irmsb;
+    int32_t awatt;
+    int32_t bwatt;
+    int32_t avar;
+    int32_t bvar;
+    int32_t ava;
+    int32_t bva;
+} adi_snapshot_t;
+
 uint32_t spi_read_reg(SpiCmdNameT reg, uint8_t *buff);
 void spi_write_reg(SpiCmdNameT reg, uint8_t *buff);
 char *get_reg_name(SpiCmdNameT reg);
@@ -90,6 +109,20 @@ void adi_hw_reset(void);
 void adi_spi_setup(void);
 int adi_spi_reinit(void);
 void lcd_get_id(void);
+esp_err_t adi_read_snapshot(adi_snapshot_t *snapshot);
+
+// Running totals of the (read-with-reset) energy registers since boot:
+typedef struct {
+    int64_t aenergy;
+    int64_t benergy;
+    int64_t renergya;
+    int64_t renergyb;
+} adi_energy_t;
+
+esp_err_t adi_read_energy(adi_energy_t *energy);
+
+// The voltage peak since the last call (RSTVPEAK), and only this reads it:
+esp_err_t adi_read_vpeak(int32_t *vpeak);
 
 
 #if defined (__OMAR_AD7953_SPI_SUPPORT_READY__)
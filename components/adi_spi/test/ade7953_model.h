@@ -0,0 +1,162 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * ade7953_model.h - a model of the ADE7953's spi interface for the
+ * host spi master (see host_spi_attach()), as far as adi_spi.c can
+ * tell
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "host.h"
+
+#define ADE7953_REG_COUNT           (0x400)
+#define ADE7953_READ                (0x80)
+
+// A few registers by address, with their power-on values:
+#define ADE7953_LCYCMODE            (0x004)
+#define ADE7953_CONFIG              (0x102)
+#define ADE7953_AP_NOLOAD           (0x203)
+#define ADE7953_VRMS                (0x21c)
+#define ADE7953_AENERGYA            (0x21e)
+#define ADE7953_APENERGYB           (0x223)
+#define ADE7953_VPEAK               (0x226)
+#define ADE7953_RSTVPEAK            (0x227)
+#define ADE7953_IRQSTATA            (0x22d)
+#define ADE7953_RSTIRQSTATA         (0x22e)
+#define ADE7953_IRQSTATB            (0x230)
+#define ADE7953_RSTIRQSTATB         (0x231)
+
+#define ADE7953_LCYCMODE_RESET      (0x40)      // RSTREAD: the energy registers clear on read
+#define ADE7953_CONFIG_RESET        (0x8004)
+#define ADE7953_AP_NOLOAD_RESET     (0x00e419)
+
+typedef struct {
+    uint32_t regs[ADE7953_REG_COUNT];
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t bad_frames;            // too short, or neither a read nor a write
+    uint8_t last_frame[8];          // the last frame clocked in, as far as it fits
+    size_t last_len;
+} ade7953_model_t;
+
+static inline void ade7953_model_reset(ade7953_model_t *chip)
+{
+    memset(chip, 0, sizeof(*chip));
+    chip->regs[ADE7953_LCYCMODE] = ADE7953_LCYCMODE_RESET;
+    chip->regs[ADE7953_CONFIG] = ADE7953_CONFIG_RESET;
+    chip->regs[ADE7953_AP_NOLOAD] = ADE7953_AP_NOLOAD_RESET;
+}
+
+/*
+ * The 32-bit registers at 0x3xx are the 24-bit ones at 0x2xx, sign
+ * extended; everything is stored under the 0x2xx address, 24 bits
+ * wide.
+ */
+static inline uint16_t ade7953_model_home(uint16_t address)
+{
+    return ((address & 0x300) == 0x300 ? (uint16_t)(address - 0x100) : address);
+}
+
+static inline uint32_t ade7953_model_value(const ade7953_model_t *chip, uint16_t address)
+{
+    uint32_t value = chip->regs[ade7953_model_home(address)];
+
+    if ((address & 0x300) == 0x300 && (value & 0x800000)) {
+        value |= 0xff000000;
+    }
+    return value;
+}
+
+static inline void ade7953_model_set(ade7953_model_t *chip, uint16_t address, int32_t value)
+{
+    uint16_t home = ade7953_model_home(address);
+
+    chip->regs[home] = (uint32_t) value & ((home & 0x300) == 0x200 ? 0xffffff : 0xffffffff);
+}
+
+// What a read of 'address' does to the chip after it's been shifted out:
+static inline void ade7953_model_after_read(ade7953_model_t *chip, uint16_t address)
+{
+    uint16_t home = ade7953_model_home(address);
+
+    if (home >= ADE7953_AENERGYA && home <= ADE7953_APENERGYB
+        && (chip->regs[ADE7953_LCYCMODE] & ADE7953_LCYCMODE_RESET)) {
+        chip->regs[home] = 0;
+    } else if (home == ADE7953_RSTVPEAK) {
+        chip->regs[ADE7953_VPEAK] = 0;
+    } else if (home == ADE7953_RSTIRQSTATA) {
+        chip->regs[ADE7953_IRQSTATA] = 0;
+    } else if (home == ADE7953_RSTIRQSTATB) {
+        chip->regs[ADE7953_IRQSTATB] = 0;
+    }
+}
+
+/*
+ * A frame is the register address (msb first), a read or write byte,
+ * and the data, msb first; the data width is whatever's left. On a
+ * read the chip shifts the register out over the data bytes, the
+ * first three coming back as whatever the line floats to.
+ */
+static inline esp_err_t ade7953_model_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    ade7953_model_t *chip = (ade7953_model_t *) ctx;
+
+    chip->last_len = len;
+    memcpy(chip->last_frame, tx, (len < sizeof(chip->last_frame) ? len : sizeof(chip->last_frame)));
+
+    if (len < 4 || len > 7 || (tx[2] != ADE7953_READ && tx[2] != 0x00)) {
+        chip->bad_frames++;
+        return ESP_OK;                  // the chip can't say so
+    }
+
+    uint16_t address = (uint16_t)(((tx[0] << 8) | tx[1]) % ADE7953_REG_COUNT);
+    size_t width = len - 3;
+    uint16_t lookup = (address == ADE7953_RSTVPEAK ? ADE7953_VPEAK
+                       : address == ADE7953_RSTIRQSTATA ? ADE7953_IRQSTATA
+                       : address == ADE7953_RSTIRQSTATB ? ADE7953_IRQSTATB
+                       : address);
+
+    if (tx[2] == ADE7953_READ) {
+        uint32_t value = ade7953_model_value(chip, lookup);
+
+        memset(rx, 0xff, 3);
+        for (size_t i = 0; i < width; i++) {
+            rx[3 + i] = (uint8_t)(value >> (8 * (width - 1 - i)));
+        }
+        chip->reads++;
+        ade7953_model_after_read(chip, address);
+    } else {
+        uint32_t value = 0;
+
+        for (size_t i = 0; i < width; i++) {
+            value = (value << 8) | tx[3 + i];
+        }
+        ade7953_model_set(chip, address, (int32_t) value);
+        chip->writes++;
+        memset(rx, 0xff, len);
+    }
+    return ESP_OK;
+}
+
+// Energy accumulates until it's read (and, with RSTREAD on, cleared):
+static inline void ade7953_model_add_energy(ade7953_model_t *chip, uint16_t address, int32_t delta)
+{
+    uint32_t value = ade7953_model_value(chip, address);
+
+    if (value & 0x800000) {
+        value |= 0xff000000;
+    }
+    ade7953_model_set(chip, address, (int32_t) value + delta);
+}
+
+static inline void ade7953_model_attach(ade7953_model_t *chip, int host)
+{
+    static host_spi_slave_t s_slave;
+
+    s_slave = (host_spi_slave_t) { ade7953_model_transfer, chip };
+    host_spi_attach(host, &s_slave);
+}
@@ -0,0 +1,224 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_adi_spi.c - adi_spi.c against a model of the ADE7953 on the
+ * host spi master: the reset, the frames, the register widths, the
+ * clear-on-read energy totals, and readers on several threads
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "unit.h"
+#include "host.h"
+#include "driver/spi_master.h"
+#include "adi_spi.h"
+#include "utils.h"
+#include "hw_setup.h"
+#include "ade7953_model.h"
+
+#define READERS                     (4)
+#define READER_ROUNDS               (500)
+
+static ade7953_model_t m_chip;
+static uint32_t m_reset_edges[2];
+
+static void reset_watch(int gpio, uint32_t level, void *ctx)
+{
+    (void) ctx;
+
+    if (gpio == ADI_RESET) {
+        m_reset_edges[level ? 1 : 0]++;
+    }
+}
+
+static void test_init(void)
+{
+    uint8_t buff[4];
+
+    ade7953_model_reset(&m_chip);
+    ade7953_model_attach(&m_chip, HSPI_HOST);
+    host_gpio_watch(reset_watch, NULL);
+
+    adi_spi_init();
+    host_gpio_watch(NULL, NULL);
+
+    // The hardware reset pulses the line low, and leaves it high:
+    CHECK_EQ(m_reset_edges[0], 1);
+    CHECK_EQ(m_reset_edges[1], 1);
+    CHECK_EQ(host_gpio_level(ADI_RESET), 1);
+
+    // ...and the chip answers with its power-on CONFIG:
+    CHECK_EQ(spi_read_reg(CONFIG, buff), 2);
+    CHECK_EQ(buff[0], 0x80);
+    CHECK_EQ(buff[1], 0x04);
+    CHECK_EQ(m_chip.bad_frames, 0);
+}
+
+static void test_frames(void)
+{
+    uint8_t buff[4] = { 0x12, 0x34, 0x56 };
+
+    // A read: the address, 0x80, then room for the data to come back in:
+    spi_read_reg(VRMS, buff);
+    CHECK_EQ(m_chip.last_len, 6);
+    CHECK_EQ(m_chip.last_frame[0], 0x02);
+    CHECK_EQ(m_chip.last_frame[1], 0x1c);
+    CHECK_EQ(m_chip.last_frame[2], 0x80);
+
+    // A write: the address, 0x00, then the data msb first:
+    buff[0] = 0x12;
+    buff[1] = 0x34;
+    buff[2] = 0x56;
+    spi_write_reg(AIGAIN, buff);
+    CHECK_EQ(m_chip.last_len, 6);
+    CHECK_EQ(m_chip.last_frame[1], 0x80);
+    CHECK_EQ(m_chip.last_frame[2], 0x00);
+    CHECK_EQ(m_chip.last_frame[3], 0x12);
+    CHECK_EQ(m_chip.last_frame[5], 0x56);
+    CHECK_EQ(m_chip.regs[0x280], 0x123456);
+    CHECK_EQ(m_chip.bad_frames, 0);
+}
+
+static void test_widths(void)
+{
+    static const struct {
+        SpiCmdNameT reg;
+        uint16_t address;
+        uint32_t bytes;
+    } regs[] = {
+        { PGA_IA, 0x008, 1 },
+        { LINECYC, 0x101, 2 },
+        { IRQENA, 0x22c, 3 },
+        { AP_NOLOAD, 0x303, 4 },
+    };
+    uint8_t buff[4];
+
+    for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+        uint32_t value = 0;
+
+        ade7953_model_set(&m_chip, regs[i].address, (int32_t)(0xa5a5a5a5u >> (8 * (4 - regs[i].bytes))));
+        CHECK_EQ(spi_read_reg(regs[i].reg, buff), regs[i].bytes);
+        for (uint32_t b = 0; b < regs[i].bytes; b++) {
+            value = (value << 8) | buff[b];
+        }
+        CHECK_EQ(value, ade7953_model_value(&m_chip, regs[i].address));
+    }
+
+    // The 32-bit copy of a 24-bit register is sign extended:
+    ade7953_model_set(&m_chip, ADE7953_AP_NOLOAD, -2);
+    spi_read_reg(AP_NOLOAD, buff);
+    CHECK_EQ(buff[0], 0xff);
+    CHECK_EQ(buff[3], 0xfe);
+    ade7953_model_set(&m_chip, ADE7953_AP_NOLOAD, ADE7953_AP_NOLOAD_RESET);
+}
+
+static void test_snapshot(void)
+{
+    adi_snapshot_t snapshot;
+
+    ade7953_model_set(&m_chip, ADE7953_VRMS, 0x3a9800);
+    ade7953_model_set(&m_chip, 0x21a, 12345);       // IRMSA
+    ade7953_model_set(&m_chip, 0x212, -16);         // AWATT, exporting
+    ade7953_model_set(&m_chip, 0x213, 0x7fffff);    // BWATT, full scale
+
+    CHECK_EQ(adi_read_snapshot(&snapshot), ESP_OK);
+    CHECK_EQ(snapshot.vrms, 0x3a9800);
+    CHECK_EQ(snapshot.irmsa, 12345);
+    CHECK_EQ(snapshot.awatt, -16);
+    CHECK_EQ(snapshot.bwatt, 0x7fffff);
+}
+
+static void test_energy_totals(void)
+{
+    adi_energy_t first, second;
+
+    adi_read_energy(&first);
+
+    // RSTREAD is on out of reset, so each read takes what's built up since the last:
+    ade7953_model_add_energy(&m_chip, ADE7953_AENERGYA, 1000);
+    ade7953_model_add_energy(&m_chip, 0x21f, -250);
+    CHECK_EQ(adi_read_energy(&second), ESP_OK);
+    CHECK_EQ(second.aenergy - first.aenergy, 1000);
+    CHECK_EQ(second.benergy - first.benergy, -250);
+    CHECK_EQ(m_chip.regs[ADE7953_AENERGYA], 0);
+
+    ade7953_model_add_energy(&m_chip, ADE7953_AENERGYA, 7);
+    adi_read_energy(&second);
+    CHECK_EQ(second.aenergy - first.aenergy, 1007);
+}
+
+static void test_vpeak_resets(void)
+{
+    int32_t vpeak = 0;
+
+    ade7953_model_set(&m_chip, ADE7953_VPEAK, 0x400000);
+    CHECK_EQ(adi_read_vpeak(&vpeak), ESP_OK);
+    CHECK_EQ(vpeak, 0x400000);
+    CHECK_EQ(m_chip.regs[ADE7953_VPEAK], 0);
+}
+
+static void *reader(void *arg)
+{
+    uint32_t *torn = (uint32_t *) arg;
+
+    for (int i = 0; i < READER_ROUNDS; i++) {
+        adi_snapshot_t snapshot;
+        adi_energy_t energy;
+
+        adi_read_snapshot(&snapshot);
+        if (snapshot.vrms != 0x3a9800 || snapshot.awatt != -16) {
+            (*torn)++;
+        }
+        adi_read_energy(&energy);
+    }
+    return NULL;
+}
+
+/*
+ * The console, rpc server and telemetry all read the meter, so
+ * nothing two readers do may land one frame inside another (the spi
+ * master would mix them up), and each unit of energy is counted by
+ * exactly one of them.
+ */
+static void test_concurrent_readers(void)
+{
+    pthread_t threads[READERS];
+    uint32_t torn[READERS] = { 0 };
+    host_spi_stats_t stats;
+    adi_energy_t before, after;
+
+    adi_read_energy(&before);
+    ade7953_model_add_energy(&m_chip, ADE7953_AENERGYA, 300);
+    host_spi_reset_stats();
+
+    for (int i = 0; i < READERS; i++) {
+        pthread_create(&threads[i], NULL, reader, &torn[i]);
+    }
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK_EQ(torn[i], 0);
+    }
+
+    adi_read_energy(&after);
+    CHECK_EQ(after.aenergy - before.aenergy, 300);
+    host_spi_get_stats(&stats);
+    CHECK_EQ(stats.overlaps, 0);
+    CHECK(stats.transactions >= READERS * READER_ROUNDS * 13);
+    CHECK_EQ(m_chip.bad_frames, 0);
+    printf("    %u transactions, %u bytes\n", stats.transactions, stats.bytes);
+}
+
+int main(void)
+{
+    RUN(test_init);
+    RUN(test_frames);
+    RUN(test_widths);
+    RUN(test_snapshot);
+    RUN(test_energy_totals);
+    RUN(test_vpeak_resets);
+    RUN(test_concurrent_readers);
+    return unit_done();
+}
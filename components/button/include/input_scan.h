@@ -0,0 +1,52 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * input_scan.h - table-driven debounce, long-press and serial-press
+ * detection for a single digital input
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Events reported by input_scan_edge()/input_scan_expire(), as a
+ * bitmask since one step can produce more than one (a short press
+ * being released is both a TAP and a RELEASE). When more than one
+ * is set they should be handled in bit order.
+ */
+typedef enum {
+    INPUT_EVENT_PUSH    = (1 << 0),    // press has settled
+    INPUT_EVENT_LONG    = (1 << 1),    // held for long_press_ms
+    INPUT_EVENT_SERIAL  = (1 << 2),    // still held, every serial_ms after LONG
+    INPUT_EVENT_TAP     = (1 << 3),    // released before LONG
+    INPUT_EVENT_RELEASE = (1 << 4),    // release has settled
+} input_event_t;
+
+typedef struct {
+    uint16_t debounce_ms;       // the level has to be stable this long
+    uint16_t long_press_ms;     // 0 disables LONG and SERIAL
+    uint16_t serial_ms;         // 0 disables SERIAL
+} input_timing_t;
+
+typedef struct {
+    const input_timing_t *timing;
+    uint8_t state;
+    bool active;                // most recent level seen, true if active
+    bool armed;                 // deadline is valid
+    uint32_t deadline;          // msec
+    uint32_t pressed_at;        // msec
+} input_scan_t;
+
+/*
+ * Times are in milliseconds from any free-running 32-bit clock;
+ * wraparound is handled. An input that's already active at
+ * init is treated as held: its release is reported, but not as
+ * a TAP.
+ */
+void input_scan_init(input_scan_t *scan, const input_timing_t *timing, bool active, uint32_t now);
+uint8_t input_scan_edge(input_scan_t *scan, bool active, uint32_t now);
+uint8_t input_scan_expire(input_scan_t *scan, uint32_t now);
+
+// Returns true, and the time input_scan_expire() is next due, if there's a timer running:
+bool input_scan_deadline(const input_scan_t *scan, uint32_t *deadline);
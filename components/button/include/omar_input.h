@@ -0,0 +1,34 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_input.h - one gpio isr and one scanner task for all of omar's
+ * switch and plug-detect inputs
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <driver/gpio.h>
+#include "esp_err.h"
+#include "input_scan.h"
+
+#define OMAR_INPUT_MAX              (8)
+
+/*
+ * Edges waiting for the scanner task. If the ring ever overflows
+ * the scanner resyncs every input from its current gpio level.
+ */
+#define OMAR_INPUT_RING_SIZE        (32)    // must be a power of two
+
+// Called from the scanner task once for each input_event_t that occurs:
+typedef void (* omar_input_cb_t)(input_event_t event, void *arg);
+
+typedef struct {
+    uint32_t edges;             // edges queued by the isr
+    uint32_t events;            // events delivered to callbacks
+    uint32_t overflows;         // edges dropped because the ring was full
+} omar_input_stats_t;
+
+esp_err_t omar_input_init(void);
+esp_err_t omar_input_add(gpio_num_t gpio, uint8_t active_level, const input_timing_t *timing,
+                         omar_input_cb_t cb, void *arg);
+void omar_input_get_stats(omar_input_stats_t *stats);
@@ -0,0 +1,169 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * input_scan.c - table-driven debounce, long-press and serial-press
+ * detection for a single digital input
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "input_scan.h"
+
+typedef enum {
+    SCAN_IDLE = 0,
+    SCAN_PRESS_SETTLE,          // edge seen while idle, waiting for it to settle
+    SCAN_PRESSED,               // pushed, waiting for long_press_ms
+    SCAN_HELD,                  // long press reported, repeating SERIAL
+    SCAN_RELEASE_SETTLE,        // edge seen while pressed
+    SCAN_HELD_RELEASE_SETTLE,   // edge seen while held
+    SCAN_STATE_COUNT
+} scan_state_t;
+
+typedef enum {
+    SCAN_EDGE = 0,              // the level changed
+    SCAN_SETTLED_ACTIVE,        // debounce timer expired with the input active
+    SCAN_SETTLED_INACTIVE,      // debounce timer expired with the input inactive
+    SCAN_HOLD,                  // long press or serial timer expired
+    SCAN_INPUT_COUNT
+} scan_input_t;
+
+typedef enum {
+    TIMER_NONE = 0,
+    TIMER_DEBOUNCE,             // now + debounce_ms
+    TIMER_LONG,                 // pressed_at + long_press_ms
+    TIMER_SERIAL,               // now + serial_ms
+} scan_timer_t;
+
+typedef struct {
+    uint8_t next;
+    uint8_t events;
+    uint8_t timer;
+} scan_transition_t;
+
+/*
+ * Every edge restarts the debounce timer, so a bouncing contact
+ * never gets past one of the *_SETTLE states until it has been
+ * quiet for debounce_ms; only then is the level looked at. The
+ * combinations that can't happen (e.g. a settle timeout while
+ * idle) leave the state alone.
+ */
+static const scan_transition_t m_table[SCAN_STATE_COUNT][SCAN_INPUT_COUNT] = {
+    [SCAN_IDLE] = {
+        [SCAN_EDGE]             = {SCAN_PRESS_SETTLE,   0,                  TIMER_DEBOUNCE},
+        [SCAN_SETTLED_ACTIVE]   = {SCAN_IDLE,           0,                  TIMER_NONE},
+        [SCAN_SETTLED_INACTIVE] = {SCAN_IDLE,           0,                  TIMER_NONE},
+        [SCAN_HOLD]             = {SCAN_IDLE,           0,                  TIMER_NONE},
+    },
+    [SCAN_PRESS_SETTLE] = {
+        [SCAN_EDGE]             = {SCAN_PRESS_SETTLE,   0,                  TIMER_DEBOUNCE},
+        [SCAN_SETTLED_ACTIVE]   = {SCAN_PRESSED,        INPUT_EVENT_PUSH,   TIMER_LONG},
+        [SCAN_SETTLED_INACTIVE] = {SCAN_IDLE,           0,                  TIMER_NONE},
+        [SCAN_HOLD]             = {SCAN_PRESS_SETTLE,   0,                  TIMER_DEBOUNCE},
+    },
+    [SCAN_PRESSED] = {
+        [SCAN_EDGE]             = {SCAN_RELEASE_SETTLE, 0,                  TIMER_DEBOUNCE},
+        [SCAN_SETTLED_ACTIVE]   = {SCAN_PRESSED,        0,                  TIMER_LONG},
+        [SCAN_SETTLED_INACTIVE] = {SCAN_PRESSED,        0,                  TIMER_LONG},
+        [SCAN_HOLD]             = {SCAN_HELD,           INPUT_EVENT_LONG,   TIMER_SERIAL},
+    },
+    [SCAN_HELD] = {
+        [SCAN_EDGE]             = {SCAN_HELD_RELEASE_SETTLE, 0,             TIMER_DEBOUNCE},
+        [SCAN_SETTLED_ACTIVE]   = {SCAN_HELD,           0,                  TIMER_SERIAL},
+        [SCAN_SETTLED_INACTIVE] = {SCAN_HELD,           0,                  TIMER_SERIAL},
+        [SCAN_HOLD]             = {SCAN_HELD,           INPUT_EVENT_SERIAL, TIMER_SERIAL},
+    },
+    [SCAN_RELEASE_SETTLE] = {
+        [SCAN_EDGE]             = {SCAN_RELEASE_SETTLE, 0,                  TIMER_DEBOUNCE},
+        [SCAN_SETTLED_ACTIVE]   = {SCAN_PRESSED,        0,                  TIMER_LONG},
+        [SCAN_SETTLED_INACTIVE] = {SCAN_IDLE,           INPUT_EVENT_TAP | INPUT_EVENT_RELEASE, TIMER_NONE},
+        [SCAN_HOLD]             = {SCAN_RELEASE_SETTLE, 0,                  TIMER_DEBOUNCE},
+    },
+    [SCAN_HELD_RELEASE_SETTLE] = {
+        [SCAN_EDGE]             = {SCAN_HELD_RELEASE_SETTLE, 0,             TIMER_DEBOUNCE},
+        [SCAN_SETTLED_ACTIVE]   = {SCAN_HELD,           0,                  TIMER_SERIAL},
+        [SCAN_SETTLED_INACTIVE] = {SCAN_IDLE,           INPUT_EVENT_RELEASE, TIMER_NONE},
+        [SCAN_HOLD]             = {SCAN_HELD_RELEASE_SETTLE, 0,             TIMER_DEBOUNCE},
+    },
+};
+
+static uint8_t scan_step(input_scan_t *scan, scan_input_t input, uint32_t now)
+{
+    const scan_transition_t *t = &m_table[scan->state][input];
+    const input_timing_t *timing = scan->timing;
+
+    if (t->events & INPUT_EVENT_PUSH) {
+        scan->pressed_at = now;
+    }
+
+    scan->state = t->next;
+    scan->armed = false;
+
+    switch (t->timer) {
+
+    case TIMER_DEBOUNCE:
+        scan->deadline = now + timing->debounce_ms;
+        scan->armed = true;
+        break;
+
+    case TIMER_LONG:
+        if (timing->long_press_ms != 0) {
+            scan->deadline = scan->pressed_at + timing->long_press_ms;
+            scan->armed = true;
+        }
+        break;
+
+    case TIMER_SERIAL:
+        if (timing->long_press_ms != 0 && timing->serial_ms != 0) {
+            scan->deadline = now + timing->serial_ms;
+            scan->armed = true;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return t->events;
+}
+
+void input_scan_init(input_scan_t *scan, const input_timing_t *timing, bool active, uint32_t now)
+{
+    memset(scan, 0, sizeof(*scan));
+    scan->timing = timing;
+    scan->active = active;
+    scan->pressed_at = now;
+    scan->state = (active ? SCAN_HELD : SCAN_IDLE);
+}
+
+uint8_t input_scan_edge(input_scan_t *scan, bool active, uint32_t now)
+{
+    scan->active = active;
+    return scan_step(scan, SCAN_EDGE, now);
+}
+
+uint8_t input_scan_expire(input_scan_t *scan, uint32_t now)
+{
+    if (!scan->armed || (int32_t)(now - scan->deadline) < 0) {
+        return 0;
+    }
+
+    switch (scan->state) {
+
+    case SCAN_PRESS_SETTLE:
+    case SCAN_RELEASE_SETTLE:
+    case SCAN_HELD_RELEASE_SETTLE:
+        return scan_step(scan, (scan->active ? SCAN_SETTLED_ACTIVE : SCAN_SETTLED_INACTIVE), now);
+
+    default:
+        return scan_step(scan, SCAN_HOLD, now);
+    }
+}
+
+bool input_scan_deadline(const input_scan_t *scan, uint32_t *deadline)
+{
+    if (scan->armed) {
+        *deadline = scan->deadline;
+    }
+    return scan->armed;
+}
@@ -0,0 +1,258 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_input.c - one gpio isr and one scanner task for all of omar's
+ * switch and plug-detect inputs.
+ *
+ * The isr does nothing but timestamp the edge, push it onto a ring and
+ * wake the scanner. The scanner task runs every input through its
+ * input_scan state machine and sleeps until the next edge or the
+ * earliest debounce/long-press deadline, so there are no per-button
+ * software timers or queues, and nothing runs while the inputs are
+ * quiet.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/gpio.h>
+#include <rom/gpio.h>
+#include <soc/gpio_struct.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "omar_input.h"
+#include "omar_tasks.h"
+
+
+typedef struct {
+    uint32_t time;              // msec
+    uint8_t input;              // index into m_inputs
+    uint8_t active;
+} input_edge_t;
+
+typedef struct {
+    gpio_num_t gpio;
+    uint8_t active_level;
+    input_timing_t timing;
+    input_scan_t scan;
+    omar_input_cb_t cb;
+    void *arg;
+} omar_input_t;
+
+static omar_input_t m_inputs[OMAR_INPUT_MAX];
+static volatile uint32_t m_input_count = 0;
+
+/*
+ * Single producer (the gpio isr service, which runs all our
+ * handlers on one core) and single consumer (the scanner task,
+ * pinned to that same core), so plain head/tail counters do.
+ */
+static volatile input_edge_t m_ring[OMAR_INPUT_RING_SIZE];
+static volatile uint32_t m_ring_head = 0;
+static volatile uint32_t m_ring_tail = 0;
+
+static omar_input_stats_t m_stats;
+static TaskHandle_t m_scanner = NULL;
+
+static inline uint32_t IRAM_ATTR input_now(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// gpio_get_level() lives in flash, which the isr can't touch (see OMAR_GPIO_ISR_FLAGS); the ROM's register reads don't:
+static inline int IRAM_ATTR input_level(gpio_num_t gpio)
+{
+    return (gpio < 32 ? gpio_input_get() >> gpio : gpio_input_get_high() >> (gpio - 32)) & 1;
+}
+
+#if CONFIG_PM_ENABLE
+/*
+ * An edge that comes while the chip is in light sleep isn't latched,
+ * and a gpio can only wake it on a level, so with power management
+ * each input interrupts (and wakes us) on whichever level it isn't
+ * at, flipped at every interrupt. That's an edge interrupt that
+ * survives light sleep: the level is still there once we're awake.
+ */
+static inline gpio_int_type_t IRAM_ATTR input_wake_type(int level)
+{
+    return (level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+}
+#endif
+
+static void IRAM_ATTR omar_input_isr(void *arg)
+{
+    uint32_t index = (uint32_t)(intptr_t) arg;
+    uint32_t head = m_ring_head;
+    int level = input_level(m_inputs[index].gpio);
+
+#if CONFIG_PM_ENABLE
+    // If the level moves again before this lands, we just get another interrupt:
+    GPIO.pin[m_inputs[index].gpio].int_type = input_wake_type(level);
+#endif
+
+    if (head - m_ring_tail >= OMAR_INPUT_RING_SIZE) {
+        m_stats.overflows++;
+    } else {
+        volatile input_edge_t *edge = &m_ring[head & (OMAR_INPUT_RING_SIZE - 1)];
+        edge->time = input_now();
+        edge->input = index;
+        edge->active = (level == m_inputs[index].active_level);
+        m_ring_head = head + 1;
+        m_stats.edges++;
+    }
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(m_scanner, &woken);
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void input_dispatch(omar_input_t *input, uint8_t events)
+{
+    for (uint8_t event = INPUT_EVENT_PUSH; event <= INPUT_EVENT_RELEASE; event <<= 1) {
+        if (events & event) {
+            m_stats.events++;
+            if (input->cb) {
+                input->cb((input_event_t) event, input->arg);
+            }
+        }
+    }
+}
+
+/*
+ * After an overflow we can't trust the edge history, so feed each
+ * input whatever level it's at now; the state machine only acts on
+ * levels once they've settled anyway.
+ */
+static void input_resync(uint32_t now)
+{
+    for (uint32_t i = 0; i < m_input_count; i++) {
+        omar_input_t *input = &m_inputs[i];
+        bool active = (gpio_get_level(input->gpio) == input->active_level);
+
+        if (active != input->scan.active) {
+            input_dispatch(input, input_scan_edge(&input->scan, active, now));
+        }
+    }
+}
+
+static TickType_t input_next_wait(uint32_t now)
+{
+    TickType_t wait = portMAX_DELAY;
+
+    for (uint32_t i = 0; i < m_input_count; i++) {
+        uint32_t deadline;
+
+        if (input_scan_deadline(&m_inputs[i].scan, &deadline)) {
+            int32_t remaining = (int32_t)(deadline - now);
+            // Round up so we never wake a tick early and go straight back to sleep:
+            TickType_t ticks = 
+                (remaining <= 0 ? 0 : (remaining + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+            if (ticks < wait) {
+                wait = ticks;
+            }
+        }
+    }
+
+    return wait;
+}
+
+static void omar_input_task(void *arg)
+{
+    uint32_t overflows_seen = 0;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, input_next_wait(input_now()));
+
+        while (m_ring_tail != m_ring_head) {
+            volatile input_edge_t *edge = &m_ring[m_ring_tail & (OMAR_INPUT_RING_SIZE - 1)];
+            omar_input_t *input = &m_inputs[edge->input];
+            uint8_t events = input_scan_edge(&input->scan, edge->active, edge->time);
+            m_ring_tail++;
+
+            input_dispatch(input, events);
+        }
+
+        uint32_t now = input_now();
+
+        if (m_stats.overflows != overflows_seen) {
+            overflows_seen = m_stats.overflows;
+            input_resync(now);
+        }
+
+        for (uint32_t i = 0; i < m_input_count; i++) {
+            input_dispatch(&m_inputs[i], input_scan_expire(&m_inputs[i].scan, now));
+        }
+    }
+}
+
+esp_err_t omar_input_init(void)
+{
+    if (m_scanner != NULL) {
+        return ESP_OK;
+    }
+
+    // ESP_ERR_INVALID_STATE just means someone else installed it first:
+    esp_err_t ret = gpio_install_isr_service(OMAR_GPIO_ISR_FLAGS);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        printf("%s(): couldn't install the gpio isr service (%d)\n", __func__, ret);
+        return ret;
+    }
+
+    /*
+     * Keep the scanner on the core the isr service was installed on
+     * (see m_ring). The boot table has us on the app cpu, but if it
+     * couldn't, sharing a core matters more than which one.
+     */
+    if (omar_task_create_on(OMAR_TASK_INPUT, xPortGetCoreID(), omar_input_task, NULL, &m_scanner) != ESP_OK) {
+        printf("%s(): couldn't create the input scanner task\n", __func__);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t omar_input_add(gpio_num_t gpio, uint8_t active_level, const input_timing_t *timing,
+                         omar_input_cb_t cb, void *arg)
+{
+    if (m_scanner == NULL || m_input_count >= OMAR_INPUT_MAX || gpio >= GPIO_NUM_MAX) {
+        printf("%s(): can't add an input on gpio %d\n", __func__, gpio);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t index = m_input_count;
+    omar_input_t *input = &m_inputs[index];
+
+    gpio_config_t gpio_conf = {
+        .intr_type = GPIO_INTR_ANYEDGE,
+        .mode = GPIO_MODE_INPUT,
+        .pin_bit_mask = ((uint64_t)1 << gpio),
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+    };
+    gpio_config(&gpio_conf);
+
+    input->gpio = gpio;
+    input->active_level = active_level;
+    input->timing = *timing;
+    input->cb = cb;
+    input->arg = arg;
+    input_scan_init(&input->scan, &input->timing, (gpio_get_level(gpio) == active_level), input_now());
+
+    // Only let the scanner see the new input once it's filled in:
+    m_input_count = index + 1;
+
+#if CONFIG_PM_ENABLE
+    gpio_wakeup_enable(gpio, input_wake_type(gpio_get_level(gpio)));
+#endif
+    gpio_isr_handler_add(gpio, omar_input_isr, (void *)(intptr_t) index);
+
+    return ESP_OK;
+}
+
+void omar_input_get_stats(omar_input_stats_t *stats)
+{
+    *stats = m_stats;
+}
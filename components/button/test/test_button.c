@@ -0,0 +1,181 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_button.c - the iot_button driver (button.c) on the host gpio
+ * and software timer stand-ins, on a virtual clock: glitch filtering,
+ * tap, serial and held-for callbacks, each at the time it's due
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "unit.h"
+#include "host.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "soc/gpio_struct.h"
+#include "sdkconfig.h"
+#include "iot_button.h"
+
+#define BUTTON_GPIO                 (0)
+#define FILTER_US                   (CONFIG_IO_GLITCH_FILTER_TIME_MS * 1000)
+
+enum {
+    CB_PUSH,
+    CB_RELEASE,
+    CB_TAP,
+    CB_SERIAL,
+    CB_HELD_2S,
+    CB_RELEASED_AFTER_3S,
+    CB_COUNT
+};
+
+static uint32_t m_counts[CB_COUNT];
+static int64_t m_last_at[CB_COUNT];
+static button_handle_t m_button;
+
+static void record(void *arg)
+{
+    int cb = (int)(intptr_t) arg;
+
+    m_counts[cb]++;
+    m_last_at[cb] = host_time_usec();
+}
+
+static void counts_reset(void)
+{
+    memset(m_counts, 0, sizeof(m_counts));
+    memset(m_last_at, 0, sizeof(m_last_at));
+}
+
+// Drives the pin to 'level' after 'usec':
+static void after(int64_t usec, uint32_t level)
+{
+    host_sleep_usec(usec);
+    host_gpio_input(BUTTON_GPIO, level);
+}
+
+static void test_setup(void)
+{
+    host_clock_virtual(0);
+
+    m_button = iot_button_create(BUTTON_GPIO, BUTTON_ACTIVE_LOW);
+    CHECK(m_button != NULL);
+    CHECK_EQ(iot_button_set_evt_cb(m_button, BUTTON_CB_PUSH, record, (void *) CB_PUSH), ESP_OK);
+    CHECK_EQ(iot_button_set_evt_cb(m_button, BUTTON_CB_RELEASE, record, (void *) CB_RELEASE), ESP_OK);
+    CHECK_EQ(iot_button_set_evt_cb(m_button, BUTTON_CB_TAP, record, (void *) CB_TAP), ESP_OK);
+    CHECK_EQ(iot_button_set_evt_cb(m_button, BUTTON_CB_SERIAL, record, (void *) CB_SERIAL), ESP_OK);
+    CHECK_EQ(iot_button_add_on_press_cb(m_button, 2, record, (void *) CB_HELD_2S), ESP_OK);
+    CHECK_EQ(iot_button_add_on_release_cb(m_button, 3, record, (void *) CB_RELEASED_AFTER_3S), ESP_OK);
+
+    // Creating it sets the pin up to interrupt on both edges, and there's no such pin as GPIO_NUM_MAX:
+    CHECK_EQ(GPIO.pin[BUTTON_GPIO].int_type, GPIO_INTR_ANYEDGE);
+    CHECK_EQ(iot_button_create(GPIO_NUM_MAX, BUTTON_ACTIVE_LOW), NULL);
+}
+
+static void test_glitch_ignored(void)
+{
+    counts_reset();
+
+    after(1000, 0);
+    after(FILTER_US / 5, 1);
+    host_sleep_usec(1000 * 1000);
+
+    for (int i = 0; i < CB_COUNT; i++) {
+        CHECK_EQ(m_counts[i], 0);
+    }
+}
+
+static void test_tap(void)
+{
+    int64_t pressed;
+
+    counts_reset();
+
+    // Bounce on the way down; the filter runs from the last edge:
+    after(1000, 0);
+    after(2000, 1);
+    after(2000, 0);
+    pressed = host_time_usec();
+    host_sleep_usec(300 * 1000);
+
+    CHECK_EQ(m_counts[CB_PUSH], 1);
+    CHECK_EQ(m_last_at[CB_PUSH] - pressed, FILTER_US);
+
+    after(0, 1);
+    int64_t released = host_time_usec();
+    host_sleep_usec(300 * 1000);
+
+    CHECK_EQ(m_counts[CB_TAP], 1);
+    CHECK_EQ(m_counts[CB_RELEASE], 1);
+    CHECK_EQ(m_last_at[CB_RELEASE] - released, FILTER_US);
+    CHECK_EQ(m_counts[CB_SERIAL], 0);
+    CHECK_EQ(m_counts[CB_HELD_2S], 0);
+    CHECK_EQ(m_counts[CB_RELEASED_AFTER_3S], 0);
+}
+
+/*
+ * Held for 3.5 s: serial calls start a second after the press and
+ * repeat every second, the 2 s callback fires while it's still held,
+ * and the 3 s one waits for the release. A held button is no tap.
+ */
+static void test_long_hold(void)
+{
+    counts_reset();
+
+    after(1000, 0);
+    int64_t pressed = host_time_usec();
+    after(3500 * 1000, 1);
+    host_sleep_usec(300 * 1000);
+
+    CHECK_EQ(m_counts[CB_PUSH], 1);
+    CHECK_EQ(m_counts[CB_SERIAL], 3);
+    CHECK_EQ(m_last_at[CB_SERIAL] - pressed, FILTER_US + 3000 * 1000);
+    CHECK_EQ(m_counts[CB_HELD_2S], 1);
+    CHECK_EQ(m_last_at[CB_HELD_2S] - pressed, 2000 * 1000);
+    CHECK_EQ(m_counts[CB_RELEASED_AFTER_3S], 1);
+    CHECK(m_last_at[CB_RELEASED_AFTER_3S] >= pressed + 3500 * 1000);
+    CHECK_EQ(m_counts[CB_TAP], 0);
+    CHECK_EQ(m_counts[CB_RELEASE], 1);
+}
+
+static void test_released_early(void)
+{
+    counts_reset();
+
+    // Let go at 2.5 s: the 2 s callback has fired, the 3 s one never does:
+    after(1000, 0);
+    after(2500 * 1000, 1);
+    host_sleep_usec(300 * 1000);
+
+    CHECK_EQ(m_counts[CB_HELD_2S], 1);
+    CHECK_EQ(m_counts[CB_RELEASED_AFTER_3S], 0);
+    CHECK_EQ(m_counts[CB_RELEASE], 1);
+}
+
+static void test_delete(void)
+{
+    counts_reset();
+
+    CHECK_EQ(iot_button_delete(m_button), ESP_OK);
+    after(1000, 0);
+    after(1000 * 1000, 1);
+    host_sleep_usec(300 * 1000);
+
+    for (int i = 0; i < CB_COUNT; i++) {
+        CHECK_EQ(m_counts[i], 0);
+    }
+}
+
+int main(void)
+{
+    RUN(test_setup);
+    RUN(test_glitch_ignored);
+    RUN(test_tap);
+    RUN(test_long_hold);
+    RUN(test_released_early);
+    RUN(test_delete);
+    return unit_done();
+}
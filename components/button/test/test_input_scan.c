@@ -0,0 +1,223 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_input_scan.c - replays recorded edge sequences, bounce and all,
+ * through input_scan the way the scanner task does and checks the
+ * events that come out, and when
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "unit.h"
+#include "input_scan.h"
+
+#define REPLAY_EVENTS_MAX       (16)
+
+typedef struct {
+    uint32_t at;                // msec
+    bool active;
+} edge_t;
+
+typedef struct {
+    uint32_t at;
+    uint8_t events;
+} emitted_t;
+
+typedef struct {
+    emitted_t events[REPLAY_EVENTS_MAX];
+    uint32_t count;
+} replay_t;
+
+static const input_timing_t m_timing = {
+    .debounce_ms = 20,
+    .long_press_ms = 1000,
+    .serial_ms = 200,
+};
+
+static void emit(replay_t *replay, uint32_t at, uint8_t events)
+{
+    if (events != 0 && replay->count < REPLAY_EVENTS_MAX) {
+        replay->events[replay->count].at = at;
+        replay->events[replay->count].events = events;
+        replay->count++;
+    }
+}
+
+/*
+ * Like the scanner task: timers that are due before the next edge
+ * are expired at their deadline, then the edge is fed in; after the
+ * last edge the clock runs on to 'end'.
+ */
+static void replay(const input_timing_t *timing, bool active, uint32_t start,
+                   const edge_t *edges, uint32_t count, uint32_t end, replay_t *out)
+{
+    input_scan_t scan;
+    uint32_t deadline;
+
+    out->count = 0;
+    input_scan_init(&scan, timing, active, start);
+
+    for (uint32_t i = 0; i <= count; i++) {
+        uint32_t next = (i < count ? start + edges[i].at : start + end);
+
+        while (input_scan_deadline(&scan, &deadline) && (int32_t)(next - deadline) >= 0) {
+            emit(out, deadline - start, input_scan_expire(&scan, deadline));
+        }
+        if (i < count) {
+            emit(out, edges[i].at, input_scan_edge(&scan, edges[i].active, next));
+        }
+    }
+}
+
+#define REPLAY(active, edges, end, out) \
+    replay(&m_timing, (active), 0, (edges), sizeof(edges) / sizeof((edges)[0]), (end), (out))
+
+#define EMITTED(out, i, t, e) do {                                          \
+        CHECK_EQ((out)->events[i].at, (t));                                 \
+        CHECK_EQ((out)->events[i].events, (e));                             \
+    } while (0)
+
+static void test_clean_tap(void)
+{
+    const edge_t edges[] = { {100, true}, {300, false} };
+    replay_t out;
+
+    REPLAY(false, edges, 5000, &out);
+    CHECK_EQ(out.count, 2);
+    EMITTED(&out, 0, 120, INPUT_EVENT_PUSH);
+    EMITTED(&out, 1, 320, INPUT_EVENT_TAP | INPUT_EVENT_RELEASE);
+}
+
+static void test_bouncy_tap(void)
+{
+    // A recorded switch: ~10ms of bounce on the way in, ~5ms on the way out
+    const edge_t edges[] = {
+        {100, true}, {102, false}, {105, true}, {109, false}, {111, true},
+        {400, false}, {401, true}, {404, false},
+    };
+    replay_t out;
+
+    REPLAY(false, edges, 5000, &out);
+    CHECK_EQ(out.count, 2);
+    EMITTED(&out, 0, 131, INPUT_EVENT_PUSH);
+    EMITTED(&out, 1, 424, INPUT_EVENT_TAP | INPUT_EVENT_RELEASE);
+}
+
+static void test_glitch(void)
+{
+    // Shorter than the debounce time, so nothing at all:
+    const edge_t edges[] = { {100, true}, {103, false}, {500, true}, {519, false} };
+    replay_t out;
+
+    REPLAY(false, edges, 5000, &out);
+    CHECK_EQ(out.count, 0);
+}
+
+static void test_release_bounce_back(void)
+{
+    // Contact lifts and comes back inside the debounce time while pressed:
+    const edge_t edges[] = { {100, true}, {300, false}, {305, true}, {600, false} };
+    replay_t out;
+
+    REPLAY(false, edges, 5000, &out);
+    CHECK_EQ(out.count, 2);
+    EMITTED(&out, 0, 120, INPUT_EVENT_PUSH);
+    EMITTED(&out, 1, 620, INPUT_EVENT_TAP | INPUT_EVENT_RELEASE);
+}
+
+static void test_long_and_serial(void)
+{
+    const edge_t edges[] = { {100, true}, {1600, false}, {1603, true}, {1606, false} };
+    replay_t out;
+
+    REPLAY(false, edges, 5000, &out);
+    CHECK_EQ(out.count, 5);
+    EMITTED(&out, 0, 120, INPUT_EVENT_PUSH);
+    EMITTED(&out, 1, 1120, INPUT_EVENT_LONG);
+    EMITTED(&out, 2, 1320, INPUT_EVENT_SERIAL);
+    EMITTED(&out, 3, 1520, INPUT_EVENT_SERIAL);
+    // No TAP after a LONG; the SERIAL due at 1720 never comes:
+    EMITTED(&out, 4, 1626, INPUT_EVENT_RELEASE);
+}
+
+static void test_bounce_while_held(void)
+{
+    // A glitch while held isn't a release, but it does restart the SERIAL period:
+    const edge_t edges[] = { {100, true}, {1400, false}, {1405, true}, {2000, false} };
+    replay_t out;
+
+    REPLAY(false, edges, 5000, &out);
+    CHECK_EQ(out.count, 6);
+    EMITTED(&out, 0, 120, INPUT_EVENT_PUSH);
+    EMITTED(&out, 1, 1120, INPUT_EVENT_LONG);
+    EMITTED(&out, 2, 1320, INPUT_EVENT_SERIAL);
+    EMITTED(&out, 3, 1625, INPUT_EVENT_SERIAL);
+    EMITTED(&out, 4, 1825, INPUT_EVENT_SERIAL);
+    EMITTED(&out, 5, 2020, INPUT_EVENT_RELEASE);
+}
+
+static void test_long_press_disabled(void)
+{
+    const input_timing_t timing = { .debounce_ms = 20, .long_press_ms = 0, .serial_ms = 200 };
+    const edge_t edges[] = { {100, true}, {3000, false} };
+    replay_t out;
+
+    replay(&timing, false, 0, edges, 2, 5000, &out);
+    CHECK_EQ(out.count, 2);
+    EMITTED(&out, 0, 120, INPUT_EVENT_PUSH);
+    EMITTED(&out, 1, 3020, INPUT_EVENT_TAP | INPUT_EVENT_RELEASE);
+}
+
+static void test_serial_disabled(void)
+{
+    const input_timing_t timing = { .debounce_ms = 20, .long_press_ms = 1000, .serial_ms = 0 };
+    const edge_t edges[] = { {100, true}, {3000, false} };
+    replay_t out;
+
+    replay(&timing, false, 0, edges, 2, 5000, &out);
+    CHECK_EQ(out.count, 3);
+    EMITTED(&out, 1, 1120, INPUT_EVENT_LONG);
+    EMITTED(&out, 2, 3020, INPUT_EVENT_RELEASE);
+}
+
+static void test_active_at_init(void)
+{
+    // A plug already in at boot: its removal is a RELEASE, not a TAP
+    const edge_t edges[] = { {50, false}, {52, true}, {54, false} };
+    replay_t out;
+
+    REPLAY(true, edges, 5000, &out);
+    CHECK_EQ(out.count, 1);
+    EMITTED(&out, 0, 74, INPUT_EVENT_RELEASE);
+}
+
+static void test_clock_wrap(void)
+{
+    const edge_t edges[] = { {100, true}, {105, false}, {110, true}, {1500, false} };
+    replay_t out;
+
+    // The same presses straddling the 32-bit millisecond wrap:
+    replay(&m_timing, false, UINT32_MAX - 500, edges, 4, 5000, &out);
+    CHECK_EQ(out.count, 4);
+    EMITTED(&out, 0, 130, INPUT_EVENT_PUSH);
+    EMITTED(&out, 1, 1130, INPUT_EVENT_LONG);
+    EMITTED(&out, 2, 1330, INPUT_EVENT_SERIAL);
+    EMITTED(&out, 3, 1520, INPUT_EVENT_RELEASE);
+}
+
+int main(void)
+{
+    RUN(test_clean_tap);
+    RUN(test_bouncy_tap);
+    RUN(test_glitch);
+    RUN(test_release_bounce_back);
+    RUN(test_long_and_serial);
+    RUN(test_bounce_while_held);
+    RUN(test_long_press_disabled);
+    RUN(test_serial_disabled);
+    RUN(test_active_at_init);
+    RUN(test_clock_wrap);
+
+    return unit_done();
+}
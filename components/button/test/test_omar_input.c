@@ -0,0 +1,212 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_omar_input.c - omar_input.c on the host gpio driver: bouncy
+ * presses through the real isr and scanner task, the level-triggered
+ * interrupts that stand in for edges under power management, and the
+ * resync after the edge ring overflows
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "unit.h"
+#include "host.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "soc/gpio_struct.h"
+#include "sdkconfig.h"
+#include "omar_input.h"
+
+#define SWITCH_GPIO                 (34)
+#define PLUG_GPIO                   (35)
+#define ACTIVE_LEVEL                (0)
+#define EVENTS_MAX                  (64)
+#define WAIT_MS                     (2000)
+
+typedef struct {
+    int gpio;
+    input_event_t event;
+} event_t;
+
+static const input_timing_t m_timing = {
+    .debounce_ms = 20,
+};
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static event_t m_events[EVENTS_MAX];
+static uint32_t m_event_count = 0;
+static SemaphoreHandle_t m_gate = NULL;
+static volatile bool m_gated = false;
+
+static void input_cb(input_event_t event, void *arg)
+{
+    pthread_mutex_lock(&m_lock);
+    if (m_event_count < EVENTS_MAX) {
+        m_events[m_event_count++] = (event_t) { (int)(intptr_t) arg, event };
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    // Holds the scanner task up, with the edges piling up behind it:
+    if (m_gated) {
+        xSemaphoreTake(m_gate, portMAX_DELAY);
+    }
+}
+
+static uint32_t event_count(void)
+{
+    pthread_mutex_lock(&m_lock);
+    uint32_t count = m_event_count;
+    pthread_mutex_unlock(&m_lock);
+    return count;
+}
+
+static bool wait_events(uint32_t count)
+{
+    for (int waited = 0; waited < WAIT_MS; waited++) {
+        if (event_count() >= count) {
+            return true;
+        }
+        host_sleep_usec(1000);
+    }
+    return false;
+}
+
+static void events_reset(void)
+{
+    pthread_mutex_lock(&m_lock);
+    m_event_count = 0;
+    pthread_mutex_unlock(&m_lock);
+}
+
+// A contact bounces a few times, 1 msec apart, before it settles on 'level':
+static void bounce_to(int gpio, uint32_t level)
+{
+    for (int i = 0; i < 3; i++) {
+        host_gpio_input(gpio, level);
+        host_sleep_usec(1000);
+        host_gpio_input(gpio, !level);
+        host_sleep_usec(1000);
+    }
+    host_gpio_input(gpio, level);
+}
+
+static void test_setup(void)
+{
+    m_gate = xSemaphoreCreateBinary();
+
+    CHECK_EQ(omar_input_init(), ESP_OK);
+    CHECK_EQ(omar_input_add(SWITCH_GPIO, ACTIVE_LEVEL, &m_timing, input_cb, (void *) SWITCH_GPIO), ESP_OK);
+    CHECK_EQ(omar_input_add(PLUG_GPIO, ACTIVE_LEVEL, &m_timing, input_cb, (void *) PLUG_GPIO), ESP_OK);
+
+    // Both pins are pulled up, so inactive; with pm each waits for the level it isn't at:
+#if CONFIG_PM_ENABLE
+    CHECK_EQ(GPIO.pin[SWITCH_GPIO].int_type, GPIO_INTR_LOW_LEVEL);
+    CHECK_EQ(GPIO.pin[SWITCH_GPIO].wakeup_enable, 1);
+#else
+    CHECK_EQ(GPIO.pin[SWITCH_GPIO].int_type, GPIO_INTR_ANYEDGE);
+#endif
+}
+
+static void test_bouncy_press(void)
+{
+    omar_input_stats_t before, after;
+
+    events_reset();
+    omar_input_get_stats(&before);
+
+    bounce_to(SWITCH_GPIO, ACTIVE_LEVEL);
+    CHECK(wait_events(1));
+    bounce_to(SWITCH_GPIO, !ACTIVE_LEVEL);
+    CHECK(wait_events(3));
+    host_sleep_usec(50 * 1000);
+
+    // One push, then a tap and a release; the bounces come to nothing:
+    CHECK_EQ(event_count(), 3);
+    CHECK_EQ(m_events[0].gpio, SWITCH_GPIO);
+    CHECK_EQ(m_events[0].event, INPUT_EVENT_PUSH);
+    CHECK_EQ(m_events[1].event, INPUT_EVENT_TAP);
+    CHECK_EQ(m_events[2].event, INPUT_EVENT_RELEASE);
+
+    // ...but every edge got to the scanner, once:
+    omar_input_get_stats(&after);
+    CHECK_EQ(after.edges - before.edges, 14);
+    CHECK_EQ(after.events - before.events, 3);
+    CHECK_EQ(after.overflows, before.overflows);
+}
+
+#if CONFIG_PM_ENABLE
+/*
+ * A level interrupt goes on firing as long as the level holds, so the
+ * isr has to turn it round to the other level each time, or it would
+ * never return (the gpio stand-in gives up after a few repeats).
+ */
+static void test_level_interrupts_flip(void)
+{
+    omar_input_stats_t before, after;
+
+    events_reset();
+    omar_input_get_stats(&before);
+
+    host_gpio_input(PLUG_GPIO, ACTIVE_LEVEL);
+    CHECK_EQ(GPIO.pin[PLUG_GPIO].int_type, GPIO_INTR_HIGH_LEVEL);
+    CHECK(wait_events(1));
+    host_gpio_input(PLUG_GPIO, !ACTIVE_LEVEL);
+    CHECK_EQ(GPIO.pin[PLUG_GPIO].int_type, GPIO_INTR_LOW_LEVEL);
+    CHECK(wait_events(3));
+
+    omar_input_get_stats(&after);
+    CHECK_EQ(after.edges - before.edges, 2);
+    CHECK_EQ(m_events[0].gpio, PLUG_GPIO);
+    CHECK_EQ(m_events[0].event, INPUT_EVENT_PUSH);
+    CHECK_EQ(m_events[2].event, INPUT_EVENT_RELEASE);
+}
+#endif
+
+/*
+ * With the scanner held up in a callback, 41 edges overflow the
+ * 32-edge ring. The last one that fits says pressed, but the switch
+ * ended up released, which the scanner has to find out from the pin
+ * itself once it catches up.
+ */
+static void test_overflow_resync(void)
+{
+    omar_input_stats_t before, after;
+
+    events_reset();
+    omar_input_get_stats(&before);
+
+    m_gated = true;
+    host_gpio_input(SWITCH_GPIO, ACTIVE_LEVEL);
+    CHECK(wait_events(1));
+
+    for (int i = 1; i <= 41; i++) {
+        host_gpio_input(SWITCH_GPIO, (i & 1 ? !ACTIVE_LEVEL : ACTIVE_LEVEL));
+    }
+    m_gated = false;
+    xSemaphoreGive(m_gate);
+
+    CHECK(wait_events(3));
+    host_sleep_usec(50 * 1000);
+
+    omar_input_get_stats(&after);
+    CHECK_EQ(after.overflows - before.overflows, 41 - OMAR_INPUT_RING_SIZE);
+    CHECK_EQ(event_count(), 3);
+    CHECK_EQ(m_events[0].event, INPUT_EVENT_PUSH);
+    CHECK_EQ(m_events[2].event, INPUT_EVENT_RELEASE);
+}
+
+int main(void)
+{
+    RUN(test_setup);
+    RUN(test_bouncy_press);
+#if CONFIG_PM_ENABLE
+    RUN(test_level_interrupts_flip);
+#endif
+    RUN(test_overflow_resync);
+    return unit_done();
+}
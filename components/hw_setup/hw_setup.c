@@ -3,11 +3,18 @@
 #include "omar_als_timer.h"
 #include "adi_spi.h"
 #include "i2c.h"
+#include "omar_thermal.h"
+#include "omar_relay.h"
+#include "omar_led.h"
+#include "omar_boot.h"
+#include "omar_tasks.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <iot_button.h>
+#include "omar_input.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
 #include "driver/adc.h"
-#include "esp_adc_cal.h"
+#include "omar_adc.h"
 #include "driver/ledc.h"
 
 
@@ -15,24 +22,71 @@ static void gpio_setup(void);
 #if defined(HW_OMAR)
 static HwVersionT m_hw_version = HW_VERSION_UNKNOWN;
 static int m_hw_version_raw_adc = 0;
-static void led_setup(void);
 static void button_setup(void);
 static void plug_detect_setup(void);
 static void adc_setup(void);
 #endif  // HW_OMAR
 
-void omar_setup(void)
-{
-    gpio_setup();
-    i2c_init();
+/*
+ * The setup stages and what each one has to wait for. Independent
+ * stages run side by side on both cores; table order breaks ties,
+ * so the slow ones (the ADE7953's reset and the s24c08's bit-banged
+ * reset) go early. We're "ready" once metering and the relays are up.
+ *
+ * gpio_setup() configures the relay coil, led, ADI_RESET and (for
+ * the bit-banged eeprom reset) i2c lines, so nearly everything waits
+ * for it. button_setup() installs the gpio isr service that
+ * thermal_setup() relies on (unless relay_setup() already did), and
+ * its callbacks drive the relays and leds. adc_setup() doesn't need
+ * the gpios, but waiting for them keeps it from being the only other
+ * stage the app cpu can start with, and holding up the ADE7953.
+ *
+ * Interrupts are allocated on the core that asks for them, so the
+ * stages that set up the spi bus, the zero crossing and input gpio
+ * isrs and the als timers are kept to the app cpu (see omar_tasks.h).
+ */
+enum {
+    STAGE_GPIO,
+    STAGE_ADI,
+    STAGE_I2C,
+#if defined(HW_OMAR)
+    STAGE_RELAY,
+    STAGE_ADC,
+    STAGE_LED,
+    STAGE_BUTTON,
+    STAGE_TIMER,
+    STAGE_THERMAL,
+#endif
+    STAGE_COUNT
+};
+
+#define ANY_CPU             (0)
+#define APP_CPU_ONLY        BOOT_WORKER_BIT(OMAR_APP_CPU)
+
+static const boot_stage_t m_boot_stages[STAGE_COUNT] = {
+    [STAGE_GPIO]    = { "gpio",     gpio_setup,     0,                                                          ANY_CPU },
+    [STAGE_ADI]     = { "adi",      adi_spi_init,   BOOT_STAGE_BIT(STAGE_GPIO),                                 APP_CPU_ONLY },
+    [STAGE_I2C]     = { "i2c",      i2c_init,       BOOT_STAGE_BIT(STAGE_GPIO),                                 ANY_CPU },
 #if defined(HW_OMAR)
-    button_setup();
-    adc_setup();
-    led_setup();
-    timer_setup();
+    [STAGE_RELAY]   = { "relay",    relay_setup,    BOOT_STAGE_BIT(STAGE_GPIO),                                 APP_CPU_ONLY },
+    [STAGE_ADC]     = { "adc",      adc_setup,      BOOT_STAGE_BIT(STAGE_GPIO),                                 ANY_CPU },
+    [STAGE_LED]     = { "led",      led_setup,      BOOT_STAGE_BIT(STAGE_GPIO),                                 ANY_CPU },
+    [STAGE_BUTTON]  = { "button",   button_setup,   BOOT_STAGE_BIT(STAGE_RELAY) | BOOT_STAGE_BIT(STAGE_LED),    APP_CPU_ONLY },
+    [STAGE_TIMER]   = { "timer",    timer_setup,    BOOT_STAGE_BIT(STAGE_LED) | BOOT_STAGE_BIT(STAGE_ADC),      APP_CPU_ONLY },
+    [STAGE_THERMAL] = { "thermal",  thermal_setup,  BOOT_STAGE_BIT(STAGE_I2C) | BOOT_STAGE_BIT(STAGE_RELAY)
+                                                    | BOOT_STAGE_BIT(STAGE_LED) | BOOT_STAGE_BIT(STAGE_BUTTON),  ANY_CPU },
 #endif
+};
 
-    adi_spi_init();
+#if defined(HW_OMAR)
+#define OMAR_BOOT_READY     (BOOT_STAGE_BIT(STAGE_ADI) | BOOT_STAGE_BIT(STAGE_RELAY))
+#else
+#define OMAR_BOOT_READY     (BOOT_STAGE_BIT(STAGE_ADI))
+#endif
+
+void omar_setup(void)
+{
+    omar_boot_run(m_boot_stages, STAGE_COUNT, OMAR_BOOT_READY);
 }
 
 
@@ -175,65 +229,11 @@ static void gpio_setup(void)
 
 }
 
-/*
- * Both leds share a single pwm timer:
- */
-static ledc_timer_config_t ledc_timer = {
-    .duty_resolution = OMAR_LED_DUTY_RESOLUTION,// resolution of PWM duty
-    .freq_hz = OMAR_LEDC_FREQ_HZ,               // frequency of PWM signal
-    .speed_mode = OMAR_LEDC_SPEED_MODE,         // timer mode
-    .timer_num = OMAR_LEDC_TIMER                // timer index
-};
-    
-/*
- * Index into the array of channel configs:
- */
-#define OMAR_LED0_LEDCINDEX             (0)
-#define OMAR_LED1_LEDCINDEX             (1)
-
-
-static ledc_channel_config_t ledc_channel[] = {
-    {
-        .channel    = LEDC_CHANNEL_0,
-        .duty       = 0,
-        .gpio_num   = OMAR_WHITE_LED0,
-        .speed_mode = LEDC_HIGH_SPEED_MODE,
-        .timer_sel  = LEDC_TIMER_0
-    },
-    {
-        .channel    = LEDC_CHANNEL_1,
-        .duty       = 0,
-        .gpio_num   = OMAR_WHITE_LED1,
-        .speed_mode = LEDC_HIGH_SPEED_MODE,
-        .timer_sel  = LEDC_TIMER_0
-    }
-};
-
-
-static void led_setup(void)
-{
-    ledc_timer_config(&ledc_timer);
-
-    ledc_channel_config(&ledc_channel[OMAR_LED0_LEDCINDEX]);
-    ledc_channel_config(&ledc_channel[OMAR_LED1_LEDCINDEX]);
-
-}
-
-static void update_relay_coil(gpio_num_t coil)
-{
-
-    // Energize the coil for 10 milliseconds - that's all it takes:
-    gpio_set_level(coil, true);
-    vTaskDelay(10/portTICK_PERIOD_MS);
-    gpio_set_level(coil, false);
-
-}
-
 static void button_toggle_state(void)
 {
     int on = toggle_white_led0(0, NULL);
 
-    update_relay_coil(on ? OMAR_COIL_2_SET_GPIO : OMAR_COIL_2_RESET_GPIO);
+    relay_set(OMAR_RELAY_2, on);
 
 }
 
@@ -241,100 +241,48 @@ static void button_toggle_state1(void)
 {
     int on = toggle_white_led1(0, NULL);
 
-    update_relay_coil(on ? OMAR_COIL_1_SET_GPIO : OMAR_COIL_1_RESET_GPIO);
+    relay_set(OMAR_RELAY_1, on);
 
 }
 
-static void push_btn_cb(void* arg)
-{
-    static uint64_t previous;
+/*
+ * The switches act on release; the plug detects report both
+ * edges. Debouncing is left entirely to the input scanner.
+ */
+static const input_timing_t m_switch_timing = {
+    .debounce_ms = CONFIG_IO_GLITCH_FILTER_TIME_MS,
+};
 
-    uint64_t current = xTaskGetTickCount();
-    if ((current - previous) > DEBOUNCE_TIME) {
-        previous = current;
-        button_toggle_state();
-    }
-}
+static const input_timing_t m_plug_detect_timing = {
+    .debounce_ms = CONFIG_IO_GLITCH_FILTER_TIME_MS,
+};
 
-static void push_btn_cb1(void* arg)
+static void switch_cb(input_event_t event, void* arg)
 {
-    static uint64_t previous;
+    if (event != INPUT_EVENT_RELEASE) {
+        return;
+    }
 
-    uint64_t current = xTaskGetTickCount();
-    if ((current - previous) > DEBOUNCE_TIME) {
-        previous = current;
+    if ((uint32_t)(intptr_t) arg == OMAR_SWITCH_INT0) {
+        button_toggle_state();
+    } else {
         button_toggle_state1();
     }
 }
 
 static void button_setup(void)
 {
-    button_handle_t btn_handle = 
-        iot_button_create_omar(
-            OMAR_SWITCH_INT0,
-            BUTTON_ACTIVE_LEVEL);
-
-    if (btn_handle) {
-        iot_button_set_evt_cb(btn_handle, BUTTON_CB_RELEASE, push_btn_cb, "RELEASE");
-    }
+    ESP_ERROR_CHECK(omar_input_init());
 
-    button_handle_t btn_handle1 = 
-        iot_button_create_omar(
-            OMAR_SWITCH_INT1,
-            BUTTON_ACTIVE_LEVEL);
-
-    if (btn_handle1) {
-        iot_button_set_evt_cb(btn_handle1, BUTTON_CB_RELEASE, push_btn_cb1, "RELEASE");
-    }
+    omar_input_add(OMAR_SWITCH_INT0, BUTTON_ACTIVE_LEVEL, &m_switch_timing, 
+                   switch_cb, (void *) OMAR_SWITCH_INT0);
+    omar_input_add(OMAR_SWITCH_INT1, BUTTON_ACTIVE_LEVEL, &m_switch_timing, 
+                   switch_cb, (void *) OMAR_SWITCH_INT1);
 
     plug_detect_setup();
 
 }
 
-/*
- * led_gt_brightness() returns the duty cycle of the pwm channel
- * associated with the specified led.
- *
- * The led is specified by the assocaited gpio (so either
- * OMAR_WHITE_LED0 or OMAR_WHITE_LED1)
- * 
- */
-uint32_t led_get_brightness(uint8_t led)
-{
-    uint8_t ch = (led == OMAR_WHITE_LED0 ? OMAR_LED0_LEDCINDEX : OMAR_LED1_LEDCINDEX);
-
-    return ledc_get_duty(ledc_channel[ch].speed_mode, ledc_channel[ch].channel);
-
-}
-
-/*
- * NOTE: led_set_brightness() is not thread safe! See comments in "ledc.h" 
- * in the esp-idf sdk for details... If we decide to implement some kind
- * of "ui thread" and restrict all led manipulation to that thread, we're
- * ok with this implementation. Otherwise we'll have to revisit this..
- */
-void led_set_brightness(uint8_t led, uint32_t duty)
-{
-    uint8_t ch = (led == OMAR_WHITE_LED0 ? OMAR_LED0_LEDCINDEX : OMAR_LED1_LEDCINDEX);
-
-    if (duty > OMAR_LED_MAX_DUTY) {
-        duty = OMAR_LED_MAX_DUTY;
-    }
-
-    ledc_set_duty(ledc_channel[ch].speed_mode, ledc_channel[ch].channel, duty);
-    ledc_update_duty(ledc_channel[ch].speed_mode, ledc_channel[ch].channel);
-
-
-#if defined(HW_SETUP_VERBOSE)
-    printf("%s(): Set the duty cycle of led #%d to %d (hpoint is now %d)\n", 
-           __func__,
-           ch,
-           duty,
-           ledc_get_hpoint(ledc_channel[ch].speed_mode, ledc_channel[ch].channel));
-#endif
-
-}
-
 /*
  * led_turnonoff() is used to toggle an led between
  * "full on" (duty cycle set to OMAR_LED_MAX_DUTY), and
@@ -342,15 +290,16 @@ void led_set_brightness(uint8_t led, uint32_t duty)
  * 
  * It mimics the way we used to control the leds
  * before the PWM integration, when the leds were
- * just gpio lines that we pulled high or low.
+ * just gpio lines that we pulled high or low --
+ * except that it fades rather than snapping.
  *
  */
 static void led_turnonoff(uint8_t led, bool on)
 {
     if (on) {
-        led_set_brightness(led, OMAR_LED_MAX_DUTY);
+        led_fade_brightness(led, OMAR_LED_MAX_DUTY, OMAR_LED_TOGGLE_FADE_MSEC);
     } else {
-        led_set_brightness(led, 0);
+        led_fade_brightness(led, 0, OMAR_LED_TOGGLE_FADE_MSEC);
     }
 }
 
@@ -372,72 +321,19 @@ static void handle_plug_unplug_event(uint32_t plug, bool on)
     }
 }
 
-static void plug_detect1_plug_cb(void* arg)
-{
-    static uint64_t previous;
-
-    uint64_t current = xTaskGetTickCount();
-    if ((current - previous) > DEBOUNCE_TIME) {
-        previous = current;
-        handle_plug_unplug_event(PLUG_DETECT1, true);
-    }
-}
-
-static void plug_detect1_unplug_cb(void* arg)
-{
-    static uint64_t previous;
-
-    uint64_t current = xTaskGetTickCount();
-    if ((current - previous) > DEBOUNCE_TIME) {
-        previous = current;
-        handle_plug_unplug_event(PLUG_DETECT1, false);
-    }
-}
-
-static void plug_detect2_plug_cb(void* arg)
-{
-    static uint64_t previous;
-
-    uint64_t current = xTaskGetTickCount();
-    if ((current - previous) > DEBOUNCE_TIME) {
-        previous = current;
-        handle_plug_unplug_event(PLUG_DETECT2, true);
-    }
-}
-
-static void plug_detect2_unplug_cb(void* arg)
+static void plug_detect_cb(input_event_t event, void* arg)
 {
-    static uint64_t previous;
-
-    uint64_t current = xTaskGetTickCount();
-    if ((current - previous) > DEBOUNCE_TIME) {
-        previous = current;
-        handle_plug_unplug_event(PLUG_DETECT2, false);
+    if (event == INPUT_EVENT_PUSH || event == INPUT_EVENT_RELEASE) {
+        handle_plug_unplug_event((uint32_t)(intptr_t) arg, event == INPUT_EVENT_PUSH);
     }
 }
 
 static void plug_detect_setup(void)
 {
-    button_handle_t plug_detect1 = 
-        iot_button_create_omar(
-            PLUG_DETECT1,
-            BUTTON_ACTIVE_LEVEL);
-
-    if (plug_detect1) {
-        iot_button_set_evt_cb(plug_detect1, BUTTON_CB_PUSH, plug_detect1_plug_cb, "PLUG");
-        iot_button_set_evt_cb(plug_detect1, BUTTON_CB_RELEASE, plug_detect1_unplug_cb, "UNPLUG");
-    }
-
-    button_handle_t plug_detect2 = 
-        iot_button_create_omar(
-            PLUG_DETECT2,
-            BUTTON_ACTIVE_LEVEL);
-
-    if (plug_detect2) {
-        iot_button_set_evt_cb(plug_detect2, BUTTON_CB_PUSH, plug_detect2_plug_cb, "PLUG");
-        iot_button_set_evt_cb(plug_detect2, BUTTON_CB_RELEASE, plug_detect2_unplug_cb, "UNPLUG");
-    }
-
+    omar_input_add(PLUG_DETECT1, BUTTON_ACTIVE_LEVEL, &m_plug_detect_timing, 
+                   plug_detect_cb, (void *) PLUG_DETECT1);
+    omar_input_add(PLUG_DETECT2, BUTTON_ACTIVE_LEVEL, &m_plug_detect_timing, 
+                   plug_detect_cb, (void *) PLUG_DETECT2);
 }
 
 int toggle_white_led0(int argc, char** argv)
@@ -464,15 +360,14 @@ int toggle_white_led1(int argc, char** argv)
 
 static void adc_setup(void)
 {
-    
-
-    // Configure the ambient light sensor ADC input:
-    adc1_config_width(ADC_WIDTH_BIT_12);
-    adc1_config_channel_atten(VOUT_LGHT_SNSR__ADC_CHANNEL, ADC_ATTEN_DB_11);
-    adc1_config_channel_atten(HW_DET__ADC_CHANNEL, ADC_ATTEN_DB_0);
-
-    
+    omar_adc_reading_t reading;
 
+    // Characterize both inputs once, and take the hw detect reading while we're here:
+    if (omar_adc_init() == ESP_OK
+        &&
+        omar_adc_read(OMAR_ADC_HW_DET, OMAR_ADC_SAMPLES, &reading) == ESP_OK) {
+        m_hw_version_raw_adc = reading.raw;
+    }
 }
 
 /*
@@ -488,40 +383,20 @@ static void adc_setup(void)
  * the result would be (50/33)*621=941
  *
  */
-#define DEFAULT_VREF    1100        //Use adc2_vref_to_gpio() to obtain a better estimate
-static void print_char_val_type(esp_adc_cal_value_t val_type)
-{
-    if (val_type == ESP_ADC_CAL_VAL_EFUSE_TP) {
-        printf("Characterized using Two Point Value\n");
-    } else if (val_type == ESP_ADC_CAL_VAL_EFUSE_VREF) {
-        printf("Characterized using eFuse Vref\n");
-    } else {
-        printf("Characterized using Default Vref\n");
-    }
-}
-
 int hw_version_raw(void)
 {
-    int raw_adc;
-    esp_adc_cal_characteristics_t *adc_chars;
+    omar_adc_reading_t reading;
 
-    adc_chars = calloc(1, sizeof(esp_adc_cal_characteristics_t));
-    esp_adc_cal_value_t val_type = 
-        esp_adc_cal_characterize(
-            ADC_UNIT_1, 
-            ADC_ATTEN_DB_0, 
-            ADC_WIDTH_BIT_12, 
-            DEFAULT_VREF, adc_chars); 
-
-    print_char_val_type(val_type);
-
-    raw_adc = adc1_get_raw(HW_DET__ADC_CHANNEL);
+    if (omar_adc_read(OMAR_ADC_HW_DET, OMAR_ADC_SAMPLES, &reading) != ESP_OK) {
+        printf("%s(): the hw detect input couldn't be read\n", __func__);
+        return -1;
+    }
 
-    //Convert adc_reading to voltage in mV
-    uint32_t voltage = esp_adc_cal_raw_to_voltage(raw_adc, adc_chars);
-    printf("Raw: %d\tVoltage: %dmV (Expected value is 500mV)\n", raw_adc, voltage);
+    printf("Characterized using %s\n", omar_adc_cal_name(OMAR_ADC_HW_DET));
+    printf("Raw: %u (%u - %u over %u samples)\tVoltage: %umV (Expected value is 500mV)\n",
+           reading.raw, reading.raw_min, reading.raw_max, reading.samples, reading.mv);
 
-    return raw_adc;
+    return reading.raw;
 }
 
 HwVersionT hw_version(void)
@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
+
 /*
  * Macro to check the outputs of TWDT functions and trigger an abort if an
  * incorrect code is returned.
@@ -136,6 +139,12 @@ typedef enum {
 // Don't implement AD7953 interrupt support just yet:
 //#define ADE7953_INTERRUPT_SUPPORT
 
+// Nor is the ADE7953's ZX (voltage zero crossing) output routed to the
+// esp32 yet. Enable ADE7953_ZX_SUPPORT once ADE7953_ZX_GPIO is wired up
+// and the relays will switch in step with the mains:
+//#define ADE7953_ZX_SUPPORT
+#define ADE7953_ZX_GPIO                 (13)
+
 
 // Omar LEDs and Buttons
 
@@ -152,11 +161,13 @@ typedef enum {
 #define OMAR_LEDC_SPEED_MODE            (LEDC_HIGH_SPEED_MODE)
 #define OMAR_LEDC_FREQ_HZ               (5000)
 
+// On/off toggles (buttons, plug detect) fade over this long:
+#define OMAR_LED_TOGGLE_FADE_MSEC       (250)
+
 #define OMAR_WHITE_LED0                 (26)
 #define OMAR_WHITE_LED1                 (27)
 
 #define BUTTON_ACTIVE_LEVEL             (1)
-#define DEBOUNCE_TIME                   (30)
 
 #define OMAR_SWITCH_INT0                (36)   // aka "SENSOR_VP" (Pin 5)
 #define OMAR_SWITCH_INT1                (39)   // aka "SENSOR_VN" (Pin 8)
@@ -167,9 +178,9 @@ typedef enum {
 
 // Omar ADC inputs; both the ambient light sensor, and hw detect, are on ADC1:
 #define VOUT_LGHT_SNSR                  (37)
-#define VOUT_LGHT_SNSR__ADC_CHANNEL     (ADC_CHANNEL_1) 
+#define VOUT_LGHT_SNSR__ADC_CHANNEL     (ADC1_CHANNEL_1)
 #define HW_DET                          (38)
-#define HW_DET__ADC_CHANNEL             (ADC_CHANNEL_2)
+#define HW_DET__ADC_CHANNEL             (ADC1_CHANNEL_2)
 
 // At fixed intervals we "pause" the pwm led drive, turning
 // the leds off so that we can sample the ambient light using
@@ -185,6 +196,13 @@ typedef enum {
 // 11.4 usec.
 #define ALS_SAMPLE_DELAY                (1/portTICK_PERIOD_MS)
 
+// The S-5852A temperature sensor's EVENT output (open-drain, active
+// low). It isn't routed to the esp32 on the current board, so by
+// default the thermal supervisor polls the sensor instead; enable
+// S5852A_EVENT_SUPPORT once OMAR_TEMP_EVENT_GPIO is wired up:
+//#define S5852A_EVENT_SUPPORT
+#define OMAR_TEMP_EVENT_GPIO            (25)
+
 
 #endif // HW_OMAR
 
@@ -209,6 +227,4 @@ int toggle_red(int argc, char** argv);
 HwVersionT hw_version(void);
 int hw_version_raw(void);
 int als_raw(void);
-uint32_t led_get_brightness(uint8_t led);
-void led_set_brightness(uint8_t led, uint32_t duty);
 #endif  // HW_OMAR
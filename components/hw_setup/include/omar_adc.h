@@ -0,0 +1,49 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_adc.h - the als and hw detect adc inputs, characterized once at
+ * boot, with a table-driven raw-to-millivolt conversion
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Both inputs are on ADC1: the als at 11dB (up to about 3.9V) and the
+ * hw detect ladder at 0dB (up to about 1.1V). omar_adc_init() sets the
+ * attenuations, characterizes each one from the efuse values and
+ * builds its lookup table (see adc_lut.h), so a conversion afterwards
+ * doesn't go near esp_adc_cal or the heap.
+ */
+typedef enum {
+    OMAR_ADC_ALS,
+    OMAR_ADC_HW_DET,
+
+    OMAR_ADC_COUNT
+} omar_adc_t;
+
+// A single adc1 read is noisy to a few tens of codes; this many is the usual batch:
+#define OMAR_ADC_SAMPLES        (16)
+#define OMAR_ADC_SAMPLES_MAX    (256)
+
+typedef struct {
+    uint32_t samples;
+    uint32_t raw;               // mean of the raw codes
+    uint32_t raw_min;
+    uint32_t raw_max;
+    uint32_t mv;                // mean of the calibrated samples
+} omar_adc_reading_t;
+
+esp_err_t omar_adc_init(void);
+
+// Back-to-back reads, 1 to OMAR_ADC_SAMPLES_MAX of them:
+esp_err_t omar_adc_read(omar_adc_t channel, uint32_t samples, omar_adc_reading_t *reading);
+
+// No locks, flash or floating point, so fine from an isr once omar_adc_init() has run:
+uint32_t omar_adc_raw_to_mv(omar_adc_t channel, uint32_t raw);
+
+// Compares the table with esp_adc_cal over every code; the largest error in mV:
+uint32_t omar_adc_check(omar_adc_t channel, uint32_t *worst_raw);
+
+const char *omar_adc_name(omar_adc_t channel);
+const char *omar_adc_cal_name(omar_adc_t channel);     // what the characterization came from
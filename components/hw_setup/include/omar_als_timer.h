@@ -6,13 +6,19 @@
  */
 #pragma once
 
+#include <stdint.h>
+
 #define NANOSECOND                  (1e-9)
 
 #define OMAR_ALS_TIMER_GROUP        (TIMER_GROUP_0)
 
 /*
  * The primary timer fires once every 
- * OMAR_ALS_PRIMARY_INTERVAL seconds.
+ * OMAR_ALS_PRIMARY_INTERVAL seconds. It's
+ * the als event task's timeout rather than
+ * a hardware timer (those stop in light
+ * sleep), so it's good to a tick or so, and
+ * OMAR_ALS_PRIMARY_TIMER is just the event.
  * When the primary timer fires, it pauses
  * the led pwm, shutting the leds off
  * if they are on.
@@ -84,3 +90,6 @@ typedef enum {
 
 void report_als_samples(als_backroundsample_reportformat_t format);
 
+int als_get_last_reading(void); // latest reading from the primary/secondary cycle (-1 before the first one)
+uint32_t als_get_dropped_events(void);  // timer events lost to a full event queue since boot
+
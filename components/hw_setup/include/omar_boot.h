@@ -0,0 +1,24 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_boot.h - runs the omar_setup() stages in parallel, in dependency order
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "boot_graph.h"
+
+#define OMAR_BOOT_HELPER_STACK_SIZE (4096)
+
+/*
+ * The calling task works through the stages on its own core and a
+ * helper task does the same on the other one. The call returns as
+ * soon as the 'ready_mask' stages are done; the helper finishes
+ * whatever's left in the background. Workers are numbered by core,
+ * so a stage's 'workers' are BOOT_WORKER_BIT(core)s. Since the caller
+ * may leave early, only keep stages to the helper's core.
+ */
+void omar_boot_run(const boot_stage_t *stages, uint32_t count, uint32_t ready_mask);
+
+bool omar_boot_done(void);
+void omar_boot_report(bool timing);     // when, and with 'timing', how long each stage took and the critical path
@@ -0,0 +1,29 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_energy_log.h - logs energy, voltage peak and temperature to
+ * flash every CONFIG_ENERGY_LOG_PERIOD_S
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "energy_log.h"
+
+/*
+ * Record times are the system clock's seconds once something has
+ * set it (it reads before OMAR_ENERGY_LOG_CLOCK_SET until then).
+ * Before that they carry on from the newest record in the log, so
+ * they never go backwards across a reset, though the time the board
+ * was off doesn't show.
+ */
+#define OMAR_ENERGY_LOG_CLOCK_SET   (1546300800)    // 2019-01-01
+
+esp_err_t omar_energy_log_start(const char *path);
+
+// As energy_log_query(); 'fn' runs with the log locked, so it shouldn't dawdle:
+uint32_t omar_energy_log_query(uint32_t from, uint32_t to, energy_log_fn_t fn, void *arg);
+
+// False if the log isn't running:
+bool omar_energy_log_get_summary(energy_log_summary_t *summary, energy_log_stats_t *stats);
+esp_err_t omar_energy_log_flush(void);
@@ -0,0 +1,40 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_led.h - led service task; the only code that touches the ledc
+ * channels driving OMAR_WHITE_LED0 and OMAR_WHITE_LED1
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "omar_led_curve.h"
+
+/*
+ * All of these queue a command for the led service and return
+ * straight away, so they're safe to call from any task (but not
+ * from an isr). Commands are applied in the order they were
+ * queued. The led is specified by the associated gpio (so either
+ * OMAR_WHITE_LED0 or OMAR_WHITE_LED1).
+ */
+void led_setup(void);
+void led_set_brightness(uint8_t led, uint32_t duty);
+void led_fade_brightness(uint8_t led, uint32_t duty, uint32_t fade_msec);  // uses the ledc fade engine
+void led_set_level(uint8_t led, uint32_t level, uint32_t fade_msec);        // perceptual level, 0..OMAR_LED_LEVEL_MAX
+void led_blink(uint8_t led, uint32_t duty, uint32_t on_msec, uint32_t off_msec, uint32_t count);  // count 0: until the next set/fade
+void led_set_duty_limit(uint32_t limit);    // cap both leds, e.g. for thermal derating
+
+// The brightness most recently applied by the led service (not counting derating or blinking):
+uint32_t led_get_brightness(uint8_t led);   // as a duty cycle, 0..OMAR_LED_MAX_DUTY
+uint32_t led_get_level(uint8_t led);        // as a perceptual level, 0..OMAR_LED_LEVEL_MAX
+
+/*
+ * The ambient light sensor needs the leds dark while it samples.
+ * led_als_pause() waits until both leds are off and returns true,
+ * or returns false straight away if a fade is in progress (the
+ * ledc fade engine can't be interrupted), in which case the
+ * sample should be skipped. Every successful pause must be
+ * followed by led_als_resume().
+ */
+bool led_als_pause(void);
+void led_als_resume(void);
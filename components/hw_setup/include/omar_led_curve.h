@@ -0,0 +1,26 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_led_curve.h - perceptual (CIE 1931 lightness) brightness curve for
+ * the 13-bit led pwm
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Perceptual brightness levels run from 0 (off) to OMAR_LED_LEVEL_MAX
+ * (full on), evenly spaced in lightness (L*) rather than in duty cycle.
+ */
+#define OMAR_LED_LEVEL_MAX          (1000)
+
+/*
+ * Duty cycles coming out of the curve are in eighths of a pwm count
+ * ("Q3"), 0 .. OMAR_LED_MAX_DUTY*8; the bottom of the curve needs
+ * the extra resolution.
+ */
+#define OMAR_LED_DUTY_Q3_SHIFT      (3)
+#define OMAR_LED_MAX_DUTY_Q3        (OMAR_LED_MAX_DUTY << OMAR_LED_DUTY_Q3_SHIFT)
+
+uint32_t led_level_to_duty_q3(uint32_t level);
+uint32_t led_duty_q3_to_level(uint32_t duty_q3);   // the lowest level with at least this duty
@@ -0,0 +1,42 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_postmortem.h - what the last run left in rtc memory: the
+ * energy totals, the relays and its last few trace events
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "adi_spi.h"
+#include "omar_relay.h"
+#include "postmortem.h"
+
+/*
+ * The region is RTC_NOINIT, so it comes through a panic, the task
+ * watchdog's abort(), a software reset or a brownout (as long as the
+ * rtc domain held up), but not a power cycle. Trace events go into it
+ * as well as the ordinary trace rings, from omar_postmortem_init() on.
+ */
+typedef struct {
+    bool survived;              // false after a power cycle (or a new layout)
+    uint32_t resets;            // the region has come through
+    int reset_reason[portNUM_PROCESSORS];   // RESET_REASON, from rom/rtc.h
+    bool have_state;
+    postmortem_state_t state;   // the last run's, as it was when last saved
+    uint32_t trace_count[POSTMORTEM_CORES];
+    uint32_t trace_bad[POSTMORTEM_CORES];
+    trace_record_t trace[POSTMORTEM_CORES][POSTMORTEM_TRACE_SLOTS];
+} omar_postmortem_t;
+
+// Call before anything traces, so the last run's events are still there:
+void omar_postmortem_init(void);
+
+// The last run's energy totals, if it left any; false after a power cycle:
+bool omar_postmortem_restore_energy(adi_energy_t *energy);
+
+void omar_postmortem_save_energy(const adi_energy_t *energy);
+void omar_postmortem_save_relay(omar_relay_t relay, bool closed);
+
+const omar_postmortem_t *omar_postmortem_get(void);
+const char *omar_postmortem_reset_name(int reason);
@@ -0,0 +1,73 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_power.h - automatic light sleep, and the pm locks that keep the
+ * chip out of it while something needs the clocks
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "power_sched.h"
+
+/*
+ * With CONFIG_PM_ENABLE and tickless idle the chip drops to the
+ * minimum cpu frequency whenever nothing holds it up, and into light
+ * sleep whenever every task is blocked for a few ticks. It wakes for
+ * the next task timeout or esp_timer alarm (the als cycle, the relay
+ * pulses, debounce deadlines), an edge on a switch or plug detect
+ * input, or a character on the console uart.
+ *
+ * A hold keeps the apb clock at full speed, and so the chip awake,
+ * for the peripherals that run off it and stop in light sleep: the
+ * ledc pwm while a led is lit, and the timer group while an als
+ * reading is being taken. A deadline source is a timer that can't
+ * wait out a wake; see power_sched.h.
+ */
+typedef enum {
+    OMAR_POWER_LEDS,            // a led is lit, fading or blinking
+    OMAR_POWER_ALS,             // an als reading or capture is under way
+    OMAR_POWER_CONSOLE,         // the console's been used lately
+
+    OMAR_POWER_HOLD_COUNT
+} omar_power_hold_t;
+
+typedef enum {
+    OMAR_WAKE_ALS,              // the als cycle
+    OMAR_WAKE_RELAY1,           // a coil pulse starting or ending
+    OMAR_WAKE_RELAY2,
+
+    OMAR_WAKE_COUNT
+} omar_wake_t;
+
+typedef struct {
+    uint32_t count;             // times taken
+    uint64_t held_us;           // in all, including now if it's held
+    bool held;
+} omar_power_hold_stats_t;
+
+typedef struct {
+    bool light_sleep;           // automatic light sleep is on
+    uint32_t wake_us;
+    omar_power_hold_stats_t holds[OMAR_POWER_HOLD_COUNT];
+    power_sched_stats_t wakes[OMAR_WAKE_COUNT];
+    uint32_t uart_wakes;
+} omar_power_status_t;
+
+// Holds taken before this are applied once it's run:
+esp_err_t omar_power_init(void);
+
+// These can all be called from a critical section or an esp_timer callback:
+void omar_power_hold(omar_power_hold_t hold, bool on);
+void omar_power_hold_for(omar_power_hold_t hold, uint32_t msec);
+
+void omar_power_arm(omar_wake_t source, int64_t deadline_us);
+void omar_power_done(omar_wake_t source);
+void omar_power_disarm(omar_wake_t source);
+
+// Puts the wake sources back after something (the 'light_sleep' command) has cleared them:
+void omar_power_restore_wakeups(void);
+
+void omar_power_get_status(omar_power_status_t *status);
+const char *omar_power_hold_name(omar_power_hold_t hold);
+const char *omar_power_wake_name(omar_wake_t source);
@@ -0,0 +1,45 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_relay.h - non-blocking latching relay driver with optional
+ * zero-cross synchronized switching
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * How long a coil is energized for; 10 milliseconds is all it takes
+ * to flip the latch.
+ */
+#define OMAR_RELAY_PULSE_USEC           (10000)
+
+/*
+ * With ADE7953_ZX_SUPPORT (see hw_setup.h) the contacts are timed to
+ * land OMAR_RELAY_ZX_OFFSET_USEC after a mains zero crossing, assuming
+ * they move OMAR_RELAY_CONTACT_DELAY_USEC after the coil is energized.
+ * That's the relay's nominal operate time; nothing on the board sees
+ * the contacts move, so it isn't measured.
+ */
+#define OMAR_RELAY_ZX_OFFSET_USEC       (0)
+#define OMAR_RELAY_CONTACT_DELAY_USEC   (4000)
+
+// Omar relays, in terms of the coils that drive them:
+typedef enum {
+    OMAR_RELAY_1 = 0,   // OMAR_COIL_1_SET_GPIO/OMAR_COIL_1_RESET_GPIO
+    OMAR_RELAY_2,       // OMAR_COIL_2_SET_GPIO/OMAR_COIL_2_RESET_GPIO
+    OMAR_RELAY_COUNT
+} omar_relay_t;
+
+typedef struct {
+    bool closed;                // state after the last completed pulse
+    uint32_t pulses;
+    int32_t zx_half_period_usec;    // 0 if there's no zero-cross signal
+} omar_relay_info_t;
+
+void relay_setup(void);
+void relay_set(omar_relay_t relay, bool closed);    // returns straight away; the pulse runs from a timer
+bool relay_get(omar_relay_t relay);
+void relay_inhibit(bool inhibit);
+void relay_get_info(omar_relay_t relay, omar_relay_info_t *info);
@@ -0,0 +1,28 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_sample.h - reads the meter, als and temperature channels for
+ * the stream and telemetry
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "stream_record.h"
+
+/*
+ * The energy channels report the energy since the reader's previous
+ * sample, so each reader keeps its own context (see adi_read_energy()).
+ * The als and temperature channels are the latest readings their own
+ * tasks have taken, so sampling never adds an als cycle or an i2c
+ * transaction.
+ */
+typedef struct {
+    int64_t aenergy;
+    int64_t benergy;
+    bool primed;                // false until the first energy read
+} omar_sample_ctx_t;
+
+void omar_sample_reset(omar_sample_ctx_t *ctx);
+
+// 'values' is indexed by stream_channel_t; channels outside 'mask' are left alone:
+void omar_sample_read(omar_sample_ctx_t *ctx, uint32_t mask, int32_t *values);
@@ -0,0 +1,24 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_stream.h - periodic meter, als and temperature records for the
+ * 'stream' console command
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "stream_record.h"
+
+#define OMAR_STREAM_MAX_HZ          (100)
+
+/*
+ * Records are read with omar_sample_read(), so each energy value is
+ * the energy since the record before (zero in the first one).
+ */
+typedef struct {
+    uint32_t records;           // records printed
+    uint32_t missed;            // sample periods that went by without one
+} omar_stream_stats_t;
+
+bool omar_stream_start(uint32_t hz, uint32_t mask);    // prints a header line, then records until omar_stream_stop()
+void omar_stream_stop(omar_stream_stats_t *stats);
@@ -0,0 +1,101 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_tasks.h - which core each of our tasks runs on, at what
+ * priority and with how much stack, and a monitor that keeps an
+ * eye on them
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_intr_alloc.h"
+#include "task_load.h"
+
+/*
+ * Metering, the als and the leds (the als blanks them) get the app
+ * cpu; wifi, the console, the i2c bus and anything that writes flash
+ * stay on the pro cpu with the IDF's own tasks (telemetry does both). Interrupts go to
+ * whichever core allocates them, so the boot table in hw_setup.c
+ * runs the adi, relay, button and timer stages on the app cpu too.
+ */
+#if CONFIG_FREERTOS_UNICORE
+#define OMAR_PRO_CPU                (0)
+#define OMAR_APP_CPU                (0)
+#else
+#define OMAR_PRO_CPU                (0)
+#define OMAR_APP_CPU                (1)
+#endif
+
+/*
+ * The gpio isr service's handlers (relay zero crossing, inputs,
+ * thermal event) are all IRAM_ATTR and stay out of flash, so they
+ * keep running while the other core writes it.
+ */
+#define OMAR_GPIO_ISR_FLAGS         (ESP_INTR_FLAG_IRAM)
+
+/*
+ *  id             name              core          prio  stack
+ */
+#define OMAR_TASKS(X) \
+    X(ALS,         "timer_evt_task", OMAR_APP_CPU, 5,    2048) \
+    X(LED,         "led_task",       OMAR_APP_CPU, 6,    2048) \
+    X(INPUT,       "input_task",     OMAR_APP_CPU, 5,    2048) \
+    X(STREAM,      "stream_task",    OMAR_APP_CPU, 4,    3072) \
+    X(I2C_BUS,     "i2c_bus_task",   OMAR_PRO_CPU, 10,   2048) \
+    X(THERMAL,     "thermal_task",   OMAR_PRO_CPU, 6,    2048) \
+    X(TELEMETRY,   "telemetry",      OMAR_PRO_CPU, 3,    4096) \
+    X(CONSOLE_OUT, "console_out",    OMAR_PRO_CPU, 2,    2048) \
+    X(HISTORY,     "history_task",   OMAR_PRO_CPU, 1,    3072) \
+    X(ENERGY_LOG,  "energy_log",     OMAR_PRO_CPU, 1,    4096) \
+    X(TASK_MON,    "task_mon",       OMAR_PRO_CPU, 1,    3072)
+
+#define OMAR_TASK_ENUM(id, name, core, prio, stack)     OMAR_TASK_##id,
+
+typedef enum {
+    OMAR_TASKS(OMAR_TASK_ENUM)
+    OMAR_TASK_COUNT
+} omar_task_id_t;
+
+// Create the task as the table says (on 'core' rather than the table's core for the second); ESP_ERR_NO_MEM if it couldn't be:
+esp_err_t omar_task_create(omar_task_id_t id, TaskFunction_t fn, void *arg, TaskHandle_t *handle);
+esp_err_t omar_task_create_on(omar_task_id_t id, int core, TaskFunction_t fn, void *arg, TaskHandle_t *handle);
+
+int omar_task_core(omar_task_id_t id);
+
+/*
+ * A lock shared between the cores. omar_task_take_recursive() counts
+ * the takes that had to wait, and the ones that waited on a holder
+ * pinned to the other core (each of those is traced too); the task
+ * monitor complains when the second count goes up. The counts can
+ * miss the odd wait if both cores wait at once.
+ */
+typedef struct {
+    const char *name;
+    volatile uint32_t waits;
+    volatile uint32_t cross_core;
+    uint32_t warned;            // cross_core when the monitor last complained
+    uint8_t id;
+} omar_lock_stats_t;
+
+#define OMAR_TASK_MAX_LOCKS         (4)
+
+void omar_task_watch_lock(omar_lock_stats_t *stats);
+void omar_task_take_recursive(SemaphoreHandle_t lock, omar_lock_stats_t *stats);
+const omar_lock_stats_t *omar_task_get_lock(uint32_t index);   // NULL past the last one
+
+/*
+ * The monitor samples every task's run time counter and stack high
+ * water mark every OMAR_TASK_MON_PERIOD_MS, and warns when one of the
+ * tasks above turns up on a core it isn't meant to be on. Per-task
+ * cpu shares need CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+ */
+#define OMAR_TASK_MON_PERIOD_MS     (5000)
+
+esp_err_t omar_task_mon_start(void);
+
+// Copies the last sample; 'busy' gets each core's share (tenths of a percent) of the last window:
+bool omar_task_mon_get(task_load_t *load, uint16_t busy[portNUM_PROCESSORS]);
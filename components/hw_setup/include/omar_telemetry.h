@@ -0,0 +1,33 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_telemetry.h - publishes meter, als and temperature samples to
+ * a collector on the network
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "telem_pub.h"
+
+#define OMAR_TELEMETRY_MAX_HZ       (10)
+#define OMAR_TELEMETRY_POLL_MS      (100)
+#define OMAR_TELEMETRY_BATCH_MS     (10000)     // longest a sample waits to go out
+
+typedef struct {
+    bool running;
+    telem_pub_config_t cfg;
+    uint32_t hz;
+    uint32_t uptime_ms;         // from omar_telemetry_start() to now, or to the stop
+    uint32_t queued;            // bytes waiting in ram
+    uint32_t spill_pending;     // ... and in the spill file
+    telem_pub_stats_t stats;
+} omar_telemetry_status_t;
+
+// 'spill_path' is where frames go while the collector can't take them (NULL for nowhere):
+void omar_telemetry_init(const char *spill_path);
+
+// Only cfg->host, port, tcp and mask are used; false if they're no good or it's already running:
+bool omar_telemetry_start(const telem_pub_config_t *cfg, uint32_t hz);
+void omar_telemetry_stop(void);     // unsent frames go to the spill file, for next time
+
+void omar_telemetry_get_status(omar_telemetry_status_t *status);
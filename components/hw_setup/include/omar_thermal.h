@@ -0,0 +1,45 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_thermal.h - thermal supervisor: reduced-rate polling of the S-5852A
+ * with its hardware limits programmed
+ *
+ */
+#pragma once
+
+#include <stdbool.h>
+#include "temp_history.h"
+
+/*
+ * Limits programmed into the S-5852A. Above OMAR_THERMAL_UPPER_C
+ * the leds are derated to OMAR_THERMAL_DERATED_DUTY; at or above
+ * OMAR_THERMAL_CRITICAL_C the leds are turned off and both relays
+ * are opened, and they stay that way until the temperature falls
+ * back below OMAR_THERMAL_UPPER_C (less the sensor's 1.5C
+ * hysteresis).
+ */
+#define OMAR_THERMAL_LOWER_C            (-20.0)
+#define OMAR_THERMAL_UPPER_C            (70.0)
+#define OMAR_THERMAL_CRITICAL_C         (85.0)
+#define OMAR_THERMAL_DERATED_DUTY       (OMAR_LED_MAX_DUTY/2)
+
+/*
+ * The supervisor reads the sensor this often to fill in the
+ * temperature history (see temp_history.h), and that's also when
+ * limit crossings are noticed: it can be up to this late to derate
+ * or trip. The EVENT line would wake it in between (see
+ * S5852A_EVENT_SUPPORT in hw_setup.h), but it isn't wired on any
+ * board yet.
+ */
+#define OMAR_THERMAL_SAMPLE_INTERVAL_MS (10000)
+
+typedef enum {
+    THERMAL_STATE_NORMAL = 0,
+    THERMAL_STATE_COLD,         // below OMAR_THERMAL_LOWER_C, reported only
+    THERMAL_STATE_DERATED,      // above OMAR_THERMAL_UPPER_C
+    THERMAL_STATE_CRITICAL,     // tripped at OMAR_THERMAL_CRITICAL_C
+} thermal_state_t;
+
+void thermal_setup(void);       // program the sensor limits and start the supervisor task
+thermal_state_t thermal_get_state(float *temperature);  // last state and reading seen by the supervisor
+const char *thermal_state_name(thermal_state_t state);
+bool thermal_get_history(temp_history_t *history);      // copy out the temperature history
@@ -0,0 +1,16 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_thermal_policy.h - what the thermal supervisor makes of the
+ * S-5852A's limit flags, and what it does about it
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include "omar_thermal.h"
+
+// The state the supervisor should be in, given the one it's in and the sensor's S5852A_ALARM_* flags:
+thermal_state_t thermal_classify(thermal_state_t current, uint8_t alarms);
+
+// Derates or turns off the leds and inhibits the relays to suit 'state', or lifts all that again:
+void thermal_apply(thermal_state_t state);
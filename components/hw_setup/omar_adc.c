@@ -0,0 +1,139 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_adc.c - the als and hw detect adc inputs, characterized once at
+ * boot, with a table-driven raw-to-millivolt conversion
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "driver/adc.h"
+#include "esp_adc_cal.h"
+
+#include "hw_setup.h"
+#include "adc_lut.h"
+#include "omar_adc.h"
+
+// Only used when the efuse has neither a vref nor two point values; adc2_vref_to_gpio() gives a better one
+#define DEFAULT_VREF    1100
+
+typedef struct {
+    const char *name;
+    adc1_channel_t channel;
+    adc_atten_t atten;
+} omar_adc_input_t;
+
+static const omar_adc_input_t m_inputs[OMAR_ADC_COUNT] = {
+    [OMAR_ADC_ALS]      = { "als",      VOUT_LGHT_SNSR__ADC_CHANNEL,    ADC_ATTEN_DB_11 },
+    [OMAR_ADC_HW_DET]   = { "hw_det",   HW_DET__ADC_CHANNEL,            ADC_ATTEN_DB_0 },
+};
+
+static bool m_ready = false;
+static esp_adc_cal_characteristics_t m_chars[OMAR_ADC_COUNT];
+static esp_adc_cal_value_t m_cal_type[OMAR_ADC_COUNT];
+static adc_lut_t m_luts[OMAR_ADC_COUNT];
+
+static uint32_t adc_cal_ref(uint32_t raw, void *arg)
+{
+    return esp_adc_cal_raw_to_voltage(raw, (const esp_adc_cal_characteristics_t *) arg);
+}
+
+esp_err_t omar_adc_init(void)
+{
+    esp_err_t ret = adc1_config_width(ADC_WIDTH_BIT_12);
+
+    for (int i = 0; i < OMAR_ADC_COUNT && ret == ESP_OK; i++) {
+        ret = adc1_config_channel_atten(m_inputs[i].channel, m_inputs[i].atten);
+        if (ret == ESP_OK) {
+            m_cal_type[i] = esp_adc_cal_characterize(ADC_UNIT_1, m_inputs[i].atten, ADC_WIDTH_BIT_12,
+                                                     DEFAULT_VREF, &m_chars[i]);
+            adc_lut_build(&m_luts[i], adc_cal_ref, &m_chars[i]);
+        }
+    }
+
+    if (ret != ESP_OK) {
+        printf("%s(): adc1 setup failed (%d)\n", __func__, ret);
+        return ret;
+    }
+
+    m_ready = true;
+    return ESP_OK;
+}
+
+esp_err_t omar_adc_read(omar_adc_t channel, uint32_t samples, omar_adc_reading_t *reading)
+{
+    if (!m_ready || channel >= OMAR_ADC_COUNT || samples == 0 || samples > OMAR_ADC_SAMPLES_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t raw_sum = 0;
+    uint32_t mv_sum = 0;
+
+    reading->raw_min = UINT32_MAX;
+    reading->raw_max = 0;
+
+    for (uint32_t i = 0; i < samples; i++) {
+        int code = adc1_get_raw(m_inputs[channel].channel);
+
+        if (code < 0) {
+            return ESP_FAIL;
+        }
+
+        uint32_t raw = code;
+
+        raw_sum += raw;
+        mv_sum += adc_lut_mv(&m_luts[channel], raw);
+        if (raw < reading->raw_min) {
+            reading->raw_min = raw;
+        }
+        if (raw > reading->raw_max) {
+            reading->raw_max = raw;
+        }
+    }
+
+    reading->samples = samples;
+    reading->raw = (raw_sum + samples / 2) / samples;
+    reading->mv = (mv_sum + samples / 2) / samples;
+
+    return ESP_OK;
+}
+
+uint32_t IRAM_ATTR omar_adc_raw_to_mv(omar_adc_t channel, uint32_t raw)
+{
+    return (channel < OMAR_ADC_COUNT ? adc_lut_mv(&m_luts[channel], raw) : 0);
+}
+
+uint32_t omar_adc_check(omar_adc_t channel, uint32_t *worst_raw)
+{
+    *worst_raw = 0;
+    if (!m_ready || channel >= OMAR_ADC_COUNT) {
+        return 0;
+    }
+
+    return adc_lut_check(&m_luts[channel], adc_cal_ref, &m_chars[channel], worst_raw);
+}
+
+const char *omar_adc_name(omar_adc_t channel)
+{
+    return (channel < OMAR_ADC_COUNT ? m_inputs[channel].name : "?");
+}
+
+const char *omar_adc_cal_name(omar_adc_t channel)
+{
+    if (!m_ready || channel >= OMAR_ADC_COUNT) {
+        return "not characterized";
+    }
+
+    switch (m_cal_type[channel]) {
+    case ESP_ADC_CAL_VAL_EFUSE_TP:
+        return "two point";
+    case ESP_ADC_CAL_VAL_EFUSE_VREF:
+        return "efuse vref";
+    default:
+        return "default vref";
+    }
+}
@@ -1,6 +1,6 @@
 /* Copyright (c) 2019 Currant Inc. All Rights Reserved.
  *
- * omar_als_timer.c - sets up a timer which fires once a second, turns off the leds briefly
+ * omar_als_timer.c - every couple of seconds, turns off the leds briefly
  * and then takes a reading with the ambient light sensor.
  *
  */
@@ -13,6 +13,7 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "esp_task_wdt.h"
+#include "esp_timer.h"
 #include "driver/ledc.h"
 #include "soc/timer_group_struct.h"
 #include "driver/periph_ctrl.h"
@@ -20,12 +21,14 @@
 #include "esp_err.h"
 #include "hw_setup.h"
 #include "omar_als_timer.h"
+#include "omar_led.h"
+#include "trace.h"
+#include "omar_tasks.h"
+#include "omar_power.h"
 
 // Enable OMAR_ALS_TIMER_VERBOSE to see lots of debug spew
 //#define OMAR_ALS_TIMER_VERBOSE
 
-static void pause_led_pwm(void);
-static void resume_led_pwm(void);
 static void timer_example_evt_task(void *arg);
 static void hexdump_als_samples(void);
 
@@ -33,6 +36,12 @@ static void hexdump_als_samples(void);
 #define TIMER_SCALE           (TIMER_BASE_CLK / TIMER_DIVIDER)  // convert counter value to seconds
 #define AUTO_RELOAD_ON        1 // testing will be done with auto reload
 #define AUTO_RELOAD_OFF       0 // no auto reload
+
+// enable_als_timer() changed m_als_on; the event task picks it up:
+#define ALS_EVENT_ENABLE      44
+
+// While the als cycle's on, the event task wakes at least this often for the watchdog:
+#define ALS_WDT_MSEC          (CONFIG_TASK_WDT_TIMEOUT_S * 1000 / 2)
 /*
  * A sample structure to pass events
  * from the timer interrupt handler to the main program.
@@ -57,6 +66,37 @@ static bool als_sample_mode = false;
 static uint32_t als_sample_count = 0;
 static int als_sample_array[ALS_SAMPLE_COUNT] = {-1};
 
+// The most recent reading from the primary/secondary cycle, for the likes of 'stream':
+static volatile int m_last_als_reading = -1;
+
+static volatile bool m_als_on = false;
+
+/*
+ * Events the isr couldn't queue because the event task had fallen
+ * ten behind. A capture only sends one every ALS_SAMPLE_PROGRESS
+ * samples (and then the one that says it's finished), rather than
+ * one per sample, so it can't fill the queue by itself.
+ */
+#define ALS_SAMPLE_PROGRESS   (1000)
+static volatile uint32_t m_als_dropped = 0;
+
+uint32_t als_get_dropped_events(void)
+{
+    return m_als_dropped;
+}
+
+static void IRAM_ATTR als_queue_from_isr(const timer_event_t *evt)
+{
+    if (xQueueSendFromISR(timer_queue, evt, NULL) != pdTRUE) {
+        m_als_dropped++;
+    }
+}
+
+int als_get_last_reading(void)
+{
+    return m_last_als_reading;
+}
+
 void set_als_timer_period(als_timer_t timer, double period)
 {
 
@@ -139,7 +179,7 @@ static void inline print_timer_counter(uint64_t counter_value)
  */
 void IRAM_ATTR timer_group0_isr(void *para)
 {
-    int timer_idx = (int) para;
+    int timer_idx = (int)(intptr_t) para;
 
     /* Retrieve the interrupt status and the counter value
        from the timer that reported the interrupt */
@@ -157,24 +197,10 @@ void IRAM_ATTR timer_group0_isr(void *para)
     evt.timer_counter_value = timer_counter_value;
 
     /* Clear the interrupt
-       and update the alarm time for the timer with without reload */
-    if ((intr_status & BIT(timer_idx)) && timer_idx == OMAR_ALS_PRIMARY_TIMER) {
-
-        evt.type = timer_idx;
-        TIMERG0.int_clr_timers.t0 = 1;
-
-        /* After the alarm has been triggered
-           we need enable it again, so it is triggered the next time */
-        TIMERG0.hw_timer[timer_idx].config.alarm_en = TIMER_ALARM_EN;
-
-        evt.als_reading = -1; // Flag to show we didn't read the adc here
-
-        /* Now just send the event data back to the main program task */
-
-        xQueueSendFromISR(timer_queue, &evt, NULL);
-
-
-    } else if ((intr_status & BIT(timer_idx)) && timer_idx == OMAR_ALS_SECONDARY_TIMER) {
+       and update the alarm time for the timer with without reload.
+       The primary "timer" is the event task's timeout (see
+       timer_example_evt_task()), so only the secondary lands here */
+    if ((intr_status & BIT(timer_idx)) && timer_idx == OMAR_ALS_SECONDARY_TIMER) {
 
         if (als_sample_mode) {
             
@@ -183,10 +209,11 @@ void IRAM_ATTR timer_group0_isr(void *para)
 
                 // Re-enable the alarm since we've still got samples to take
                 TIMERG0.hw_timer[timer_idx].config.alarm_en = TIMER_ALARM_EN;
-                evt.type = 43;
 
-
-                xQueueSendFromISR(timer_queue, &evt, NULL);
+                if (als_sample_count % ALS_SAMPLE_PROGRESS == 0) {
+                    evt.type = 43;
+                    als_queue_from_isr(&evt);
+                }
 
             } else {
                 // Disable the sampling:
@@ -196,7 +223,7 @@ void IRAM_ATTR timer_group0_isr(void *para)
                 evt.type = 42;
 
 
-                xQueueSendFromISR(timer_queue, &evt, NULL);
+                als_queue_from_isr(&evt);
 
             }
 
@@ -213,7 +240,7 @@ void IRAM_ATTR timer_group0_isr(void *para)
                enable it again here */
 
 
-            xQueueSendFromISR(timer_queue, &evt, NULL);
+            als_queue_from_isr(&evt);
 
         }
 
@@ -225,6 +252,13 @@ void IRAM_ATTR timer_group0_isr(void *para)
 
 }
 
+/*
+ * Each timer's isr is registered just once: every registration
+ * allocates another interrupt, on whichever core makes it, and
+ * timer_setup() makes both from the app cpu.
+ */
+static intr_handle_t m_timer_isr[TIMER_MAX];
+
 /*
  * Initialize selected timer of the timer group 0
  *
@@ -261,8 +295,10 @@ static void omar_als_timer_init(int timer_idx,
     /* Configure the alarm value and the interrupt on alarm. */
     timer_set_alarm_value(OMAR_ALS_TIMER_GROUP, timer_idx, timer_interval_sec * TIMER_SCALE);
     timer_enable_intr(OMAR_ALS_TIMER_GROUP, timer_idx);
-    timer_isr_register(OMAR_ALS_TIMER_GROUP, timer_idx, timer_group0_isr, 
-        (void *) timer_idx, ESP_INTR_FLAG_IRAM, NULL);
+    if (m_timer_isr[timer_idx] == NULL) {
+        timer_isr_register(OMAR_ALS_TIMER_GROUP, timer_idx, timer_group0_isr, 
+            (void *)(intptr_t) timer_idx, ESP_INTR_FLAG_IRAM, &m_timer_isr[timer_idx]);
+    }
 
 }
 
@@ -286,6 +322,9 @@ void start_als_sample_capture(void)
     als_sample_mode = true;
     als_sample_count = 0;
 
+    // The timer group stops in light sleep:
+    omar_power_hold(OMAR_POWER_ALS, true);
+
     // Start the timer!
     omar_als_timer_init(OMAR_ALS_SECONDARY_TIMER, 
                         AUTO_RELOAD_ON, 
@@ -332,63 +371,94 @@ void report_als_samples(als_backroundsample_reportformat_t format)
 
 void enable_als_timer(bool on)
 {
-    if (on) {
-        timer_start(OMAR_ALS_TIMER_GROUP, OMAR_ALS_PRIMARY_TIMER);
-    } else {
-        timer_pause(OMAR_ALS_TIMER_GROUP, OMAR_ALS_PRIMARY_TIMER);
-    }
+    timer_event_t evt = {
+        .type = ALS_EVENT_ENABLE,
+    };
+
+    m_als_on = on;
+    xQueueSend(timer_queue, &evt, 0);
 }
 
 void timer_setup(void)
 {
     timer_queue = xQueueCreate(10, sizeof(timer_event_t));
-    omar_als_timer_init(OMAR_ALS_PRIMARY_TIMER, AUTO_RELOAD_ON, get_als_timer_period(PRIMARY_TIMER));
-    xTaskCreate(timer_example_evt_task, "timer_evt_task", 2048, NULL, 5, NULL);
-}
-
-typedef struct {
-    uint32_t led0_dutycycle;
-    uint32_t led1_dutycycle;
-} led_dutycycle_state_t;
-    
-static led_dutycycle_state_t led_state = {0, 0};
+    // Not started, just here so its isr lands on this core:
+    omar_als_timer_init(OMAR_ALS_SECONDARY_TIMER, AUTO_RELOAD_OFF, get_als_timer_period(SECONDARY_TIMER));
 
-static void pause_led_pwm(void)
-{
-    led_state.led0_dutycycle = led_get_brightness(OMAR_WHITE_LED0);
-    led_state.led1_dutycycle = led_get_brightness(OMAR_WHITE_LED1);
-
-    led_set_brightness(OMAR_WHITE_LED0, 0);
-    led_set_brightness(OMAR_WHITE_LED1, 0);
+    if (omar_task_create(OMAR_TASK_ALS, timer_example_evt_task, NULL, NULL) != ESP_OK) {
+        printf("%s(): omar_task_create() failed, no als readings\n", __func__);
+    }
 }
 
-static void resume_led_pwm(void)
+static int64_t als_primary_period_usec(void)
 {
-    led_set_brightness(OMAR_WHITE_LED0, led_state.led0_dutycycle);
-    led_set_brightness(OMAR_WHITE_LED1, led_state.led1_dutycycle);
+    int64_t period = (int64_t)(get_als_timer_period(PRIMARY_TIMER) * 1000000.0);
+
+    // Any shorter and we'd spin:
+    return (period < portTICK_PERIOD_MS * 1000 ? portTICK_PERIOD_MS * 1000 : period);
 }
 
+/*
+ * The primary cycle is paced by this task's own timeout rather than
+ * by a timer group timer, which would stop in light sleep; a task
+ * timeout is something tickless idle wakes us for. While the cycle's
+ * on we're on the task watchdog, and wake for it at least every
+ * ALS_WDT_MSEC; while it's off we block until there's an event, and
+ * leave the watchdog out of it.
+ */
 static void timer_example_evt_task(void *arg)
 {
-
-    uint32_t block_time_msec = 250; // block a quarter second so you can pet the watchdog
-	static uint32_t als_samples_sofar = 0;
-
-    // Subscribe this task to the TWDT, check to make sure it's subscribed:
-    CHECK_ERROR_CODE(esp_task_wdt_add(NULL), ESP_OK);
-    CHECK_ERROR_CODE(esp_task_wdt_status(NULL), ESP_OK);
+    bool watched = false;
+    int64_t next_primary = 0;
 
     while (1) {
         timer_event_t evt;
         bool gotQueueEvent;
+        TickType_t wait = portMAX_DELAY;
+
+        if (m_als_on != watched) {
+            watched = m_als_on;
+            if (watched) {
+                CHECK_ERROR_CODE(esp_task_wdt_add(NULL), ESP_OK);
+                next_primary = esp_timer_get_time() + als_primary_period_usec();
+                omar_power_arm(OMAR_WAKE_ALS, next_primary);
+            } else {
+                CHECK_ERROR_CODE(esp_task_wdt_delete(NULL), ESP_OK);
+                omar_power_disarm(OMAR_WAKE_ALS);
+            }
+        }
 
-        gotQueueEvent = xQueueReceive(timer_queue, &evt, block_time_msec / portTICK_PERIOD_MS);
+        if (watched) {
+            int64_t remaining = next_primary - esp_timer_get_time();
+            // Round up so we never wake a tick early and go straight back to sleep:
+            TickType_t ticks = 
+                (remaining <= 0 ? 0 : (remaining + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000));
+            wait = (ticks < ALS_WDT_MSEC / portTICK_PERIOD_MS ? ticks : ALS_WDT_MSEC / portTICK_PERIOD_MS);
+        }
+
+        gotQueueEvent = xQueueReceive(timer_queue, &evt, wait);
 
-        CHECK_ERROR_CODE(esp_task_wdt_reset(), ESP_OK);  // Pet the watchdog each time through
+        if (watched) {
+            CHECK_ERROR_CODE(esp_task_wdt_reset(), ESP_OK);
+        }
 
         if (!gotQueueEvent) {
-            // Timed out waiting for an event, nothing on the queue:
-            continue;
+            int64_t now = esp_timer_get_time();
+
+            // Timed out for the watchdog, or the cycle's been turned off:
+            if (!watched || now < next_primary) {
+                continue;
+            }
+
+            omar_power_done(OMAR_WAKE_ALS);
+            next_primary += als_primary_period_usec();
+            if (next_primary <= now) {
+                // We fell behind (the period got shorter, say); don't try to catch up:
+                next_primary = now + als_primary_period_usec();
+            }
+            omar_power_arm(OMAR_WAKE_ALS, next_primary);
+
+            evt.type = OMAR_ALS_PRIMARY_TIMER;
         }
 
         /* Print information that the timer reported an event */
@@ -397,11 +467,17 @@ static void timer_example_evt_task(void *arg)
              * to read the als adc after a short delay of
              * OMAR_ALS_SECONDARY_INTERVAL:
              */
-            pause_led_pwm();
+            if (!led_als_pause()) {
+                // An led is mid-fade and can't be turned off; skip this sample:
+                TRACE0(TRACE_ALS_SKIPPED);
+                continue;
+            }
 
+            // The timer group stops in light sleep:
+            omar_power_hold(OMAR_POWER_ALS, true);
             omar_als_timer_init(OMAR_ALS_SECONDARY_TIMER, AUTO_RELOAD_OFF, get_als_timer_period(SECONDARY_TIMER));
             timer_start(OMAR_ALS_TIMER_GROUP, OMAR_ALS_SECONDARY_TIMER);
-            printf("\t\t\t\t\t\t\t\t<primary>\n");
+            TRACE0(TRACE_ALS_PRIMARY);
 
         
         } else if (evt.type == OMAR_ALS_SECONDARY_TIMER) {
@@ -410,26 +486,31 @@ static void timer_example_evt_task(void *arg)
              * re-enable the pwm led controller
              * so the lights turn on again:
              */
-            resume_led_pwm();
+            led_als_resume();
 
-            // Print out the als reading taken inside the timer interrupt:
-            printf("\t\t\t\t\t\t\t\t[als=%d]\n", evt.als_reading);
+            // Trace the als reading taken inside the timer interrupt:
+            TRACE1(TRACE_ALS_READING, evt.als_reading);
+            m_last_als_reading = evt.als_reading;
 
             // Pause the secondary timer:
             timer_pause(OMAR_ALS_TIMER_GROUP, OMAR_ALS_SECONDARY_TIMER);
+            if (!als_sample_mode) {
+                omar_power_hold(OMAR_POWER_ALS, false);
+            }
             
         } else if (evt.type == 43) {
-			als_samples_sofar++;
-			if (als_samples_sofar % 1000 == 0) {
-				printf("\r\n.\r\n");
-			}
+            // Another ALS_SAMPLE_PROGRESS samples captured:
+            printf("\r\n.\r\n");
         } else if (evt.type == 42) {
             // The sampling of als output is finished, print the report:
           printf("%s(): Ambient light sensor sampling finished\n", __func__) ;
 
           // Pause the als sample timer:
           timer_pause(OMAR_ALS_TIMER_GROUP, OMAR_ALS_SAMPLER_TIMER);
+          omar_power_hold(OMAR_POWER_ALS, false);
 
+        } else if (evt.type == ALS_EVENT_ENABLE) {
+            // Picked up at the top of the loop
 
         } else {
             printf("\n\t\t\t\t\t\t\t\t  UNKNOWN EVENT TYPE\n");
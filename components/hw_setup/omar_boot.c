@@ -0,0 +1,176 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_boot.c - runs the omar_setup() stages in parallel, in dependency order
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#include "omar_boot.h"
+
+// Workers are numbered by the core they run on, so stages can be kept to one (see omar_tasks.h):
+#define OMAR_BOOT_WORKERS           (portNUM_PROCESSORS)
+
+static boot_graph_t m_graph;
+static SemaphoreHandle_t m_lock;
+
+/*
+ * One per worker, given whenever a stage finishes (and so may have
+ * let another one start). Semaphores rather than task notifications,
+ * since the calling task uses its notifications for other things
+ * (i2c_bus_xfer(), for one) once we're done.
+ */
+static SemaphoreHandle_t m_wake[OMAR_BOOT_WORKERS];
+
+static void boot_work(int worker, bool until_ready)
+{
+    while (true) {
+        xSemaphoreTake(m_lock, portMAX_DELAY);
+        if (boot_graph_all_done(&m_graph) || (until_ready && boot_graph_ready(&m_graph))) {
+            xSemaphoreGive(m_lock);
+            return;
+        }
+        int stage = boot_graph_next(&m_graph, esp_timer_get_time(), worker);
+        xSemaphoreGive(m_lock);
+
+        if (stage < 0) {
+            // Everything left is waiting on a stage the other worker is running, or is kept to the other worker:
+            xSemaphoreTake(m_wake[worker], portMAX_DELAY);
+            continue;
+        }
+
+        m_graph.stages[stage].fn();
+
+        xSemaphoreTake(m_lock, portMAX_DELAY);
+        bool ready = boot_graph_finish(&m_graph, stage, esp_timer_get_time());
+        xSemaphoreGive(m_lock);
+
+        if (ready) {
+            printf("%s(): ready after %lld msec\n", __func__, (long long) m_graph.ready_us / 1000);
+        }
+
+        for (int i = 0; i < OMAR_BOOT_WORKERS; i++) {
+            xSemaphoreGive(m_wake[i]);
+        }
+    }
+}
+
+static void boot_helper_task(void *arg)
+{
+    boot_work((int)(intptr_t) arg, false);
+    vTaskDelete(NULL);
+}
+
+void omar_boot_run(const boot_stage_t *stages, uint32_t count, uint32_t ready_mask)
+{
+    bool valid = boot_graph_init(&m_graph, stages, count, ready_mask);
+    assert(valid);
+
+    m_lock = xSemaphoreCreateMutex();
+    assert(m_lock != NULL);
+    for (int i = 0; i < OMAR_BOOT_WORKERS; i++) {
+        m_wake[i] = xSemaphoreCreateBinary();
+        assert(m_wake[i] != NULL);
+    }
+
+    int core = xPortGetCoreID();
+
+    m_graph.workers = BOOT_WORKER_BIT(core);
+
+#if portNUM_PROCESSORS > 1
+    int other_core = !core;
+
+    m_graph.workers |= BOOT_WORKER_BIT(other_core);
+    if (xTaskCreatePinnedToCore(boot_helper_task, "boot_helper", OMAR_BOOT_HELPER_STACK_SIZE, (void *)(intptr_t) other_core,
+                                uxTaskPriorityGet(NULL), NULL, other_core) != pdPASS) {
+        printf("%s(): xTaskCreatePinnedToCore() failed, booting on one core\n", __func__);
+        m_graph.workers = BOOT_WORKER_BIT(core);
+        boot_work(core, false);
+        return;
+    }
+
+    boot_work(core, true);
+#else
+    // No helper to finish up after we're ready:
+    boot_work(core, false);
+#endif
+}
+
+bool omar_boot_done(void)
+{
+    return boot_graph_all_done(&m_graph);
+}
+
+void omar_boot_report(bool timing)
+{
+    int64_t serial_us = 0;
+    int64_t first_us = INT64_MAX;
+    int64_t last_us = 0;
+
+    for (uint32_t i = 0; i < m_graph.count; i++) {
+        if (m_graph.done & BOOT_STAGE_BIT(i)) {
+            serial_us += m_graph.times[i].end_us - m_graph.times[i].start_us;
+            if (m_graph.times[i].start_us < first_us) {
+                first_us = m_graph.times[i].start_us;
+            }
+            if (m_graph.times[i].end_us > last_us) {
+                last_us = m_graph.times[i].end_us;
+            }
+        }
+    }
+
+    printf("ready at %lld.%03lld msec; ", (long long) m_graph.ready_us / 1000, (long long) m_graph.ready_us % 1000);
+    if (boot_graph_all_done(&m_graph)) {
+        printf("all %u stages done at %lld.%03lld msec\n", m_graph.count, (long long) last_us / 1000, (long long) last_us % 1000);
+    } else {
+        printf("still booting\n");
+    }
+
+    if (!timing) {
+        return;
+    }
+
+    printf("\n%-10s %6s %12s %12s  %s\n", "stage", "worker", "start us", "took us", "waits for");
+    for (uint32_t i = 0; i < m_graph.count; i++) {
+        const boot_stage_t *stage = &m_graph.stages[i];
+        const boot_stage_time_t *t = &m_graph.times[i];
+
+        if (!(m_graph.done & BOOT_STAGE_BIT(i))) {
+            printf("%-10s %6s\n", stage->name, (m_graph.started & BOOT_STAGE_BIT(i) ? "busy" : "-"));
+            continue;
+        }
+
+        printf("%-10s %6d %12lld %12lld ", stage->name, t->worker, (long long) t->start_us, (long long)(t->end_us - t->start_us));
+        for (uint32_t d = 0; d < m_graph.count; d++) {
+            if (stage->deps & BOOT_STAGE_BIT(d)) {
+                printf(" %s", m_graph.stages[d].name);
+            }
+        }
+        printf("\n");
+    }
+
+    int path[BOOT_GRAPH_MAX_STAGES];
+    uint32_t len = boot_graph_critical_path(&m_graph, m_graph.ready_mask, path);
+
+    printf("\ncritical path to ready:");
+    for (uint32_t i = 0; i < len; i++) {
+        printf(" %s%s", (i > 0 ? "-> " : ""), m_graph.stages[path[i]].name);
+    }
+    printf("\n");
+
+    if (last_us > first_us) {
+        int64_t wall_us = last_us - first_us;
+
+        printf("%lld usec of stages in %lld usec of wall time (%lld.%02lldx)\n",
+               (long long) serial_us, (long long) wall_us, (long long) serial_us / wall_us,
+               (long long)(serial_us * 100 / wall_us) % 100);
+    }
+}
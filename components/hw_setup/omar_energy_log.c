@@ -0,0 +1,153 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_energy_log.c - logs energy, voltage peak and temperature to
+ * flash every CONFIG_ENERGY_LOG_PERIOD_S
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "adi_spi.h"
+#include "omar_thermal.h"
+#include "omar_energy_log.h"
+#include "omar_tasks.h"
+
+#define ENERGY_LOG_SLOTS            (CONFIG_ENERGY_LOG_MAX_KB * 1024 / ENERGY_LOG_BLOCK_SIZE)
+
+// Rewriting the open block costs a sector erase, so it's only done every so often:
+#define ENERGY_LOG_FLUSH_PERIODS \
+    ((CONFIG_ENERGY_LOG_FLUSH_MIN * 60 + CONFIG_ENERGY_LOG_PERIOD_S - 1) / CONFIG_ENERGY_LOG_PERIOD_S)
+
+static TaskHandle_t m_energy_log_task = NULL;
+static SemaphoreHandle_t m_lock = NULL;
+static energy_log_t m_log;
+static energy_log_index_t m_index[ENERGY_LOG_SLOTS];
+static uint32_t m_time_base = 0;
+
+static uint32_t log_time(void)
+{
+    time_t now = time(NULL);
+
+    if (now >= OMAR_ENERGY_LOG_CLOCK_SET) {
+        return (uint32_t) now;
+    }
+    return m_time_base + (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+static void energy_log_task(void *arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+    uint32_t periods = 0;
+    adi_energy_t last;
+    int32_t vpeak;
+
+    // Both read-with-reset, so the first period starts from here:
+    adi_read_energy(&last);
+    adi_read_vpeak(&vpeak);
+
+    while (true) {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONFIG_ENERGY_LOG_PERIOD_S * 1000));
+
+        energy_log_record_t record = { .time = log_time() };
+        adi_energy_t energy;
+        float temperature = 0.0;
+
+        // A failed read leaves the totals as they were, so its energy lands in the next period:
+        adi_read_energy(&energy);
+        record.aenergy = (int32_t)(energy.aenergy - last.aenergy);
+        record.benergy = (int32_t)(energy.benergy - last.benergy);
+        record.renergy = (int32_t)((energy.renergya - last.renergya) + (energy.renergyb - last.renergyb));
+        last = energy;
+
+        if (adi_read_vpeak(&vpeak) == ESP_OK) {
+            record.vpeak = vpeak;
+        }
+
+        thermal_get_state(&temperature);
+        record.temperature = (int32_t)(temperature * 4.0f);    // 0.25C counts
+
+        xSemaphoreTake(m_lock, portMAX_DELAY);
+        if (!energy_log_append(&m_log, &record)) {
+            printf("%s(): couldn't write a full block, its records are lost\n", __func__);
+        }
+        if (++periods % ENERGY_LOG_FLUSH_PERIODS == 0 && !energy_log_flush(&m_log)) {
+            printf("%s(): energy_log_flush() failed\n", __func__);
+        }
+        xSemaphoreGive(m_lock);
+    }
+}
+
+esp_err_t omar_energy_log_start(const char *path)
+{
+    if (m_energy_log_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    m_lock = xSemaphoreCreateMutex();
+    if (m_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    energy_log_summary_t summary;
+
+    energy_log_init(&m_log, path, m_index, ENERGY_LOG_SLOTS);
+    energy_log_get_summary(&m_log, &summary);
+    if (summary.records != 0) {
+        m_time_base = summary.t_max + CONFIG_ENERGY_LOG_PERIOD_S;
+    }
+
+    esp_err_t ret = omar_task_create(OMAR_TASK_ENERGY_LOG, energy_log_task, NULL, &m_energy_log_task);
+    if (ret != ESP_OK) {
+        printf("%s(): omar_task_create() failed, energy won't be logged\n", __func__);
+    }
+    return ret;
+}
+
+uint32_t omar_energy_log_query(uint32_t from, uint32_t to, energy_log_fn_t fn, void *arg)
+{
+    if (m_energy_log_task == NULL) {
+        return 0;
+    }
+
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    uint32_t matched = energy_log_query(&m_log, from, to, fn, arg);
+    xSemaphoreGive(m_lock);
+
+    return matched;
+}
+
+bool omar_energy_log_get_summary(energy_log_summary_t *summary, energy_log_stats_t *stats)
+{
+    if (m_energy_log_task == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    energy_log_get_summary(&m_log, summary);
+    *stats = m_log.stats;
+    xSemaphoreGive(m_lock);
+
+    return true;
+}
+
+esp_err_t omar_energy_log_flush(void)
+{
+    if (m_energy_log_task == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    bool ok = energy_log_flush(&m_log);
+    xSemaphoreGive(m_lock);
+
+    return (ok ? ESP_OK : ESP_FAIL);
+}
@@ -0,0 +1,442 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_led.c - led service. A single task owns both ledc channels, and
+ * everybody else (console, input callbacks, thermal supervisor, the als
+ * timer task) talks to it through a queue, so none of the non thread safe
+ * ledc calls ever race. Fades run on the ledc hardware fade engine; while
+ * a channel is fading, further commands for it are held back and the
+ * latest one is applied when the fade finishes, so the service itself
+ * never blocks on the engine.
+ *
+ * Internally duty cycles are kept in eighths of a pwm count (see
+ * omar_led_curve.h). The ledc duty register has four fractional bits
+ * which the hardware dithers over successive pwm periods, so the
+ * bottom of the perceptual curve gets sub-count resolution with no
+ * cpu involvement.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/ledc.h"
+#include "soc/ledc_struct.h"
+#include "esp_err.h"
+#include "hw_setup.h"
+#include "omar_led.h"
+#include "omar_led_curve.h"
+#include "omar_tasks.h"
+#include "omar_power.h"
+
+// Enable OMAR_LED_VERBOSE to see every duty cycle change
+//#define OMAR_LED_VERBOSE
+
+#define LED_QUEUE_LENGTH        (16)
+
+/*
+ * Index into the array of channel configs:
+ */
+#define OMAR_LED0_LEDCINDEX     (0)
+#define OMAR_LED1_LEDCINDEX     (1)
+#define OMAR_LED_COUNT          (2)
+
+#define LED_INDEX(led)          ((led) == OMAR_WHITE_LED0 ? OMAR_LED0_LEDCINDEX : OMAR_LED1_LEDCINDEX)
+
+typedef enum {
+    LED_CMD_SET = 0,
+    LED_CMD_BLINK,
+    LED_CMD_LIMIT,
+    LED_CMD_ALS_PAUSE,
+    LED_CMD_ALS_RESUME,
+} led_cmd_type_t;
+
+typedef struct {
+    led_cmd_type_t type;
+    uint8_t ch;
+    uint32_t duty;              // Q3, except for LED_CMD_LIMIT
+    uint32_t fade_msec;         // LED_CMD_SET
+    uint32_t on_msec;           // LED_CMD_BLINK
+    uint32_t off_msec;
+    uint32_t count;
+    TaskHandle_t reply;         // LED_CMD_ALS_PAUSE
+} led_cmd_t;
+
+// Values handed back to led_als_pause() through the task notification:
+#define LED_PAUSE_REFUSED       (1)
+#define LED_PAUSE_OK            (2)
+
+typedef struct {
+    uint32_t level;             // brightness asked for, Q3
+    uint32_t driven;            // what the channel is (or will be, once resumed) set to, Q3
+    bool fading;
+    TickType_t fade_done;
+    bool pending;               // a change is waiting for the fade to finish
+    uint32_t pending_fade_msec;
+    bool blinking;
+    bool blink_lit;
+    uint32_t blink_duty;
+    uint32_t blink_on;
+    uint32_t blink_off;
+    uint32_t blink_count;       // flashes left, 0 for forever
+    TickType_t blink_next;
+} led_state_t;
+
+/*
+ * Both leds share a single pwm timer:
+ */
+static ledc_timer_config_t ledc_timer = {
+    .duty_resolution = OMAR_LED_DUTY_RESOLUTION,// resolution of PWM duty
+    .freq_hz = OMAR_LEDC_FREQ_HZ,               // frequency of PWM signal
+    .speed_mode = OMAR_LEDC_SPEED_MODE,         // timer mode
+    .timer_num = OMAR_LEDC_TIMER                // timer index
+};
+
+static ledc_channel_config_t ledc_channel[OMAR_LED_COUNT] = {
+    {
+        .channel    = LEDC_CHANNEL_0,
+        .duty       = 0,
+        .gpio_num   = OMAR_WHITE_LED0,
+        .speed_mode = LEDC_HIGH_SPEED_MODE,
+        .timer_sel  = LEDC_TIMER_0
+    },
+    {
+        .channel    = LEDC_CHANNEL_1,
+        .duty       = 0,
+        .gpio_num   = OMAR_WHITE_LED1,
+        .speed_mode = LEDC_HIGH_SPEED_MODE,
+        .timer_sel  = LEDC_TIMER_0
+    }
+};
+
+// Everything below is only touched by the led service task, except that
+// the getters read 'level' under m_level_lock (the task holds it to write it):
+static portMUX_TYPE m_level_lock = portMUX_INITIALIZER_UNLOCKED;
+static led_state_t m_leds[OMAR_LED_COUNT];
+static uint32_t m_duty_limit = OMAR_LED_MAX_DUTY_Q3;
+static bool m_paused = false;
+
+static QueueHandle_t m_led_queue = NULL;
+
+static void led_task(void *arg);
+
+void led_setup(void)
+{
+    ledc_timer_config(&ledc_timer);
+
+    ledc_channel_config(&ledc_channel[OMAR_LED0_LEDCINDEX]);
+    ledc_channel_config(&ledc_channel[OMAR_LED1_LEDCINDEX]);
+
+    ledc_fade_func_install(0);
+
+    m_led_queue = xQueueCreate(LED_QUEUE_LENGTH, sizeof(led_cmd_t));
+    // Above the als task, on the same core (see omar_tasks.h):
+    omar_task_create(OMAR_TASK_LED, led_task, NULL, NULL);
+}
+
+static void led_send(const led_cmd_t *cmd)
+{
+    if (m_led_queue == NULL) {
+        printf("%s(): the led service isn't running\n", __func__);
+        return;
+    }
+    xQueueSend(m_led_queue, cmd, portMAX_DELAY);
+}
+
+static void led_send_set(uint8_t led, uint32_t duty_q3, uint32_t fade_msec)
+{
+    led_cmd_t cmd = {
+        .type = LED_CMD_SET,
+        .ch = LED_INDEX(led),
+        .duty = duty_q3,
+        .fade_msec = fade_msec,
+    };
+    led_send(&cmd);
+}
+
+void led_set_brightness(uint8_t led, uint32_t duty)
+{
+    led_fade_brightness(led, duty, 0);
+}
+
+void led_fade_brightness(uint8_t led, uint32_t duty, uint32_t fade_msec)
+{
+    if (duty > OMAR_LED_MAX_DUTY) {
+        duty = OMAR_LED_MAX_DUTY;
+    }
+    led_send_set(led, duty << OMAR_LED_DUTY_Q3_SHIFT, fade_msec);
+}
+
+void led_set_level(uint8_t led, uint32_t level, uint32_t fade_msec)
+{
+    led_send_set(led, led_level_to_duty_q3(level), fade_msec);
+}
+
+void led_blink(uint8_t led, uint32_t duty, uint32_t on_msec, uint32_t off_msec, uint32_t count)
+{
+    led_cmd_t cmd = {
+        .type = LED_CMD_BLINK,
+        .ch = LED_INDEX(led),
+        .duty = (duty > OMAR_LED_MAX_DUTY ? OMAR_LED_MAX_DUTY : duty) << OMAR_LED_DUTY_Q3_SHIFT,
+        .on_msec = on_msec,
+        .off_msec = off_msec,
+        .count = count,
+    };
+    led_send(&cmd);
+}
+
+void led_set_duty_limit(uint32_t limit)
+{
+    led_cmd_t cmd = {
+        .type = LED_CMD_LIMIT,
+        .duty = limit,
+    };
+    led_send(&cmd);
+}
+
+static uint32_t led_get_duty_q3(uint8_t led)
+{
+    uint32_t level;
+
+    portENTER_CRITICAL(&m_level_lock);
+    level = m_leds[LED_INDEX(led)].level;
+    portEXIT_CRITICAL(&m_level_lock);
+
+    return level;
+}
+
+uint32_t led_get_brightness(uint8_t led)
+{
+    return led_get_duty_q3(led) >> OMAR_LED_DUTY_Q3_SHIFT;
+}
+
+uint32_t led_get_level(uint8_t led)
+{
+    return led_duty_q3_to_level(led_get_duty_q3(led));
+}
+
+bool led_als_pause(void)
+{
+    led_cmd_t cmd = {
+        .type = LED_CMD_ALS_PAUSE,
+        .reply = xTaskGetCurrentTaskHandle(),
+    };
+
+    if (m_led_queue == NULL) {
+        return false;
+    }
+
+    led_send(&cmd);
+    return (ulTaskNotifyTake(pdTRUE, portMAX_DELAY) == LED_PAUSE_OK);
+}
+
+void led_als_resume(void)
+{
+    led_cmd_t cmd = {
+        .type = LED_CMD_ALS_RESUME,
+    };
+    led_send(&cmd);
+}
+
+static uint32_t led_output(const led_state_t *led)
+{
+    if (led->blinking) {
+        return (led->blink_lit ? led->blink_duty : 0);
+    }
+    return led->level;
+}
+
+static void led_write(uint8_t ch, uint32_t duty_q3)
+{
+    ledc_mode_t mode = ledc_channel[ch].speed_mode;
+    ledc_channel_t channel = ledc_channel[ch].channel;
+
+    ledc_set_duty(mode, channel, duty_q3 >> OMAR_LED_DUTY_Q3_SHIFT);
+
+    /*
+     * ledc_set_duty() leaves the register's four fractional bits
+     * clear; fill in the top three from our Q3 value before the
+     * update latches it.
+     */
+    LEDC.channel_group[mode].channel[channel].duty.duty |= 
+        (duty_q3 & ((1 << OMAR_LED_DUTY_Q3_SHIFT) - 1)) << 1;
+
+    ledc_update_duty(mode, channel);
+}
+
+/*
+ * Bring a channel's output in line with its state, respecting the
+ * duty limit. While a fade is running the change is deferred; while
+ * the leds are paused it's just recorded, and applied on resume.
+ */
+static void led_refresh(uint8_t ch, uint32_t fade_msec)
+{
+    led_state_t *led = &m_leds[ch];
+
+    if (led->fading) {
+        led->pending = true;
+        led->pending_fade_msec = fade_msec;
+        return;
+    }
+
+    uint32_t duty = led_output(led);
+    if (duty > m_duty_limit) {
+        duty = m_duty_limit;
+    }
+
+    if (m_paused) {
+        led->driven = duty;
+        return;
+    }
+
+    if (fade_msec != 0 && duty != led->driven) {
+        // The fade engine works in whole counts; a fade just lands on the nearest one below
+        ledc_set_fade_with_time(ledc_channel[ch].speed_mode, ledc_channel[ch].channel, 
+                                duty >> OMAR_LED_DUTY_Q3_SHIFT, fade_msec);
+        ledc_fade_start(ledc_channel[ch].speed_mode, ledc_channel[ch].channel, LEDC_FADE_NO_WAIT);
+        led->fading = true;
+        // One extra tick so we never catch the engine just before it finishes:
+        led->fade_done = xTaskGetTickCount() + fade_msec/portTICK_PERIOD_MS + 1;
+    } else {
+        led_write(ch, duty);
+    }
+    led->driven = duty;
+
+#if defined(OMAR_LED_VERBOSE)
+    printf("%s(): led #%d -> %d over %d msec\n", __func__, ch, duty, fade_msec);
+#endif
+}
+
+static void led_handle(const led_cmd_t *cmd)
+{
+    led_state_t *led = &m_leds[cmd->ch < OMAR_LED_COUNT ? cmd->ch : 0];
+    TickType_t now = xTaskGetTickCount();
+
+    switch (cmd->type) {
+
+    case LED_CMD_SET:
+        led->blinking = false;
+        portENTER_CRITICAL(&m_level_lock);
+        led->level = (cmd->duty > OMAR_LED_MAX_DUTY_Q3 ? OMAR_LED_MAX_DUTY_Q3 : cmd->duty);
+        portEXIT_CRITICAL(&m_level_lock);
+        led_refresh(cmd->ch, cmd->fade_msec);
+        break;
+
+    case LED_CMD_BLINK:
+        led->blinking = true;
+        led->blink_lit = true;
+        led->blink_duty = cmd->duty;
+        // Anything shorter than a tick would have us spinning:
+        led->blink_on = (cmd->on_msec < portTICK_PERIOD_MS ? portTICK_PERIOD_MS : cmd->on_msec);
+        led->blink_off = (cmd->off_msec < portTICK_PERIOD_MS ? portTICK_PERIOD_MS : cmd->off_msec);
+        led->blink_count = cmd->count;
+        led->blink_next = now + led->blink_on/portTICK_PERIOD_MS;
+        led_refresh(cmd->ch, 0);
+        break;
+
+    case LED_CMD_LIMIT:
+        m_duty_limit = (cmd->duty > OMAR_LED_MAX_DUTY ? OMAR_LED_MAX_DUTY : cmd->duty) << OMAR_LED_DUTY_Q3_SHIFT;
+        for (uint8_t ch = 0; ch < OMAR_LED_COUNT; ch++) {
+            led_refresh(ch, 0);
+        }
+        break;
+
+    case LED_CMD_ALS_PAUSE:
+        if (m_leds[OMAR_LED0_LEDCINDEX].fading || m_leds[OMAR_LED1_LEDCINDEX].fading) {
+            xTaskNotify(cmd->reply, LED_PAUSE_REFUSED, eSetValueWithOverwrite);
+            break;
+        }
+        m_paused = true;
+        led_write(OMAR_LED0_LEDCINDEX, 0);
+        led_write(OMAR_LED1_LEDCINDEX, 0);
+        xTaskNotify(cmd->reply, LED_PAUSE_OK, eSetValueWithOverwrite);
+        break;
+
+    case LED_CMD_ALS_RESUME:
+        if (m_paused) {
+            m_paused = false;
+            led_write(OMAR_LED0_LEDCINDEX, m_leds[OMAR_LED0_LEDCINDEX].driven);
+            led_write(OMAR_LED1_LEDCINDEX, m_leds[OMAR_LED1_LEDCINDEX].driven);
+        }
+        break;
+
+    default:
+        printf("%s(): Unknown led command %d\n", __func__, cmd->type);
+        break;
+    }
+}
+
+/*
+ * Finish off fades and step blinks that are due, and work out how
+ * long we can sleep until the next one.
+ */
+static TickType_t led_service_timers(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t wait = portMAX_DELAY;
+
+    for (uint8_t ch = 0; ch < OMAR_LED_COUNT; ch++) {
+        led_state_t *led = &m_leds[ch];
+
+        if (led->fading && (int32_t)(now - led->fade_done) >= 0) {
+            led->fading = false;
+            if (led->pending) {
+                led->pending = false;
+                led_refresh(ch, led->pending_fade_msec);
+            } else if ((led->driven & ((1 << OMAR_LED_DUTY_Q3_SHIFT) - 1)) && !m_paused) {
+                // The fade stopped on a whole count; add the fraction back in:
+                led_write(ch, led->driven);
+            }
+        }
+
+        if (led->blinking && (int32_t)(now - led->blink_next) >= 0) {
+            if (led->blink_lit && led->blink_count != 0 && --led->blink_count == 0) {
+                led->blinking = false;
+            } else {
+                led->blink_lit = !led->blink_lit;
+                led->blink_next = now + (led->blink_lit ? led->blink_on : led->blink_off)/portTICK_PERIOD_MS;
+            }
+            led_refresh(ch, 0);
+        }
+
+        if (led->fading && (TickType_t)(led->fade_done - now) < wait) {
+            wait = led->fade_done - now;
+        }
+        if (led->blinking && (TickType_t)(led->blink_next - now) < wait) {
+            wait = led->blink_next - now;
+        }
+    }
+
+    return wait;
+}
+
+/*
+ * The ledc counts the apb clock, which slows down and then stops
+ * in light sleep, so keep it running while anything's lit.
+ */
+static bool led_lit(void)
+{
+    for (uint8_t ch = 0; ch < OMAR_LED_COUNT; ch++) {
+        if (m_leds[ch].driven != 0 || m_leds[ch].fading) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void led_task(void *arg)
+{
+    TickType_t wait = portMAX_DELAY;
+
+    while (1) {
+        led_cmd_t cmd;
+
+        if (xQueueReceive(m_led_queue, &cmd, wait)) {
+            led_handle(&cmd);
+        }
+
+        wait = led_service_timers();
+        omar_power_hold(OMAR_POWER_LEDS, led_lit());
+    }
+}
@@ -0,0 +1,61 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_led_curve.c - perceptual (CIE 1931 lightness) brightness curve for
+ * the 13-bit led pwm
+ *
+ */
+
+#include <stdint.h>
+#include "hw_setup.h"
+#include "omar_led_curve.h"
+
+/*
+ * CIE 1931 lightness to relative luminance:
+ *
+ *   Y = L* / 903.3              for L* <= 8
+ *   Y = ((L* + 16) / 116)^3     otherwise
+ *
+ * with level/10 as L*. The whole table is built by the preprocessor
+ * as a constant initializer, so it's computed at compile time, lives
+ * in flash, and costs nothing at startup.
+ */
+#define CIE_L(level)        ((level) / 10.0)
+#define CIE_F(level)        ((CIE_L(level) + 16.0) / 116.0)
+#define CIE_Y(level)        (CIE_L(level) <= 8.0 ? CIE_L(level) / 903.3 : CIE_F(level) * CIE_F(level) * CIE_F(level))
+#define CIE_DUTY_Q3(level)  ((uint16_t)(CIE_Y(level) * OMAR_LED_MAX_DUTY_Q3 + 0.5))
+
+#define CIE_1(n)            CIE_DUTY_Q3(n),
+#define CIE_10(n)           CIE_1(n) CIE_1(n+1) CIE_1(n+2) CIE_1(n+3) CIE_1(n+4) \
+                            CIE_1(n+5) CIE_1(n+6) CIE_1(n+7) CIE_1(n+8) CIE_1(n+9)
+#define CIE_100(n)          CIE_10(n) CIE_10(n+10) CIE_10(n+20) CIE_10(n+30) CIE_10(n+40) \
+                            CIE_10(n+50) CIE_10(n+60) CIE_10(n+70) CIE_10(n+80) CIE_10(n+90)
+#define CIE_1000(n)         CIE_100(n) CIE_100(n+100) CIE_100(n+200) CIE_100(n+300) CIE_100(n+400) \
+                            CIE_100(n+500) CIE_100(n+600) CIE_100(n+700) CIE_100(n+800) CIE_100(n+900)
+
+static const uint16_t m_cie_duty_q3[OMAR_LED_LEVEL_MAX + 1] = {
+    CIE_1000(0)
+    CIE_DUTY_Q3(OMAR_LED_LEVEL_MAX)
+};
+
+uint32_t led_level_to_duty_q3(uint32_t level)
+{
+    return m_cie_duty_q3[level > OMAR_LED_LEVEL_MAX ? OMAR_LED_LEVEL_MAX : level];
+}
+
+uint32_t led_duty_q3_to_level(uint32_t duty_q3)
+{
+    uint32_t lo = 0;
+    uint32_t hi = OMAR_LED_LEVEL_MAX;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (m_cie_duty_q3[mid] < duty_q3) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
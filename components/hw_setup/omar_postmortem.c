@@ -0,0 +1,131 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_postmortem.c - what the last run left in rtc memory: the
+ * energy totals, the relays and its last few trace events
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "rom/rtc.h"
+
+#include "trace.h"
+#include "omar_postmortem.h"
+
+static RTC_NOINIT_ATTR postmortem_t m_region;
+
+static omar_postmortem_t m_last;
+static postmortem_state_t m_state;
+static SemaphoreHandle_t m_lock = NULL;
+
+// Saving costs two crcs over the state and one copy of it, a few microseconds:
+static void save_state(void)
+{
+    m_state.uptime_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    postmortem_save_state(&m_region, &m_state);
+}
+
+void omar_postmortem_init(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        m_last.reset_reason[core] = rtc_get_reset_reason(core);
+    }
+
+    m_last.survived = postmortem_open(&m_region);
+    m_last.resets = m_region.resets;
+    if (m_last.survived) {
+        m_last.have_state = postmortem_load_state(&m_region, &m_last.state);
+        for (int core = 0; core < POSTMORTEM_CORES; core++) {
+            m_last.trace_count[core] = postmortem_ring_take(&m_region.rings[core], m_last.trace[core],
+                                                            &m_last.trace_bad[core]);
+        }
+    }
+
+    // The relays latch, so they're as the last run left them until someone moves them:
+    if (m_last.have_state) {
+        m_state = m_last.state;
+    }
+
+    m_lock = xSemaphoreCreateMutex();
+
+    for (int core = 0; core < portNUM_PROCESSORS && core < POSTMORTEM_CORES; core++) {
+        trace_mirror(core, &m_region.rings[core]);
+    }
+}
+
+bool omar_postmortem_restore_energy(adi_energy_t *energy)
+{
+    if (!m_last.have_state) {
+        return false;
+    }
+
+    energy->aenergy = m_last.state.energy[0];
+    energy->benergy = m_last.state.energy[1];
+    energy->renergya = m_last.state.energy[2];
+    energy->renergyb = m_last.state.energy[3];
+    return true;
+}
+
+void omar_postmortem_save_energy(const adi_energy_t *energy)
+{
+    if (m_lock == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    m_state.energy[0] = energy->aenergy;
+    m_state.energy[1] = energy->benergy;
+    m_state.energy[2] = energy->renergya;
+    m_state.energy[3] = energy->renergyb;
+    save_state();
+    xSemaphoreGive(m_lock);
+}
+
+void omar_postmortem_save_relay(omar_relay_t relay, bool closed)
+{
+    if (m_lock == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    if (closed) {
+        m_state.relays |= (1 << relay);
+    } else {
+        m_state.relays &= ~(1 << relay);
+    }
+    save_state();
+    xSemaphoreGive(m_lock);
+}
+
+const omar_postmortem_t *omar_postmortem_get(void)
+{
+    return &m_last;
+}
+
+const char *omar_postmortem_reset_name(int reason)
+{
+    switch (reason) {
+    case POWERON_RESET:             return "power on";
+    case SW_RESET:                  return "software";
+    case OWDT_RESET:                return "legacy watchdog";
+    case DEEPSLEEP_RESET:           return "deep sleep";
+    case SDIO_RESET:                return "sdio";
+    case TG0WDT_SYS_RESET:          return "timer group 0 watchdog";
+    case TG1WDT_SYS_RESET:          return "timer group 1 watchdog";
+    case RTCWDT_SYS_RESET:          return "rtc watchdog";
+    case INTRUSION_RESET:           return "intrusion";
+    case TGWDT_CPU_RESET:           return "timer group watchdog (cpu)";
+    case SW_CPU_RESET:              return "software (cpu), e.g. a panic";
+    case RTCWDT_CPU_RESET:          return "rtc watchdog (cpu)";
+    case EXT_CPU_RESET:             return "the other cpu";
+    case RTCWDT_BROWN_OUT_RESET:    return "brownout";
+    case RTCWDT_RTC_RESET:          return "rtc watchdog (rtc)";
+    default:                        return "unknown";
+    }
+}
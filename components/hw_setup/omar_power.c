@@ -0,0 +1,322 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_power.c - automatic light sleep, and the pm locks that keep the
+ * chip out of it while something needs the clocks
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_freertos_hooks.h"
+#include "driver/uart.h"
+#include "sdkconfig.h"
+
+#include "omar_power.h"
+#include "omar_tasks.h"
+
+// Rising edges on the console's rx line it takes to wake the chip:
+#define POWER_UART_WAKE_EDGES       (3)
+
+/*
+ * Light sleep costs up to CONFIG_POWER_WAKE_US before a timer runs.
+ * The als cycle doesn't mind (the reading itself is timed by the
+ * timer group, under a hold); a coil pulse is aimed at a point on
+ * the mains cycle, so a relay can only be a little late.
+ */
+static const power_sched_source_t m_wake_sources[OMAR_WAKE_COUNT] = {
+    [OMAR_WAKE_ALS]     = { "als",      20000 },
+    [OMAR_WAKE_RELAY1]  = { "relay1",   250 },
+    [OMAR_WAKE_RELAY2]  = { "relay2",   250 },
+};
+
+static const char *m_hold_names[OMAR_POWER_HOLD_COUNT] = {
+    [OMAR_POWER_LEDS]       = "leds",
+    [OMAR_POWER_ALS]        = "als",
+    [OMAR_POWER_CONSOLE]    = "console",
+};
+
+// Everything below is under m_power_lock; the holds and deadlines come from isr-ish places:
+static portMUX_TYPE m_power_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool m_started = false;
+static omar_power_hold_stats_t m_holds[OMAR_POWER_HOLD_COUNT];
+static int64_t m_held_since[OMAR_POWER_HOLD_COUNT];
+static esp_timer_handle_t m_hold_timers[OMAR_POWER_HOLD_COUNT];
+static power_sched_t m_sched;
+static esp_timer_handle_t m_wake_timer = NULL;
+static bool m_kept_awake = false;
+static uint32_t m_uart_wakes = 0;
+static bool m_uart_wake_seen = false;
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t m_hold_locks[OMAR_POWER_HOLD_COUNT];
+static esp_pm_lock_handle_t m_awake_lock = NULL;
+#endif
+
+static void power_pm_lock(bool hold_lock, omar_power_hold_t hold, bool on)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t lock = (hold_lock ? m_hold_locks[hold] : m_awake_lock);
+
+    if (lock != NULL) {
+        if (on) {
+            esp_pm_lock_acquire(lock);
+        } else {
+            esp_pm_lock_release(lock);
+        }
+    }
+#endif
+}
+
+void omar_power_hold(omar_power_hold_t hold, bool on)
+{
+    if (hold >= OMAR_POWER_HOLD_COUNT) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&m_power_lock);
+    if (on != m_holds[hold].held) {
+        m_holds[hold].held = on;
+        if (on) {
+            m_holds[hold].count++;
+            m_held_since[hold] = now;
+        } else {
+            m_holds[hold].held_us += now - m_held_since[hold];
+        }
+        if (m_started) {
+            power_pm_lock(true, hold, on);
+        }
+    }
+    portEXIT_CRITICAL(&m_power_lock);
+}
+
+static void power_hold_expired(void *arg)
+{
+    omar_power_hold((omar_power_hold_t)(intptr_t) arg, false);
+}
+
+void omar_power_hold_for(omar_power_hold_t hold, uint32_t msec)
+{
+    if (hold >= OMAR_POWER_HOLD_COUNT || !m_started) {
+        return;
+    }
+
+    omar_power_hold(hold, true);
+    esp_timer_stop(m_hold_timers[hold]);
+    esp_timer_start_once(m_hold_timers[hold], (uint64_t) msec * 1000);
+}
+
+/*
+ * With m_power_lock held: keep the chip awake if a deadline is too
+ * close to sleep through, or set the wake timer for when one will be.
+ * The timer is what wakes us, if we're asleep by then.
+ */
+static void power_replan(int64_t now)
+{
+    int64_t wake_at;
+    bool stay = power_sched_plan(&m_sched, now, &wake_at);
+
+    if (stay != m_kept_awake) {
+        m_kept_awake = stay;
+        power_pm_lock(false, 0, stay);
+    }
+
+    esp_timer_stop(m_wake_timer);
+    if (!stay && wake_at != POWER_SCHED_NEVER) {
+        esp_timer_start_once(m_wake_timer, (wake_at > now ? wake_at - now : 0));
+    }
+}
+
+static void power_wake_timer_cb(void *arg)
+{
+    portENTER_CRITICAL(&m_power_lock);
+    power_replan(esp_timer_get_time());
+    portEXIT_CRITICAL(&m_power_lock);
+}
+
+void omar_power_arm(omar_wake_t source, int64_t deadline_us)
+{
+    if (!m_started) {
+        return;
+    }
+
+    portENTER_CRITICAL(&m_power_lock);
+    power_sched_arm(&m_sched, source, deadline_us);
+    power_replan(esp_timer_get_time());
+    portEXIT_CRITICAL(&m_power_lock);
+}
+
+void omar_power_done(omar_wake_t source)
+{
+    if (!m_started) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&m_power_lock);
+    power_sched_done(&m_sched, source, now);
+    power_replan(now);
+    portEXIT_CRITICAL(&m_power_lock);
+}
+
+void omar_power_disarm(omar_wake_t source)
+{
+    if (!m_started) {
+        return;
+    }
+
+    portENTER_CRITICAL(&m_power_lock);
+    power_sched_disarm(&m_sched, source);
+    power_replan(esp_timer_get_time());
+    portEXIT_CRITICAL(&m_power_lock);
+}
+
+#if CONFIG_PM_ENABLE
+/*
+ * The character that wakes the chip from the uart is lost, and so
+ * would every one after it be if we went straight back to sleep
+ * between keystrokes, so a uart wake keeps us up for a while. Nothing
+ * says so as the wake happens; the idle task finds out from the wake
+ * cause once it runs again. The cause stays put until the next wake,
+ * so it's only counted once; a second uart wake with no other wake
+ * (the thermal poll, say) in between goes unnoticed, and the key
+ * after that does the job.
+ */
+static bool power_idle_hook(void)
+{
+    bool uart = (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UART);
+
+    if (uart && !m_uart_wake_seen) {
+        m_uart_wakes++;
+        omar_power_hold_for(OMAR_POWER_CONSOLE, CONFIG_POWER_CONSOLE_AWAKE_S * 1000);
+    }
+    m_uart_wake_seen = uart;
+
+    return true;
+}
+#endif
+
+void omar_power_restore_wakeups(void)
+{
+#if CONFIG_PM_ENABLE
+    /*
+     * The inputs set up their own pins (see omar_input_add()); a gpio
+     * wake is level triggered, so they flip the level each edge.
+     */
+    esp_sleep_enable_gpio_wakeup();
+
+    if (CONFIG_CONSOLE_UART_NUM <= UART_NUM_1) {
+        uart_set_wakeup_threshold(CONFIG_CONSOLE_UART_NUM, POWER_UART_WAKE_EDGES);
+        esp_sleep_enable_uart_wakeup(CONFIG_CONSOLE_UART_NUM);
+    }
+#endif
+}
+
+esp_err_t omar_power_init(void)
+{
+    if (m_started) {
+        return ESP_OK;
+    }
+
+    power_sched_init(&m_sched, m_wake_sources, OMAR_WAKE_COUNT, CONFIG_POWER_WAKE_US);
+
+    for (int i = 0; i < OMAR_POWER_HOLD_COUNT; i++) {
+        esp_timer_create_args_t args = {
+            .callback = power_hold_expired,
+            .arg = (void *)(intptr_t) i,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "power_hold",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&args, &m_hold_timers[i]));
+    }
+
+    esp_timer_create_args_t wake_args = {
+        .callback = power_wake_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "power_wake",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&wake_args, &m_wake_timer));
+
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t locks[OMAR_POWER_HOLD_COUNT];
+
+    for (int i = 0; i < OMAR_POWER_HOLD_COUNT; i++) {
+        ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, m_hold_names[i], &locks[i]));
+    }
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "deadline", &m_awake_lock));
+
+    esp_pm_config_esp32_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_POWER_MIN_FREQ_MHZ,
+#if CONFIG_POWER_LIGHT_SLEEP && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t ret = esp_pm_configure(&pm_config);
+    if (ret != ESP_OK) {
+        printf("%s(): esp_pm_configure() failed (%d), staying at full speed\n", __func__, ret);
+        return ret;
+    }
+
+    omar_power_restore_wakeups();
+    esp_register_freertos_idle_hook_for_cpu(power_idle_hook, OMAR_PRO_CPU);
+#endif
+
+    // Take the locks for whatever was held before they existed:
+    portENTER_CRITICAL(&m_power_lock);
+#if CONFIG_PM_ENABLE
+    memcpy(m_hold_locks, locks, sizeof(m_hold_locks));
+#endif
+    m_started = true;
+    for (int i = 0; i < OMAR_POWER_HOLD_COUNT; i++) {
+        if (m_holds[i].held) {
+            power_pm_lock(true, i, true);
+        }
+    }
+    portEXIT_CRITICAL(&m_power_lock);
+
+    return ESP_OK;
+}
+
+void omar_power_get_status(omar_power_status_t *status)
+{
+    int64_t now = esp_timer_get_time();
+
+    memset(status, 0, sizeof(*status));
+#if CONFIG_PM_ENABLE && CONFIG_POWER_LIGHT_SLEEP && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    status->light_sleep = m_started;
+#endif
+    status->wake_us = CONFIG_POWER_WAKE_US;
+
+    portENTER_CRITICAL(&m_power_lock);
+    for (int i = 0; i < OMAR_POWER_HOLD_COUNT; i++) {
+        status->holds[i] = m_holds[i];
+        if (m_holds[i].held) {
+            status->holds[i].held_us += now - m_held_since[i];
+        }
+    }
+    for (int i = 0; i < OMAR_WAKE_COUNT; i++) {
+        status->wakes[i] = m_sched.entries[i].stats;
+    }
+    status->uart_wakes = m_uart_wakes;
+    portEXIT_CRITICAL(&m_power_lock);
+}
+
+const char *omar_power_hold_name(omar_power_hold_t hold)
+{
+    return (hold < OMAR_POWER_HOLD_COUNT ? m_hold_names[hold] : "?");
+}
+
+const char *omar_power_wake_name(omar_wake_t source)
+{
+    return (source < OMAR_WAKE_COUNT ? m_wake_sources[source].name : "?");
+}
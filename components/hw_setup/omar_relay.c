@@ -0,0 +1,288 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_relay.c - non-blocking latching relay driver. Coil pulses are run
+ * from esp_timer one-shots, so relay_set() never blocks its caller. With
+ * the ADE7953's ZX signal available, each pulse is started early enough
+ * (by the relay's nominal mechanical delay) that the contacts land at a
+ * fixed offset from a mains zero crossing, which cuts inrush current and
+ * contact wear.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "hw_setup.h"
+#include "omar_relay.h"
+#include "omar_tasks.h"
+#include "omar_postmortem.h"
+#include "omar_power.h"
+
+// Enable OMAR_RELAY_VERBOSE to see every pulse that's scheduled
+//#define OMAR_RELAY_VERBOSE
+
+/*
+ * Don't try to schedule a pulse closer than this to "now"; it also
+ * covers esp_timer's dispatch latency.
+ */
+#define RELAY_MIN_LEAD_USEC         (500)
+
+/*
+ * The zero-cross tracker gives up on the signal (and the relays
+ * switch immediately) if it hasn't seen an edge for this long.
+ */
+#define ZX_STALE_USEC               (100000)
+
+// ZX toggles at every crossing, so this covers 45-65Hz mains:
+#define ZX_MIN_HALF_PERIOD_USEC     (7500)
+#define ZX_MAX_HALF_PERIOD_USEC     (11200)
+
+typedef enum {
+    RELAY_IDLE = 0,
+    RELAY_WAITING,              // pulse scheduled, coil not energized yet
+    RELAY_PULSING,              // coil energized
+} relay_phase_t;
+
+typedef struct {
+    gpio_num_t set_gpio;
+    gpio_num_t reset_gpio;
+    esp_timer_handle_t timer;
+    relay_phase_t phase;
+    bool closed;                // state after the last completed pulse
+    bool target;                // state we've been asked for
+    bool pulse_target;          // what the current pulse will leave us in
+    uint32_t pulses;
+} relay_t;
+
+static relay_t m_relays[OMAR_RELAY_COUNT] = {
+    [OMAR_RELAY_1] = {.set_gpio = OMAR_COIL_1_SET_GPIO, .reset_gpio = OMAR_COIL_1_RESET_GPIO},
+    [OMAR_RELAY_2] = {.set_gpio = OMAR_COIL_2_SET_GPIO, .reset_gpio = OMAR_COIL_2_RESET_GPIO},
+};
+
+// Each relay's pulses are a deadline light sleep mustn't make late (see omar_power.h):
+#define RELAY_WAKE(relay)           ((omar_wake_t)(OMAR_WAKE_RELAY1 + ((relay) - m_relays)))
+
+// Covers m_relays and m_relays_inhibited:
+static portMUX_TYPE m_relay_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool m_relays_inhibited = false;
+
+// Zero-cross tracking, written from the ZX isr:
+static volatile int64_t m_zx_last = 0;
+static volatile int32_t m_zx_half_period = 0;
+
+static void relay_timer_cb(void *arg);
+static void relay_schedule(relay_t *relay, int64_t now);
+
+#if defined(ADE7953_ZX_SUPPORT)
+/*
+ * The half period is smoothed (1/8 weight per edge) so a single
+ * late interrupt doesn't throw the next few switching times off.
+ */
+static void IRAM_ATTR relay_zx_isr(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    int32_t interval = (int32_t)(now - m_zx_last);
+
+    if (interval >= ZX_MIN_HALF_PERIOD_USEC && interval <= ZX_MAX_HALF_PERIOD_USEC) {
+        m_zx_half_period = (m_zx_half_period == 0 
+                            ? interval 
+                            : m_zx_half_period + (interval - m_zx_half_period) / 8);
+    }
+    m_zx_last = now;
+}
+#endif
+
+/*
+ * relay_zx_fire_time() works out when to energize a coil so the
+ * contacts move 'offset' usec after a zero crossing: the earliest
+ * time at least 'lead' usec from now that's 'offset - delay' after
+ * one of the crossings extrapolated from 'last_zx'.
+ */
+static int64_t relay_zx_fire_time(int64_t now, int64_t last_zx, int32_t half_period,
+                                  int32_t offset, int32_t delay, int32_t lead)
+{
+    int64_t fire = last_zx + offset - delay;
+    int64_t earliest = now + lead;
+
+    if (fire < earliest) {
+        fire += ((earliest - fire + half_period - 1) / half_period) * half_period;
+    } else {
+        fire -= ((fire - earliest) / half_period) * half_period;
+    }
+
+    return fire;
+}
+
+void relay_setup(void)
+{
+    for (int i = 0; i < OMAR_RELAY_COUNT; i++) {
+        relay_t *relay = &m_relays[i];
+        esp_timer_create_args_t args = {
+            .callback = relay_timer_cb,
+            .arg = relay,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "relay",
+        };
+
+        ESP_ERROR_CHECK(esp_timer_create(&args, &relay->timer));
+    }
+
+#if defined(ADE7953_ZX_SUPPORT)
+    gpio_config_t gpio_cfg = {
+        .pin_bit_mask = ((uint64_t)1 << ADE7953_ZX_GPIO),
+        .mode = GPIO_MODE_INPUT,
+        .intr_type = GPIO_INTR_ANYEDGE,
+    };
+    gpio_config(&gpio_cfg);
+
+    // ESP_ERR_INVALID_STATE just means the service is already installed:
+    esp_err_t ret = gpio_install_isr_service(OMAR_GPIO_ISR_FLAGS);
+    if (ret == ESP_OK || ret == ESP_ERR_INVALID_STATE) {
+        gpio_isr_handler_add(ADE7953_ZX_GPIO, relay_zx_isr, NULL);
+    }
+#endif
+}
+
+/*
+ * Must be called with m_relay_lock held and the relay idle.
+ */
+static void relay_schedule(relay_t *relay, int64_t now)
+{
+    int64_t last_zx = m_zx_last;
+    int32_t half_period = m_zx_half_period;
+    int64_t delay = 0;
+
+    relay->pulse_target = relay->target;
+    relay->phase = RELAY_WAITING;
+
+    if (half_period != 0 && now - last_zx < ZX_STALE_USEC) {
+        delay = relay_zx_fire_time(now, last_zx, half_period, 
+                                   OMAR_RELAY_ZX_OFFSET_USEC, OMAR_RELAY_CONTACT_DELAY_USEC, 
+                                   RELAY_MIN_LEAD_USEC) - now;
+    }
+
+    esp_timer_start_once(relay->timer, delay);
+    omar_power_arm(RELAY_WAKE(relay), now + delay);
+}
+
+static void relay_timer_cb(void *arg)
+{
+    relay_t *relay = (relay_t *) arg;
+    int64_t now = esp_timer_get_time();
+    bool moved = false;
+    bool closed = false;
+
+    portENTER_CRITICAL(&m_relay_lock);
+
+    if (relay->phase == RELAY_WAITING) {
+        gpio_set_level(relay->pulse_target ? relay->set_gpio : relay->reset_gpio, true);
+        relay->phase = RELAY_PULSING;
+        esp_timer_start_once(relay->timer, OMAR_RELAY_PULSE_USEC);
+        omar_power_done(RELAY_WAKE(relay));
+        omar_power_arm(RELAY_WAKE(relay), now + OMAR_RELAY_PULSE_USEC);
+
+    } else if (relay->phase == RELAY_PULSING) {
+        gpio_set_level(relay->pulse_target ? relay->set_gpio : relay->reset_gpio, false);
+        omar_power_done(RELAY_WAKE(relay));
+        relay->closed = relay->pulse_target;
+        relay->pulses++;
+        relay->phase = RELAY_IDLE;
+        moved = true;
+        closed = relay->closed;
+
+        // Asked to change again while we were busy?
+        if (relay->target != relay->closed) {
+            relay_schedule(relay, now);
+        }
+    }
+
+    portEXIT_CRITICAL(&m_relay_lock);
+
+    if (moved) {
+        omar_postmortem_save_relay(relay - m_relays, closed);
+    }
+}
+
+/*
+ * relay_set() closes or opens a relay by pulsing the
+ * appropriate coil. Closing is refused while the relays are
+ * inhibited by relay_inhibit().
+ *
+ * The relays latch, so we can't be sure what state they came
+ * up in; a request while idle always gets a pulse, even if it
+ * matches the state we think the relay is in.
+ */
+void relay_set(omar_relay_t which, bool closed)
+{
+    if (which >= OMAR_RELAY_COUNT) {
+        printf("%s(): Invalid relay %d\n", __func__, which);
+        return;
+    }
+
+    relay_t *relay = &m_relays[which];
+    bool inhibited;
+
+    portENTER_CRITICAL(&m_relay_lock);
+    inhibited = (closed && m_relays_inhibited);
+    if (!inhibited) {
+        relay->target = closed;
+        if (relay->phase == RELAY_IDLE) {
+            relay_schedule(relay, esp_timer_get_time());
+        }
+    }
+    portEXIT_CRITICAL(&m_relay_lock);
+
+    if (inhibited) {
+        printf("%s(): Relay #%d is inhibited, leaving it open\n", __func__, which);
+        return;
+    }
+
+#if defined(OMAR_RELAY_VERBOSE)
+    printf("%s(): relay #%d -> %s\n", __func__, which, (closed ? "closed" : "open"));
+#endif
+}
+
+bool relay_get(omar_relay_t which)
+{
+    return (which < OMAR_RELAY_COUNT ? m_relays[which].closed : false);
+}
+
+/*
+ * relay_inhibit(true) opens both relays and keeps them open
+ * until relay_inhibit(false) is called. Lifting the inhibit
+ * doesn't close anything; that's left to the user.
+ */
+void relay_inhibit(bool inhibit)
+{
+    portENTER_CRITICAL(&m_relay_lock);
+    m_relays_inhibited = inhibit;
+    portEXIT_CRITICAL(&m_relay_lock);
+
+    if (inhibit) {
+        for (int relay = 0; relay < OMAR_RELAY_COUNT; relay++) {
+            relay_set(relay, false);
+        }
+    }
+}
+
+void relay_get_info(omar_relay_t which, omar_relay_info_t *info)
+{
+    memset(info, 0, sizeof(*info));
+
+    if (which >= OMAR_RELAY_COUNT) {
+        return;
+    }
+
+    relay_t *relay = &m_relays[which];
+
+    portENTER_CRITICAL(&m_relay_lock);
+    info->closed = relay->closed;
+    info->pulses = relay->pulses;
+    portEXIT_CRITICAL(&m_relay_lock);
+
+    info->zx_half_period_usec = 
+        (esp_timer_get_time() - m_zx_last < ZX_STALE_USEC ? m_zx_half_period : 0);
+}
@@ -0,0 +1,70 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_sample.c - reads the meter, als and temperature channels for
+ * the stream and telemetry
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hw_setup.h"
+#include "adi_spi.h"
+#include "omar_als_timer.h"
+#include "omar_thermal.h"
+#include "omar_sample.h"
+
+#define METER_CHANNELS \
+    (STREAM_CHANNEL_BIT(STREAM_VRMS) | STREAM_CHANNEL_BIT(STREAM_IRMSA) | STREAM_CHANNEL_BIT(STREAM_IRMSB) \
+     | STREAM_CHANNEL_BIT(STREAM_AWATT) | STREAM_CHANNEL_BIT(STREAM_BWATT))
+
+#define ENERGY_CHANNELS \
+    (STREAM_CHANNEL_BIT(STREAM_AENERGY) | STREAM_CHANNEL_BIT(STREAM_BENERGY))
+
+void omar_sample_reset(omar_sample_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void omar_sample_read(omar_sample_ctx_t *ctx, uint32_t mask, int32_t *values)
+{
+    if (mask & METER_CHANNELS) {
+        adi_snapshot_t snapshot;
+
+        if (adi_read_snapshot(&snapshot) == ESP_OK) {
+            values[STREAM_VRMS] = snapshot.vrms;
+            values[STREAM_IRMSA] = snapshot.irmsa;
+            values[STREAM_IRMSB] = snapshot.irmsb;
+            values[STREAM_AWATT] = snapshot.awatt;
+            values[STREAM_BWATT] = snapshot.bwatt;
+        }
+    }
+
+    if (mask & ENERGY_CHANNELS) {
+        adi_energy_t energy;
+
+        if (adi_read_energy(&energy) == ESP_OK) {
+            // The first sample's energy goes back to whenever the totals started, so call it zero:
+            if (!ctx->primed) {
+                ctx->aenergy = energy.aenergy;
+                ctx->benergy = energy.benergy;
+                ctx->primed = true;
+            }
+            values[STREAM_AENERGY] = (int32_t)(energy.aenergy - ctx->aenergy);
+            values[STREAM_BENERGY] = (int32_t)(energy.benergy - ctx->benergy);
+            ctx->aenergy = energy.aenergy;
+            ctx->benergy = energy.benergy;
+        }
+    }
+
+    if (mask & STREAM_CHANNEL_BIT(STREAM_ALS)) {
+        values[STREAM_ALS] = als_get_last_reading();
+    }
+    if (mask & STREAM_CHANNEL_BIT(STREAM_TEMP)) {
+        float temperature = 0.0;
+
+        thermal_get_state(&temperature);
+        values[STREAM_TEMP] = (int32_t)(temperature * 4.0f);   // 0.25C counts
+    }
+}
@@ -0,0 +1,124 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_stream.c - periodic meter, als and temperature records for the
+ * 'stream' console command
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "hw_setup.h"
+#include "utils.h"
+#include "omar_stream.h"
+#include "omar_tasks.h"
+#include "omar_sample.h"
+
+/*
+ * The stream task sits below the als task on the same core (see
+ * omar_tasks.h), so a busy stream can't hold up an als reading; the
+ * samples themselves are paced by an esp_timer, not by the 10 msec
+ * tick.
+ */
+static TaskHandle_t m_stream_task = NULL;
+static esp_timer_handle_t m_stream_timer = NULL;
+static volatile uint32_t m_mask = 0;
+static volatile bool m_running = false;
+static volatile bool m_restart = false;
+static omar_stream_stats_t m_stats;
+static omar_sample_ctx_t m_sample;
+
+static void stream_tick(void *arg)
+{
+    xTaskNotifyGive(m_stream_task);
+}
+
+static void stream_task(void *arg)
+{
+    uint32_t seq = 0;
+
+    while (true) {
+        // More than one tick pending means we fell behind; those periods are gaps:
+        uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (!m_running) {
+            continue;
+        }
+
+        if (m_restart) {
+            // Ticks left over from the last stream don't count against this one:
+            m_restart = false;
+            seq = 0;
+            ticks = 1;
+        }
+
+        int32_t values[STREAM_CHANNEL_COUNT] = {0};
+        char line[STREAM_RECORD_MAX];
+        uint32_t mask = m_mask;
+
+        seq += ticks - 1;
+        m_stats.missed += ticks - 1;
+
+        omar_sample_read(&m_sample, mask, values);
+        stream_record_format(line, sizeof(line), seq++, (uint32_t)(esp_timer_get_time() / 1000), mask, values);
+        fputs(line, stdout);
+        m_stats.records++;
+    }
+}
+
+bool omar_stream_start(uint32_t hz, uint32_t mask)
+{
+    if (hz == 0 || hz > OMAR_STREAM_MAX_HZ || mask == 0 || m_running) {
+        return false;
+    }
+
+    if (m_stream_task == NULL) {
+        const esp_timer_create_args_t args = {
+            .callback = stream_tick,
+            .name = "stream",
+        };
+
+        if (omar_task_create(OMAR_TASK_STREAM, stream_task, NULL, &m_stream_task) != ESP_OK) {
+            printf("%s(): omar_task_create() failed\n", __func__);
+            return false;
+        }
+        ESP_ERROR_CHECK( esp_timer_create(&args, &m_stream_timer) );
+    }
+
+    // The header says which columns follow:
+    printf("# stream %u Hz: seq msec", hz);
+    for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+        if (mask & STREAM_CHANNEL_BIT(ch)) {
+            printf(" %s", stream_channel_name(ch));
+        }
+    }
+    printf("\n");
+
+    memset(&m_stats, 0, sizeof(m_stats));
+    omar_sample_reset(&m_sample);
+    m_mask = mask;
+    m_restart = true;
+    m_running = true;
+
+    ESP_ERROR_CHECK( esp_timer_start_periodic(m_stream_timer, 1000000 / hz) );
+    return true;
+}
+
+void omar_stream_stop(omar_stream_stats_t *stats)
+{
+    if (!m_running) {
+        return;
+    }
+
+    esp_timer_stop(m_stream_timer);
+    m_running = false;
+
+    if (stats) {
+        *stats = m_stats;
+    }
+}
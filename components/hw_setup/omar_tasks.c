@@ -0,0 +1,211 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_tasks.c - which core each of our tasks runs on, at what
+ * priority and with how much stack, and a monitor that keeps an
+ * eye on them
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "trace.h"
+#include "omar_tasks.h"
+
+#if !configTASKLIST_INCLUDE_COREID
+#error "The task monitor needs CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID"
+#endif
+
+typedef struct {
+    const char *name;
+    int core;
+    UBaseType_t prio;
+    uint32_t stack;
+} omar_task_t;
+
+#define OMAR_TASK_ENTRY(id, name, core, prio, stack)    [OMAR_TASK_##id] = { name, core, prio, stack },
+
+static const omar_task_t m_tasks[OMAR_TASK_COUNT] = {
+    OMAR_TASKS(OMAR_TASK_ENTRY)
+};
+
+static omar_lock_stats_t *m_locks[OMAR_TASK_MAX_LOCKS];
+static uint32_t m_lock_count = 0;
+
+static TaskHandle_t m_mon_task = NULL;
+static SemaphoreHandle_t m_mon_lock = NULL;
+static TaskStatus_t m_status[TASK_LOAD_MAX];
+static task_load_t m_load;
+static uint16_t m_busy[portNUM_PROCESSORS];
+static uint32_t m_misplaced = 0;        // OMAR_TASK bits we've already warned about
+
+esp_err_t omar_task_create(omar_task_id_t id, TaskFunction_t fn, void *arg, TaskHandle_t *handle)
+{
+    return omar_task_create_on(id, m_tasks[id].core, fn, arg, handle);
+}
+
+esp_err_t omar_task_create_on(omar_task_id_t id, int core, TaskFunction_t fn, void *arg, TaskHandle_t *handle)
+{
+    const omar_task_t *task = &m_tasks[id];
+
+    if (xTaskCreatePinnedToCore(fn, task->name, task->stack, arg, task->prio, handle, core) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+int omar_task_core(omar_task_id_t id)
+{
+    return m_tasks[id].core;
+}
+
+void omar_task_watch_lock(omar_lock_stats_t *stats)
+{
+    if (m_lock_count >= OMAR_TASK_MAX_LOCKS) {
+        printf("%s(): can't watch the %s lock, already watching %d\n", __func__, stats->name, OMAR_TASK_MAX_LOCKS);
+        return;
+    }
+    stats->id = m_lock_count;
+    m_locks[m_lock_count++] = stats;
+}
+
+void omar_task_take_recursive(SemaphoreHandle_t lock, omar_lock_stats_t *stats)
+{
+    if (xSemaphoreTakeRecursive(lock, 0) == pdTRUE) {
+        return;
+    }
+
+    // The holder may let go before we look, in which case we count a wait that didn't happen:
+    TaskHandle_t holder = xSemaphoreGetMutexHolder(lock);
+    BaseType_t core = (holder != NULL ? xTaskGetAffinity(holder) : tskNO_AFFINITY);
+
+    stats->waits++;
+    if (core != tskNO_AFFINITY && core != xPortGetCoreID()) {
+        stats->cross_core++;
+        TRACE2(TRACE_LOCK_CROSS_CORE, stats->id, core);
+    }
+
+    xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+}
+
+const omar_lock_stats_t *omar_task_get_lock(uint32_t index)
+{
+    return (index < m_lock_count ? m_locks[index] : NULL);
+}
+
+static void task_mon_check_placement(const TaskStatus_t *status)
+{
+    for (int i = 0; i < OMAR_TASK_COUNT; i++) {
+        if ((m_misplaced & (1u << i)) || strcmp(status->pcTaskName, m_tasks[i].name) != 0) {
+            continue;
+        }
+        if (status->xCoreID != m_tasks[i].core) {
+            m_misplaced |= (1u << i);
+            if (status->xCoreID == tskNO_AFFINITY) {
+                printf("%s(): %s isn't pinned, expected it on cpu %d\n", __func__, m_tasks[i].name, m_tasks[i].core);
+            } else {
+                printf("%s(): %s is on cpu %d, expected cpu %d\n", __func__, m_tasks[i].name,
+                       status->xCoreID, m_tasks[i].core);
+            }
+        }
+        return;
+    }
+}
+
+static void task_mon_sample(void)
+{
+    uint32_t now = 0;
+    UBaseType_t count = uxTaskGetSystemState(m_status, TASK_LOAD_MAX, &now);
+
+    if (count == 0) {
+        // It fills in nothing at all unless there's room for every task:
+        m_load.overflows++;
+        return;
+    }
+
+    xSemaphoreTake(m_mon_lock, portMAX_DELAY);
+    task_load_begin(&m_load, now);
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *status = &m_status[i];
+        task_load_entry_t *entry = task_load_update(&m_load, status->xTaskNumber, status->pcTaskName,
+                                                    status->ulRunTimeCounter, status->uxCurrentPriority,
+                                                    (status->xCoreID == tskNO_AFFINITY ? TASK_LOAD_NO_CORE : status->xCoreID),
+                                                    status->usStackHighWaterMark);
+
+        for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+            if (entry != NULL && status->xHandle == xTaskGetIdleTaskHandleForCPU(cpu)) {
+                m_busy[cpu] = 1000 - entry->share;
+            }
+        }
+    }
+    task_load_end(&m_load);
+    xSemaphoreGive(m_mon_lock);
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        task_mon_check_placement(&m_status[i]);
+    }
+}
+
+static void task_mon_check_locks(void)
+{
+    for (uint32_t i = 0; i < m_lock_count; i++) {
+        omar_lock_stats_t *stats = m_locks[i];
+        uint32_t cross_core = stats->cross_core;
+
+        if (cross_core != stats->warned) {
+            printf("%s(): %u more waits on the %s lock held from the other cpu (%u in all)\n", __func__,
+                   cross_core - stats->warned, stats->name, cross_core);
+            stats->warned = cross_core;
+        }
+    }
+}
+
+static void task_mon_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+
+    while (1) {
+        task_mon_sample();
+        task_mon_check_locks();
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(OMAR_TASK_MON_PERIOD_MS));
+    }
+}
+
+esp_err_t omar_task_mon_start(void)
+{
+    if (m_mon_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    task_load_reset(&m_load);
+    m_mon_lock = xSemaphoreCreateMutex();
+    if (m_mon_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = omar_task_create(OMAR_TASK_TASK_MON, task_mon_task, NULL, &m_mon_task);
+    if (ret != ESP_OK) {
+        printf("%s(): omar_task_create() failed, tasks won't be monitored\n", __func__);
+    }
+    return ret;
+}
+
+bool omar_task_mon_get(task_load_t *load, uint16_t busy[portNUM_PROCESSORS])
+{
+    if (m_mon_lock == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(m_mon_lock, portMAX_DELAY);
+    bool sampled = (m_load.samples > 0);
+    memcpy(load, &m_load, sizeof(*load));
+    memcpy(busy, m_busy, sizeof(m_busy));
+    xSemaphoreGive(m_mon_lock);
+
+    return sampled;
+}
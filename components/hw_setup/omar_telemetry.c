@@ -0,0 +1,146 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_telemetry.c - publishes meter, als and temperature samples to
+ * a collector on the network
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "omar_telemetry.h"
+#include "omar_tasks.h"
+#include "omar_sample.h"
+
+/*
+ * The telemetry task runs on the pro cpu with wifi and the other
+ * flash writers (the spill file lives on the storage partition). It
+ * wakes every OMAR_TELEMETRY_POLL_MS to take any sample that's due
+ * and to let the publisher send what the socket will take; m_lock
+ * keeps the console's start, stop and stats off the publisher while
+ * it does.
+ */
+static TaskHandle_t m_telemetry_task = NULL;
+static SemaphoreHandle_t m_lock = NULL;
+static const char *m_spill_path = NULL;
+static telem_pub_t m_pub;
+static uint8_t m_queue_buf[CONFIG_TELEMETRY_QUEUE_SIZE];
+static omar_sample_ctx_t m_sample;
+static bool m_running = false;
+static uint32_t m_hz = 0;
+static uint32_t m_next_sample_ms = 0;
+static uint32_t m_stopped_ms = 0;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void telemetry_task(void *arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+
+    while (true) {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(OMAR_TELEMETRY_POLL_MS));
+
+        xSemaphoreTake(m_lock, portMAX_DELAY);
+        if (m_running) {
+            uint32_t now = now_ms();
+
+            if ((int32_t)(now - m_next_sample_ms) >= 0) {
+                telem_sample_t sample = { .msec = now };
+
+                omar_sample_read(&m_sample, m_pub.cfg.mask, sample.values);
+                telem_pub_add(&m_pub, &sample, now);
+
+                // A late sample doesn't make the next one early:
+                m_next_sample_ms += 1000 / m_hz;
+                if ((int32_t)(now - m_next_sample_ms) >= 0) {
+                    m_next_sample_ms = now + 1000 / m_hz;
+                }
+            }
+            telem_pub_poll(&m_pub, now);
+        }
+        xSemaphoreGive(m_lock);
+    }
+}
+
+void omar_telemetry_init(const char *spill_path)
+{
+    m_spill_path = spill_path;
+    m_lock = xSemaphoreCreateMutex();
+}
+
+bool omar_telemetry_start(const telem_pub_config_t *cfg, uint32_t hz)
+{
+    if (m_lock == NULL || hz == 0 || hz > OMAR_TELEMETRY_MAX_HZ || cfg->mask == 0) {
+        return false;
+    }
+
+    if (m_telemetry_task == NULL) {
+        if (omar_task_create(OMAR_TASK_TELEMETRY, telemetry_task, NULL, &m_telemetry_task) != ESP_OK) {
+            printf("%s(): omar_task_create() failed\n", __func__);
+            return false;
+        }
+    }
+
+    telem_pub_config_t pub_cfg = *cfg;
+    bool started = false;
+
+    pub_cfg.batch_ms = OMAR_TELEMETRY_BATCH_MS;
+    pub_cfg.spill_path = m_spill_path;
+    pub_cfg.spill_max = CONFIG_TELEMETRY_SPILL_MAX;
+
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    if (!m_running && telem_pub_init(&m_pub, &pub_cfg, m_queue_buf, sizeof(m_queue_buf), now_ms())) {
+        omar_sample_reset(&m_sample);
+        m_hz = hz;
+        m_next_sample_ms = now_ms();
+        m_running = true;
+        started = true;
+    }
+    xSemaphoreGive(m_lock);
+
+    return started;
+}
+
+void omar_telemetry_stop(void)
+{
+    if (m_lock == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    if (m_running) {
+        telem_pub_close(&m_pub);
+        m_stopped_ms = now_ms();
+        m_running = false;
+    }
+    xSemaphoreGive(m_lock);
+}
+
+void omar_telemetry_get_status(omar_telemetry_status_t *status)
+{
+    memset(status, 0, sizeof(*status));
+    if (m_lock == NULL) {
+        return;
+    }
+
+    // The publisher's numbers stay put after a stop, until the next start:
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    status->running = m_running;
+    status->cfg = m_pub.cfg;
+    status->hz = m_hz;
+    status->uptime_ms = (m_hz != 0 ? (m_running ? now_ms() : m_stopped_ms) - m_pub.stats.started_ms : 0);
+    status->queued = telem_queue_used(&m_pub.queue);
+    status->spill_pending = (m_pub.cfg.spill_path != NULL ? telem_spill_pending(&m_pub.spill) : 0);
+    status->stats = m_pub.stats;
+    xSemaphoreGive(m_lock);
+}
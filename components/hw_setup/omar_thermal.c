@@ -0,0 +1,162 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_thermal.c - thermal supervisor. Programs the S-5852A's lower, upper
+ * and critical limits, then polls the sensor at a reduced rate (every
+ * OMAR_THERMAL_SAMPLE_INTERVAL_MS) to keep a history. Each read returns the
+ * limit flags along with the temperature, and those drive the led derating
+ * and relay protection policies. The EVENT output isn't routed on the
+ * current board, so a crossing is only noticed at the next poll; the
+ * interrupt path behind S5852A_EVENT_SUPPORT is untested.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "hw_setup.h"
+#include "s5852a.h"
+#include "omar_thermal.h"
+#include "omar_thermal_policy.h"
+#include "omar_tasks.h"
+
+// Enable OMAR_THERMAL_VERBOSE to see every reading the supervisor takes
+//#define OMAR_THERMAL_VERBOSE
+
+// After a failed read, try again this soon rather than waiting for the next event:
+#define THERMAL_RETRY_INTERVAL_MS   (1000)
+
+#define THERMAL_IDLE_WAIT           (OMAR_THERMAL_SAMPLE_INTERVAL_MS/portTICK_PERIOD_MS)
+
+static void thermal_task(void *arg);
+
+static SemaphoreHandle_t m_event;
+static SemaphoreHandle_t m_history_lock;
+static temp_history_t m_history;
+static volatile thermal_state_t m_state = THERMAL_STATE_NORMAL;
+static volatile float m_temperature;
+
+static const char *m_state_names[] = {
+    [THERMAL_STATE_NORMAL]   = "normal",
+    [THERMAL_STATE_COLD]     = "cold",
+    [THERMAL_STATE_DERATED]  = "derated",
+    [THERMAL_STATE_CRITICAL] = "critical",
+};
+
+#if defined(S5852A_EVENT_SUPPORT)
+static void IRAM_ATTR thermal_event_isr(void *arg)
+{
+    BaseType_t woken = pdFALSE;
+
+    xSemaphoreGiveFromISR(m_event, &woken);
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+#endif
+
+void thermal_setup(void)
+{
+    if (s5852a_set_limits(OMAR_THERMAL_LOWER_C, 
+                          OMAR_THERMAL_UPPER_C, 
+                          OMAR_THERMAL_CRITICAL_C) != ESP_OK) {
+        printf("%s(): couldn't program the temperature limits, thermal supervision is disabled\n", __func__);
+        return;
+    }
+
+    m_event = xSemaphoreCreateBinary();
+    m_history_lock = xSemaphoreCreateMutex();
+    temp_history_reset(&m_history);
+
+#if defined(S5852A_EVENT_SUPPORT)
+    /*
+     * EVENT is in comparator mode, so it changes level both when a
+     * limit is crossed and when the temperature comes back; either
+     * edge means the state needs another look. The gpio isr service
+     * has already been installed by the button setup.
+     */
+    gpio_config_t gpio_cfg = {
+        .pin_bit_mask = ((uint64_t)1 << OMAR_TEMP_EVENT_GPIO),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = 1,
+        .intr_type = GPIO_INTR_ANYEDGE,
+    };
+    gpio_config(&gpio_cfg);
+    gpio_isr_handler_add(OMAR_TEMP_EVENT_GPIO, thermal_event_isr, NULL);
+#endif
+
+    omar_task_create(OMAR_TASK_THERMAL, thermal_task, NULL, NULL);
+}
+
+thermal_state_t thermal_get_state(float *temperature)
+{
+    if (temperature) {
+        *temperature = m_temperature;
+    }
+    return m_state;
+}
+
+bool thermal_get_history(temp_history_t *history)
+{
+    if (m_history_lock == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(m_history_lock, portMAX_DELAY);
+    memcpy(history, &m_history, sizeof(m_history));
+    xSemaphoreGive(m_history_lock);
+
+    return true;
+}
+
+const char *thermal_state_name(thermal_state_t state)
+{
+    return (state <= THERMAL_STATE_CRITICAL ? m_state_names[state] : "unknown");
+}
+
+static void thermal_task(void *arg)
+{
+    TickType_t wait = 0;    // take the first reading straight away
+
+    while (1) {
+        xSemaphoreTake(m_event, wait);
+
+        float temperature;
+        uint8_t alarms;
+
+        if (s5852a_get_alarms(&temperature, &alarms) != ESP_OK) {
+            wait = THERMAL_RETRY_INTERVAL_MS/portTICK_PERIOD_MS;
+            continue;
+        }
+        wait = THERMAL_IDLE_WAIT;
+
+        m_temperature = temperature;
+
+        xSemaphoreTake(m_history_lock, portMAX_DELAY);
+        temp_history_record(&m_history, 
+                            (uint32_t)(esp_timer_get_time() / 1000000), 
+                            TEMP_HISTORY_TO_QUARTERS(temperature));
+        xSemaphoreGive(m_history_lock);
+
+        thermal_state_t state = thermal_classify(m_state, alarms);
+
+#if defined(OMAR_THERMAL_VERBOSE)
+        printf("%s(): %.2fC, alarms 0x%x, state %s\n", __func__, temperature, alarms, thermal_state_name(state));
+#endif
+
+        if (state != m_state) {
+            printf("%s(): thermal state %s -> %s at %.2fC\n", 
+                   __func__,
+                   thermal_state_name(m_state),
+                   thermal_state_name(state),
+                   temperature);
+
+            thermal_apply(state);
+            m_state = state;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_thermal_policy.c - what the thermal supervisor makes of the
+ * S-5852A's limit flags, and what it does about it
+ *
+ */
+
+#include <stdint.h>
+#include "hw_setup.h"
+#include "s5852a.h"
+#include "omar_relay.h"
+#include "omar_led.h"
+#include "omar_thermal_policy.h"
+
+/*
+ * The sensor does the comparisons for us; the only state we keep
+ * is the critical trip, which latches until the temperature is
+ * back below the upper limit so the relays don't chatter around
+ * the critical threshold.
+ */
+thermal_state_t thermal_classify(thermal_state_t current, uint8_t alarms)
+{
+    if (alarms & S5852A_ALARM_CRITICAL) {
+        return THERMAL_STATE_CRITICAL;
+    }
+
+    if (alarms & S5852A_ALARM_UPPER) {
+        return (current == THERMAL_STATE_CRITICAL ? THERMAL_STATE_CRITICAL : THERMAL_STATE_DERATED);
+    }
+
+    if (alarms & S5852A_ALARM_LOWER) {
+        return THERMAL_STATE_COLD;
+    }
+
+    return THERMAL_STATE_NORMAL;
+}
+
+void thermal_apply(thermal_state_t state)
+{
+    switch (state) {
+
+    case THERMAL_STATE_CRITICAL:
+        led_set_duty_limit(0);
+        relay_inhibit(true);
+        break;
+
+    case THERMAL_STATE_DERATED:
+        led_set_duty_limit(OMAR_THERMAL_DERATED_DUTY);
+        relay_inhibit(false);
+        break;
+
+    case THERMAL_STATE_NORMAL:
+    case THERMAL_STATE_COLD:
+    default:
+        led_set_duty_limit(OMAR_LED_MAX_DUTY);
+        relay_inhibit(false);
+        break;
+    }
+}
@@ -0,0 +1,159 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_als_timer.c - omar_als_timer.c and omar_led.c running as they
+ * do on the target, against the host timer group, ledc and adc: every
+ * reading is taken with the leds off and puts them back after, none
+ * is taken mid-fade, and a sample capture takes every sample without
+ * losing an event
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "unit.h"
+#include "host.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/adc.h"
+#include "hw_setup.h"
+#include "omar_als_timer.h"
+#include "omar_led.h"
+#include "omar_led_curve.h"
+#include "omar_power.h"
+
+#define PRIMARY_SEC                 (0.1)
+#define SAMPLE_SEC                  (0.0001)
+#define WAIT_MS                     (5000)
+#define LED0_CHANNEL                (0)
+#define LED1_CHANNEL                (1)
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t m_reads = 0;
+static uint32_t m_reads_lit = 0;
+
+// The sensor: counts its reads, and any taken while an led is driven:
+static int als_sensor(int channel, void *ctx)
+{
+    (void) channel;
+    (void) ctx;
+
+    pthread_mutex_lock(&m_lock);
+    uint32_t n = ++m_reads;
+    if (host_ledc_duty(LED0_CHANNEL) != 0 || host_ledc_duty(LED1_CHANNEL) != 0) {
+        m_reads_lit++;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    return (int)(1000 + n % 1000);
+}
+
+static uint32_t reads(void)
+{
+    pthread_mutex_lock(&m_lock);
+    uint32_t n = m_reads;
+    pthread_mutex_unlock(&m_lock);
+    return n;
+}
+
+static bool wait_reads(uint32_t count)
+{
+    for (int waited = 0; waited < WAIT_MS; waited++) {
+        if (reads() >= count) {
+            return true;
+        }
+        host_sleep_usec(1000);
+    }
+    return false;
+}
+
+static void test_setup(void)
+{
+    host_adc_source(VOUT_LGHT_SNSR__ADC_CHANNEL, als_sensor, NULL);
+    adc1_config_channel_atten(VOUT_LGHT_SNSR__ADC_CHANNEL, ADC_ATTEN_DB_11);
+
+    led_setup();
+    set_als_timer_period(PRIMARY_TIMER, PRIMARY_SEC);
+    set_als_timer_period(ALS_SAMPLE_TIMER, SAMPLE_SEC);
+    timer_setup();
+
+    CHECK_EQ(als_get_last_reading(), -1);
+}
+
+static void test_readings_dark(void)
+{
+    led_set_brightness(OMAR_WHITE_LED0, OMAR_LED_MAX_DUTY);
+    host_sleep_usec(50 * 1000);
+    CHECK_EQ(host_ledc_duty(LED0_CHANNEL), OMAR_LED_MAX_DUTY_Q3 << 1);
+
+    uint32_t start = reads();
+
+    enable_als_timer(true);
+    CHECK(wait_reads(start + 5));
+    enable_als_timer(false);
+    host_sleep_usec(50 * 1000);
+
+    // Each one taken with both leds off, and led 0 back on afterwards:
+    CHECK_EQ(m_reads_lit, 0);
+    CHECK_EQ(als_get_last_reading(), (int)(1000 + reads() % 1000));
+    CHECK_EQ(host_ledc_duty(LED0_CHANNEL), OMAR_LED_MAX_DUTY_Q3 << 1);
+    CHECK_EQ(als_get_dropped_events(), 0);
+    CHECK_EQ(host_task_wdt_timeouts(), 0);
+}
+
+/*
+ * An led that's fading can't be paused mid-fade (the engine would
+ * carry on from wherever it had got to), so the cycles that land in
+ * a fade are skipped rather than read with the light on.
+ */
+static void test_skipped_while_fading(void)
+{
+    uint32_t before;
+
+    led_fade_brightness(OMAR_WHITE_LED0, 0, 1000);
+    host_sleep_usec(20 * 1000);
+    before = reads();
+
+    enable_als_timer(true);
+    host_sleep_usec(700 * 1000);
+    CHECK_EQ(reads(), before);
+
+    // ...and once it's over, the readings start again:
+    CHECK(wait_reads(before + 2));
+    enable_als_timer(false);
+
+    // Let the last cycle's reading through; it pauses timer 1, which the capture shares:
+    host_sleep_usec(50 * 1000);
+    CHECK_EQ(m_reads_lit, 0);
+    CHECK_EQ(host_ledc_duty(LED0_CHANNEL), 0);
+}
+
+static void test_sample_capture(void)
+{
+    omar_power_status_t status;
+    uint32_t before = reads();
+
+    start_als_sample_capture();
+    CHECK(wait_reads(before + ALS_SAMPLE_COUNT));
+    host_sleep_usec(100 * 1000);
+
+    // Every sample, no more, and the four progress events and the last one all got through:
+    CHECK_EQ(reads() - before, ALS_SAMPLE_COUNT);
+    CHECK_EQ(als_get_dropped_events(), 0);
+
+    // The timer group stops in light sleep, so the capture held it off until it was done:
+    omar_power_get_status(&status);
+    CHECK(status.holds[OMAR_POWER_ALS].count >= 1);
+    CHECK(!status.holds[OMAR_POWER_ALS].held);
+}
+
+int main(void)
+{
+    RUN(test_setup);
+    RUN(test_readings_dark);
+    RUN(test_skipped_while_fading);
+    RUN(test_sample_capture);
+    return unit_done();
+}
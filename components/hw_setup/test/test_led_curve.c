@@ -0,0 +1,109 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_led_curve.c - the compile-time CIE 1931 table: monotonic, the
+ * right ends, close to the formula, and no step bigger than it should be
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "unit.h"
+#include "hw_setup.h"
+#include "omar_led_curve.h"
+
+// The formula the table is generated from, worked out at run time:
+static double cie_duty_q3(uint32_t level)
+{
+    double l = level / 10.0;
+    double y = (l <= 8.0 ? l / 903.3 : pow((l + 16.0) / 116.0, 3.0));
+
+    return y * OMAR_LED_MAX_DUTY_Q3;
+}
+
+static void test_ends(void)
+{
+    CHECK_EQ(led_level_to_duty_q3(0), 0);
+    CHECK_EQ(led_level_to_duty_q3(OMAR_LED_LEVEL_MAX), OMAR_LED_MAX_DUTY_Q3);
+
+    // Past the top is the top:
+    CHECK_EQ(led_level_to_duty_q3(OMAR_LED_LEVEL_MAX + 1), OMAR_LED_MAX_DUTY_Q3);
+    CHECK_EQ(led_level_to_duty_q3(UINT32_MAX), OMAR_LED_MAX_DUTY_Q3);
+
+    // The first level is on, but below one whole pwm count (the hardware dithers it):
+    CHECK(led_level_to_duty_q3(1) > 0);
+    CHECK(led_level_to_duty_q3(1) < (1 << OMAR_LED_DUTY_Q3_SHIFT));
+}
+
+static void test_matches_formula(void)
+{
+    for (uint32_t level = 0; level <= OMAR_LED_LEVEL_MAX; level++) {
+        double error = fabs(led_level_to_duty_q3(level) - cie_duty_q3(level));
+
+        if (!CHECK(error <= 0.5)) {
+            printf("    level %u: %u, not %.2f\n", level, led_level_to_duty_q3(level), cie_duty_q3(level));
+            break;
+        }
+    }
+}
+
+static void test_monotonic(void)
+{
+    for (uint32_t level = 1; level <= OMAR_LED_LEVEL_MAX; level++) {
+        if (!CHECK(led_level_to_duty_q3(level) > led_level_to_duty_q3(level - 1))) {
+            printf("    level %u: %u after %u\n", level,
+                   led_level_to_duty_q3(level), led_level_to_duty_q3(level - 1));
+            break;
+        }
+    }
+}
+
+static void test_max_step(void)
+{
+    uint32_t max_step = 0;
+    uint32_t max_step_at = 0;
+
+    for (uint32_t level = 1; level <= OMAR_LED_LEVEL_MAX; level++) {
+        uint32_t step = led_level_to_duty_q3(level) - led_level_to_duty_q3(level - 1);
+
+        if (step > max_step) {
+            max_step = step;
+            max_step_at = level;
+        }
+    }
+
+    /*
+     * dY/dL* peaks at the top of the curve, 3/116 per unit of L*;
+     * a level is 0.1 L*, so the biggest step is ~0.26% of full
+     * scale (21 pwm counts), at the very top (give or take rounding):
+     */
+    CHECK(max_step <= (uint32_t)(OMAR_LED_MAX_DUTY_Q3 * 0.3 / 116.0) + 1);
+    CHECK(max_step_at >= OMAR_LED_LEVEL_MAX - 10);
+
+    // ...while the bottom tenth, 10% duty on a linear curve, is barely 1%:
+    CHECK(led_level_to_duty_q3(OMAR_LED_LEVEL_MAX / 10) < OMAR_LED_MAX_DUTY_Q3 / 80);
+}
+
+static void test_inverse(void)
+{
+    for (uint32_t level = 0; level <= OMAR_LED_LEVEL_MAX; level++) {
+        CHECK_EQ(led_duty_q3_to_level(led_level_to_duty_q3(level)), level);
+    }
+
+    // A duty between two levels comes back as the upper one:
+    uint32_t between = led_level_to_duty_q3(500) + 1;
+
+    CHECK_EQ(led_duty_q3_to_level(between), 501);
+    CHECK_EQ(led_duty_q3_to_level(OMAR_LED_MAX_DUTY_Q3 + 100), OMAR_LED_LEVEL_MAX);
+}
+
+int main(void)
+{
+    RUN(test_ends);
+    RUN(test_matches_formula);
+    RUN(test_monotonic);
+    RUN(test_max_step);
+    RUN(test_inverse);
+
+    return unit_done();
+}
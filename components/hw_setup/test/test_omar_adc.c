@@ -0,0 +1,114 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_omar_adc.c - omar_adc.c on the host adc1 and esp_adc_cal
+ * stand-ins: which channel each input reads, the batch statistics,
+ * and the tables against esp_adc_cal at every code
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "unit.h"
+#include "host.h"
+#include "driver/adc.h"
+#include "esp_adc_cal.h"
+#include "hw_setup.h"
+#include "omar_adc.h"
+
+// A noisy input: 2000 plus a sawtooth from -8 to +7, sixteen reads to a cycle:
+static int sawtooth(int channel, void *ctx)
+{
+    uint32_t *n = (uint32_t *) ctx;
+
+    (void) channel;
+    return 2000 + (int)((*n)++ % 16) - 8;
+}
+
+static void test_not_ready(void)
+{
+    omar_adc_reading_t reading;
+    uint32_t worst;
+
+    CHECK_EQ(omar_adc_read(OMAR_ADC_ALS, 1, &reading), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(omar_adc_check(OMAR_ADC_ALS, &worst), 0);
+    CHECK(strcmp(omar_adc_cal_name(OMAR_ADC_ALS), "not characterized") == 0);
+}
+
+static void test_init(void)
+{
+    CHECK_EQ(omar_adc_init(), ESP_OK);
+
+    // No efuse values on the host, so both fall back on DEFAULT_VREF:
+    CHECK(strcmp(omar_adc_cal_name(OMAR_ADC_ALS), "default vref") == 0);
+    CHECK(strcmp(omar_adc_cal_name(OMAR_ADC_HW_DET), "default vref") == 0);
+    CHECK(strcmp(omar_adc_name(OMAR_ADC_HW_DET), "hw_det") == 0);
+}
+
+static void test_channels(void)
+{
+    omar_adc_reading_t reading;
+
+    host_adc_set(VOUT_LGHT_SNSR__ADC_CHANNEL, 3000);
+    host_adc_set(HW_DET__ADC_CHANNEL, 150);
+
+    CHECK_EQ(omar_adc_read(OMAR_ADC_ALS, 4, &reading), ESP_OK);
+    CHECK_EQ(reading.raw, 3000);
+    CHECK_EQ(omar_adc_read(OMAR_ADC_HW_DET, 4, &reading), ESP_OK);
+    CHECK_EQ(reading.raw, 150);
+    CHECK_EQ(reading.raw_min, 150);
+    CHECK_EQ(reading.raw_max, 150);
+}
+
+static void test_batch(void)
+{
+    esp_adc_cal_characteristics_t chars;
+    omar_adc_reading_t reading;
+    uint32_t n = 0;
+    uint32_t reads = host_adc_reads();
+    uint32_t mv_sum = 0;
+
+    host_adc_source(VOUT_LGHT_SNSR__ADC_CHANNEL, sawtooth, &n);
+    CHECK_EQ(omar_adc_read(OMAR_ADC_ALS, OMAR_ADC_SAMPLES, &reading), ESP_OK);
+    host_adc_source(VOUT_LGHT_SNSR__ADC_CHANNEL, NULL, NULL);
+
+    CHECK_EQ(host_adc_reads() - reads, OMAR_ADC_SAMPLES);
+    CHECK_EQ(reading.samples, OMAR_ADC_SAMPLES);
+    CHECK_EQ(reading.raw_min, 1992);
+    CHECK_EQ(reading.raw_max, 2007);
+    CHECK_EQ(reading.raw, 2000);        // 1999.5, rounded
+
+    // The millivolts are the mean of the converted samples, not the conversion of the mean:
+    esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &chars);
+    for (int raw = 1992; raw <= 2007; raw++) {
+        mv_sum += esp_adc_cal_raw_to_voltage(raw, &chars);
+    }
+    CHECK(reading.mv + 1 >= (mv_sum + 8) / 16 && reading.mv <= (mv_sum + 8) / 16 + 1);
+
+    CHECK_EQ(omar_adc_read(OMAR_ADC_ALS, 0, &reading), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(omar_adc_read(OMAR_ADC_ALS, OMAR_ADC_SAMPLES_MAX + 1, &reading), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(omar_adc_read(OMAR_ADC_COUNT, 1, &reading), ESP_ERR_INVALID_ARG);
+}
+
+static void test_tables(void)
+{
+    for (int channel = 0; channel < OMAR_ADC_COUNT; channel++) {
+        uint32_t worst_raw;
+        uint32_t worst = omar_adc_check(channel, &worst_raw);
+
+        if (!CHECK(worst <= 1)) {
+            printf("    %s: %u mV off at code %u\n", omar_adc_name(channel), worst, worst_raw);
+        }
+    }
+}
+
+int main(void)
+{
+    RUN(test_not_ready);
+    RUN(test_init);
+    RUN(test_channels);
+    RUN(test_batch);
+    RUN(test_tables);
+    return unit_done();
+}
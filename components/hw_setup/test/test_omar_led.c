@@ -0,0 +1,312 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_omar_led.c - the led service with many tasks queueing commands
+ * at once, against the ledc stand-in: no command is lost or applied
+ * out of order, the als pause handshake holds both leds dark however
+ * it races them, and the leds settle on the last command applied
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "unit.h"
+#include "host.h"
+#include "hw_setup.h"
+#include "omar_led.h"
+
+// The led on each ledc channel, as omar_led.c sets them up:
+#define LEDS                        (2)
+static const uint8_t m_led_gpio[LEDS] = { OMAR_WHITE_LED0, OMAR_WHITE_LED1 };
+
+#define PRODUCERS                   (8)
+#define COMMANDS                    (400)       // per producer, alternating between the leds
+#define PER_LED                     (COMMANDS / 2)
+
+// Each producer's duties are its own: 1 + producer * SPAN + the command's number on that led
+#define SPAN                        (1000)
+#define DUTY(p, k)                  (1 + (p) * SPAN + (k))
+
+// Where both leds start each run, outside every producer's span:
+#define START_DUTY                  (1 + PRODUCERS * SPAN)
+
+// In the fading run the first producer fades now and then, over a couple of ticks:
+#define FADE_EVERY                  (50)
+#define FADE_MSEC                   (10)
+
+// Long enough for the led task to drain its queue and finish any fade:
+#define SETTLE_USEC                 (100 * 1000)
+
+#define LOG_MAX                     (4 * PRODUCERS * COMMANDS)
+
+typedef struct {
+    uint32_t duty;              // whole counts
+    bool fade;
+} entry_t;
+
+static pthread_mutex_t m_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static entry_t m_log[LEDS][LOG_MAX];
+static int m_log_count[LEDS];
+
+static atomic_int m_producing;
+static bool m_fading_run;
+
+// Every duty the led task latches or fades to, in order:
+static void ledc_watch(int channel, uint32_t duty, bool fade, void *ctx)
+{
+    (void) ctx;
+
+    if (channel < 0 || channel >= LEDS) {
+        return;
+    }
+    pthread_mutex_lock(&m_log_lock);
+    if (m_log_count[channel] < LOG_MAX) {
+        m_log[channel][m_log_count[channel]++] = (entry_t){ duty >> 4, fade };
+    }
+    pthread_mutex_unlock(&m_log_lock);
+}
+
+static void log_reset(void)
+{
+    pthread_mutex_lock(&m_log_lock);
+    memset(m_log_count, 0, sizeof(m_log_count));
+    pthread_mutex_unlock(&m_log_lock);
+}
+
+static void *producer(void *arg)
+{
+    int p = (int)(intptr_t) arg;
+
+    for (int i = 0; i < COMMANDS; i++) {
+        int k = i / 2;
+        uint32_t fade = (m_fading_run && p == 0 && k % FADE_EVERY == 0 ? FADE_MSEC : 0);
+
+        led_fade_brightness(m_led_gpio[i % 2], DUTY(p, k), fade);
+        if (i % 4 == 0) {
+            host_sleep_usec(1000);
+        }
+    }
+    atomic_fetch_sub(&m_producing, 1);
+    return NULL;
+}
+
+typedef struct {
+    uint32_t ok;
+    uint32_t refused;
+    uint32_t lit;               // times a paused led was found on, or fading
+} pauses_t;
+
+static bool both_dark(void)
+{
+    return (host_ledc_duty(0) == 0 && host_ledc_duty(1) == 0 &&
+            !host_ledc_fading(0) && !host_ledc_fading(1));
+}
+
+// What the als task does around each sample, for as long as the producers are busy:
+static void *pauser(void *arg)
+{
+    pauses_t *pauses = arg;
+
+    while (atomic_load(&m_producing) > 0) {
+        if (led_als_pause()) {
+            pauses->ok++;
+            pauses->lit += !both_dark();
+            host_sleep_usec(300);
+            pauses->lit += !both_dark();
+            led_als_resume();
+        } else {
+            pauses->refused++;
+        }
+        host_sleep_usec(200);
+    }
+    return NULL;
+}
+
+static void run(bool fading, bool pausing, pauses_t *pauses)
+{
+    pthread_t producers[PRODUCERS], als;
+
+    m_fading_run = fading;
+    memset(pauses, 0, sizeof(*pauses));
+    for (int ch = 0; ch < LEDS; ch++) {
+        led_set_brightness(m_led_gpio[ch], START_DUTY);
+    }
+    host_sleep_usec(SETTLE_USEC);
+    log_reset();
+
+    atomic_store(&m_producing, PRODUCERS);
+    for (int p = 0; p < PRODUCERS; p++) {
+        pthread_create(&producers[p], NULL, producer, (void *)(intptr_t) p);
+    }
+    if (pausing) {
+        pthread_create(&als, NULL, pauser, pauses);
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        pthread_join(producers[p], NULL);
+    }
+    if (pausing) {
+        pthread_join(als, NULL);
+    }
+    host_sleep_usec(SETTLE_USEC);
+}
+
+/*
+ * Each producer's duties on a led come out in the order it asked for
+ * them. With 'all' set every one of them must, exactly once; otherwise
+ * the service may pass over ones that were overtaken while it was
+ * paused or fading, and the resume may put the last one back. Returns
+ * the number of pause writes (duty 0) seen.
+ */
+static uint32_t check_order(int ch, bool all)
+{
+    int next[PRODUCERS];
+    uint32_t dark = 0, bad = 0;
+    uint32_t prev = 0;
+
+    memset(next, 0, sizeof(next));
+    pthread_mutex_lock(&m_log_lock);
+    for (int i = 0; i < m_log_count[ch]; i++) {
+        uint32_t duty = m_log[ch][i].duty;
+
+        if (duty == 0) {
+            dark++;
+        } else if (duty == START_DUTY) {
+            // A resume before any producer's command got to this led
+            bad += (all || prev != 0);
+        } else {
+            int p = (duty - 1) / SPAN;
+            int k = (duty - 1) % SPAN;
+
+            if (p >= PRODUCERS || k >= PER_LED) {
+                bad++;
+            } else if (all) {
+                bad += (k != next[p]);
+                next[p] = k + 1;
+            } else {
+                // Going back is never right; writing the same one twice is only the resume:
+                bad += (k < next[p] - 1 || (k == next[p] - 1 && prev != 0));
+                next[p] = (k + 1 > next[p] ? k + 1 : next[p]);
+            }
+        }
+        prev = duty;
+    }
+    pthread_mutex_unlock(&m_log_lock);
+
+    CHECK_EQ(bad, 0);
+    if (all) {
+        for (int p = 0; p < PRODUCERS; p++) {
+            CHECK_EQ(next[p], PER_LED);
+        }
+    }
+    return dark;
+}
+
+/*
+ * Once it's all gone quiet each led is at the last duty applied,
+ * which has to be some producer's last command to it, and the
+ * getters agree with the output.
+ */
+static void check_settled(int ch)
+{
+    pthread_mutex_lock(&m_log_lock);
+    CHECK(m_log_count[ch] > 0);
+    uint32_t last = m_log[ch][m_log_count[ch] - 1].duty;
+    pthread_mutex_unlock(&m_log_lock);
+
+    CHECK(last > 0 && (last - 1) % SPAN == PER_LED - 1);
+    CHECK_EQ(host_ledc_duty(ch), last << 4);
+    CHECK(!host_ledc_fading(ch));
+    CHECK_EQ(led_get_brightness(m_led_gpio[ch]), last);
+}
+
+static void check_ledc_stats(void)
+{
+    host_ledc_stats_t stats;
+
+    // Only the led task ever touched the driver, and never cut into or stacked up a fade:
+    host_ledc_get_stats(&stats);
+    CHECK_EQ(stats.foreign_calls, 0);
+    CHECK_EQ(stats.overlaps, 0);
+    CHECK_EQ(stats.fades_blocked, 0);
+    CHECK_EQ(stats.fades_cut_short, 0);
+}
+
+static void test_setup(void)
+{
+    led_setup();
+    host_sleep_usec(SETTLE_USEC);
+
+    // The channels were configured from here; from now on the led task should be the only caller:
+    host_ledc_reset();
+    host_ledc_watch(ledc_watch, NULL);
+}
+
+// Every command from every producer is applied, each producer's in order:
+static void test_no_lost_commands(void)
+{
+    pauses_t pauses;
+
+    run(false, false, &pauses);
+    for (int ch = 0; ch < LEDS; ch++) {
+        CHECK_EQ(m_log_count[ch], PRODUCERS * PER_LED);
+        CHECK_EQ(check_order(ch, true), 0);
+        check_settled(ch);
+    }
+    check_ledc_stats();
+}
+
+/*
+ * An als task pausing and resuming as fast as it can: every pause is
+ * granted, both leds go dark once for each and stay that way until the
+ * resume, whatever the producers ask for in the meantime.
+ */
+static void test_pause_races_producers(void)
+{
+    pauses_t pauses;
+
+    run(false, true, &pauses);
+    printf("    %u pauses\n", pauses.ok);
+
+    CHECK(pauses.ok > 0);
+    CHECK_EQ(pauses.refused, 0);
+    CHECK_EQ(pauses.lit, 0);
+    for (int ch = 0; ch < LEDS; ch++) {
+        CHECK_EQ(check_order(ch, false), pauses.ok);
+        check_settled(ch);
+    }
+    check_ledc_stats();
+}
+
+/*
+ * With fades in the mix, a pause is refused while either led is
+ * fading, commands that come in during a fade are folded into the
+ * last one, and nothing is latched until the fade engine's done.
+ */
+static void test_pause_races_fades(void)
+{
+    pauses_t pauses;
+
+    run(true, true, &pauses);
+    printf("    %u pauses, %u refused\n", pauses.ok, pauses.refused);
+
+    CHECK(pauses.ok > 0);
+    CHECK(pauses.refused > 0);
+    CHECK_EQ(pauses.lit, 0);
+    for (int ch = 0; ch < LEDS; ch++) {
+        CHECK_EQ(check_order(ch, false), pauses.ok);
+        check_settled(ch);
+    }
+    check_ledc_stats();
+}
+
+int main(void)
+{
+    RUN(test_setup);
+    RUN(test_no_lost_commands);
+    RUN(test_pause_races_producers);
+    RUN(test_pause_races_fades);
+    return unit_done();
+}
@@ -0,0 +1,274 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_omar_stream.c - the 'stream' records on a virtual clock, read
+ * back with stream_record_parse() and stream_gap_check() the way the
+ * host side does: their cadence, a period the stream task missed
+ * while a meter read was held up, a line the console dropped, and the
+ * sequence number wrapping
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "unit.h"
+#include "host.h"
+#include "driver/spi_master.h"
+#include "adi_spi.h"
+#include "hw_setup.h"
+#include "omar_stream.h"
+#include "stream_record.h"
+#include "ade7953_model.h"
+
+#define HZ                          (100)
+#define PERIOD_MSEC                 (1000 / HZ)
+#define VRMS                        (0x012345)
+
+#define RECORDS_MAX                 (64)
+#define STALL_PERIODS               (3)         // periods that go by while the stream task's held up
+
+typedef struct {
+    uint32_t seq;
+    uint32_t msec;
+    int32_t values[STREAM_CHANNEL_COUNT];
+} record_t;
+
+static ade7953_model_t m_chip;
+static FILE *m_capture;
+
+static record_t m_records[RECORDS_MAX];
+static int m_record_count;
+static bool m_parsed;
+
+// The meter, which can be made to hang on to a read until it's let go:
+static pthread_mutex_t m_stall_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t m_stall_cond = PTHREAD_COND_INITIALIZER;
+static bool m_stall;
+static bool m_stalled;
+
+static esp_err_t meter_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    pthread_mutex_lock(&m_stall_lock);
+    while (m_stall) {
+        m_stalled = true;
+        pthread_cond_wait(&m_stall_cond, &m_stall_lock);
+    }
+    pthread_mutex_unlock(&m_stall_lock);
+
+    return ade7953_model_transfer(ctx, tx, rx, len);
+}
+
+static void stall(bool on)
+{
+    pthread_mutex_lock(&m_stall_lock);
+    m_stall = on;
+    m_stalled = false;
+    pthread_cond_broadcast(&m_stall_cond);
+    pthread_mutex_unlock(&m_stall_lock);
+}
+
+static void wait_stalled(void)
+{
+    pthread_mutex_lock(&m_stall_lock);
+    while (!m_stalled) {
+        pthread_mutex_unlock(&m_stall_lock);
+        usleep(100);
+        pthread_mutex_lock(&m_stall_lock);
+    }
+    pthread_mutex_unlock(&m_stall_lock);
+}
+
+// Waits for the stream task's next line and keeps it:
+static void next_record(void)
+{
+    char line[STREAM_RECORD_MAX];
+    record_t *record = &m_records[m_record_count];
+
+    if (m_record_count < RECORDS_MAX && fgets(line, sizeof(line), m_capture) != NULL) {
+        m_parsed &= stream_record_parse(line, STREAM_CHANNEL_BIT(STREAM_VRMS),
+                                        &record->seq, &record->msec, record->values);
+        m_record_count++;
+    }
+}
+
+static void step(void)
+{
+    host_clock_advance(PERIOD_MSEC * 1000);
+    next_record();
+}
+
+static void test_setup(void)
+{
+    ade7953_model_reset(&m_chip);
+    ade7953_model_set(&m_chip, ADE7953_VRMS, VRMS);
+
+    static const host_spi_slave_t slave = { meter_transfer, &m_chip };
+    host_spi_attach(HSPI_HOST, &slave);
+    adi_spi_init();
+
+    host_clock_virtual(1000 * 1000);
+}
+
+/*
+ * Twenty periods, one stalled for three more, and twenty after it,
+ * with stdout going to a pipe the test reads the lines back from.
+ */
+static void test_stream(void)
+{
+    omar_stream_stats_t stats = { 0 };
+    char header[80] = "";
+    int fds[2];
+
+    CHECK_EQ(pipe(fds), 0);
+    m_capture = fdopen(fds[0], "r");
+    FILE *console = stdout;
+    stdout = fdopen(fds[1], "w");
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    m_parsed = true;
+    int64_t start = host_time_usec();
+    bool started = omar_stream_start(HZ, STREAM_CHANNEL_BIT(STREAM_VRMS));
+    if (started) {
+        fgets(header, sizeof(header), m_capture);
+
+        for (int i = 0; i < 20; i++) {
+            step();
+        }
+
+        // The next read hangs while three more periods go by:
+        stall(true);
+        host_clock_advance(PERIOD_MSEC * 1000);
+        wait_stalled();
+        for (int i = 0; i < STALL_PERIODS; i++) {
+            host_clock_advance(PERIOD_MSEC * 1000);
+        }
+        stall(false);
+        next_record();
+
+        // ...and the record after it, for the same moment, says how many it missed:
+        next_record();
+
+        for (int i = 0; i < 20; i++) {
+            step();
+        }
+        // It counts a record once the line's out, which is just after we've read it:
+        usleep(20 * 1000);
+        omar_stream_stop(&stats);
+    }
+
+    fclose(stdout);
+    stdout = console;
+    fclose(m_capture);
+
+    CHECK(started);
+    CHECK(strcmp(header, "# stream 100 Hz: seq msec vrms\n") == 0);
+    CHECK(m_parsed);
+    CHECK_EQ(m_record_count, 42);
+    CHECK_EQ(stats.records, m_record_count);
+    CHECK_EQ(stats.missed, STALL_PERIODS - 1);
+
+    // Every record's stamped with the end of its own period, but the one that was held up:
+    uint32_t base = (uint32_t)(start / 1000) + PERIOD_MSEC;
+    int late = 0;
+
+    for (int i = 0; i < m_record_count; i++) {
+        record_t *record = &m_records[i];
+        uint32_t due = base + record->seq * PERIOD_MSEC;
+
+        CHECK_EQ(record->values[STREAM_VRMS], VRMS);
+        if (record->msec != due) {
+            late++;
+            CHECK_EQ(i, 20);
+            CHECK_EQ(record->msec - due, STALL_PERIODS * PERIOD_MSEC);
+        }
+    }
+    CHECK_EQ(late, 1);
+}
+
+// The host's gap check finds the periods the device missed, and tells them from lines the console lost:
+static void test_gaps(void)
+{
+    stream_gap_t gap;
+
+    stream_gap_reset(&gap);
+    for (int i = 0; i < m_record_count; i++) {
+        stream_gap_check(&gap, m_records[i].seq);
+    }
+    CHECK_EQ(gap.records, 42);
+    CHECK_EQ(gap.gaps, 1);
+    CHECK_EQ(gap.missing, STALL_PERIODS - 1);
+
+    // Drop a line, as the console would with its ring full:
+    stream_gap_reset(&gap);
+    for (int i = 0; i < m_record_count; i++) {
+        if (i != 30) {
+            stream_gap_check(&gap, m_records[i].seq);
+        }
+    }
+    CHECK_EQ(gap.records, 41);
+    CHECK_EQ(gap.gaps, 2);
+    CHECK_EQ(gap.missing, STALL_PERIODS);
+}
+
+/*
+ * A stream left running for 497 days at 100 Hz wraps its sequence
+ * number; records formatted and parsed across it, with one dropped
+ * on either side of zero.
+ */
+static void test_sequence_wrap(void)
+{
+    static const uint32_t seqs[] = { 0xfffffffc, 0xfffffffd, 0xfffffffe, 0xffffffff, 0, 1, 2, 3 };
+    int32_t values[STREAM_CHANNEL_COUNT] = { 0 };
+    char line[STREAM_RECORD_MAX];
+    stream_gap_t whole, dropped;
+    uint32_t mask = STREAM_ALL_CHANNELS;
+
+    stream_gap_reset(&whole);
+    stream_gap_reset(&dropped);
+    for (size_t i = 0; i < sizeof(seqs)/sizeof(seqs[0]); i++) {
+        uint32_t seq, msec;
+        int32_t parsed[STREAM_CHANNEL_COUNT];
+
+        for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+            values[ch] = (int32_t)(seqs[i] * 31 + ch) * (ch % 2 ? -1 : 1);
+        }
+        int len = stream_record_format(line, sizeof(line), seqs[i], seqs[i] * PERIOD_MSEC, mask, values);
+        CHECK_EQ(len, STREAM_RECORD_MAX - 1);
+        CHECK(stream_record_parse(line, mask, &seq, &msec, parsed));
+        CHECK_EQ(seq, seqs[i]);
+        CHECK_EQ(msec, seqs[i] * PERIOD_MSEC);
+        CHECK(memcmp(parsed, values, sizeof(values)) == 0);
+
+        stream_gap_check(&whole, seq);
+        if (seq != 0xfffffffe && seq != 1) {
+            stream_gap_check(&dropped, seq);
+        }
+    }
+
+    CHECK_EQ(whole.gaps, 0);
+    CHECK_EQ(whole.missing, 0);
+    CHECK_EQ(dropped.records, 6);
+    CHECK_EQ(dropped.gaps, 2);
+    CHECK_EQ(dropped.missing, 2);
+
+    // A torn line doesn't parse:
+    uint32_t seq, msec;
+    int32_t parsed[STREAM_CHANNEL_COUNT];
+
+    stream_record_format(line, sizeof(line), 7, 70, mask, values);
+    line[20] = '\0';
+    CHECK(!stream_record_parse(line, mask, &seq, &msec, parsed));
+    CHECK(!stream_record_parse("=0000000g 00000046\n", 0, &seq, &msec, parsed));
+}
+
+int main(void)
+{
+    RUN(test_setup);
+    RUN(test_stream);
+    RUN(test_gaps);
+    RUN(test_sequence_wrap);
+    return unit_done();
+}
@@ -0,0 +1,285 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_relay.c - omar_relay.c's coil pulses on a virtual clock, against
+ * the esp_timer and gpio stand-ins with 60Hz mains on the ZX pin:
+ * when each pulse starts relative to the zero crossings, how long it
+ * lasts, and the order back-to-back requests come out in
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "unit.h"
+#include "host.h"
+#include "driver/gpio.h"
+#include "soc/gpio_struct.h"
+#include "hw_setup.h"
+#include "omar_relay.h"
+
+// ZX toggles at every crossing of 60Hz mains:
+#define HALF_PERIOD_USEC            (8333)
+
+// RELAY_MIN_LEAD_USEC in omar_relay.c: no pulse is scheduled closer to now than this
+#define MIN_LEAD_USEC               (500)
+
+// How far the contacts' landing is from the crossing before it:
+#define LANDING(t)                  (((t) + OMAR_RELAY_CONTACT_DELAY_USEC - OMAR_RELAY_ZX_OFFSET_USEC - m_zx_origin) % HALF_PERIOD_USEC)
+
+#define EDGES_MAX                   (64)
+
+typedef struct {
+    int64_t at;
+    int gpio;
+    uint32_t level;
+} edge_t;
+
+static edge_t m_edges[EDGES_MAX];
+static int m_edge_count;
+static uint32_t m_coils[GPIO_NUM_MAX];
+static uint32_t m_overlaps;
+
+static bool m_mains = false;
+static uint32_t m_zx_level = 1;
+static int64_t m_zx_origin;
+static int64_t m_zx_last;
+static int64_t m_zx_next;
+
+static bool is_coil(int gpio)
+{
+    return (gpio == OMAR_COIL_1_SET_GPIO || gpio == OMAR_COIL_1_RESET_GPIO ||
+            gpio == OMAR_COIL_2_SET_GPIO || gpio == OMAR_COIL_2_RESET_GPIO);
+}
+
+// Every level a coil's driven to, and whether both of a relay's coils were ever on at once:
+static void coil_watch(int gpio, uint32_t level, void *ctx)
+{
+    (void) ctx;
+
+    if (!is_coil(gpio)) {
+        return;
+    }
+    m_coils[gpio] = level;
+    if ((m_coils[OMAR_COIL_1_SET_GPIO] && m_coils[OMAR_COIL_1_RESET_GPIO]) ||
+        (m_coils[OMAR_COIL_2_SET_GPIO] && m_coils[OMAR_COIL_2_RESET_GPIO])) {
+        m_overlaps++;
+    }
+    if (m_edge_count < EDGES_MAX) {
+        m_edges[m_edge_count++] = (edge_t){ host_time_usec(), gpio, level };
+    }
+}
+
+static void edges_reset(void)
+{
+    m_edge_count = 0;
+}
+
+// Moves the clock on to 'until', toggling ZX at each crossing on the way while the mains is on:
+static void run_until(int64_t until)
+{
+    while (m_mains && m_zx_next <= until) {
+        host_clock_advance(m_zx_next - host_time_usec());
+        m_zx_level = !m_zx_level;
+        host_gpio_input(ADE7953_ZX_GPIO, m_zx_level);
+        m_zx_last = m_zx_next;
+        m_zx_next += HALF_PERIOD_USEC;
+    }
+    host_clock_advance(until - host_time_usec());
+}
+
+// Runs on, a little at a time, until the coils have seen 'count' edges (or a second's gone by):
+static void run_until_edges(int count)
+{
+    int64_t give_up = host_time_usec() + 1000 * 1000;
+
+    while (m_edge_count < count && host_time_usec() < give_up) {
+        run_until(host_time_usec() + 100);
+    }
+}
+
+static void mains_on(void)
+{
+    m_mains = true;
+    m_zx_origin = m_zx_next = host_time_usec() + 1000;
+}
+
+static bool edge_is(int i, int gpio, uint32_t level)
+{
+    return (i < m_edge_count && m_edges[i].gpio == gpio && m_edges[i].level == level);
+}
+
+static void test_setup(void)
+{
+    host_clock_virtual(0);
+    host_gpio_watch(coil_watch, NULL);
+    relay_setup();
+
+    // The ZX pin interrupts on both edges:
+    CHECK_EQ(GPIO.pin[ADE7953_ZX_GPIO].int_type, GPIO_INTR_ANYEDGE);
+}
+
+// No mains, no crossings: the pulse starts straight away
+static void test_no_zero_cross(void)
+{
+    omar_relay_info_t info;
+
+    edges_reset();
+    int64_t called = host_time_usec();
+    relay_set(OMAR_RELAY_1, true);
+    run_until(called + 2 * OMAR_RELAY_PULSE_USEC);
+
+    CHECK_EQ(m_edge_count, 2);
+    CHECK(edge_is(0, OMAR_COIL_1_SET_GPIO, 1));
+    CHECK(edge_is(1, OMAR_COIL_1_SET_GPIO, 0));
+    CHECK_EQ(m_edges[0].at, called);
+    CHECK_EQ(m_edges[1].at - m_edges[0].at, OMAR_RELAY_PULSE_USEC);
+
+    relay_get_info(OMAR_RELAY_1, &info);
+    CHECK(info.closed);
+    CHECK_EQ(info.pulses, 1);
+    CHECK_EQ(info.zx_half_period_usec, 0);
+}
+
+static void test_locks_on(void)
+{
+    omar_relay_info_t info;
+
+    mains_on();
+    run_until(host_time_usec() + 10 * HALF_PERIOD_USEC);
+
+    relay_get_info(OMAR_RELAY_2, &info);
+    CHECK_EQ(info.zx_half_period_usec, HALF_PERIOD_USEC);
+}
+
+/*
+ * Asked at every point in the half period, the coil goes on at the
+ * first time at least MIN_LEAD_USEC off that has the contacts land
+ * on a crossing. 3833 and 3834 are either side of the lead: the
+ * landing 4333 usec after the last crossing is then 500 or 499 away.
+ */
+static void test_fire_offset(void)
+{
+    static const int32_t phases[] = { 0, 1000, 2000, 3000, 3833, 3834, 4000, 4333, 5000, 6000, 7000, 8000, 8332 };
+    bool closed = false;
+
+    for (size_t i = 0; i < sizeof(phases)/sizeof(phases[0]); i++) {
+        int failures = unit_failures;
+
+        run_until(m_zx_last + phases[i]);
+        int64_t called = host_time_usec();
+
+        // The first landing far enough off:
+        int64_t expected = m_zx_last + OMAR_RELAY_ZX_OFFSET_USEC - OMAR_RELAY_CONTACT_DELAY_USEC;
+        while (expected < called + MIN_LEAD_USEC) {
+            expected += HALF_PERIOD_USEC;
+        }
+
+        edges_reset();
+        closed = !closed;
+        relay_set(OMAR_RELAY_2, closed);
+        run_until(called + 2 * HALF_PERIOD_USEC + OMAR_RELAY_PULSE_USEC);
+
+        int coil = (closed ? OMAR_COIL_2_SET_GPIO : OMAR_COIL_2_RESET_GPIO);
+        CHECK_EQ(m_edge_count, 2);
+        CHECK(edge_is(0, coil, 1));
+        CHECK(edge_is(1, coil, 0));
+        CHECK_EQ(m_edges[0].at, expected);
+        CHECK_EQ(LANDING(m_edges[0].at), 0);
+        CHECK(m_edges[0].at - called >= MIN_LEAD_USEC);
+        CHECK(m_edges[0].at - called < MIN_LEAD_USEC + HALF_PERIOD_USEC);
+        CHECK_EQ(m_edges[1].at - m_edges[0].at, OMAR_RELAY_PULSE_USEC);
+        CHECK_EQ(relay_get(OMAR_RELAY_2), closed);
+
+        if (unit_failures != failures) {
+            printf("    at %d usec past the crossing\n", phases[i]);
+            break;
+        }
+    }
+}
+
+/*
+ * Requests that come in while a pulse is waiting or running don't cut
+ * into it: each pulse runs its full width, one at a time, and another
+ * follows if the relay's last been asked for the other state.
+ */
+static void test_back_to_back(void)
+{
+    omar_relay_info_t before, after;
+
+    CHECK(relay_get(OMAR_RELAY_1));
+    relay_get_info(OMAR_RELAY_1, &before);
+
+    // Three at once: the first one's pulse, and the last one's state, which happen to agree:
+    edges_reset();
+    relay_set(OMAR_RELAY_1, false);
+    relay_set(OMAR_RELAY_1, true);
+    relay_set(OMAR_RELAY_1, false);
+    run_until(host_time_usec() + 3 * HALF_PERIOD_USEC + OMAR_RELAY_PULSE_USEC);
+
+    CHECK_EQ(m_edge_count, 2);
+    CHECK(edge_is(0, OMAR_COIL_1_RESET_GPIO, 1));
+    CHECK(edge_is(1, OMAR_COIL_1_RESET_GPIO, 0));
+    CHECK(!relay_get(OMAR_RELAY_1));
+
+    // Close; open while that pulse is on; close again while the open's waiting:
+    edges_reset();
+    relay_set(OMAR_RELAY_1, true);
+    run_until_edges(1);
+    run_until(host_time_usec() + OMAR_RELAY_PULSE_USEC / 2);
+    relay_set(OMAR_RELAY_1, false);
+    CHECK_EQ(m_edge_count, 1);
+    run_until_edges(2);
+    relay_set(OMAR_RELAY_1, true);
+    CHECK_EQ(m_edge_count, 2);
+    run_until(host_time_usec() + 4 * HALF_PERIOD_USEC + 2 * OMAR_RELAY_PULSE_USEC);
+
+    CHECK_EQ(m_edge_count, 6);
+    CHECK(edge_is(0, OMAR_COIL_1_SET_GPIO, 1));
+    CHECK(edge_is(1, OMAR_COIL_1_SET_GPIO, 0));
+    CHECK(edge_is(2, OMAR_COIL_1_RESET_GPIO, 1));
+    CHECK(edge_is(3, OMAR_COIL_1_RESET_GPIO, 0));
+    CHECK(edge_is(4, OMAR_COIL_1_SET_GPIO, 1));
+    CHECK(edge_is(5, OMAR_COIL_1_SET_GPIO, 0));
+    for (int i = 0; i + 1 < m_edge_count; i += 2) {
+        CHECK_EQ(LANDING(m_edges[i].at), 0);
+        CHECK_EQ(m_edges[i + 1].at - m_edges[i].at, OMAR_RELAY_PULSE_USEC);
+        CHECK(i == 0 || m_edges[i].at - m_edges[i - 1].at >= MIN_LEAD_USEC);
+    }
+    CHECK(relay_get(OMAR_RELAY_1));
+
+    relay_get_info(OMAR_RELAY_1, &after);
+    CHECK_EQ(after.pulses - before.pulses, 4);
+    CHECK_EQ(m_overlaps, 0);
+}
+
+// Once ZX has been quiet for a while it's given up on, and the pulses go straight out again:
+static void test_zero_cross_lost(void)
+{
+    omar_relay_info_t info;
+
+    m_mains = false;
+    run_until(host_time_usec() + 200 * 1000);
+    relay_get_info(OMAR_RELAY_2, &info);
+    CHECK_EQ(info.zx_half_period_usec, 0);
+
+    edges_reset();
+    int64_t called = host_time_usec();
+    relay_set(OMAR_RELAY_2, !relay_get(OMAR_RELAY_2));
+    run_until(called + 2 * OMAR_RELAY_PULSE_USEC);
+
+    CHECK_EQ(m_edge_count, 2);
+    CHECK_EQ(m_edges[0].at, called);
+    CHECK_EQ(m_edges[1].at - m_edges[0].at, OMAR_RELAY_PULSE_USEC);
+}
+
+int main(void)
+{
+    RUN(test_setup);
+    RUN(test_no_zero_cross);
+    RUN(test_locks_on);
+    RUN(test_fire_offset);
+    RUN(test_back_to_back);
+    RUN(test_zero_cross_lost);
+    return unit_done();
+}
@@ -0,0 +1,152 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_thermal.c - the thermal supervisor's policy, walked across the
+ * lower, upper and critical limits with the S-5852A's own comparator
+ * (and its hysteresis) setting the flags, and the led derating and
+ * relay inhibit it applies and lifts on the way
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "unit.h"
+#include "host.h"
+#include "hw_setup.h"
+#include "i2c.h"
+#include "s5852a.h"
+#include "omar_led.h"
+#include "omar_relay.h"
+#include "omar_thermal.h"
+#include "omar_thermal_policy.h"
+#include "i2c_slaves.h"
+
+// Long enough for the led task to take a command, and for a relay pulse to finish:
+#define SETTLE_USEC                 (40 * 1000)
+
+#define L                           S5852A_ALARM_LOWER
+#define U                           S5852A_ALARM_UPPER
+#define C                           S5852A_ALARM_CRITICAL
+
+typedef struct {
+    float celsius;
+    uint8_t alarms;             // what the sensor should flag
+    thermal_state_t state;      // and what the supervisor should make of it
+} crossing_t;
+
+/*
+ * With the limits at -20, 70 and 85C and 1.5C of hysteresis; each
+ * row follows on from the one before.
+ */
+static const crossing_t m_crossings[] = {
+    {  25.0f,   0,      THERMAL_STATE_NORMAL },
+    {  70.0f,   0,      THERMAL_STATE_NORMAL },     // at the limit isn't over it
+    {  70.25f,  U,      THERMAL_STATE_DERATED },
+    {  69.0f,   U,      THERMAL_STATE_DERATED },    // inside the hysteresis
+    {  68.25f,  0,      THERMAL_STATE_NORMAL },
+    {  84.75f,  U,      THERMAL_STATE_DERATED },
+    {  85.0f,   C | U,  THERMAL_STATE_CRITICAL },   // at the critical limit is
+    {  83.75f,  C | U,  THERMAL_STATE_CRITICAL },
+    {  80.0f,   U,      THERMAL_STATE_CRITICAL },   // latched while it's over the upper limit...
+    {  70.25f,  U,      THERMAL_STATE_CRITICAL },
+    {  69.0f,   U,      THERMAL_STATE_CRITICAL },
+    {  68.25f,  0,      THERMAL_STATE_NORMAL },     // ...and only released once it's under it
+    {  90.0f,   C | U,  THERMAL_STATE_CRITICAL },
+    {  25.0f,   0,      THERMAL_STATE_NORMAL },
+    { -20.0f,   0,      THERMAL_STATE_NORMAL },
+    { -20.25f,  L,      THERMAL_STATE_COLD },
+    { -19.0f,   L,      THERMAL_STATE_COLD },
+    { -18.25f,  0,      THERMAL_STATE_NORMAL },
+    { -40.0f,   L,      THERMAL_STATE_COLD },
+    {  86.0f,   C | U,  THERMAL_STATE_CRITICAL },
+    {  75.0f,   U,      THERMAL_STATE_CRITICAL },
+    {  25.0f,   0,      THERMAL_STATE_NORMAL },
+};
+
+static thermal_state_t m_state = THERMAL_STATE_NORMAL;
+
+// The duty register, in whole counts:
+static uint32_t led_duty(int channel)
+{
+    return host_ledc_duty(channel) >> 4;
+}
+
+static uint32_t duty_limit(thermal_state_t state)
+{
+    switch (state) {
+    case THERMAL_STATE_CRITICAL:
+        return 0;
+    case THERMAL_STATE_DERATED:
+        return OMAR_THERMAL_DERATED_DUTY;
+    default:
+        return OMAR_LED_MAX_DUTY;
+    }
+}
+
+static void test_setup(void)
+{
+    slaves_attach();
+    i2c_init();
+    led_setup();
+    relay_setup();
+
+    CHECK_EQ(s5852a_set_limits(OMAR_THERMAL_LOWER_C, OMAR_THERMAL_UPPER_C, OMAR_THERMAL_CRITICAL_C), ESP_OK);
+
+    led_set_brightness(OMAR_WHITE_LED0, OMAR_LED_MAX_DUTY);
+    led_set_brightness(OMAR_WHITE_LED1, OMAR_LED_MAX_DUTY);
+    relay_set(OMAR_RELAY_1, true);
+    host_sleep_usec(SETTLE_USEC);
+
+    CHECK_EQ(led_duty(0), OMAR_LED_MAX_DUTY);
+    CHECK(relay_get(OMAR_RELAY_1));
+}
+
+static void test_crossings(void)
+{
+    for (size_t i = 0; i < sizeof(m_crossings)/sizeof(m_crossings[0]); i++) {
+        const crossing_t *row = &m_crossings[i];
+        int failures = unit_failures;
+        float temperature;
+        uint8_t alarms = 0xff;
+
+        // One of the supervisor's polls, as thermal_task() takes it:
+        slave_s5852a_temperature(&m_s5852a, row->celsius);
+        CHECK_EQ(s5852a_get_alarms(&temperature, &alarms), ESP_OK);
+        CHECK(temperature == row->celsius);
+        CHECK_EQ(alarms, row->alarms);
+
+        thermal_state_t state = thermal_classify(m_state, alarms);
+        CHECK_EQ(state, row->state);
+        if (state != m_state) {
+            thermal_apply(state);
+            m_state = state;
+        }
+        host_sleep_usec(SETTLE_USEC);
+
+        // The leds are capped (or let go again), whatever they were asked for:
+        CHECK_EQ(led_duty(0), duty_limit(state));
+        CHECK_EQ(led_duty(1), duty_limit(state));
+        CHECK_EQ(led_get_brightness(OMAR_WHITE_LED0), OMAR_LED_MAX_DUTY);
+
+        // A trip opens the relay we closed last time round, and won't let it close again:
+        if (state == THERMAL_STATE_CRITICAL) {
+            CHECK(!relay_get(OMAR_RELAY_1));
+        }
+        relay_set(OMAR_RELAY_1, true);
+        host_sleep_usec(SETTLE_USEC);
+        CHECK_EQ(relay_get(OMAR_RELAY_1), state != THERMAL_STATE_CRITICAL);
+
+        if (unit_failures != failures) {
+            printf("    at row %zu, %.2fC\n", i, row->celsius);
+            break;
+        }
+    }
+}
+
+int main(void)
+{
+    RUN(test_setup);
+    RUN(test_crossings);
+    return unit_done();
+}
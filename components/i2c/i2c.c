@@ -3,8 +3,15 @@
  * i2c.c - routines to communicate to slave peripherials via I2C, using the TWI module.
  */
 
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "rom/ets_sys.h"
+#include "driver/gpio.h"
 #include "driver/i2c.h"
 #include "i2c.h"
+#include "i2c_bus.h"
 #include "hw_setup.h"
 #include "s5852a.h"
 #include "s24c08.h"
@@ -35,6 +42,10 @@ static int console_command(int argc, char *argv[]);
 
 #endif//defined(NEW_DAY)
 
+static void i2c_master_config(void);
+
+static SemaphoreHandle_t m_i2c_lock = NULL;
+
 void i2c_init(void)
 {
 
@@ -52,6 +63,17 @@ void i2c_init(void)
 
     s24c08_init();
 
+    i2c_master_config();
+
+    m_i2c_lock = xSemaphoreCreateMutex();
+
+    i2c_bus_init();
+
+    s5852a_init();
+}
+
+static void i2c_master_config(void)
+{
     int i2c_master_port = OMAR_I2C_MASTER_PORT; 
     i2c_config_t conf;
     conf.mode = I2C_MODE_MASTER;
@@ -62,8 +84,51 @@ void i2c_init(void)
     conf.master.clk_speed = OMAR_ESP32_I2C_CLOCKFREQHZ;
     i2c_param_config(i2c_master_port, &conf);
     i2c_driver_install(i2c_master_port, conf.mode, 0, 0, 0);
+}
 
-    s5852a_init();
+/*
+ * i2c_bus_recover() frees a bus that's been left stuck by a slave
+ * holding SDA low (typically because a transaction was cut off
+ * part way through a byte the slave was sending). We take SCL and
+ * SDA away from the i2c controller and clock SCL by hand - at most
+ * 9 clocks are needed for the slave to finish its byte and release
+ * SDA - then bit-bang a STOP and hand the pins back to a freshly
+ * installed driver.
+ */
+#define I2C_RECOVERY_HALF_PERIOD_US (5)     // 100kHz, slow enough for any slave
+
+void i2c_bus_recover(void)
+{
+    xSemaphoreTake(m_i2c_lock, portMAX_DELAY);
+
+    i2c_driver_delete(OMAR_I2C_MASTER_PORT);
+
+    gpio_set_direction(I2C_SCL, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_direction(I2C_SDA, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_level(I2C_SDA, true);
+    gpio_set_level(I2C_SCL, true);
+    ets_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+
+    for (int clock = 0; clock < 9 && gpio_get_level(I2C_SDA) == 0; clock++) {
+        gpio_set_level(I2C_SCL, false);
+        ets_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+        gpio_set_level(I2C_SCL, true);
+        ets_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    }
+
+    // STOP: SDA goes low-to-high while SCL is high
+    gpio_set_level(I2C_SCL, false);
+    ets_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    gpio_set_level(I2C_SDA, false);
+    ets_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    gpio_set_level(I2C_SCL, true);
+    ets_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    gpio_set_level(I2C_SDA, true);
+    ets_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+
+    i2c_master_config();
+
+    xSemaphoreGive(m_i2c_lock);
 }
 
 #if     defined(NEW_DAY)
@@ -100,35 +165,153 @@ static ret_code_t twi_master_init(void)
 #endif//defined(NEW_DAY)
 
 
-esp_err_t i2c_tx(uint8_t address, uint8_t* data_wr, size_t size)
+/*
+ * All three transaction types (write, read, and write-then-read)
+ * funnel through i2c_xfer().
+ *
+ * The esp-idf i2c driver allocates one heap node for every
+ * i2c_master_*() call appended to a command link, and consumes
+ * those nodes as it executes them, so a command link can't be
+ * built once and replayed. What we *can* do is keep the number
+ * of nodes per transaction to a minimum: rather than appending
+ * the ADDR+W byte and the payload as two commands, the write
+ * payload is staged behind its address byte in m_staging[] and
+ * appended as a single command. A 2-byte temperature read is 7
+ * nodes (it was 9 as a separate write and read), a 16-byte
+ * eeprom page write is 3 (it was 4) - plus the link itself.
+ *
+ * m_staging[] is shared, so transactions are serialized with
+ * m_i2c_lock; that also keeps the s5852a and s24c08 from
+ * interleaving their command links on the bus.
+ *
+ * I2C_STAGING_SIZE covers an eeprom page write: the device
+ * address, the word address and MAX_PAGE_WRITE bytes of data.
+ * Anything bigger falls back to appending the address byte and
+ * the caller's buffer separately.
+ */
+#define I2C_STAGING_SIZE        (2 + MAX_PAGE_WRITE)
+#define I2C_XFER_TIMEOUT        (1000 / portTICK_RATE_MS)
+
+static uint8_t m_staging[I2C_STAGING_SIZE];
+static i2c_stats_t m_stats = {0};
+
+static esp_err_t i2c_xfer(uint8_t address, uint8_t *wbuf, size_t wlen, uint8_t *rbuf, size_t rlen)
 {
+    uint32_t nodes = 0;
+
+    if (m_i2c_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(m_i2c_lock, portMAX_DELAY);
+
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, ( address << 1 ) | I2C_MASTER_WRITE, ACK_CHECK_EN);
-    i2c_master_write(cmd, data_wr, size, ACK_CHECK_EN);
+
+    if (wlen > 0 || rlen == 0) {
+        i2c_master_start(cmd);
+        nodes++;
+        if (wlen + 1 <= I2C_STAGING_SIZE) {
+            m_staging[0] = ( address << 1 ) | I2C_MASTER_WRITE;
+            memcpy(&m_staging[1], wbuf, wlen);
+            i2c_master_write(cmd, m_staging, wlen + 1, ACK_CHECK_EN);
+            nodes++;
+        } else {
+            i2c_master_write_byte(cmd, ( address << 1 ) | I2C_MASTER_WRITE, ACK_CHECK_EN);
+            i2c_master_write(cmd, wbuf, wlen, ACK_CHECK_EN);
+            nodes += 2;
+        }
+    }
+
+    if (rlen > 0) {
+        // A START here is a repeated START if we just wrote something:
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, ( address << 1 ) | I2C_MASTER_READ, ACK_CHECK_EN);
+        nodes += 2;
+        if (rlen > 1) {
+            i2c_master_read(cmd, rbuf, rlen - 1, ACK_VAL);
+            nodes++;
+        }
+        i2c_master_read_byte(cmd, rbuf + rlen - 1, NACK_VAL);
+        nodes++;
+    }
+
     i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(OMAR_I2C_MASTER_PORT, cmd, 1000 / portTICK_RATE_MS);
+    nodes++;
+
+    /*
+     * The command link is fully built at this point, so this is
+     * the high-water mark of heap use for the transaction:
+     */
+    uint32_t free_heap = esp_get_free_heap_size();
+
+    esp_err_t ret = i2c_master_cmd_begin(OMAR_I2C_MASTER_PORT, cmd, I2C_XFER_TIMEOUT);
     i2c_cmd_link_delete(cmd);
+
+    m_stats.transactions++;
+    m_stats.cmd_nodes += nodes;
+    if (nodes > m_stats.max_cmd_nodes) {
+        m_stats.max_cmd_nodes = nodes;
+    }
+    if (m_stats.min_free_heap == 0 || free_heap < m_stats.min_free_heap) {
+        m_stats.min_free_heap = free_heap;
+    }
+    if (ret != ESP_OK) {
+        m_stats.errors++;
+    }
+
+    xSemaphoreGive(m_i2c_lock);
+
     return ret;
 }
 
+esp_err_t i2c_tx(uint8_t address, uint8_t* data_wr, size_t size)
+{
+    return i2c_xfer(address, data_wr, size, NULL, 0);
+}
+
+/*
+ * i2c_write_read() writes 'wlen' bytes to the slave and then, without
+ * releasing the bus, issues a repeated START and reads 'rlen' bytes
+ * back. This is the "set the register pointer, then read it" pattern
+ * used by both the s5852a (pointer register) and the s24c08 (the
+ * "dummy write" random read), done as a single command link and a
+ * single i2c_master_cmd_begin() instead of two:
+ *
+ * START | ADDR+W | wbuf[0..wlen-1] | RESTART | ADDR+R | rbuf[0..rlen-1] | STOP
+ *
+ * Every byte read is ACKed except the last, which is NACKed to tell
+ * the slave we're done.
+ */
+esp_err_t i2c_write_read(uint8_t address, uint8_t *wbuf, size_t wlen, uint8_t *rbuf, size_t rlen)
+{
+    return i2c_xfer(address, wbuf, wlen, rbuf, rlen);
+}
+
 //FIXME: change API, we don't need xfer_pending for i2c_rx
 esp_err_t i2c_rx(uint8_t address, uint8_t *data_rd, size_t size)
 {
     if (size == 0) {
         return ESP_OK;
     }
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, ( address << 1 ) | I2C_MASTER_READ, ACK_CHECK_EN);
-    if (size > 1) {
-        i2c_master_read(cmd, data_rd, size - 1, ACK_VAL);
+    return i2c_xfer(address, NULL, 0, data_rd, size);
+}
+
+/*
+ * i2c_get_stats() returns a snapshot of the transaction counters.
+ * The average cmd_nodes/transactions is the number of driver heap
+ * allocations per transaction; min_free_heap should stay put once
+ * the system has settled - if it keeps creeping down, something on
+ * the i2c path is leaking.
+ */
+void i2c_get_stats(i2c_stats_t *stats)
+{
+    if (m_i2c_lock != NULL) {
+        xSemaphoreTake(m_i2c_lock, portMAX_DELAY);
+    }
+    *stats = m_stats;
+    if (m_i2c_lock != NULL) {
+        xSemaphoreGive(m_i2c_lock);
     }
-    i2c_master_read_byte(cmd, data_rd + size - 1, NACK_VAL);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(OMAR_I2C_MASTER_PORT, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
 }
 
 
@@ -0,0 +1,267 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * i2c_bus.c - arbitrates access to omar's shared i2c bus
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "i2c.h"
+#include "i2c_bus.h"
+#include "latency_hist.h"
+#include "omar_tasks.h"
+
+// Enable I2C_BUS_VERBOSE to see every deadline miss and bus recovery
+//#define I2C_BUS_VERBOSE
+
+#define I2C_BUS_QUEUE_DEPTH         (8)
+
+/*
+ * A waiter blocks on a binary semaphore of its own rather than on
+ * its task notification, which other code (the stream task, the led
+ * service's replies) also uses: a stray notification would wake it
+ * while the scheduler still had a pointer to the request on its
+ * stack. They're made once, at init, so the i2c path stays off the
+ * heap; there's one for every request that can be queued.
+ */
+#define I2C_BUS_WAITERS             (I2C_BUS_QUEUE_DEPTH * I2C_BUS_PRIO_COUNT)
+
+/*
+ * A stuck bus shows up as a timeout from the driver. After this
+ * many failed transactions in a row we assume a slave is holding
+ * SDA low and clock the bus free (see i2c_bus_recover()).
+ */
+#define I2C_BUS_RECOVERY_THRESHOLD  (2)
+
+typedef struct {
+    i2c_bus_dev_t dev;
+    uint8_t address;
+    uint8_t *wbuf;
+    size_t wlen;
+    uint8_t *rbuf;
+    size_t rlen;
+    int64_t submitted;          // usec, esp_timer_get_time()
+    int64_t deadline;           // usec, absolute; 0 if there isn't one
+    SemaphoreHandle_t done;     // given once 'result' is in
+    esp_err_t result;
+} i2c_bus_req_t;
+
+typedef struct {
+    latency_hist_t latency;
+    uint32_t errors;
+    uint32_t deadline_misses;
+} i2c_bus_dev_state_t;
+
+static const char *m_dev_names[I2C_BUS_DEV_COUNT] = {
+    "s5852a",
+    "s24c08",
+};
+
+static QueueHandle_t m_queues[I2C_BUS_PRIO_COUNT];
+static SemaphoreHandle_t m_pending = NULL;     // one count per queued request
+static SemaphoreHandle_t m_stats_lock = NULL;
+static QueueHandle_t m_waiters = NULL;          // the free 'done' semaphores
+static TaskHandle_t m_scheduler_task = NULL;
+static i2c_bus_dev_state_t m_dev_state[I2C_BUS_DEV_COUNT];
+static uint32_t m_recoveries = 0;
+static uint32_t m_consecutive_failures = 0;
+
+static i2c_bus_req_t *next_request(void)
+{
+    i2c_bus_req_t *req;
+
+    for (int prio = 0; prio < I2C_BUS_PRIO_COUNT; prio++) {
+        if (xQueueReceive(m_queues[prio], &req, 0) == pdTRUE) {
+            return req;
+        }
+    }
+
+    return NULL;
+}
+
+static void complete_request(i2c_bus_req_t *req, esp_err_t result)
+{
+    uint32_t latency = (uint32_t )(esp_timer_get_time() - req->submitted);
+    i2c_bus_dev_state_t *state = &m_dev_state[req->dev];
+
+    xSemaphoreTake(m_stats_lock, portMAX_DELAY);
+    if (result == ESP_ERR_TIMEOUT && req->deadline != 0 && esp_timer_get_time() > req->deadline) {
+        state->deadline_misses++;
+    } else {
+        latency_hist_record(&state->latency, latency);
+        if (result != ESP_OK) {
+            state->errors++;
+        }
+    }
+    xSemaphoreGive(m_stats_lock);
+
+    req->result = result;
+    xSemaphoreGive(req->done);
+}
+
+static void i2c_bus_task(void *arg)
+{
+    (void) arg;
+
+    while (1) {
+        xSemaphoreTake(m_pending, portMAX_DELAY);
+
+        i2c_bus_req_t *req = next_request();
+        if (req == NULL) {
+            continue;
+        }
+
+        if (req->deadline != 0 && esp_timer_get_time() > req->deadline) {
+#if defined(I2C_BUS_VERBOSE)
+            printf("%s(): %s request missed its deadline\n", __func__, m_dev_names[req->dev]);
+#endif
+            complete_request(req, ESP_ERR_TIMEOUT);
+            continue;
+        }
+
+        esp_err_t ret = i2c_write_read(req->address, req->wbuf, req->wlen, req->rbuf, req->rlen);
+
+        if (ret == ESP_OK) {
+            m_consecutive_failures = 0;
+        } else if (++m_consecutive_failures >= I2C_BUS_RECOVERY_THRESHOLD) {
+#if defined(I2C_BUS_VERBOSE)
+            printf("%s(): %d failed transactions in a row, recovering the bus\n", __func__, m_consecutive_failures);
+#endif
+            i2c_bus_recover();
+            m_recoveries++;
+            m_consecutive_failures = 0;
+        }
+
+        // The deadline only applies to waiting for the bus; once a
+        // transaction has run, report whatever the bus said:
+        req->deadline = 0;
+        complete_request(req, ret);
+    }
+}
+
+void i2c_bus_init(void)
+{
+    for (int prio = 0; prio < I2C_BUS_PRIO_COUNT; prio++) {
+        m_queues[prio] = xQueueCreate(I2C_BUS_QUEUE_DEPTH, sizeof(i2c_bus_req_t *));
+    }
+    m_pending = xSemaphoreCreateCounting(I2C_BUS_QUEUE_DEPTH * I2C_BUS_PRIO_COUNT, 0);
+    m_stats_lock = xSemaphoreCreateMutex();
+
+    m_waiters = xQueueCreate(I2C_BUS_WAITERS, sizeof(SemaphoreHandle_t));
+    for (int i = 0; i < I2C_BUS_WAITERS; i++) {
+        SemaphoreHandle_t done = xSemaphoreCreateBinary();
+
+        xQueueSend(m_waiters, &done, 0);
+    }
+
+    i2c_bus_reset_stats();
+
+    omar_task_create(OMAR_TASK_I2C_BUS, i2c_bus_task, NULL, &m_scheduler_task);
+}
+
+esp_err_t i2c_bus_xfer(i2c_bus_dev_t dev, 
+                       i2c_bus_prio_t prio, 
+                       TickType_t deadline,
+                       uint8_t address, 
+                       uint8_t *wbuf, size_t wlen, 
+                       uint8_t *rbuf, size_t rlen)
+{
+    if (dev >= I2C_BUS_DEV_COUNT || prio >= I2C_BUS_PRIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Before the scheduler is up (or if it's calling us) there's
+    // no one to arbitrate against, so just run the transaction:
+    if (m_scheduler_task == NULL || xTaskGetCurrentTaskHandle() == m_scheduler_task) {
+        return i2c_write_read(address, wbuf, wlen, rbuf, rlen);
+    }
+
+    i2c_bus_req_t req = {
+        .dev = dev,
+        .address = address,
+        .wbuf = wbuf,
+        .wlen = wlen,
+        .rbuf = rbuf,
+        .rlen = rlen,
+        .submitted = esp_timer_get_time(),
+        .deadline = 0,
+        .result = ESP_FAIL,
+    };
+
+    if (deadline != I2C_BUS_NO_DEADLINE) {
+        req.deadline = req.submitted + (int64_t )deadline * portTICK_PERIOD_MS * 1000;
+    }
+
+    // There are as many of these as queue slots, so this only waits when the queues are full anyway:
+    if (xQueueReceive(m_waiters, &req.done, deadline) != pdTRUE) {
+        xSemaphoreTake(m_stats_lock, portMAX_DELAY);
+        m_dev_state[dev].deadline_misses++;
+        xSemaphoreGive(m_stats_lock);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    i2c_bus_req_t *p_req = &req;
+    if (xQueueSend(m_queues[prio], &p_req, deadline) != pdTRUE) {
+        xQueueSend(m_waiters, &req.done, 0);
+        xSemaphoreTake(m_stats_lock, portMAX_DELAY);
+        m_dev_state[dev].deadline_misses++;
+        xSemaphoreGive(m_stats_lock);
+        return ESP_ERR_TIMEOUT;
+    }
+    xSemaphoreGive(m_pending);
+
+    // 'req' lives on our stack, so wait for the scheduler no matter what:
+    xSemaphoreTake(req.done, portMAX_DELAY);
+    xQueueSend(m_waiters, &req.done, 0);
+
+    return req.result;
+}
+
+void i2c_bus_get_stats(i2c_bus_dev_t dev, i2c_bus_dev_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (dev >= I2C_BUS_DEV_COUNT || m_stats_lock == NULL) {
+        return;
+    }
+
+    i2c_bus_dev_state_t *state = &m_dev_state[dev];
+
+    xSemaphoreTake(m_stats_lock, portMAX_DELAY);
+    stats->count = state->latency.count;
+    stats->errors = state->errors;
+    stats->deadline_misses = state->deadline_misses;
+    stats->p50_usec = latency_hist_percentile(&state->latency, 50);
+    stats->p90_usec = latency_hist_percentile(&state->latency, 90);
+    stats->p99_usec = latency_hist_percentile(&state->latency, 99);
+    stats->max_usec = state->latency.max;
+    xSemaphoreGive(m_stats_lock);
+}
+
+uint32_t i2c_bus_get_recoveries(void)
+{
+    return m_recoveries;
+}
+
+void i2c_bus_reset_stats(void)
+{
+    if (m_stats_lock != NULL) {
+        xSemaphoreTake(m_stats_lock, portMAX_DELAY);
+    }
+    for (int dev = 0; dev < I2C_BUS_DEV_COUNT; dev++) {
+        latency_hist_reset(&m_dev_state[dev].latency);
+        m_dev_state[dev].errors = 0;
+        m_dev_state[dev].deadline_misses = 0;
+    }
+    if (m_stats_lock != NULL) {
+        xSemaphoreGive(m_stats_lock);
+    }
+}
+
+const char *i2c_bus_dev_name(i2c_bus_dev_t dev)
+{
+    return (dev < I2C_BUS_DEV_COUNT ? m_dev_names[dev] : "unknown");
+}
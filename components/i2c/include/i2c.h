@@ -3,14 +3,25 @@
 
 #include "esp_err.h"
 #include <stdint.h>
+#include <stddef.h>
 
 #define ACK_CHECK_EN    (0x1)              /*!< I2C master will check ack from slave*/
 #define ACK_VAL         (0x0)              /*!< I2C ack value */
 #define NACK_VAL        (0x1)              /*!< I2C nack value */
 
+typedef struct {
+    uint32_t transactions;      // i2c_master_cmd_begin() calls
+    uint32_t errors;            // ...that didn't return ESP_OK
+    uint32_t cmd_nodes;         // command link nodes built (each one a driver heap allocation)
+    uint32_t max_cmd_nodes;     // most nodes used by any single transaction
+    uint32_t min_free_heap;     // lowest free heap seen with a command link fully built
+} i2c_stats_t;
 
 void i2c_init(void);
 esp_err_t i2c_tx(uint8_t address, uint8_t* data_wr, size_t size);
-esp_err_t i2c_rx(uint8_t address, uint8_t *p_data, uint32_t length);
+esp_err_t i2c_rx(uint8_t address, uint8_t *p_data, size_t length);
+esp_err_t i2c_write_read(uint8_t address, uint8_t *wbuf, size_t wlen, uint8_t *rbuf, size_t rlen);
+void i2c_get_stats(i2c_stats_t *stats);
+void i2c_bus_recover(void);    // clock a stuck slave off the bus, and re-install the driver
 
 #endif //I2C_H
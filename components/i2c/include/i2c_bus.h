@@ -0,0 +1,65 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * i2c_bus.h - arbitrates access to omar's shared i2c bus
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+/*
+ * The s5852a temperature sensor and the s24c08 eeprom share
+ * OMAR_I2C_MASTER_PORT. Rather than letting each driver call
+ * straight into the esp-idf i2c driver, transactions are handed
+ * to a single scheduler task which always runs the highest
+ * priority request waiting. Each request also carries a deadline:
+ * a request that's still waiting when its deadline passes is
+ * failed with ESP_ERR_TIMEOUT without ever touching the bus.
+ */
+typedef enum {
+    I2C_BUS_PRIO_HIGH = 0,      // time-critical (temperature)
+    I2C_BUS_PRIO_NORMAL,
+    I2C_BUS_PRIO_LOW,           // bulk (eeprom)
+    I2C_BUS_PRIO_COUNT
+} i2c_bus_prio_t;
+
+typedef enum {
+    I2C_BUS_DEV_S5852A = 0,
+    I2C_BUS_DEV_S24C08,
+    I2C_BUS_DEV_COUNT
+} i2c_bus_dev_t;
+
+#define I2C_BUS_NO_DEADLINE         (portMAX_DELAY)
+
+typedef struct {
+    uint32_t count;             // transactions completed
+    uint32_t errors;            // ...that failed on the bus
+    uint32_t deadline_misses;   // dropped because they waited past their deadline
+    uint32_t p50_usec;          // submit-to-completion latency percentiles
+    uint32_t p90_usec;
+    uint32_t p99_usec;
+    uint32_t max_usec;
+} i2c_bus_dev_stats_t;
+
+void i2c_bus_init(void);        // called from i2c_init() once the esp-idf driver is installed
+
+/*
+ * i2c_bus_xfer() queues a write, read or write-then-read (see
+ * i2c_write_read()) and blocks until the scheduler has run it.
+ * 'deadline' is relative to now, in ticks. It leaves the calling
+ * task's notification value alone.
+ */
+esp_err_t i2c_bus_xfer(i2c_bus_dev_t dev, 
+                       i2c_bus_prio_t prio, 
+                       TickType_t deadline,
+                       uint8_t address, 
+                       uint8_t *wbuf, size_t wlen, 
+                       uint8_t *rbuf, size_t rlen);
+
+void i2c_bus_get_stats(i2c_bus_dev_t dev, i2c_bus_dev_stats_t *stats);
+uint32_t i2c_bus_get_recoveries(void);
+void i2c_bus_reset_stats(void);
+const char *i2c_bus_dev_name(i2c_bus_dev_t dev);
@@ -2,8 +2,22 @@
 #define S5852A_H
 
 #include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Comparison flags reported alongside each temperature reading
+ * by s5852a_get_alarms():
+ */
+#define S5852A_ALARM_LOWER      (1 << 0)    // below the lower limit
+#define S5852A_ALARM_UPPER      (1 << 1)    // above the upper limit
+#define S5852A_ALARM_CRITICAL   (1 << 2)    // at or above the critical limit
 
 void s5852a_init(void);
 esp_err_t s5852a_get(float *temperature);
+esp_err_t s5852a_get_alarms(float *temperature, uint8_t *alarms);
+esp_err_t s5852a_set_limits(float lower, float upper, float critical);
+
+// The temperature register's two bytes, as read, in degrees C:
+float s5852a_raw_to_float(uint8_t raw[2]);
 
 #endif //S5852A_H
@@ -10,6 +10,7 @@
 #include "hw_setup.h"
 #include "driver/i2c.h"
 #include "i2c.h"
+#include "i2c_bus.h"
 #include "s24c08.h"
 #include "esp_err.h"
 
@@ -21,7 +22,7 @@ static void bit_bang_i2c_start(void);
 static void bit_bang_i2c_stop(void);
 static void bit_bang_i2c_clock(uint8_t cycles);
 static uint16_t number_of_pages_spanned(uint16_t address, uint16_t count);
-static esp_err_t s24c08_read_nbytes(s24c08_eeprom_page_t page, uint8_t *data, uint16_t count);
+static esp_err_t s24c08_random_read(s24c08_eeprom_page_t page, uint8_t in_page_addr, uint8_t *data, uint16_t count);
 static esp_err_t s24c08_write_page(uint16_t address, uint8_t *data, uint16_t count);
 static esp_err_t s24c08_write_up_to_16_bytes(s24c08_eeprom_page_t page, uint8_t *data, uint16_t count);
 
@@ -164,7 +165,9 @@ static esp_err_t s24c08_write_up_to_16_bytes(s24c08_eeprom_page_t page, uint8_t
         return ESP_OK;
     }
 
-    if ((status=i2c_tx(page, data, count)) != ESP_OK) {
+    status = i2c_bus_xfer(I2C_BUS_DEV_S24C08, I2C_BUS_PRIO_LOW, I2C_BUS_NO_DEADLINE,
+                          page, data, count, NULL, 0);
+    if (status != ESP_OK) {
         printf("%s(): failed to write the %d bytes of data to address 0x%02x\n",
                __func__,
                count,
@@ -333,21 +336,13 @@ static uint16_t number_of_pages_spanned(uint16_t address, uint16_t count)
     uint16_t pages =
         1 // Even a one-byte write is on a page somewhere.
         +
-        (   // Add in extra page-spans for each time you cross a page boundary:
-            ((address + count)/OMAR_EEPROM_PAGE_SIZE) 
+        (   // Add in extra page-spans for each time you cross a page boundary
+            // (counting from the last byte accessed, so callers never pass 0):
+            ((address + count - 1)/OMAR_EEPROM_PAGE_SIZE) 
             - 
             (address/OMAR_EEPROM_PAGE_SIZE)
         );
 
-
-    /*
-     * In cases where the access touches the last byte in eeprom,
-     * the preceding formula can yield 5 - catch that case
-     * and fix it (the max number of pages spanned is 4):
-     */
-    pages = (pages > 4) ? 4 : pages;
-
-
     return pages;
 }
 
@@ -454,13 +449,14 @@ esp_err_t s24c08_read(uint16_t address, uint8_t *data, uint16_t count)
         return ESP_FAIL;
     }
 
-    // Because s24c08_read_nbytes() can only read data from one
+    // Because s24c08_random_read() can only read data from one
     // contiguous 256-byte "page" of s24c08 eeprom memory, figure
     // out how many eeprom pages are spanned, and thus how many
     // invocations are required:
 
     uint16_t pages_spanned = number_of_pages_spanned(address, count);
     uint16_t bytes_to_read_from_this_page = OMAR_EEPROM_PAGE_SIZE - (address % OMAR_EEPROM_PAGE_SIZE);
+    bytes_to_read_from_this_page = (bytes_to_read_from_this_page > count ? count : bytes_to_read_from_this_page);
     uint16_t current_address = address;
     uint16_t final_address = address + count;
 
@@ -489,19 +485,14 @@ esp_err_t s24c08_read(uint16_t address, uint8_t *data, uint16_t count)
         uint8_t in_page_addr = (uint8_t )(current_address % OMAR_EEPROM_PAGE_SIZE);
 
         /*
-         * First, set up the address to be read from (using the "dummy write" 
+         * Set up the address to be read from (using the "dummy write" 
          * technique describd in section "7.2 Random read"of the s24c08
-         * datasheet):
+         * datasheet) and read the data back, all in one transaction:
          */
-        esp_err_t ret = i2c_tx(page, &in_page_addr, 1);
-        if (ret != ESP_OK) {
-            printf("%s(): failed to setup the address to read from\n", __func__);
-            return ESP_FAIL;
-        }
-
         if (ESP_OK != 
-            s24c08_read_nbytes(
+            s24c08_random_read(
                 page, 
+                in_page_addr,
                 &data[current_address - address], 
                 bytes_to_read_from_this_page)) {
 
@@ -532,18 +523,14 @@ esp_err_t s24c08_read(uint16_t address, uint8_t *data, uint16_t count)
 }
 
 /*
- * s24c08_read_nbytes() reads n bytes from the "current address"
- * maintained internally by the s24c08 EEPROM chip.
- * 
- * This address may have just been setup by a call to
- * s24c08_read(), or we may just be reading 
- * from successive locations in EEPROM and so relying
- * on the s24c08 to update its internal address for
- * us.
+ * s24c08_random_read() reads n bytes starting at 'in_page_addr'
+ * within the given page. The "dummy write" of the word address
+ * and the sequential read are issued back-to-back with a repeated
+ * START, so the s24c08 sees exactly the "Random read" sequence
+ * described in its datasheet without a STOP in between.
  *
- * 
  */
-static esp_err_t s24c08_read_nbytes(s24c08_eeprom_page_t page, uint8_t *data, uint16_t count)
+static esp_err_t s24c08_random_read(s24c08_eeprom_page_t page, uint8_t in_page_addr, uint8_t *data, uint16_t count)
 {
     if (!m_initialized) {
         printf("%s(): the s24c08 hasn't been initialized\n", __func__);
@@ -555,10 +542,9 @@ static esp_err_t s24c08_read_nbytes(s24c08_eeprom_page_t page, uint8_t *data, ui
         return ESP_FAIL;
     }
     
-    // The s24c08 EEPROM chip knows the offset location
-    // within the page specified by 'page' from
-    // which to read the data:
-    esp_err_t ret = i2c_rx(page, data, count);
+    esp_err_t ret = 
+        i2c_bus_xfer(I2C_BUS_DEV_S24C08, I2C_BUS_PRIO_LOW, I2C_BUS_NO_DEADLINE,
+                     page, &in_page_addr, 1, data, count);
     if (ret != ESP_OK) {
         printf("%s(): failed to read the requested data from the s24c08 EEPROM\n", __func__);
         return ESP_FAIL;
@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "i2c.h"
+#include "i2c_bus.h"
 #include "s5852a.h"
 #if     defined(NEW_DAY)
 #include <stdlib.h>
@@ -24,6 +25,7 @@
 #endif//defined(NEW_DAY)
 
 #include "esp_err.h"
+#include "trace.h"
 
 
 
@@ -39,7 +41,22 @@
 
 #define TICK_TIMER_INTERVAL_MS (5000)
 
-static float raw_to_float(uint8_t raw[2]);
+/*
+ * Configuration register bits (see the CONF register description in
+ * the S-5852A datasheet):
+ */
+#define S5852A_CONF_EVENT_CNT   0x0008  // EVENT output enabled
+#define S5852A_CONF_HYST_1_5C   0x0200  // 1.5C hysteresis on all three limits
+
+/*
+ * Temperature reads go to the front of the i2c bus queue; if one
+ * can't get onto the bus within S5852A_I2C_DEADLINE it's reported
+ * as a failure rather than returning a stale answer late.
+ */
+#define S5852A_I2C_DEADLINE     (50/portTICK_PERIOD_MS)
+
+static uint16_t float_to_limit(float temperature);
+static esp_err_t s5852a_write_reg(uint8_t reg, uint16_t value);
 #if     defined(NEW_DAY)
 static int console_command(int argc, char *argv[]);
 static int test(void);
@@ -81,7 +98,9 @@ void s5852a_init(void)
 {
     //set pointer to the Ambient Temperature register
     uint8_t pointer = S5852A_TEMP_REG;
-    esp_err_t ret = i2c_tx(S5852A_I2C_ADDRESS, &pointer, 1);
+    esp_err_t ret = 
+        i2c_bus_xfer(I2C_BUS_DEV_S5852A, I2C_BUS_PRIO_HIGH, S5852A_I2C_DEADLINE,
+                     S5852A_I2C_ADDRESS, &pointer, 1, NULL, 0);
     if (ret != ESP_OK) {
         printf("error: can't set s5852 pointer!\n");
         return;
@@ -122,26 +141,81 @@ static void usage(void)
  *  returns a floating point value with 0.25C resolution
  */
 esp_err_t s5852a_get(float *temperature)
+{
+    return s5852a_get_alarms(temperature, NULL);
+}
+
+/*
+ * s5852a_get_alarms - same as s5852a_get(), but also hands back the
+ *  S5852A_ALARM_* flags that come along with the temperature reading.
+ *  alarms may be NULL.
+ */
+esp_err_t s5852a_get_alarms(float *temperature, uint8_t *alarms)
 {
     if (!m_initialized) return ESP_FAIL;
 
+    // Point at the temperature register and read it back
+    // in one transaction (repeated START, no STOP in between):
     uint8_t pointer = S5852A_TEMP_REG;
-    esp_err_t ret = i2c_tx(S5852A_I2C_ADDRESS, &pointer, 1);
+    uint8_t raw[2];
+    esp_err_t ret = 
+        i2c_bus_xfer(I2C_BUS_DEV_S5852A, I2C_BUS_PRIO_HIGH, S5852A_I2C_DEADLINE,
+                     S5852A_I2C_ADDRESS, &pointer, 1, raw, 2);
     if (ret != ESP_OK) {
-        printf("error: can't set s5852 pointer!\n");
+        printf("error: can't read the s5852 temperature register!\n");
         return ESP_FAIL;
     }
 
-    uint8_t raw[2];
-    ret = i2c_rx(S5852A_I2C_ADDRESS, raw, 2);
-
-    printf("%s(): Raw return values, raw[0] = 0x%02x, raw[1] = 0x%02x\n", __func__, raw[0], raw[1]);
+    TRACE2(TRACE_S5852A_RAW, raw[0], raw[1]);
     
-    *temperature = raw_to_float(raw);
+    *temperature = s5852a_raw_to_float(raw);
+    if (alarms) {
+        // The top three bits of the temperature register are the
+        // critical/upper/lower comparison flags:
+        *alarms = raw[0] >> 5;
+    }
     return ret;
 }
 
-static float raw_to_float(uint8_t raw[2])
+/*
+ * s5852a_set_limits - program the lower, upper and critical limit
+ *  registers (0.25C resolution), then enable the EVENT output in
+ *  comparator mode. EVENT is asserted (low) for as long as the
+ *  temperature is outside the lower/upper window or above the
+ *  critical limit, and released once it's back inside the window
+ *  by more than the 1.5C hysteresis.
+ */
+esp_err_t s5852a_set_limits(float lower, float upper, float critical)
+{
+    if (!m_initialized) return ESP_FAIL;
+
+    if (!(lower < upper && upper <= critical)) {
+        printf("%s(): invalid limits (lower %.2f, upper %.2f, critical %.2f)\n",
+               __func__, lower, upper, critical);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s5852a_write_reg(S5852A_DT_L_REG, float_to_limit(lower)) != ESP_OK ||
+        s5852a_write_reg(S5852A_DT_H_REG, float_to_limit(upper)) != ESP_OK ||
+        s5852a_write_reg(S5852A_ST_H_REG, float_to_limit(critical)) != ESP_OK ||
+        s5852a_write_reg(S5852A_CONF_REG, 
+                         S5852A_CONF_EVENT_CNT | S5852A_CONF_HYST_1_5C) != ESP_OK) {
+        printf("error: can't program the s5852 limit registers!\n");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t s5852a_write_reg(uint8_t reg, uint16_t value)
+{
+    uint8_t buf[3] = {reg, value >> 8, value & 0xff};
+
+    return i2c_bus_xfer(I2C_BUS_DEV_S5852A, I2C_BUS_PRIO_HIGH, S5852A_I2C_DEADLINE,
+                        S5852A_I2C_ADDRESS, buf, sizeof(buf), NULL, 0);
+}
+
+float s5852a_raw_to_float(uint8_t raw[2])
 {
     //we're using default resolution (10-bit, 0.25C resolution)
     int16_t ambient = (raw[0] << 8) | raw[1];
@@ -159,6 +233,17 @@ static float raw_to_float(uint8_t raw[2])
     return temp;
 }
 
+/*
+ * The limit registers use the same 13-bit, two's complement format
+ * as the temperature register, minus the two bits below 0.25C:
+ */
+static uint16_t float_to_limit(float temperature)
+{
+    int16_t quarters = (int16_t)(temperature * 4.0f);
+
+    return (uint16_t)(quarters * 4) & 0x1ffc;
+}
+
 #if     defined(NEW_DAY)
 static int console_command(int argc, char *argv[])
 {
@@ -233,7 +318,7 @@ static int test(void)
     };
 
     for (int i=0; i<sizeof(vectors)/sizeof(int16_t); i++) {
-        float result = raw_to_float(vectors[i]);
+        float result = s5852a_raw_to_float(vectors[i]);
         LOG(LOG_LEVEL_DEBUG, "vector %d: %0.2f\r\n", i, result);
     }
 
@@ -0,0 +1,75 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * bench_i2c.c - i2c transactions against the mock driver: what the
+ * command link building, the bus task hand-off and the locking cost,
+ * with the wire time taken out
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "host.h"
+#include "host_bench.h"
+#include "i2c.h"
+#include "s5852a.h"
+#include "s24c08.h"
+#include "i2c_slaves.h"
+
+#define BENCH_I2C_REPS          (10000)
+
+static void temperature_read(void *arg)
+{
+    float temperature;
+
+    (void) arg;
+    s5852a_get(&temperature);
+}
+
+static void write_read(void *arg)
+{
+    uint8_t pointer = 0x05;
+    uint8_t raw[2];
+
+    (void) arg;
+    i2c_write_read(0x18, &pointer, 1, raw, sizeof(raw));
+}
+
+static void eeprom_read(void *arg)
+{
+    uint8_t data[MAX_PAGE_WRITE];
+
+    (void) arg;
+    s24c08_read(0x100, data, sizeof(data));
+}
+
+static void throughput(const char *name, bench_fn_t fn)
+{
+    uint32_t start = host_bench_clock();
+
+    for (int i = 0; i < BENCH_I2C_REPS; i++) {
+        fn(NULL);
+    }
+
+    uint32_t elapsed = host_bench_clock() - start;
+
+    printf("# %s: %.0f transactions/s\n", name, BENCH_I2C_REPS * 1e9 / (elapsed ? elapsed : 1));
+}
+
+int main(void)
+{
+    bench_t bench;
+
+    slaves_attach();
+    i2c_init();
+
+    host_bench_init(&bench, "i2c");
+    host_bench_run(&bench, "i2c_write_read(2)", write_read, NULL, BENCH_I2C_REPS);
+    host_bench_run(&bench, "s5852a_get", temperature_read, NULL, BENCH_I2C_REPS);
+    host_bench_run(&bench, "s24c08_read(16)", eeprom_read, NULL, BENCH_I2C_REPS);
+
+    throughput("i2c_write_read(2)", write_read);
+    throughput("s5852a_get", temperature_read);
+    throughput("s24c08_read(16)", eeprom_read);
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * i2c_slaves.h - models of the S-5852A and S-24C08C for the host i2c
+ * mock (see host_i2c_attach()), as far as the drivers can tell
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "host.h"
+
+#define SLAVE_S5852A_ADDRESS        (0x18)
+#define SLAVE_S24C08_ADDRESS        (0x50)      // block 0; blocks 1-3 follow
+#define SLAVE_S24C08_SIZE           (0x400)
+#define SLAVE_S24C08_PAGE_WRITE     (16)
+
+typedef struct {
+    uint8_t pointer;
+    uint16_t regs[16];
+    uint32_t writes;
+} slave_s5852a_t;
+
+typedef struct {
+    uint8_t mem[SLAVE_S24C08_SIZE];
+    uint16_t address;               // the chip's address counter, all 10 bits
+    uint32_t writes;                // page writes, each a write cycle
+} slave_s24c08_t;
+
+typedef struct {
+    slave_s24c08_t *chip;
+    uint16_t block;
+} slave_s24c08_block_t;
+
+static slave_s5852a_t m_s5852a;
+static slave_s24c08_t m_s24c08;
+static slave_s24c08_block_t m_s24c08_blocks[4];
+
+// The pointer byte, optionally followed by a 16-bit value for that register:
+static inline esp_err_t slave_s5852a_write(void *ctx, const uint8_t *data, size_t len)
+{
+    slave_s5852a_t *chip = (slave_s5852a_t *) ctx;
+
+    chip->pointer = data[0] & 0x0f;
+    if (len >= 3) {
+        chip->regs[chip->pointer] = (uint16_t)((data[1] << 8) | data[2]);
+        chip->writes++;
+    }
+    return (len == 1 || len == 3 ? ESP_OK : ESP_FAIL);
+}
+
+// Registers read back msb first; past two bytes it starts over:
+static inline esp_err_t slave_s5852a_read(void *ctx, uint8_t *data, size_t len)
+{
+    slave_s5852a_t *chip = (slave_s5852a_t *) ctx;
+    static size_t s_byte = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        uint16_t reg = chip->regs[chip->pointer];
+
+        data[i] = (s_byte++ & 1 ? reg & 0xff : reg >> 8);
+    }
+    return ESP_OK;
+}
+
+// The limit and temperature registers hold 13-bit two's complement sixteenths of a degree:
+static inline float slave_s5852a_celsius(uint16_t reg)
+{
+    return (int16_t)(reg << 3) / 128.0f;
+}
+
+/*
+ * Puts 'celsius' in the temperature register, with the critical,
+ * upper and lower flags in its top three bits set as the chip's
+ * comparator would: each once the temperature goes past its limit,
+ * and cleared again only once it's come back by the hysteresis the
+ * CONF register picks (0, 1.5, 3 or 6C).
+ */
+static inline void slave_s5852a_temperature(slave_s5852a_t *chip, float celsius)
+{
+    static const float hysteresis[4] = { 0.0f, 1.5f, 3.0f, 6.0f };
+    float hyst = hysteresis[(chip->regs[0x01] >> 9) & 3];
+    float upper = slave_s5852a_celsius(chip->regs[0x02]);
+    float lower = slave_s5852a_celsius(chip->regs[0x03]);
+    float critical = slave_s5852a_celsius(chip->regs[0x04]);
+    uint16_t flags = chip->regs[0x05] >> 13;
+
+    if (celsius >= critical) {
+        flags |= 4;
+    } else if (celsius < critical - hyst) {
+        flags &= ~4;
+    }
+    if (celsius > upper) {
+        flags |= 2;
+    } else if (celsius < upper - hyst) {
+        flags &= ~2;
+    }
+    if (celsius < lower) {
+        flags |= 1;
+    } else if (celsius > lower + hyst) {
+        flags &= ~1;
+    }
+
+    chip->regs[0x05] = (uint16_t)((flags << 13) | ((int16_t)(celsius * 16.0f) & 0x1fff));
+}
+
+/*
+ * The word address, then up to 16 bytes which wrap around inside
+ * their 16-byte page (as the datasheet warns they will).
+ */
+static inline esp_err_t slave_s24c08_write(void *ctx, const uint8_t *data, size_t len)
+{
+    slave_s24c08_block_t *block = (slave_s24c08_block_t *) ctx;
+    slave_s24c08_t *chip = block->chip;
+
+    chip->address = (uint16_t)(block->block * 0x100 + data[0]);
+    if (len == 1) {
+        return ESP_OK;
+    }
+    if (len - 1 > SLAVE_S24C08_PAGE_WRITE) {
+        return ESP_FAIL;
+    }
+
+    uint16_t page = chip->address & ~(SLAVE_S24C08_PAGE_WRITE - 1);
+
+    for (size_t i = 1; i < len; i++) {
+        chip->mem[page | ((chip->address + i - 1) & (SLAVE_S24C08_PAGE_WRITE - 1))] = data[i];
+    }
+    chip->writes++;
+    return ESP_OK;
+}
+
+// Sequential reads run on through the whole chip:
+static inline esp_err_t slave_s24c08_read(void *ctx, uint8_t *data, size_t len)
+{
+    slave_s24c08_t *chip = ((slave_s24c08_block_t *) ctx)->chip;
+
+    for (size_t i = 0; i < len; i++) {
+        data[i] = chip->mem[chip->address];
+        chip->address = (chip->address + 1) % SLAVE_S24C08_SIZE;
+    }
+    return ESP_OK;
+}
+
+static inline void slaves_attach(void)
+{
+    const host_i2c_slave_t s5852a = { slave_s5852a_write, slave_s5852a_read, &m_s5852a };
+
+    memset(&m_s5852a, 0, sizeof(m_s5852a));
+    host_i2c_attach(SLAVE_S5852A_ADDRESS, &s5852a);
+
+    memset(&m_s24c08, 0xff, sizeof(m_s24c08.mem));
+    m_s24c08.address = 0;
+    m_s24c08.writes = 0;
+    for (uint16_t b = 0; b < 4; b++) {
+        m_s24c08_blocks[b].chip = &m_s24c08;
+        m_s24c08_blocks[b].block = b;
+
+        host_i2c_slave_t block = { slave_s24c08_write, slave_s24c08_read, &m_s24c08_blocks[b] };
+        host_i2c_attach(SLAVE_S24C08_ADDRESS + b, &block);
+    }
+}
@@ -0,0 +1,286 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_i2c.c - the exact START/ADDR/DATA/repeated START/STOP sequences
+ * the s5852a and s24c08 drivers put on the bus, against models of both
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "unit.h"
+#include "host.h"
+#include "i2c.h"
+#include "s5852a.h"
+#include "s24c08.h"
+#include "i2c_slaves.h"
+
+#define OPS_MAX     (16)
+
+static host_i2c_op_t m_ops[OPS_MAX];
+
+static uint32_t last_ops(void)
+{
+    memset(m_ops, 0, sizeof(m_ops));
+    return host_i2c_last(m_ops, OPS_MAX);
+}
+
+static bool op_is(const host_i2c_op_t *op, host_i2c_op_type_t type, bool ack, const uint8_t *data, size_t len)
+{
+    if (op->type != type || op->len != len) {
+        return false;
+    }
+    if (type == HOST_I2C_WRITE || type == HOST_I2C_READ) {
+        if (op->ack != ack) {
+            return false;
+        }
+    }
+    return (data == NULL || memcmp(op->data, data, len) == 0);
+}
+
+#define START_IS(i)                 CHECK(op_is(&m_ops[i], HOST_I2C_START, false, NULL, 0))
+#define STOP_IS(i)                  CHECK(op_is(&m_ops[i], HOST_I2C_STOP, false, NULL, 0))
+#define WRITE_IS(i, ...)            do {                                    \
+        const uint8_t bytes[] = { __VA_ARGS__ };                            \
+        CHECK(op_is(&m_ops[i], HOST_I2C_WRITE, true, bytes, sizeof(bytes))); \
+    } while (0)
+#define READ_IS(i, len, ack)        CHECK(op_is(&m_ops[i], HOST_I2C_READ, ack, NULL, len))
+
+static void test_temperature_read(void)
+{
+    float temperature = 0;
+
+    m_s5852a.regs[0x05] = 0xe190;
+    CHECK_EQ(s5852a_get(&temperature), ESP_OK);
+    CHECK(temperature == 25.0f);
+
+    // ADDR+W, pointer, repeated START, ADDR+R, ACKed byte, NACKed byte, STOP:
+    CHECK_EQ(last_ops(), 7);
+    START_IS(0);
+    WRITE_IS(1, 0x18 << 1, 0x05);
+    START_IS(2);
+    WRITE_IS(3, (0x18 << 1) | 1);
+    READ_IS(4, 1, true);
+    READ_IS(5, 1, false);
+    STOP_IS(6);
+}
+
+static void test_temperature_alarms(void)
+{
+    float temperature = 0;
+    uint8_t alarms = 0;
+
+    // Above the critical and upper limits, at -0.25C (sign bit set):
+    m_s5852a.regs[0x05] = 0xc000 | 0x1ffc;
+    CHECK_EQ(s5852a_get_alarms(&temperature, &alarms), ESP_OK);
+    CHECK(temperature == -0.25f);
+    CHECK_EQ(alarms, S5852A_ALARM_CRITICAL | S5852A_ALARM_UPPER);
+}
+
+static void test_set_limits(void)
+{
+    CHECK_EQ(s5852a_set_limits(10.0f, 60.0f, 85.0f), ESP_OK);
+    CHECK_EQ(m_s5852a.regs[0x03], 10 * 16);
+    CHECK_EQ(m_s5852a.regs[0x02], 60 * 16);
+    CHECK_EQ(m_s5852a.regs[0x04], 85 * 16);
+    CHECK_EQ(m_s5852a.regs[0x01], 0x0208);
+
+    // The last of the four is the configuration register, written in one frame:
+    CHECK_EQ(last_ops(), 3);
+    START_IS(0);
+    WRITE_IS(1, 0x18 << 1, 0x01, 0x02, 0x08);
+    STOP_IS(2);
+
+    CHECK_EQ(s5852a_set_limits(60.0f, 10.0f, 85.0f), ESP_ERR_INVALID_ARG);
+}
+
+static void test_eeprom_random_read(void)
+{
+    uint8_t data[5] = { 0 };
+
+    for (int i = 0; i < SLAVE_S24C08_SIZE; i++) {
+        m_s24c08.mem[i] = (uint8_t)(i * 7);
+    }
+
+    // 0x123 is offset 0x23 of block 1, so ADDR is 0x51:
+    CHECK_EQ(s24c08_read(0x123, data, sizeof(data)), ESP_OK);
+    for (int i = 0; i < (int) sizeof(data); i++) {
+        CHECK_EQ(data[i], (uint8_t)((0x123 + i) * 7));
+    }
+
+    CHECK_EQ(last_ops(), 7);
+    START_IS(0);
+    WRITE_IS(1, 0x51 << 1, 0x23);
+    START_IS(2);
+    WRITE_IS(3, (0x51 << 1) | 1);
+    READ_IS(4, 4, true);
+    READ_IS(5, 1, false);
+    STOP_IS(6);
+}
+
+static void test_eeprom_single_byte_read(void)
+{
+    uint8_t data = 0;
+
+    m_s24c08.mem[0x3ff] = 0xa5;
+    CHECK_EQ(s24c08_read(0x3ff, &data, 1), ESP_OK);
+    CHECK_EQ(data, 0xa5);
+
+    // One byte is just the NACKed one:
+    CHECK_EQ(last_ops(), 6);
+    START_IS(0);
+    WRITE_IS(1, 0x53 << 1, 0xff);
+    START_IS(2);
+    WRITE_IS(3, (0x53 << 1) | 1);
+    READ_IS(4, 1, false);
+    STOP_IS(5);
+}
+
+static void test_eeprom_read_across_blocks(void)
+{
+    uint8_t data[4] = { 0 };
+    host_i2c_stats_t before, after;
+
+    for (int i = 0; i < SLAVE_S24C08_SIZE; i++) {
+        m_s24c08.mem[i] = (uint8_t) i;
+    }
+
+    host_i2c_get_stats(&before);
+    CHECK_EQ(s24c08_read(0x0fe, data, sizeof(data)), ESP_OK);
+    host_i2c_get_stats(&after);
+
+    // One transaction per block, the second starting at offset 0 of 0x51:
+    CHECK_EQ(after.transactions - before.transactions, 2);
+    CHECK_EQ(data[0], 0xfe);
+    CHECK_EQ(data[1], 0xff);
+    CHECK_EQ(data[2], 0x00);
+    CHECK_EQ(data[3], 0x01);
+    CHECK_EQ(last_ops(), 7);
+    WRITE_IS(1, 0x51 << 1, 0x00);
+    READ_IS(4, 1, true);
+    READ_IS(5, 1, false);
+
+    CHECK_EQ(s24c08_read(0x3ff, data, 2), ESP_FAIL);
+}
+
+static void test_eeprom_read_to_block_end(void)
+{
+    uint8_t data[16];
+    host_i2c_stats_t before, after;
+
+    // Ending on the last byte of a block doesn't touch the next one:
+    host_i2c_get_stats(&before);
+    CHECK_EQ(s24c08_read(0x0f0, data, sizeof(data)), ESP_OK);
+    CHECK_EQ(s24c08_read(0x3f0, data, sizeof(data)), ESP_OK);
+    host_i2c_get_stats(&after);
+    CHECK_EQ(after.transactions - before.transactions, 2);
+}
+
+static void test_eeprom_page_write(void)
+{
+    uint8_t data[MAX_PAGE_WRITE];
+
+    for (int i = 0; i < MAX_PAGE_WRITE; i++) {
+        data[i] = (uint8_t)(0x80 + i);
+    }
+
+    uint32_t writes = m_s24c08.writes;
+
+    CHECK_EQ(s24c08_write(0x220, data, sizeof(data)), ESP_OK);
+    CHECK_EQ(m_s24c08.writes - writes, 1);
+    CHECK(memcmp(&m_s24c08.mem[0x220], data, sizeof(data)) == 0);
+
+    // ADDR, the word address and the whole page in a single write:
+    CHECK_EQ(last_ops(), 3);
+    START_IS(0);
+    CHECK_EQ(m_ops[1].type, HOST_I2C_WRITE);
+    CHECK_EQ(m_ops[1].len, 2 + MAX_PAGE_WRITE);
+    CHECK_EQ(m_ops[1].data[0], 0x52 << 1);
+    CHECK_EQ(m_ops[1].data[1], 0x20);
+    CHECK(memcmp(&m_ops[1].data[2], data, sizeof(data)) == 0);
+    STOP_IS(2);
+}
+
+static void test_tx_and_rx(void)
+{
+    uint8_t pointer[] = { 0x05 };
+    uint8_t raw[2] = { 0 };
+
+    m_s5852a.regs[0x05] = 0xe550;
+    CHECK_EQ(i2c_tx(0x18, pointer, sizeof(pointer)), ESP_OK);
+    CHECK_EQ(last_ops(), 3);
+    START_IS(0);
+    WRITE_IS(1, 0x18 << 1, 0x05);
+    STOP_IS(2);
+
+    // A read on its own has no write phase, so no repeated START:
+    CHECK_EQ(i2c_rx(0x18, raw, sizeof(raw)), ESP_OK);
+    CHECK_EQ(raw[0], 0xe5);
+    CHECK_EQ(raw[1], 0x50);
+    CHECK_EQ(last_ops(), 5);
+    START_IS(0);
+    WRITE_IS(1, (0x18 << 1) | 1);
+    READ_IS(2, 1, true);
+    READ_IS(3, 1, false);
+    STOP_IS(4);
+
+    CHECK_EQ(i2c_rx(0x18, raw, 0), ESP_OK);
+}
+
+static void test_oversize_write(void)
+{
+    uint8_t data[1 + 2 * MAX_PAGE_WRITE];
+    uint8_t address[] = { 0x00 };
+
+    // Too big for the staging buffer, so ADDR goes as its own byte:
+    memset(data, 0x5a, sizeof(data));
+    data[0] = 0x40;
+    CHECK_EQ(i2c_tx(0x50, data, sizeof(data)), ESP_FAIL);
+    CHECK_EQ(last_ops(), 4);
+    START_IS(0);
+    WRITE_IS(1, 0x50 << 1);
+    CHECK_EQ(m_ops[2].len, sizeof(data));
+    CHECK(memcmp(m_ops[2].data, data, HOST_I2C_OP_DATA) == 0);
+    STOP_IS(3);
+
+    // The model NACKed that (more than a page), but i2c_tx() of the address is fine:
+    CHECK_EQ(i2c_tx(0x50, address, sizeof(address)), ESP_OK);
+}
+
+static void test_missing_slave(void)
+{
+    uint8_t pointer = 0;
+    uint8_t raw[2];
+    i2c_stats_t before, after;
+
+    i2c_get_stats(&before);
+    CHECK_EQ(i2c_write_read(0x33, &pointer, 1, raw, sizeof(raw)), ESP_FAIL);
+    i2c_get_stats(&after);
+    CHECK_EQ(after.transactions - before.transactions, 1);
+    CHECK_EQ(after.errors - before.errors, 1);
+
+    // And the node count is what's on the wire, link aside:
+    CHECK_EQ(after.cmd_nodes - before.cmd_nodes, 7);
+}
+
+int main(void)
+{
+    host_clock_virtual(0);
+    slaves_attach();
+    i2c_init();
+
+    RUN(test_temperature_read);
+    RUN(test_temperature_alarms);
+    RUN(test_set_limits);
+    RUN(test_eeprom_random_read);
+    RUN(test_eeprom_single_byte_read);
+    RUN(test_eeprom_read_across_blocks);
+    RUN(test_eeprom_read_to_block_end);
+    RUN(test_eeprom_page_write);
+    RUN(test_tx_and_rx);
+    RUN(test_oversize_write);
+    RUN(test_missing_slave);
+
+    return unit_done();
+}
@@ -0,0 +1,271 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_i2c_bus.c - the i2c bus scheduler under load: temperature reads
+ * racing a flood of eeprom page writes never wait behind more than the
+ * one transaction already on the bus, a read stuck behind a long one
+ * misses its deadline without touching the bus, and a run of failures
+ * clocks a stuck slave free
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "unit.h"
+#include "host.h"
+#include "driver/i2c.h"
+#include "hw_setup.h"
+#include "i2c.h"
+#include "i2c_bus.h"
+#include "s5852a.h"
+#include "s24c08.h"
+#include "i2c_slaves.h"
+
+/*
+ * Slow enough that one eeprom page write (16.4 ms) dwarfs the host's
+ * scheduling jitter, and fast enough that it and a temperature read
+ * still fit in the s5852a's 50 ms deadline:
+ */
+#define BUS_HZ                      (10000)
+#define BITS_USEC(bits)             ((uint32_t)((bits) * 1000000ULL / BUS_HZ))
+
+// START, ADDR+W, word address, 16 bytes, STOP:
+#define PAGE_WRITE_USEC             BITS_USEC(1 + 9 * (2 + SLAVE_S24C08_PAGE_WRITE) + 1)
+// START, ADDR+W, pointer, START, ADDR+R, 2 bytes, STOP:
+#define TEMP_READ_USEC              BITS_USEC(1 + 9 * 2 + 1 + 9 * 3 + 1)
+// Thread wake-ups and the like, on top of the bus time:
+#define SLACK_USEC                  (4000)
+
+#define WRITERS                     (4)
+#define WRITER_BYTES                (64)
+#define READS                       (60)
+#define READ_GAP_USEC               (7000)
+
+#define STUCK_CLOCKS                (5)
+
+static void bus_speed(uint32_t hz)
+{
+    i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER,
+        .sda_io_num = I2C_SDA,
+        .scl_io_num = I2C_SCL,
+        .master.clk_speed = hz,
+    };
+    i2c_param_config(OMAR_I2C_MASTER_PORT, &conf);
+}
+
+static atomic_bool m_flooding;
+static atomic_uint m_writes[WRITERS];
+
+// Each writer fills its own stretch of the eeprom with its round number, over and over:
+static void *writer(void *arg)
+{
+    int w = (int)(intptr_t) arg;
+    uint8_t data[WRITER_BYTES];
+
+    while (atomic_load(&m_flooding)) {
+        memset(data, (uint8_t)(atomic_load(&m_writes[w]) + 1), sizeof(data));
+        if (s24c08_write((uint16_t)(w * 2 * WRITER_BYTES), data, sizeof(data)) == ESP_OK) {
+            atomic_fetch_add(&m_writes[w], 1);
+        }
+    }
+    return NULL;
+}
+
+static void test_reads_jump_the_flood(void)
+{
+    pthread_t threads[WRITERS];
+    i2c_bus_dev_stats_t high, low;
+    float temperature;
+    uint32_t good = 0;
+
+    m_s5852a.regs[0x05] = 0xe190;
+    bus_speed(BUS_HZ);
+    host_i2c_timing(true);
+    i2c_bus_reset_stats();
+
+    atomic_store(&m_flooding, true);
+    for (int w = 0; w < WRITERS; w++) {
+        atomic_store(&m_writes[w], 0);
+        pthread_create(&threads[w], NULL, writer, (void *)(intptr_t) w);
+    }
+    host_sleep_usec(3 * PAGE_WRITE_USEC);
+
+    for (int i = 0; i < READS; i++) {
+        temperature = 0;
+        if (s5852a_get(&temperature) == ESP_OK && temperature == 25.0f) {
+            good++;
+        }
+        host_sleep_usec(READ_GAP_USEC);
+    }
+
+    atomic_store(&m_flooding, false);
+    for (int w = 0; w < WRITERS; w++) {
+        pthread_join(threads[w], NULL);
+    }
+    host_i2c_timing(false);
+
+    i2c_bus_get_stats(I2C_BUS_DEV_S5852A, &high);
+    i2c_bus_get_stats(I2C_BUS_DEV_S24C08, &low);
+    printf("    s5852a p50 %u p99 %u max %u us, s24c08 p50 %u max %u us (a page write is %u us)\n",
+           high.p50_usec, high.p99_usec, high.max_usec, low.p50_usec, low.max_usec, PAGE_WRITE_USEC);
+
+    CHECK_EQ(good, READS);
+    CHECK_EQ(high.count, READS);
+    CHECK_EQ(high.errors, 0);
+    CHECK_EQ(high.deadline_misses, 0);
+
+    // The page write already on the bus, then our own read, and never a second page write:
+    CHECK(high.p99_usec <= PAGE_WRITE_USEC + TEMP_READ_USEC + SLACK_USEC);
+    CHECK(high.max_usec <= PAGE_WRITE_USEC + TEMP_READ_USEC + SLACK_USEC);
+
+    // ...which matters, since the writes were queueing behind each other:
+    CHECK(low.max_usec > 2 * PAGE_WRITE_USEC);
+    CHECK_EQ(low.errors, 0);
+
+    // And the flood still got through, each writer's last round intact:
+    for (int w = 0; w < WRITERS; w++) {
+        uint32_t writes = atomic_load(&m_writes[w]);
+        bool intact = true;
+
+        CHECK(writes > 0);
+        for (int b = 0; b < WRITER_BYTES; b++) {
+            intact &= (m_s24c08.mem[w * 2 * WRITER_BYTES + b] == (uint8_t) writes);
+        }
+        CHECK(intact);
+    }
+}
+
+static void *long_read(void *arg)
+{
+    static uint8_t data[0x100];
+
+    *(esp_err_t *) arg = s24c08_read(0, data, sizeof(data));
+    return NULL;
+}
+
+/*
+ * A whole 256-byte page read takes 233 ms at BUS_HZ; a temperature
+ * read that queues behind it is failed once it gets to the front,
+ * rather than run 180 ms late.
+ */
+static void test_deadline_miss(void)
+{
+    pthread_t thread;
+    esp_err_t long_ret = ESP_FAIL;
+    i2c_bus_dev_stats_t high;
+    host_i2c_stats_t before, after;
+    float temperature;
+
+    bus_speed(BUS_HZ);
+    host_i2c_timing(true);
+    i2c_bus_reset_stats();
+
+    pthread_create(&thread, NULL, long_read, &long_ret);
+    host_sleep_usec(20 * 1000);
+
+    host_i2c_get_stats(&before);
+    int64_t start = host_time_usec();
+    CHECK_EQ(s5852a_get(&temperature), ESP_FAIL);
+    int64_t waited = host_time_usec() - start;
+    host_i2c_get_stats(&after);
+
+    pthread_join(thread, NULL);
+    host_i2c_timing(false);
+
+    // It waited out the long read, and never went on the bus itself:
+    CHECK_EQ(long_ret, ESP_OK);
+    CHECK(waited >= 150 * 1000);
+    CHECK_EQ(after.transactions, before.transactions);
+
+    i2c_bus_get_stats(I2C_BUS_DEV_S5852A, &high);
+    CHECK_EQ(high.deadline_misses, 1);
+    CHECK_EQ(high.count, 0);
+    CHECK_EQ(high.errors, 0);
+
+    // With the bus free again the next one's fine:
+    CHECK_EQ(s5852a_get(&temperature), ESP_OK);
+    CHECK(temperature == 25.0f);
+}
+
+/*
+ * A slave that was cut off mid-byte holds SDA low until it's clocked
+ * through the rest of it; these are the levels it sees.
+ */
+static int m_stuck;
+static uint32_t m_scl = 1;
+static uint32_t m_clocks;
+static uint32_t m_stops;
+
+static void stuck_slave(int gpio, uint32_t level, void *ctx)
+{
+    (void) ctx;
+
+    if (gpio == I2C_SCL) {
+        if (level && !m_scl) {
+            m_clocks++;
+            if (m_stuck > 0 && --m_stuck == 0) {
+                host_gpio_input(I2C_SDA, 1);
+            }
+        }
+        m_scl = level;
+    } else if (gpio == I2C_SDA && level) {
+        if (m_stuck > 0) {
+            host_gpio_input(I2C_SDA, 0);
+        } else if (m_scl) {
+            m_stops++;
+        }
+    }
+}
+
+static void test_recovery(void)
+{
+    i2c_bus_dev_stats_t high;
+    float temperature;
+    uint32_t recoveries = i2c_bus_get_recoveries();
+
+    i2c_bus_reset_stats();
+    m_stuck = STUCK_CLOCKS;
+    host_gpio_input(I2C_SDA, 0);
+    host_gpio_watch(stuck_slave, NULL);
+
+    // One failure's not enough to go poking at the pins:
+    host_i2c_fail(2, ESP_ERR_TIMEOUT);
+    CHECK_EQ(s5852a_get(&temperature), ESP_FAIL);
+    CHECK_EQ(i2c_bus_get_recoveries(), recoveries);
+    CHECK_EQ(m_clocks, 0);
+
+    // The second in a row clocks the slave free, then STOPs:
+    CHECK_EQ(s5852a_get(&temperature), ESP_FAIL);
+    host_gpio_watch(NULL, NULL);
+
+    CHECK_EQ(i2c_bus_get_recoveries(), recoveries + 1);
+    CHECK_EQ(m_stuck, 0);
+    CHECK_EQ(m_clocks, STUCK_CLOCKS + 1);
+    CHECK_EQ(m_stops, 1);
+    CHECK_EQ(host_gpio_level(I2C_SDA), 1);
+    CHECK_EQ(host_gpio_level(I2C_SCL), 1);
+
+    i2c_bus_get_stats(I2C_BUS_DEV_S5852A, &high);
+    CHECK_EQ(high.errors, 2);
+    CHECK_EQ(high.deadline_misses, 0);
+
+    // ...and the reinstalled driver carries on:
+    CHECK_EQ(s5852a_get(&temperature), ESP_OK);
+    CHECK(temperature == 25.0f);
+}
+
+int main(void)
+{
+    slaves_attach();
+    i2c_init();
+
+    RUN(test_reads_jump_the_flood);
+    RUN(test_deadline_miss);
+    RUN(test_recovery);
+
+    return unit_done();
+}
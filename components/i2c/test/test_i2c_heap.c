@@ -0,0 +1,190 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_i2c_heap.c - every heap allocation on the i2c path is one the
+ * esp-idf driver makes for its command link, and there are no more of
+ * those than the transaction has commands
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "unit.h"
+#include "host.h"
+#include "i2c.h"
+#include "s5852a.h"
+#include "s24c08.h"
+#include "i2c_slaves.h"
+
+/*
+ * malloc() and friends are interposed on, and counted whatever thread
+ * calls them (the i2c bus task does the driver calls), forwarding to
+ * glibc's own:
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static atomic_uint m_allocations;
+static atomic_uint m_frees;
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add(&m_allocations, 1);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    atomic_fetch_add(&m_allocations, 1);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add(&m_allocations, 1);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if (ptr != NULL) {
+        atomic_fetch_add(&m_frees, 1);
+    }
+    __libc_free(ptr);
+}
+
+typedef struct {
+    uint32_t allocations;
+    uint32_t frees;
+    host_i2c_stats_t driver;
+} heap_use_t;
+
+static void heap_use_start(heap_use_t *use)
+{
+    use->allocations = atomic_load(&m_allocations);
+    use->frees = atomic_load(&m_frees);
+    host_i2c_get_stats(&use->driver);
+}
+
+static void heap_use_end(heap_use_t *use)
+{
+    host_i2c_stats_t driver;
+
+    host_i2c_get_stats(&driver);
+    use->allocations = atomic_load(&m_allocations) - use->allocations;
+    use->frees = atomic_load(&m_frees) - use->frees;
+    use->driver.transactions = driver.transactions - use->driver.transactions;
+    use->driver.links = driver.links - use->driver.links;
+    use->driver.nodes = driver.nodes - use->driver.nodes;
+    use->driver.allocations = driver.allocations - use->driver.allocations;
+}
+
+static void test_temperature_read(void)
+{
+    float temperature;
+    heap_use_t use;
+
+    heap_use_start(&use);
+    for (int i = 0; i < 100; i++) {
+        CHECK_EQ(s5852a_get(&temperature), ESP_OK);
+    }
+    heap_use_end(&use);
+
+    // The link and its 7 nodes, all given back, and nothing of ours:
+    CHECK_EQ(use.driver.transactions, 100);
+    CHECK_EQ(use.driver.links, 100);
+    CHECK_EQ(use.driver.nodes, 7 * 100);
+    CHECK_EQ(use.allocations, use.driver.allocations);
+    CHECK_EQ(use.frees, use.allocations);
+}
+
+static void test_eeprom_page_write(void)
+{
+    uint8_t page[MAX_PAGE_WRITE] = { 0 };
+    heap_use_t use;
+
+    heap_use_start(&use);
+    for (int i = 0; i < 16; i++) {
+        CHECK_EQ(s24c08_write(i * MAX_PAGE_WRITE, page, sizeof(page)), ESP_OK);
+    }
+    heap_use_end(&use);
+
+    // START, ADDR with the word address and data, STOP:
+    CHECK_EQ(use.driver.transactions, 16);
+    CHECK_EQ(use.driver.nodes, 3 * 16);
+    CHECK_EQ(use.allocations, use.driver.allocations);
+    CHECK_EQ(use.frees, use.allocations);
+}
+
+static void test_eeprom_read(void)
+{
+    uint8_t data[OMAR_EEPROM_SIZE];
+    heap_use_t use;
+
+    heap_use_start(&use);
+    CHECK_EQ(s24c08_read(0, data, sizeof(data)), ESP_OK);
+    heap_use_end(&use);
+
+    CHECK_EQ(use.driver.transactions, 4);
+    CHECK_EQ(use.driver.nodes, 7 * 4);
+    CHECK_EQ(use.allocations, use.driver.allocations);
+    CHECK_EQ(use.frees, use.allocations);
+}
+
+static void test_direct_calls(void)
+{
+    uint8_t pointer = 0x05;
+    uint8_t raw[2];
+    heap_use_t use;
+
+    heap_use_start(&use);
+    CHECK_EQ(i2c_tx(0x18, &pointer, 1), ESP_OK);
+    CHECK_EQ(i2c_rx(0x18, raw, sizeof(raw)), ESP_OK);
+    CHECK_EQ(i2c_write_read(0x18, &pointer, 1, raw, sizeof(raw)), ESP_OK);
+    heap_use_end(&use);
+
+    CHECK_EQ(use.driver.nodes, 3 + 5 + 7);
+    CHECK_EQ(use.allocations, use.driver.allocations);
+    CHECK_EQ(use.frees, use.allocations);
+}
+
+static void test_stats_agree(void)
+{
+    i2c_stats_t before, after;
+    heap_use_t use;
+    float temperature;
+
+    // What the 'i2c' console command reports is what the driver allocated, less the links:
+    i2c_get_stats(&before);
+    heap_use_start(&use);
+    CHECK_EQ(s5852a_get(&temperature), ESP_OK);
+    heap_use_end(&use);
+    i2c_get_stats(&after);
+
+    CHECK_EQ(after.cmd_nodes - before.cmd_nodes, use.driver.nodes);
+    CHECK_EQ(after.max_cmd_nodes, 7);
+}
+
+int main(void)
+{
+    float temperature;
+
+    host_clock_virtual(0);
+    slaves_attach();
+    i2c_init();
+
+    // Once through, so stdio's buffers and the like are already there:
+    s5852a_get(&temperature);
+
+    RUN(test_temperature_read);
+    RUN(test_eeprom_page_write);
+    RUN(test_eeprom_read);
+    RUN(test_direct_calls);
+    RUN(test_stats_agree);
+
+    return unit_done();
+}
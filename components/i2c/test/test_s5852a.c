@@ -0,0 +1,63 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_s5852a.c - s5852a_raw_to_float() against the datasheet's
+ * temperature register examples (the table in the old test())
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "unit.h"
+#include "esp_err.h"
+#include "s5852a.h"
+#include "temp_history.h"
+
+static const struct {
+    uint8_t raw[2];
+    float celsius;
+} m_vectors[] = {
+    { {0xe7, 0xd0}, 125.00f },
+    { {0xe5, 0x50},  85.00f },
+    { {0xe4, 0x10},  65.00f },
+    { {0xe1, 0x90},  25.00f },
+    { {0xe0, 0x10},   1.00f },
+    { {0xe0, 0x04},   0.25f },
+    { {0xe0, 0x00},   0.00f },
+    { {0xff, 0xfc},  -0.25f },
+    { {0xff, 0xf0},  -1.00f },
+    { {0xfe, 0xc0}, -20.00f },
+    { {0xfd, 0x80}, -40.00f },
+};
+
+static void test_datasheet_vectors(void)
+{
+    for (size_t i = 0; i < sizeof(m_vectors) / sizeof(m_vectors[0]); i++) {
+        uint8_t raw[2] = { m_vectors[i].raw[0], m_vectors[i].raw[1] };
+        float celsius = s5852a_raw_to_float(raw);
+
+        if (!CHECK(celsius == m_vectors[i].celsius)) {
+            printf("    0x%02x%02x: %.2f, not %.2f\n", raw[0], raw[1], celsius, m_vectors[i].celsius);
+        }
+
+        // ...and what the temperature history keeps of it is exact:
+        CHECK_EQ(TEMP_HISTORY_TO_QUARTERS(celsius), (int)(m_vectors[i].celsius * 4));
+    }
+}
+
+static void test_flag_bits_ignored(void)
+{
+    // The three alarm bits above the sign don't change the reading:
+    for (uint8_t flags = 0; flags < 8; flags++) {
+        uint8_t raw[2] = { (uint8_t)((flags << 5) | 0x01), 0x90 };
+
+        CHECK(s5852a_raw_to_float(raw) == 25.0f);
+    }
+}
+
+int main(void)
+{
+    RUN(test_datasheet_vectors);
+    RUN(test_flag_bits_ignored);
+
+    return unit_done();
+}
@@ -0,0 +1,57 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * telem_codec.h - packs batches of samples into compact telemetry frames
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "stream_record.h"
+#include "varint.h"
+
+/*
+ * A frame:
+ *
+ *   'T' 'M' | version | count | seq (4) | mask (2) | body len (2) | body | crc (2)
+ *
+ * Multi-byte fields are little-endian, and the crc is rpc_crc16()
+ * over everything before it. The body holds the sample times, then
+ * each channel in the mask (in stream_channel_t order) a column at a
+ * time: the first value, then each one's difference from the one
+ * before, all as zigzag varints. The times go in as differences of
+ * differences, so a steady sample rate costs a byte a sample. Meter
+ * readings move slowly next to their size, so most values take one
+ * or two bytes rather than four.
+ *
+ * The header says how long the body is, so frames can go back to
+ * back over tcp, or one to a datagram over udp.
+ */
+#define TELEM_MAGIC0                ('T')
+#define TELEM_MAGIC1                ('M')
+#define TELEM_VERSION               (1)
+#define TELEM_HEADER_LEN            (12)
+#define TELEM_CRC_LEN               (2)
+#define TELEM_BATCH_MAX             (32)
+#define TELEM_FRAME_MAX             (TELEM_HEADER_LEN + VARINT_MAX * TELEM_BATCH_MAX * (1 + STREAM_CHANNEL_COUNT) + TELEM_CRC_LEN)
+
+typedef struct {
+    uint32_t msec;
+    int32_t values[STREAM_CHANNEL_COUNT];   // indexed by stream_channel_t
+} telem_sample_t;
+
+typedef struct {
+    uint32_t seq;               // frame number
+    uint32_t mask;              // STREAM_CHANNEL_BITs
+    uint32_t count;
+    telem_sample_t samples[TELEM_BATCH_MAX];
+} telem_batch_t;
+
+// Returns the frame's length, or 0 if it won't fit in 'size' bytes (TELEM_FRAME_MAX always does):
+uint32_t telem_frame_encode(const telem_batch_t *batch, uint8_t *out, uint32_t size);
+
+// How long the frame starting at 'data' is, once TELEM_HEADER_LEN bytes are in; 0 if it isn't a frame header:
+uint32_t telem_frame_length(const uint8_t *data);
+
+// For the collector's side; false if the frame is damaged:
+bool telem_frame_decode(const uint8_t *frame, uint32_t len, telem_batch_t *batch);
@@ -0,0 +1,83 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * telem_pub.h - batches samples into telemetry frames and ships them
+ * to a collector over udp or tcp
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "telem_codec.h"
+#include "telem_queue.h"
+#include "telem_spill.h"
+
+/*
+ * Nothing in here is specific to the ESP32: it's plain sockets and
+ * stdio, and the caller supplies the clock, so the same code builds
+ * on a Linux host and can be pointed at a collector on 127.0.0.1.
+ *
+ * Samples collect into a batch, and a batch becomes a frame when it's
+ * full or 'batch_ms' after its first sample. Frames wait in the ram
+ * queue until the socket takes them. When the queue fills up (the
+ * collector is unreachable, or slower than we are) the oldest frames
+ * move to the spill file, and when that's full too, they're dropped.
+ * Once frames are moving again the spill file goes out first, so the
+ * collector still sees them oldest first. The socket never blocks:
+ * a frame it won't take now is tried again on the next poll.
+ */
+#define TELEM_PUB_HOST_MAX          (40)
+#define TELEM_PUB_RETRY_MS          (5000)      // between connection attempts
+#define TELEM_PUB_SEND_BURST        (8)         // most frames sent per poll
+
+typedef struct {
+    char host[TELEM_PUB_HOST_MAX];  // dotted quad
+    uint16_t port;
+    bool tcp;
+    uint32_t mask;                  // STREAM_CHANNEL_BITs to send
+    uint32_t batch_ms;
+    const char *spill_path;         // NULL for no spill file
+    uint32_t spill_max;             // bytes
+} telem_pub_config_t;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t frames;                // frames built
+    uint32_t frame_bytes;           // ... and their total size
+    uint32_t sent;                  // frames the socket took
+    uint32_t sent_bytes;
+    uint32_t spilled;               // frames moved to the spill file
+    uint32_t unspilled;             // ... and read back from it
+    uint32_t dropped;               // frames lost with the queue and spill file both full
+    uint32_t busy;                  // polls where the socket wouldn't take a frame
+    uint32_t errors;                // socket errors (each one costs a reconnect)
+    uint32_t connects;
+    uint32_t started_ms;
+} telem_pub_stats_t;
+
+typedef struct {
+    telem_pub_config_t cfg;
+    int sock;
+    bool connected;
+    uint32_t retry_ms;              // no connection attempts before this
+    telem_batch_t batch;
+    uint32_t batch_start_ms;
+    telem_queue_t queue;
+    telem_spill_t spill;
+    uint8_t encoded[TELEM_FRAME_MAX];
+    uint8_t spare[TELEM_FRAME_MAX]; // for moving a frame from the queue to the spill file
+    uint8_t out[TELEM_FRAME_MAX];   // the frame being sent, already off the queue or spill file
+    uint32_t out_len;
+    uint32_t out_sent;              // how much of it tcp has taken
+    telem_pub_stats_t stats;
+} telem_pub_t;
+
+// 'queue_buf' is the ram queue; it wants to be a good few frames long:
+bool telem_pub_init(telem_pub_t *pub, const telem_pub_config_t *cfg, uint8_t *queue_buf, uint32_t queue_size,
+                    uint32_t now_ms);
+
+void telem_pub_add(telem_pub_t *pub, const telem_sample_t *sample, uint32_t now_ms);
+void telem_pub_poll(telem_pub_t *pub, uint32_t now_ms);
+
+// Closes the socket; whatever hasn't been sent goes to the spill file if it fits:
+void telem_pub_close(telem_pub_t *pub);
@@ -0,0 +1,35 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * telem_queue.h - a bounded ram queue of encoded telemetry frames
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Frames are stored back to back in the caller's buffer, each after
+ * a two byte length, wrapping at the end; a short frame takes only
+ * as much room as it needs. No locking: the publisher is the only
+ * one to touch it.
+ */
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t head;              // bytes written, ever
+    uint32_t tail;              // bytes consumed, ever
+    uint32_t frames;
+} telem_queue_t;
+
+void telem_queue_init(telem_queue_t *queue, uint8_t *buf, uint32_t size);
+
+bool telem_queue_push(telem_queue_t *queue, const uint8_t *frame, uint32_t len);   // false if there isn't room
+
+// Copies the oldest frame to 'out' and drops it from the queue; returns its length, 0 if the queue is empty:
+uint32_t telem_queue_pop(telem_queue_t *queue, uint8_t *out, uint32_t max);
+
+static inline uint32_t telem_queue_used(const telem_queue_t *queue)
+{
+    return queue->head - queue->tail;
+}
@@ -0,0 +1,39 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * telem_spill.h - a file that holds telemetry frames while the
+ * collector can't be reached
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Frames are appended after a two byte length and read back from the
+ * front; the file is removed once it's all been read, so an empty
+ * spill costs nothing. One left over from before a reset is picked up
+ * and sent from the start, so the collector may see some frames
+ * twice (the frame's sequence number and times tell them apart). A
+ * frame cut short by a reset ends the file.
+ */
+typedef struct {
+    const char *path;
+    uint32_t max;               // bytes
+    uint32_t size;              // bytes in the file
+    uint32_t read;              // ... of which have been read back
+    uint32_t written;           // frames appended
+    uint32_t errors;            // failed file operations
+} telem_spill_t;
+
+void telem_spill_init(telem_spill_t *spill, const char *path, uint32_t max);
+
+bool telem_spill_push(telem_spill_t *spill, const uint8_t *frame, uint32_t len);  // false if it's full or the write failed
+
+// Copies the oldest unread frame to 'out'; returns its length, 0 if there isn't one:
+uint32_t telem_spill_pop(telem_spill_t *spill, uint8_t *out, uint32_t max);
+
+static inline uint32_t telem_spill_pending(const telem_spill_t *spill)
+{
+    return spill->size - spill->read;
+}
@@ -0,0 +1,164 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * telem_codec.c - packs batches of samples into compact telemetry frames
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "rpc_frame.h"
+#include "varint.h"
+#include "telem_codec.h"
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t size;
+    bool overflow;
+} writer_t;
+
+typedef struct {
+    const uint8_t *buf;
+    uint32_t pos;
+    uint32_t len;
+    bool bad;
+} reader_t;
+
+static void put_varint(writer_t *w, uint32_t value)
+{
+    if (w->len + varint_len(value) > w->size) {
+        w->overflow = true;
+        return;
+    }
+    w->len += varint_put(&w->buf[w->len], value);
+}
+
+static uint32_t get_varint(reader_t *r)
+{
+    uint32_t value;
+    uint32_t n = varint_get(&r->buf[r->pos], r->len - r->pos, &value);
+
+    if (n == 0) {
+        r->bad = true;
+        return 0;
+    }
+    r->pos += n;
+    return value;
+}
+
+static void put_le(uint8_t *out, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+static uint32_t get_le(const uint8_t *in, int bytes)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint32_t) in[i] << (8 * i);
+    }
+    return value;
+}
+
+uint32_t telem_frame_encode(const telem_batch_t *batch, uint8_t *out, uint32_t size)
+{
+    if (size < TELEM_HEADER_LEN + TELEM_CRC_LEN || batch->count > TELEM_BATCH_MAX) {
+        return 0;
+    }
+
+    writer_t w = { out, TELEM_HEADER_LEN, size - TELEM_CRC_LEN, false };
+    uint32_t prev = 0;
+    uint32_t prev_step = 0;
+
+    // The first time goes in whole (as a difference from zero), then a difference of differences each:
+    for (uint32_t i = 0; i < batch->count; i++) {
+        uint32_t step = batch->samples[i].msec - prev;
+
+        put_varint(&w, varint_zigzag((int32_t)(step - prev_step)));
+        prev = batch->samples[i].msec;
+        prev_step = (i == 0 ? 0 : step);
+    }
+
+    for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+        if (!(batch->mask & STREAM_CHANNEL_BIT(ch))) {
+            continue;
+        }
+        prev = 0;
+        for (uint32_t i = 0; i < batch->count; i++) {
+            uint32_t value = (uint32_t) batch->samples[i].values[ch];
+
+            put_varint(&w, varint_zigzag((int32_t)(value - prev)));
+            prev = value;
+        }
+    }
+
+    if (w.overflow) {
+        return 0;
+    }
+
+    out[0] = TELEM_MAGIC0;
+    out[1] = TELEM_MAGIC1;
+    out[2] = TELEM_VERSION;
+    out[3] = batch->count;
+    put_le(&out[4], batch->seq, 4);
+    put_le(&out[8], batch->mask, 2);
+    put_le(&out[10], w.len - TELEM_HEADER_LEN, 2);
+    put_le(&out[w.len], rpc_crc16(RPC_CRC16_INIT, out, w.len), 2);
+
+    return w.len + TELEM_CRC_LEN;
+}
+
+uint32_t telem_frame_length(const uint8_t *data)
+{
+    if (data[0] != TELEM_MAGIC0 || data[1] != TELEM_MAGIC1 || data[2] != TELEM_VERSION || data[3] > TELEM_BATCH_MAX) {
+        return 0;
+    }
+
+    uint32_t len = TELEM_HEADER_LEN + get_le(&data[10], 2) + TELEM_CRC_LEN;
+
+    return (len <= TELEM_FRAME_MAX ? len : 0);
+}
+
+bool telem_frame_decode(const uint8_t *frame, uint32_t len, telem_batch_t *batch)
+{
+    if (len < TELEM_HEADER_LEN + TELEM_CRC_LEN || telem_frame_length(frame) != len) {
+        return false;
+    }
+    if (rpc_crc16(RPC_CRC16_INIT, frame, len - TELEM_CRC_LEN) != get_le(&frame[len - TELEM_CRC_LEN], 2)) {
+        return false;
+    }
+
+    reader_t r = { frame, TELEM_HEADER_LEN, len - TELEM_CRC_LEN, false };
+    uint32_t prev = 0;
+    uint32_t prev_step = 0;
+
+    memset(batch, 0, sizeof(*batch));
+    batch->count = frame[3];
+    batch->seq = get_le(&frame[4], 4);
+    batch->mask = get_le(&frame[8], 2);
+
+    for (uint32_t i = 0; i < batch->count; i++) {
+        uint32_t step = prev_step + (uint32_t) varint_unzigzag(get_varint(&r));
+
+        batch->samples[i].msec = prev + step;
+        prev = batch->samples[i].msec;
+        prev_step = (i == 0 ? 0 : step);
+    }
+
+    for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+        if (!(batch->mask & STREAM_CHANNEL_BIT(ch))) {
+            continue;
+        }
+        prev = 0;
+        for (uint32_t i = 0; i < batch->count; i++) {
+            prev += (uint32_t) varint_unzigzag(get_varint(&r));
+            batch->samples[i].values[ch] = (int32_t) prev;
+        }
+    }
+
+    return (!r.bad && r.pos == r.len);
+}
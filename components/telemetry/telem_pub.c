@@ -0,0 +1,263 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * telem_pub.c - batches samples into telemetry frames and ships them
+ * to a collector over udp or tcp
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "telem_pub.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL                (0)
+#endif
+
+static bool time_reached(uint32_t now_ms, uint32_t when_ms)
+{
+    return ((int32_t)(now_ms - when_ms) >= 0);
+}
+
+static void pub_disconnect(telem_pub_t *pub, uint32_t now_ms)
+{
+    if (pub->sock >= 0) {
+        close(pub->sock);
+    }
+    pub->sock = -1;
+    pub->connected = false;
+    pub->out_sent = 0;          // tcp starts the frame over on the next connection
+    pub->retry_ms = now_ms + TELEM_PUB_RETRY_MS;
+}
+
+static bool pub_connect(telem_pub_t *pub, uint32_t now_ms)
+{
+    if (pub->connected) {
+        return true;
+    }
+
+    if (pub->sock < 0) {
+        if (!time_reached(now_ms, pub->retry_ms)) {
+            return false;
+        }
+
+        struct sockaddr_in addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(pub->cfg.port);
+        inet_aton(pub->cfg.host, &addr.sin_addr);
+
+        pub->sock = socket(AF_INET, (pub->cfg.tcp ? SOCK_STREAM : SOCK_DGRAM), 0);
+        if (pub->sock < 0 || fcntl(pub->sock, F_SETFL, O_NONBLOCK) < 0) {
+            pub->stats.errors++;
+            pub_disconnect(pub, now_ms);
+            return false;
+        }
+
+        // For udp this just sets where send() goes:
+        if (connect(pub->sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+            if (errno != EINPROGRESS) {
+                pub->stats.errors++;
+                pub_disconnect(pub, now_ms);
+                return false;
+            }
+            // The handshake gets until the next retry time:
+            pub->retry_ms = now_ms + TELEM_PUB_RETRY_MS;
+            return false;
+        }
+    } else {
+        // A tcp connect under way is done once the socket is writable:
+        fd_set writable;
+        struct timeval no_wait = { 0, 0 };
+
+        FD_ZERO(&writable);
+        FD_SET(pub->sock, &writable);
+        if (select(pub->sock + 1, NULL, &writable, NULL, &no_wait) <= 0) {
+            if (time_reached(now_ms, pub->retry_ms)) {
+                pub->stats.errors++;
+                pub_disconnect(pub, now_ms);
+            }
+            return false;
+        }
+
+        int err = 0;
+        socklen_t len = sizeof(err);
+
+        if (getsockopt(pub->sock, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            pub->stats.errors++;
+            pub_disconnect(pub, now_ms);
+            return false;
+        }
+    }
+
+    pub->connected = true;
+    pub->stats.connects++;
+    return true;
+}
+
+// The spill file holds older frames than the queue does, so it goes first:
+static bool pub_next(telem_pub_t *pub)
+{
+    if (pub->out_len != 0) {
+        return true;
+    }
+
+    if (pub->cfg.spill_path != NULL && telem_spill_pending(&pub->spill) != 0) {
+        pub->out_len = telem_spill_pop(&pub->spill, pub->out, sizeof(pub->out));
+        if (pub->out_len != 0) {
+            pub->stats.unspilled++;
+            return true;
+        }
+    }
+
+    pub->out_len = telem_queue_pop(&pub->queue, pub->out, sizeof(pub->out));
+    return (pub->out_len != 0);
+}
+
+// True once the socket has taken all of the frame in 'out':
+static bool pub_send(telem_pub_t *pub, uint32_t now_ms)
+{
+    while (pub->out_sent < pub->out_len) {
+        ssize_t n = send(pub->sock, pub->out + pub->out_sent, pub->out_len - pub->out_sent, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOMEM || errno == ENOBUFS) {
+                pub->stats.busy++;
+            } else {
+                pub->stats.errors++;
+                pub_disconnect(pub, now_ms);
+            }
+            return false;
+        }
+        // A datagram goes whole or not at all:
+        pub->out_sent = (pub->cfg.tcp ? pub->out_sent + n : pub->out_len);
+    }
+
+    pub->stats.sent++;
+    pub->stats.sent_bytes += pub->out_len;
+    pub->out_len = 0;
+    pub->out_sent = 0;
+    return true;
+}
+
+static void pub_spill(telem_pub_t *pub, const uint8_t *frame, uint32_t len)
+{
+    if (pub->cfg.spill_path != NULL && telem_spill_push(&pub->spill, frame, len)) {
+        pub->stats.spilled++;
+    } else {
+        pub->stats.dropped++;
+    }
+}
+
+static void pub_enqueue(telem_pub_t *pub, const uint8_t *frame, uint32_t len)
+{
+    // Make room by moving the oldest frames out to the spill file:
+    while (!telem_queue_push(&pub->queue, frame, len)) {
+        if (pub->queue.frames == 0) {
+            // Bigger than the whole queue:
+            pub_spill(pub, frame, len);
+            return;
+        }
+
+        uint32_t old_len = telem_queue_pop(&pub->queue, pub->spare, sizeof(pub->spare));
+        if (old_len != 0) {
+            pub_spill(pub, pub->spare, old_len);
+        }
+    }
+}
+
+static void pub_flush(telem_pub_t *pub)
+{
+    if (pub->batch.count == 0) {
+        return;
+    }
+
+    uint32_t len = telem_frame_encode(&pub->batch, pub->encoded, sizeof(pub->encoded));
+
+    pub->batch.seq++;
+    pub->batch.count = 0;
+
+    pub->stats.frames++;
+    pub->stats.frame_bytes += len;
+    pub_enqueue(pub, pub->encoded, len);
+}
+
+bool telem_pub_init(telem_pub_t *pub, const telem_pub_config_t *cfg, uint8_t *queue_buf, uint32_t queue_size,
+                    uint32_t now_ms)
+{
+    struct in_addr addr;
+
+    if (cfg->port == 0 || (cfg->mask & ~STREAM_ALL_CHANNELS) != 0 || inet_aton(cfg->host, &addr) == 0) {
+        return false;
+    }
+
+    memset(pub, 0, sizeof(*pub));
+    pub->cfg = *cfg;
+    pub->sock = -1;
+    pub->retry_ms = now_ms;
+    pub->batch.mask = cfg->mask;
+    pub->stats.started_ms = now_ms;
+
+    telem_queue_init(&pub->queue, queue_buf, queue_size);
+    if (cfg->spill_path != NULL) {
+        telem_spill_init(&pub->spill, cfg->spill_path, cfg->spill_max);
+    }
+    return true;
+}
+
+void telem_pub_add(telem_pub_t *pub, const telem_sample_t *sample, uint32_t now_ms)
+{
+    if (pub->batch.count == 0) {
+        pub->batch_start_ms = now_ms;
+    }
+    pub->batch.samples[pub->batch.count++] = *sample;
+    pub->stats.samples++;
+
+    if (pub->batch.count == TELEM_BATCH_MAX) {
+        pub_flush(pub);
+    }
+}
+
+void telem_pub_poll(telem_pub_t *pub, uint32_t now_ms)
+{
+    if (pub->batch.count != 0 && time_reached(now_ms, pub->batch_start_ms + pub->cfg.batch_ms)) {
+        pub_flush(pub);
+    }
+
+    if (!pub_connect(pub, now_ms)) {
+        return;
+    }
+
+    for (int i = 0; i < TELEM_PUB_SEND_BURST; i++) {
+        if (!pub_next(pub) || !pub_send(pub, now_ms)) {
+            break;
+        }
+    }
+}
+
+void telem_pub_close(telem_pub_t *pub)
+{
+    uint32_t len;
+
+    pub_flush(pub);
+
+    // Whatever was on its way out goes behind anything already spilled, so the odd frame may come out of order:
+    if (pub->out_len != 0) {
+        pub_spill(pub, pub->out, pub->out_len);
+        pub->out_len = 0;
+    }
+    while ((len = telem_queue_pop(&pub->queue, pub->encoded, sizeof(pub->encoded))) != 0) {
+        pub_spill(pub, pub->encoded, len);
+    }
+
+    pub_disconnect(pub, 0);
+}
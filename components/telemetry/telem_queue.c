@@ -0,0 +1,82 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * telem_queue.c - a bounded ram queue of encoded telemetry frames
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "telem_queue.h"
+
+#define TELEM_QUEUE_LEN_BYTES       (2)
+
+static void queue_write(telem_queue_t *queue, const uint8_t *data, uint32_t len)
+{
+    uint32_t pos = queue->head % queue->size;
+    uint32_t first = queue->size - pos;
+
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&queue->buf[pos], data, first);
+    memcpy(queue->buf, data + first, len - first);
+    queue->head += len;
+}
+
+static void queue_read(telem_queue_t *queue, uint8_t *data, uint32_t len)
+{
+    uint32_t pos = queue->tail % queue->size;
+    uint32_t first = queue->size - pos;
+
+    if (first > len) {
+        first = len;
+    }
+    memcpy(data, &queue->buf[pos], first);
+    memcpy(data + first, queue->buf, len - first);
+    queue->tail += len;
+}
+
+void telem_queue_init(telem_queue_t *queue, uint8_t *buf, uint32_t size)
+{
+    memset(queue, 0, sizeof(*queue));
+    queue->buf = buf;
+    queue->size = size;
+}
+
+bool telem_queue_push(telem_queue_t *queue, const uint8_t *frame, uint32_t len)
+{
+    if (len == 0 || len > 0xffff || TELEM_QUEUE_LEN_BYTES + len > queue->size - telem_queue_used(queue)) {
+        return false;
+    }
+
+    uint8_t prefix[TELEM_QUEUE_LEN_BYTES] = { len & 0xff, len >> 8 };
+
+    queue_write(queue, prefix, sizeof(prefix));
+    queue_write(queue, frame, len);
+    queue->frames++;
+    return true;
+}
+
+uint32_t telem_queue_pop(telem_queue_t *queue, uint8_t *out, uint32_t max)
+{
+    if (queue->frames == 0) {
+        return 0;
+    }
+
+    uint8_t prefix[TELEM_QUEUE_LEN_BYTES];
+
+    queue_read(queue, prefix, sizeof(prefix));
+    uint32_t len = prefix[0] | (prefix[1] << 8);
+
+    if (len > max) {
+        // Can't happen if 'max' is TELEM_FRAME_MAX; drop it rather than wedge the queue:
+        queue->tail += len;
+        queue->frames--;
+        return 0;
+    }
+
+    queue_read(queue, out, len);
+    queue->frames--;
+    return len;
+}
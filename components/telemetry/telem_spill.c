@@ -0,0 +1,103 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * telem_spill.c - a file that holds telemetry frames while the
+ * collector can't be reached
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "telem_spill.h"
+
+#define TELEM_SPILL_LEN_BYTES       (2)
+
+static void spill_empty(telem_spill_t *spill)
+{
+    remove(spill->path);
+    spill->size = 0;
+    spill->read = 0;
+}
+
+void telem_spill_init(telem_spill_t *spill, const char *path, uint32_t max)
+{
+    memset(spill, 0, sizeof(*spill));
+    spill->path = path;
+    spill->max = max;
+
+    FILE *f = fopen(path, "rb");
+    if (f != NULL) {
+        if (fseek(f, 0, SEEK_END) == 0) {
+            long size = ftell(f);
+            spill->size = (size > 0 ? size : 0);
+        }
+        fclose(f);
+    }
+}
+
+bool telem_spill_push(telem_spill_t *spill, const uint8_t *frame, uint32_t len)
+{
+    if (len == 0 || len > 0xffff || spill->size + TELEM_SPILL_LEN_BYTES + len > spill->max) {
+        return false;
+    }
+
+    FILE *f = fopen(spill->path, "ab");
+    if (f == NULL) {
+        spill->errors++;
+        return false;
+    }
+
+    uint8_t prefix[TELEM_SPILL_LEN_BYTES] = { len & 0xff, len >> 8 };
+    bool ok = (fwrite(prefix, 1, sizeof(prefix), f) == sizeof(prefix) && fwrite(frame, 1, len, f) == len);
+
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        // A partial record would throw off everything after it:
+        spill->errors++;
+        spill_empty(spill);
+        return false;
+    }
+
+    spill->size += sizeof(prefix) + len;
+    spill->written++;
+    return true;
+}
+
+uint32_t telem_spill_pop(telem_spill_t *spill, uint8_t *out, uint32_t max)
+{
+    if (telem_spill_pending(spill) == 0) {
+        return 0;
+    }
+
+    FILE *f = fopen(spill->path, "rb");
+    uint8_t prefix[TELEM_SPILL_LEN_BYTES];
+    uint32_t len = 0;
+
+    if (f != NULL
+        && fseek(f, spill->read, SEEK_SET) == 0
+        && fread(prefix, 1, sizeof(prefix), f) == sizeof(prefix)) {
+        len = prefix[0] | (prefix[1] << 8);
+        if (len > max || fread(out, 1, len, f) != len) {
+            len = 0;
+        }
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+
+    if (len == 0) {
+        // Missing, truncated or garbage: nothing after this point can be trusted.
+        spill->errors++;
+        spill_empty(spill);
+        return 0;
+    }
+
+    spill->read += sizeof(prefix) + len;
+    if (telem_spill_pending(spill) == 0) {
+        spill_empty(spill);
+    }
+    return len;
+}
@@ -0,0 +1,114 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * bench_telem.c - what a telemetry frame costs to build and to read
+ * back, and how fast the publisher moves samples to a collector on
+ * loopback over udp and tcp, in frames/s, samples/s and bytes/sample
+ */
+
+#include "collector.h"
+#include "host_bench.h"
+#include "telem_pub.h"
+
+#define BENCH_REPS          (5000)
+#define LOOPBACK_SAMPLES    (320000)
+#define ALL_CHANNELS        ((1 << STREAM_CHANNEL_COUNT) - 1)
+
+static telem_batch_t m_batch;
+static telem_batch_t m_decoded;
+static uint8_t m_frame[TELEM_FRAME_MAX];
+static uint32_t m_frame_len;
+static uint8_t m_queue[64 * 1024];
+static telem_pub_t m_pub;
+static collector_t m_collector;
+
+static void bench_encode(void *arg)
+{
+    (void) arg;
+    m_frame_len = telem_frame_encode(&m_batch, m_frame, sizeof(m_frame));
+}
+
+static void bench_decode(void *arg)
+{
+    (void) arg;
+    telem_frame_decode(m_frame, m_frame_len, &m_decoded);
+}
+
+static void fill_batch(uint32_t mask)
+{
+    memset(&m_batch, 0, sizeof(m_batch));
+    m_batch.mask = mask;
+    for (uint32_t i = 0; i < TELEM_BATCH_MAX; i++) {
+        collector_sample(i, &m_batch.samples[m_batch.count++]);
+    }
+    bench_encode(NULL);
+}
+
+/*
+ * The sample clock runs at whatever pace the host can manage rather
+ * than 10Hz, so this is the ceiling the code sets, not the meter.
+ */
+static void loopback(bool tcp)
+{
+    telem_pub_config_t cfg = {
+        .host = "127.0.0.1",
+        .tcp = tcp,
+        .mask = ALL_CHANNELS,
+        .batch_ms = 60000,
+    };
+    telem_sample_t sample;
+
+    if (!collector_open(&m_collector, tcp, 0)) {
+        printf("# %s: no collector\n", tcp ? "tcp" : "udp");
+        return;
+    }
+    cfg.port = m_collector.port;
+    telem_pub_init(&m_pub, &cfg, m_queue, sizeof(m_queue), 0);
+
+    uint32_t start = host_bench_clock();
+
+    for (uint32_t i = 0; i < LOOPBACK_SAMPLES; i++) {
+        collector_sample(i, &sample);
+        telem_pub_add(&m_pub, &sample, sample.msec);
+        telem_pub_poll(&m_pub, sample.msec);
+        if (i % TELEM_BATCH_MAX == 0) {
+            collector_drain(&m_collector);
+        }
+    }
+    for (uint32_t i = 0; i < 1000 && m_collector.frames < m_pub.stats.sent; i++) {
+        telem_pub_poll(&m_pub, sample.msec);
+        collector_drain(&m_collector);
+    }
+
+    double secs = (uint32_t)(host_bench_clock() - start) / 1e9;
+
+    printf("# loopback %s: %.0f frames/s, %.0f samples/s, %.2f bytes/sample"
+           " (%u of %u frames arrived, %u dropped, %u busy)\n",
+           tcp ? "tcp" : "udp", m_collector.frames / secs, m_collector.samples / secs,
+           (double) m_collector.bytes / m_collector.samples, m_collector.frames, m_pub.stats.frames,
+           m_pub.stats.dropped, m_pub.stats.busy);
+
+    telem_pub_close(&m_pub);
+    collector_close(&m_collector);
+}
+
+int main(void)
+{
+    bench_t bench;
+
+    host_bench_init(&bench, "telem");
+
+    fill_batch(STREAM_CHANNEL_BIT(STREAM_VRMS) | STREAM_CHANNEL_BIT(STREAM_IRMSA) | STREAM_CHANNEL_BIT(STREAM_AWATT));
+    printf("# 3 channels: %u bytes for %u samples\n", m_frame_len, m_batch.count);
+    host_bench_run(&bench, "encode_3ch", bench_encode, NULL, BENCH_REPS);
+    host_bench_run(&bench, "decode_3ch", bench_decode, NULL, BENCH_REPS);
+
+    fill_batch(ALL_CHANNELS);
+    printf("# %u channels: %u bytes for %u samples\n", STREAM_CHANNEL_COUNT, m_frame_len, m_batch.count);
+    host_bench_run(&bench, "encode_all", bench_encode, NULL, BENCH_REPS);
+    host_bench_run(&bench, "decode_all", bench_decode, NULL, BENCH_REPS);
+
+    loopback(false);
+    loopback(true);
+
+    return 0;
+}
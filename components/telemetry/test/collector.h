@@ -0,0 +1,199 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * collector.h - a stand-in telemetry collector on 127.0.0.1, udp or
+ * tcp, that decodes what arrives and checks it against the samples
+ * the test made
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "telem_codec.h"
+
+#define COLLECTOR_BUF               (64 * 1024)
+#define COLLECTOR_STEP_MS           (100)       // the test's sample period
+
+typedef struct {
+    bool tcp;
+    int listener;                   // tcp
+    int sock;                       // the udp socket, or the accepted tcp connection
+    uint16_t port;
+    uint8_t buf[COLLECTOR_BUF];
+    uint32_t len;
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t samples;
+    uint32_t bad;                   // frames that didn't decode, or had the wrong samples in them
+    uint32_t out_of_order;          // frames with a seq at or before the last one's
+    uint32_t gaps;                  // places where frames were skipped
+    uint32_t missing;               // ... and how many
+    bool started;
+    uint32_t next_seq;
+    uint32_t next_sample;           // index of the sample expected next
+} collector_t;
+
+// Sample 'i' of the test's stream; every channel is some function of it, so a frame can be checked on its own:
+static inline void collector_sample(uint32_t i, telem_sample_t *sample)
+{
+    sample->msec = 1000 + i * COLLECTOR_STEP_MS;
+    for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+        sample->values[ch] = (int32_t)(2000000 + (ch + 1) * (int32_t)(i % 97) - ch * 1000);
+    }
+}
+
+static inline int collector_socket(bool tcp, uint16_t port)
+{
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd = socket(AF_INET, (tcp ? SOCK_STREAM : SOCK_DGRAM), 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || (tcp && listen(fd, 1) != 0)) {
+        perror("collector");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+static inline uint16_t collector_port_of(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    getsockname(fd, (struct sockaddr *) &addr, &len);
+    return ntohs(addr.sin_port);
+}
+
+// Port 0 for any free one:
+static inline bool collector_open(collector_t *c, bool tcp, uint16_t port)
+{
+    int fd = collector_socket(tcp, port);
+
+    memset(c, 0, sizeof(*c));
+    c->tcp = tcp;
+    c->listener = (tcp ? fd : -1);
+    c->sock = (tcp ? -1 : fd);
+    c->port = (fd >= 0 ? collector_port_of(fd) : 0);
+    return (fd >= 0);
+}
+
+static inline void collector_close(collector_t *c)
+{
+    if (c->sock >= 0) {
+        close(c->sock);
+    }
+    if (c->listener >= 0) {
+        close(c->listener);
+    }
+    c->sock = c->listener = -1;
+}
+
+static inline void collector_frame(collector_t *c, const uint8_t *frame, uint32_t len)
+{
+    static telem_batch_t batch;
+    telem_sample_t expected;
+
+    c->frames++;
+    c->bytes += len;
+    if (!telem_frame_decode(frame, len, &batch) || batch.count == 0) {
+        c->bad++;
+        return;
+    }
+
+    if (c->started && batch.seq != c->next_seq) {
+        if ((int32_t)(batch.seq - c->next_seq) < 0) {
+            c->out_of_order++;
+        } else {
+            c->gaps++;
+            c->missing += batch.seq - c->next_seq;
+        }
+    }
+    c->started = true;
+    c->next_seq = batch.seq + 1;
+
+    // Which sample it starts at comes from its time:
+    uint32_t first = (batch.samples[0].msec - 1000) / COLLECTOR_STEP_MS;
+
+    for (uint32_t i = 0; i < batch.count; i++) {
+        collector_sample(first + i, &expected);
+        if (batch.samples[i].msec != expected.msec) {
+            c->bad++;
+            return;
+        }
+        for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+            if ((batch.mask & STREAM_CHANNEL_BIT(ch)) && batch.samples[i].values[ch] != expected.values[ch]) {
+                c->bad++;
+                return;
+            }
+        }
+    }
+    c->samples += batch.count;
+    c->next_sample = first + batch.count;
+}
+
+// Takes whatever has arrived; datagrams are a frame each, tcp is a stream of them back to back:
+static inline void collector_drain(collector_t *c)
+{
+    if (c->tcp && c->sock < 0) {
+        c->sock = accept(c->listener, NULL, NULL);
+        if (c->sock < 0) {
+            return;
+        }
+        fcntl(c->sock, F_SETFL, O_NONBLOCK);
+    }
+
+    while (true) {
+        ssize_t n = recv(c->sock, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+
+        if (n <= 0) {
+            if (n == 0 && c->tcp) {
+                // The publisher hung up; the next connection starts a fresh stream:
+                close(c->sock);
+                c->sock = -1;
+                c->len = 0;
+            }
+            return;
+        }
+        if (!c->tcp) {
+            collector_frame(c, c->buf, n);
+            continue;
+        }
+
+        c->len += n;
+        while (c->len >= TELEM_HEADER_LEN) {
+            uint32_t len = telem_frame_length(c->buf);
+
+            if (len == 0) {
+                // Lost sync, which tcp shouldn't ever do:
+                c->bad++;
+                c->len = 0;
+                break;
+            }
+            if (c->len < len) {
+                break;
+            }
+            collector_frame(c, c->buf, len);
+            memmove(c->buf, c->buf + len, c->len - len);
+            c->len -= len;
+        }
+    }
+}
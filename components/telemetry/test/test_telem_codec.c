@@ -0,0 +1,225 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_telem_codec.c - telemetry frames round-trip exactly, at the
+ * extremes too, damage is caught, and how small steady meter data packs
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "unit.h"
+#include "telem_codec.h"
+
+static telem_batch_t m_batch;
+static telem_batch_t m_decoded;
+static uint8_t m_frame[TELEM_FRAME_MAX];
+
+static uint32_t random32(void)
+{
+    return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+static bool batches_equal(const telem_batch_t *a, const telem_batch_t *b)
+{
+    if (a->seq != b->seq || a->mask != b->mask || a->count != b->count) {
+        return false;
+    }
+    for (uint32_t i = 0; i < a->count; i++) {
+        if (a->samples[i].msec != b->samples[i].msec) {
+            return false;
+        }
+        for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+            if ((a->mask & STREAM_CHANNEL_BIT(ch)) && a->samples[i].values[ch] != b->samples[i].values[ch]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool round_trips(const telem_batch_t *batch)
+{
+    uint32_t len = telem_frame_encode(batch, m_frame, sizeof(m_frame));
+
+    return (len != 0
+            && telem_frame_length(m_frame) == len
+            && telem_frame_decode(m_frame, len, &m_decoded)
+            && batches_equal(batch, &m_decoded));
+}
+
+static void test_random_batches(void)
+{
+    uint32_t failures = 0;
+
+    srand(4043);
+    for (uint32_t run = 0; run < 5000; run++) {
+        memset(&m_batch, 0, sizeof(m_batch));
+        m_batch.seq = random32();
+        m_batch.mask = random32() & STREAM_ALL_CHANNELS;
+        m_batch.count = rand() % (TELEM_BATCH_MAX + 1);
+
+        // Anything from small steps to the full range, so every varint length comes up:
+        uint32_t spread = 1u << (rand() % 32);
+
+        for (uint32_t i = 0; i < m_batch.count; i++) {
+            m_batch.samples[i].msec = (i == 0 ? random32() : m_batch.samples[i - 1].msec + random32() % spread);
+            for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+                m_batch.samples[i].values[ch] = (int32_t)(random32() % spread) - (int32_t)(spread / 2);
+            }
+        }
+        failures += !round_trips(&m_batch);
+    }
+    CHECK_EQ(failures, 0);
+}
+
+static void test_extremes(void)
+{
+    memset(&m_batch, 0, sizeof(m_batch));
+    m_batch.seq = UINT32_MAX;
+    m_batch.mask = STREAM_ALL_CHANNELS;
+    m_batch.count = TELEM_BATCH_MAX;
+
+    // Values swinging end to end, and times wrapping and going backwards:
+    for (uint32_t i = 0; i < TELEM_BATCH_MAX; i++) {
+        m_batch.samples[i].msec = (i % 3 == 0 ? UINT32_MAX - i : i * 0x7fffffffu);
+        for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+            m_batch.samples[i].values[ch] = ((i + ch) % 2 ? INT32_MIN : INT32_MAX);
+        }
+    }
+    CHECK(round_trips(&m_batch));
+
+    // Differences of INT32_MIN (modulo 2^32) are the longest varints there are, and it still fits:
+    for (uint32_t i = 0; i < TELEM_BATCH_MAX; i++) {
+        for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+            m_batch.samples[i].values[ch] = ((i + ch) % 2 ? INT32_MIN : 0);
+        }
+    }
+    CHECK(round_trips(&m_batch));
+
+    uint32_t len = telem_frame_encode(&m_batch, m_frame, sizeof(m_frame));
+
+    CHECK(len <= TELEM_FRAME_MAX);
+    CHECK(len >= TELEM_HEADER_LEN + VARINT_MAX * (TELEM_BATCH_MAX - 1) * STREAM_CHANNEL_COUNT);
+
+    // An empty batch is still a frame:
+    m_batch.count = 0;
+    CHECK(round_trips(&m_batch));
+    CHECK_EQ(telem_frame_encode(&m_batch, m_frame, sizeof(m_frame)), TELEM_HEADER_LEN + TELEM_CRC_LEN);
+
+    m_batch.count = TELEM_BATCH_MAX + 1;
+    CHECK_EQ(telem_frame_encode(&m_batch, m_frame, sizeof(m_frame)), 0);
+}
+
+static void test_short_buffer(void)
+{
+    uint32_t wrong = 0;
+
+    memset(&m_batch, 0, sizeof(m_batch));
+    m_batch.mask = STREAM_CHANNEL_BIT(STREAM_VRMS) | STREAM_CHANNEL_BIT(STREAM_AWATT);
+    m_batch.count = 20;
+    for (uint32_t i = 0; i < m_batch.count; i++) {
+        m_batch.samples[i].msec = i * 1000;
+        m_batch.samples[i].values[STREAM_VRMS] = 2000000 + i * 1000;
+        m_batch.samples[i].values[STREAM_AWATT] = -(int32_t) i * 100000;
+    }
+
+    uint32_t len = telem_frame_encode(&m_batch, m_frame, sizeof(m_frame));
+
+    // Anything short of the whole frame is refused rather than written past:
+    for (uint32_t size = 0; size < len; size++) {
+        memset(m_frame, 0xee, sizeof(m_frame));
+        wrong += (telem_frame_encode(&m_batch, m_frame, size) != 0);
+        wrong += (m_frame[size] != 0xee && size >= TELEM_HEADER_LEN);
+    }
+    CHECK_EQ(wrong, 0);
+    CHECK_EQ(telem_frame_encode(&m_batch, m_frame, len), len);
+}
+
+static void test_damage(void)
+{
+    uint32_t missed = 0;
+
+    memset(&m_batch, 0, sizeof(m_batch));
+    m_batch.seq = 7;
+    m_batch.mask = STREAM_ALL_CHANNELS;
+    m_batch.count = 8;
+    for (uint32_t i = 0; i < m_batch.count; i++) {
+        m_batch.samples[i].msec = 5000 + i * 250;
+        for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+            m_batch.samples[i].values[ch] = ch * 1000 + i;
+        }
+    }
+
+    uint32_t len = telem_frame_encode(&m_batch, m_frame, sizeof(m_frame));
+
+    // Every single-bit error:
+    for (uint32_t bit = 0; bit < len * 8; bit++) {
+        m_frame[bit / 8] ^= 1 << (bit % 8);
+        missed += telem_frame_decode(m_frame, len, &m_decoded);
+        m_frame[bit / 8] ^= 1 << (bit % 8);
+    }
+    CHECK_EQ(missed, 0);
+
+    // Cut short or run on:
+    for (uint32_t n = 0; n < len; n++) {
+        missed += telem_frame_decode(m_frame, n, &m_decoded);
+    }
+    missed += telem_frame_decode(m_frame, len + 1, &m_decoded);
+    CHECK_EQ(missed, 0);
+    CHECK(telem_frame_decode(m_frame, len, &m_decoded));
+
+    // Not a header at all:
+    m_frame[2] = TELEM_VERSION + 1;
+    CHECK_EQ(telem_frame_length(m_frame), 0);
+    m_frame[2] = TELEM_VERSION;
+    m_frame[3] = TELEM_BATCH_MAX + 1;
+    CHECK_EQ(telem_frame_length(m_frame), 0);
+}
+
+static void test_steady_meter_size(void)
+{
+    uint32_t bytes = 0;
+    uint32_t samples = 0;
+
+    srand(1);
+    memset(&m_batch, 0, sizeof(m_batch));
+    m_batch.mask = STREAM_CHANNEL_BIT(STREAM_VRMS) | STREAM_CHANNEL_BIT(STREAM_IRMSA) | STREAM_CHANNEL_BIT(STREAM_AWATT);
+
+    /*
+     * An hour at 1Hz of a steady load: raw register values around a
+     * 120V mains and a few amps, with a little noise, as the meter
+     * reads them:
+     */
+    for (uint32_t t = 0; t < 3600; t += TELEM_BATCH_MAX) {
+        m_batch.count = TELEM_BATCH_MAX;
+        for (uint32_t i = 0; i < TELEM_BATCH_MAX; i++) {
+            m_batch.samples[i].msec = 20000 + (t + i) * 1000 + rand() % 3;
+            m_batch.samples[i].values[STREAM_VRMS] = 2100000 + rand() % 200 - 100;
+            m_batch.samples[i].values[STREAM_IRMSA] = 450000 + rand() % 100 - 50;
+            m_batch.samples[i].values[STREAM_AWATT] = -1200000 + rand() % 120 - 60;
+        }
+        bytes += telem_frame_encode(&m_batch, m_frame, sizeof(m_frame));
+        samples += m_batch.count;
+        m_batch.seq++;
+    }
+
+    // Against 4 bytes a value and 4 for the time, uncompressed:
+    double per_sample = (double) bytes / samples;
+
+    printf("    3 channels at 1Hz: %.2f bytes/sample (16 raw)\n", per_sample);
+    CHECK(per_sample < 8.0);
+}
+
+int main(void)
+{
+    RUN(test_random_batches);
+    RUN(test_extremes);
+    RUN(test_short_buffer);
+    RUN(test_damage);
+    RUN(test_steady_meter_size);
+
+    return unit_done();
+}
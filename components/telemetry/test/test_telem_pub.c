@@ -0,0 +1,338 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_telem_pub.c - the telemetry publisher against a collector on
+ * loopback: everything arrives, in order, over udp and tcp, and
+ * across the collector going away and coming back
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unit.h"
+#include "telem_pub.h"
+#include "collector.h"
+
+#define MASK                (STREAM_CHANNEL_BIT(STREAM_VRMS) | STREAM_CHANNEL_BIT(STREAM_IRMSA) \
+                             | STREAM_CHANNEL_BIT(STREAM_AWATT) | STREAM_CHANNEL_BIT(STREAM_ALS) \
+                             | STREAM_CHANNEL_BIT(STREAM_TEMP))
+#define QUEUE_SMALL         (1024)
+#define QUEUE_BIG           (16 * 1024)
+#define DRAIN_POLLS         (500)
+
+static char m_dir[] = "/tmp/telem_pub.XXXXXX";
+static char m_spill_path[64];
+static uint8_t m_queue[QUEUE_BIG];
+static telem_pub_t m_pub;
+static collector_t m_collector;
+static uint32_t m_now = 0;
+
+static telem_pub_config_t config(uint16_t port, bool tcp, uint32_t batch_ms, uint32_t spill_max)
+{
+    telem_pub_config_t cfg = {
+        .host = "127.0.0.1",
+        .port = port,
+        .tcp = tcp,
+        .mask = MASK,
+        .batch_ms = batch_ms,
+        .spill_path = (spill_max > 0 ? m_spill_path : NULL),
+        .spill_max = spill_max,
+    };
+    return cfg;
+}
+
+// Samples 'from' up to 'to', polling after each, as the telemetry task does:
+static void publish(telem_pub_t *pub, collector_t *c, uint32_t from, uint32_t to)
+{
+    telem_sample_t sample;
+
+    for (uint32_t i = from; i < to; i++) {
+        collector_sample(i, &sample);
+        m_now = sample.msec;
+        telem_pub_add(pub, &sample, m_now);
+        telem_pub_poll(pub, m_now);
+        if (c != NULL) {
+            collector_drain(c);
+        }
+    }
+}
+
+static bool pub_idle(const telem_pub_t *pub)
+{
+    return (pub->batch.count == 0 && pub->queue.frames == 0 && pub->out_len == 0
+            && (pub->cfg.spill_path == NULL || telem_spill_pending(&pub->spill) == 0));
+}
+
+// Lets the clock run on with no new samples until everything's at the collector:
+static void drain(telem_pub_t *pub, collector_t *c)
+{
+    for (uint32_t i = 0; i < DRAIN_POLLS && !(pub_idle(pub) && c->frames == pub->stats.sent); i++) {
+        m_now += 1000;
+        telem_pub_poll(pub, m_now);
+        usleep(1000);
+        collector_drain(c);
+    }
+}
+
+// A port nothing's listening on, so tcp connections are refused:
+static uint16_t dead_port(void)
+{
+    collector_t c;
+
+    collector_open(&c, true, 0);
+    collector_close(&c);
+    return c.port;
+}
+
+static void check_complete(const collector_t *c, const telem_pub_t *pub, uint32_t samples)
+{
+    CHECK_EQ(c->bad, 0);
+    CHECK_EQ(c->out_of_order, 0);
+    CHECK_EQ(c->gaps, 0);
+    CHECK_EQ(c->frames, pub->stats.frames);
+    CHECK_EQ(c->samples, samples);
+    CHECK_EQ(c->next_sample, samples);
+    CHECK_EQ(c->bytes, pub->stats.frame_bytes);
+    CHECK_EQ(pub->stats.dropped, 0);
+}
+
+static void report(const char *what, const telem_pub_t *pub)
+{
+    double secs = (m_now - pub->stats.started_ms) / 1000.0;
+
+    printf("    %s: %u samples in %u frames, %.2f bytes/sample, %.2f frames/s\n", what,
+           pub->stats.samples, pub->stats.frames, (double) pub->stats.frame_bytes / pub->stats.samples,
+           pub->stats.frames / secs);
+}
+
+static void test_udp(void)
+{
+    telem_pub_config_t cfg;
+
+    CHECK(collector_open(&m_collector, false, 0));
+    cfg = config(m_collector.port, false, 1000, 0);
+    CHECK(telem_pub_init(&m_pub, &cfg, m_queue, QUEUE_BIG, 0));
+
+    // 10Hz with a second's batching, so about 10 samples a frame:
+    publish(&m_pub, &m_collector, 0, 3000);
+    drain(&m_pub, &m_collector);
+
+    check_complete(&m_collector, &m_pub, 3000);
+    CHECK_EQ(m_pub.stats.errors, 0);
+    CHECK(m_pub.stats.frames >= 3000 / 11);
+    report("udp", &m_pub);
+
+    telem_pub_close(&m_pub);
+    collector_close(&m_collector);
+}
+
+static void test_tcp(void)
+{
+    telem_pub_config_t cfg;
+
+    CHECK(collector_open(&m_collector, true, 0));
+    cfg = config(m_collector.port, true, 10000, 0);
+    CHECK(telem_pub_init(&m_pub, &cfg, m_queue, QUEUE_BIG, 0));
+
+    // Batches fill before they time out, so frames are TELEM_BATCH_MAX samples:
+    publish(&m_pub, &m_collector, 0, 3200);
+    drain(&m_pub, &m_collector);
+
+    check_complete(&m_collector, &m_pub, 3200);
+    CHECK_EQ(m_pub.stats.frames, 3200 / TELEM_BATCH_MAX);
+    CHECK_EQ(m_pub.stats.connects, 1);
+    report("tcp", &m_pub);
+
+    telem_pub_close(&m_pub);
+    collector_close(&m_collector);
+}
+
+static void test_offline_spill(void)
+{
+    telem_pub_config_t cfg;
+    uint16_t port = dead_port();
+
+    cfg = config(port, true, 1000, 1024 * 1024);
+    CHECK(telem_pub_init(&m_pub, &cfg, m_queue, QUEUE_SMALL, 0));
+
+    // Nobody there: the ram queue fills and the oldest frames go to the file:
+    publish(&m_pub, NULL, 0, 2000);
+    CHECK_EQ(m_pub.stats.connects, 0);
+    CHECK(m_pub.stats.errors > 0);
+    CHECK(m_pub.stats.spilled > 0);
+    CHECK_EQ(m_pub.stats.dropped, 0);
+    CHECK(telem_queue_used(&m_pub.queue) > QUEUE_SMALL / 2);
+    CHECK(access(m_spill_path, F_OK) == 0);
+
+    // The collector comes back; the file goes out first, then the queue:
+    CHECK(collector_open(&m_collector, true, port));
+    drain(&m_pub, &m_collector);
+
+    check_complete(&m_collector, &m_pub, 2000);
+    CHECK_EQ(m_pub.stats.unspilled, m_pub.stats.spilled);
+    CHECK(access(m_spill_path, F_OK) != 0);
+
+    telem_pub_close(&m_pub);
+    collector_close(&m_collector);
+}
+
+static void test_spill_full(void)
+{
+    telem_pub_config_t cfg;
+    uint16_t port = dead_port();
+
+    cfg = config(port, true, 1000, 2048);
+    CHECK(telem_pub_init(&m_pub, &cfg, m_queue, QUEUE_SMALL, 0));
+
+    publish(&m_pub, NULL, 0, 2000);
+    CHECK(m_pub.stats.dropped > 0);
+    CHECK(m_pub.spill.size <= 2048);
+
+    /*
+     * What's kept is the oldest frames (in the file) and the newest
+     * (in the queue); the ones that fell between are one gap:
+     */
+    CHECK(collector_open(&m_collector, true, port));
+    drain(&m_pub, &m_collector);
+
+    CHECK_EQ(m_collector.bad, 0);
+    CHECK_EQ(m_collector.out_of_order, 0);
+    CHECK_EQ(m_collector.gaps, 1);
+    CHECK_EQ(m_collector.missing, m_pub.stats.dropped);
+    CHECK_EQ(m_collector.frames + m_pub.stats.dropped, m_pub.stats.frames);
+    CHECK_EQ(m_collector.next_sample, 2000);
+
+    telem_pub_close(&m_pub);
+    collector_close(&m_collector);
+}
+
+static void test_close_and_restart(void)
+{
+    telem_pub_config_t cfg;
+    telem_pub_t before;
+
+    // Offline, then shut down (as for a reset): everything goes to the file...
+    cfg = config(dead_port(), true, 1000, 1024 * 1024);
+    CHECK(telem_pub_init(&m_pub, &cfg, m_queue, QUEUE_BIG, 0));
+    publish(&m_pub, NULL, 0, 555);
+    telem_pub_close(&m_pub);
+    CHECK_EQ(m_pub.stats.dropped, 0);
+    CHECK(telem_spill_pending(&m_pub.spill) > 0);
+    before = m_pub;
+
+    // ... and comes out ahead of what the next publisher sends:
+    CHECK(collector_open(&m_collector, false, 0));
+    cfg = config(m_collector.port, false, 1000, 1024 * 1024);
+    CHECK(telem_pub_init(&m_pub, &cfg, m_queue, QUEUE_BIG, m_now));
+    CHECK_EQ(telem_spill_pending(&m_pub.spill), before.spill.size);
+    publish(&m_pub, &m_collector, 555, 1000);
+    drain(&m_pub, &m_collector);
+
+    CHECK_EQ(m_collector.bad, 0);
+    CHECK_EQ(m_collector.frames, before.stats.frames + m_pub.stats.frames);
+    CHECK_EQ(m_collector.samples, 1000);
+    CHECK_EQ(m_collector.next_sample, 1000);
+
+    // The new publisher's seq starts over, which is the one step back:
+    CHECK_EQ(m_collector.out_of_order, 1);
+
+    telem_pub_close(&m_pub);
+    collector_close(&m_collector);
+}
+
+static void test_queue_wrap(void)
+{
+    telem_queue_t queue;
+    uint8_t buf[100];
+    uint8_t frame[64];
+    uint8_t out[64];
+    uint32_t next_in = 0;
+    uint32_t next_out = 0;
+    uint32_t wrong = 0;
+
+    telem_queue_init(&queue, buf, sizeof(buf));
+    CHECK_EQ(telem_queue_pop(&queue, out, sizeof(out)), 0);
+
+    // Frames of 1 to 40 bytes, each filled with its own number, pushed until full then popped a few at a time:
+    for (uint32_t round = 0; round < 1000; round++) {
+        while (true) {
+            uint32_t len = 1 + next_in % 40;
+
+            memset(frame, (uint8_t) next_in, len);
+            if (!telem_queue_push(&queue, frame, len)) {
+                wrong += (2 + len <= sizeof(buf) - telem_queue_used(&queue));
+                break;
+            }
+            next_in++;
+        }
+        for (uint32_t i = 0; i < 1 + round % 3 && queue.frames > 0; i++) {
+            uint32_t len = telem_queue_pop(&queue, out, sizeof(out));
+
+            wrong += (len != 1 + next_out % 40);
+            for (uint32_t j = 0; j < len; j++) {
+                wrong += (out[j] != (uint8_t) next_out);
+            }
+            next_out++;
+        }
+    }
+    CHECK_EQ(wrong, 0);
+    CHECK_EQ(queue.frames, next_in - next_out);
+    CHECK(next_in > 1000);
+
+    CHECK(!telem_queue_push(&queue, frame, 0));
+    CHECK(!telem_queue_push(&queue, frame, sizeof(buf) - 1));
+}
+
+static void test_spill_truncated(void)
+{
+    telem_spill_t spill;
+    uint8_t frame[20];
+    uint8_t out[20];
+
+    remove(m_spill_path);
+    telem_spill_init(&spill, m_spill_path, 1024);
+    for (uint8_t i = 0; i < 5; i++) {
+        memset(frame, i, sizeof(frame));
+        CHECK(telem_spill_push(&spill, frame, sizeof(frame)));
+    }
+    CHECK(!telem_spill_push(&spill, frame, 1024));
+
+    // A reset in the middle of the last write:
+    CHECK_EQ(truncate(m_spill_path, spill.size - 7), 0);
+
+    telem_spill_init(&spill, m_spill_path, 1024);
+    CHECK_EQ(telem_spill_pending(&spill), 5 * (2 + sizeof(frame)) - 7);
+    for (uint8_t i = 0; i < 4; i++) {
+        CHECK_EQ(telem_spill_pop(&spill, out, sizeof(out)), sizeof(frame));
+        CHECK_EQ(out[0], i);
+        CHECK_EQ(out[sizeof(out) - 1], i);
+    }
+    CHECK_EQ(telem_spill_pop(&spill, out, sizeof(out)), 0);
+    CHECK_EQ(spill.errors, 1);
+    CHECK_EQ(telem_spill_pending(&spill), 0);
+    CHECK(access(m_spill_path, F_OK) != 0);
+}
+
+int main(void)
+{
+    if (mkdtemp(m_dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(m_spill_path, sizeof(m_spill_path), "%s/spill", m_dir);
+
+    RUN(test_udp);
+    RUN(test_tcp);
+    RUN(test_offline_spill);
+    RUN(test_spill_full);
+    RUN(test_close_and_restart);
+    RUN(test_queue_wrap);
+    RUN(test_spill_truncated);
+
+    remove(m_spill_path);
+    rmdir(m_dir);
+    return unit_done();
+}
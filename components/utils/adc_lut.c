@@ -0,0 +1,44 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * adc_lut.c - raw 12-bit adc code to millivolt lookup table
+ */
+
+#include <stdint.h>
+
+#include "adc_lut.h"
+
+void adc_lut_build(adc_lut_t *lut, adc_lut_ref_fn_t ref, void *arg)
+{
+    for (uint32_t i = 0; i < ADC_LUT_POINTS - 1; i++) {
+        lut->mv[i] = (uint16_t) ref(i << ADC_LUT_SHIFT, arg);
+    }
+
+    /*
+     * There's no code ADC_LUT_CODES to ask about, so carry the last
+     * step (ADC_LUT_STEP - 1 codes wide) on to where it would be.
+     */
+    uint32_t top = ref(ADC_LUT_CODES - 1, arg);
+    uint32_t base = lut->mv[ADC_LUT_POINTS - 2];
+    uint32_t rise = (top > base ? top - base : 0);
+
+    lut->mv[ADC_LUT_POINTS - 1] = (uint16_t)(base + (rise * ADC_LUT_STEP + (ADC_LUT_STEP - 1) / 2) / (ADC_LUT_STEP - 1));
+}
+
+uint32_t adc_lut_check(const adc_lut_t *lut, adc_lut_ref_fn_t ref, void *arg, uint32_t *worst_raw)
+{
+    uint32_t worst = 0;
+
+    *worst_raw = 0;
+    for (uint32_t raw = 0; raw < ADC_LUT_CODES; raw++) {
+        uint32_t want = ref(raw, arg);
+        uint32_t got = adc_lut_mv(lut, raw);
+        uint32_t error = (got > want ? got - want : want - got);
+
+        if (error > worst) {
+            worst = error;
+            *worst_raw = raw;
+        }
+    }
+
+    return worst;
+}
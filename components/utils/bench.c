@@ -0,0 +1,92 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * bench.c - times a function over many runs and reports exact percentiles
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+#define BENCH_CALIBRATION_RUNS      (64)
+
+static void bench_nothing(void *arg)
+{
+    (void) arg;
+}
+
+// Never inlined or specialized, so the calibration's empty call costs what a real one does:
+static uint32_t __attribute__((noinline, noclone)) bench_time(bench_t *bench, bench_fn_t fn, void *arg)
+{
+    uint32_t start = bench->clock();
+
+    fn(arg);
+    return bench->clock() - start;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest rank, so it's always one of the runs:
+static uint32_t bench_percentile(const uint32_t *sorted, uint32_t count, uint32_t percent)
+{
+    uint32_t rank = (count * percent + 99) / 100;
+
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void bench_init(bench_t *bench, bench_clock_fn_t clock, uint32_t *samples, uint32_t samples_max)
+{
+    bench->clock = clock;
+    bench->samples = samples;
+    bench->samples_max = samples_max;
+    bench->overhead = UINT32_MAX;
+
+    // The quickest of a few, since anything that gets in the way only makes it slower:
+    for (uint32_t i = 0; i < BENCH_CALIBRATION_RUNS; i++) {
+        uint32_t cycles = bench_time(bench, bench_nothing, NULL);
+
+        if (cycles < bench->overhead) {
+            bench->overhead = cycles;
+        }
+    }
+}
+
+bool bench_run(bench_t *bench, bench_fn_t fn, void *arg, uint32_t warmup, uint32_t reps, bench_result_t *result)
+{
+    if (reps == 0 || reps > bench->samples_max) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < warmup; i++) {
+        fn(arg);
+    }
+
+    uint64_t total = 0;
+
+    for (uint32_t i = 0; i < reps; i++) {
+        uint32_t cycles = bench_time(bench, fn, arg);
+
+        cycles = (cycles > bench->overhead ? cycles - bench->overhead : 0);
+        bench->samples[i] = cycles;
+        total += cycles;
+    }
+
+    qsort(bench->samples, reps, sizeof(bench->samples[0]), bench_compare);
+
+    result->reps = reps;
+    result->min = bench->samples[0];
+    result->p50 = bench_percentile(bench->samples, reps, 50);
+    result->p90 = bench_percentile(bench->samples, reps, 90);
+    result->p99 = bench_percentile(bench->samples, reps, 99);
+    result->max = bench->samples[reps - 1];
+    result->mean = (uint32_t)((total + reps / 2) / reps);
+
+    return true;
+}
@@ -0,0 +1,112 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * boot_graph.c - bookkeeping for running init stages in dependency order
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "boot_graph.h"
+
+bool boot_graph_init(boot_graph_t *graph, const boot_stage_t *stages, uint32_t count, uint32_t ready_mask)
+{
+    memset(graph, 0, sizeof(*graph));
+    graph->stages = stages;
+    graph->count = count;
+    graph->ready_mask = ready_mask;
+
+    if (count == 0 || count > BOOT_GRAPH_MAX_STAGES || (ready_mask >> count) != 0) {
+        return false;
+    }
+
+    // Peel off stages whose dependencies are met until nothing changes; anything left is in a cycle:
+    uint32_t all = BOOT_STAGE_BIT(count) - 1;
+    uint32_t met = 0;
+    bool progress = true;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (stages[i].deps & ~all) {
+            return false;
+        }
+    }
+
+    while (progress) {
+        progress = false;
+        for (uint32_t i = 0; i < count; i++) {
+            if (!(met & BOOT_STAGE_BIT(i)) && (stages[i].deps & ~met) == 0) {
+                met |= BOOT_STAGE_BIT(i);
+                progress = true;
+            }
+        }
+    }
+
+    return (met == all);
+}
+
+static bool worker_may_run(const boot_graph_t *graph, uint32_t stage, int worker)
+{
+    uint32_t workers = graph->stages[stage].workers & graph->workers;
+
+    return (workers == 0 || (workers & BOOT_WORKER_BIT(worker)));
+}
+
+int boot_graph_next(boot_graph_t *graph, int64_t now_us, int worker)
+{
+    for (uint32_t i = 0; i < graph->count; i++) {
+        if (!(graph->started & BOOT_STAGE_BIT(i))
+            && (graph->stages[i].deps & ~graph->done) == 0
+            && worker_may_run(graph, i, worker)) {
+            graph->started |= BOOT_STAGE_BIT(i);
+            graph->times[i].start_us = now_us;
+            graph->times[i].worker = worker;
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool boot_graph_finish(boot_graph_t *graph, int stage, int64_t now_us)
+{
+    bool was_ready = boot_graph_ready(graph);
+
+    graph->times[stage].end_us = now_us;
+    graph->done |= BOOT_STAGE_BIT(stage);
+
+    if (!was_ready && boot_graph_ready(graph)) {
+        graph->ready_us = now_us;
+        return true;
+    }
+    return false;
+}
+
+static int last_to_finish(const boot_graph_t *graph, uint32_t mask)
+{
+    int last = -1;
+
+    for (uint32_t i = 0; i < graph->count; i++) {
+        if ((mask & graph->done & BOOT_STAGE_BIT(i))
+            &&
+            (last < 0 || graph->times[i].end_us > graph->times[last].end_us)) {
+            last = i;
+        }
+    }
+    return last;
+}
+
+uint32_t boot_graph_critical_path(const boot_graph_t *graph, uint32_t mask, int *path)
+{
+    int reversed[BOOT_GRAPH_MAX_STAGES];
+    uint32_t len = 0;
+    int stage = last_to_finish(graph, mask);
+
+    while (stage >= 0 && len < BOOT_GRAPH_MAX_STAGES) {
+        reversed[len++] = stage;
+        stage = last_to_finish(graph, graph->stages[stage].deps);
+    }
+
+    for (uint32_t i = 0; i < len; i++) {
+        path[i] = reversed[len - 1 - i];
+    }
+    return len;
+}
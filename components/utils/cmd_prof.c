@@ -0,0 +1,65 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * cmd_prof.c - per-command latency and heap statistics for the console
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cmd_prof.h"
+
+static bool is_space(char c)
+{
+    return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+}
+
+void cmd_prof_reset(cmd_prof_t *prof)
+{
+    memset(prof, 0, sizeof(*prof));
+}
+
+bool cmd_prof_name(const char *line, char *name)
+{
+    uint32_t len = 0;
+
+    while (is_space(*line)) {
+        line++;
+    }
+    while (*line && !is_space(*line) && len < CMD_PROF_NAME_MAX - 1) {
+        name[len++] = *line++;
+    }
+    name[len] = '\0';
+
+    return (len > 0);
+}
+
+void cmd_prof_record(cmd_prof_t *prof, const char *line, uint32_t usec, int32_t heap_delta)
+{
+    char name[CMD_PROF_NAME_MAX];
+    cmd_prof_entry_t *entry = NULL;
+
+    if (!cmd_prof_name(line, name)) {
+        return;
+    }
+
+    // A few dozen commands at most, so a linear search is plenty:
+    for (uint32_t i = 0; i < prof->used && entry == NULL; i++) {
+        if (strcmp(prof->entries[i].name, name) == 0) {
+            entry = &prof->entries[i];
+        }
+    }
+
+    if (entry == NULL) {
+        if (prof->used == CMD_PROF_MAX_COMMANDS) {
+            prof->overflow++;
+            return;
+        }
+        entry = &prof->entries[prof->used++];
+        strcpy(entry->name, name);
+    }
+
+    latency_hist_record(&entry->usec, usec);
+    entry->heap_last = heap_delta;
+    entry->heap_total += heap_delta;
+}
@@ -0,0 +1,470 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * energy_log.c - append-only energy log in flash-sector-sized,
+ * delta-encoded blocks
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "rpc_frame.h"
+#include "varint.h"
+#include "energy_log.h"
+
+#define ROW_MAX                     (VARINT_MAX * ENERGY_LOG_COLUMNS)
+
+static void put_le(uint8_t *out, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+static uint32_t get_le(const uint8_t *in, int bytes)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint32_t) in[i] << (8 * i);
+    }
+    return value;
+}
+
+static void record_to_columns(const energy_log_record_t *record, int32_t *cols)
+{
+    cols[ENERGY_LOG_TIME] = (int32_t) record->time;
+    cols[ENERGY_LOG_AENERGY] = record->aenergy;
+    cols[ENERGY_LOG_BENERGY] = record->benergy;
+    cols[ENERGY_LOG_RENERGY] = record->renergy;
+    cols[ENERGY_LOG_VPEAK] = record->vpeak;
+    cols[ENERGY_LOG_TEMPERATURE] = record->temperature;
+}
+
+static void columns_to_record(const int32_t *cols, energy_log_record_t *record)
+{
+    record->time = (uint32_t) cols[ENERGY_LOG_TIME];
+    record->aenergy = cols[ENERGY_LOG_AENERGY];
+    record->benergy = cols[ENERGY_LOG_BENERGY];
+    record->renergy = cols[ENERGY_LOG_RENERGY];
+    record->vpeak = cols[ENERGY_LOG_VPEAK];
+    record->temperature = cols[ENERGY_LOG_TEMPERATURE];
+}
+
+static void open_block(energy_log_t *log, uint32_t seq)
+{
+    log->seq = seq;
+    log->count = 0;
+    log->t_min = UINT32_MAX;
+    log->t_max = 0;
+    memset(log->last, 0, sizeof(log->last));
+    log->last_step = 0;
+    log->rows_len = 0;
+    memset(log->col_len, 0, sizeof(log->col_len));
+    log->dirty = false;
+}
+
+// Adds a record to the open block; false if it won't fit:
+static bool add_row(energy_log_t *log, const int32_t *cols)
+{
+    uint8_t row[ROW_MAX];
+    uint32_t lens[ENERGY_LOG_COLUMNS];
+    uint32_t len = 0;
+    uint32_t step = (uint32_t) cols[ENERGY_LOG_TIME] - (uint32_t) log->last[ENERGY_LOG_TIME];
+
+    // The first time goes in whole (as a difference from zero), then a difference of differences each:
+    lens[ENERGY_LOG_TIME] = varint_put(row, varint_zigzag((int32_t)(step - log->last_step)));
+    len += lens[ENERGY_LOG_TIME];
+    for (int c = ENERGY_LOG_TIME + 1; c < ENERGY_LOG_COLUMNS; c++) {
+        lens[c] = varint_put(&row[len], varint_zigzag((int32_t)((uint32_t) cols[c] - (uint32_t) log->last[c])));
+        len += lens[c];
+    }
+
+    if (ENERGY_LOG_HEADER_LEN + log->rows_len + len > ENERGY_LOG_BLOCK_SIZE) {
+        return false;
+    }
+
+    memcpy(&log->rows[log->rows_len], row, len);
+    log->rows_len += len;
+    for (int c = 0; c < ENERGY_LOG_COLUMNS; c++) {
+        log->col_len[c] += lens[c];
+        log->last[c] = cols[c];
+    }
+    log->last_step = (log->count == 0 ? 0 : step);
+    log->count++;
+
+    uint32_t t = (uint32_t) cols[ENERGY_LOG_TIME];
+
+    log->t_min = (t < log->t_min ? t : log->t_min);
+    log->t_max = (t > log->t_max ? t : log->t_max);
+    return true;
+}
+
+// Turns the open block's rows into columns in log->block:
+static void build_block(energy_log_t *log, uint8_t flags)
+{
+    uint8_t *b = log->block;
+    uint32_t off[ENERGY_LOG_COLUMNS];
+    uint32_t pos = 0;
+
+    memset(b, 0xff, ENERGY_LOG_BLOCK_SIZE);
+
+    off[0] = ENERGY_LOG_HEADER_LEN;
+    for (int c = 1; c < ENERGY_LOG_COLUMNS; c++) {
+        off[c] = off[c - 1] + log->col_len[c - 1];
+    }
+
+    // The rows were encoded here, so they're well formed:
+    for (uint32_t r = 0; r < log->count; r++) {
+        for (int c = 0; c < ENERGY_LOG_COLUMNS; c++) {
+            uint32_t value;
+            uint32_t n = varint_get(&log->rows[pos], log->rows_len - pos, &value);
+
+            memcpy(&b[off[c]], &log->rows[pos], n);
+            off[c] += n;
+            pos += n;
+        }
+    }
+
+    b[0] = ENERGY_LOG_MAGIC0;
+    b[1] = ENERGY_LOG_MAGIC1;
+    b[2] = ENERGY_LOG_VERSION;
+    b[3] = flags;
+    put_le(&b[4], log->seq, 4);
+    put_le(&b[8], log->count, 2);
+    put_le(&b[10], log->rows_len, 2);
+    put_le(&b[12], log->t_min, 4);
+    put_le(&b[16], log->t_max, 4);
+    put_le(&b[20], 0, 2);
+
+    uint16_t crc = rpc_crc16(RPC_CRC16_INIT, b, ENERGY_LOG_HEADER_LEN - 2);
+
+    crc = rpc_crc16(crc, &b[ENERGY_LOG_HEADER_LEN], log->rows_len);
+    put_le(&b[22], crc, 2);
+}
+
+static bool write_block(energy_log_t *log, uint8_t flags)
+{
+    uint32_t slot = log->seq % log->slots;
+    FILE *f = fopen(log->path, "r+b");
+
+    if (f == NULL) {
+        f = fopen(log->path, "w+b");
+    }
+    if (f == NULL) {
+        log->stats.write_errors++;
+        return false;
+    }
+
+    build_block(log, flags);
+
+    // No stdio buffering, so the whole sector goes down in one write:
+    setvbuf(f, NULL, _IONBF, 0);
+
+    bool ok = (fseek(f, slot * ENERGY_LOG_BLOCK_SIZE, SEEK_SET) == 0
+               &&
+               fwrite(log->block, ENERGY_LOG_BLOCK_SIZE, 1, f) == 1);
+
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        log->stats.write_errors++;
+        return false;
+    }
+
+    energy_log_index_t *entry = &log->index[slot];
+
+    entry->seq = log->seq;
+    entry->t_min = log->t_min;
+    entry->t_max = log->t_max;
+    entry->count = log->count;
+    entry->flags = flags;
+
+    log->stats.writes++;
+    log->dirty = false;
+    return true;
+}
+
+static bool parse_header(const uint8_t *b, energy_log_index_t *entry)
+{
+    if (b[0] != ENERGY_LOG_MAGIC0 || b[1] != ENERGY_LOG_MAGIC1 || b[2] != ENERGY_LOG_VERSION) {
+        return false;
+    }
+
+    uint32_t count = get_le(&b[8], 2);
+    uint32_t body_len = get_le(&b[10], 2);
+
+    if (count == 0 || body_len > ENERGY_LOG_BLOCK_SIZE - ENERGY_LOG_HEADER_LEN) {
+        return false;
+    }
+
+    entry->seq = get_le(&b[4], 4);
+    entry->count = count;
+    entry->t_min = get_le(&b[12], 4);
+    entry->t_max = get_le(&b[16], 4);
+    entry->flags = b[3];
+    return true;
+}
+
+static bool block_crc_ok(const uint8_t *b)
+{
+    uint32_t body_len = get_le(&b[10], 2);
+    uint16_t crc = rpc_crc16(RPC_CRC16_INIT, b, ENERGY_LOG_HEADER_LEN - 2);
+
+    crc = rpc_crc16(crc, &b[ENERGY_LOG_HEADER_LEN], body_len);
+    return (crc == get_le(&b[22], 2));
+}
+
+/*
+ * Decodes 'count' records from 'body', by columns or (for the open
+ * block) by rows, and hands the ones from 'from' to 'to' to 'fn'.
+ * Returns how many it handed over; *stop is set if 'fn' asked to
+ * stop, and false comes back in *ok if the body is damaged.
+ */
+static uint32_t decode_records(const uint8_t *body, uint32_t len, uint32_t count, bool by_rows,
+                               uint32_t from, uint32_t to, energy_log_fn_t fn, void *arg, bool *stop, bool *ok)
+{
+    uint32_t offs[ENERGY_LOG_COLUMNS];
+    uint32_t shared = 0;
+    uint32_t *pos[ENERGY_LOG_COLUMNS];
+    int32_t cols[ENERGY_LOG_COLUMNS] = {0};
+    uint32_t step = 0;
+    uint32_t matched = 0;
+    uint32_t value;
+
+    // Rows read every column from one place in turn; columns each start where the one before ends:
+    offs[0] = 0;
+    for (int c = 0; c < ENERGY_LOG_COLUMNS; c++) {
+        pos[c] = (by_rows ? &shared : &offs[c]);
+        if (by_rows || c == ENERGY_LOG_COLUMNS - 1) {
+            continue;
+        }
+        offs[c + 1] = offs[c];
+        for (uint32_t r = 0; r < count; r++) {
+            uint32_t n = varint_get(&body[offs[c + 1]], len - offs[c + 1], &value);
+
+            if (n == 0) {
+                *ok = false;
+                return 0;
+            }
+            offs[c + 1] += n;
+        }
+    }
+
+    for (uint32_t r = 0; r < count; r++) {
+        for (int c = 0; c < ENERGY_LOG_COLUMNS; c++) {
+            uint32_t n = (*pos[c] < len ? varint_get(&body[*pos[c]], len - *pos[c], &value) : 0);
+
+            if (n == 0) {
+                *ok = false;
+                return matched;
+            }
+            *pos[c] += n;
+
+            if (c == ENERGY_LOG_TIME) {
+                uint32_t this_step = step + (uint32_t) varint_unzigzag(value);
+
+                cols[c] = (int32_t)((uint32_t) cols[c] + this_step);
+                step = (r == 0 ? 0 : this_step);
+            } else {
+                cols[c] = (int32_t)((uint32_t) cols[c] + (uint32_t) varint_unzigzag(value));
+            }
+        }
+
+        uint32_t t = (uint32_t) cols[ENERGY_LOG_TIME];
+
+        if (t < from || t > to) {
+            continue;
+        }
+
+        energy_log_record_t record;
+
+        columns_to_record(cols, &record);
+        matched++;
+        if (!fn(&record, arg)) {
+            *stop = true;
+            return matched;
+        }
+    }
+    return matched;
+}
+
+static bool restore_record(const energy_log_record_t *record, void *arg)
+{
+    energy_log_t *log = arg;
+    int32_t cols[ENERGY_LOG_COLUMNS];
+
+    record_to_columns(record, cols);
+    return add_row(log, cols);
+}
+
+bool energy_log_init(energy_log_t *log, const char *path, energy_log_index_t *index, uint32_t slots)
+{
+    if (slots < 2) {
+        return false;
+    }
+
+    memset(log, 0, sizeof(*log));
+    memset(index, 0, slots * sizeof(*index));
+    log->path = path;
+    log->index = index;
+    log->slots = slots;
+
+    FILE *f = fopen(path, "rb");
+    int newest = -1;
+
+    if (f == NULL) {
+        open_block(log, 0);
+        return true;
+    }
+
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        uint8_t header[ENERGY_LOG_HEADER_LEN];
+
+        if (fseek(f, slot * ENERGY_LOG_BLOCK_SIZE, SEEK_SET) != 0 || fread(header, sizeof(header), 1, f) != 1) {
+            break;
+        }
+        if (!parse_header(header, &index[slot])) {
+            continue;
+        }
+        if (newest < 0 || index[slot].seq > index[newest].seq) {
+            newest = slot;
+        }
+    }
+
+    if (newest < 0) {
+        open_block(log, 0);
+    } else if (index[newest].flags & ENERGY_LOG_SEALED) {
+        open_block(log, index[newest].seq + 1);
+    } else {
+        // A block that was still filling up when we stopped; carry on with it:
+        bool stop = false;
+        bool ok = true;
+
+        open_block(log, index[newest].seq);
+        if (fseek(f, newest * ENERGY_LOG_BLOCK_SIZE, SEEK_SET) == 0
+            &&
+            fread(log->block, ENERGY_LOG_BLOCK_SIZE, 1, f) == 1
+            &&
+            block_crc_ok(log->block)) {
+            decode_records(&log->block[ENERGY_LOG_HEADER_LEN], get_le(&log->block[10], 2), index[newest].count, false,
+                           0, UINT32_MAX, restore_record, log, &stop, &ok);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            log->stats.bad_blocks++;
+        }
+        // Whatever of it is left goes back at the next flush:
+        log->dirty = !ok;
+    }
+
+    fclose(f);
+    return true;
+}
+
+bool energy_log_append(energy_log_t *log, const energy_log_record_t *record)
+{
+    int32_t cols[ENERGY_LOG_COLUMNS];
+    bool ok = true;
+
+    record_to_columns(record, cols);
+    if (!add_row(log, cols)) {
+        ok = write_block(log, ENERGY_LOG_SEALED);
+        open_block(log, log->seq + 1);
+        add_row(log, cols);
+    }
+    log->dirty = true;
+    log->stats.appended++;
+    return ok;
+}
+
+bool energy_log_flush(energy_log_t *log)
+{
+    return (!log->dirty || write_block(log, 0));
+}
+
+uint32_t energy_log_query(energy_log_t *log, uint32_t from, uint32_t to, energy_log_fn_t fn, void *arg)
+{
+    FILE *f = NULL;
+    uint32_t matched = 0;
+    bool stop = false;
+
+    // The open block's slot was the oldest block's, so that one's gone already:
+    uint32_t first = (log->seq >= log->slots ? log->seq - log->slots + 1 : 0);
+
+    for (uint32_t seq = first; seq < log->seq && !stop; seq++) {
+        const energy_log_index_t *entry = &log->index[seq % log->slots];
+
+        if (entry->count == 0 || entry->seq != seq || entry->t_max < from || entry->t_min > to) {
+            continue;
+        }
+
+        if (f == NULL && (f = fopen(log->path, "rb")) == NULL) {
+            break;
+        }
+        if (fseek(f, (seq % log->slots) * ENERGY_LOG_BLOCK_SIZE, SEEK_SET) != 0
+            ||
+            fread(log->block, ENERGY_LOG_BLOCK_SIZE, 1, f) != 1) {
+            log->stats.bad_blocks++;
+            continue;
+        }
+        log->stats.blocks_read++;
+
+        if (!block_crc_ok(log->block)) {
+            log->stats.bad_blocks++;
+            continue;
+        }
+
+        bool ok = true;
+
+        matched += decode_records(&log->block[ENERGY_LOG_HEADER_LEN], get_le(&log->block[10], 2), entry->count,
+                                  false, from, to, fn, arg, &stop, &ok);
+        if (!ok) {
+            log->stats.bad_blocks++;
+        }
+    }
+
+    if (f != NULL) {
+        fclose(f);
+    }
+
+    if (!stop && log->count != 0 && log->t_max >= from && log->t_min <= to) {
+        bool ok = true;
+
+        matched += decode_records(log->rows, log->rows_len, log->count, true, from, to, fn, arg, &stop, &ok);
+    }
+    return matched;
+}
+
+void energy_log_get_summary(const energy_log_t *log, energy_log_summary_t *summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    summary->t_min = UINT32_MAX;
+
+    for (uint32_t slot = 0; slot < log->slots; slot++) {
+        const energy_log_index_t *entry = &log->index[slot];
+
+        // The open block's slot holds it or the block it's about to replace; it's counted from ram below:
+        if (entry->count == 0 || slot == log->seq % log->slots) {
+            continue;
+        }
+        summary->blocks++;
+        summary->records += entry->count;
+        summary->t_min = (entry->t_min < summary->t_min ? entry->t_min : summary->t_min);
+        summary->t_max = (entry->t_max > summary->t_max ? entry->t_max : summary->t_max);
+    }
+
+    if (log->count != 0) {
+        summary->blocks++;
+        summary->records += log->count;
+        summary->t_min = (log->t_min < summary->t_min ? log->t_min : summary->t_min);
+        summary->t_max = (log->t_max > summary->t_max ? log->t_max : summary->t_max);
+    }
+
+    if (summary->records == 0) {
+        summary->t_min = 0;
+    }
+}
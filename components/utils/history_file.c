@@ -0,0 +1,171 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * history_file.c - append-only console history file with crash-safe
+ * compaction
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "history_file.h"
+
+static bool file_exists(const char *path)
+{
+    struct stat st;
+
+    return (stat(path, &st) == 0);
+}
+
+/*
+ * Counts the complete lines in 'path'; '*partial' is set when
+ * the file ends part way through a line.
+ */
+static int count_lines(const char *path, bool *partial)
+{
+    FILE *f = fopen(path, "r");
+    int lines = 0;
+    int last = '\n';
+    int c;
+
+    if (f == NULL) {
+        return -1;
+    }
+
+    while ((c = fgetc(f)) != EOF) {
+        if (c == '\n') {
+            lines++;
+        }
+        last = c;
+    }
+    fclose(f);
+
+    *partial = (last != '\n');
+    return lines;
+}
+
+/*
+ * Copies complete lines number 'skip' onwards from 'from' to 'to',
+ * which is flushed and closed before we return.
+ */
+static int copy_lines(const char *from, const char *to, int skip)
+{
+    char line[HISTORY_FILE_LINE_MAX];
+    FILE *in = fopen(from, "r");
+    int copied = 0;
+    int n = 0;
+
+    if (in == NULL) {
+        return -1;
+    }
+
+    FILE *out = fopen(to, "w");
+
+    if (out == NULL) {
+        fclose(in);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        size_t len = strlen(line);
+
+        if (line[len - 1] != '\n') {
+            // Either the partial last line or one too long for us; neither is worth keeping:
+            while (line[len - 1] != '\n' && fgets(line, sizeof(line), in) != NULL) {
+                len = strlen(line);
+            }
+            continue;
+        }
+
+        if (n++ < skip) {
+            continue;
+        }
+
+        if (fputs(line, out) == EOF) {
+            fclose(in);
+            fclose(out);
+            return -1;
+        }
+        copied++;
+    }
+    fclose(in);
+
+    if (fclose(out) != 0) {
+        return -1;
+    }
+    return copied;
+}
+
+static int replace_with_copy(const char *path, const char *tmp_path, int skip)
+{
+    int copied = copy_lines(path, tmp_path, skip);
+
+    if (copied < 0) {
+        remove(tmp_path);
+        return -1;
+    }
+
+    // Only once the copy is safely closed does the original go:
+    if (remove(path) != 0 || rename(tmp_path, path) != 0) {
+        return -1;
+    }
+    return copied;
+}
+
+int history_file_recover(const char *path, const char *tmp_path)
+{
+    bool partial = false;
+
+    if (file_exists(tmp_path)) {
+        if (file_exists(path)) {
+            remove(tmp_path);
+        } else if (rename(tmp_path, path) != 0) {
+            return -1;
+        }
+    }
+
+    if (!file_exists(path)) {
+        return 0;
+    }
+
+    int lines = count_lines(path, &partial);
+
+    if (lines >= 0 && partial) {
+        lines = replace_with_copy(path, tmp_path, 0);
+    }
+    return lines;
+}
+
+bool history_file_append(const char *path, char *const *lines, uint32_t count)
+{
+    FILE *f = fopen(path, "a");
+    bool ok = true;
+
+    if (f == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count && ok; i++) {
+        ok = (fputs(lines[i], f) != EOF && fputc('\n', f) != EOF);
+    }
+
+    return (fclose(f) == 0 && ok);
+}
+
+int history_file_compact(const char *path, const char *tmp_path, uint32_t keep)
+{
+    bool partial = false;
+    int lines = count_lines(path, &partial);
+
+    if (lines < 0) {
+        return -1;
+    }
+
+    if ((uint32_t)lines <= keep && !partial) {
+        return lines;
+    }
+
+    return replace_with_copy(path, tmp_path, ((uint32_t)lines > keep ? lines - keep : 0));
+}
@@ -0,0 +1,47 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * adc_lut.h - raw 12-bit adc code to millivolt lookup table
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * The table holds the calibrated voltage at every ADC_LUT_STEP'th
+ * code, and a lookup interpolates between the two either side, so
+ * it's a shift, a multiply and an add with no floating point, flash
+ * or locks: fine from an isr, and small enough (514 bytes) to keep
+ * one per channel. The reference it's built from is esp_adc_cal's
+ * conversion on the target: a straight line per channel and
+ * attenuation, except at 11dB from code 2880 up, where it blends into
+ * a table of its own every 64 codes. That only bends on multiples of
+ * ADC_LUT_STEP codes, and the blend barely bends at all, so all this
+ * table adds is a millivolt of rounding (adc_lut_check() says how
+ * much).
+ */
+#define ADC_LUT_CODES           (4096)              // 12-bit
+#define ADC_LUT_SHIFT           (4)
+#define ADC_LUT_STEP            (1 << ADC_LUT_SHIFT)
+#define ADC_LUT_POINTS          ((ADC_LUT_CODES >> ADC_LUT_SHIFT) + 1)
+
+// The reference conversion; only ever called with codes below ADC_LUT_CODES:
+typedef uint32_t (*adc_lut_ref_fn_t)(uint32_t raw, void *arg);
+
+typedef struct {
+    uint16_t mv[ADC_LUT_POINTS];
+} adc_lut_t;
+
+void adc_lut_build(adc_lut_t *lut, adc_lut_ref_fn_t ref, void *arg);
+
+static inline __attribute__((always_inline)) uint32_t adc_lut_mv(const adc_lut_t *lut, uint32_t raw)
+{
+    uint32_t i = (raw & (ADC_LUT_CODES - 1)) >> ADC_LUT_SHIFT;
+    uint32_t frac = raw & (ADC_LUT_STEP - 1);
+    int32_t span = (int32_t) lut->mv[i + 1] - (int32_t) lut->mv[i];
+
+    return lut->mv[i] + (span * (int32_t) frac + ADC_LUT_STEP / 2) / ADC_LUT_STEP;
+}
+
+// The largest difference between the table and 'ref' over every code, and the first code it's at:
+uint32_t adc_lut_check(const adc_lut_t *lut, adc_lut_ref_fn_t ref, void *arg, uint32_t *worst_raw);
@@ -0,0 +1,41 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * bench.h - times a function over many runs and reports exact percentiles
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The clock is whatever free-running 32-bit counter the caller has:
+ * the cpu cycle counter on the target, a nanosecond clock on a host.
+ * Runs are timed one at a time, so a run has to be shorter than one
+ * wrap of it. The cost of reading the clock and calling an empty
+ * function is measured by bench_init() and taken off every run.
+ */
+typedef uint32_t (*bench_clock_fn_t)(void);
+typedef void (*bench_fn_t)(void *arg);
+
+typedef struct {
+    bench_clock_fn_t clock;
+    uint32_t overhead;
+    uint32_t *samples;              // room for up to samples_max runs
+    uint32_t samples_max;
+} bench_t;
+
+typedef struct {
+    uint32_t reps;
+    uint32_t min;
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t max;
+    uint32_t mean;
+} bench_result_t;
+
+void bench_init(bench_t *bench, bench_clock_fn_t clock, uint32_t *samples, uint32_t samples_max);
+
+// 'warmup' untimed runs, then 'reps' timed ones; false if reps is 0 or more than samples_max:
+bool bench_run(bench_t *bench, bench_fn_t fn, void *arg, uint32_t warmup, uint32_t reps, bench_result_t *result);
@@ -0,0 +1,72 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * boot_graph.h - bookkeeping for running init stages in dependency order
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BOOT_GRAPH_MAX_STAGES       (16)
+#define BOOT_STAGE_BIT(i)           (1u << (i))
+#define BOOT_WORKER_BIT(i)          (1u << (i))
+
+typedef struct {
+    const char *name;
+    void (*fn)(void);
+    uint32_t deps;                  // BOOT_STAGE_BITs of the stages that must finish first
+    uint32_t workers;               // BOOT_WORKER_BITs of the workers allowed to run it; 0 for any
+} boot_stage_t;
+
+typedef struct {
+    int64_t start_us;
+    int64_t end_us;
+    int8_t worker;                  // which worker (core) ran it
+} boot_stage_time_t;
+
+/*
+ * The graph does no locking and calls none of the stage functions
+ * itself: workers take turns (under the caller's lock) asking
+ * boot_graph_next() for something to do, run it unlocked, and
+ * report back with boot_graph_finish().
+ *
+ * A stage can be kept to some of the workers, but only if one of
+ * them is taking part: when none is, any worker may run it.
+ */
+typedef struct {
+    const boot_stage_t *stages;
+    uint32_t count;
+    uint32_t ready_mask;            // stages that have to be up before we call ourselves ready
+    uint32_t workers;               // BOOT_WORKER_BITs of the workers taking part (boot_graph_init() says none)
+    uint32_t started;
+    uint32_t done;
+    int64_t ready_us;
+    boot_stage_time_t times[BOOT_GRAPH_MAX_STAGES];
+} boot_graph_t;
+
+// Returns false if a dependency is out of range or there's a cycle:
+bool boot_graph_init(boot_graph_t *graph, const boot_stage_t *stages, uint32_t count, uint32_t ready_mask);
+
+// Claims the first stage (in table order) this worker may run whose dependencies are all done; -1 if there isn't one right now:
+int boot_graph_next(boot_graph_t *graph, int64_t now_us, int worker);
+
+// Returns true if this stage was the last one the ready mask was waiting for:
+bool boot_graph_finish(boot_graph_t *graph, int stage, int64_t now_us);
+
+static inline bool boot_graph_ready(const boot_graph_t *graph)
+{
+    return (graph->done & graph->ready_mask) == graph->ready_mask;
+}
+
+static inline bool boot_graph_all_done(const boot_graph_t *graph)
+{
+    return graph->done == BOOT_STAGE_BIT(graph->count) - 1;
+}
+
+/*
+ * Walks back from the last of 'mask' to finish, each time through
+ * whichever dependency finished last, and fills 'path' (first stage
+ * first); returns its length.
+ */
+uint32_t boot_graph_critical_path(const boot_graph_t *graph, uint32_t mask, int *path);
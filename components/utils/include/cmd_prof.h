@@ -0,0 +1,35 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * cmd_prof.h - per-command latency and heap statistics for the console
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "latency_hist.h"
+
+#define CMD_PROF_MAX_COMMANDS       (32)
+#define CMD_PROF_NAME_MAX           (16)
+
+typedef struct {
+    char name[CMD_PROF_NAME_MAX];
+    latency_hist_t usec;            // count, total, max and percentiles of the run time
+    int32_t heap_last;              // bytes of heap the last run kept (negative: gave back)
+    int64_t heap_total;
+} cmd_prof_entry_t;
+
+typedef struct {
+    cmd_prof_entry_t entries[CMD_PROF_MAX_COMMANDS];
+    uint32_t used;
+    uint32_t overflow;              // runs of commands that didn't fit in the table
+} cmd_prof_t;
+
+void cmd_prof_reset(cmd_prof_t *prof);
+
+// 'line' is the whole command line; only its first word (the command name) is used:
+void cmd_prof_record(cmd_prof_t *prof, const char *line, uint32_t usec, int32_t heap_delta);
+
+// Copies the first word of 'line' into 'name'; returns false if there isn't one:
+bool cmd_prof_name(const char *line, char *name);
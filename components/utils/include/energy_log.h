@@ -0,0 +1,124 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * energy_log.h - append-only energy log in flash-sector-sized,
+ * delta-encoded blocks
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The log file is a ring of 'slots' blocks of ENERGY_LOG_BLOCK_SIZE
+ * bytes, one flash sector each, so every write is one whole sector
+ * for the wear levelling underneath. A block:
+ *
+ *   'E' 'L' | version | flags | seq (4) | count (2) | body len (2) | t_min (4) | t_max (4) | 0 (2) | crc (2) | body
+ *
+ * Multi-byte fields are little-endian, and the crc is rpc_crc16()
+ * over the header before it and then the body. The body is a column
+ * at a time (energy_log_column_t order), each holding 'count' zigzag
+ * varints: the times as differences of differences, everything else
+ * as differences from the record before, the same as the telemetry
+ * frames. At a steady period and load a record takes 6 to 10 bytes,
+ * so a block holds a few hundred of them.
+ *
+ * Records collect in ram (a row at a time, turned into columns when
+ * the block is written) until the block is full; it's then written
+ * with ENERGY_LOG_SEALED set and the next block starts. Until then
+ * energy_log_flush() can rewrite the open block in place, so a reset
+ * loses only what came after the last flush. Once the ring is full
+ * each new block takes the oldest one's slot.
+ *
+ * energy_log_init() reads every block header into 'index', so a
+ * query reads only the blocks whose time range meets its own.
+ */
+#define ENERGY_LOG_BLOCK_SIZE       (4096)
+#define ENERGY_LOG_HEADER_LEN       (24)
+#define ENERGY_LOG_MAGIC0           ('E')
+#define ENERGY_LOG_MAGIC1           ('L')
+#define ENERGY_LOG_VERSION          (1)
+#define ENERGY_LOG_SEALED           (0x01)      // the block is full; nothing more goes in it
+
+typedef enum {
+    ENERGY_LOG_TIME,
+    ENERGY_LOG_AENERGY,
+    ENERGY_LOG_BENERGY,
+    ENERGY_LOG_RENERGY,
+    ENERGY_LOG_VPEAK,
+    ENERGY_LOG_TEMPERATURE,
+
+    ENERGY_LOG_COLUMNS
+} energy_log_column_t;
+
+// One period's worth; the meter values are raw ADE7953 counts, as in adi_energy_t:
+typedef struct {
+    uint32_t time;              // seconds
+    int32_t aenergy;            // AENERGYA over the period
+    int32_t benergy;            // AENERGYB
+    int32_t renergy;            // RENERGYA + RENERGYB
+    int32_t vpeak;              // the voltage peak in the period
+    int32_t temperature;        // 0.25C counts
+} energy_log_record_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t t_min;
+    uint32_t t_max;
+    uint16_t count;             // 0 for a slot with no block in it
+    uint8_t flags;
+} energy_log_index_t;
+
+typedef struct {
+    uint32_t appended;
+    uint32_t writes;            // blocks written, whole or in part
+    uint32_t write_errors;
+    uint32_t blocks_read;       // by queries
+    uint32_t bad_blocks;        // read back with a bad crc
+} energy_log_stats_t;
+
+typedef struct {
+    const char *path;
+    energy_log_index_t *index;
+    uint32_t slots;
+
+    // The open block:
+    uint32_t seq;
+    uint32_t count;
+    uint32_t t_min;
+    uint32_t t_max;
+    int32_t last[ENERGY_LOG_COLUMNS];
+    uint32_t last_step;
+    uint8_t rows[ENERGY_LOG_BLOCK_SIZE];
+    uint32_t rows_len;
+    uint32_t col_len[ENERGY_LOG_COLUMNS];
+    bool dirty;                 // it has records the file doesn't
+
+    uint8_t block[ENERGY_LOG_BLOCK_SIZE];
+    energy_log_stats_t stats;
+} energy_log_t;
+
+typedef struct {
+    uint32_t blocks;            // including the open one
+    uint32_t records;
+    uint32_t t_min;
+    uint32_t t_max;
+} energy_log_summary_t;
+
+// 'index' has room for 'slots' (at least 2) entries; picks up where the file left off:
+bool energy_log_init(energy_log_t *log, const char *path, energy_log_index_t *index, uint32_t slots);
+
+// False if a full block couldn't be written (its records are lost):
+bool energy_log_append(energy_log_t *log, const energy_log_record_t *record);
+
+// Writes the open block if there's anything new in it:
+bool energy_log_flush(energy_log_t *log);
+
+// Return false to stop the query:
+typedef bool (*energy_log_fn_t)(const energy_log_record_t *record, void *arg);
+
+// Calls 'fn' on each record with a time from 'from' to 'to', oldest block first; returns how many:
+uint32_t energy_log_query(energy_log_t *log, uint32_t from, uint32_t to, energy_log_fn_t fn, void *arg);
+
+void energy_log_get_summary(const energy_log_t *log, energy_log_summary_t *summary);
@@ -0,0 +1,33 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * history_file.h - append-only console history file with crash-safe
+ * compaction
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * New lines are only ever appended to 'path'. Once it holds more
+ * than twice the lines we want to keep, history_file_compact()
+ * writes the newest ones to 'tmp_path', removes 'path' and renames
+ * the copy into place (FAT won't rename over an existing file).
+ * history_file_recover() puts things right after a reset at any
+ * point along the way:
+ *
+ *   - 'tmp_path' without 'path': the rename didn't happen; do it now
+ *   - both: the copy may be incomplete; throw it away
+ *   - 'path' ends part way through a line: drop the partial line
+ */
+#define HISTORY_FILE_LINE_MAX       (256)
+
+// Returns the number of lines in 'path' after recovery, or -1 on error:
+int history_file_recover(const char *path, const char *tmp_path);
+
+// Appends 'count' lines (without their newlines) and closes the file; returns false on error:
+bool history_file_append(const char *path, char *const *lines, uint32_t count);
+
+// Rewrites 'path' with only its newest 'keep' lines; returns the line count, or -1 on error:
+int history_file_compact(const char *path, const char *tmp_path, uint32_t keep);
@@ -0,0 +1,32 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * latency_hist.h - fixed-size latency histogram with percentile estimates
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Samples are binned logarithmically: values 0-3 get a bucket each,
+ * and every power of two above that is split into four sub-buckets,
+ * so a percentile estimate is never off by more than 25%. 96 buckets
+ * cover values up to 2^25 (a little over 33 seconds when recording
+ * microseconds); anything bigger lands in the last bucket, but 'max'
+ * is always exact.
+ */
+#define LATENCY_HIST_BUCKETS        (96)
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t buckets[LATENCY_HIST_BUCKETS];
+} latency_hist_t;
+
+void latency_hist_reset(latency_hist_t *hist);
+void latency_hist_record(latency_hist_t *hist, uint32_t value);
+
+// Returns an upper bound on the 'percent' percentile (0-100) of the recorded values:
+uint32_t latency_hist_percentile(const latency_hist_t *hist, uint32_t percent);
@@ -0,0 +1,43 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * log_ring.h - byte ring for buffered console output that drops
+ * (and counts) whole writes rather than blocking the writer
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * 'size' must be a power of two. head and tail run freely and
+ * are only masked on access, so head - tail is always the number
+ * of bytes waiting and the ring can be filled completely.
+ *
+ * The ring does no locking of its own; the caller serializes
+ * log_ring_put() against log_ring_peek()/log_ring_consume().
+ */
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t head;          // next byte to write
+    uint32_t tail;          // next byte to drain
+    uint32_t high_water;    // most bytes ever waiting at once
+    uint32_t written;       // writes accepted
+    uint32_t dropped;       // writes refused because they didn't fit
+    uint32_t dropped_bytes;
+} log_ring_t;
+
+void log_ring_init(log_ring_t *ring, uint8_t *buf, uint32_t size);
+
+// Copies all 'len' bytes in, or none of them if there isn't room:
+bool log_ring_put(log_ring_t *ring, const void *data, uint32_t len);
+
+// Returns how many contiguous bytes can be drained starting at *data:
+uint32_t log_ring_peek(const log_ring_t *ring, const uint8_t **data);
+void log_ring_consume(log_ring_t *ring, uint32_t len);
+
+static inline uint32_t log_ring_used(const log_ring_t *ring)
+{
+    return ring->head - ring->tail;
+}
@@ -0,0 +1,109 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * postmortem.h - state and the last few trace events, kept where a
+ * reset (a panic, the watchdog, a brownout) doesn't clear them
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "trace_ring.h"
+
+/*
+ * The region lives in memory that survives a reset but not a power
+ * cycle, so at boot it holds either what the last run left or
+ * garbage. The header (with its own crc, and the region's size so a
+ * new layout doesn't pass) says which.
+ *
+ * The state is written whole each time, alternately into one of two
+ * copies, each with a sequence number and a crc; a reset part way
+ * through a write spoils only the copy being written, and the other
+ * one still holds the state before it.
+ *
+ * Trace records are too frequent for a crc each. Each one gets a
+ * check byte instead (in trace_record_t.reserved), which catches a
+ * record the reset cut off half written, or one that's garbage.
+ */
+#define POSTMORTEM_MAGIC            (0x504d5254)    // "PMRT"
+#define POSTMORTEM_VERSION          (1)
+#define POSTMORTEM_CORES            (2)
+#define POSTMORTEM_TRACE_SLOTS      (16)            // per core, a power of two
+#define POSTMORTEM_ENERGY_COUNT     (4)
+
+typedef struct {
+    uint32_t seq;                       // the newer of the two valid copies wins
+    uint32_t uptime_ms;                 // when it was written
+    int64_t energy[POSTMORTEM_ENERGY_COUNT];
+    uint32_t relays;                    // a bit per relay, set while it's closed
+    uint16_t reserved;
+    uint16_t crc;                       // over everything before it
+} postmortem_state_t;
+
+typedef struct {
+    volatile uint32_t head;             // records ever written
+    trace_record_t records[POSTMORTEM_TRACE_SLOTS];
+} postmortem_ring_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                      // sizeof(postmortem_t)
+    uint32_t resets;                    // that the region has come through
+    uint16_t reserved;
+    uint16_t crc;                       // over everything before it
+    postmortem_state_t state[2];
+    postmortem_ring_t rings[POSTMORTEM_CORES];
+} postmortem_t;
+
+static inline __attribute__((always_inline)) uint8_t postmortem_record_check(const trace_record_t *record)
+{
+    uint32_t x = POSTMORTEM_MAGIC ^ record->timestamp ^ ((uint32_t) record->id << 8) ^ record->nargs
+                 ^ record->args[0] ^ record->args[1] ^ record->args[2] ^ record->args[3];
+
+    x ^= x >> 16;
+    x ^= x >> 8;
+    return (uint8_t) x;
+}
+
+/*
+ * A few stores and xors, so it's fine anywhere trace_ring_put() is
+ * (it's inlined, so an IRAM caller keeps it in IRAM). One writer per
+ * ring, as with trace_ring_t.
+ */
+static inline __attribute__((always_inline)) void postmortem_ring_put(postmortem_ring_t *ring, uint32_t timestamp,
+                                                                      uint16_t id, uint8_t nargs, uint32_t a0,
+                                                                      uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    uint32_t head = ring->head;
+    trace_record_t *record = &ring->records[head & (POSTMORTEM_TRACE_SLOTS - 1)];
+
+    record->timestamp = timestamp;
+    record->id = id;
+    record->nargs = nargs;
+    record->args[0] = a0;
+    record->args[1] = a1;
+    record->args[2] = a2;
+    record->args[3] = a3;
+    record->reserved = postmortem_record_check(record);
+
+    __asm__ __volatile__ ("" ::: "memory");
+    ring->head = head + 1;
+}
+
+// True if the region came through the reset; otherwise it's been set up afresh:
+bool postmortem_open(postmortem_t *pm);
+
+// False if neither copy is any good:
+bool postmortem_load_state(const postmortem_t *pm, postmortem_state_t *state);
+
+// Fills in state->seq and state->crc, and writes it over the older copy:
+void postmortem_save_state(postmortem_t *pm, postmortem_state_t *state);
+
+/*
+ * Copies the ring's records out, oldest first, and empties it; any
+ * that fail their check are left out and counted in *bad. Meant for
+ * boot, before anything writes the ring again.
+ */
+uint32_t postmortem_ring_take(postmortem_ring_t *ring, trace_record_t *out, uint32_t *bad);
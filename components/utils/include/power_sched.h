@@ -0,0 +1,67 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * power_sched.h - keeps track of the deadlines that light sleep's wake
+ * up time could make late, and when to stop sleeping for them
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * With automatic light sleep the chip sleeps whenever every task is
+ * blocked, until the next timer or wake source. Waking costs up to
+ * 'wake_us' before any code runs, so a timer due at D may run as
+ * late as D + wake_us. A deadline that can stand that (its slack is
+ * at least wake_us) needs nothing more. One that can't has to find
+ * the chip already awake: from D + slack - wake_us on, it mustn't
+ * go back to sleep. A wake beginning at that moment, the latest one
+ * that can be, is over by D + slack.
+ *
+ * The caller arms a source with its next deadline and reports when
+ * it got round to it; power_sched_plan() says whether the chip has
+ * to stay awake now and, if not, when it next has to be. Nothing in
+ * here knows about the ESP32, so the same code runs in a host model.
+ */
+#define POWER_SCHED_SOURCES_MAX     (8)
+#define POWER_SCHED_NEVER           (INT64_MAX)
+
+typedef struct {
+    const char *name;
+    uint32_t slack_us;          // how late a deadline may be met
+} power_sched_source_t;
+
+typedef struct {
+    uint32_t arms;
+    uint32_t met;
+    uint32_t missed;
+    uint32_t kept_awake;        // deadlines the chip stayed awake for
+    uint32_t worst_late_us;
+} power_sched_stats_t;
+
+typedef struct {
+    bool armed;
+    bool awake;                 // we're holding the chip awake for it
+    int64_t deadline;
+    power_sched_stats_t stats;
+} power_sched_entry_t;
+
+typedef struct {
+    const power_sched_source_t *sources;
+    uint32_t count;
+    uint32_t wake_us;
+    power_sched_entry_t entries[POWER_SCHED_SOURCES_MAX];
+} power_sched_t;
+
+void power_sched_init(power_sched_t *sched, const power_sched_source_t *sources, uint32_t count, uint32_t wake_us);
+
+// Arming an armed source moves its deadline:
+void power_sched_arm(power_sched_t *sched, uint32_t source, int64_t deadline);
+void power_sched_disarm(power_sched_t *sched, uint32_t source);
+
+// The source's deadline was seen to at 'now'; false if that was too late:
+bool power_sched_done(power_sched_t *sched, uint32_t source, int64_t now);
+
+// True if the chip has to stay awake now; otherwise *wake_at is when it next has to (or POWER_SCHED_NEVER):
+bool power_sched_plan(power_sched_t *sched, int64_t now, int64_t *wake_at);
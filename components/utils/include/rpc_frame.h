@@ -0,0 +1,66 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * rpc_frame.h - length-prefixed, crc-protected frames for the binary
+ * rpc mode on the console uart
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * A frame on the wire:
+ *
+ *   0x7e | type | seq | len (2 bytes, LE) | payload (len bytes) | crc (2 bytes, LE)
+ *
+ * The crc is CRC-16/CCITT-FALSE over type through the end of the
+ * payload. There's no byte stuffing: a receiver that loses sync
+ * just hunts for the next 0x7e whose header and crc check out, so
+ * stray console text between frames costs nothing but a few
+ * skipped bytes.
+ */
+#define RPC_FRAME_SOF               (0x7e)
+#define RPC_FRAME_HEADER_LEN        (5)
+#define RPC_FRAME_CRC_LEN           (2)
+#define RPC_FRAME_PAYLOAD_MAX       (256)
+#define RPC_FRAME_MAX               (RPC_FRAME_HEADER_LEN + RPC_FRAME_PAYLOAD_MAX + RPC_FRAME_CRC_LEN)
+
+typedef enum {
+    RPC_DECODE_SOF,
+    RPC_DECODE_TYPE,
+    RPC_DECODE_SEQ,
+    RPC_DECODE_LEN_LO,
+    RPC_DECODE_LEN_HI,
+    RPC_DECODE_PAYLOAD,
+    RPC_DECODE_CRC_LO,
+    RPC_DECODE_CRC_HI,
+} rpc_decode_state_t;
+
+typedef struct {
+    rpc_decode_state_t state;
+    uint8_t type;
+    uint8_t seq;
+    uint16_t len;
+    uint16_t got;
+    uint16_t crc;
+    uint16_t rx_crc;
+    uint8_t payload[RPC_FRAME_PAYLOAD_MAX];
+
+    uint32_t frames;            // good frames decoded
+    uint32_t crc_errors;
+    uint32_t oversize;          // headers claiming more than RPC_FRAME_PAYLOAD_MAX
+    uint32_t skipped;           // bytes seen outside any frame
+} rpc_decoder_t;
+
+#define RPC_CRC16_INIT              (0xffff)
+
+uint16_t rpc_crc16(uint16_t crc, const uint8_t *data, uint32_t len);
+
+// Builds a frame in 'out' (at least RPC_FRAME_HEADER_LEN + len + RPC_FRAME_CRC_LEN bytes); returns its length:
+uint32_t rpc_frame_encode(uint8_t type, uint8_t seq, const void *payload, uint16_t len, uint8_t *out);
+
+void rpc_decoder_init(rpc_decoder_t *decoder);
+
+// Returns true when 'byte' completes a good frame; it stays in the decoder until the next call:
+bool rpc_decoder_feed(rpc_decoder_t *decoder, uint8_t byte);
@@ -0,0 +1,95 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * rpc_proto.h - message types and payloads carried in rpc frames
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Requests come from the host with a nonzero seq; the response
+ * carries the request type with RPC_RESPONSE set, the same seq, and
+ * a payload that starts with an rpc_status_t byte. Telemetry frames
+ * are unsolicited and always have seq 0. All multi-byte fields are
+ * little-endian, as the ESP32 lays them out.
+ */
+#define RPC_RESPONSE                (0x80)
+
+typedef enum {
+    RPC_PING            = 0x01,     // payload echoed back
+    RPC_METER_SNAPSHOT  = 0x02,     // -> rpc_meter_snapshot_t
+    RPC_READ_REG        = 0x03,     // rpc_read_reg_t -> register bytes, MSB first
+    RPC_SET_LED         = 0x04,     // rpc_set_led_t
+    RPC_READ_EEPROM     = 0x05,     // rpc_read_eeprom_t -> the bytes
+    RPC_STREAM          = 0x06,     // rpc_stream_t; period 0 stops the stream
+    RPC_BYE             = 0x07,     // back to the text console
+    RPC_LOG_QUERY       = 0x08,     // rpc_log_query_t -> rpc_log_record_t[], oldest first
+
+    RPC_TELEMETRY       = 0x40,     // -> rpc_meter_snapshot_t, unsolicited
+} rpc_type_t;
+
+typedef enum {
+    RPC_STATUS_OK = 0,
+    RPC_STATUS_UNKNOWN_TYPE,
+    RPC_STATUS_BAD_ARGS,
+    RPC_STATUS_FAILED,
+    RPC_STATUS_UNSUPPORTED,
+} rpc_status_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t msec;                  // since boot
+    int32_t vrms;                   // raw ADE7953 registers, as in adi_snapshot_t
+    int32_t irmsa;
+    int32_t irmsb;
+    int32_t awatt;
+    int32_t bwatt;
+    int32_t avar;
+    int32_t bvar;
+    int32_t ava;
+    int32_t bva;
+    int16_t temperature;            // 0.25C counts
+    uint8_t thermal_state;
+    uint8_t reserved;
+} rpc_meter_snapshot_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t reg;                    // SpiCmdNameT
+} rpc_read_reg_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t led;                    // 1 or 2
+    uint16_t level;                 // perceptual, 0..OMAR_LED_LEVEL_MAX
+    uint16_t fade_msec;
+} rpc_set_led_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t address;
+    uint8_t count;                  // at most RPC_FRAME_PAYLOAD_MAX - 1
+} rpc_read_eeprom_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t period_msec;
+} rpc_stream_t;
+
+/*
+ * The reply holds as many of the energy log's records from 'from'
+ * to 'to' as fit; fewer than RPC_LOG_RECORDS_MAX means that's all of
+ * them, otherwise ask again from the last one's time + 1.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t from;                  // seconds, as in energy_log_record_t
+    uint32_t to;
+} rpc_log_query_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t time;
+    int32_t aenergy;                // raw ADE7953 counts over the period
+    int32_t benergy;
+    int32_t renergy;
+    int32_t vpeak;
+    int16_t temperature;            // 0.25C counts
+    uint16_t reserved;
+} rpc_log_record_t;
+
+#define RPC_LOG_RECORDS_MAX         (10)        // (RPC_FRAME_PAYLOAD_MAX - 1) / sizeof(rpc_log_record_t)
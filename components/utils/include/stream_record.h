@@ -0,0 +1,64 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * stream_record.h - fixed-width text records for the 'stream' command,
+ * and the matching parser and gap check for the host side
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A record is one line:
+ *
+ *   =SSSSSSSS TTTTTTTT VVVVVVVV VVVVVVVV ...
+ *
+ * S is the sequence number, T milliseconds since boot, and there's
+ * one V for each channel in the stream's mask, in the order below;
+ * all in hex, all eight digits. The sequence number counts sample
+ * periods rather than records, so a period the device couldn't
+ * sample (or a line the console dropped) shows up as a gap.
+ */
+#define STREAM_CHANNELS(X) \
+    X(STREAM_VRMS,      "vrms") \
+    X(STREAM_IRMSA,     "irmsa") \
+    X(STREAM_IRMSB,     "irmsb") \
+    X(STREAM_AWATT,     "awatt") \
+    X(STREAM_BWATT,     "bwatt") \
+    X(STREAM_AENERGY,   "aenergy") \
+    X(STREAM_BENERGY,   "benergy") \
+    X(STREAM_ALS,       "als") \
+    X(STREAM_TEMP,      "temp")
+
+#define STREAM_CHANNEL_ENUM(id, name)   id,
+
+typedef enum {
+    STREAM_CHANNELS(STREAM_CHANNEL_ENUM)
+    STREAM_CHANNEL_COUNT
+} stream_channel_t;
+
+#define STREAM_CHANNEL_BIT(ch)      (1u << (ch))
+#define STREAM_ALL_CHANNELS         (STREAM_CHANNEL_BIT(STREAM_CHANNEL_COUNT) - 1)
+#define STREAM_RECORD_MAX           (1 + 9 + 9 + 9 * STREAM_CHANNEL_COUNT + 1)     // with '\n' and '\0'
+
+typedef struct {
+    bool started;
+    uint32_t next_seq;
+    uint32_t records;
+    uint32_t gaps;                  // places where one or more records went missing
+    uint32_t missing;               // ... and how many
+} stream_gap_t;
+
+const char *stream_channel_name(stream_channel_t ch);
+
+// Parses a comma-separated list of channel names ("all" for every one); returns 0 if a name isn't known:
+uint32_t stream_channel_mask(const char *list);
+
+// 'values' is indexed by stream_channel_t; returns the line length, including the '\n':
+int stream_record_format(char *buf, size_t len, uint32_t seq, uint32_t msec, uint32_t mask, const int32_t *values);
+bool stream_record_parse(const char *line, uint32_t mask, uint32_t *seq, uint32_t *msec, int32_t *values);
+
+void stream_gap_reset(stream_gap_t *gap);
+void stream_gap_check(stream_gap_t *gap, uint32_t seq);
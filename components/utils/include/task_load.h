@@ -0,0 +1,53 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * task_load.h - per-task cpu share from successive run time counter samples
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TASK_LOAD_MAX               (32)
+#define TASK_LOAD_NAME_LEN          (16)
+#define TASK_LOAD_NO_CORE           (-1)
+
+/*
+ * Shares are in tenths of a percent of one core, over the window
+ * between the last two samples. The run time counter is 32 bits and
+ * free-running, so a window has to be shorter than one wrap of it.
+ */
+typedef struct {
+    char name[TASK_LOAD_NAME_LEN];
+    uint32_t id;                // the task's number, which (unlike its name) is unique
+    uint32_t runtime;           // its run time counter at the last sample
+    uint32_t stack_free;        // high water mark: the least free stack it's ever had, bytes
+    uint16_t share;
+    uint8_t prio;
+    int8_t core;                // TASK_LOAD_NO_CORE if it isn't pinned
+    bool seen;
+} task_load_entry_t;
+
+typedef struct {
+    task_load_entry_t entries[TASK_LOAD_MAX];
+    uint32_t count;
+    uint32_t samples;
+    uint32_t now;               // run time clock at the last sample
+    uint32_t window;            // run time clock ticks between the last two samples
+    uint32_t overflows;         // tasks that didn't fit
+} task_load_t;
+
+void task_load_reset(task_load_t *load);
+
+/*
+ * A sample is a task_load_begin(), a task_load_update() for every
+ * task there is, and a task_load_end(), which forgets the tasks that
+ * weren't mentioned. The first sample's window starts at zero, so it
+ * gives the shares since boot.
+ */
+void task_load_begin(task_load_t *load, uint32_t now);
+task_load_entry_t *task_load_update(task_load_t *load, uint32_t id, const char *name, uint32_t runtime,
+                                    uint8_t prio, int8_t core, uint32_t stack_free);
+void task_load_end(task_load_t *load);
+
+void task_load_sort(task_load_t *load);    // busiest first
@@ -0,0 +1,70 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * temp_history.h - fixed-size temperature history with per-minute and
+ * per-hour min/max/mean aggregation
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Temperatures are kept as signed 16-bit counts of 0.25C (the
+ * S-5852A's native resolution), so 25.50C is stored as 102.
+ *
+ * With a 10 second sample interval the sample ring and the
+ * minute ring both cover the last hour, and the hour ring the
+ * last two days; a little over 2KB altogether.
+ */
+#define TEMP_HISTORY_SAMPLES        (360)
+#define TEMP_HISTORY_MINUTES        (60)
+#define TEMP_HISTORY_HOURS          (48)
+
+#define TEMP_HISTORY_TO_QUARTERS(c) ((int16_t)((c) * 4.0f))
+#define TEMP_HISTORY_TO_FLOAT(q)    ((float)(q) / 4.0f)
+
+typedef struct {
+    uint32_t start;     // minute (or hour) number since boot
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+    uint16_t count;     // samples that went into this bucket
+} temp_bucket_t;
+
+typedef struct {
+    int32_t sum;
+    temp_bucket_t bucket;
+} temp_accumulator_t;
+
+typedef struct {
+    int16_t samples[TEMP_HISTORY_SAMPLES];
+    uint16_t sample_head;
+    uint16_t sample_count;
+
+    temp_bucket_t minutes[TEMP_HISTORY_MINUTES];
+    uint16_t minute_head;
+    uint16_t minute_count;
+
+    temp_bucket_t hours[TEMP_HISTORY_HOURS];
+    uint16_t hour_head;
+    uint16_t hour_count;
+
+    // The minute and hour still being filled in:
+    temp_accumulator_t minute;
+    temp_accumulator_t hour;
+} temp_history_t;
+
+void temp_history_reset(temp_history_t *history);
+void temp_history_record(temp_history_t *history, uint32_t seconds, int16_t quarters);
+
+/*
+ * Accessors; index 0 is the most recent entry. They return false
+ * once index runs past what's been recorded. The minute and hour
+ * getters only return completed buckets; temp_history_current()
+ * returns the minute in progress.
+ */
+bool temp_history_sample(const temp_history_t *history, uint32_t index, int16_t *quarters);
+bool temp_history_minute(const temp_history_t *history, uint32_t index, temp_bucket_t *bucket);
+bool temp_history_hour(const temp_history_t *history, uint32_t index, temp_bucket_t *bucket);
+bool temp_history_current(const temp_history_t *history, temp_bucket_t *bucket);
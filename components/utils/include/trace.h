@@ -0,0 +1,36 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * trace.h - always-on binary tracing for driver hot paths
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "trace_ring.h"
+#include "postmortem.h"
+
+/*
+ * Each core records into its own ring with interrupts masked for
+ * the few stores it takes, so tracing never takes a lock and is
+ * safe from tasks and ISRs alike; nothing is formatted until the
+ * 'trace' console command (or a host tool) decodes the records.
+ */
+#define TRACE_RING_SLOTS            (128)       // per core
+
+#define TRACE0(id)                  trace_event((id), 0, 0, 0, 0, 0)
+#define TRACE1(id, a)               trace_event((id), 1, (uint32_t)(a), 0, 0, 0)
+#define TRACE2(id, a, b)            trace_event((id), 2, (uint32_t)(a), (uint32_t)(b), 0, 0)
+#define TRACE3(id, a, b, c)         trace_event((id), 3, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c), 0)
+#define TRACE4(id, a, b, c, d)      trace_event((id), 4, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c), (uint32_t)(d))
+
+void trace_event(uint16_t id, uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+// Prints the newest 'max' records from each core (0 for all of them):
+void trace_dump(uint32_t max);
+void trace_clear(void);
+uint32_t trace_count(int core);
+
+// From now on, also records the core's events into 'ring' (see omar_postmortem.h):
+void trace_mirror(int core, postmortem_ring_t *ring);
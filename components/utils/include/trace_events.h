@@ -0,0 +1,28 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * trace_events.h - the list of trace events and their format strings
+ */
+
+#pragma once
+
+/*
+ * X(id, format): the format is only used when the record is decoded
+ * (by 'trace dump' or on the host), never at the call site. Arguments
+ * are recorded as uint32_t, so stick to %u, %d and %x; append new
+ * events at the end so old dumps still decode.
+ */
+#define TRACE_EVENTS(X) \
+    X(TRACE_SPI_READ,           "spi_read_reg(): reg %u, read %u bytes") \
+    X(TRACE_SPI_WRITE,          "spi_write_reg(): reg %u, read %u bytes") \
+    X(TRACE_S5852A_RAW,         "s5852a_get(): raw[0] = 0x%02x, raw[1] = 0x%02x") \
+    X(TRACE_ALS_PRIMARY,        "als: <primary>") \
+    X(TRACE_ALS_SKIPPED,        "als: led mid-fade, sample skipped") \
+    X(TRACE_ALS_READING,        "als: [als=%d]") \
+    X(TRACE_LOCK_CROSS_CORE,    "lock %u: waiting on a holder pinned to cpu %u")
+
+#define TRACE_EVENT_ENUM(id, fmt)   id,
+
+typedef enum {
+    TRACE_EVENTS(TRACE_EVENT_ENUM)
+    TRACE_EVENT_COUNT
+} trace_event_t;
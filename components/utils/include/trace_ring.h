@@ -0,0 +1,51 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * trace_ring.h - fixed-size ring of binary trace records, decoded
+ * against the format strings in trace_events.h after the fact
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "trace_events.h"
+
+#define TRACE_MAX_ARGS              (4)
+
+typedef struct {
+    uint32_t timestamp;                 // esp_timer microseconds, low 32 bits
+    uint16_t id;                        // trace_event_t
+    uint8_t nargs;
+    uint8_t reserved;
+    uint32_t args[TRACE_MAX_ARGS];
+} trace_record_t;
+
+/*
+ * A flight recorder: once full, each new record overwrites the
+ * oldest. 'slots' must be a power of two.
+ *
+ * There's exactly one writer per ring, which fills the slot and
+ * only then advances 'head', so a reader on another core can take
+ * a snapshot without stopping it (see trace_ring_snapshot()).
+ */
+typedef struct {
+    trace_record_t *records;
+    uint32_t slots;
+    volatile uint32_t head;             // records ever written
+    uint32_t floor;                     // records before this one have been cleared (reader side only)
+} trace_ring_t;
+
+void trace_ring_init(trace_ring_t *ring, trace_record_t *records, uint32_t slots);
+void trace_ring_put(trace_ring_t *ring, uint32_t timestamp, uint16_t id,
+                    uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+// Forgets what's in the ring without touching anything the writer uses:
+void trace_ring_clear(trace_ring_t *ring);
+
+// Copies up to 'max' (at most slots - 1) records, oldest first; records the writer overwrote mid-copy are left out:
+uint32_t trace_ring_snapshot(const trace_ring_t *ring, trace_record_t *out, uint32_t max);
+
+// Formats the record's message (without the timestamp); returns what snprintf() would:
+int trace_format(const trace_record_t *record, char *buf, uint32_t len);
+const char *trace_event_name(uint16_t id);
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdint.h>
+
+#include "adi_spi.h"
 
 void hexdump_bytes(uint8_t *buff, unsigned int len);
 void hexdump_bytes_log(uint8_t *buff, unsigned int len);
@@ -0,0 +1,44 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * varint.h - zigzag varints for the telemetry frames and the energy
+ * log
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Seven bits a byte, least significant first, with the top bit set
+ * on every byte but the last. Signed values go through zigzag first
+ * so small negative numbers stay short too. Differences are taken
+ * modulo 2^32, so the difference of any two int32_t values fits.
+ */
+#define VARINT_MAX                  (5)         // bytes in the longest uint32_t
+
+static inline uint32_t varint_zigzag(int32_t value)
+{
+    return ((uint32_t) value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t varint_unzigzag(uint32_t value)
+{
+    return (int32_t)((value >> 1) ^ (0 - (value & 1)));
+}
+
+static inline uint32_t varint_len(uint32_t value)
+{
+    uint32_t len = 1;
+
+    while (value >= 0x80) {
+        value >>= 7;
+        len++;
+    }
+    return len;
+}
+
+// Writes VARINT_MAX bytes at most; returns how many:
+uint32_t varint_put(uint8_t *out, uint32_t value);
+
+// Returns how many bytes it took, or 0 if 'in' ends (after 'len' bytes) or runs on too long:
+uint32_t varint_get(const uint8_t *in, uint32_t len, uint32_t *value);
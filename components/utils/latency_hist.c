@@ -0,0 +1,85 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * latency_hist.c - fixed-size latency histogram with percentile estimates
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "latency_hist.h"
+
+static uint32_t bucket_index(uint32_t value)
+{
+    if (value < 4) {
+        return value;
+    }
+
+    uint32_t msb = 31 - __builtin_clz(value);
+    uint32_t index = (msb - 1) * 4 + ((value >> (msb - 2)) & 3);
+
+    return (index < LATENCY_HIST_BUCKETS ? index : LATENCY_HIST_BUCKETS - 1);
+}
+
+/*
+ * bucket_upper_bound() is the inverse of bucket_index(): the largest
+ * value that lands in the given bucket.
+ */
+static uint32_t bucket_upper_bound(uint32_t index)
+{
+    if (index < 4) {
+        return index;
+    }
+
+    uint32_t msb = index / 4 + 1;
+    uint32_t sub = index % 4;
+    uint32_t lower = (4 + sub) << (msb - 2);
+
+    return lower + (1 << (msb - 2)) - 1;
+}
+
+void latency_hist_reset(latency_hist_t *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+}
+
+void latency_hist_record(latency_hist_t *hist, uint32_t value)
+{
+    if (hist->count == 0 || value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+    hist->count++;
+    hist->total += value;
+    hist->buckets[bucket_index(value)]++;
+}
+
+uint32_t latency_hist_percentile(const latency_hist_t *hist, uint32_t percent)
+{
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    if (percent > 100) {
+        percent = 100;
+    }
+
+    // The rank of the sample we're after, rounded up (so p99 of
+    // 10 samples is the 10th, not the 9th):
+    uint64_t rank = ((uint64_t )hist->count * percent + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint32_t bound = bucket_upper_bound(i);
+            return (bound < hist->max ? bound : hist->max);
+        }
+    }
+
+    return hist->max;
+}
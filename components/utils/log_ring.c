@@ -0,0 +1,62 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * log_ring.c - byte ring for buffered console output that drops
+ * (and counts) whole writes rather than blocking the writer
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "log_ring.h"
+
+void log_ring_init(log_ring_t *ring, uint8_t *buf, uint32_t size)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->buf = buf;
+    ring->size = size;
+}
+
+bool log_ring_put(log_ring_t *ring, const void *data, uint32_t len)
+{
+    uint32_t used = ring->head - ring->tail;
+
+    if (len > ring->size - used) {
+        // Half a line is worse than no line at all:
+        ring->dropped++;
+        ring->dropped_bytes += len;
+        return false;
+    }
+
+    uint32_t start = ring->head & (ring->size - 1);
+    uint32_t first = ring->size - start;
+
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&ring->buf[start], data, first);
+    memcpy(ring->buf, (const uint8_t *)data + first, len - first);
+
+    ring->head += len;
+    ring->written++;
+
+    if (used + len > ring->high_water) {
+        ring->high_water = used + len;
+    }
+    return true;
+}
+
+uint32_t log_ring_peek(const log_ring_t *ring, const uint8_t **data)
+{
+    uint32_t used = ring->head - ring->tail;
+    uint32_t start = ring->tail & (ring->size - 1);
+    uint32_t contiguous = ring->size - start;
+
+    *data = &ring->buf[start];
+    return (used < contiguous ? used : contiguous);
+}
+
+void log_ring_consume(log_ring_t *ring, uint32_t len)
+{
+    ring->tail += len;
+}
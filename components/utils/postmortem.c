@@ -0,0 +1,101 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * postmortem.c - state and the last few trace events, kept where a
+ * reset (a panic, the watchdog, a brownout) doesn't clear them
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "rpc_frame.h"
+#include "postmortem.h"
+
+static uint16_t header_crc(const postmortem_t *pm)
+{
+    return rpc_crc16(RPC_CRC16_INIT, (const uint8_t *) pm, offsetof(postmortem_t, crc));
+}
+
+static uint16_t state_crc(const postmortem_state_t *state)
+{
+    return rpc_crc16(RPC_CRC16_INIT, (const uint8_t *) state, offsetof(postmortem_state_t, crc));
+}
+
+// The index of the newer good copy, or -1:
+static int newest_state(const postmortem_t *pm)
+{
+    bool ok0 = (state_crc(&pm->state[0]) == pm->state[0].crc);
+    bool ok1 = (state_crc(&pm->state[1]) == pm->state[1].crc);
+
+    if (ok0 && ok1) {
+        return ((int32_t)(pm->state[1].seq - pm->state[0].seq) > 0 ? 1 : 0);
+    }
+    return (ok0 ? 0 : (ok1 ? 1 : -1));
+}
+
+bool postmortem_open(postmortem_t *pm)
+{
+    if (pm->magic == POSTMORTEM_MAGIC
+        &&
+        pm->version == POSTMORTEM_VERSION
+        &&
+        pm->size == sizeof(postmortem_t)
+        &&
+        pm->crc == header_crc(pm)) {
+        pm->resets++;
+        pm->crc = header_crc(pm);
+        return true;
+    }
+
+    memset(pm, 0, sizeof(*pm));
+    pm->magic = POSTMORTEM_MAGIC;
+    pm->version = POSTMORTEM_VERSION;
+    pm->size = sizeof(postmortem_t);
+    pm->crc = header_crc(pm);
+    return false;
+}
+
+bool postmortem_load_state(const postmortem_t *pm, postmortem_state_t *state)
+{
+    int newest = newest_state(pm);
+
+    if (newest < 0) {
+        return false;
+    }
+    *state = pm->state[newest];
+    return true;
+}
+
+void postmortem_save_state(postmortem_t *pm, postmortem_state_t *state)
+{
+    int newest = newest_state(pm);
+    int target = (newest < 0 ? 0 : newest ^ 1);
+
+    state->seq = (newest < 0 ? 0 : pm->state[newest].seq + 1);
+    state->reserved = 0;
+    state->crc = state_crc(state);
+    pm->state[target] = *state;
+}
+
+uint32_t postmortem_ring_take(postmortem_ring_t *ring, trace_record_t *out, uint32_t *bad)
+{
+    uint32_t head = ring->head;
+    uint32_t count = (head < POSTMORTEM_TRACE_SLOTS ? head : POSTMORTEM_TRACE_SLOTS);
+    uint32_t taken = 0;
+
+    *bad = 0;
+    for (uint32_t i = head - count; i != head; i++) {
+        const trace_record_t *record = &ring->records[i & (POSTMORTEM_TRACE_SLOTS - 1)];
+
+        if (record->reserved != postmortem_record_check(record) || record->id >= TRACE_EVENT_COUNT) {
+            (*bad)++;
+            continue;
+        }
+        out[taken++] = *record;
+    }
+
+    ring->head = 0;
+    return taken;
+}
@@ -0,0 +1,94 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * power_sched.c - keeps track of the deadlines that light sleep's wake
+ * up time could make late, and when to stop sleeping for them
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "power_sched.h"
+
+void power_sched_init(power_sched_t *sched, const power_sched_source_t *sources, uint32_t count, uint32_t wake_us)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->sources = sources;
+    sched->count = (count < POWER_SCHED_SOURCES_MAX ? count : POWER_SCHED_SOURCES_MAX);
+    sched->wake_us = wake_us;
+}
+
+void power_sched_arm(power_sched_t *sched, uint32_t source, int64_t deadline)
+{
+    if (source >= sched->count) {
+        return;
+    }
+
+    power_sched_entry_t *entry = &sched->entries[source];
+
+    entry->armed = true;
+    entry->deadline = deadline;
+    entry->stats.arms++;
+}
+
+void power_sched_disarm(power_sched_t *sched, uint32_t source)
+{
+    if (source < sched->count) {
+        sched->entries[source].armed = false;
+        sched->entries[source].awake = false;
+    }
+}
+
+bool power_sched_done(power_sched_t *sched, uint32_t source, int64_t now)
+{
+    if (source >= sched->count || !sched->entries[source].armed) {
+        return true;
+    }
+
+    power_sched_entry_t *entry = &sched->entries[source];
+    int64_t late = now - entry->deadline;
+    bool met = (late <= (int64_t) sched->sources[source].slack_us);
+
+    if (late > (int64_t) entry->stats.worst_late_us) {
+        entry->stats.worst_late_us = (late > UINT32_MAX ? UINT32_MAX : (uint32_t) late);
+    }
+    if (met) {
+        entry->stats.met++;
+    } else {
+        entry->stats.missed++;
+    }
+
+    power_sched_disarm(sched, source);
+    return met;
+}
+
+bool power_sched_plan(power_sched_t *sched, int64_t now, int64_t *wake_at)
+{
+    bool stay = false;
+
+    *wake_at = POWER_SCHED_NEVER;
+
+    for (uint32_t i = 0; i < sched->count; i++) {
+        power_sched_entry_t *entry = &sched->entries[i];
+        uint32_t slack = sched->sources[i].slack_us;
+
+        // A roomy deadline is fine with whatever wake it gets:
+        if (!entry->armed || slack >= sched->wake_us) {
+            continue;
+        }
+
+        int64_t awake_from = entry->deadline + slack - sched->wake_us;
+
+        if (entry->awake || awake_from <= now) {
+            if (!entry->awake) {
+                entry->awake = true;
+                entry->stats.kept_awake++;
+            }
+            stay = true;
+        } else if (awake_from < *wake_at) {
+            *wake_at = awake_from;
+        }
+    }
+
+    return stay;
+}
@@ -0,0 +1,128 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * rpc_frame.c - length-prefixed, crc-protected frames for the binary
+ * rpc mode on the console uart
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "rpc_frame.h"
+
+// A nibble at a time keeps the table down to 32 bytes:
+static const uint16_t m_crc_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+uint16_t rpc_crc16(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        crc = (crc << 4) ^ m_crc_nibble[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ m_crc_nibble[(crc >> 12) ^ (data[i] & 0x0f)];
+    }
+    return crc;
+}
+
+uint32_t rpc_frame_encode(uint8_t type, uint8_t seq, const void *payload, uint16_t len, uint8_t *out)
+{
+    out[0] = RPC_FRAME_SOF;
+    out[1] = type;
+    out[2] = seq;
+    out[3] = len & 0xff;
+    out[4] = len >> 8;
+    if (len > 0) {
+        memcpy(&out[RPC_FRAME_HEADER_LEN], payload, len);
+    }
+
+    uint16_t crc = rpc_crc16(RPC_CRC16_INIT, &out[1], RPC_FRAME_HEADER_LEN - 1 + len);
+
+    out[RPC_FRAME_HEADER_LEN + len] = crc & 0xff;
+    out[RPC_FRAME_HEADER_LEN + len + 1] = crc >> 8;
+
+    return RPC_FRAME_HEADER_LEN + len + RPC_FRAME_CRC_LEN;
+}
+
+void rpc_decoder_init(rpc_decoder_t *decoder)
+{
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->state = RPC_DECODE_SOF;
+}
+
+static void decoder_crc(rpc_decoder_t *decoder, uint8_t byte)
+{
+    decoder->crc = rpc_crc16(decoder->crc, &byte, 1);
+}
+
+bool rpc_decoder_feed(rpc_decoder_t *decoder, uint8_t byte)
+{
+    switch (decoder->state) {
+    case RPC_DECODE_SOF:
+        if (byte == RPC_FRAME_SOF) {
+            decoder->crc = RPC_CRC16_INIT;
+            decoder->state = RPC_DECODE_TYPE;
+        } else {
+            decoder->skipped++;
+        }
+        break;
+
+    case RPC_DECODE_TYPE:
+        decoder->type = byte;
+        decoder_crc(decoder, byte);
+        decoder->state = RPC_DECODE_SEQ;
+        break;
+
+    case RPC_DECODE_SEQ:
+        decoder->seq = byte;
+        decoder_crc(decoder, byte);
+        decoder->state = RPC_DECODE_LEN_LO;
+        break;
+
+    case RPC_DECODE_LEN_LO:
+        decoder->len = byte;
+        decoder_crc(decoder, byte);
+        decoder->state = RPC_DECODE_LEN_HI;
+        break;
+
+    case RPC_DECODE_LEN_HI:
+        decoder->len |= (uint16_t)byte << 8;
+        decoder_crc(decoder, byte);
+        decoder->got = 0;
+
+        if (decoder->len > RPC_FRAME_PAYLOAD_MAX) {
+            // Can't be a frame of ours; go back to hunting for the next SOF:
+            decoder->oversize++;
+            decoder->state = RPC_DECODE_SOF;
+        } else {
+            decoder->state = (decoder->len > 0 ? RPC_DECODE_PAYLOAD : RPC_DECODE_CRC_LO);
+        }
+        break;
+
+    case RPC_DECODE_PAYLOAD:
+        decoder->payload[decoder->got++] = byte;
+        decoder_crc(decoder, byte);
+        if (decoder->got == decoder->len) {
+            decoder->state = RPC_DECODE_CRC_LO;
+        }
+        break;
+
+    case RPC_DECODE_CRC_LO:
+        decoder->rx_crc = byte;
+        decoder->state = RPC_DECODE_CRC_HI;
+        break;
+
+    case RPC_DECODE_CRC_HI:
+        decoder->rx_crc |= (uint16_t)byte << 8;
+        decoder->state = RPC_DECODE_SOF;
+
+        if (decoder->rx_crc == decoder->crc) {
+            decoder->frames++;
+            return true;
+        }
+        decoder->crc_errors++;
+        break;
+    }
+
+    return false;
+}
@@ -0,0 +1,148 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * stream_record.c - fixed-width text records for the 'stream' command,
+ * and the matching parser and gap check for the host side
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream_record.h"
+
+#define STREAM_CHANNEL_NAME(id, name)   name,
+
+static const char *const m_names[STREAM_CHANNEL_COUNT] = {
+    STREAM_CHANNELS(STREAM_CHANNEL_NAME)
+};
+
+static const char m_hex[] = "0123456789abcdef";
+
+const char *stream_channel_name(stream_channel_t ch)
+{
+    return (ch < STREAM_CHANNEL_COUNT ? m_names[ch] : "?");
+}
+
+uint32_t stream_channel_mask(const char *list)
+{
+    uint32_t mask = 0;
+
+    while (*list) {
+        const char *end = strchr(list, ',');
+        size_t len = (end ? (size_t)(end - list) : strlen(list));
+        uint32_t bit = 0;
+
+        if (len == 3 && strncmp(list, "all", 3) == 0) {
+            bit = STREAM_ALL_CHANNELS;
+        }
+        for (int ch = 0; ch < STREAM_CHANNEL_COUNT && bit == 0; ch++) {
+            if (strlen(m_names[ch]) == len && strncmp(list, m_names[ch], len) == 0) {
+                bit = STREAM_CHANNEL_BIT(ch);
+            }
+        }
+
+        if (bit == 0) {
+            return 0;
+        }
+        mask |= bit;
+        list += len + (end ? 1 : 0);
+    }
+
+    return mask;
+}
+
+// snprintf() is far too slow to run 100 times a second for this:
+static char *put_hex(char *p, char separator, uint32_t value)
+{
+    *p++ = separator;
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        *p++ = m_hex[(value >> shift) & 0xf];
+    }
+    return p;
+}
+
+int stream_record_format(char *buf, size_t len, uint32_t seq, uint32_t msec, uint32_t mask, const int32_t *values)
+{
+    if (len < STREAM_RECORD_MAX) {
+        return -1;
+    }
+
+    char *p = buf;
+
+    p = put_hex(p, '=', seq);
+    p = put_hex(p, ' ', msec);
+
+    for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+        if (mask & STREAM_CHANNEL_BIT(ch)) {
+            p = put_hex(p, ' ', (uint32_t)values[ch]);
+        }
+    }
+
+    *p++ = '\n';
+    *p = '\0';
+    return p - buf;
+}
+
+static bool get_hex(const char **line, char separator, uint32_t *value)
+{
+    const char *p = *line;
+    uint32_t v = 0;
+
+    if (*p++ != separator) {
+        return false;
+    }
+    for (int i = 0; i < 8; i++, p++) {
+        const char *digit = (*p ? strchr(m_hex, *p) : NULL);
+
+        if (digit == NULL) {
+            return false;
+        }
+        v = (v << 4) | (digit - m_hex);
+    }
+
+    *value = v;
+    *line = p;
+    return true;
+}
+
+bool stream_record_parse(const char *line, uint32_t mask, uint32_t *seq, uint32_t *msec, int32_t *values)
+{
+    const char *p = line;
+
+    if (!get_hex(&p, '=', seq) || !get_hex(&p, ' ', msec)) {
+        return false;
+    }
+
+    for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+        uint32_t v;
+
+        if (!(mask & STREAM_CHANNEL_BIT(ch))) {
+            continue;
+        }
+        if (!get_hex(&p, ' ', &v)) {
+            return false;
+        }
+        values[ch] = (int32_t)v;
+    }
+
+    return (*p == '\n' || *p == '\r' || *p == '\0');
+}
+
+void stream_gap_reset(stream_gap_t *gap)
+{
+    memset(gap, 0, sizeof(*gap));
+}
+
+void stream_gap_check(stream_gap_t *gap, uint32_t seq)
+{
+    if (gap->started && seq != gap->next_seq) {
+        gap->gaps++;
+        gap->missing += seq - gap->next_seq;
+    }
+
+    gap->started = true;
+    gap->next_seq = seq + 1;
+    gap->records++;
+}
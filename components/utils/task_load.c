@@ -0,0 +1,89 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * task_load.c - per-task cpu share from successive run time counter samples
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "task_load.h"
+
+void task_load_reset(task_load_t *load)
+{
+    memset(load, 0, sizeof(*load));
+}
+
+void task_load_begin(task_load_t *load, uint32_t now)
+{
+    load->window = now - load->now;
+    load->now = now;
+    load->samples++;
+
+    for (uint32_t i = 0; i < load->count; i++) {
+        load->entries[i].seen = false;
+    }
+}
+
+task_load_entry_t *task_load_update(task_load_t *load, uint32_t id, const char *name, uint32_t runtime,
+                                    uint8_t prio, int8_t core, uint32_t stack_free)
+{
+    task_load_entry_t *entry = NULL;
+    uint32_t previous = 0;      // a task we haven't seen before has run for all of its run time this window
+
+    for (uint32_t i = 0; i < load->count; i++) {
+        if (load->entries[i].id == id) {
+            entry = &load->entries[i];
+            previous = entry->runtime;
+            break;
+        }
+    }
+
+    if (entry == NULL) {
+        if (load->count >= TASK_LOAD_MAX) {
+            load->overflows++;
+            return NULL;
+        }
+        entry = &load->entries[load->count++];
+        memset(entry, 0, sizeof(*entry));
+        entry->id = id;
+        strncpy(entry->name, name, TASK_LOAD_NAME_LEN - 1);
+    }
+
+    uint64_t share = (load->window == 0 ? 0 : (uint64_t)(runtime - previous) * 1000 / load->window);
+
+    entry->runtime = runtime;
+    entry->share = (share > 1000 ? 1000 : share);
+    entry->prio = prio;
+    entry->core = core;
+    entry->stack_free = stack_free;
+    entry->seen = true;
+    return entry;
+}
+
+void task_load_end(task_load_t *load)
+{
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < load->count; i++) {
+        if (load->entries[i].seen) {
+            load->entries[kept++] = load->entries[i];
+        }
+    }
+    load->count = kept;
+}
+
+void task_load_sort(task_load_t *load)
+{
+    // Insertion sort: there are only a couple of dozen tasks, and it keeps ties in order.
+    for (uint32_t i = 1; i < load->count; i++) {
+        task_load_entry_t entry = load->entries[i];
+        uint32_t j = i;
+
+        while (j > 0 && load->entries[j - 1].share < entry.share) {
+            load->entries[j] = load->entries[j - 1];
+            j--;
+        }
+        load->entries[j] = entry;
+    }
+}
@@ -0,0 +1,141 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * temp_history.c - fixed-size temperature history with per-minute and
+ * per-hour min/max/mean aggregation
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "temp_history.h"
+
+// Round to the nearest 0.25C rather than truncating towards zero:
+static int16_t mean_of(int32_t sum, uint16_t count)
+{
+    int32_t half = count / 2;
+
+    return (int16_t)(sum >= 0 ? (sum + half) / count : -((-sum + half) / count));
+}
+
+static void accumulator_start(temp_accumulator_t *acc, uint32_t start)
+{
+    memset(acc, 0, sizeof(*acc));
+    acc->bucket.start = start;
+}
+
+static void accumulator_add(temp_accumulator_t *acc, int16_t quarters)
+{
+    if (acc->bucket.count == 0 || quarters < acc->bucket.min) {
+        acc->bucket.min = quarters;
+    }
+    if (acc->bucket.count == 0 || quarters > acc->bucket.max) {
+        acc->bucket.max = quarters;
+    }
+    acc->sum += quarters;
+    acc->bucket.count++;
+}
+
+static void accumulator_finish(const temp_accumulator_t *acc, temp_bucket_t *bucket)
+{
+    *bucket = acc->bucket;
+    bucket->mean = mean_of(acc->sum, acc->bucket.count);
+}
+
+/*
+ * Pushes a completed bucket onto one of the rings; 'head' is the
+ * slot the next bucket goes into.
+ */
+static void ring_push(temp_bucket_t *ring, uint16_t size, uint16_t *head, uint16_t *count,
+                      const temp_accumulator_t *acc)
+{
+    accumulator_finish(acc, &ring[*head]);
+    *head = (*head + 1) % size;
+    if (*count < size) {
+        (*count)++;
+    }
+}
+
+static bool ring_get(const temp_bucket_t *ring, uint16_t size, uint16_t head, uint16_t count,
+                     uint32_t index, temp_bucket_t *bucket)
+{
+    if (index >= count) {
+        return false;
+    }
+    *bucket = ring[(head + size - 1 - index) % size];
+    return true;
+}
+
+void temp_history_reset(temp_history_t *history)
+{
+    memset(history, 0, sizeof(*history));
+}
+
+void temp_history_record(temp_history_t *history, uint32_t seconds, int16_t quarters)
+{
+    uint32_t minute = seconds / 60;
+    uint32_t hour = minute / 60;
+
+    /*
+     * Close out the minute (and hour) in progress once a sample
+     * from a later one shows up. Minutes with no samples at all
+     * simply don't get a bucket.
+     */
+    if (history->minute.bucket.count != 0 && history->minute.bucket.start != minute) {
+        ring_push(history->minutes, TEMP_HISTORY_MINUTES,
+                  &history->minute_head, &history->minute_count, &history->minute);
+        history->minute.bucket.count = 0;
+    }
+    if (history->hour.bucket.count != 0 && history->hour.bucket.start != hour) {
+        ring_push(history->hours, TEMP_HISTORY_HOURS,
+                  &history->hour_head, &history->hour_count, &history->hour);
+        history->hour.bucket.count = 0;
+    }
+
+    if (history->minute.bucket.count == 0) {
+        accumulator_start(&history->minute, minute);
+    }
+    if (history->hour.bucket.count == 0) {
+        accumulator_start(&history->hour, hour);
+    }
+
+    // The hour's mean is taken over every sample, not over the minute means:
+    accumulator_add(&history->minute, quarters);
+    accumulator_add(&history->hour, quarters);
+
+    history->samples[history->sample_head] = quarters;
+    history->sample_head = (history->sample_head + 1) % TEMP_HISTORY_SAMPLES;
+    if (history->sample_count < TEMP_HISTORY_SAMPLES) {
+        history->sample_count++;
+    }
+}
+
+bool temp_history_sample(const temp_history_t *history, uint32_t index, int16_t *quarters)
+{
+    if (index >= history->sample_count) {
+        return false;
+    }
+    *quarters = history->samples[(history->sample_head + TEMP_HISTORY_SAMPLES - 1 - index) % TEMP_HISTORY_SAMPLES];
+    return true;
+}
+
+bool temp_history_minute(const temp_history_t *history, uint32_t index, temp_bucket_t *bucket)
+{
+    return ring_get(history->minutes, TEMP_HISTORY_MINUTES,
+                    history->minute_head, history->minute_count, index, bucket);
+}
+
+bool temp_history_hour(const temp_history_t *history, uint32_t index, temp_bucket_t *bucket)
+{
+    return ring_get(history->hours, TEMP_HISTORY_HOURS,
+                    history->hour_head, history->hour_count, index, bucket);
+}
+
+bool temp_history_current(const temp_history_t *history, temp_bucket_t *bucket)
+{
+    if (history->minute.bucket.count == 0) {
+        return false;
+    }
+    accumulator_finish(&history->minute, bucket);
+    return true;
+}
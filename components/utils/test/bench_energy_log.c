@@ -0,0 +1,137 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * bench_energy_log.c - a year of one-minute energy log records: how
+ * fast they go in (flushing the open block every hour, as the board
+ * does), how many sector writes that takes, and how long queries of an
+ * hour up to the whole year take. The file sits in the host's page
+ * cache, so the times are the code's; on a board each block read and
+ * write adds the flash's own time.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "energy_log.h"
+#include "energy_records.h"
+#include "host_bench.h"
+
+#define YEAR_SLOTS          (1024)          // enough for a year at a minute
+#define BOARD_SLOTS         (512 / 4)       // CONFIG_ENERGY_LOG_MAX_KB's default
+#define FLUSH_PERIODS       (60)            // CONFIG_ENERGY_LOG_FLUSH_MIN's default
+
+static char m_dir[] = "/tmp/energy_log.XXXXXX";
+static char m_path[64];
+static energy_log_t m_log;
+static energy_log_index_t m_index[YEAR_SLOTS];
+
+typedef struct {
+    uint32_t from;
+    uint32_t to;
+    uint32_t records;
+} query_case_t;
+
+static bool count_record(const energy_log_record_t *record, void *arg)
+{
+    (*(uint32_t *) arg)++;
+    (void) record;
+    return true;
+}
+
+static void bench_query(void *arg)
+{
+    query_case_t *query = arg;
+    uint32_t count = 0;
+
+    query->records = energy_log_query(&m_log, query->from, query->to, count_record, &count);
+}
+
+static void append_year(const char *name, uint32_t slots)
+{
+    energy_log_record_t record;
+    energy_log_summary_t summary;
+
+    remove(m_path);
+    energy_log_init(&m_log, m_path, m_index, slots);
+
+    uint32_t start = host_bench_clock();
+
+    for (uint32_t i = 0; i < ENERGY_RECORDS_YEAR; i++) {
+        energy_record(i, &record);
+        energy_log_append(&m_log, &record);
+        if ((i + 1) % FLUSH_PERIODS == 0) {
+            energy_log_flush(&m_log);
+        }
+    }
+
+    double secs = (uint32_t)(host_bench_clock() - start) / 1e9;
+
+    energy_log_get_summary(&m_log, &summary);
+    printf("# %s (%u KB): %u records appended at %.0f records/s, %u sector writes (%u to seal a block),"
+           " %u records kept (%.1f days), %.2f bytes/record\n",
+           name, slots * ENERGY_LOG_BLOCK_SIZE / 1024, m_log.stats.appended, m_log.stats.appended / secs,
+           m_log.stats.writes, m_log.seq, summary.records, summary.records / (24.0 * 60),
+           (double)(slots < m_log.seq ? slots : m_log.seq) * ENERGY_LOG_BLOCK_SIZE
+           / (summary.records - m_log.count));
+}
+
+static void queries(bench_t *bench, const char *name)
+{
+    static const struct {
+        const char *name;
+        uint32_t minutes;
+        uint32_t reps;
+    } spans[] = {
+        { "hour", 60, 2000 },
+        { "day", 24 * 60, 1000 },
+        { "week", 7 * 24 * 60, 200 },
+        { "month", 30 * 24 * 60, 50 },
+        { "all", ENERGY_RECORDS_YEAR, 20 },
+    };
+    energy_log_summary_t summary;
+
+    energy_log_get_summary(&m_log, &summary);
+    for (uint32_t i = 0; i < sizeof(spans) / sizeof(spans[0]); i++) {
+        // The span ending a week back, so it's all sealed blocks that have to be read:
+        query_case_t query;
+        char label[48];
+
+        query.to = summary.t_max - 7 * 24 * 3600;
+        query.from = query.to - spans[i].minutes * ENERGY_RECORDS_PERIOD;
+        if (query.from < summary.t_min || query.to < query.from) {
+            query.from = summary.t_min;
+        }
+
+        uint32_t blocks = m_log.stats.blocks_read;
+
+        snprintf(label, sizeof(label), "%s_query_%s", name, spans[i].name);
+        host_bench_run(bench, label, bench_query, &query, spans[i].reps);
+        printf("#   %u records, %u blocks read a query\n", query.records,
+               (m_log.stats.blocks_read - blocks) / (spans[i].reps + spans[i].reps / 10));
+    }
+}
+
+int main(void)
+{
+    bench_t bench;
+
+    if (mkdtemp(m_dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(m_path, sizeof(m_path), "%s/energy.log", m_dir);
+
+    host_bench_init(&bench, "energy_log");
+
+    append_year("year", YEAR_SLOTS);
+    queries(&bench, "year");
+
+    append_year("board", BOARD_SLOTS);
+    queries(&bench, "board");
+
+    remove(m_path);
+    rmdir(m_dir);
+    return 0;
+}
@@ -0,0 +1,43 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * bench_latency_hist.c - the histogram every i2c transaction and
+ * console command is recorded into
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "latency_hist.h"
+#include "host_bench.h"
+
+static latency_hist_t m_hist;
+static uint32_t m_value = 1;
+
+static void record(void *arg)
+{
+    (void) arg;
+
+    // A spread of magnitudes, so every bucket's search path gets a turn:
+    m_value = m_value * 1103515245 + 12345;
+    latency_hist_record(&m_hist, m_value >> (m_value & 31));
+}
+
+static void percentile(void *arg)
+{
+    latency_hist_percentile(&m_hist, *(uint32_t *) arg);
+}
+
+int main(void)
+{
+    bench_t bench;
+    uint32_t p50 = 50;
+    uint32_t p99 = 99;
+
+    latency_hist_reset(&m_hist);
+    host_bench_init(&bench, "latency_hist");
+    host_bench_run(&bench, "latency_hist_record", record, NULL, 10000);
+    host_bench_run(&bench, "latency_hist_percentile(50)", percentile, &p50, 10000);
+    host_bench_run(&bench, "latency_hist_percentile(99)", percentile, &p99, 10000);
+
+    return 0;
+}
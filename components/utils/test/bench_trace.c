@@ -0,0 +1,77 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * bench_trace.c - what a trace call site costs, against the printf()
+ * it replaced, and what decoding costs
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "trace.h"
+#include "trace_ring.h"
+#include "postmortem.h"
+#include "host_bench.h"
+
+static trace_record_t m_records[TRACE_RING_SLOTS];
+static trace_ring_t m_ring;
+static postmortem_ring_t m_postmortem;
+static uint32_t m_arg;
+
+static void ring_put(void *arg)
+{
+    (void) arg;
+    trace_ring_put(&m_ring, m_arg, TRACE_S5852A_RAW, 2, m_arg, m_arg + 1, 0, 0);
+    m_arg++;
+}
+
+static void postmortem_put(void *arg)
+{
+    (void) arg;
+    postmortem_ring_put(&m_postmortem, m_arg, TRACE_S5852A_RAW, 2, m_arg, m_arg + 1, 0, 0);
+    m_arg++;
+}
+
+static void event(void *arg)
+{
+    (void) arg;
+    TRACE2(TRACE_S5852A_RAW, m_arg, m_arg + 1);
+    m_arg++;
+}
+
+static void format(void *arg)
+{
+    char buf[96];
+
+    trace_format((const trace_record_t *) arg, buf, sizeof(buf));
+}
+
+static void sprint(void *arg)
+{
+    char buf[96];
+
+    // The formatting a printf() at the call site used to do, less the uart:
+    (void) arg;
+    snprintf(buf, sizeof(buf), "s5852a_get(): raw[0] = 0x%02x, raw[1] = 0x%02x\n", m_arg, m_arg + 1);
+    m_arg++;
+}
+
+int main(void)
+{
+    bench_t bench;
+    trace_record_t record = {
+        .id = TRACE_S5852A_RAW, .nargs = 2, .args = { 0xe1, 0x90 },
+    };
+
+    trace_ring_init(&m_ring, m_records, TRACE_RING_SLOTS);
+
+    host_bench_init(&bench, "trace");
+    host_bench_run(&bench, "trace_ring_put", ring_put, NULL, 10000);
+    // The same record again, with its check byte, into the ring that outlives a reset:
+    host_bench_run(&bench, "postmortem_ring_put", postmortem_put, NULL, 10000);
+    // On the host the critical section is a pthread mutex, so this is the pessimistic case:
+    host_bench_run(&bench, "TRACE2", event, NULL, 10000);
+    host_bench_run(&bench, "trace_format", format, &record, 10000);
+    host_bench_run(&bench, "snprintf (the old call site)", sprint, NULL, 10000);
+
+    return 0;
+}
@@ -0,0 +1,40 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * energy_records.h - made-up but meter-like energy log records for the
+ * energy_log test and bench: a load that follows the time of day, a
+ * line voltage that wanders a little, a temperature that lags the load
+ * and a period that's now and then a second late
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#include "energy_log.h"
+
+#define ENERGY_RECORDS_START        (1546300800)    // 2019-01-01
+#define ENERGY_RECORDS_PERIOD       (60)
+#define ENERGY_RECORDS_YEAR         (365 * 24 * 60)
+
+// Record 'i' is always the same record, whatever order they're asked for in:
+static inline void energy_record(uint32_t i, energy_log_record_t *record)
+{
+    uint32_t hash = i * 2654435761u;
+    double day = 2 * M_PI * (i % (24 * 60)) / (24 * 60);
+    double load = 1.2 + sin(day - 2.0) + 0.3 * sin(3 * day);
+
+    // Every 97th period comes in a second late, and the next one catches up:
+    record->time = ENERGY_RECORDS_START + i * ENERGY_RECORDS_PERIOD + (i % 97 == 50);
+    record->aenergy = (int32_t)(4000 * (load > 0.2 ? load : 0.2)) + (int32_t)(hash >> 26);
+    record->benergy = (int32_t)(800 * (load > 0.2 ? load : 0.2)) + (int32_t)((hash >> 20) & 0x0f);
+    record->renergy = record->aenergy / 5 - (int32_t)((hash >> 12) & 0x1f);
+    record->vpeak = 3400000 + (int32_t)(20000 * sin(day)) + (int32_t)((hash >> 8) & 0x3ff);
+    record->temperature = 160 + (int32_t)(24 * sin(day - 2.5));
+}
+
+static inline bool energy_records_equal(const energy_log_record_t *a, const energy_log_record_t *b)
+{
+    return (a->time == b->time && a->aenergy == b->aenergy && a->benergy == b->benergy
+            && a->renergy == b->renergy && a->vpeak == b->vpeak && a->temperature == b->temperature);
+}
@@ -0,0 +1,43 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * host_bench.h - bench.h on the host: a nanosecond clock, and the same
+ * csv the 'bench' console command prints, so host and target runs of a
+ * case line up
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define HOST_BENCH_SAMPLES_MAX      (10000)
+
+static uint32_t host_bench_samples[HOST_BENCH_SAMPLES_MAX];
+
+static inline uint32_t host_bench_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t) now.tv_sec * 1000000000 + now.tv_nsec);
+}
+
+static inline void host_bench_init(bench_t *bench, const char *name)
+{
+    bench_init(bench, host_bench_clock, host_bench_samples, HOST_BENCH_SAMPLES_MAX);
+    printf("# %s overhead=%u unit=ns\n", name, bench->overhead);
+    printf("case,reps,min,p50,p90,p99,max,mean\n");
+}
+
+static inline void host_bench_run(bench_t *bench, const char *name, bench_fn_t fn, void *arg, uint32_t reps)
+{
+    bench_result_t result;
+
+    if (bench_run(bench, fn, arg, reps / 10, reps, &result)) {
+        printf("%s,%u,%u,%u,%u,%u,%u,%u\n", name, result.reps, result.min,
+               result.p50, result.p90, result.p99, result.max, result.mean);
+    }
+}
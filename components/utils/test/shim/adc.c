@@ -0,0 +1,122 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * adc.c - host stand-in for adc1 and esp_adc_cal
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "driver/adc.h"
+#include "esp_adc_cal.h"
+#include "host.h"
+
+#define ADC_12_BIT_RES              (4096)
+#define ADC_LIN_COEFF_A_SCALE       (65536)
+
+typedef struct {
+    bool configured;
+    uint32_t raw;
+    int (*source)(int channel, void *ctx);
+    void *ctx;
+} adc_input_t;
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static adc_input_t m_inputs[ADC1_CHANNEL_MAX];
+static uint32_t m_reads = 0;
+
+// esp-idf v3.3's, per attenuation:
+static const uint32_t m_atten_scale[ADC_ATTEN_MAX] = { 57431, 76236, 105481, 196602 };
+static const uint32_t m_atten_offset[ADC_ATTEN_MAX] = { 75, 78, 107, 142 };
+
+esp_err_t adc1_config_width(adc_bits_width_t width_bit)
+{
+    return (width_bit == ADC_WIDTH_BIT_12 ? ESP_OK : ESP_ERR_NOT_SUPPORTED);
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten)
+{
+    if (channel < 0 || channel >= ADC1_CHANNEL_MAX || atten < 0 || atten >= ADC_ATTEN_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    m_inputs[channel].configured = true;
+    pthread_mutex_unlock(&m_lock);
+
+    return ESP_OK;
+}
+
+int adc1_get_raw(adc1_channel_t channel)
+{
+    if (channel < 0 || channel >= ADC1_CHANNEL_MAX) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    adc_input_t input = m_inputs[channel];
+    m_reads++;
+    pthread_mutex_unlock(&m_lock);
+
+    if (!input.configured) {
+        return -1;
+    }
+
+    int raw = (input.source != NULL ? input.source(channel, input.ctx) : (int) input.raw);
+
+    return (raw < 0 ? 0 : raw >= ADC_12_BIT_RES ? ADC_12_BIT_RES - 1 : raw);
+}
+
+esp_err_t adc2_vref_to_gpio(gpio_num_t gpio)
+{
+    return (gpio == 25 || gpio == 26 || gpio == 27 ? ESP_OK : ESP_ERR_INVALID_ARG);
+}
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t adc_num, adc_atten_t atten, adc_bits_width_t bit_width,
+                                             uint32_t default_vref, esp_adc_cal_characteristics_t *chars)
+{
+    chars->adc_num = adc_num;
+    chars->atten = atten;
+    chars->bit_width = bit_width;
+    chars->vref = default_vref;
+    chars->coeff_a = (default_vref * m_atten_scale[atten]) / ADC_12_BIT_RES;
+    chars->coeff_b = m_atten_offset[atten];
+    chars->low_curve = NULL;
+    chars->high_curve = NULL;
+
+    return ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t adc_reading, const esp_adc_cal_characteristics_t *chars)
+{
+    return ((chars->coeff_a * adc_reading) + ADC_LIN_COEFF_A_SCALE / 2) / ADC_LIN_COEFF_A_SCALE + chars->coeff_b;
+}
+
+void host_adc_set(int channel, uint32_t raw)
+{
+    if (channel >= 0 && channel < ADC1_CHANNEL_MAX) {
+        pthread_mutex_lock(&m_lock);
+        m_inputs[channel].raw = raw;
+        m_inputs[channel].source = NULL;
+        pthread_mutex_unlock(&m_lock);
+    }
+}
+
+void host_adc_source(int channel, int (*source)(int channel, void *ctx), void *ctx)
+{
+    if (channel >= 0 && channel < ADC1_CHANNEL_MAX) {
+        pthread_mutex_lock(&m_lock);
+        m_inputs[channel].source = source;
+        m_inputs[channel].ctx = ctx;
+        pthread_mutex_unlock(&m_lock);
+    }
+}
+
+uint32_t host_adc_reads(void)
+{
+    pthread_mutex_lock(&m_lock);
+    uint32_t reads = m_reads;
+    pthread_mutex_unlock(&m_lock);
+
+    return reads;
+}
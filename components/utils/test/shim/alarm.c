@@ -0,0 +1,258 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * alarm.c - the alarm list behind the shim's esp_timer, software
+ * timers and timer group; see host_alarm.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "host_alarm.h"
+#include "host.h"
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;     // never held across a call out
+static pthread_cond_t m_changed;
+static pthread_once_t m_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t m_esp_timer_task;
+static pthread_mutex_t m_tmr_svc_task;
+static host_alarm_t *m_alarms = NULL;
+static uint64_t m_order = 0;
+static bool m_driven = false;
+
+static void *alarm_thread(void *arg);
+
+static void alarm_init(void)
+{
+    pthread_condattr_t cond_attr;
+    pthread_mutexattr_t attr;
+    pthread_t thread;
+
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&m_changed, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&m_esp_timer_task, &attr);
+    pthread_mutex_init(&m_tmr_svc_task, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    pthread_create(&thread, NULL, alarm_thread, NULL);
+    pthread_detach(thread);
+}
+
+// With m_lock held:
+static void unlink_alarm(host_alarm_t *alarm)
+{
+    for (host_alarm_t **p = &m_alarms; *p != NULL; p = &(*p)->next) {
+        if (*p == alarm) {
+            *p = alarm->next;
+            break;
+        }
+    }
+    alarm->armed = false;
+    alarm->overdue = false;
+}
+
+/*
+ * With m_lock held; the earliest armed alarm (the first started, of a
+ * tie), overdue ones only if 'overdue', and only from 'source' unless
+ * that's -1.
+ */
+static host_alarm_t *earliest(bool overdue, int source)
+{
+    host_alarm_t *first = NULL;
+
+    for (host_alarm_t *alarm = m_alarms; alarm != NULL; alarm = alarm->next) {
+        if ((overdue && !alarm->overdue) || (source >= 0 && (int) alarm->source != source)) {
+            continue;
+        }
+        if (first == NULL || alarm->at < first->at || (alarm->at == first->at && alarm->order < first->order)) {
+            first = alarm;
+        }
+    }
+    return first;
+}
+
+// With m_lock held: takes it off the list, or moves it to its next period
+static void pop(host_alarm_t *alarm)
+{
+    if (alarm->period == 0) {
+        unlink_alarm(alarm);
+        return;
+    }
+    alarm->at += alarm->period;
+    alarm->order = m_order++;
+    alarm->overdue = false;
+}
+
+void host_alarm_start(host_alarm_t *alarm, int64_t at, int64_t period)
+{
+    pthread_once(&m_once, alarm_init);
+    pthread_mutex_lock(&m_lock);
+
+    if (!alarm->armed) {
+        alarm->next = m_alarms;
+        m_alarms = alarm;
+    }
+    alarm->at = at;
+    alarm->period = period;
+    alarm->order = m_order++;
+    alarm->armed = true;
+    alarm->overdue = (host_clock_is_virtual() && at <= host_time_usec());
+
+    pthread_cond_broadcast(&m_changed);
+    pthread_mutex_unlock(&m_lock);
+}
+
+void host_alarm_stop(host_alarm_t *alarm)
+{
+    pthread_mutex_lock(&m_lock);
+    if (alarm->armed) {
+        unlink_alarm(alarm);
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+bool host_alarm_armed(const host_alarm_t *alarm)
+{
+    pthread_mutex_lock(&m_lock);
+    bool armed = alarm->armed;
+    pthread_mutex_unlock(&m_lock);
+
+    return armed;
+}
+
+void host_alarm_fire(host_alarm_t *alarm)
+{
+    pthread_once(&m_once, alarm_init);
+
+    switch (alarm->source) {
+    case HOST_ALARM_ISR:
+        host_critical_enter();
+        alarm->fn(alarm->arg);
+        host_critical_exit();
+        break;
+    case HOST_ALARM_ESP_TIMER:
+        pthread_mutex_lock(&m_esp_timer_task);
+        alarm->fn(alarm->arg);
+        pthread_mutex_unlock(&m_esp_timer_task);
+        break;
+    case HOST_ALARM_TMR_SVC:
+        pthread_mutex_lock(&m_tmr_svc_task);
+        alarm->fn(alarm->arg);
+        pthread_mutex_unlock(&m_tmr_svc_task);
+        break;
+    }
+}
+
+/*
+ * Steps the clock to each alarm that falls due on the way to 'until'
+ * and fires it there, so a callback sees the time it was due (or now,
+ * if it was overdue already).
+ */
+void host_alarm_advance(int64_t until)
+{
+    pthread_mutex_lock(&m_lock);
+    while (1) {
+        host_alarm_t *alarm = earliest(false, -1);
+        int64_t now = host_time_usec();
+
+        if (alarm == NULL || alarm->at > until) {
+            if (until > now) {
+                host_clock_virtual(until);
+            }
+            break;
+        }
+
+        if (alarm->at > now) {
+            host_clock_virtual(alarm->at);
+        }
+        pop(alarm);
+        pthread_mutex_unlock(&m_lock);
+        host_alarm_fire(alarm);
+        pthread_mutex_lock(&m_lock);
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+void host_alarm_driven(bool driven)
+{
+    pthread_once(&m_once, alarm_init);
+    pthread_mutex_lock(&m_lock);
+    m_driven = driven;
+    pthread_cond_broadcast(&m_changed);
+    pthread_mutex_unlock(&m_lock);
+}
+
+bool host_alarm_next(host_alarm_source_t source, int64_t *at)
+{
+    pthread_mutex_lock(&m_lock);
+    host_alarm_t *alarm = earliest(false, (int) source);
+
+    if (alarm != NULL) {
+        *at = alarm->at;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    return (alarm != NULL);
+}
+
+host_alarm_t *host_alarm_take(host_alarm_source_t source, int64_t until, int64_t *at)
+{
+    pthread_mutex_lock(&m_lock);
+    host_alarm_t *alarm = earliest(false, (int) source);
+
+    if (alarm != NULL && alarm->at <= until) {
+        *at = alarm->at;
+        pop(alarm);
+    } else {
+        alarm = NULL;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    return alarm;
+}
+
+static void *alarm_thread(void *arg)
+{
+    (void) arg;
+
+    pthread_mutex_lock(&m_lock);
+    while (1) {
+        bool virtual = host_clock_is_virtual();
+        host_alarm_t *alarm = (m_driven ? NULL : earliest(virtual, -1));
+
+        if (alarm == NULL) {
+            pthread_cond_wait(&m_changed, &m_lock);
+            continue;
+        }
+
+        int64_t left = alarm->at - host_time_usec();
+
+        if (!virtual && left > 0) {
+            struct timespec until;
+
+            clock_gettime(CLOCK_MONOTONIC, &until);
+            until.tv_sec += left / 1000000;
+            until.tv_nsec += (left % 1000000) * 1000;
+            if (until.tv_nsec >= 1000000000) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&m_changed, &m_lock, &until);
+            continue;
+        }
+
+        pop(alarm);
+        pthread_mutex_unlock(&m_lock);
+        host_alarm_fire(alarm);
+        pthread_mutex_lock(&m_lock);
+    }
+    return NULL;
+}
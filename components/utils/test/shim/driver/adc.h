@@ -0,0 +1,63 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * adc.h - host stand-in for adc1: each channel reads whatever the test
+ * put on it (see host_adc_set())
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef enum {
+    ADC_UNIT_1 = 1,
+    ADC_UNIT_2 = 2,
+} adc_unit_t;
+
+typedef enum {
+    ADC_CHANNEL_0 = 0,
+    ADC_CHANNEL_1,
+    ADC_CHANNEL_2,
+    ADC_CHANNEL_3,
+    ADC_CHANNEL_4,
+    ADC_CHANNEL_5,
+    ADC_CHANNEL_6,
+    ADC_CHANNEL_7,
+    ADC_CHANNEL_8,
+    ADC_CHANNEL_9,
+    ADC_CHANNEL_MAX,
+} adc_channel_t;
+
+typedef enum {
+    ADC1_CHANNEL_0 = 0,
+    ADC1_CHANNEL_1,
+    ADC1_CHANNEL_2,
+    ADC1_CHANNEL_3,
+    ADC1_CHANNEL_4,
+    ADC1_CHANNEL_5,
+    ADC1_CHANNEL_6,
+    ADC1_CHANNEL_7,
+    ADC1_CHANNEL_MAX,
+} adc1_channel_t;
+
+typedef enum {
+    ADC_ATTEN_DB_0 = 0,
+    ADC_ATTEN_DB_2_5,
+    ADC_ATTEN_DB_6,
+    ADC_ATTEN_DB_11,
+    ADC_ATTEN_MAX,
+} adc_atten_t;
+
+typedef enum {
+    ADC_WIDTH_BIT_9 = 0,
+    ADC_WIDTH_BIT_10,
+    ADC_WIDTH_BIT_11,
+    ADC_WIDTH_BIT_12,
+    ADC_WIDTH_MAX,
+} adc_bits_width_t;
+
+esp_err_t adc1_config_width(adc_bits_width_t width_bit);
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten);
+int adc1_get_raw(adc1_channel_t channel);                  // -1 if the channel isn't configured
+esp_err_t adc2_vref_to_gpio(gpio_num_t gpio);
@@ -0,0 +1,69 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * gpio.h - host stand-in: a level per pin, which a test can drive from
+ * the other end (see host_gpio_input()), and the isr service
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "soc/soc.h"
+
+#define HOST_GPIO_COUNT             (40)
+#define GPIO_NUM_MAX                HOST_GPIO_COUNT
+
+typedef int gpio_num_t;
+
+typedef enum {
+    GPIO_MODE_DISABLE = 0,
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+    GPIO_MODE_OUTPUT_OD,
+    GPIO_MODE_INPUT_OUTPUT_OD,
+    GPIO_MODE_INPUT_OUTPUT,
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE = 0,
+    GPIO_PULLUP_ENABLE,
+} gpio_pullup_t;
+
+typedef enum {
+    GPIO_PULLDOWN_DISABLE = 0,
+    GPIO_PULLDOWN_ENABLE,
+} gpio_pulldown_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE,
+    GPIO_INTR_LOW_LEVEL,
+    GPIO_INTR_HIGH_LEVEL,
+    GPIO_INTR_MAX,
+} gpio_int_type_t;
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void *arg);
+
+esp_err_t gpio_config(const gpio_config_t *config);
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level);
+int gpio_get_level(gpio_num_t gpio);
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode);
+esp_err_t gpio_set_intr_type(gpio_num_t gpio, gpio_int_type_t type);
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio, gpio_int_type_t type);    // level types only
+
+// ESP_ERR_INVALID_STATE if it's already installed:
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+void gpio_uninstall_isr_service(void);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t handler, void *arg);
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio);
@@ -0,0 +1,18 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * periph_ctrl.h - host stand-in; every peripheral is always clocked
+ */
+
+#pragma once
+
+typedef int periph_module_t;
+
+static inline void periph_module_enable(periph_module_t module)
+{
+    (void) module;
+}
+
+static inline void periph_module_disable(periph_module_t module)
+{
+    (void) module;
+}
@@ -0,0 +1,79 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * timer.h - host stand-in for the timer group driver: counters that
+ * run off the host clock at TIMER_BASE_CLK / divider, and alarms that
+ * call the registered isr (see soc/timer_group_struct.h)
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_intr_alloc.h"
+#include "soc/soc.h"
+
+#define TIMER_BASE_CLK              (80000000)      // APB_CLK_FREQ
+
+typedef enum {
+    TIMER_GROUP_0 = 0,
+    TIMER_GROUP_1,
+    TIMER_GROUP_MAX,
+} timer_group_t;
+
+typedef enum {
+    TIMER_0 = 0,
+    TIMER_1,
+    TIMER_MAX,
+} timer_idx_t;
+
+typedef enum {
+    TIMER_COUNT_DOWN = 0,
+    TIMER_COUNT_UP,
+    TIMER_COUNT_MAX,
+} timer_count_dir_t;
+
+typedef enum {
+    TIMER_PAUSE = 0,
+    TIMER_START,
+} timer_start_t;
+
+typedef enum {
+    TIMER_INTR_LEVEL = 0,
+    TIMER_INTR_MAX,
+} timer_intr_mode_t;
+
+typedef enum {
+    TIMER_ALARM_DIS = 0,
+    TIMER_ALARM_EN,
+    TIMER_ALARM_MAX,
+} timer_alarm_t;
+
+typedef enum {
+    TIMER_AUTORELOAD_DIS = 0,
+    TIMER_AUTORELOAD_EN,
+    TIMER_AUTORELOAD_MAX,
+} timer_autoreload_t;
+
+typedef struct {
+    bool alarm_en;
+    bool counter_en;
+    timer_intr_mode_t intr_type;
+    timer_count_dir_t counter_dir;
+    bool auto_reload;
+    uint32_t divider;
+} timer_config_t;
+
+typedef intr_handle_t timer_isr_handle_t;
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t idx, const timer_config_t *config);
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t idx, uint64_t value);
+esp_err_t timer_get_counter_value(timer_group_t group, timer_idx_t idx, uint64_t *value);
+esp_err_t timer_set_alarm_value(timer_group_t group, timer_idx_t idx, uint64_t value);
+esp_err_t timer_set_alarm(timer_group_t group, timer_idx_t idx, timer_alarm_t alarm_en);
+esp_err_t timer_enable_intr(timer_group_t group, timer_idx_t idx);
+esp_err_t timer_disable_intr(timer_group_t group, timer_idx_t idx);
+esp_err_t timer_isr_register(timer_group_t group, timer_idx_t idx, void (*fn)(void *arg), void *arg,
+                             int intr_alloc_flags, timer_isr_handle_t *handle);
+esp_err_t timer_start(timer_group_t group, timer_idx_t idx);
+esp_err_t timer_pause(timer_group_t group, timer_idx_t idx);
@@ -0,0 +1,30 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * uart.h - host stand-in: each port is whatever fd a test hands
+ * host_uart_attach(), typically one end of a pty
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#define HOST_UART_COUNT             (3)
+
+typedef int uart_port_t;
+
+#define UART_NUM_0                  (0)
+#define UART_NUM_1                  (1)
+#define UART_NUM_2                  (2)
+
+/*
+ * As in esp-idf v3.3: waits for 'length' bytes, giving up only when
+ * 'ticks_to_wait' passes with nothing new arriving, and returns how
+ * many it got.
+ */
+int uart_read_bytes(uart_port_t uart_num, uint8_t *buf, uint32_t length, TickType_t ticks_to_wait);
+int uart_write_bytes(uart_port_t uart_num, const char *src, size_t size);
+esp_err_t uart_flush_input(uart_port_t uart_num);
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart_num, int wakeup_threshold);
@@ -0,0 +1,357 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * driver_i2c.c - host stand-in for the esp-idf i2c master driver; see
+ * driver/i2c.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "driver/i2c.h"
+#include "host.h"
+
+#define HOST_I2C_ADDRESSES          (128)
+#define HOST_I2C_LOG_OPS            (32)
+
+typedef struct host_i2c_node {
+    struct host_i2c_node *next;
+    host_i2c_op_type_t type;
+    bool ack;                   // WRITE: check the slave's ack; READ: ack the last byte
+    uint8_t byte;               // i2c_master_write_byte() keeps its byte here...
+    uint8_t *data;              // ...everything else points at the caller's buffer
+    size_t len;
+} host_i2c_node_t;
+
+typedef struct {
+    host_i2c_node_t *first;
+    host_i2c_node_t *last;
+} host_i2c_link_t;
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool m_installed[I2C_NUM_MAX];
+static uint32_t m_clk_speed[I2C_NUM_MAX];
+static bool m_timing = false;
+static host_i2c_slave_t m_slaves[HOST_I2C_ADDRESSES];
+static bool m_attached[HOST_I2C_ADDRESSES];
+static uint32_t m_fail_count = 0;
+static esp_err_t m_fail_err = ESP_OK;
+static host_i2c_op_t m_log[HOST_I2C_LOG_OPS];
+static uint32_t m_log_count = 0;
+static host_i2c_stats_t m_stats;
+
+void host_i2c_attach(uint8_t address, const host_i2c_slave_t *slave)
+{
+    pthread_mutex_lock(&m_lock);
+    m_slaves[address & 0x7f] = *slave;
+    m_attached[address & 0x7f] = true;
+    pthread_mutex_unlock(&m_lock);
+}
+
+void host_i2c_timing(bool on)
+{
+    m_timing = on;
+}
+
+void host_i2c_detach_all(void)
+{
+    pthread_mutex_lock(&m_lock);
+    memset(m_attached, 0, sizeof(m_attached));
+    pthread_mutex_unlock(&m_lock);
+}
+
+void host_i2c_fail(uint32_t count, esp_err_t err)
+{
+    pthread_mutex_lock(&m_lock);
+    m_fail_count = count;
+    m_fail_err = err;
+    pthread_mutex_unlock(&m_lock);
+}
+
+uint32_t host_i2c_last(host_i2c_op_t *ops, uint32_t max)
+{
+    pthread_mutex_lock(&m_lock);
+    uint32_t count = m_log_count;
+    memcpy(ops, m_log, (count < max ? count : max) * sizeof(*ops));
+    pthread_mutex_unlock(&m_lock);
+
+    return count;
+}
+
+void host_i2c_get_stats(host_i2c_stats_t *stats)
+{
+    pthread_mutex_lock(&m_lock);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_lock);
+}
+
+void host_i2c_reset_stats(void)
+{
+    pthread_mutex_lock(&m_lock);
+    memset(&m_stats, 0, sizeof(m_stats));
+    pthread_mutex_unlock(&m_lock);
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf)
+{
+    if (i2c_num >= I2C_NUM_MAX || i2c_conf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    m_clk_speed[i2c_num] = i2c_conf->master.clk_speed;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len,
+                             size_t slv_tx_buf_len, int intr_alloc_flags)
+{
+    (void) mode;
+    (void) slv_rx_buf_len;
+    (void) slv_tx_buf_len;
+    (void) intr_alloc_flags;
+
+    if (i2c_num >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    m_installed[i2c_num] = true;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t i2c_num)
+{
+    if (i2c_num >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    m_installed[i2c_num] = false;
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    host_i2c_link_t *link = calloc(1, sizeof(*link));
+
+    pthread_mutex_lock(&m_lock);
+    m_stats.links++;
+    m_stats.allocations++;
+    pthread_mutex_unlock(&m_lock);
+
+    return link;
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    host_i2c_link_t *link = (host_i2c_link_t *) cmd_handle;
+    uint32_t frees = 0;
+
+    if (link == NULL) {
+        return;
+    }
+
+    for (host_i2c_node_t *node = link->first, *next; node != NULL; node = next) {
+        next = node->next;
+        free(node);
+        frees++;
+    }
+    free(link);
+
+    pthread_mutex_lock(&m_lock);
+    m_stats.frees += frees + 1;
+    pthread_mutex_unlock(&m_lock);
+}
+
+static esp_err_t link_append(i2c_cmd_handle_t cmd_handle, host_i2c_op_type_t type, bool ack,
+                             uint8_t *data, size_t len)
+{
+    host_i2c_link_t *link = (host_i2c_link_t *) cmd_handle;
+    host_i2c_node_t *node;
+
+    if (link == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    node = calloc(1, sizeof(*node));
+    if (node == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    node->type = type;
+    node->ack = ack;
+    node->data = data;
+    node->len = len;
+
+    if (link->last == NULL) {
+        link->first = node;
+    } else {
+        link->last->next = node;
+    }
+    link->last = node;
+
+    pthread_mutex_lock(&m_lock);
+    m_stats.nodes++;
+    m_stats.allocations++;
+    pthread_mutex_unlock(&m_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    return link_append(cmd_handle, HOST_I2C_START, false, NULL, 0);
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    esp_err_t ret = link_append(cmd_handle, HOST_I2C_WRITE, ack_en, NULL, 1);
+
+    if (ret == ESP_OK) {
+        host_i2c_link_t *link = (host_i2c_link_t *) cmd_handle;
+
+        link->last->byte = data;
+        link->last->data = &link->last->byte;
+    }
+    return ret;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, bool ack_en)
+{
+    if (data == NULL || data_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return link_append(cmd_handle, HOST_I2C_WRITE, ack_en, data, data_len);
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack)
+{
+    return i2c_master_read(cmd_handle, data, 1, ack);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, i2c_ack_type_t ack)
+{
+    if (data == NULL || data_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return link_append(cmd_handle, HOST_I2C_READ, (ack == I2C_MASTER_ACK), data, data_len);
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    return link_append(cmd_handle, HOST_I2C_STOP, false, NULL, 0);
+}
+
+static void log_op(const host_i2c_node_t *node)
+{
+    if (m_log_count >= HOST_I2C_LOG_OPS) {
+        return;
+    }
+
+    host_i2c_op_t *op = &m_log[m_log_count++];
+
+    op->type = node->type;
+    op->ack = node->ack;
+    op->len = node->len;
+    if (node->data != NULL) {
+        memcpy(op->data, node->data, (node->len < HOST_I2C_OP_DATA ? node->len : HOST_I2C_OP_DATA));
+    }
+}
+
+/*
+ * Plays the link against the slaves. The first byte written after a
+ * START is the address; what follows is collected and handed to the
+ * slave at the next START or STOP. Reads go to the slave straight
+ * away, into the caller's buffer, as the real driver's do.
+ */
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait)
+{
+    host_i2c_link_t *link = (host_i2c_link_t *) cmd_handle;
+    host_i2c_slave_t *slave = NULL;
+    uint8_t pending[256];
+    size_t pending_len = 0;
+    uint32_t bits = 0;
+    bool addressed = false;
+    bool reading = false;
+    esp_err_t ret = ESP_OK;
+
+    (void) ticks_to_wait;
+
+    if (i2c_num >= I2C_NUM_MAX || link == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&m_lock);
+
+    m_stats.transactions++;
+    m_log_count = 0;
+
+    if (!m_installed[i2c_num]) {
+        pthread_mutex_unlock(&m_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (m_fail_count > 0) {
+        m_fail_count--;
+        pthread_mutex_unlock(&m_lock);
+        return m_fail_err;
+    }
+
+    for (host_i2c_node_t *node = link->first; node != NULL && ret == ESP_OK; node = node->next) {
+        size_t offset = 0;
+
+        switch (node->type) {
+
+        case HOST_I2C_START:
+        case HOST_I2C_STOP:
+            if (slave != NULL && !reading && pending_len > 0 && slave->write != NULL) {
+                ret = slave->write(slave->ctx, pending, pending_len);
+            }
+            slave = NULL;
+            addressed = (node->type == HOST_I2C_START);
+            pending_len = 0;
+            break;
+
+        case HOST_I2C_WRITE:
+            if (addressed && slave == NULL) {
+                uint8_t address = node->data[0] >> 1;
+
+                if (!m_attached[address]) {
+                    ret = (node->ack ? ESP_FAIL : ESP_OK);
+                    break;
+                }
+                slave = &m_slaves[address];
+                reading = (node->data[0] & 1) == I2C_MASTER_READ;
+                offset = 1;
+            }
+            if (slave == NULL || reading) {
+                ret = (slave == NULL && node->ack ? ESP_FAIL : ESP_OK);
+                break;
+            }
+            if (pending_len + node->len - offset > sizeof(pending)) {
+                ret = ESP_ERR_INVALID_SIZE;
+                break;
+            }
+            memcpy(&pending[pending_len], node->data + offset, node->len - offset);
+            pending_len += node->len - offset;
+            break;
+
+        case HOST_I2C_READ:
+            if (slave == NULL || !reading) {
+                ret = ESP_FAIL;
+                break;
+            }
+            ret = (slave->read != NULL ? slave->read(slave->ctx, node->data, node->len) : ESP_FAIL);
+            break;
+        }
+
+        log_op(node);
+        bits += (node->type == HOST_I2C_START || node->type == HOST_I2C_STOP ? 1 : 9 * node->len);
+    }
+
+    bool timed = (m_timing && m_clk_speed[i2c_num] > 0);
+
+    pthread_mutex_unlock(&m_lock);
+
+    // Outside the lock, since on the simulator's clock other events run in the meantime:
+    if (timed) {
+        host_sleep_usec(((int64_t) bits * 1000000 + m_clk_speed[i2c_num] - 1) / m_clk_speed[i2c_num]);
+    }
+    return ret;
+}
@@ -0,0 +1,118 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * driver_uart.c - host stand-in for the esp-idf uart driver; see
+ * driver/uart.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "driver/uart.h"
+#include "host.h"
+
+static int m_fds[HOST_UART_COUNT] = { -1, -1, -1 };
+static uint32_t m_baud[HOST_UART_COUNT];
+
+void host_uart_attach(int uart, int fd)
+{
+    if (uart >= 0 && uart < HOST_UART_COUNT) {
+        m_fds[uart] = fd;
+    }
+}
+
+void host_uart_baud(int uart, uint32_t baud)
+{
+    if (uart >= 0 && uart < HOST_UART_COUNT) {
+        m_baud[uart] = baud;
+    }
+}
+
+static int uart_fd(uart_port_t uart_num)
+{
+    return (uart_num >= 0 && uart_num < HOST_UART_COUNT ? m_fds[uart_num] : -1);
+}
+
+int uart_read_bytes(uart_port_t uart_num, uint8_t *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    int fd = uart_fd(uart_num);
+    int timeout = (ticks_to_wait == portMAX_DELAY ? -1 : (int)(ticks_to_wait * portTICK_PERIOD_MS));
+    uint32_t got = 0;
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    while (got < length) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, timeout);
+
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0 || !(pfd.revents & POLLIN)) {
+            break;
+        }
+
+        ssize_t n = read(fd, &buf[got], length - got);
+
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    return got;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const char *src, size_t size)
+{
+    int fd = uart_fd(uart_num);
+    size_t done = 0;
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    while (done < size) {
+        ssize_t n = write(fd, &src[done], size - done);
+
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        done += n;
+    }
+
+    if (m_baud[uart_num] > 0) {
+        host_sleep_usec(((int64_t) size * 10 * 1000000 + m_baud[uart_num] - 1) / m_baud[uart_num]);
+    }
+    return done;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num)
+{
+    int fd = uart_fd(uart_num);
+    uint8_t discard[64];
+
+    if (fd < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+        if (read(fd, discard, sizeof(discard)) <= 0) {
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart_num, int wakeup_threshold)
+{
+    return (uart_num >= 0 && uart_num < HOST_UART_COUNT && wakeup_threshold > 2 ? ESP_OK : ESP_ERR_INVALID_ARG);
+}
@@ -0,0 +1,147 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * esp.c - host stand-ins for the clock, heap and delay functions
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+#include "rom/rtc.h"
+#include "esp_timer.h"
+#include "rom/ets_sys.h"
+#include "sdkconfig.h"
+#include "host_alarm.h"
+#include "host.h"
+
+#define HOST_DEFAULT_FREE_HEAP      (160 * 1024)
+
+static volatile bool m_virtual = false;
+static volatile int64_t m_virtual_usec = 0;
+static void (*m_advance_hook)(int64_t usec) = NULL;
+static uint32_t m_free_heap = HOST_DEFAULT_FREE_HEAP;
+static uint32_t m_min_free_heap = HOST_DEFAULT_FREE_HEAP;
+static esp_log_level_t m_log_level = ESP_LOG_INFO;
+static RESET_REASON m_reset_reason = POWERON_RESET;
+
+void host_clock_virtual(int64_t usec)
+{
+    m_virtual_usec = usec;
+    m_virtual = true;
+}
+
+void host_clock_advance(int64_t usec)
+{
+    if (m_advance_hook != NULL) {
+        m_advance_hook(usec);
+        return;
+    }
+    host_alarm_advance(host_time_usec() + usec);
+}
+
+void host_clock_hook(void (*advance)(int64_t usec))
+{
+    m_advance_hook = advance;
+}
+
+bool host_clock_is_virtual(void)
+{
+    return m_virtual;
+}
+
+int64_t host_time_usec(void)
+{
+    if (m_virtual) {
+        return __atomic_load_n(&m_virtual_usec, __ATOMIC_SEQ_CST);
+    }
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void host_sleep_usec(int64_t usec)
+{
+    if (usec <= 0) {
+        return;
+    }
+
+    if (m_virtual) {
+        host_clock_advance(usec);
+        return;
+    }
+
+    struct timespec delay = {
+        .tv_sec = usec / 1000000,
+        .tv_nsec = (usec % 1000000) * 1000,
+    };
+    nanosleep(&delay, NULL);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return host_time_usec();
+}
+
+void ets_delay_us(uint32_t us)
+{
+    host_sleep_usec(us);
+}
+
+void host_heap_set(uint32_t free_bytes)
+{
+    m_free_heap = free_bytes;
+    if (free_bytes < m_min_free_heap) {
+        m_min_free_heap = free_bytes;
+    }
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return m_free_heap;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return m_min_free_heap;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void) tag;
+    m_log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list args;
+
+    (void) tag;
+    if (level > m_log_level) {
+        return;
+    }
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(host_time_usec() / 1000);
+}
+
+void host_reset_reason_set(int reason)
+{
+    m_reset_reason = reason;
+}
+
+RESET_REASON rtc_get_reset_reason(int cpu_no)
+{
+    (void) cpu_no;
+    return m_reset_reason;
+}
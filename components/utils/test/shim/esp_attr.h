@@ -0,0 +1,11 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * esp_attr.h - host stand-in: there's only one kind of memory here
+ */
+
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
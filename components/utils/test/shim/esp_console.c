@@ -0,0 +1,60 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * esp_console.c - host stand-in for the esp-idf console's command
+ * table; see esp_console.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_console.h"
+
+static esp_console_cmd_t m_commands[HOST_CONSOLE_COMMANDS_MAX];
+static size_t m_count = 0;
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd)
+{
+    if (cmd == NULL || cmd->command == NULL || strchr(cmd->command, ' ') != NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t i = 0; i < m_count; i++) {
+        if (strcmp(m_commands[i].command, cmd->command) == 0) {
+            m_commands[i] = *cmd;
+            return ESP_OK;
+        }
+    }
+
+    if (m_count == HOST_CONSOLE_COMMANDS_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    m_commands[m_count++] = *cmd;
+    return ESP_OK;
+}
+
+esp_err_t esp_console_run(const char *cmdline, int *cmd_ret)
+{
+    char line[256];
+    char *argv[HOST_CONSOLE_ARGS_MAX];
+    int argc = 0;
+
+    snprintf(line, sizeof(line), "%s", cmdline);
+
+    // Plain whitespace splitting; nothing here needs quotes:
+    for (char *save, *arg = strtok_r(line, " \t\r\n", &save);
+         arg != NULL && argc < HOST_CONSOLE_ARGS_MAX;
+         arg = strtok_r(NULL, " \t\r\n", &save)) {
+        argv[argc++] = arg;
+    }
+    if (argc == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t i = 0; i < m_count; i++) {
+        if (strcmp(m_commands[i].command, argv[0]) == 0) {
+            *cmd_ret = m_commands[i].func(argc, argv);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
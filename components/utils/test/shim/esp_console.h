@@ -0,0 +1,32 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * esp_console.h - host stand-in: registration and dispatch, without
+ * argtable's help or hints
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#define HOST_CONSOLE_COMMANDS_MAX   (48)
+#define HOST_CONSOLE_ARGS_MAX       (8)
+
+typedef int (*esp_console_cmd_func_t)(int argc, char **argv);
+
+typedef struct {
+    const char *command;
+    const char *help;
+    const char *hint;
+    esp_console_cmd_func_t func;
+    void *argtable;
+} esp_console_cmd_t;
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd);
+
+/*
+ * As in esp-idf: ESP_ERR_INVALID_ARG for a line with nothing on it,
+ * ESP_ERR_NOT_FOUND for a command nobody registered, otherwise ESP_OK
+ * with the command's own return value in *cmd_ret.
+ */
+esp_err_t esp_console_run(const char *cmdline, int *cmd_ret);
@@ -0,0 +1,16 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * esp_freertos_hooks.h - host stand-in: there's no idle task to call
+ * the hooks, so a test calls them itself (see host_idle_hooks_run())
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef bool (*esp_freertos_idle_cb_t)(void);
+
+esp_err_t esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t new_idle_cb, int cpuid);
+esp_err_t esp_register_freertos_idle_hook(esp_freertos_idle_cb_t new_idle_cb);
+void esp_deregister_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t old_idle_cb, int cpuid);
@@ -0,0 +1,11 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * esp_intr_alloc.h - host stand-in
+ */
+
+#pragma once
+
+#define ESP_INTR_FLAG_LEVEL1        (1 << 1)
+#define ESP_INTR_FLAG_IRAM          (1 << 10)
+
+typedef struct intr_handle_data_t *intr_handle_t;
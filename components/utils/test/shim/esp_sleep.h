@@ -0,0 +1,31 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * esp_sleep.h - host stand-in: the chip never sleeps, the wakeup
+ * sources are only recorded, and the wakeup cause is whatever the
+ * test says it is (see host_sleep_wakeup())
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_SLEEP_WAKEUP_UNDEFINED,
+    ESP_SLEEP_WAKEUP_ALL,
+    ESP_SLEEP_WAKEUP_EXT0,
+    ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER,
+    ESP_SLEEP_WAKEUP_TOUCHPAD,
+    ESP_SLEEP_WAKEUP_ULP,
+    ESP_SLEEP_WAKEUP_GPIO,
+    ESP_SLEEP_WAKEUP_UART,
+} esp_sleep_source_t;
+
+typedef esp_sleep_source_t esp_sleep_wakeup_cause_t;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+esp_err_t esp_sleep_enable_gpio_wakeup(void);
+esp_err_t esp_sleep_enable_uart_wakeup(int uart_num);
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source);
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void);
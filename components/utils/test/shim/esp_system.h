@@ -0,0 +1,13 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * esp_system.h - host stand-in; the free heap is whatever the test
+ * says it is (see host_heap_set())
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
@@ -0,0 +1,19 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * esp_task_wdt.h - host stand-in: a subscribed task that goes longer
+ * than CONFIG_TASK_WDT_TIMEOUT_S between resets is counted, not
+ * panicked (see host_task_wdt_timeouts())
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+esp_err_t esp_task_wdt_init(uint32_t timeout, bool panic);
+esp_err_t esp_task_wdt_add(TaskHandle_t handle);
+esp_err_t esp_task_wdt_delete(TaskHandle_t handle);
+esp_err_t esp_task_wdt_reset(void);
+esp_err_t esp_task_wdt_status(TaskHandle_t handle);
@@ -0,0 +1,81 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * esp_timer.c - host stand-in for esp_timer, on the shim's alarm list
+ */
+
+#include <stdlib.h>
+
+#include "esp_timer.h"
+#include "host_alarm.h"
+#include "host.h"
+
+struct esp_timer {
+    host_alarm_t alarm;
+    const char *name;
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    if (args == NULL || args->callback == NULL || handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->alarm.fn = args->callback;
+    timer->alarm.arg = args->arg;
+    timer->alarm.source = HOST_ALARM_ESP_TIMER;
+    timer->name = args->name;
+
+    *handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (host_alarm_armed(&timer->alarm)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(timer);
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t usec, bool periodic)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (host_alarm_armed(&timer->alarm)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_alarm_start(&timer->alarm, host_time_usec() + (int64_t) usec, (periodic ? (int64_t) usec : 0));
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return (period_us == 0 ? ESP_ERR_INVALID_ARG : timer_start(timer, period_us, true));
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!host_alarm_armed(&timer->alarm)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_alarm_stop(&timer->alarm);
+    return ESP_OK;
+}
@@ -0,0 +1,680 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * freertos.c - host stand-in for FreeRTOS tasks, notifications, queues
+ * and semaphores, on pthreads
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "host.h"
+
+// How long a wait on a virtual clock gives other tasks to move it, in real time:
+#define HOST_VIRTUAL_POLL_USEC      (1000)
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t number;
+    UBaseType_t priority;
+    BaseType_t core;
+    uint32_t stack;
+    void *sched;                // the scheduler's, if one's hooked in
+    bool listed;                // in m_tasks, for uxTaskGetSystemState()
+    struct host_task *next;
+
+    pthread_mutex_t notify_lock;
+    pthread_cond_t notified;
+    uint32_t notify_value;
+    bool notify_pending;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint32_t length;
+    uint32_t item_size;
+    uint32_t count;
+    uint32_t head;
+    bool mutex;
+    struct host_task *holder;
+    uint32_t recursion;
+    uint8_t items[];
+};
+
+static pthread_once_t m_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t m_critical;
+static pthread_mutex_t m_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct host_task *m_tasks = NULL;
+static UBaseType_t m_task_count = 0;
+static UBaseType_t m_next_number = 1;
+static struct host_task m_idle[portNUM_PROCESSORS];
+static __thread struct host_task *m_current = NULL;
+static const host_sched_t *m_sched = NULL;
+
+static void cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void task_init(struct host_task *task, const char *name, UBaseType_t priority, BaseType_t core)
+{
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->priority = priority;
+    task->core = core;
+    pthread_mutex_init(&task->notify_lock, NULL);
+    cond_init(&task->notified);
+}
+
+static void shim_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&m_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    // The idle tasks never run here, but they're listed as they would be:
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+        char name[configMAX_TASK_NAME_LEN];
+
+        snprintf(name, sizeof(name), "IDLE%d", cpu);
+        task_init(&m_idle[cpu], name, tskIDLE_PRIORITY, cpu);
+        m_idle[cpu].number = m_next_number++;
+    }
+}
+
+void host_critical_enter(void)
+{
+    pthread_once(&m_once, shim_init);
+    pthread_mutex_lock(&m_critical);
+}
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&m_critical);
+}
+
+void host_sched_hook(const host_sched_t *sched)
+{
+    m_sched = sched;
+}
+
+int xPortGetCoreID(void)
+{
+    return 0;
+}
+
+/*
+ * Waits with 'lock' held until ready(ctx), or 'wait' ticks go by
+ * (false). Whoever makes it ready broadcasts 'cond' under 'lock'.
+ */
+static bool host_wait(pthread_mutex_t *lock, pthread_cond_t *cond, bool (*ready)(void *ctx), void *ctx,
+                      TickType_t wait)
+{
+    int64_t deadline = host_time_usec() + (int64_t) wait * portTICK_PERIOD_MS * 1000;
+    int64_t polled_at = 0;
+    bool polled = false;
+
+    // The scheduler says when we run again, which may be before we're ready (another took the item, say):
+    if (m_sched != NULL) {
+        while (!ready(ctx)) {
+            if (wait != portMAX_DELAY && host_time_usec() >= deadline) {
+                return false;
+            }
+            pthread_mutex_unlock(lock);
+            m_sched->wait(ready, ctx, (wait == portMAX_DELAY ? INT64_MAX : deadline));
+            pthread_mutex_lock(lock);
+        }
+        return true;
+    }
+
+    while (!ready(ctx)) {
+        if (wait == portMAX_DELAY) {
+            pthread_cond_wait(cond, lock);
+            continue;
+        }
+
+        int64_t now = host_time_usec();
+        int64_t left = deadline - now;
+
+        if (left <= 0) {
+            return false;
+        }
+
+        /*
+         * A virtual clock only moves when someone waits. Give the other
+         * tasks a moment of real time to answer; if none of them has
+         * moved the clock or made us ready by then, we're the only one
+         * waiting, so jump to the deadline as an event-driven
+         * simulation would. Whatever the clock runs on the way (timer
+         * callbacks, say) may need the lock.
+         */
+        if (host_clock_is_virtual()) {
+            if (polled && now == polled_at) {
+                pthread_mutex_unlock(lock);
+                host_clock_advance(left);
+                pthread_mutex_lock(lock);
+                continue;
+            }
+            polled = true;
+            polled_at = now;
+            left = HOST_VIRTUAL_POLL_USEC;
+        }
+
+        struct timespec until;
+
+        clock_gettime(CLOCK_MONOTONIC, &until);
+        until.tv_sec += left / 1000000;
+        until.tv_nsec += (left % 1000000) * 1000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(cond, lock, &until);
+    }
+
+    return true;
+}
+
+static void *task_entry(void *p)
+{
+    struct host_task *task = (struct host_task *) p;
+
+    m_current = task;
+    if (task->sched != NULL) {
+        m_sched->start(task->sched);
+    }
+    task->fn(task->arg);
+
+    fprintf(stderr, "%s(): task %s returned without deleting itself\n", __func__, task->name);
+    abort();
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+
+    if (task == NULL) {
+        return pdFAIL;
+    }
+
+    pthread_once(&m_once, shim_init);
+    task_init(task, name, priority, core);
+    task->fn = fn;
+    task->arg = arg;
+    task->stack = stack_depth;
+
+    pthread_mutex_lock(&m_tasks_lock);
+    task->number = m_next_number++;
+    task->listed = true;
+    task->next = m_tasks;
+    m_tasks = task;
+    m_task_count++;
+    pthread_mutex_unlock(&m_tasks_lock);
+
+    if (handle != NULL) {
+        *handle = task;
+    }
+    if (m_sched != NULL) {
+        task->sched = m_sched->create(task->name, priority);
+    }
+
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0) {
+        vTaskDelete(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+
+    return pdPASS;
+}
+
+static void task_unlist(struct host_task *task)
+{
+    pthread_mutex_lock(&m_tasks_lock);
+    for (struct host_task **p = &m_tasks; *p != NULL; p = &(*p)->next) {
+        if (*p == task) {
+            *p = task->next;
+            task->listed = false;
+            m_task_count--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_tasks_lock);
+}
+
+// The handle stays allocated: anyone still holding it may yet notify it
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL) {
+        task = m_current;
+    }
+    if (task != NULL && task->thread != 0 && task != m_current) {
+        fprintf(stderr, "%s(): can only delete the calling task here\n", __func__);
+        abort();
+    }
+    if (task != NULL) {
+        task_unlist(task);
+        if (task->thread == 0) {
+            return;         // it never got a thread
+        }
+    }
+    if (task != NULL && task->sched != NULL) {
+        m_sched->exit();
+    }
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host_sleep_usec((int64_t) ticks * portTICK_PERIOD_MS * 1000);
+}
+
+// As in FreeRTOS, a wake time already past returns at once and the next one stays on the grid:
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment)
+{
+    *previous_wake += increment;
+    host_sleep_usec((int64_t) *previous_wake * portTICK_PERIOD_MS * 1000 - host_time_usec());
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_time_usec() / (portTICK_PERIOD_MS * 1000));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // Threads that weren't created as tasks (main, to begin with) get a handle the first time they ask:
+    if (m_current == NULL) {
+        m_current = calloc(1, sizeof(*m_current));
+        task_init(m_current, "host", tskIDLE_PRIORITY + 1, tskNO_AFFINITY);
+        m_current->thread = pthread_self();
+    }
+    return m_current;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->priority;
+}
+
+BaseType_t xTaskGetAffinity(TaskHandle_t task)
+{
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->core;
+}
+
+char *pcTaskGetTaskName(TaskHandle_t task)
+{
+    return (task != NULL ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    pthread_mutex_lock(&m_tasks_lock);
+    UBaseType_t count = m_task_count + portNUM_PROCESSORS;
+    pthread_mutex_unlock(&m_tasks_lock);
+
+    return count;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu)
+{
+    pthread_once(&m_once, shim_init);
+    return (cpu < portNUM_PROCESSORS ? &m_idle[cpu] : NULL);
+}
+
+static uint32_t task_run_time(const struct host_task *task)
+{
+    clockid_t clock;
+    struct timespec used;
+
+    if (pthread_getcpuclockid(task->thread, &clock) != 0 || clock_gettime(clock, &used) != 0) {
+        return 0;
+    }
+    return (uint32_t)((int64_t) used.tv_sec * 1000000 + used.tv_nsec / 1000);
+}
+
+static void task_status(const struct host_task *task, uint32_t run_time, TaskStatus_t *status)
+{
+    status->xHandle = (TaskHandle_t) task;
+    status->pcTaskName = task->name;
+    status->xTaskNumber = task->number;
+    status->eCurrentState = (task == m_current ? eRunning : eBlocked);
+    status->uxCurrentPriority = task->priority;
+    status->uxBasePriority = task->priority;
+    status->ulRunTimeCounter = run_time;
+    status->pxStackBase = NULL;
+    status->usStackHighWaterMark = task->stack;
+    status->xCoreID = task->core;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t size, uint32_t *total_run_time)
+{
+    uint32_t total = (uint32_t) host_time_usec();
+    uint32_t pinned[portNUM_PROCESSORS] = { 0 };
+    UBaseType_t count = 0;
+
+    pthread_once(&m_once, shim_init);
+    pthread_mutex_lock(&m_tasks_lock);
+    if (size < m_task_count + portNUM_PROCESSORS) {
+        pthread_mutex_unlock(&m_tasks_lock);
+        return 0;
+    }
+
+    for (struct host_task *task = m_tasks; task != NULL; task = task->next) {
+        uint32_t run_time = task_run_time(task);
+
+        pinned[task->core == tskNO_AFFINITY ? 0 : task->core % portNUM_PROCESSORS] += run_time;
+        task_status(task, run_time, &status[count++]);
+    }
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+        task_status(&m_idle[cpu], (pinned[cpu] < total ? total - pinned[cpu] : 0), &status[count++]);
+    }
+    pthread_mutex_unlock(&m_tasks_lock);
+
+    if (total_run_time != NULL) {
+        *total_run_time = total;
+    }
+    return count;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    BaseType_t ret = pdPASS;
+
+    pthread_mutex_lock(&task->notify_lock);
+    switch (action) {
+    case eNoAction:
+        break;
+    case eSetBits:
+        task->notify_value |= value;
+        break;
+    case eIncrement:
+        task->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify_value = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (task->notify_pending) {
+            ret = pdFAIL;
+        } else {
+            task->notify_value = value;
+        }
+        break;
+    }
+    if (ret == pdPASS) {
+        task->notify_pending = true;
+        pthread_cond_broadcast(&task->notified);
+    }
+    pthread_mutex_unlock(&task->notify_lock);
+
+    return ret;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+    if (woken != NULL) {
+        *woken = pdFALSE;
+    }
+    return xTaskNotify(task, value, action);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyFromISR(task, 0, eIncrement, woken);
+}
+
+static bool notify_pending(void *ctx)
+{
+    return ((struct host_task *) ctx)->notify_pending;
+}
+
+static bool notify_nonzero(void *ctx)
+{
+    return ((struct host_task *) ctx)->notify_value != 0;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t wait)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&task->notify_lock);
+    if (!task->notify_pending) {
+        task->notify_value &= ~clear_on_entry;
+    }
+    if (host_wait(&task->notify_lock, &task->notified, notify_pending, task, wait)) {
+        ret = pdTRUE;
+    }
+    if (value != NULL) {
+        *value = task->notify_value;
+    }
+    if (ret == pdTRUE) {
+        task->notify_value &= ~clear_on_exit;
+    }
+    task->notify_pending = false;
+    pthread_mutex_unlock(&task->notify_lock);
+
+    return ret;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+
+    pthread_mutex_lock(&task->notify_lock);
+    host_wait(&task->notify_lock, &task->notified, notify_nonzero, task, wait);
+
+    uint32_t value = task->notify_value;
+
+    if (value != 0) {
+        task->notify_value = (clear ? 0 : value - 1);
+    }
+    task->notify_pending = false;
+    pthread_mutex_unlock(&task->notify_lock);
+
+    return value;
+}
+
+static struct host_queue *queue_create(uint32_t length, uint32_t item_size, uint32_t count)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue) + (size_t) length * item_size);
+
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&queue->lock, NULL);
+    cond_init(&queue->changed);
+
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->count = count;
+
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return (length == 0 ? NULL : queue_create(length, item_size, 0));
+}
+
+QueueHandle_t host_queue_create_full(UBaseType_t length, UBaseType_t count)
+{
+    return (length == 0 || count > length ? NULL : queue_create(length, 0, count));
+}
+
+QueueHandle_t host_queue_create_mutex(bool recursive)
+{
+    struct host_queue *queue = queue_create(1, 0, 1);
+
+    (void) recursive;           // the recursion count is only used by the *_recursive() calls
+    if (queue != NULL) {
+        queue->mutex = true;
+    }
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue != NULL) {
+        pthread_cond_destroy(&queue->changed);
+        pthread_mutex_destroy(&queue->lock);
+        free(queue);
+    }
+}
+
+static bool queue_has_room(void *ctx)
+{
+    struct host_queue *queue = (struct host_queue *) ctx;
+
+    return queue->count < queue->length;
+}
+
+static bool queue_has_item(void *ctx)
+{
+    return ((struct host_queue *) ctx)->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    if (!host_wait(&queue->lock, &queue->changed, queue_has_room, queue, wait)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+
+    if (queue->item_size != 0) {
+        uint32_t slot = (queue->head + queue->count) % queue->length;
+
+        memcpy(&queue->items[slot * queue->item_size], item, queue->item_size);
+    }
+    queue->count++;
+    queue->holder = NULL;
+
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    if (!host_wait(&queue->lock, &queue->changed, queue_has_item, queue, wait)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+
+    if (queue->item_size != 0) {
+        memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    if (queue->mutex) {
+        queue->holder = xTaskGetCurrentTaskHandle();
+    }
+
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken)
+{
+    if (woken != NULL) {
+        *woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->item_size != 0) {
+        memcpy(&queue->items[queue->head * queue->item_size], item, queue->item_size);
+    }
+    queue->count = 1;
+
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+
+    return count;
+}
+
+BaseType_t host_queue_take_recursive(QueueHandle_t mutex, TickType_t wait)
+{
+    struct host_task *self = xTaskGetCurrentTaskHandle();
+
+    pthread_mutex_lock(&mutex->lock);
+    if (mutex->holder == self) {
+        mutex->recursion++;
+        pthread_mutex_unlock(&mutex->lock);
+        return pdTRUE;
+    }
+    pthread_mutex_unlock(&mutex->lock);
+
+    if (xQueueReceive(mutex, NULL, wait) != pdTRUE) {
+        return pdFALSE;
+    }
+
+    // No one else can change it while we hold it:
+    mutex->recursion = 1;
+    return pdTRUE;
+}
+
+BaseType_t host_queue_give_recursive(QueueHandle_t mutex)
+{
+    struct host_task *self = xTaskGetCurrentTaskHandle();
+
+    pthread_mutex_lock(&mutex->lock);
+    if (mutex->holder != self) {
+        pthread_mutex_unlock(&mutex->lock);
+        return pdFAIL;
+    }
+    bool release = (--mutex->recursion == 0);
+    pthread_mutex_unlock(&mutex->lock);
+
+    return (release ? xQueueSend(mutex, NULL, 0) : pdPASS);
+}
+
+void *host_queue_holder(QueueHandle_t mutex)
+{
+    pthread_mutex_lock(&mutex->lock);
+    void *holder = mutex->holder;
+    pthread_mutex_unlock(&mutex->lock);
+
+    return holder;
+}
@@ -0,0 +1,64 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * FreeRTOS.h - host stand-in for the parts of FreeRTOS (esp-idf's SMP
+ * port) the portable code uses, on pthreads.
+ *
+ * Every critical section takes the same recursive lock, which is as
+ * close as a host gets to interrupts masked on both cores.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>             // esp-idf's FreeRTOSConfig.h brings it in, and some of the code counts on that
+
+#include "sdkconfig.h"
+#include "esp_attr.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portBASE_TYPE               int
+
+#define pdTRUE                      ((BaseType_t) 1)
+#define pdFALSE                     ((BaseType_t) 0)
+#define pdPASS                      pdTRUE
+#define pdFAIL                      pdFALSE
+
+#define portMAX_DELAY               ((TickType_t) 0xffffffffUL)
+#define configTICK_RATE_HZ          CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS          ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS            portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#define configTASKLIST_INCLUDE_COREID   CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+#define configGENERATE_RUN_TIME_STATS   CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+
+#if CONFIG_FREERTOS_UNICORE
+#define portNUM_PROCESSORS          1
+#else
+#define portNUM_PROCESSORS          2
+#endif
+
+typedef struct {
+    uint32_t unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+
+void host_critical_enter(void);
+void host_critical_exit(void);
+
+#define portENTER_CRITICAL(mux)         ((void)(mux), host_critical_enter())
+#define portEXIT_CRITICAL(mux)          ((void)(mux), host_critical_exit())
+#define portENTER_CRITICAL_ISR(mux)     portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux)      portEXIT_CRITICAL(mux)
+#define portENTER_CRITICAL_NESTED()     (host_critical_enter(), 0u)
+#define portEXIT_CRITICAL_NESTED(state) ((void)(state), host_critical_exit())
+#define portYIELD_FROM_ISR()
+
+// Every task runs on "core 0"; the host has no notion of pinning
+int xPortGetCoreID(void);
@@ -0,0 +1,9 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * portmacro.h - host stand-in; the port's types and macros are all in
+ * FreeRTOS.h here
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
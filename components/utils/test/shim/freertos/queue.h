@@ -0,0 +1,34 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * queue.h - host stand-in; semaphores (semphr.h) are queues too, with
+ * zero-sized items, as they are in FreeRTOS
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue *QueueHandle_t;
+typedef QueueHandle_t xQueueHandle;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item);      // length 1 queues only
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#define xQueueSendToBack            xQueueSend
+#define xQueueOverwriteFromISR(queue, item, woken) \
+    ((woken) != NULL ? (void)(*(BaseType_t *)(woken) = pdFALSE) : (void) 0, xQueueOverwrite((queue), (item)))
+
+// For semphr.h: 'count' of 'length' items already in the queue
+QueueHandle_t host_queue_create_full(UBaseType_t length, UBaseType_t count);
+
+// For semphr.h: a mutex, which keeps track of its holder (and, if 'recursive', how many takes it owes)
+QueueHandle_t host_queue_create_mutex(bool recursive);
+BaseType_t host_queue_take_recursive(QueueHandle_t mutex, TickType_t wait);
+BaseType_t host_queue_give_recursive(QueueHandle_t mutex);
+void *host_queue_holder(QueueHandle_t mutex);
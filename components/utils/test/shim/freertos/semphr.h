@@ -0,0 +1,26 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * semphr.h - host stand-in; a mutex is a binary semaphore that starts
+ * out given and remembers who took it (there's no priority
+ * inheritance)
+ */
+
+#pragma once
+
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#define xSemaphoreCreateBinary()                    host_queue_create_full(1, 0)
+#define xSemaphoreCreateCounting(max, initial)      host_queue_create_full((max), (initial))
+#define xSemaphoreCreateMutex()                     host_queue_create_mutex(false)
+#define xSemaphoreCreateRecursiveMutex()            host_queue_create_mutex(true)
+#define vSemaphoreDelete(sem)                       vQueueDelete(sem)
+
+#define xSemaphoreTake(sem, wait)                   xQueueReceive((sem), NULL, (wait))
+#define xSemaphoreGive(sem)                         xQueueSend((sem), NULL, 0)
+#define xSemaphoreGiveFromISR(sem, woken)           xQueueSendFromISR((sem), NULL, (woken))
+#define xSemaphoreTakeRecursive(mutex, wait)        host_queue_take_recursive((mutex), (wait))
+#define xSemaphoreGiveRecursive(mutex)              host_queue_give_recursive(mutex)
+#define xSemaphoreGetMutexHolder(mutex)             ((TaskHandle_t) host_queue_holder(mutex))
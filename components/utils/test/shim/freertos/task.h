@@ -0,0 +1,81 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * task.h - host stand-in: a task is a detached pthread. Priorities
+ * and cores are recorded (and reported back) but not honored; the
+ * simulator (sim.h) is what runs tasks in priority order.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+#define tskNO_AFFINITY              (0x7fffffff)
+#define tskIDLE_PRIORITY            ((UBaseType_t) 0)
+#define configMAX_PRIORITIES        (25)
+#define configMAX_TASK_NAME_LEN     (16)
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core);
+
+#define xTaskCreate(fn, name, stack_depth, arg, priority, handle) \
+    xTaskCreatePinnedToCore((fn), (name), (stack_depth), (arg), (priority), (handle), tskNO_AFFINITY)
+
+void vTaskDelete(TaskHandle_t task);            // only ever the calling task (or NULL)
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+BaseType_t xTaskGetAffinity(TaskHandle_t task);
+char *pcTaskGetTaskName(TaskHandle_t task);
+UBaseType_t uxTaskGetNumberOfTasks(void);
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu);
+
+typedef enum {
+    eNoAction = 0,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t wait);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+
+#define xTaskNotifyGive(task)       xTaskNotify((task), 0, eIncrement)
+
+typedef enum {
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+} eTaskState;
+
+/*
+ * Run times are in microseconds of the thread's cpu time (as with
+ * CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER), and each idle
+ * task gets whatever its core's pinned tasks didn't use. Tasks that
+ * weren't created with xTaskCreate*() (main, say) aren't listed.
+ */
+typedef struct {
+    TaskHandle_t xHandle;
+    const char *pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    uint32_t ulRunTimeCounter;
+    void *pxStackBase;
+    uint32_t usStackHighWaterMark;
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t size, uint32_t *total_run_time);
@@ -0,0 +1,39 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * timers.h - host stand-in for FreeRTOS software timers. Commands take
+ * effect at once rather than through the timer service task's queue,
+ * so their 'wait' never matters; callbacks run one at a time, as they
+ * would in that task.
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_timer *TimerHandle_t;
+typedef TimerHandle_t xTimerHandle;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait);     // starts it too
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+
+#define xTimerStartFromISR(timer, woken)                host_timer_from_isr(xTimerStart((timer), 0), (woken))
+#define xTimerStopFromISR(timer, woken)                 host_timer_from_isr(xTimerStop((timer), 0), (woken))
+#define xTimerResetFromISR(timer, woken)                host_timer_from_isr(xTimerReset((timer), 0), (woken))
+#define xTimerChangePeriodFromISR(timer, period, woken) \
+    host_timer_from_isr(xTimerChangePeriod((timer), (period), 0), (woken))
+
+static inline BaseType_t host_timer_from_isr(BaseType_t ret, BaseType_t *woken)
+{
+    if (woken != NULL) {
+        *woken = pdFALSE;
+    }
+    return ret;
+}
@@ -0,0 +1,249 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * gpio.c - host stand-in for the gpio driver, the ROM's register reads
+ * and the per-pin registers
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "rom/gpio.h"
+#include "soc/gpio_struct.h"
+#include "host.h"
+
+// A level interrupt that's still asserted after this many goes is left for the next change:
+#define HOST_GPIO_LEVEL_REPEATS     (16)
+
+typedef struct {
+    gpio_isr_t handler;
+    void *arg;
+} gpio_handler_t;
+
+gpio_dev_t GPIO;
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t m_levels[HOST_GPIO_COUNT];
+static bool m_set[HOST_GPIO_COUNT];
+static gpio_handler_t m_handlers[HOST_GPIO_COUNT];
+static bool m_service = false;
+static void (*m_watch)(int gpio, uint32_t level, void *ctx) = NULL;
+static void *m_watch_ctx = NULL;
+
+static inline bool gpio_valid(gpio_num_t gpio)
+{
+    return (gpio >= 0 && gpio < HOST_GPIO_COUNT);
+}
+
+uint32_t host_gpio_level(int gpio)
+{
+    if (!gpio_valid(gpio)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    uint32_t level = (m_set[gpio] ? m_levels[gpio] : 1);
+    pthread_mutex_unlock(&m_lock);
+
+    return level;
+}
+
+static bool gpio_int_due(gpio_int_type_t type, uint32_t was, uint32_t level)
+{
+    switch (type) {
+    case GPIO_INTR_POSEDGE:
+        return (!was && level);
+    case GPIO_INTR_NEGEDGE:
+        return (was && !level);
+    case GPIO_INTR_ANYEDGE:
+        return (was != level);
+    case GPIO_INTR_LOW_LEVEL:
+        return !level;
+    case GPIO_INTR_HIGH_LEVEL:
+        return level;
+    default:
+        return false;
+    }
+}
+
+/*
+ * The isr service runs the pin's handler with interrupts masked (the
+ * critical section lock). A level interrupt goes on firing for as
+ * long as the level holds, as it would on the chip, unless the
+ * handler changes the type.
+ */
+static void gpio_dispatch(int gpio, uint32_t was, uint32_t level)
+{
+    host_critical_enter();
+    for (int i = 0; i < HOST_GPIO_LEVEL_REPEATS; i++) {
+        gpio_int_type_t type = (gpio_int_type_t) GPIO.pin[gpio].int_type;
+        gpio_handler_t handler = m_handlers[gpio];
+
+        if (!m_service || handler.handler == NULL || !gpio_int_due(type, was, level)) {
+            break;
+        }
+        handler.handler(handler.arg);
+        if (type != GPIO_INTR_LOW_LEVEL && type != GPIO_INTR_HIGH_LEVEL) {
+            break;
+        }
+        was = level;
+    }
+    host_critical_exit();
+}
+
+static void gpio_drive(int gpio, uint32_t level, bool dispatch)
+{
+    pthread_mutex_lock(&m_lock);
+    uint32_t was = (m_set[gpio] ? m_levels[gpio] : 1);
+
+    m_levels[gpio] = (level != 0);
+    m_set[gpio] = true;
+    pthread_mutex_unlock(&m_lock);
+
+    if (m_watch != NULL) {
+        m_watch(gpio, (level != 0), m_watch_ctx);
+    }
+    if (dispatch) {
+        gpio_dispatch(gpio, was, (level != 0));
+    }
+}
+
+void host_gpio_input(int gpio, uint32_t level)
+{
+    if (gpio_valid(gpio)) {
+        gpio_drive(gpio, level, true);
+    }
+}
+
+void host_gpio_watch(void (*watch)(int gpio, uint32_t level, void *ctx), void *ctx)
+{
+    m_watch_ctx = ctx;
+    m_watch = watch;
+}
+
+void host_gpio_reset(void)
+{
+    pthread_mutex_lock(&m_lock);
+    for (int gpio = 0; gpio < HOST_GPIO_COUNT; gpio++) {
+        m_set[gpio] = false;
+        m_handlers[gpio].handler = NULL;
+        GPIO.pin[gpio].val = 0;
+    }
+    m_service = false;
+    m_watch = NULL;
+    pthread_mutex_unlock(&m_lock);
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    if (!gpio_valid(gpio)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_drive(gpio, level, false);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio)
+{
+    return (int) host_gpio_level(gpio);
+}
+
+uint32_t gpio_input_get(void)
+{
+    uint32_t levels = 0;
+
+    for (int gpio = 0; gpio < 32; gpio++) {
+        levels |= host_gpio_level(gpio) << gpio;
+    }
+    return levels;
+}
+
+uint32_t gpio_input_get_high(void)
+{
+    uint32_t levels = 0;
+
+    for (int gpio = 32; gpio < HOST_GPIO_COUNT; gpio++) {
+        levels |= host_gpio_level(gpio) << (gpio - 32);
+    }
+    return levels;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode)
+{
+    (void) mode;
+    return (gpio_valid(gpio) ? ESP_OK : ESP_ERR_INVALID_ARG);
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio, gpio_int_type_t type)
+{
+    if (!gpio_valid(gpio) || type >= GPIO_INTR_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    GPIO.pin[gpio].int_type = type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    if (config->pin_bit_mask == 0 || config->pin_bit_mask >= (1ULL << HOST_GPIO_COUNT)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int gpio = 0; gpio < HOST_GPIO_COUNT; gpio++) {
+        if (config->pin_bit_mask & (1ULL << gpio)) {
+            GPIO.pin[gpio].int_type = config->intr_type;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio, gpio_int_type_t type)
+{
+    if (!gpio_valid(gpio) || (type != GPIO_INTR_LOW_LEVEL && type != GPIO_INTR_HIGH_LEVEL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    GPIO.pin[gpio].int_type = type;
+    GPIO.pin[gpio].wakeup_enable = 1;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    (void) intr_alloc_flags;
+
+    pthread_mutex_lock(&m_lock);
+    esp_err_t ret = (m_service ? ESP_ERR_INVALID_STATE : ESP_OK);
+    m_service = true;
+    pthread_mutex_unlock(&m_lock);
+
+    return ret;
+}
+
+void gpio_uninstall_isr_service(void)
+{
+    m_service = false;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t handler, void *arg)
+{
+    if (!gpio_valid(gpio)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!m_service) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    host_critical_enter();
+    m_handlers[gpio].handler = handler;
+    m_handlers[gpio].arg = arg;
+    host_critical_exit();
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio)
+{
+    return gpio_isr_handler_add(gpio, NULL, NULL);
+}
@@ -0,0 +1,234 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * host.h - controls for the esp-idf and FreeRTOS stand-ins the host
+ * build links the code under test against
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+/*
+ * The clock behind esp_timer_get_time(), xTaskGetTickCount() and
+ * xthal_get_ccount() is the host's monotonic clock until a test calls
+ * host_clock_virtual(). From then on it only moves when something
+ * waits (vTaskDelay(), ets_delay_us(), a queue or semaphore timing
+ * out) or the test calls host_clock_advance(), so a test can run
+ * through hours of delays instantly and get the same answer every
+ * time. Waits in different tasks add up rather than overlap, so a
+ * virtual clock is for tests with one task doing the waiting. Timers
+ * (esp_timer, software timers, the timer group) that fall due on the
+ * way fire from inside the wait, at the time they were due, so a
+ * callback that blocks on the waiting task would hang it.
+ */
+void host_clock_virtual(int64_t usec);
+void host_clock_advance(int64_t usec);
+
+/*
+ * With a hook set, host_clock_advance() (and so every wait on a
+ * virtual clock) calls it instead of moving the clock itself; the
+ * hook moves it with host_clock_virtual(). It's how the simulator
+ * (sim.h) runs other events in the time something waits. NULL to
+ * take it off again.
+ */
+void host_clock_hook(void (*advance)(int64_t usec));
+
+/*
+ * With a scheduler hooked in, tasks only run when it says so. create()
+ * is called by the creator for each task before its thread starts, and
+ * whatever it returns is handed back to start(), in the task's own
+ * thread, before the task function runs; start() returns once the task
+ * is to run. Every block (on a queue, semaphore or notification) calls
+ * wait() instead of waiting itself, with the queue's lock let go, until
+ * ready(ctx) or the host clock reaches 'until' (INT64_MAX for never),
+ * and exit() is the task deleting itself. It's how the simulator runs
+ * tasks one at a time, on its own clock. NULL to take it off again.
+ */
+typedef struct {
+    void *(*create)(const char *name, unsigned priority);
+    void (*start)(void *task);
+    void (*wait)(bool (*ready)(void *ctx), void *ctx, int64_t until);
+    void (*exit)(void);
+} host_sched_t;
+
+void host_sched_hook(const host_sched_t *sched);
+
+bool host_clock_is_virtual(void);
+int64_t host_time_usec(void);
+void host_sleep_usec(int64_t usec);
+
+// esp_get_free_heap_size() returns this (and the minimum tracks it):
+void host_heap_set(uint32_t free_bytes);
+
+// rtc_get_reset_reason() returns this (a RESET_REASON; POWERON_RESET to start with):
+void host_reset_reason_set(int reason);
+
+// Subscribed tasks that went longer than the task watchdog timeout between resets:
+uint32_t host_task_wdt_timeouts(void);
+
+// Lines the last linenoiseHistoryLoad() read:
+int host_linenoise_loaded(void);
+
+// uart_read_bytes() and friends on port 'uart' read and write 'fd':
+void host_uart_attach(int uart, int fd);
+
+// uart_write_bytes() on 'uart' then waits for the bytes to shift out at 'baud', 10 bits each, as with no tx buffer installed (0, the default, doesn't wait):
+void host_uart_baud(int uart, uint32_t baud);
+
+// The level a pin was last set to (pins start high, as if pulled up):
+uint32_t host_gpio_level(int gpio);
+
+/*
+ * Drives an input from outside, as a switch or another chip would,
+ * and runs the pin's isr handler if its interrupt type (GPIO.pin[]
+ * int_type, which gpio_config() and friends set) says the change
+ * fires it.
+ */
+void host_gpio_input(int gpio, uint32_t level);
+
+// Calls 'watch' on every level a pin is set or driven to, in the setter's thread; NULL to stop:
+void host_gpio_watch(void (*watch)(int gpio, uint32_t level, void *ctx), void *ctx);
+
+// Back to power-on: pins high and unconfigured, and no isr service:
+void host_gpio_reset(void);
+
+/*
+ * An i2c slave sees a transaction as the bytes written after its
+ * ADDR+W, in one call per START (or repeated START) ... STOP, and a
+ * call per i2c_master_read*() for the bytes the master reads. Either
+ * can return an error to NACK.
+ */
+typedef struct {
+    esp_err_t (*write)(void *ctx, const uint8_t *data, size_t len);
+    esp_err_t (*read)(void *ctx, uint8_t *data, size_t len);
+    void *ctx;
+} host_i2c_slave_t;
+
+void host_i2c_attach(uint8_t address, const host_i2c_slave_t *slave);
+void host_i2c_detach_all(void);
+
+/*
+ * Each transaction takes as long as its bits would at the clk_speed
+ * given to i2c_param_config() (a bit each for START and STOP, nine
+ * for each byte): on a virtual clock the wait moves the clock, on the
+ * real one it sleeps. Off by default.
+ */
+void host_i2c_timing(bool on);
+
+// The next 'count' i2c_master_cmd_begin() calls fail with 'err' without touching a slave:
+void host_i2c_fail(uint32_t count, esp_err_t err);
+
+typedef enum {
+    HOST_I2C_START,
+    HOST_I2C_WRITE,             // ack checked if 'ack'
+    HOST_I2C_READ,              // the last byte is acked if 'ack'
+    HOST_I2C_STOP,
+} host_i2c_op_type_t;
+
+#define HOST_I2C_OP_DATA            (32)        // bytes of each op kept in the log
+
+typedef struct {
+    host_i2c_op_type_t type;
+    bool ack;
+    size_t len;
+    uint8_t data[HOST_I2C_OP_DATA];
+} host_i2c_op_t;
+
+typedef struct {
+    uint32_t transactions;      // i2c_master_cmd_begin() calls
+    uint32_t links;             // command links created
+    uint32_t nodes;             // command nodes appended, each a heap allocation
+    uint32_t allocations;       // links + nodes: everything the driver took from the heap
+    uint32_t frees;
+} host_i2c_stats_t;
+
+// Copies out up to 'max' ops of the last transaction; returns how many it had:
+uint32_t host_i2c_last(host_i2c_op_t *ops, uint32_t max);
+void host_i2c_get_stats(host_i2c_stats_t *stats);
+void host_i2c_reset_stats(void);
+
+/*
+ * The ledc stand-in keeps the duty each high speed channel runs at,
+ * with the register's four fractional bits (so 16 per count), moving
+ * in a straight line while the fade engine runs. It also counts the
+ * ways the driver could be misused, as it isn't thread safe.
+ */
+typedef struct {
+    uint32_t updates;           // ledc_update_duty() calls
+    uint32_t fades;             // fades started
+    uint32_t fades_blocked;     // started while the last was still running, which blocks on the target
+    uint32_t fades_cut_short;   // duties latched while a fade was running
+    uint32_t foreign_calls;     // calls from a thread other than the first one to call
+    uint32_t overlaps;          // calls made while another thread was in the driver
+} host_ledc_stats_t;
+
+uint32_t host_ledc_duty(int channel);
+bool host_ledc_fading(int channel);
+
+// Calls 'watch' with every duty a channel's latched at or starts fading to (fraction bits and all), in the caller's thread; NULL to stop:
+void host_ledc_watch(void (*watch)(int channel, uint32_t duty, bool fade, void *ctx), void *ctx);
+
+void host_ledc_get_stats(host_ledc_stats_t *stats);
+void host_ledc_reset(void);
+
+/*
+ * adc1_get_raw() on a channel reads 'raw' (clamped to 12 bits), or
+ * whatever 'source' returns, called in the reader's thread, if there
+ * is one. Channels read -1 until they're configured.
+ */
+void host_adc_set(int channel, uint32_t raw);
+void host_adc_source(int channel, int (*source)(int channel, void *ctx), void *ctx);
+uint32_t host_adc_reads(void);
+
+/*
+ * An spi slave sees each transaction whole: the bytes the master
+ * clocks out, and room for the ones it clocks back in at the same
+ * time. One slave per bus (HSPI_HOST, say); with none, miso reads
+ * all ones.
+ */
+typedef struct {
+    esp_err_t (*transfer)(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len);
+    void *ctx;
+} host_spi_slave_t;
+
+void host_spi_attach(int host, const host_spi_slave_t *slave);     // NULL to detach
+
+// As host_i2c_timing(), at the device's clock_speed_hz:
+void host_spi_timing(bool on);
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t bytes;
+    uint32_t overlaps;          // transactions started on a device already in one
+} host_spi_stats_t;
+
+void host_spi_get_stats(host_spi_stats_t *stats);
+void host_spi_reset_stats(void);
+
+/*
+ * The cpu frequency the pm locks held right now would run at, as
+ * esp-idf v3.3 works it out from the esp_pm_configure() settings
+ * (CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ until something configures it),
+ * and whether the idle task could go into light sleep. ccount counts
+ * at that frequency, so it slows down under DFS as it does on the chip.
+ */
+int host_pm_cpu_freq_mhz(void);
+bool host_pm_can_sleep(void);
+
+// Back to unconfigured, with every lock released, no wakeup sources and no idle hooks:
+void host_pm_reset(void);
+
+/*
+ * Wakes the chip from a light sleep it never went into, as 'cause' (an
+ * esp_sleep_source_t) would, if that source is enabled: from then on
+ * esp_sleep_get_wakeup_cause() says so. Returns false, leaving the
+ * cause alone, if it isn't.
+ */
+bool host_sleep_wakeup(int cause);
+
+// Calls the idle hooks registered for 'cpu', as that cpu's idle task would:
+void host_idle_hooks_run(int cpu);
@@ -0,0 +1,65 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * host_alarm.h - the one alarm list behind the shim's esp_timer,
+ * FreeRTOS software timers and timer group; not for tests
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Who an alarm's function runs as. An isr runs inside the critical
+ * section lock, as if interrupts were masked; esp_timer callbacks run
+ * one at a time, as they would in the esp_timer task, and so do
+ * software timer callbacks, in the timer service task's stead.
+ */
+typedef enum {
+    HOST_ALARM_ISR,
+    HOST_ALARM_ESP_TIMER,
+    HOST_ALARM_TMR_SVC,
+} host_alarm_source_t;
+
+typedef struct host_alarm {
+    void (*fn)(void *arg);
+    void *arg;
+    host_alarm_source_t source;
+
+    // The rest is the alarm list's:
+    int64_t at;
+    int64_t period;             // 0 for one-shot
+    uint64_t order;
+    bool armed;
+    bool overdue;               // already due when it was started
+    struct host_alarm *next;
+} host_alarm_t;
+
+/*
+ * Arms 'alarm' (again, if it already was) for 'at' on the host clock,
+ * and every 'period' after that if that isn't 0. On the monotonic
+ * clock a thread of the alarm list's fires it; on a virtual clock,
+ * whoever moves the clock past 'at' does (see host_clock_advance()),
+ * except that the list's thread fires any that are already due (and
+ * see host_alarm_driven()).
+ */
+void host_alarm_start(host_alarm_t *alarm, int64_t at, int64_t period);
+void host_alarm_stop(host_alarm_t *alarm);
+bool host_alarm_armed(const host_alarm_t *alarm);
+
+// Calls its function as its source says:
+void host_alarm_fire(host_alarm_t *alarm);
+
+// For host_clock_advance() on a virtual clock: fires everything due up to 'until' as it goes
+void host_alarm_advance(int64_t until);
+
+/*
+ * For a scheduler that fires the alarms itself (the simulator): while
+ * the list is driven its thread leaves them all alone, and whoever
+ * drives it takes each alarm off (or on to its next period) with
+ * host_alarm_take() and fires it. Both false or NULL if there's none
+ * from 'source' (due by 'until'); *at is when it's due.
+ */
+void host_alarm_driven(bool driven);
+bool host_alarm_next(host_alarm_source_t source, int64_t *at);
+host_alarm_t *host_alarm_take(host_alarm_source_t source, int64_t until, int64_t *at);
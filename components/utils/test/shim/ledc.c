@@ -0,0 +1,291 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * ledc.c - host stand-in for the led pwm driver and its fade engine
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "driver/ledc.h"
+#include "soc/ledc_struct.h"
+#include "host.h"
+
+#define LEDC_FRACTION_BITS          (4)
+
+typedef struct {
+    uint32_t latched;           // the duty the output runs at, with the fraction bits
+    bool fade_set;              // ledc_set_fade_with_time() since the last start
+    uint32_t fade_target;       // with the fraction bits
+    int64_t fade_usec;
+    bool fading;
+    uint32_t fade_from;
+    int64_t fade_start;
+} ledc_state_t;
+
+ledc_dev_t LEDC;
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static ledc_state_t m_channels[LEDC_SPEED_MODE_MAX][LEDC_CHANNEL_MAX];
+static host_ledc_stats_t m_stats;
+static volatile uint32_t m_inside = 0;
+static pthread_t m_owner;
+static bool m_owned = false;
+static void (*m_watch)(int channel, uint32_t duty, bool fade, void *ctx) = NULL;
+static void *m_watch_ctx = NULL;
+
+static inline bool ledc_valid(ledc_mode_t mode, ledc_channel_t channel)
+{
+    return (mode >= 0 && mode < LEDC_SPEED_MODE_MAX && channel >= 0 && channel < LEDC_CHANNEL_MAX);
+}
+
+/*
+ * Every call goes through here. The driver isn't thread safe, so two
+ * threads in it at once, or calls from more than one thread at all,
+ * get counted.
+ */
+static void ledc_enter(void)
+{
+    if (__atomic_fetch_add(&m_inside, 1, __ATOMIC_SEQ_CST) != 0) {
+        __atomic_add_fetch(&m_stats.overlaps, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_lock(&m_lock);
+    if (!m_owned) {
+        m_owner = pthread_self();
+        m_owned = true;
+    } else if (!pthread_equal(m_owner, pthread_self())) {
+        m_stats.foreign_calls++;
+    }
+}
+
+static void ledc_exit(void)
+{
+    pthread_mutex_unlock(&m_lock);
+    __atomic_sub_fetch(&m_inside, 1, __ATOMIC_SEQ_CST);
+}
+
+static void ledc_watch(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty, bool fade)
+{
+    if (m_watch != NULL && mode == LEDC_HIGH_SPEED_MODE) {
+        m_watch(channel, duty, fade, m_watch_ctx);
+    }
+}
+
+// With m_lock held: where the output is now, finishing off a fade that's done
+static uint32_t ledc_output(ledc_state_t *state, int64_t now)
+{
+    if (state->fading) {
+        int64_t elapsed = now - state->fade_start;
+
+        if (elapsed >= state->fade_usec) {
+            state->fading = false;
+            state->latched = state->fade_target;
+        } else {
+            int64_t span = (int64_t) state->fade_target - state->fade_from;
+
+            return (uint32_t)(state->fade_from + span * elapsed / state->fade_usec);
+        }
+    }
+    return state->latched;
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config)
+{
+    if (config->speed_mode >= LEDC_SPEED_MODE_MAX || config->timer_num >= LEDC_TIMER_MAX || config->freq_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config)
+{
+    if (!ledc_valid(config->speed_mode, config->channel)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ledc_enter();
+    ledc_state_t *state = &m_channels[config->speed_mode][config->channel];
+
+    memset(state, 0, sizeof(*state));
+    state->latched = config->duty << LEDC_FRACTION_BITS;
+    LEDC.channel_group[config->speed_mode].channel[config->channel].duty.duty = state->latched;
+    LEDC.channel_group[config->speed_mode].channel[config->channel].conf0.timer_sel = config->timer_sel;
+    ledc_exit();
+
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags)
+{
+    (void) intr_alloc_flags;
+    return ESP_OK;
+}
+
+void ledc_fade_func_uninstall(void)
+{
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty)
+{
+    if (!ledc_valid(mode, channel)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ledc_enter();
+    LEDC.channel_group[mode].channel[channel].duty.duty = duty << LEDC_FRACTION_BITS;
+    ledc_exit();
+
+    return ESP_OK;
+}
+
+// Latching a duty takes the channel off whatever fade it was on:
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+    if (!ledc_valid(mode, channel)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ledc_enter();
+    ledc_state_t *state = &m_channels[mode][channel];
+
+    ledc_output(state, host_time_usec());
+    if (state->fading) {
+        state->fading = false;
+        m_stats.fades_cut_short++;
+    }
+    state->latched = LEDC.channel_group[mode].channel[channel].duty.duty;
+    m_stats.updates++;
+    uint32_t latched = state->latched;
+    ledc_exit();
+
+    ledc_watch(mode, channel, latched, false);
+
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+    if (!ledc_valid(mode, channel)) {
+        return 0;
+    }
+
+    ledc_enter();
+    uint32_t duty = ledc_output(&m_channels[mode][channel], host_time_usec()) >> LEDC_FRACTION_BITS;
+    ledc_exit();
+
+    return duty;
+}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t mode, ledc_channel_t channel, uint32_t target_duty, int max_fade_time_ms)
+{
+    if (!ledc_valid(mode, channel) || max_fade_time_ms < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ledc_enter();
+    ledc_state_t *state = &m_channels[mode][channel];
+
+    state->fade_set = true;
+    state->fade_target = target_duty << LEDC_FRACTION_BITS;
+    state->fade_usec = (int64_t) max_fade_time_ms * 1000;
+    ledc_exit();
+
+    return ESP_OK;
+}
+
+/*
+ * The real driver blocks a second fade on a channel until the first
+ * is done; here it takes over at once, and is counted, since the led
+ * service never expects to wait.
+ */
+esp_err_t ledc_fade_start(ledc_mode_t mode, ledc_channel_t channel, ledc_fade_mode_t fade_mode)
+{
+    if (!ledc_valid(mode, channel) || fade_mode >= LEDC_FADE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ledc_enter();
+    ledc_state_t *state = &m_channels[mode][channel];
+    int64_t now = host_time_usec();
+    uint32_t from = ledc_output(state, now);
+    int64_t usec = state->fade_usec;
+
+    if (!state->fade_set) {
+        ledc_exit();
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (state->fading) {
+        m_stats.fades_blocked++;
+    }
+    state->fade_set = false;
+    state->fade_from = from;
+    state->fade_start = now;
+    state->fading = (usec > 0);
+    if (!state->fading) {
+        state->latched = state->fade_target;
+    }
+    m_stats.fades++;
+    uint32_t target = state->fade_target;
+    ledc_exit();
+
+    ledc_watch(mode, channel, target, true);
+
+    if (fade_mode == LEDC_FADE_WAIT_DONE) {
+        host_sleep_usec(usec);
+    }
+    return ESP_OK;
+}
+
+uint32_t host_ledc_duty(int channel)
+{
+    if (!ledc_valid(LEDC_HIGH_SPEED_MODE, channel)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    uint32_t duty = ledc_output(&m_channels[LEDC_HIGH_SPEED_MODE][channel], host_time_usec());
+    pthread_mutex_unlock(&m_lock);
+
+    return duty;
+}
+
+bool host_ledc_fading(int channel)
+{
+    if (!ledc_valid(LEDC_HIGH_SPEED_MODE, channel)) {
+        return false;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    ledc_state_t *state = &m_channels[LEDC_HIGH_SPEED_MODE][channel];
+
+    ledc_output(state, host_time_usec());
+    bool fading = state->fading;
+    pthread_mutex_unlock(&m_lock);
+
+    return fading;
+}
+
+void host_ledc_watch(void (*watch)(int channel, uint32_t duty, bool fade, void *ctx), void *ctx)
+{
+    m_watch_ctx = ctx;
+    m_watch = watch;
+}
+
+void host_ledc_get_stats(host_ledc_stats_t *stats)
+{
+    pthread_mutex_lock(&m_lock);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_lock);
+}
+
+void host_ledc_reset(void)
+{
+    pthread_mutex_lock(&m_lock);
+    memset(m_channels, 0, sizeof(m_channels));
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_owned = false;
+    m_watch = NULL;
+    pthread_mutex_unlock(&m_lock);
+}
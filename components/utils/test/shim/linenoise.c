@@ -0,0 +1,84 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * linenoise.c - host stand-in for the history part of linenoise:
+ * repeats of the previous line are skipped, as the real one does,
+ * and the rest is just counted
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "linenoise/linenoise.h"
+#include "host.h"
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static char m_last[256];
+static int m_max_len = 100;
+static int m_len = 0;
+static int m_loaded = 0;
+
+int linenoiseHistoryAdd(const char *line)
+{
+    int added = 0;
+
+    pthread_mutex_lock(&m_lock);
+    if (m_len == 0 || strncmp(m_last, line, sizeof(m_last)) != 0) {
+        snprintf(m_last, sizeof(m_last), "%s", line);
+        if (m_len < m_max_len) {
+            m_len++;
+        }
+        added = 1;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    return added;
+}
+
+int linenoiseHistorySetMaxLen(int len)
+{
+    if (len < 1) {
+        return 0;
+    }
+    pthread_mutex_lock(&m_lock);
+    m_max_len = len;
+    if (m_len > len) {
+        m_len = len;
+    }
+    pthread_mutex_unlock(&m_lock);
+    return 1;
+}
+
+int linenoiseHistorySave(const char *filename)
+{
+    (void) filename;
+    return -1;
+}
+
+int linenoiseHistoryLoad(const char *filename)
+{
+    char line[256];
+    FILE *f = fopen(filename, "r");
+
+    if (f == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    m_len = 0;
+    m_loaded = 0;
+    pthread_mutex_unlock(&m_lock);
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        linenoiseHistoryAdd(line);
+        m_loaded++;
+    }
+    fclose(f);
+    return 0;
+}
+
+int host_linenoise_loaded(void)
+{
+    return m_loaded;
+}
@@ -0,0 +1,11 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * linenoise.h - host stand-in for the history part of linenoise
+ */
+
+#pragma once
+
+int linenoiseHistoryAdd(const char *line);
+int linenoiseHistorySetMaxLen(int len);
+int linenoiseHistorySave(const char *filename);
+int linenoiseHistoryLoad(const char *filename);
@@ -0,0 +1,76 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * newlib.c - host stand-ins for the newlib extensions the target code
+ * uses: funopen() and the global reent
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "sys/reent.h"
+
+static struct _reent m_global_reent;
+struct _reent *_global_impure_ptr = &m_global_reent;
+
+typedef struct {
+    void *cookie;
+    int (*readfn)(void *cookie, char *buf, int len);
+    int (*writefn)(void *cookie, const char *buf, int len);
+    int (*closefn)(void *cookie);
+} funopen_t;
+
+static ssize_t funopen_read(void *arg, char *buf, size_t len)
+{
+    funopen_t *f = arg;
+
+    return (f->readfn != NULL ? f->readfn(f->cookie, buf, (int) len) : -1);
+}
+
+static ssize_t funopen_write(void *arg, const char *buf, size_t len)
+{
+    funopen_t *f = arg;
+
+    return (f->writefn != NULL ? f->writefn(f->cookie, buf, (int) len) : -1);
+}
+
+static int funopen_close(void *arg)
+{
+    funopen_t *f = arg;
+    int ret = (f->closefn != NULL ? f->closefn(f->cookie) : 0);
+
+    free(f);
+    return ret;
+}
+
+// Seeking isn't supported, which is all the console asks for:
+FILE *funopen(const void *cookie,
+              int (*readfn)(void *cookie, char *buf, int len),
+              int (*writefn)(void *cookie, const char *buf, int len),
+              long (*seekfn)(void *cookie, long offset, int whence),
+              int (*closefn)(void *cookie))
+{
+    cookie_io_functions_t io = {
+        .read = funopen_read,
+        .write = funopen_write,
+        .close = funopen_close,
+    };
+    funopen_t *f = calloc(1, sizeof(*f));
+
+    (void) seekfn;
+    if (f == NULL) {
+        return NULL;
+    }
+    f->cookie = (void *) cookie;
+    f->readfn = readfn;
+    f->writefn = writefn;
+    f->closefn = closefn;
+
+    FILE *stream = fopencookie(f, (readfn != NULL ? (writefn != NULL ? "r+" : "r") : "w"), io);
+    if (stream == NULL) {
+        free(f);
+    }
+    return stream;
+}
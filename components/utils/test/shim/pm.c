@@ -0,0 +1,347 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * pm.c - host stand-ins for the pm locks, the sleep wakeup sources and
+ * the idle hooks
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_freertos_hooks.h"
+#include "xtensa/hal.h"
+#include "sdkconfig.h"
+#include "host.h"
+
+#define HOST_APB_FREQ_MHZ           (80)
+#define HOST_IDLE_HOOKS             (8)
+
+struct esp_pm_lock {
+    esp_pm_lock_type_t type;
+    const char *name;
+    uint32_t count;
+    struct esp_pm_lock *next;
+};
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool m_configured = false;
+static esp_pm_config_esp32_t m_config;
+static struct esp_pm_lock *m_locks = NULL;
+static uint32_t m_held[ESP_PM_NO_LIGHT_SLEEP + 1];
+static uint32_t m_wakeup_sources = 0;
+static esp_sleep_wakeup_cause_t m_wakeup_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+static esp_freertos_idle_cb_t m_idle_hooks[2][HOST_IDLE_HOOKS];
+
+// The cycle counter, as of the last time the frequency changed (or the clock went back):
+static int64_t m_ccount_usec = 0;
+static uint64_t m_ccount_cycles = 0;
+static int m_ccount_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+
+/*
+ * As esp-idf v3.3 picks the mode: any CPU_FREQ_MAX lock runs at the
+ * maximum, an APB_FREQ_MAX lock at no less than the 80 MHz the apb
+ * needs, and otherwise the cpu drops to the minimum.
+ */
+static int pm_freq_mhz(void)
+{
+    int mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+
+    if (m_configured) {
+        if (m_held[ESP_PM_CPU_FREQ_MAX] != 0) {
+            mhz = m_config.max_freq_mhz;
+        } else if (m_held[ESP_PM_APB_FREQ_MAX] != 0) {
+            mhz = (m_config.max_freq_mhz < HOST_APB_FREQ_MHZ ? m_config.max_freq_mhz : HOST_APB_FREQ_MHZ);
+            mhz = (m_config.min_freq_mhz > mhz ? m_config.min_freq_mhz : mhz);
+        } else {
+            mhz = m_config.min_freq_mhz;
+        }
+    }
+    return mhz;
+}
+
+// With m_lock held; a clock that's gone back (to a virtual one, say) starts the count again from there:
+static uint64_t pm_ccount(int64_t now)
+{
+    if (now < m_ccount_usec) {
+        m_ccount_usec = now;
+        m_ccount_cycles = (uint64_t) now * m_ccount_mhz;
+    }
+    return m_ccount_cycles + (uint64_t)(now - m_ccount_usec) * m_ccount_mhz;
+}
+
+// With m_lock held, after anything that might change the frequency:
+static void pm_ccount_update(void)
+{
+    int64_t now = host_time_usec();
+
+    m_ccount_cycles = pm_ccount(now);
+    m_ccount_usec = now;
+    m_ccount_mhz = pm_freq_mhz();
+}
+
+uint32_t xthal_get_ccount(void)
+{
+    pthread_mutex_lock(&m_lock);
+    uint32_t ccount = (uint32_t) pm_ccount(host_time_usec());
+    pthread_mutex_unlock(&m_lock);
+
+    return ccount;
+}
+
+esp_err_t esp_pm_configure(const void *config)
+{
+    const esp_pm_config_esp32_t *pm = config;
+
+    if (pm == NULL || pm->min_freq_mhz > pm->max_freq_mhz || pm->min_freq_mhz < 10) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    m_config = *pm;
+    m_configured = true;
+    pm_ccount_update();
+    pthread_mutex_unlock(&m_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle)
+{
+    (void) arg;
+
+    if (lock_type > ESP_PM_NO_LIGHT_SLEEP || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct esp_pm_lock *lock = calloc(1, sizeof(*lock));
+
+    if (lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    lock->type = lock_type;
+    lock->name = (name != NULL ? name : "?");
+
+    pthread_mutex_lock(&m_lock);
+    lock->next = m_locks;
+    m_locks = lock;
+    pthread_mutex_unlock(&m_lock);
+
+    *out_handle = lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle)
+{
+    esp_err_t ret = ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_lock(&m_lock);
+    for (struct esp_pm_lock **p = &m_locks; *p != NULL; p = &(*p)->next) {
+        if (*p == handle) {
+            ret = (handle->count != 0 ? ESP_ERR_INVALID_STATE : ESP_OK);
+            if (ret == ESP_OK) {
+                *p = handle->next;
+                free(handle);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    return ret;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    handle->count++;
+    m_held[handle->type]++;
+    pm_ccount_update();
+    pthread_mutex_unlock(&m_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    if (handle->count == 0) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        handle->count--;
+        m_held[handle->type]--;
+        pm_ccount_update();
+    }
+    pthread_mutex_unlock(&m_lock);
+    return ret;
+}
+
+esp_err_t esp_pm_dump_locks(FILE *stream)
+{
+    pthread_mutex_lock(&m_lock);
+    fprintf(stream, "Lock stats:\n");
+    for (struct esp_pm_lock *lock = m_locks; lock != NULL; lock = lock->next) {
+        static const char *types[] = { "CPU_FREQ_MAX", "APB_FREQ_MAX", "NO_SLEEP" };
+
+        fprintf(stream, "%-15s  %-14s  %u\n", lock->name, types[lock->type], lock->count);
+    }
+    pthread_mutex_unlock(&m_lock);
+    return ESP_OK;
+}
+
+int host_pm_cpu_freq_mhz(void)
+{
+    pthread_mutex_lock(&m_lock);
+    int mhz = pm_freq_mhz();
+    pthread_mutex_unlock(&m_lock);
+
+    return mhz;
+}
+
+bool host_pm_can_sleep(void)
+{
+    pthread_mutex_lock(&m_lock);
+    bool sleep = (m_configured && m_config.light_sleep_enable
+                  && m_held[ESP_PM_CPU_FREQ_MAX] == 0 && m_held[ESP_PM_APB_FREQ_MAX] == 0
+                  && m_held[ESP_PM_NO_LIGHT_SLEEP] == 0);
+    pthread_mutex_unlock(&m_lock);
+    return sleep;
+}
+
+void host_pm_reset(void)
+{
+    pthread_mutex_lock(&m_lock);
+    m_configured = false;
+    for (struct esp_pm_lock *lock = m_locks; lock != NULL; lock = lock->next) {
+        lock->count = 0;
+    }
+    memset(m_held, 0, sizeof(m_held));
+    m_wakeup_sources = 0;
+    m_wakeup_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+    memset(m_idle_hooks, 0, sizeof(m_idle_hooks));
+    pm_ccount_update();
+    pthread_mutex_unlock(&m_lock);
+}
+
+static esp_err_t sleep_enable(esp_sleep_source_t source)
+{
+    pthread_mutex_lock(&m_lock);
+    m_wakeup_sources |= 1u << source;
+    pthread_mutex_unlock(&m_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    (void) time_in_us;
+    return sleep_enable(ESP_SLEEP_WAKEUP_TIMER);
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void)
+{
+    return sleep_enable(ESP_SLEEP_WAKEUP_GPIO);
+}
+
+esp_err_t esp_sleep_enable_uart_wakeup(int uart_num)
+{
+    return (uart_num == 0 || uart_num == 1 ? sleep_enable(ESP_SLEEP_WAKEUP_UART) : ESP_ERR_INVALID_ARG);
+}
+
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source)
+{
+    pthread_mutex_lock(&m_lock);
+    if (source == ESP_SLEEP_WAKEUP_ALL) {
+        m_wakeup_sources = 0;
+    } else {
+        m_wakeup_sources &= ~(1u << source);
+    }
+    pthread_mutex_unlock(&m_lock);
+    return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void)
+{
+    return __atomic_load_n(&m_wakeup_cause, __ATOMIC_SEQ_CST);
+}
+
+bool host_sleep_wakeup(int cause)
+{
+    pthread_mutex_lock(&m_lock);
+    bool enabled = (cause > ESP_SLEEP_WAKEUP_ALL && cause <= ESP_SLEEP_WAKEUP_UART
+                    && (m_wakeup_sources & (1u << cause)) != 0);
+    if (enabled) {
+        m_wakeup_cause = cause;
+    }
+    pthread_mutex_unlock(&m_lock);
+    return enabled;
+}
+
+esp_err_t esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t new_idle_cb, int cpuid)
+{
+    esp_err_t ret = ESP_ERR_NO_MEM;
+
+    if (cpuid < 0 || cpuid > 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    for (int i = 0; i < HOST_IDLE_HOOKS; i++) {
+        if (m_idle_hooks[cpuid][i] == NULL) {
+            m_idle_hooks[cpuid][i] = new_idle_cb;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    return ret;
+}
+
+esp_err_t esp_register_freertos_idle_hook(esp_freertos_idle_cb_t new_idle_cb)
+{
+    return esp_register_freertos_idle_hook_for_cpu(new_idle_cb, 0);
+}
+
+void esp_deregister_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t old_idle_cb, int cpuid)
+{
+    if (cpuid < 0 || cpuid > 1) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    for (int i = 0; i < HOST_IDLE_HOOKS; i++) {
+        if (m_idle_hooks[cpuid][i] == old_idle_cb) {
+            m_idle_hooks[cpuid][i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+void host_idle_hooks_run(int cpu)
+{
+    esp_freertos_idle_cb_t hooks[HOST_IDLE_HOOKS];
+
+    if (cpu < 0 || cpu > 1) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    memcpy(hooks, m_idle_hooks[cpu], sizeof(hooks));
+    pthread_mutex_unlock(&m_lock);
+
+    for (int i = 0; i < HOST_IDLE_HOOKS; i++) {
+        if (hooks[i] != NULL) {
+            hooks[i]();
+        }
+    }
+}
@@ -0,0 +1,10 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * ets_sys.h - host stand-in
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+void ets_delay_us(uint32_t us);
@@ -0,0 +1,12 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * gpio.h - host stand-in for the ROM's gpio register reads
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// The levels of gpios 0-31, and of 32-39 in the low bits:
+uint32_t gpio_input_get(void);
+uint32_t gpio_input_get_high(void);
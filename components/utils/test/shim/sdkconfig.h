@@ -0,0 +1,29 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * sdkconfig.h - the sdkconfig values the host build needs, as set in
+ * the project's sdkconfig
+ */
+
+#pragma once
+
+#define CONFIG_FREERTOS_HZ                      100
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 1
+#define CONFIG_FREERTOS_USE_TICKLESS_IDLE       1
+#define CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID 1
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ       160
+#define CONFIG_CONSOLE_UART_NUM                 0
+#define CONFIG_CONSOLE_RUNTIME_BAUDRATE         115200
+#define CONFIG_CONSOLE_TX_RING_SIZE             4096
+#define CONFIG_TASK_WDT_TIMEOUT_S               5
+#define CONFIG_PM_ENABLE                        1
+
+#define CONFIG_IO_GLITCH_FILTER_TIME_MS         50
+#define CONFIG_POWER_LIGHT_SLEEP                1
+#define CONFIG_POWER_MIN_FREQ_MHZ               40
+#define CONFIG_POWER_WAKE_US                    2000
+#define CONFIG_POWER_CONSOLE_AWAKE_S            30
+#define CONFIG_ENERGY_LOG_PERIOD_S              60
+#define CONFIG_ENERGY_LOG_FLUSH_MIN             60
+#define CONFIG_ENERGY_LOG_MAX_KB                512
+#define CONFIG_TELEMETRY_QUEUE_SIZE             4096
+#define CONFIG_TELEMETRY_SPILL_MAX              262144
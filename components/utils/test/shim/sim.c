@@ -0,0 +1,674 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * sim.c - a deterministic discrete-event simulator on the host build's
+ * virtual clock; see sim.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "host.h"
+#include "host_alarm.h"
+#include "sim.h"
+
+#define SIM_FNV_OFFSET              (0xcbf29ce484222325ull)
+#define SIM_FNV_PRIME               (0x100000001b3ull)
+
+#define SIM_TASKS_MAX               (16)
+#define SIM_TASK_NAME_MAX           (16)
+
+typedef struct {
+    int64_t at;
+    uint64_t order;
+    sim_fn_t fn;
+    void *arg;
+    int kind;
+} sim_event_t;
+
+/*
+ * A task's thread only runs while it holds the cpu: whoever hands it
+ * over (the thread running the events) waits until the task gives it
+ * back by blocking, so only one thread ever runs at a time.
+ */
+typedef struct {
+    sim_kind_t kind;
+    char name[SIM_TASK_NAME_MAX];
+    int id;
+    pthread_cond_t go;
+    bool on_cpu;
+    bool gone;                  // deleted itself
+    bool (*ready)(void *ctx);   // what it's blocked on; NULL for a delay
+    void *ctx;
+    int64_t until;
+    int64_t due;                // INT64_MAX while it's blocked
+    uint64_t order;
+} sim_task_t;
+
+typedef enum {
+    SIM_PICK_NONE,
+    SIM_PICK_EVENT,
+    SIM_PICK_TASK,
+    SIM_PICK_ALARM,
+} sim_pick_type_t;
+
+// Whatever's next, of an event, a task or an alarm:
+typedef struct {
+    sim_pick_type_t type;
+    uint32_t index;             // into m_events, m_tasks or m_alarm_kinds
+    int kind;
+    int64_t at;
+    uint64_t order;
+} sim_pick_t;
+
+typedef struct {
+    const char *name;
+    uint32_t budget_usec;
+} sim_budget_t;
+
+// The tasks that run them on the board: ESP_TASK_TIMER_PRIO and configTIMER_TASK_PRIORITY in v3.3
+static const sim_kind_t m_peripheral_kinds[SIM_PERIPHERAL_COUNT] = {
+    [SIM_TIMER_ISR] = { "timer_isr", 0, true, 0 },
+    [SIM_GPIO_ISR] = { "gpio_isr", 0, true, 0 },
+    [SIM_ESP_TIMER] = { "esp_timer", 22, false, 0 },
+    [SIM_TMR_SVC] = { "tmr_svc", 1, false, 0 },
+};
+
+static const struct {
+    sim_peripheral_t peripheral;
+    host_alarm_source_t source;
+} m_alarm_kinds[] = {
+    { SIM_TIMER_ISR, HOST_ALARM_ISR },
+    { SIM_ESP_TIMER, HOST_ALARM_ESP_TIMER },
+    { SIM_TMR_SVC, HOST_ALARM_TMR_SVC },
+};
+
+#define SIM_ALARM_KINDS             (sizeof(m_alarm_kinds) / sizeof(m_alarm_kinds[0]))
+
+static sim_event_t m_events[SIM_EVENTS_MAX];
+static uint32_t m_event_count = 0;
+static uint64_t m_order = 0;
+
+static const sim_kind_t *m_kinds[SIM_TRACKS_MAX];
+static sim_track_t m_tracks[SIM_TRACKS_MAX];
+static uint32_t m_track_count = 0;
+
+static sim_task_t *m_tasks[SIM_TASKS_MAX];
+static uint32_t m_task_count = 0;
+static int m_peripherals[SIM_PERIPHERAL_COUNT];
+static sim_budget_t m_budgets[SIM_TRACKS_MAX];
+static uint32_t m_budget_count = 0;
+
+static pthread_mutex_t m_cpu_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t m_cpu_back = PTHREAD_COND_INITIALIZER;
+static __thread sim_task_t *m_self = NULL;
+
+static uint32_t m_running = 0;             // a bit per kind with an event on the stack
+static bool m_in_isr = false;
+static int m_priority = -1;                 // of the event running; -1 for none
+static uint64_t m_rng = 0;
+static uint64_t m_digest = SIM_FNV_OFFSET;
+
+static void digest(uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        m_digest = (m_digest ^ ((value >> (8 * i)) & 0xff)) * SIM_FNV_PRIME;
+    }
+}
+
+// While the running event waits anything else can run; while it's busy, only what would preempt it:
+static bool runnable(int id, bool busy)
+{
+    const sim_kind_t *kind = m_kinds[id];
+
+    if (kind->isr || m_in_isr) {
+        return !m_in_isr;
+    }
+    return ((m_running & (1u << id)) == 0 && (!busy || kind->priority > m_priority));
+}
+
+// Whether 'a' goes before 'b', both due:
+static bool before(const sim_pick_t *a, const sim_pick_t *b)
+{
+    const sim_kind_t *ka = m_kinds[a->kind];
+    const sim_kind_t *kb = m_kinds[b->kind];
+
+    if (ka->isr != kb->isr) {
+        return ka->isr;
+    }
+    if (ka->priority != kb->priority) {
+        return ka->priority > kb->priority;
+    }
+    if (a->at != b->at) {
+        return a->at < b->at;
+    }
+    return a->order < b->order;
+}
+
+static void consider(sim_pick_t *best, int64_t *next, const sim_pick_t *candidate, int64_t now, bool busy)
+{
+    if (!runnable(candidate->kind, busy)) {
+        return;
+    }
+    if (candidate->at > now) {
+        *next = (candidate->at < *next ? candidate->at : *next);
+    } else if (best->type == SIM_PICK_NONE || before(candidate, best)) {
+        *best = *candidate;
+    }
+}
+
+/*
+ * A blocked task falls due the first time we find it ready, or when
+ * it times out; until then *next covers its timeout.
+ */
+static bool task_due(sim_task_t *task, int64_t now, bool busy, int64_t *next)
+{
+    if (task->gone || task->on_cpu) {
+        return false;
+    }
+    if (task->due == INT64_MAX) {
+        if (task->ready != NULL && task->ready(task->ctx)) {
+            task->due = now;
+        } else if (task->until <= now) {
+            task->due = task->until;
+        } else {
+            if (runnable(task->id, busy) && task->until < *next) {
+                *next = task->until;
+            }
+            return false;
+        }
+        task->order = m_order++;
+    }
+    return true;
+}
+
+/*
+ * What's due to run next, if anything can; *next is left at the
+ * earliest time something that can't yet will be due.
+ */
+static sim_pick_t pick(int64_t now, bool busy, int64_t *next)
+{
+    sim_pick_t best = { .type = SIM_PICK_NONE };
+
+    *next = INT64_MAX;
+    for (uint32_t i = 0; i < m_event_count; i++) {
+        const sim_event_t *event = &m_events[i];
+        sim_pick_t candidate = { SIM_PICK_EVENT, i, event->kind, event->at, event->order };
+
+        consider(&best, next, &candidate, now, busy);
+    }
+    for (uint32_t i = 0; i < m_task_count; i++) {
+        sim_task_t *task = m_tasks[i];
+
+        if (task_due(task, now, busy, next)) {
+            sim_pick_t candidate = { SIM_PICK_TASK, i, task->id, task->due, task->order };
+
+            consider(&best, next, &candidate, now, busy);
+        }
+    }
+    for (uint32_t i = 0; i < SIM_ALARM_KINDS; i++) {
+        sim_pick_t candidate = { SIM_PICK_ALARM, i, -1, 0, 0 };
+
+        if (host_alarm_next(m_alarm_kinds[i].source, &candidate.at)) {
+            candidate.kind = sim_peripheral(m_alarm_kinds[i].peripheral);
+            consider(&best, next, &candidate, now, busy);
+        }
+    }
+    return best;
+}
+
+static void run_as(int kind, int64_t due, sim_fn_t fn, void *arg)
+{
+    int64_t start = host_time_usec();
+
+    sim_record(kind, start - due);
+    digest((uint64_t) kind);
+    digest((uint64_t) due);
+    digest((uint64_t) start);
+
+    uint32_t running = m_running;
+    bool in_isr = m_in_isr;
+    int priority = m_priority;
+
+    m_running |= (1u << kind);
+    m_in_isr = m_kinds[kind]->isr;
+    m_priority = m_kinds[kind]->priority;
+    fn(arg);
+    m_running = running;
+    m_in_isr = in_isr;
+    m_priority = priority;
+}
+
+// Hands the cpu to the task, and has it back once the task blocks again:
+static void run_task(sim_task_t *task)
+{
+    int64_t start = host_time_usec();
+
+    sim_record(task->id, start - task->due);
+    digest((uint64_t) task->id);
+    digest((uint64_t) task->due);
+    digest((uint64_t) start);
+    task->due = INT64_MAX;
+
+    pthread_mutex_lock(&m_cpu_lock);
+    task->on_cpu = true;
+    pthread_cond_signal(&task->go);
+    while (task->on_cpu) {
+        pthread_cond_wait(&m_cpu_back, &m_cpu_lock);
+    }
+    pthread_mutex_unlock(&m_cpu_lock);
+}
+
+static void fire_alarm(void *arg)
+{
+    host_alarm_fire((host_alarm_t *) arg);
+}
+
+static void run_pick(const sim_pick_t *next)
+{
+    switch (next->type) {
+    case SIM_PICK_EVENT: {
+        sim_event_t event = m_events[next->index];
+
+        m_events[next->index] = m_events[--m_event_count];
+        run_as(event.kind, event.at, event.fn, event.arg);
+        break;
+    }
+    case SIM_PICK_TASK:
+        run_task(m_tasks[next->index]);
+        break;
+    case SIM_PICK_ALARM: {
+        int64_t at;
+        host_alarm_t *alarm = host_alarm_take(m_alarm_kinds[next->index].source, host_time_usec(), &at);
+
+        if (alarm != NULL) {
+            run_as(next->kind, at, fire_alarm, alarm);
+        }
+        break;
+    }
+    case SIM_PICK_NONE:
+        break;
+    }
+}
+
+// Runs what can run until the clock reaches 'end', then leaves it there:
+static uint32_t run_until(int64_t end)
+{
+    uint32_t ran = 0;
+
+    while (true) {
+        int64_t next;
+        sim_pick_t due = pick(host_time_usec(), false, &next);
+
+        if (due.type != SIM_PICK_NONE) {
+            run_pick(&due);
+            ran++;
+        } else if (next <= end) {
+            // Nothing to do until then; whatever's due at that point goes in the usual order:
+            host_clock_virtual(next);
+        } else {
+            break;
+        }
+    }
+    if (host_time_usec() < end) {
+        host_clock_virtual(end);
+    }
+    return ran;
+}
+
+// The task gives the cpu back, and waits to be handed it again:
+static void task_block(sim_task_t *task, bool (*ready)(void *ctx), void *ctx, int64_t until)
+{
+    pthread_mutex_lock(&m_cpu_lock);
+    task->ready = ready;
+    task->ctx = ctx;
+    task->until = until;
+    task->on_cpu = false;
+    pthread_cond_signal(&m_cpu_back);
+    while (!task->on_cpu) {
+        pthread_cond_wait(&task->go, &m_cpu_lock);
+    }
+    pthread_mutex_unlock(&m_cpu_lock);
+}
+
+// host_clock_advance() comes here: the running event or task waits, and others get their turn:
+static void sim_advance(int64_t usec)
+{
+    int64_t end = host_time_usec() + usec;
+
+    if (m_self != NULL) {
+        task_block(m_self, NULL, NULL, end);
+        return;
+    }
+    if (m_in_isr) {
+        host_clock_virtual(end);
+        return;
+    }
+    run_until(end);
+}
+
+static int add_track(const char *name, uint32_t budget_usec)
+{
+    if (m_track_count >= SIM_TRACKS_MAX) {
+        return -1;
+    }
+
+    sim_track_t *track = &m_tracks[m_track_count];
+
+    track->name = name;
+    track->budget_usec = budget_usec;
+    latency_hist_reset(&track->hist);
+    return (int) m_track_count++;
+}
+
+// A task or peripheral, with whatever budget sim_budget() gave its name:
+static int add_named(const sim_kind_t *kind)
+{
+    uint32_t budget_usec = kind->budget_usec;
+
+    for (uint32_t i = 0; i < m_budget_count; i++) {
+        if (strcmp(m_budgets[i].name, kind->name) == 0) {
+            budget_usec = m_budgets[i].budget_usec;
+        }
+    }
+
+    int id = add_track(kind->name, budget_usec);
+
+    if (id < 0) {
+        fprintf(stderr, "%s(): no room for %s, past SIM_TRACKS_MAX\n", __func__, kind->name);
+        abort();
+    }
+    m_kinds[id] = kind;
+    return id;
+}
+
+static void *sched_create(const char *name, unsigned priority)
+{
+    sim_task_t *task = calloc(1, sizeof(*task));
+
+    if (task == NULL || m_task_count >= SIM_TASKS_MAX) {
+        fprintf(stderr, "%s(): no room for task %s\n", __func__, name);
+        abort();
+    }
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->kind = (sim_kind_t) { task->name, (uint8_t) priority, false, 0 };
+    task->id = add_named(&task->kind);
+    pthread_cond_init(&task->go, NULL);
+    task->until = INT64_MAX;
+
+    // Ready to run as soon as it's created:
+    task->due = host_time_usec();
+    task->order = m_order++;
+
+    m_tasks[m_task_count++] = task;
+    return task;
+}
+
+static void sched_start(void *arg)
+{
+    sim_task_t *task = (sim_task_t *) arg;
+
+    m_self = task;
+    pthread_mutex_lock(&m_cpu_lock);
+    while (!task->on_cpu) {
+        pthread_cond_wait(&task->go, &m_cpu_lock);
+    }
+    pthread_mutex_unlock(&m_cpu_lock);
+}
+
+/*
+ * A task blocks until it's handed the cpu again. Anything else (an
+ * event, or the test itself) runs the rest nested, as it does for a
+ * wait, until it's ready or the time's up.
+ */
+static void sched_wait(bool (*ready)(void *ctx), void *ctx, int64_t until)
+{
+    if (m_self != NULL) {
+        task_block(m_self, ready, ctx, until);
+        return;
+    }
+
+    while (!ready(ctx)) {
+        int64_t now = host_time_usec();
+        int64_t next;
+
+        if (now >= until) {
+            return;
+        }
+
+        sim_pick_t due = pick(now, false, &next);
+
+        if (due.type != SIM_PICK_NONE) {
+            run_pick(&due);
+        } else if (next < until) {
+            host_clock_virtual(next);
+        } else if (until != INT64_MAX) {
+            host_clock_virtual(until);
+        } else {
+            fprintf(stderr, "%s(): blocked for good, with nothing left that could wake it\n", __func__);
+            abort();
+        }
+    }
+}
+
+static void sched_exit(void)
+{
+    pthread_mutex_lock(&m_cpu_lock);
+    m_self->gone = true;
+    m_self->on_cpu = false;
+    pthread_cond_signal(&m_cpu_back);
+    pthread_mutex_unlock(&m_cpu_lock);
+}
+
+static const host_sched_t m_sched = {
+    .create = sched_create,
+    .start = sched_start,
+    .wait = sched_wait,
+    .exit = sched_exit,
+};
+
+void sim_init(uint64_t seed, int64_t start_usec)
+{
+    memset(m_events, 0, sizeof(m_events));
+    m_event_count = 0;
+    m_order = 0;
+    memset(m_kinds, 0, sizeof(m_kinds));
+    memset(m_tracks, 0, sizeof(m_tracks));
+    m_track_count = 0;
+    m_task_count = 0;
+    m_budget_count = 0;
+    for (int i = 0; i < SIM_PERIPHERAL_COUNT; i++) {
+        m_peripherals[i] = -1;
+    }
+    m_running = 0;
+    m_in_isr = false;
+    m_priority = -1;
+    m_rng = seed;
+    m_digest = SIM_FNV_OFFSET;
+
+    host_clock_virtual(start_usec);
+    host_clock_hook(sim_advance);
+    host_sched_hook(&m_sched);
+    host_alarm_driven(true);
+}
+
+int sim_add_kind(const sim_kind_t *kind)
+{
+    int id = add_track(kind->name, kind->budget_usec);
+
+    if (id >= 0) {
+        m_kinds[id] = kind;
+    }
+    return id;
+}
+
+int sim_add_probe(const char *name, uint32_t budget_usec)
+{
+    return add_track(name, budget_usec);
+}
+
+void sim_budget(const char *name, uint32_t budget_usec)
+{
+    uint32_t i = 0;
+
+    while (i < m_budget_count && strcmp(m_budgets[i].name, name) != 0) {
+        i++;
+    }
+    if (i == m_budget_count) {
+        if (m_budget_count >= SIM_TRACKS_MAX) {
+            return;
+        }
+        m_budget_count++;
+    }
+    m_budgets[i] = (sim_budget_t) { name, budget_usec };
+
+    for (uint32_t id = 0; id < m_track_count; id++) {
+        if (m_kinds[id] != NULL && strcmp(m_tracks[id].name, name) == 0) {
+            m_tracks[id].budget_usec = budget_usec;
+        }
+    }
+}
+
+int sim_peripheral(sim_peripheral_t peripheral)
+{
+    if (m_peripherals[peripheral] < 0) {
+        m_peripherals[peripheral] = add_named(&m_peripheral_kinds[peripheral]);
+    }
+    return m_peripherals[peripheral];
+}
+
+static void gpio_edge(void *arg)
+{
+    intptr_t edge = (intptr_t) arg;
+
+    host_gpio_input((int)(edge >> 1), (uint32_t)(edge & 1));
+}
+
+bool sim_gpio(int64_t at, int gpio, uint32_t level)
+{
+    return sim_at(at, sim_peripheral(SIM_GPIO_ISR), gpio_edge, (void *)(intptr_t)((gpio << 1) | (level != 0)));
+}
+
+bool sim_at(int64_t at, int kind, sim_fn_t fn, void *arg)
+{
+    if (m_event_count >= SIM_EVENTS_MAX || kind < 0 || kind >= (int) m_track_count || m_kinds[kind] == NULL) {
+        return false;
+    }
+
+    sim_event_t *event = &m_events[m_event_count++];
+
+    event->at = at;
+    event->order = m_order++;
+    event->fn = fn;
+    event->arg = arg;
+    event->kind = kind;
+    return true;
+}
+
+bool sim_after(int64_t delay_usec, int kind, sim_fn_t fn, void *arg)
+{
+    return sim_at(host_time_usec() + delay_usec, kind, fn, arg);
+}
+
+uint32_t sim_run(int64_t until)
+{
+    return run_until(until);
+}
+
+int64_t sim_now(void)
+{
+    return host_time_usec();
+}
+
+void sim_busy(int64_t usec)
+{
+    if (m_in_isr) {
+        host_clock_virtual(host_time_usec() + usec);
+        return;
+    }
+
+    // A task that's busy only lets the others in as a wait would; it doesn't keep its priority:
+    if (m_self != NULL) {
+        task_block(m_self, NULL, NULL, host_time_usec() + usec);
+        return;
+    }
+
+    // The time anything that preempts us takes isn't ours:
+    while (true) {
+        int64_t now = host_time_usec();
+        int64_t next;
+        sim_pick_t due = pick(now, true, &next);
+
+        if (due.type != SIM_PICK_NONE) {
+            run_pick(&due);
+        } else if (next < now + usec) {
+            usec -= next - now;
+            host_clock_virtual(next);
+        } else {
+            host_clock_virtual(now + usec);
+            return;
+        }
+    }
+}
+
+void sim_record(int probe, int64_t usec)
+{
+    if (probe < 0 || probe >= (int) m_track_count) {
+        return;
+    }
+
+    sim_track_t *track = &m_tracks[probe];
+    uint32_t value = (usec < 0 ? 0 : (usec > UINT32_MAX ? UINT32_MAX : (uint32_t) usec));
+
+    latency_hist_record(&track->hist, value);
+    if (track->budget_usec != 0 && value > track->budget_usec) {
+        track->over_budget++;
+    }
+}
+
+// splitmix64, so any seed (0 included) is a good one:
+uint32_t sim_random(void)
+{
+    uint64_t z = (m_rng += 0x9e3779b97f4a7c15ull);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+int64_t sim_random_between(int64_t lo, int64_t hi)
+{
+    uint64_t span = (uint64_t)(hi - lo) + 1;
+    uint64_t r = ((uint64_t) sim_random() << 32) | sim_random();
+
+    return (span == 0 ? lo + (int64_t) r : lo + (int64_t)(r % span));
+}
+
+const sim_track_t *sim_get_track(int id)
+{
+    return (id >= 0 && id < (int) m_track_count ? &m_tracks[id] : NULL);
+}
+
+uint64_t sim_digest(void)
+{
+    return m_digest;
+}
+
+bool sim_report(void)
+{
+    bool ok = true;
+
+    printf("    %-16s %9s %9s %9s %9s %9s %6s\n", "usec late", "count", "p50", "p99", "max", "budget", "over");
+    for (uint32_t i = 0; i < m_track_count; i++) {
+        const sim_track_t *track = &m_tracks[i];
+
+        printf("    %-16s %9u %9u %9u %9u %9u %6u\n", track->name, track->hist.count,
+               latency_hist_percentile(&track->hist, 50), latency_hist_percentile(&track->hist, 99),
+               (track->hist.count > 0 ? track->hist.max : 0), track->budget_usec, track->over_budget);
+        ok = ok && track->over_budget == 0;
+    }
+    return ok;
+}
@@ -0,0 +1,126 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * sim.h - a deterministic discrete-event simulator on the host build's
+ * virtual clock, for running the real code through hours of device
+ * time in seconds
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "latency_hist.h"
+
+/*
+ * Everything happens in events: a function to call at a time, of a
+ * kind that says who runs it. There's one cpu, and a task only ever
+ * runs while everything else waits for it, so a run with the same
+ * seed makes the same calls at the same virtual times, every time
+ * (sim_digest() says so).
+ *
+ * An event runs to the end once it starts. When several are due, isr
+ * kinds go first, then the highest priority, then the earliest, then
+ * the first scheduled. Time only moves while nothing is due, or while
+ * an event waits or is busy. A wait is vTaskDelay(), a block on a
+ * queue, semaphore or notification, a timed i2c or spi transaction
+ * (see host_i2c_timing()) or anything else that ends in
+ * host_clock_advance(); while it waits, whatever falls due runs, as
+ * other tasks would on the board, except another event of its own
+ * kind (a task can't run twice at once). A block that could only end
+ * with something else running, and nothing left to run, is a
+ * deadlock, and aborts. sim_busy() is time spent working instead,
+ * which only isrs and higher priority kinds get to preempt, and it
+ * ends that much later if they do. An isr never waits, and nothing
+ * preempts it but the next isr's being due.
+ *
+ * It's one cpu, like a CONFIG_FREERTOS_UNICORE build, and an event
+ * that was waiting only picks up again once whatever it let in has
+ * finished, even if that was of a lower priority.
+ *
+ * The real tasks run too. Each task created after sim_init() is a
+ * kind of its own, named after it and at its FreeRTOS priority, that
+ * falls due when whatever it's blocked on is ready (or it times out)
+ * and runs until it blocks again. It isn't preempted in between, any
+ * more than an event is. So do the shim's peripherals: the timer
+ * group's alarms and gpio edges (sim_gpio()) run as isrs, and
+ * esp_timer and software timer callbacks at the priorities of the
+ * tasks that run them on the board, each a kind of its own.
+ *
+ * Every kind and probe has a latency budget. A kind's events count
+ * against it by how late they start after they're due (a task's, by
+ * how long it was ready before it ran); a probe counts whatever the
+ * test hands sim_record(), typically from a stimulus to the code
+ * noticing it. Tasks and peripherals start with none; sim_budget()
+ * gives them one.
+ */
+#define SIM_EVENTS_MAX              (256)       // pending at once
+#define SIM_TRACKS_MAX              (32)        // kinds, tasks, peripherals and probes
+
+typedef void (*sim_fn_t)(void *arg);
+
+typedef struct {
+    const char *name;
+    uint8_t priority;           // higher goes first
+    bool isr;
+    uint32_t budget_usec;       // how late one may start; 0 for no limit
+} sim_kind_t;
+
+typedef struct {
+    const char *name;
+    uint32_t budget_usec;       // 0 for no limit
+    uint32_t over_budget;
+    latency_hist_t hist;
+} sim_track_t;
+
+/*
+ * Puts the host clock on virtual time from 'start_usec', and forgets
+ * all kinds, probes and events. Tasks created before this are left
+ * blocked where they are, for good.
+ */
+void sim_init(uint64_t seed, int64_t start_usec);
+
+// Both return the id to use with the calls below, or -1 if there's no room:
+int sim_add_kind(const sim_kind_t *kind);
+int sim_add_probe(const char *name, uint32_t budget_usec);
+
+// The budget for the task or peripheral called 'name', from now or from whenever it's created:
+void sim_budget(const char *name, uint32_t budget_usec);
+
+typedef enum {
+    SIM_TIMER_ISR,              // "timer_isr"
+    SIM_GPIO_ISR,               // "gpio_isr"
+    SIM_ESP_TIMER,              // "esp_timer", the esp_timer task
+    SIM_TMR_SVC,                // "tmr_svc", the timer service task
+
+    SIM_PERIPHERAL_COUNT
+} sim_peripheral_t;
+
+// A peripheral's kind id, for scheduling other events as it (the stimulus behind a gpio edge, say):
+int sim_peripheral(sim_peripheral_t peripheral);
+
+// Drives 'gpio' to 'level' at 'at' (see host_gpio_input()), as a gpio isr:
+bool sim_gpio(int64_t at, int gpio, uint32_t level);
+
+// False if there are SIM_EVENTS_MAX pending already:
+bool sim_at(int64_t at, int kind, sim_fn_t fn, void *arg);
+bool sim_after(int64_t delay_usec, int kind, sim_fn_t fn, void *arg);
+
+// Runs events until the clock gets to 'until', and leaves it there; returns how many ran:
+uint32_t sim_run(int64_t until);
+
+int64_t sim_now(void);
+void sim_busy(int64_t usec);
+void sim_record(int probe, int64_t usec);
+
+// From the seed alone:
+uint32_t sim_random(void);
+int64_t sim_random_between(int64_t lo, int64_t hi);
+
+const sim_track_t *sim_get_track(int id);
+
+// Of every event run so far: its kind, when it was due and when it started:
+uint64_t sim_digest(void);
+
+// A line per kind and probe; false if any went over its budget:
+bool sim_report(void);
@@ -0,0 +1,29 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * gpio_struct.h - host stand-in for the gpio registers, as far as the
+ * per-pin configuration goes. The shim's isr dispatch reads int_type
+ * from here, so writing it works as it does on the chip.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef volatile struct {
+    union {
+        struct {
+            uint32_t sync2_bypass: 2;
+            uint32_t pad_driver: 1;
+            uint32_t sync1_bypass: 2;
+            uint32_t reserved5: 2;
+            uint32_t int_type: 3;
+            uint32_t wakeup_enable: 1;
+            uint32_t config: 2;
+            uint32_t int_ena: 5;
+            uint32_t reserved18: 14;
+        };
+        uint32_t val;
+    } pin[40];
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
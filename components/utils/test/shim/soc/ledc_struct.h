@@ -0,0 +1,61 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * ledc_struct.h - host stand-in for the ledc channel registers. The
+ * duty register (counts, with four fractional bits) is the one the
+ * shim's ledc_update_duty() latches, so writing it directly works as
+ * it does on the chip.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef volatile struct {
+    struct {
+        struct {
+            union {
+                struct {
+                    uint32_t timer_sel: 2;
+                    uint32_t sig_out_en: 1;
+                    uint32_t idle_lv: 1;
+                    uint32_t reserved4: 27;
+                    uint32_t clk_en: 1;
+                };
+                uint32_t val;
+            } conf0;
+            union {
+                struct {
+                    uint32_t hpoint: 20;
+                    uint32_t reserved20: 12;
+                };
+                uint32_t val;
+            } hpoint;
+            union {
+                struct {
+                    uint32_t duty: 25;
+                    uint32_t reserved25: 7;
+                };
+                uint32_t val;
+            } duty;
+            union {
+                struct {
+                    uint32_t duty_scale: 10;
+                    uint32_t duty_cycle: 10;
+                    uint32_t duty_num: 10;
+                    uint32_t duty_inc: 1;
+                    uint32_t duty_start: 1;
+                };
+                uint32_t val;
+            } conf1;
+            union {
+                struct {
+                    uint32_t duty_read: 25;
+                    uint32_t reserved25: 7;
+                };
+                uint32_t val;
+            } duty_rd;
+        } channel[8];
+    } channel_group[2];
+} ledc_dev_t;
+
+extern ledc_dev_t LEDC;
@@ -0,0 +1,13 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * soc.h - host stand-in: just the bit macros
+ */
+
+#pragma once
+
+#ifndef BIT
+#define BIT(nr)                     (1UL << (nr))
+#endif
+#ifndef BIT64
+#define BIT64(nr)                   (1ULL << (nr))
+#endif
@@ -0,0 +1,55 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * timer_group_struct.h - host stand-in for the timer group registers
+ * an isr touches. The shim's timer model (timer.c) latches the
+ * counter before calling the isr, and looks at alarm_en and
+ * int_clr_timers once it returns, as the hardware would.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef union {
+    struct {
+        uint32_t t0: 1;
+        uint32_t t1: 1;
+        uint32_t wdt: 1;
+        uint32_t lact: 1;
+        uint32_t reserved4: 28;
+    };
+    uint32_t val;
+} timg_int_timers_t;
+
+typedef volatile struct {
+    struct {
+        union {
+            struct {
+                uint32_t reserved0: 10;
+                uint32_t alarm_en: 1;
+                uint32_t level_int_en: 1;
+                uint32_t edge_int_en: 1;
+                uint32_t divider: 16;
+                uint32_t autoreload: 1;
+                uint32_t increase: 1;
+                uint32_t enable: 1;
+            };
+            uint32_t val;
+        } config;
+        uint32_t cnt_low;
+        uint32_t cnt_high;
+        uint32_t update;
+        uint32_t alarm_low;
+        uint32_t alarm_high;
+        uint32_t load_low;
+        uint32_t load_high;
+        uint32_t reload;
+    } hw_timer[2];
+    timg_int_timers_t int_ena_timers;
+    timg_int_timers_t int_raw_timers;
+    timg_int_timers_t int_st_timers;
+    timg_int_timers_t int_clr_timers;
+} timg_dev_t;
+
+extern timg_dev_t TIMERG0;
+extern timg_dev_t TIMERG1;
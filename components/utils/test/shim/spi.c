@@ -0,0 +1,202 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * spi.c - host stand-in for the spi master driver
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "driver/spi_master.h"
+#include "host.h"
+
+#define SPI_HOST_COUNT              (3)
+#define SPI_MAX_TRANSFER            (4094)
+
+struct spi_device_t {
+    spi_host_device_t host;
+    spi_device_interface_config_t config;
+    volatile uint32_t busy;
+};
+
+typedef struct {
+    bool initialized;
+    host_spi_slave_t slave;
+    bool attached;
+} spi_bus_t;
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static spi_bus_t m_buses[SPI_HOST_COUNT];
+static host_spi_stats_t m_stats;
+static bool m_timing = false;
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dma_chan)
+{
+    if (host < 0 || host >= SPI_HOST_COUNT || config == NULL || dma_chan < 0 || dma_chan > 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    esp_err_t ret = (m_buses[host].initialized ? ESP_ERR_INVALID_STATE : ESP_OK);
+    m_buses[host].initialized = true;
+    pthread_mutex_unlock(&m_lock);
+
+    return ret;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host)
+{
+    if (host < 0 || host >= SPI_HOST_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    esp_err_t ret = (m_buses[host].initialized ? ESP_OK : ESP_ERR_INVALID_STATE);
+    m_buses[host].initialized = false;
+    pthread_mutex_unlock(&m_lock);
+
+    return ret;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config,
+                             spi_device_handle_t *handle)
+{
+    if (host < 0 || host >= SPI_HOST_COUNT || config == NULL || handle == NULL || config->clock_speed_hz <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!m_buses[host].initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    struct spi_device_t *device = calloc(1, sizeof(*device));
+
+    if (device == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    device->host = host;
+    device->config = *config;
+
+    *handle = device;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle)
+{
+    free(handle);
+    return ESP_OK;
+}
+
+/*
+ * Full duplex: the slave sees the bytes clocked out and fills in the
+ * ones clocked in at the same time. Two threads in here at once on
+ * the same device is a misuse the real driver doesn't catch either,
+ * so it's only counted.
+ */
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans)
+{
+    if (handle == NULL || trans == NULL || trans->length == 0 || trans->length > SPI_MAX_TRANSFER * 8) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (__atomic_fetch_add(&handle->busy, 1, __ATOMIC_SEQ_CST) != 0) {
+        __atomic_add_fetch(&m_stats.overlaps, 1, __ATOMIC_SEQ_CST);
+    }
+
+    if (trans->rxlength == 0) {
+        trans->rxlength = trans->length;
+    }
+
+    size_t len = (trans->length + 7) / 8;
+    uint8_t *tx = calloc(1, len);
+    uint8_t *rx = calloc(1, len);
+    const uint8_t *tx_src = ((trans->flags & SPI_TRANS_USE_TXDATA) ? trans->tx_data : trans->tx_buffer);
+    esp_err_t ret = ESP_OK;
+
+    if (tx_src != NULL) {
+        memcpy(tx, tx_src, len);
+    }
+
+    pthread_mutex_lock(&m_lock);
+    spi_bus_t bus = m_buses[handle->host];
+    m_stats.transactions++;
+    m_stats.bytes += len;
+    pthread_mutex_unlock(&m_lock);
+
+    if (bus.attached) {
+        ret = bus.slave.transfer(bus.slave.ctx, tx, rx, len);
+    } else {
+        memset(rx, 0xff, len);      // nothing pulling miso down
+    }
+
+    size_t rx_len = (trans->rxlength + 7) / 8;
+
+    if (trans->flags & SPI_TRANS_USE_RXDATA) {
+        memcpy(trans->rx_data, rx, (rx_len < sizeof(trans->rx_data) ? rx_len : sizeof(trans->rx_data)));
+    } else if (trans->rx_buffer != NULL) {
+        memcpy(trans->rx_buffer, rx, (rx_len < len ? rx_len : len));
+    }
+    free(tx);
+    free(rx);
+
+    if (m_timing && host_clock_is_virtual()) {
+        host_clock_advance(((int64_t) trans->length * 1000000 + handle->config.clock_speed_hz - 1)
+                           / handle->config.clock_speed_hz);
+    }
+    if (handle->config.post_cb != NULL) {
+        handle->config.post_cb(trans);
+    }
+
+    __atomic_sub_fetch(&handle->busy, 1, __ATOMIC_SEQ_CST);
+    return ret;
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans)
+{
+    return spi_device_polling_transmit(handle, trans);
+}
+
+esp_err_t spi_device_polling_start(spi_device_handle_t handle, spi_transaction_t *trans, TickType_t wait)
+{
+    (void) wait;
+    return spi_device_polling_transmit(handle, trans);
+}
+
+esp_err_t spi_device_polling_end(spi_device_handle_t handle, TickType_t wait)
+{
+    (void) wait;
+    return (handle != NULL ? ESP_OK : ESP_ERR_INVALID_ARG);
+}
+
+void host_spi_attach(int host, const host_spi_slave_t *slave)
+{
+    if (host >= 0 && host < SPI_HOST_COUNT) {
+        pthread_mutex_lock(&m_lock);
+        m_buses[host].attached = (slave != NULL);
+        if (slave != NULL) {
+            m_buses[host].slave = *slave;
+        }
+        pthread_mutex_unlock(&m_lock);
+    }
+}
+
+void host_spi_timing(bool on)
+{
+    m_timing = on;
+}
+
+void host_spi_get_stats(host_spi_stats_t *stats)
+{
+    pthread_mutex_lock(&m_lock);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_lock);
+}
+
+void host_spi_reset_stats(void)
+{
+    pthread_mutex_lock(&m_lock);
+    memset(&m_stats, 0, sizeof(m_stats));
+    pthread_mutex_unlock(&m_lock);
+}
@@ -0,0 +1,24 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * sys/reent.h - host stand-in for the bits of newlib's per-task stdio
+ * state the console uses, and the funopen() that goes with it
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+// Just the stream console_out_init() swaps:
+struct _reent {
+    FILE *_stdout;
+};
+
+extern struct _reent *_global_impure_ptr;
+#define _GLOBAL_REENT               _global_impure_ptr
+
+// newlib's funopen(), on top of glibc's fopencookie():
+FILE *funopen(const void *cookie,
+              int (*readfn)(void *cookie, char *buf, int len),
+              int (*writefn)(void *cookie, const char *buf, int len),
+              long (*seekfn)(void *cookie, long offset, int whence),
+              int (*closefn)(void *cookie));
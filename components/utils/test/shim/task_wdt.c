@@ -0,0 +1,118 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * task_wdt.c - host stand-in for the task watchdog; see esp_task_wdt.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "host.h"
+
+#define HOST_WDT_TASKS              (16)
+
+typedef struct {
+    TaskHandle_t task;
+    int64_t last_reset;
+} wdt_entry_t;
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t m_timeout_us = (int64_t) CONFIG_TASK_WDT_TIMEOUT_S * 1000000;
+static wdt_entry_t m_entries[HOST_WDT_TASKS];
+static uint32_t m_timeouts = 0;
+
+static wdt_entry_t *wdt_find(TaskHandle_t task)
+{
+    for (int i = 0; i < HOST_WDT_TASKS; i++) {
+        if (m_entries[i].task == task) {
+            return &m_entries[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_task_wdt_init(uint32_t timeout, bool panic)
+{
+    (void) panic;
+
+    pthread_mutex_lock(&m_lock);
+    m_timeout_us = (int64_t) timeout * 1000000;
+    pthread_mutex_unlock(&m_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add(TaskHandle_t handle)
+{
+    TaskHandle_t task = (handle != NULL ? handle : xTaskGetCurrentTaskHandle());
+    esp_err_t ret = ESP_ERR_NO_MEM;
+
+    pthread_mutex_lock(&m_lock);
+    if (wdt_find(task) != NULL) {
+        ret = ESP_ERR_INVALID_ARG;
+    } else {
+        wdt_entry_t *entry = wdt_find(NULL);
+
+        if (entry != NULL) {
+            entry->task = task;
+            entry->last_reset = esp_timer_get_time();
+            ret = ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+    return ret;
+}
+
+esp_err_t esp_task_wdt_delete(TaskHandle_t handle)
+{
+    TaskHandle_t task = (handle != NULL ? handle : xTaskGetCurrentTaskHandle());
+    esp_err_t ret = ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_lock(&m_lock);
+    wdt_entry_t *entry = wdt_find(task);
+    if (entry != NULL) {
+        entry->task = NULL;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&m_lock);
+    return ret;
+}
+
+esp_err_t esp_task_wdt_reset(void)
+{
+    int64_t now = esp_timer_get_time();
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    pthread_mutex_lock(&m_lock);
+    wdt_entry_t *entry = wdt_find(xTaskGetCurrentTaskHandle());
+    if (entry != NULL) {
+        if (now - entry->last_reset > m_timeout_us) {
+            m_timeouts++;
+        }
+        entry->last_reset = now;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&m_lock);
+    return ret;
+}
+
+esp_err_t esp_task_wdt_status(TaskHandle_t handle)
+{
+    TaskHandle_t task = (handle != NULL ? handle : xTaskGetCurrentTaskHandle());
+
+    pthread_mutex_lock(&m_lock);
+    esp_err_t ret = (wdt_find(task) != NULL ? ESP_OK : ESP_ERR_NOT_FOUND);
+    pthread_mutex_unlock(&m_lock);
+    return ret;
+}
+
+uint32_t host_task_wdt_timeouts(void)
+{
+    pthread_mutex_lock(&m_lock);
+    uint32_t timeouts = m_timeouts;
+    pthread_mutex_unlock(&m_lock);
+    return timeouts;
+}
@@ -0,0 +1,304 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * timer.c - host model of the timer groups: counters off the host
+ * clock, and alarms that run the isr through the shim's alarm list
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/timer.h"
+#include "soc/timer_group_struct.h"
+#include "host_alarm.h"
+#include "host.h"
+
+typedef struct {
+    timg_dev_t *regs;
+    timer_group_t group;
+    timer_idx_t idx;
+    bool running;
+    uint64_t base;              // the count at 'since'
+    int64_t since;
+    uint64_t alarm;
+    uint64_t load;
+    void (*isr)(void *arg);
+    void *isr_arg;
+    host_alarm_t due;
+} timer_state_t;
+
+timg_dev_t TIMERG0;
+timg_dev_t TIMERG1;
+
+static timer_state_t m_timers[TIMER_GROUP_MAX][TIMER_MAX];
+
+static void timer_alarm(void *arg);
+
+static timer_state_t *timer_get(timer_group_t group, timer_idx_t idx)
+{
+    if (group < 0 || group >= TIMER_GROUP_MAX || idx < 0 || idx >= TIMER_MAX) {
+        return NULL;
+    }
+
+    timer_state_t *timer = &m_timers[group][idx];
+
+    if (timer->regs == NULL) {
+        timer->regs = (group == TIMER_GROUP_0 ? &TIMERG0 : &TIMERG1);
+        timer->group = group;
+        timer->idx = idx;
+        timer->due.fn = timer_alarm;
+        timer->due.arg = timer;
+        timer->due.source = HOST_ALARM_ISR;
+    }
+    return timer;
+}
+
+static uint32_t timer_divider(const timer_state_t *timer)
+{
+    uint32_t divider = timer->regs->hw_timer[timer->idx].config.divider;
+
+    return (divider == 0 ? 65536 : divider);
+}
+
+// The rest run inside the critical section, as the isr does:
+static uint64_t timer_count(const timer_state_t *timer, int64_t now)
+{
+    if (!timer->running) {
+        return timer->base;
+    }
+    return timer->base + (uint64_t)(now - timer->since) * (TIMER_BASE_CLK / 1000000) / timer_divider(timer);
+}
+
+static void timer_rebase(timer_state_t *timer, uint64_t count, int64_t now)
+{
+    timer->base = count;
+    timer->since = now;
+}
+
+// Puts the alarm on the list for when the counter gets to it, if it's running and enabled:
+static void timer_schedule(timer_state_t *timer)
+{
+    bool enabled = (timer->regs->hw_timer[timer->idx].config.alarm_en
+                    && (timer->regs->int_ena_timers.val & BIT(timer->idx)));
+
+    if (!timer->running || !enabled) {
+        host_alarm_stop(&timer->due);
+        return;
+    }
+
+    int64_t now = host_time_usec();
+    uint64_t count = timer_count(timer, now);
+    uint64_t left = (timer->alarm > count ? timer->alarm - count : 0);
+    uint64_t per_usec = TIMER_BASE_CLK / 1000000;
+    int64_t usec = (int64_t)((left * timer_divider(timer) + per_usec - 1) / per_usec);
+
+    host_alarm_start(&timer->due, now + usec, 0);
+}
+
+/*
+ * The hardware clears alarm_en, reloads if it's meant to and raises
+ * the interrupt. The isr acks it with int_clr_timers, and sets
+ * alarm_en again if it wants another.
+ */
+static void timer_alarm(void *arg)
+{
+    timer_state_t *timer = (timer_state_t *) arg;
+    timg_dev_t *regs = timer->regs;
+    int64_t now = host_time_usec();
+
+    if (!timer->running || !regs->hw_timer[timer->idx].config.alarm_en) {
+        return;
+    }
+
+    uint64_t count = (regs->hw_timer[timer->idx].config.autoreload ? timer->load : timer->alarm);
+
+    timer_rebase(timer, count, now);
+    regs->hw_timer[timer->idx].config.alarm_en = 0;
+    regs->hw_timer[timer->idx].cnt_low = (uint32_t) count;
+    regs->hw_timer[timer->idx].cnt_high = (uint32_t)(count >> 32);
+    regs->int_raw_timers.val |= BIT(timer->idx);
+    regs->int_st_timers.val |= BIT(timer->idx);
+    regs->int_clr_timers.val = 0;
+
+    if (timer->isr != NULL) {
+        timer->isr(timer->isr_arg);
+    }
+
+    if (regs->int_clr_timers.val & BIT(timer->idx)) {
+        regs->int_raw_timers.val &= ~BIT(timer->idx);
+        regs->int_st_timers.val &= ~BIT(timer->idx);
+    }
+    regs->int_clr_timers.val = 0;
+    timer_schedule(timer);
+}
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t idx, const timer_config_t *config)
+{
+    timer_state_t *timer = timer_get(group, idx);
+
+    if (timer == NULL || config == NULL || config->divider < 2 || config->divider > 65536
+        || config->counter_dir != TIMER_COUNT_UP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_critical_enter();
+    int64_t now = host_time_usec();
+
+    timer_rebase(timer, timer_count(timer, now), now);
+    timer->regs->hw_timer[idx].config.divider = config->divider & 0xffff;
+    timer->regs->hw_timer[idx].config.autoreload = config->auto_reload;
+    timer->regs->hw_timer[idx].config.increase = 1;
+    timer->regs->hw_timer[idx].config.alarm_en = config->alarm_en;
+    timer->regs->hw_timer[idx].config.level_int_en = 1;
+    timer->running = config->counter_en;
+    timer->regs->hw_timer[idx].config.enable = timer->running;
+    timer_schedule(timer);
+    host_critical_exit();
+
+    return ESP_OK;
+}
+
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t idx, uint64_t value)
+{
+    timer_state_t *timer = timer_get(group, idx);
+
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_critical_enter();
+    timer->load = value;
+    timer_rebase(timer, value, host_time_usec());
+    timer_schedule(timer);
+    host_critical_exit();
+
+    return ESP_OK;
+}
+
+esp_err_t timer_get_counter_value(timer_group_t group, timer_idx_t idx, uint64_t *value)
+{
+    timer_state_t *timer = timer_get(group, idx);
+
+    if (timer == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_critical_enter();
+    *value = timer_count(timer, host_time_usec());
+    host_critical_exit();
+
+    return ESP_OK;
+}
+
+esp_err_t timer_set_alarm_value(timer_group_t group, timer_idx_t idx, uint64_t value)
+{
+    timer_state_t *timer = timer_get(group, idx);
+
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_critical_enter();
+    timer->alarm = value;
+    timer_schedule(timer);
+    host_critical_exit();
+
+    return ESP_OK;
+}
+
+esp_err_t timer_set_alarm(timer_group_t group, timer_idx_t idx, timer_alarm_t alarm_en)
+{
+    timer_state_t *timer = timer_get(group, idx);
+
+    if (timer == NULL || alarm_en >= TIMER_ALARM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_critical_enter();
+    timer->regs->hw_timer[idx].config.alarm_en = alarm_en;
+    timer_schedule(timer);
+    host_critical_exit();
+
+    return ESP_OK;
+}
+
+static esp_err_t timer_set_intr(timer_group_t group, timer_idx_t idx, bool enable)
+{
+    timer_state_t *timer = timer_get(group, idx);
+
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_critical_enter();
+    if (enable) {
+        timer->regs->int_ena_timers.val |= BIT(idx);
+    } else {
+        timer->regs->int_ena_timers.val &= ~BIT(idx);
+    }
+    timer_schedule(timer);
+    host_critical_exit();
+
+    return ESP_OK;
+}
+
+esp_err_t timer_enable_intr(timer_group_t group, timer_idx_t idx)
+{
+    return timer_set_intr(group, idx, true);
+}
+
+esp_err_t timer_disable_intr(timer_group_t group, timer_idx_t idx)
+{
+    return timer_set_intr(group, idx, false);
+}
+
+esp_err_t timer_isr_register(timer_group_t group, timer_idx_t idx, void (*fn)(void *arg), void *arg,
+                             int intr_alloc_flags, timer_isr_handle_t *handle)
+{
+    timer_state_t *timer = timer_get(group, idx);
+
+    (void) intr_alloc_flags;
+    if (timer == NULL || fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_critical_enter();
+    timer->isr = fn;
+    timer->isr_arg = arg;
+    host_critical_exit();
+
+    if (handle != NULL) {
+        *handle = (timer_isr_handle_t) timer;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t timer_run(timer_group_t group, timer_idx_t idx, bool run)
+{
+    timer_state_t *timer = timer_get(group, idx);
+
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_critical_enter();
+    int64_t now = host_time_usec();
+
+    timer_rebase(timer, timer_count(timer, now), now);
+    timer->running = run;
+    timer->regs->hw_timer[idx].config.enable = run;
+    timer_schedule(timer);
+    host_critical_exit();
+
+    return ESP_OK;
+}
+
+esp_err_t timer_start(timer_group_t group, timer_idx_t idx)
+{
+    return timer_run(group, idx, true);
+}
+
+esp_err_t timer_pause(timer_group_t group, timer_idx_t idx)
+{
+    return timer_run(group, idx, false);
+}
@@ -0,0 +1,97 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * timers.c - host stand-in for FreeRTOS software timers, on the shim's
+ * alarm list
+ */
+
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "host_alarm.h"
+#include "host.h"
+
+struct host_timer {
+    host_alarm_t alarm;
+    const char *name;
+    TickType_t period;
+    bool auto_reload;
+    void *id;
+    TimerCallbackFunction_t callback;
+};
+
+static void timer_fire(void *arg)
+{
+    struct host_timer *timer = (struct host_timer *) arg;
+
+    timer->callback(timer);
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    if (period == 0 || callback == NULL) {
+        return NULL;
+    }
+
+    struct host_timer *timer = calloc(1, sizeof(*timer));
+
+    if (timer != NULL) {
+        timer->alarm.fn = timer_fire;
+        timer->alarm.arg = timer;
+        timer->alarm.source = HOST_ALARM_TMR_SVC;
+        timer->name = name;
+        timer->period = period;
+        timer->auto_reload = (auto_reload != pdFALSE);
+        timer->id = id;
+        timer->callback = callback;
+    }
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait)
+{
+    int64_t period = (int64_t) timer->period * portTICK_PERIOD_MS * 1000;
+
+    (void) wait;
+    host_alarm_start(&timer->alarm, host_time_usec() + period, (timer->auto_reload ? period : 0));
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait)
+{
+    (void) wait;
+    host_alarm_stop(&timer->alarm);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait)
+{
+    return xTimerStart(timer, wait);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait)
+{
+    if (period == 0) {
+        return pdFAIL;
+    }
+    timer->period = period;
+    return xTimerStart(timer, wait);
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t wait)
+{
+    xTimerStop(timer, wait);
+    free(timer);
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return (host_alarm_armed(&timer->alarm) ? pdTRUE : pdFALSE);
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
@@ -0,0 +1,12 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * hal.h - host stand-in for the cycle counter: the host clock scaled to
+ * a CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ core, so cycle arithmetic in the
+ * code under test comes out in the right units
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+uint32_t xthal_get_ccount(void);
@@ -0,0 +1,260 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_adc_lut.c - the lookup table against the reference conversion
+ * at all 4096 codes, for every attenuation over the range of vrefs the
+ * efuse can hold, for two point calibrations, and for the table
+ * esp_adc_cal switches to near the top of the 11dB range
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "unit.h"
+#include "adc_lut.h"
+
+#define ATTENS              (4)                 // 0, 2.5, 6 and 11dB
+#define ATTEN_11DB          (3)
+#define LIN_COEFF_A_SCALE   (65536)
+
+// esp_adc_cal's table for 11dB, above this code:
+#define LUT_LOW_THRESH      (2880)
+#define LUT_STEP            (64)
+#define LUT_HIGH_THRESH     (LUT_LOW_THRESH + LUT_STEP)
+#define LUT_POINTS          (20)
+#define LUT_VREF_LOW        (1000)
+#define LUT_VREF_HIGH       (1200)
+
+/*
+ * esp_adc_cal_raw_to_voltage() as esp-idf v3.3 has it for adc1: a
+ * straight line with its slope in 1/65536 mV per code, from the vref
+ * (or two point values) in the efuse. At 11dB, from LUT_LOW_THRESH
+ * up, it interpolates a table of voltages every LUT_STEP codes for
+ * vrefs of 1000 and 1200mV instead, blending from the line to the
+ * table over the first step. The curves here are made up (esp-idf's
+ * own aren't in this tree) but bend the same way.
+ */
+typedef struct {
+    uint32_t coeff_a;
+    uint32_t coeff_b;
+    uint32_t vref;
+    bool curve;
+} ref_t;
+
+static uint32_t m_not_monotonic = 0;
+static uint32_t m_check_disagrees = 0;
+static uint32_t m_low_curve[LUT_POINTS];
+static uint32_t m_high_curve[LUT_POINTS];
+
+static const uint32_t m_atten_scale[ATTENS] = { 57431, 76236, 105481, 196602 };
+static const uint32_t m_atten_offset[ATTENS] = { 75, 78, 107, 142 };
+
+static uint32_t linear(const ref_t *ref, uint32_t raw)
+{
+    return ((ref->coeff_a * raw) + LIN_COEFF_A_SCALE / 2) / LIN_COEFF_A_SCALE + ref->coeff_b;
+}
+
+// Bilinear in vref and code, with the one rounding at the end, as esp_adc_cal does it:
+static uint32_t lut_voltage(const ref_t *ref, uint32_t raw)
+{
+    uint32_t i = (raw - LUT_LOW_THRESH) / LUT_STEP;
+    int x2dist = LUT_VREF_HIGH - (int) ref->vref;
+    int x1dist = (int) ref->vref - LUT_VREF_LOW;
+    int y2dist = (int)((i + 1) * LUT_STEP + LUT_LOW_THRESH - raw);
+    int y1dist = (int)(raw - (i * LUT_STEP + LUT_LOW_THRESH));
+    int voltage = (int) m_low_curve[i] * x2dist * y2dist + (int) m_high_curve[i] * x1dist * y2dist
+                  + (int) m_low_curve[i + 1] * x2dist * y1dist + (int) m_high_curve[i + 1] * x1dist * y1dist;
+
+    voltage += ((LUT_VREF_HIGH - LUT_VREF_LOW) * LUT_STEP) / 2;
+    return (uint32_t)(voltage / ((LUT_VREF_HIGH - LUT_VREF_LOW) * LUT_STEP));
+}
+
+static uint32_t reference(uint32_t raw, void *arg)
+{
+    const ref_t *ref = arg;
+
+    if (!ref->curve || raw < LUT_LOW_THRESH) {
+        return linear(ref, raw);
+    }
+
+    int lut = (int) lut_voltage(ref, raw);
+
+    if (raw > LUT_HIGH_THRESH) {
+        return (uint32_t) lut;
+    }
+
+    int line = (int) linear(ref, raw);
+    int x = (int)(raw - LUT_LOW_THRESH);
+
+    return (uint32_t)((line * LUT_STEP + lut * x - line * x + LUT_STEP / 2) / LUT_STEP);
+}
+
+static ref_t vref_ref(uint32_t atten, uint32_t vref)
+{
+    ref_t ref = {
+        .coeff_a = (vref * m_atten_scale[atten]) / ADC_LUT_CODES,
+        .coeff_b = m_atten_offset[atten],
+        .vref = vref,
+        .curve = (atten == ATTEN_11DB),
+    };
+    return ref;
+}
+
+// Each vref's line, sagging by more at each point up to a few percent at the top:
+static void make_curves(void)
+{
+    ref_t low = vref_ref(ATTEN_11DB, LUT_VREF_LOW);
+    ref_t high = vref_ref(ATTEN_11DB, LUT_VREF_HIGH);
+
+    for (uint32_t i = 0; i < LUT_POINTS; i++) {
+        uint32_t raw = LUT_LOW_THRESH + i * LUT_STEP;
+
+        m_low_curve[i] = linear(&low, raw) - 2 * i * i / 3;
+        m_high_curve[i] = linear(&high, raw) - 3 * i * i / 4;
+    }
+}
+
+static ref_t two_point_ref(uint32_t low_raw, uint32_t low_mv, uint32_t high_raw, uint32_t high_mv)
+{
+    ref_t ref;
+
+    ref.coeff_a = (LIN_COEFF_A_SCALE * (high_mv - low_mv)) / (high_raw - low_raw);
+    ref.coeff_b = low_mv - ((ref.coeff_a * low_raw) + LIN_COEFF_A_SCALE / 2) / LIN_COEFF_A_SCALE;
+    ref.vref = 0;
+    ref.curve = false;
+    return ref;
+}
+
+/*
+ * Every code, compared here rather than trusting adc_lut_check(),
+ * which has to agree (m_check_disagrees), and the table has to rise
+ * with the code (m_not_monotonic). Returns the worst difference.
+ */
+static uint32_t compare_all(ref_t *ref, uint32_t *worst_raw)
+{
+    static adc_lut_t lut;
+    uint32_t worst = 0;
+    uint32_t check_raw;
+    uint32_t last = 0;
+    bool monotonic = true;
+
+    adc_lut_build(&lut, reference, ref);
+    for (uint32_t raw = 0; raw < ADC_LUT_CODES; raw++) {
+        uint32_t want = reference(raw, ref);
+        uint32_t got = adc_lut_mv(&lut, raw);
+        uint32_t error = (got > want ? got - want : want - got);
+
+        if (error > worst) {
+            worst = error;
+            *worst_raw = raw;
+        }
+        monotonic = monotonic && got >= last;
+        last = got;
+    }
+
+    m_not_monotonic += !monotonic;
+    m_check_disagrees += (adc_lut_check(&lut, reference, ref, &check_raw) != worst
+                          || (worst > 0 && check_raw != *worst_raw));
+    return worst;
+}
+
+static void test_vref(void)
+{
+    uint32_t worst = 0;
+    uint32_t worst_raw;
+
+    // The efuse vref is 1100mV +/- 100, in 7mV steps; every mV to be sure:
+    for (uint32_t atten = 0; atten < ATTEN_11DB; atten++) {
+        for (uint32_t vref = 1000; vref <= 1200; vref++) {
+            ref_t ref = vref_ref(atten, vref);
+            uint32_t error = compare_all(&ref, &worst_raw);
+
+            worst = (error > worst ? error : worst);
+        }
+    }
+    CHECK(worst <= 1);
+    printf("    %u attenuations x 201 vrefs x %u codes: within %u mV\n", ATTEN_11DB, ADC_LUT_CODES, worst);
+}
+
+static void test_two_point(void)
+{
+    uint32_t worst = 0;
+    uint32_t worst_raw;
+
+    // esp_adc_cal's two point values are raw readings of 150mV and 850mV at 0dB, about 2600 codes apart:
+    srand(4047);
+    for (int i = 0; i < 2000; i++) {
+        uint32_t low_raw = 450 + rand() % 100;
+        uint32_t high_raw = low_raw + 2550 + rand() % 100;
+        ref_t ref = two_point_ref(low_raw, 150, high_raw, 850);
+        uint32_t error = compare_all(&ref, &worst_raw);
+
+        worst = (error > worst ? error : worst);
+    }
+    CHECK(worst <= 1);
+}
+
+/*
+ * Past the blend, esp_adc_cal's table bends only every LUT_STEP codes,
+ * a multiple of ours, so ours follows it to a millivolt. The blend is
+ * a product of two straight lines, so it does curve across the first
+ * step, but by too little to matter.
+ */
+static void test_11db_curve(void)
+{
+    uint32_t worst = 0;
+    uint32_t worst_blend = 0;
+    uint32_t worst_raw;
+    static adc_lut_t lut;
+
+    for (uint32_t vref = LUT_VREF_LOW; vref <= LUT_VREF_HIGH; vref++) {
+        ref_t ref = vref_ref(ATTEN_11DB, vref);
+
+        compare_all(&ref, &worst_raw);
+        adc_lut_build(&lut, reference, &ref);
+        for (uint32_t raw = 0; raw < ADC_LUT_CODES; raw++) {
+            uint32_t want = reference(raw, &ref);
+            uint32_t got = adc_lut_mv(&lut, raw);
+            uint32_t error = (got > want ? got - want : want - got);
+
+            if (raw > LUT_LOW_THRESH && raw < LUT_HIGH_THRESH) {
+                worst_blend = (error > worst_blend ? error : worst_blend);
+            } else {
+                worst = (error > worst ? error : worst);
+            }
+        }
+    }
+    CHECK(worst <= 1);
+    CHECK(worst_blend <= 1);
+    printf("    11dB x 201 vrefs: within %u mV, and %u mV in the blend from code %u to %u\n",
+           worst, worst_blend, LUT_LOW_THRESH, LUT_HIGH_THRESH);
+}
+
+static void test_ends(void)
+{
+    static adc_lut_t lut;
+    ref_t ref = vref_ref(0, 1100);
+
+    adc_lut_build(&lut, reference, &ref);
+    CHECK_EQ(adc_lut_mv(&lut, 0), reference(0, &ref));
+    CHECK(abs((int) adc_lut_mv(&lut, ADC_LUT_CODES - 1) - (int) reference(ADC_LUT_CODES - 1, &ref)) <= 1);
+
+    // Only 12 bits count:
+    CHECK_EQ(adc_lut_mv(&lut, ADC_LUT_CODES + 5), adc_lut_mv(&lut, 5));
+}
+
+int main(void)
+{
+    make_curves();
+
+    RUN(test_vref);
+    RUN(test_two_point);
+    RUN(test_11db_curve);
+    RUN(test_ends);
+
+    CHECK_EQ(m_not_monotonic, 0);
+    CHECK_EQ(m_check_disagrees, 0);
+
+    return unit_done();
+}
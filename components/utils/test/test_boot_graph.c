@@ -0,0 +1,334 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_boot_graph.c - the boot stages on simulated cores with made-up
+ * run times: dependencies and core restrictions hold, nothing stalls,
+ * and how much sooner the board is ready than booting serially
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "unit.h"
+#include "boot_graph.h"
+
+#define WORKERS_MAX         (3)
+#define PRO_CPU             (0)
+#define APP_CPU             (1)
+
+/*
+ * The HW_OMAR table in hw_setup.c, with run times in proportion to
+ * what the stages do: the ADE7953's 10ms reset pulse, the bit-banged
+ * s24c08 reset and driver installs, the adc's calibration.
+ */
+enum {
+    STAGE_GPIO,
+    STAGE_ADI,
+    STAGE_I2C,
+    STAGE_RELAY,
+    STAGE_ADC,
+    STAGE_LED,
+    STAGE_BUTTON,
+    STAGE_TIMER,
+    STAGE_THERMAL,
+    STAGE_COUNT
+};
+
+#define ANY_CPU             (0)
+#define APP_CPU_ONLY        BOOT_WORKER_BIT(APP_CPU)
+#define OMAR_BOOT_READY     (BOOT_STAGE_BIT(STAGE_ADI) | BOOT_STAGE_BIT(STAGE_RELAY))
+
+static void stage_fn(void)
+{
+}
+
+static const boot_stage_t m_omar_stages[STAGE_COUNT] = {
+    [STAGE_GPIO]    = { "gpio",     stage_fn,   0,                                                          ANY_CPU },
+    [STAGE_ADI]     = { "adi",      stage_fn,   BOOT_STAGE_BIT(STAGE_GPIO),                                 APP_CPU_ONLY },
+    [STAGE_I2C]     = { "i2c",      stage_fn,   BOOT_STAGE_BIT(STAGE_GPIO),                                 ANY_CPU },
+    [STAGE_RELAY]   = { "relay",    stage_fn,   BOOT_STAGE_BIT(STAGE_GPIO),                                 APP_CPU_ONLY },
+    [STAGE_ADC]     = { "adc",      stage_fn,   BOOT_STAGE_BIT(STAGE_GPIO),                                 ANY_CPU },
+    [STAGE_LED]     = { "led",      stage_fn,   BOOT_STAGE_BIT(STAGE_GPIO),                                 ANY_CPU },
+    [STAGE_BUTTON]  = { "button",   stage_fn,   BOOT_STAGE_BIT(STAGE_RELAY) | BOOT_STAGE_BIT(STAGE_LED),    APP_CPU_ONLY },
+    [STAGE_TIMER]   = { "timer",    stage_fn,   BOOT_STAGE_BIT(STAGE_LED) | BOOT_STAGE_BIT(STAGE_ADC),      APP_CPU_ONLY },
+    [STAGE_THERMAL] = { "thermal",  stage_fn,   BOOT_STAGE_BIT(STAGE_I2C) | BOOT_STAGE_BIT(STAGE_RELAY)
+                                                | BOOT_STAGE_BIT(STAGE_LED) | BOOT_STAGE_BIT(STAGE_BUTTON),  ANY_CPU },
+};
+
+static const int64_t m_omar_usec[STAGE_COUNT] = {
+    [STAGE_GPIO]    = 300,
+    [STAGE_ADI]     = 11000,
+    [STAGE_I2C]     = 5500,
+    [STAGE_RELAY]   = 800,
+    [STAGE_ADC]     = 2500,
+    [STAGE_LED]     = 600,
+    [STAGE_BUTTON]  = 400,
+    [STAGE_TIMER]   = 300,
+    [STAGE_THERMAL] = 1500,
+};
+
+typedef struct {
+    int stage;                      // running, or -1
+    int64_t until_us;
+    bool gone;                      // the caller, back from omar_boot_run() once we're ready
+} sim_worker_t;
+
+/*
+ * omar_boot.c's workers, in simulated time: each idle worker asks
+ * for a stage, starting with worker 'first' (on the target they
+ * race); then time jumps to the next stage to finish, which wakes
+ * everyone. Worker 0 is the caller, and if 'caller_leaves' it goes
+ * as soon as it's idle and the graph is ready. Returns false if the
+ * workers stall with stages left.
+ */
+static bool simulate(boot_graph_t *graph, const int64_t *usec, uint32_t workers, bool caller_leaves, uint32_t first)
+{
+    sim_worker_t sim[WORKERS_MAX];
+    int64_t now = 0;
+
+    graph->workers = BOOT_WORKER_BIT(workers) - 1;
+    for (uint32_t w = 0; w < workers; w++) {
+        sim[w] = (sim_worker_t) { .stage = -1 };
+    }
+
+    while (!boot_graph_all_done(graph)) {
+        int next = -1;
+
+        for (uint32_t i = 0; i < workers; i++) {
+            uint32_t w = (first + i) % workers;
+
+            if (sim[w].stage < 0 && w == 0 && caller_leaves && boot_graph_ready(graph)) {
+                sim[w].gone = true;
+            }
+            if (sim[w].stage < 0 && !sim[w].gone) {
+                sim[w].stage = boot_graph_next(graph, now, w);
+                sim[w].until_us = now + (sim[w].stage >= 0 ? usec[sim[w].stage] : 0);
+            }
+        }
+        for (uint32_t w = 0; w < workers; w++) {
+            if (sim[w].stage >= 0 && (next < 0 || sim[w].until_us < sim[next].until_us)) {
+                next = w;
+            }
+        }
+        if (next < 0) {
+            return false;
+        }
+
+        now = sim[next].until_us;
+        boot_graph_finish(graph, sim[next].stage, now);
+        sim[next].stage = -1;
+    }
+    return true;
+}
+
+// Every stage started after its dependencies finished, on a worker it was allowed, and no worker ran two at once:
+static bool schedule_ok(const boot_graph_t *graph)
+{
+    for (uint32_t i = 0; i < graph->count; i++) {
+        const boot_stage_time_t *t = &graph->times[i];
+        uint32_t allowed = graph->stages[i].workers & graph->workers;
+
+        if (allowed != 0 && !(allowed & BOOT_WORKER_BIT(t->worker))) {
+            return false;
+        }
+        for (uint32_t j = 0; j < graph->count; j++) {
+            const boot_stage_time_t *u = &graph->times[j];
+
+            if ((graph->stages[i].deps & BOOT_STAGE_BIT(j)) && u->end_us > t->start_us) {
+                return false;
+            }
+            if (j != i && u->worker == t->worker && u->start_us < t->end_us && t->start_us < u->end_us) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int64_t serial_usec(const int64_t *usec, uint32_t count)
+{
+    int64_t total = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        total += usec[i];
+    }
+    return total;
+}
+
+// When the last of 'mask' finished:
+static int64_t last_end_usec(const boot_graph_t *graph, uint32_t mask)
+{
+    int64_t last = 0;
+
+    for (uint32_t i = 0; i < graph->count; i++) {
+        if ((mask & BOOT_STAGE_BIT(i)) && graph->times[i].end_us > last) {
+            last = graph->times[i].end_us;
+        }
+    }
+    return last;
+}
+
+static void test_init_rejects(void)
+{
+    boot_graph_t graph;
+    boot_stage_t stages[3] = {
+        { "a", stage_fn, 0, 0 },
+        { "b", stage_fn, BOOT_STAGE_BIT(2), 0 },
+        { "c", stage_fn, BOOT_STAGE_BIT(1), 0 },
+    };
+
+    CHECK(!boot_graph_init(&graph, stages, 3, 0));
+    stages[2].deps = BOOT_STAGE_BIT(0);
+    CHECK(boot_graph_init(&graph, stages, 3, BOOT_STAGE_BIT(1)));
+    CHECK(!boot_graph_init(&graph, stages, 3, BOOT_STAGE_BIT(3)));
+    stages[0].deps = BOOT_STAGE_BIT(3);
+    CHECK(!boot_graph_init(&graph, stages, 3, 0));
+    stages[0].deps = BOOT_STAGE_BIT(0);
+    CHECK(!boot_graph_init(&graph, stages, 3, 0));
+    CHECK(!boot_graph_init(&graph, stages, 0, 0));
+    CHECK(!boot_graph_init(&graph, stages, BOOT_GRAPH_MAX_STAGES + 1, 0));
+}
+
+static void test_omar_two_cores(void)
+{
+    boot_graph_t graph;
+    int path[BOOT_GRAPH_MAX_STAGES];
+    int64_t serial = serial_usec(m_omar_usec, STAGE_COUNT);
+
+    // Whichever core gets to the table first:
+    for (uint32_t first = 0; first < 2; first++) {
+        CHECK(boot_graph_init(&graph, m_omar_stages, STAGE_COUNT, OMAR_BOOT_READY));
+        CHECK(simulate(&graph, m_omar_usec, 2, true, first));
+        CHECK(schedule_ok(&graph));
+
+        /*
+         * The ADE7953 and the relays are both kept to the app cpu, so
+         * ready is the gpios and the two of them back to back; the
+         * pro cpu gets everything else in the meantime:
+         */
+        CHECK_EQ(graph.ready_us, m_omar_usec[STAGE_GPIO] + m_omar_usec[STAGE_ADI] + m_omar_usec[STAGE_RELAY]);
+        CHECK_EQ(graph.times[STAGE_ADI].start_us, m_omar_usec[STAGE_GPIO]);
+        CHECK_EQ(boot_graph_critical_path(&graph, OMAR_BOOT_READY, path), 2);
+        CHECK_EQ(path[0], STAGE_GPIO);
+        CHECK_EQ(path[1], STAGE_RELAY);
+
+        // With the caller gone, the app cpu finishes the rest:
+        for (uint32_t i = 0; i < STAGE_COUNT; i++) {
+            if (graph.times[i].start_us >= graph.ready_us) {
+                CHECK_EQ(graph.times[i].worker, APP_CPU);
+            }
+        }
+
+        int64_t wall = last_end_usec(&graph, UINT32_MAX);
+
+        CHECK(wall < serial);
+        printf("    pro cpu %s: %lld usec serially; ready at %lld (%.2fx sooner), all done at %lld (%.2fx)\n",
+               (first == PRO_CPU ? "first" : "second"), (long long) serial, (long long) graph.ready_us,
+               (double) serial / graph.ready_us, (long long) wall, (double) serial / wall);
+    }
+}
+
+static void test_omar_one_core(void)
+{
+    boot_graph_t graph;
+
+    // CONFIG_FREERTOS_UNICORE: the app cpu isn't taking part, so its stages run on the only one there is:
+    CHECK(boot_graph_init(&graph, m_omar_stages, STAGE_COUNT, OMAR_BOOT_READY));
+    CHECK(simulate(&graph, m_omar_usec, 1, false, 0));
+    CHECK(schedule_ok(&graph));
+    CHECK_EQ(last_end_usec(&graph, UINT32_MAX), serial_usec(m_omar_usec, STAGE_COUNT));
+    for (uint32_t i = 0; i < STAGE_COUNT; i++) {
+        CHECK_EQ(graph.times[i].worker, PRO_CPU);
+    }
+}
+
+static void test_omar_caller_stays(void)
+{
+    boot_graph_t graph;
+
+    // If the caller kept going, both cores would share what's left and be done no later:
+    CHECK(boot_graph_init(&graph, m_omar_stages, STAGE_COUNT, OMAR_BOOT_READY));
+    CHECK(simulate(&graph, m_omar_usec, 2, false, 0));
+    CHECK(schedule_ok(&graph));
+
+    int64_t stays = last_end_usec(&graph, UINT32_MAX);
+
+    CHECK(boot_graph_init(&graph, m_omar_stages, STAGE_COUNT, OMAR_BOOT_READY));
+    simulate(&graph, m_omar_usec, 2, true, 0);
+    CHECK(stays <= last_end_usec(&graph, UINT32_MAX));
+}
+
+static void test_random_graphs(void)
+{
+    uint32_t failures = 0;
+
+    srand(4041);
+
+    /*
+     * Random acyclic graphs (a stage only waits on earlier ones, in a
+     * shuffled order), random run times and random core restrictions,
+     * on one to three workers. As omar_boot.h says, stages are only
+     * kept to helpers, since the caller may leave; and with no
+     * helpers it doesn't:
+     */
+    for (uint32_t run = 0; run < 2000; run++) {
+        boot_stage_t stages[BOOT_GRAPH_MAX_STAGES];
+        int64_t usec[BOOT_GRAPH_MAX_STAGES];
+        uint32_t order[BOOT_GRAPH_MAX_STAGES];
+        uint32_t count = 1 + rand() % BOOT_GRAPH_MAX_STAGES;
+        uint32_t workers = 1 + rand() % WORKERS_MAX;
+        boot_graph_t graph;
+
+        for (uint32_t i = 0; i < count; i++) {
+            order[i] = i;
+        }
+        for (uint32_t i = count - 1; i > 0; i--) {
+            uint32_t j = rand() % (i + 1);
+            uint32_t swap = order[i];
+
+            order[i] = order[j];
+            order[j] = swap;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            boot_stage_t *stage = &stages[order[i]];
+
+            *stage = (boot_stage_t) { "s", stage_fn, 0, 0 };
+            for (uint32_t j = 0; j < i; j++) {
+                if (rand() % 4 == 0) {
+                    stage->deps |= BOOT_STAGE_BIT(order[j]);
+                }
+            }
+            if (rand() % 3 == 0) {
+                stage->workers = BOOT_WORKER_BIT(1 + rand() % (WORKERS_MAX - 1));
+            }
+            usec[order[i]] = 1 + rand() % 1000;
+        }
+
+        uint32_t ready = rand() & (BOOT_STAGE_BIT(count) - 1);
+
+        if (!boot_graph_init(&graph, stages, count, ready)
+            ||
+            !simulate(&graph, usec, workers, (workers > 1), rand() % workers)
+            ||
+            !schedule_ok(&graph)
+            ||
+            (ready != 0 && graph.ready_us != last_end_usec(&graph, ready))) {
+            failures++;
+        }
+    }
+    CHECK_EQ(failures, 0);
+}
+
+int main(void)
+{
+    RUN(test_init_rejects);
+    RUN(test_omar_two_cores);
+    RUN(test_omar_one_core);
+    RUN(test_omar_caller_stays);
+    RUN(test_random_graphs);
+
+    return unit_done();
+}
@@ -0,0 +1,248 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_energy_log.c - the energy log gives back exactly what went in,
+ * reads only the blocks a query needs, survives a reset with what was
+ * flushed, wraps, and skips a damaged block, in a scratch directory
+ * standing in for the FAT partition
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unit.h"
+#include "energy_log.h"
+#include "energy_records.h"
+
+#define TEST_SLOTS          (16)
+
+static char m_dir[] = "/tmp/energy_log.XXXXXX";
+static char m_path[64];
+static energy_log_t m_log;
+static energy_log_index_t m_index[TEST_SLOTS];
+
+typedef struct {
+    uint32_t next;              // the record the next one should be
+    uint32_t count;
+    uint32_t wrong;
+    uint32_t stop_after;        // 0 for never
+} expect_t;
+
+static bool expect_record(const energy_log_record_t *record, void *arg)
+{
+    expect_t *expect = arg;
+    energy_log_record_t want;
+
+    energy_record(expect->next++, &want);
+    expect->wrong += !energy_records_equal(record, &want);
+    expect->count++;
+    return (expect->stop_after == 0 || expect->count < expect->stop_after);
+}
+
+static void start(void)
+{
+    remove(m_path);
+    CHECK(energy_log_init(&m_log, m_path, m_index, TEST_SLOTS));
+}
+
+static void append(uint32_t from, uint32_t to)
+{
+    energy_log_record_t record;
+    uint32_t failed = 0;
+
+    for (uint32_t i = from; i < to; i++) {
+        energy_record(i, &record);
+        failed += !energy_log_append(&m_log, &record);
+    }
+    CHECK_EQ(failed, 0);
+}
+
+// Queries records [first, last] by time, and checks they're those records in order:
+static uint32_t query(uint32_t first, uint32_t last, uint32_t expect_first)
+{
+    expect_t expect = { .next = expect_first };
+    energy_log_record_t from;
+    energy_log_record_t to;
+
+    energy_record(first, &from);
+    energy_record(last, &to);
+
+    uint32_t matched = energy_log_query(&m_log, from.time, to.time, expect_record, &expect);
+
+    CHECK_EQ(expect.wrong, 0);
+    CHECK_EQ(matched, expect.count);
+    return matched;
+}
+
+static void test_init_rejects(void)
+{
+    CHECK(!energy_log_init(&m_log, m_path, m_index, 1));
+}
+
+static void test_round_trip(void)
+{
+    energy_log_summary_t summary;
+
+    start();
+    append(0, 2000);
+    CHECK(m_log.stats.writes >= 3);
+    CHECK_EQ(m_log.stats.write_errors, 0);
+
+    // Sealed blocks from the file, the open one from ram:
+    CHECK_EQ(query(0, 1999, 0), 2000);
+
+    energy_log_get_summary(&m_log, &summary);
+    CHECK_EQ(summary.records, 2000);
+    CHECK_EQ(summary.blocks, m_log.seq + 1);
+    CHECK_EQ(summary.t_min, ENERGY_RECORDS_START);
+    CHECK_EQ(summary.t_max, ENERGY_RECORDS_START + 1999 * ENERGY_RECORDS_PERIOD);
+
+    printf("    %.2f bytes/record, %u records/block\n",
+           (double)(m_log.seq * ENERGY_LOG_BLOCK_SIZE) / (2000 - m_log.count), (2000 - m_log.count) / m_log.seq);
+}
+
+static void test_query_reads_only_its_blocks(void)
+{
+    uint32_t per_block;
+    uint32_t before;
+
+    start();
+    append(0, 3000);
+    CHECK(energy_log_flush(&m_log));
+    per_block = m_index[0].count;
+    CHECK(per_block > 100);
+
+    // A range inside one sealed block reads that block and no other:
+    before = m_log.stats.blocks_read;
+    CHECK_EQ(query(per_block + 10, per_block + 20, per_block + 10), 11);
+    CHECK_EQ(m_log.stats.blocks_read - before, 1);
+
+    // Straddling the first two:
+    before = m_log.stats.blocks_read;
+    CHECK_EQ(query(per_block - 5, per_block + 4, per_block - 5), 10);
+    CHECK_EQ(m_log.stats.blocks_read - before, 2);
+
+    // Only the open block, which is in ram:
+    before = m_log.stats.blocks_read;
+    CHECK_EQ(query(2990, 2999, 2990), 10);
+    CHECK_EQ(m_log.stats.blocks_read - before, 0);
+
+    // Before and after everything:
+    before = m_log.stats.blocks_read;
+    CHECK_EQ(energy_log_query(&m_log, 0, ENERGY_RECORDS_START - 1, expect_record, &(expect_t) { 0 }), 0);
+    CHECK_EQ(energy_log_query(&m_log, UINT32_MAX - 1, UINT32_MAX, expect_record, &(expect_t) { 0 }), 0);
+    CHECK_EQ(m_log.stats.blocks_read - before, 0);
+}
+
+static void test_query_stops(void)
+{
+    expect_t expect = { .stop_after = 7 };
+
+    start();
+    append(0, 1000);
+    CHECK_EQ(energy_log_query(&m_log, 0, UINT32_MAX, expect_record, &expect), 7);
+    CHECK_EQ(expect.wrong, 0);
+}
+
+static void test_reset_keeps_what_was_flushed(void)
+{
+    start();
+    append(0, 1500);
+    CHECK(energy_log_flush(&m_log));
+    CHECK(energy_log_flush(&m_log));    // nothing new, so nothing written
+    uint32_t writes = m_log.stats.writes;
+
+    append(1500, 1510);
+    CHECK_EQ(m_log.stats.writes, writes);
+
+    // A reset: the ten since the flush are gone...
+    CHECK(energy_log_init(&m_log, m_path, m_index, TEST_SLOTS));
+    CHECK_EQ(m_log.stats.bad_blocks, 0);
+    CHECK_EQ(query(0, 1509, 0), 1500);
+
+    // ...and the log carries on in the same open block, where it left off:
+    append(1500, 1600);
+    CHECK(energy_log_flush(&m_log));
+    CHECK(energy_log_init(&m_log, m_path, m_index, TEST_SLOTS));
+    CHECK_EQ(query(0, 1599, 0), 1600);
+}
+
+static void test_wrap(void)
+{
+    energy_log_summary_t summary;
+    uint32_t oldest;
+
+    start();
+    append(0, 20000);
+    CHECK(m_log.seq > 2 * TEST_SLOTS);
+
+    // The open block holds the oldest block's slot, so TEST_SLOTS - 1 sealed blocks are left:
+    oldest = m_index[(m_log.seq + 1) % TEST_SLOTS].t_min;
+    energy_log_get_summary(&m_log, &summary);
+    CHECK_EQ(summary.blocks, TEST_SLOTS);
+    CHECK_EQ(summary.t_min, oldest);
+
+    uint32_t first = (oldest - ENERGY_RECORDS_START) / ENERGY_RECORDS_PERIOD;
+
+    CHECK_EQ(query(0, 19999, first), 20000 - first);
+    CHECK_EQ(summary.records, 20000 - first);
+
+    // And comes back the same after a reset:
+    CHECK(energy_log_flush(&m_log));
+    CHECK(energy_log_init(&m_log, m_path, m_index, TEST_SLOTS));
+    CHECK_EQ(query(0, 19999, first), 20000 - first);
+}
+
+static void test_damaged_block(void)
+{
+    expect_t expect = { 0 };
+    uint32_t first_two;
+
+    start();
+    append(0, 2000);
+    CHECK(energy_log_flush(&m_log));
+    first_two = m_index[0].count + m_index[1].count;
+
+    // One byte of the second block's body:
+    FILE *f = fopen(m_path, "r+b");
+
+    fseek(f, ENERGY_LOG_BLOCK_SIZE + ENERGY_LOG_HEADER_LEN + 100, SEEK_SET);
+    fputc(fgetc(f) ^ 0x10, f);
+    fclose(f);
+
+    CHECK(energy_log_init(&m_log, m_path, m_index, TEST_SLOTS));
+    energy_log_query(&m_log, 0, UINT32_MAX, expect_record, &expect);
+    CHECK_EQ(m_log.stats.bad_blocks, 1);
+
+    // Everything but that block, and the records after it pick up where they should:
+    CHECK_EQ(expect.count, 2000 - m_index[1].count);
+    CHECK(expect.wrong > 0);
+    expect = (expect_t) { .next = first_two };
+    energy_log_query(&m_log, m_index[2].t_min, UINT32_MAX, expect_record, &expect);
+    CHECK_EQ(expect.count, 2000 - first_two);
+    CHECK_EQ(expect.wrong, 0);
+}
+
+int main(void)
+{
+    if (mkdtemp(m_dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(m_path, sizeof(m_path), "%s/energy.log", m_dir);
+
+    RUN(test_init_rejects);
+    RUN(test_round_trip);
+    RUN(test_query_reads_only_its_blocks);
+    RUN(test_query_stops);
+    RUN(test_reset_keeps_what_was_flushed);
+    RUN(test_wrap);
+    RUN(test_damaged_block);
+
+    remove(m_path);
+    rmdir(m_dir);
+    return unit_done();
+}
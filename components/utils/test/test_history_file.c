@@ -0,0 +1,221 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_history_file.c - the append-only history file, and recovery
+ * after a reset at every byte of an append and at every step of a
+ * compaction, in a scratch directory standing in for the FAT partition
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "unit.h"
+#include "history_file.h"
+
+#define TEST_LINES          (30)
+
+static char m_dir[] = "/tmp/history_file.XXXXXX";
+static char m_path[64];
+static char m_tmp_path[64];
+
+static char m_lines[TEST_LINES][64];
+static char *m_line_ptrs[TEST_LINES];
+
+static bool exists(const char *path)
+{
+    struct stat st;
+
+    return (stat(path, &st) == 0);
+}
+
+static size_t read_file(const char *path, char *buf, size_t max)
+{
+    FILE *f = fopen(path, "r");
+    size_t len;
+
+    if (f == NULL) {
+        return 0;
+    }
+    len = fread(buf, 1, max - 1, f);
+    buf[len] = '\0';
+    fclose(f);
+    return len;
+}
+
+static void write_file(const char *path, const char *data, size_t len)
+{
+    FILE *f = fopen(path, "w");
+
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+// What the file holds once lines [first, first + count) have been appended:
+static size_t expected(char *buf, uint32_t first, uint32_t count)
+{
+    size_t len = 0;
+
+    for (uint32_t i = first; i < first + count; i++) {
+        len += sprintf(buf + len, "%s\n", m_lines[i]);
+    }
+    return len;
+}
+
+static void reset_files(void)
+{
+    remove(m_path);
+    remove(m_tmp_path);
+}
+
+static void test_append(void)
+{
+    char want[4096], got[4096];
+
+    reset_files();
+    CHECK_EQ(history_file_recover(m_path, m_tmp_path), 0);
+
+    // One open/append/close per batch, however many lines are in it:
+    CHECK(history_file_append(m_path, m_line_ptrs, 1));
+    CHECK(history_file_append(m_path, m_line_ptrs + 1, 9));
+    CHECK_EQ(history_file_recover(m_path, m_tmp_path), 10);
+
+    expected(want, 0, 10);
+    read_file(m_path, got, sizeof(got));
+    CHECK(strcmp(got, want) == 0);
+}
+
+static void test_compact(void)
+{
+    char want[4096], got[4096];
+
+    reset_files();
+    CHECK(history_file_append(m_path, m_line_ptrs, TEST_LINES));
+
+    // Nothing to do below the limit:
+    CHECK_EQ(history_file_compact(m_path, m_tmp_path, TEST_LINES), TEST_LINES);
+
+    CHECK_EQ(history_file_compact(m_path, m_tmp_path, 12), 12);
+    CHECK(!exists(m_tmp_path));
+    expected(want, TEST_LINES - 12, 12);
+    read_file(m_path, got, sizeof(got));
+    CHECK(strcmp(got, want) == 0);
+}
+
+static void test_truncated_append(void)
+{
+    char full[4096], got[4096];
+    size_t size = expected(full, 0, TEST_LINES);
+    uint32_t failures = 0;
+
+    /*
+     * A reset part way through an append leaves the file cut short
+     * at any byte; every complete line before the cut survives, and
+     * the partial one is dropped:
+     */
+    for (size_t cut = 0; cut <= size; cut++) {
+        int lines = 0;
+        size_t keep = 0;
+
+        for (size_t i = 0; i < cut; i++) {
+            if (full[i] == '\n') {
+                lines++;
+                keep = i + 1;
+            }
+        }
+
+        reset_files();
+        write_file(m_path, full, cut);
+
+        int recovered = history_file_recover(m_path, m_tmp_path);
+
+        read_file(m_path, got, sizeof(got));
+        if (recovered != lines || strlen(got) != keep || memcmp(got, full, keep) != 0 || exists(m_tmp_path)) {
+            if (failures++ == 0) {
+                printf("    cut at %zu: %d lines, expected %d\n", cut, recovered, lines);
+            }
+        }
+
+        // ...and appending carries on from a line boundary:
+        if (!history_file_append(m_path, m_line_ptrs, 1) ||
+            history_file_recover(m_path, m_tmp_path) != lines + 1) {
+            failures++;
+        }
+    }
+    CHECK_EQ(failures, 0);
+}
+
+static void test_interrupted_compaction(void)
+{
+    char full[4096], kept[4096], got[4096];
+    size_t size = expected(full, 0, TEST_LINES);
+    size_t kept_size = expected(kept, TEST_LINES - 10, 10);
+    uint32_t failures = 0;
+
+    // Reset while the copy was being written: the original is intact, the copy goes
+    for (size_t cut = 0; cut <= kept_size; cut++) {
+        reset_files();
+        write_file(m_path, full, size);
+        write_file(m_tmp_path, kept, cut);
+
+        if (history_file_recover(m_path, m_tmp_path) != TEST_LINES ||
+            exists(m_tmp_path) ||
+            read_file(m_path, got, sizeof(got)) != size) {
+            failures++;
+        }
+    }
+    CHECK_EQ(failures, 0);
+
+    // Reset after the original was removed, before the rename: the copy is complete
+    reset_files();
+    write_file(m_tmp_path, kept, kept_size);
+    CHECK_EQ(history_file_recover(m_path, m_tmp_path), 10);
+    CHECK(!exists(m_tmp_path));
+    read_file(m_path, got, sizeof(got));
+    CHECK(strcmp(got, kept) == 0);
+
+    // Reset after the rename: nothing to do
+    CHECK_EQ(history_file_recover(m_path, m_tmp_path), 10);
+    read_file(m_path, got, sizeof(got));
+    CHECK(strcmp(got, kept) == 0);
+}
+
+static void test_errors(void)
+{
+    char missing[96];
+
+    snprintf(missing, sizeof(missing), "%s/no/such/dir/history.txt", m_dir);
+    CHECK(!history_file_append(missing, m_line_ptrs, 1));
+    CHECK_EQ(history_file_compact(missing, m_tmp_path, 10), -1);
+    CHECK_EQ(history_file_recover(missing, m_tmp_path), 0);
+}
+
+int main(void)
+{
+    if (mkdtemp(m_dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(m_path, sizeof(m_path), "%s/history.txt", m_dir);
+    snprintf(m_tmp_path, sizeof(m_tmp_path), "%s/history.tmp", m_dir);
+
+    for (int i = 0; i < TEST_LINES; i++) {
+        // Lines of different lengths, so cuts land in all sorts of places:
+        snprintf(m_lines[i], sizeof(m_lines[i]), "cmd%d --arg %.*s", i, i % 17, "abcdefghijklmnopq");
+        m_line_ptrs[i] = m_lines[i];
+    }
+
+    RUN(test_append);
+    RUN(test_compact);
+    RUN(test_truncated_append);
+    RUN(test_interrupted_compaction);
+    RUN(test_errors);
+
+    reset_files();
+    rmdir(m_dir);
+
+    return unit_done();
+}
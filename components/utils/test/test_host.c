@@ -0,0 +1,219 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_host.c - checks the esp-idf and FreeRTOS stand-ins themselves,
+ * since every other host test leans on them
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "driver/i2c.h"
+#include "xtensa/hal.h"
+#include "host.h"
+#include "unit.h"
+
+static QueueHandle_t m_requests;
+static QueueHandle_t m_replies;
+
+static void echo_task(void *arg)
+{
+    (void) arg;
+
+    while (1) {
+        uint32_t value;
+
+        xQueueReceive(m_requests, &value, portMAX_DELAY);
+        value *= 2;
+        xQueueSend(m_replies, &value, portMAX_DELAY);
+    }
+}
+
+static void test_queue_between_tasks(void)
+{
+    m_requests = xQueueCreate(4, sizeof(uint32_t));
+    m_replies = xQueueCreate(4, sizeof(uint32_t));
+    CHECK(xTaskCreate(echo_task, "echo", 2048, NULL, 5, NULL) == pdPASS);
+
+    for (uint32_t i = 1; i <= 100; i++) {
+        uint32_t reply = 0;
+
+        CHECK(xQueueSend(m_requests, &i, portMAX_DELAY) == pdTRUE);
+        CHECK(xQueueReceive(m_replies, &reply, portMAX_DELAY) == pdTRUE);
+        CHECK_EQ(reply, 2 * i);
+    }
+}
+
+static void test_queue_full_and_empty(void)
+{
+    QueueHandle_t queue = xQueueCreate(2, sizeof(uint16_t));
+    uint16_t in[3] = {1, 2, 3};
+    uint16_t out = 0;
+
+    CHECK(xQueueSend(queue, &in[0], 0) == pdTRUE);
+    CHECK(xQueueSend(queue, &in[1], 0) == pdTRUE);
+    CHECK(xQueueSend(queue, &in[2], 0) == pdFALSE);
+    CHECK_EQ(uxQueueMessagesWaiting(queue), 2);
+
+    CHECK(xQueueReceive(queue, &out, 0) == pdTRUE);
+    CHECK_EQ(out, 1);
+    CHECK(xQueueReceive(queue, &out, 0) == pdTRUE);
+    CHECK_EQ(out, 2);
+    CHECK(xQueueReceive(queue, &out, 0) == pdFALSE);
+
+    vQueueDelete(queue);
+}
+
+static void test_semaphores(void)
+{
+    SemaphoreHandle_t binary = xSemaphoreCreateBinary();
+    SemaphoreHandle_t counting = xSemaphoreCreateCounting(3, 2);
+    SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+
+    CHECK(xSemaphoreTake(binary, 0) == pdFALSE);
+    CHECK(xSemaphoreGive(binary) == pdTRUE);
+    CHECK(xSemaphoreGive(binary) == pdFALSE);
+    CHECK(xSemaphoreTake(binary, 0) == pdTRUE);
+
+    CHECK(xSemaphoreTake(counting, 0) == pdTRUE);
+    CHECK(xSemaphoreTake(counting, 0) == pdTRUE);
+    CHECK(xSemaphoreTake(counting, 0) == pdFALSE);
+
+    CHECK(xSemaphoreTake(mutex, 0) == pdTRUE);
+    CHECK(xSemaphoreTake(mutex, 0) == pdFALSE);
+    CHECK(xSemaphoreGive(mutex) == pdTRUE);
+}
+
+static void test_real_timeout(void)
+{
+    SemaphoreHandle_t never = xSemaphoreCreateBinary();
+    int64_t start = esp_timer_get_time();
+
+    CHECK(xSemaphoreTake(never, 2) == pdFALSE);
+
+    int64_t waited = esp_timer_get_time() - start;
+
+    CHECK(waited >= 2 * portTICK_PERIOD_MS * 1000);
+    CHECK(waited < 1000000);
+}
+
+static void test_virtual_clock(void)
+{
+    host_clock_virtual(1000000);
+    CHECK_EQ(esp_timer_get_time(), 1000000);
+    CHECK_EQ(xTaskGetTickCount(), 1000000 / (portTICK_PERIOD_MS * 1000));
+
+    // An hour of delays takes no time at all:
+    for (int i = 0; i < 3600; i++) {
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+    }
+    CHECK_EQ(esp_timer_get_time(), 1000000 + 3600LL * 1000000);
+
+    host_clock_advance(5);
+    CHECK_EQ(esp_timer_get_time(), 1000005 + 3600LL * 1000000);
+    CHECK_EQ(xthal_get_ccount(), (uint32_t)((1000005 + 3600LL * 1000000) * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ));
+
+    SemaphoreHandle_t never = xSemaphoreCreateBinary();
+    int64_t start = esp_timer_get_time();
+
+    // Nothing else is waiting, so the clock jumps to the timeout:
+    CHECK(xSemaphoreTake(never, 50) == pdFALSE);
+    CHECK_EQ(esp_timer_get_time() - start, 50 * portTICK_PERIOD_MS * 1000);
+}
+
+static uint8_t m_slave_reg = 0;
+static uint8_t m_slave_regs[4] = {0x10, 0x20, 0x30, 0x40};
+
+static esp_err_t slave_write(void *ctx, const uint8_t *data, size_t len)
+{
+    (void) ctx;
+    m_slave_reg = data[0];
+    for (size_t i = 1; i < len; i++) {
+        m_slave_regs[(m_slave_reg + i - 1) & 3] = data[i];
+    }
+    return ESP_OK;
+}
+
+static esp_err_t slave_read(void *ctx, uint8_t *data, size_t len)
+{
+    (void) ctx;
+    for (size_t i = 0; i < len; i++) {
+        data[i] = m_slave_regs[m_slave_reg++ & 3];
+    }
+    return ESP_OK;
+}
+
+static void test_i2c_mock(void)
+{
+    const host_i2c_slave_t slave = { slave_write, slave_read, NULL };
+    uint8_t wbuf[] = { (0x48 << 1) | I2C_MASTER_WRITE, 1, 0x55 };
+    uint8_t rbuf[2] = {0};
+
+    i2c_driver_install(I2C_NUM_0, I2C_MODE_MASTER, 0, 0, 0);
+    host_i2c_attach(0x48, &slave);
+    host_i2c_reset_stats();
+
+    // Write 0x55 to register 1, then read registers 1 and 2 back:
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write(cmd, wbuf, sizeof(wbuf), true);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (0x48 << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, rbuf, 1, I2C_MASTER_ACK);
+    i2c_master_read_byte(cmd, rbuf + 1, I2C_MASTER_NACK);
+    i2c_master_stop(cmd);
+    CHECK_EQ(i2c_master_cmd_begin(I2C_NUM_0, cmd, 100), ESP_OK);
+    i2c_cmd_link_delete(cmd);
+
+    CHECK_EQ(rbuf[0], 0x55);
+    CHECK_EQ(rbuf[1], 0x30);
+
+    host_i2c_op_t ops[8];
+    CHECK_EQ(host_i2c_last(ops, 8), 7);
+    CHECK_EQ(ops[0].type, HOST_I2C_START);
+    CHECK_EQ(ops[1].type, HOST_I2C_WRITE);
+    CHECK_EQ(ops[1].len, 3);
+    CHECK_EQ(ops[5].type, HOST_I2C_READ);
+    CHECK(!ops[5].ack);
+    CHECK_EQ(ops[6].type, HOST_I2C_STOP);
+
+    host_i2c_stats_t stats;
+    host_i2c_get_stats(&stats);
+    CHECK_EQ(stats.nodes, 7);
+    CHECK_EQ(stats.allocations, 8);
+    CHECK_EQ(stats.frees, 8);
+
+    // Nobody at 0x49 to ack:
+    cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (0x49 << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_stop(cmd);
+    CHECK_EQ(i2c_master_cmd_begin(I2C_NUM_0, cmd, 100), ESP_FAIL);
+    i2c_cmd_link_delete(cmd);
+
+    host_i2c_fail(1, ESP_ERR_TIMEOUT);
+    cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (0x48 << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_stop(cmd);
+    CHECK_EQ(i2c_master_cmd_begin(I2C_NUM_0, cmd, 100), ESP_ERR_TIMEOUT);
+    CHECK_EQ(i2c_master_cmd_begin(I2C_NUM_0, cmd, 100), ESP_OK);
+    i2c_cmd_link_delete(cmd);
+}
+
+int main(void)
+{
+    RUN(test_queue_between_tasks);
+    RUN(test_queue_full_and_empty);
+    RUN(test_semaphores);
+    RUN(test_real_timeout);
+    RUN(test_virtual_clock);
+    RUN(test_i2c_mock);
+
+    return unit_done();
+}
@@ -0,0 +1,213 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_log_ring.c - the console's tx ring: filling it to the last
+ * byte, refusing whole lines that don't fit, wrapping (both the buffer
+ * and the free-running counters), and what gets dropped and counted
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "unit.h"
+#include "log_ring.h"
+
+#define TEST_SIZE           (16)
+
+static uint8_t m_buf[TEST_SIZE];
+static log_ring_t m_ring;
+
+// Drains everything waiting, in as many pieces as it takes, into 'out':
+static uint32_t drain(log_ring_t *ring, uint8_t *out, uint32_t max)
+{
+    uint32_t got = 0;
+    const uint8_t *data;
+    uint32_t len;
+
+    while ((len = log_ring_peek(ring, &data)) > 0 && got + len <= max) {
+        memcpy(&out[got], data, len);
+        log_ring_consume(ring, len);
+        got += len;
+    }
+    return got;
+}
+
+static void test_empty(void)
+{
+    const uint8_t *data = NULL;
+
+    log_ring_init(&m_ring, m_buf, TEST_SIZE);
+    CHECK_EQ(log_ring_used(&m_ring), 0);
+    CHECK_EQ(log_ring_peek(&m_ring, &data), 0);
+    CHECK(data == m_buf);
+    CHECK_EQ(m_ring.written, 0);
+    CHECK_EQ(m_ring.dropped, 0);
+}
+
+// Every byte of the ring can be used, and then the next write is refused:
+static void test_full(void)
+{
+    uint8_t out[TEST_SIZE];
+
+    log_ring_init(&m_ring, m_buf, TEST_SIZE);
+    CHECK(log_ring_put(&m_ring, "0123456789", 10));
+    CHECK(log_ring_put(&m_ring, "abcdef", 6));
+    CHECK_EQ(log_ring_used(&m_ring), TEST_SIZE);
+    CHECK_EQ(m_ring.high_water, TEST_SIZE);
+
+    CHECK(!log_ring_put(&m_ring, "x", 1));
+    CHECK_EQ(log_ring_used(&m_ring), TEST_SIZE);
+    CHECK_EQ(m_ring.written, 2);
+    CHECK_EQ(m_ring.dropped, 1);
+    CHECK_EQ(m_ring.dropped_bytes, 1);
+
+    // An empty write fits even now:
+    CHECK(log_ring_put(&m_ring, "", 0));
+
+    CHECK_EQ(drain(&m_ring, out, sizeof(out)), TEST_SIZE);
+    CHECK(memcmp(out, "0123456789abcdef", TEST_SIZE) == 0);
+    CHECK_EQ(log_ring_used(&m_ring), 0);
+}
+
+// A line longer than the space left is dropped whole: none of it goes in
+static void test_too_long(void)
+{
+    uint8_t out[TEST_SIZE];
+
+    log_ring_init(&m_ring, m_buf, TEST_SIZE);
+    memset(m_buf, '.', sizeof(m_buf));
+    CHECK(log_ring_put(&m_ring, "hello\n", 6));
+
+    CHECK(!log_ring_put(&m_ring, "0123456789abc\n", 14));
+    CHECK_EQ(log_ring_used(&m_ring), 6);
+    CHECK_EQ(m_ring.dropped, 1);
+    CHECK_EQ(m_ring.dropped_bytes, 14);
+    CHECK(memcmp(&m_buf[6], "..........", 10) == 0);
+
+    // One that just fits still goes in after it:
+    CHECK(log_ring_put(&m_ring, "0123456789", 10));
+    CHECK_EQ(drain(&m_ring, out, sizeof(out)), TEST_SIZE);
+    CHECK(memcmp(out, "hello\n0123456789", TEST_SIZE) == 0);
+
+    // And one longer than the whole ring never fits, even empty:
+    CHECK(!log_ring_put(&m_ring, "0123456789abcdefg", 17));
+    CHECK_EQ(log_ring_used(&m_ring), 0);
+    CHECK_EQ(m_ring.dropped, 2);
+    CHECK_EQ(m_ring.dropped_bytes, 14 + 17);
+    CHECK_EQ(m_ring.written, 2);
+    CHECK_EQ(m_ring.high_water, TEST_SIZE);
+}
+
+// A write across the end of the buffer is split, and drains in two pieces:
+static void test_wraparound(void)
+{
+    const uint8_t *data;
+    uint8_t out[TEST_SIZE];
+
+    log_ring_init(&m_ring, m_buf, TEST_SIZE);
+    CHECK(log_ring_put(&m_ring, "0123456789", 10));
+    CHECK_EQ(drain(&m_ring, out, sizeof(out)), 10);
+
+    CHECK(log_ring_put(&m_ring, "abcdefghijkl", 12));
+    CHECK_EQ(log_ring_used(&m_ring), 12);
+    CHECK(memcmp(&m_buf[10], "abcdef", 6) == 0);
+    CHECK(memcmp(m_buf, "ghijkl", 6) == 0);
+
+    CHECK_EQ(log_ring_peek(&m_ring, &data), 6);
+    CHECK(data == &m_buf[10]);
+    log_ring_consume(&m_ring, 6);
+    CHECK_EQ(log_ring_peek(&m_ring, &data), 6);
+    CHECK(data == m_buf);
+    CHECK(memcmp(data, "ghijkl", 6) == 0);
+    log_ring_consume(&m_ring, 6);
+
+    CHECK_EQ(log_ring_used(&m_ring), 0);
+    CHECK_EQ(m_ring.high_water, 12);
+}
+
+// head and tail run freely, so they wrap too; used and the free space have to survive it:
+static void test_counters_wrap(void)
+{
+    uint8_t out[TEST_SIZE];
+
+    log_ring_init(&m_ring, m_buf, TEST_SIZE);
+    m_ring.head = m_ring.tail = 0xfffffffa;
+
+    CHECK(log_ring_put(&m_ring, "0123456789", 10));
+    CHECK_EQ(m_ring.head, 4);
+    CHECK_EQ(log_ring_used(&m_ring), 10);
+    CHECK(!log_ring_put(&m_ring, "0123456", 7));
+    CHECK(log_ring_put(&m_ring, "abcdef", 6));
+    CHECK_EQ(log_ring_used(&m_ring), TEST_SIZE);
+
+    CHECK_EQ(drain(&m_ring, out, sizeof(out)), TEST_SIZE);
+    CHECK(memcmp(out, "0123456789abcdef", TEST_SIZE) == 0);
+    CHECK_EQ(m_ring.tail, m_ring.head);
+    CHECK_EQ(m_ring.dropped, 1);
+}
+
+/*
+ * Lines of every length against a drain that takes a bit at a time:
+ * what comes out is exactly the lines that went in, in order, and
+ * every line refused is counted.
+ */
+static void test_stream(void)
+{
+    static uint8_t expected[4096], drained[4096];
+    uint32_t expected_len = 0, drained_len = 0;
+    uint32_t refused = 0, refused_bytes = 0, accepted = 0;
+    uint8_t line[TEST_SIZE + 4];
+
+    log_ring_init(&m_ring, m_buf, TEST_SIZE);
+    for (uint32_t i = 0; i < 400; i++) {
+        uint32_t len = 1 + (i * 7) % (TEST_SIZE + 2);
+
+        for (uint32_t b = 0; b < len; b++) {
+            line[b] = (uint8_t)(i + b);
+        }
+        if (log_ring_put(&m_ring, line, len)) {
+            memcpy(&expected[expected_len], line, len);
+            expected_len += len;
+            accepted++;
+        } else {
+            refused++;
+            refused_bytes += len;
+        }
+
+        // Take up to i % 9 bytes, as the drain task would after a partial write:
+        const uint8_t *data;
+        uint32_t len_out = log_ring_peek(&m_ring, &data);
+
+        if (len_out > i % 9) {
+            len_out = i % 9;
+        }
+        memcpy(&drained[drained_len], data, len_out);
+        log_ring_consume(&m_ring, len_out);
+        drained_len += len_out;
+
+        if (expected_len > sizeof(expected) - sizeof(line)) {
+            break;
+        }
+    }
+    drained_len += drain(&m_ring, &drained[drained_len], sizeof(drained) - drained_len);
+
+    CHECK(refused > 0);
+    CHECK_EQ(m_ring.written, accepted);
+    CHECK_EQ(m_ring.dropped, refused);
+    CHECK_EQ(m_ring.dropped_bytes, refused_bytes);
+    CHECK_EQ(drained_len, expected_len);
+    CHECK(memcmp(drained, expected, expected_len) == 0);
+    CHECK(m_ring.high_water <= TEST_SIZE);
+}
+
+int main(void)
+{
+    RUN(test_empty);
+    RUN(test_full);
+    RUN(test_too_long);
+    RUN(test_wraparound);
+    RUN(test_counters_wrap);
+    RUN(test_stream);
+    return unit_done();
+}
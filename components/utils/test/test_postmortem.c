@@ -0,0 +1,345 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_postmortem.c - the postmortem region across resets at random
+ * points: a state write cut off part way never loads as anything but
+ * the state before it or the one being written, a trace record cut
+ * off is left out, and a region of garbage is never taken for one
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "unit.h"
+#include "rpc_frame.h"
+#include "postmortem.h"
+
+#define RESETS              (20000)
+#define RUN_PUTS_MAX        (40)
+
+static postmortem_t m_region;
+static trace_record_t m_taken[POSTMORTEM_TRACE_SLOTS];
+
+static uint32_t random32(void)
+{
+    return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+// What's in rtc memory after a power cycle:
+static void power_on(void)
+{
+    uint8_t *bytes = (uint8_t *) &m_region;
+
+    for (size_t i = 0; i < sizeof(m_region); i++) {
+        bytes[i] = (uint8_t) rand();
+    }
+}
+
+static bool states_equal(const postmortem_state_t *a, const postmortem_state_t *b)
+{
+    return (memcmp(a, b, sizeof(*a)) == 0);
+}
+
+static bool records_equal(const trace_record_t *a, const trace_record_t *b)
+{
+    return (memcmp(a, b, sizeof(*a)) == 0);
+}
+
+static void random_state(postmortem_state_t *state)
+{
+    memset(state, 0, sizeof(*state));
+    state->uptime_ms = random32();
+    for (int i = 0; i < POSTMORTEM_ENERGY_COUNT; i++) {
+        state->energy[i] = ((int64_t) random32() << 32) | random32();
+    }
+    state->relays = random32() & 0x3;
+}
+
+static void random_record(trace_record_t *record, uint32_t timestamp)
+{
+    record->timestamp = timestamp;
+    record->id = (uint16_t)(random32() % TRACE_EVENT_COUNT);
+    record->nargs = (uint8_t)(random32() % (TRACE_MAX_ARGS + 1));
+    for (int i = 0; i < TRACE_MAX_ARGS; i++) {
+        record->args[i] = (i < record->nargs ? random32() : 0);
+    }
+}
+
+static void put(postmortem_ring_t *ring, const trace_record_t *record)
+{
+    postmortem_ring_put(ring, record->timestamp, record->id, record->nargs,
+                        record->args[0], record->args[1], record->args[2], record->args[3]);
+}
+
+/*
+ * A write the reset cut off after its first 'len' bytes: make the
+ * whole write on a copy of the region, then keep only that much of
+ * whatever it changed.
+ */
+static void save_torn(postmortem_state_t *state, size_t len)
+{
+    postmortem_t after = m_region;
+
+    postmortem_save_state(&after, state);
+    for (int i = 0; i < 2; i++) {
+        if (!states_equal(&after.state[i], &m_region.state[i])) {
+            memcpy(&m_region.state[i], &after.state[i], len);
+        }
+    }
+}
+
+static void put_torn(postmortem_ring_t *ring, const trace_record_t *record, size_t len)
+{
+    postmortem_ring_t after = *ring;
+    uint32_t slot = ring->head & (POSTMORTEM_TRACE_SLOTS - 1);
+
+    put(&after, record);
+    memcpy(&ring->records[slot], &after.records[slot], len);
+}
+
+static void test_power_on(void)
+{
+    postmortem_state_t state;
+    uint32_t survived = 0;
+    uint32_t loaded = 0;
+
+    srand(4045);
+    for (int i = 0; i < 10000; i++) {
+        power_on();
+        survived += postmortem_open(&m_region);
+        loaded += postmortem_load_state(&m_region, &state);
+    }
+    CHECK_EQ(survived, 0);
+    CHECK_EQ(loaded, 0);
+
+    // The fresh region is one a reset keeps:
+    CHECK(postmortem_open(&m_region));
+    CHECK_EQ(m_region.resets, 1);
+    CHECK(postmortem_open(&m_region));
+    CHECK_EQ(m_region.resets, 2);
+    CHECK_EQ(m_region.rings[0].head, 0);
+    CHECK_EQ(m_region.rings[1].head, 0);
+}
+
+static void test_header_damage(void)
+{
+    postmortem_state_t state;
+    uint32_t survived = 0;
+
+    power_on();
+    postmortem_open(&m_region);
+    random_state(&state);
+    postmortem_save_state(&m_region, &state);
+
+    postmortem_t good = m_region;
+
+    // Any one bit of the header, the crc included:
+    for (size_t bit = 0; bit < 8 * offsetof(postmortem_t, state); bit++) {
+        m_region = good;
+        ((uint8_t *) &m_region)[bit / 8] ^= 1 << (bit % 8);
+        survived += postmortem_open(&m_region);
+    }
+    CHECK_EQ(survived, 0);
+    CHECK(!postmortem_load_state(&m_region, &state));
+
+    // A region from a firmware with another layout:
+    m_region = good;
+    m_region.size -= 4;
+    m_region.crc = rpc_crc16(RPC_CRC16_INIT, (const uint8_t *) &m_region, offsetof(postmortem_t, crc));
+    CHECK(!postmortem_open(&m_region));
+}
+
+static void test_torn_state_writes(void)
+{
+    postmortem_state_t before;
+    postmortem_state_t state;
+    postmortem_state_t loaded;
+    uint32_t wrong = 0;
+    uint32_t lost = 0;
+    uint32_t torn = 0;
+    uint32_t kept_new = 0;
+
+    srand(45);
+    power_on();
+    postmortem_open(&m_region);
+    random_state(&before);
+    postmortem_save_state(&m_region, &before);
+
+    for (int i = 0; i < RESETS; i++) {
+        size_t len = random32() % (sizeof(state) + 1);
+
+        // A few writes that finish, then the one the reset lands in:
+        for (uint32_t writes = random32() % 4; writes > 0; writes--) {
+            random_state(&before);
+            postmortem_save_state(&m_region, &before);
+        }
+        random_state(&state);
+        save_torn(&state, len);
+        torn += (len < sizeof(state));
+
+        if (!postmortem_open(&m_region) || !postmortem_load_state(&m_region, &loaded)) {
+            lost++;
+            postmortem_open(&m_region);
+            continue;
+        }
+
+        // The seq and crc are filled in by the save, so compare the rest:
+        loaded.seq = 0;
+        loaded.crc = 0;
+        state.seq = before.seq = 0;
+        state.crc = before.crc = 0;
+        if (states_equal(&loaded, &state)) {
+            kept_new += (len < sizeof(state));
+            before = state;
+        } else if (!states_equal(&loaded, &before)) {
+            wrong++;
+        }
+        if (len == sizeof(state)) {
+            wrong += !states_equal(&loaded, &state);
+        }
+    }
+    CHECK_EQ(wrong, 0);
+    CHECK_EQ(lost, 0);
+    CHECK(torn > RESETS * 9 / 10);
+    printf("    %u resets, %u during a state write; %u of those loaded as the new state anyway\n",
+           RESETS, torn, kept_new);
+}
+
+static void test_torn_trace(void)
+{
+    trace_record_t done[RUN_PUTS_MAX];
+    trace_record_t record;
+    uint32_t timestamp = 0;
+    uint32_t wrong = 0;
+    uint32_t caught = 0;
+    uint32_t whole = 0;
+    uint32_t missed = 0;
+
+    srand(4500);
+    power_on();
+    postmortem_open(&m_region);
+
+    for (int i = 0; i < RESETS; i++) {
+        postmortem_ring_t *ring = &m_region.rings[i % POSTMORTEM_CORES];
+        uint32_t puts = random32() % RUN_PUTS_MAX;
+        size_t len = random32() % sizeof(trace_record_t);
+        uint32_t bad;
+
+        for (uint32_t n = 0; n < puts; n++) {
+            random_record(&done[n], ++timestamp);
+            done[n].reserved = postmortem_record_check(&done[n]);
+            put(ring, &done[n]);
+        }
+
+        // The reset lands in the middle of the next one (before 'head' moves on):
+        random_record(&record, ++timestamp);
+        record.reserved = postmortem_record_check(&record);
+        put_torn(ring, &record, len);
+        wrong += !postmortem_open(&m_region);
+
+        uint32_t kept = (puts < POSTMORTEM_TRACE_SLOTS ? puts : POSTMORTEM_TRACE_SLOTS);
+        uint32_t taken = postmortem_ring_take(ring, m_taken, &bad);
+        uint32_t first = 0;
+
+        /*
+         * Once the ring's full, the torn slot is the oldest record's. It
+         * should be left out, unless what's there is whole anyway (the
+         * bytes the reset kept from being written already matched).
+         */
+        if (puts >= POSTMORTEM_TRACE_SLOTS && len > 0) {
+            if (bad == 1 && taken == kept - 1) {
+                caught++;
+            } else if (bad == 0 && taken == kept) {
+                if (records_equal(&m_taken[0], &record) || records_equal(&m_taken[0], &done[puts - kept])) {
+                    whole++;
+                } else {
+                    missed++;
+                }
+                first = 1;
+            } else {
+                wrong++;
+                continue;
+            }
+        } else {
+            wrong += (taken != kept || bad != 0);
+        }
+
+        for (uint32_t n = first; n < taken; n++) {
+            wrong += !records_equal(&m_taken[n], &done[puts - taken + n]);
+        }
+        wrong += (ring->head != 0);
+    }
+    CHECK_EQ(wrong, 0);
+    CHECK(caught > 1000);
+
+    // A check byte lets one in 256 through:
+    CHECK(missed * 100 < caught);
+    printf("    %u records cut off over the oldest: %u left out, %u whole anyway, %u let through\n",
+           caught + whole + missed, caught, whole, missed);
+}
+
+static void test_seq_wraps(void)
+{
+    postmortem_state_t state;
+    postmortem_state_t loaded;
+
+    power_on();
+    postmortem_open(&m_region);
+    random_state(&state);
+    postmortem_save_state(&m_region, &state);
+
+    // As if it had been written 2^32 - 1 times:
+    m_region.state[0].seq = UINT32_MAX;
+    m_region.state[0].crc = rpc_crc16(RPC_CRC16_INIT, (const uint8_t *) &m_region.state[0],
+                                      offsetof(postmortem_state_t, crc));
+
+    random_state(&state);
+    postmortem_save_state(&m_region, &state);
+    CHECK_EQ(state.seq, 0);
+    CHECK(postmortem_load_state(&m_region, &loaded));
+    CHECK(states_equal(&loaded, &state));
+
+    random_state(&state);
+    postmortem_save_state(&m_region, &state);
+    CHECK_EQ(state.seq, 1);
+    CHECK(postmortem_load_state(&m_region, &loaded));
+    CHECK(states_equal(&loaded, &state));
+}
+
+static void test_both_copies_bad(void)
+{
+    postmortem_state_t state;
+
+    power_on();
+    postmortem_open(&m_region);
+    CHECK(!postmortem_load_state(&m_region, &state));
+
+    random_state(&state);
+    postmortem_save_state(&m_region, &state);
+    random_state(&state);
+    postmortem_save_state(&m_region, &state);
+    m_region.state[0].energy[0] ^= 1;
+    m_region.state[1].relays ^= 1;
+    CHECK(!postmortem_load_state(&m_region, &state));
+
+    // And the next write starts over in the first copy:
+    random_state(&state);
+    postmortem_save_state(&m_region, &state);
+    CHECK_EQ(state.seq, 0);
+    CHECK(states_equal(&m_region.state[0], &state));
+}
+
+int main(void)
+{
+    RUN(test_power_on);
+    RUN(test_header_damage);
+    RUN(test_torn_state_writes);
+    RUN(test_torn_trace);
+    RUN(test_seq_wraps);
+    RUN(test_both_copies_bad);
+
+    return unit_done();
+}
@@ -0,0 +1,265 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_power_sched.c - the wake-source scheduler on its own, and in a
+ * model of a chip that light sleeps whenever it's allowed to, wakes
+ * late by anything up to the wake time, and is woken at random by the
+ * inputs and the uart: over hours of it, no deadline is missed
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unit.h"
+#include "power_sched.h"
+
+#define WAKE_US             (2000)          // CONFIG_POWER_WAKE_US
+#define MODEL_HOURS         (6)
+
+enum {
+    SOURCE_ALS,
+    SOURCE_RELAY1,
+    SOURCE_RELAY2,
+    SOURCE_TIGHT,
+    SOURCE_EDGE,
+
+    SOURCE_COUNT
+};
+
+// The board's (omar_power.c), and a couple more at the edges of what the scheduler does:
+static const power_sched_source_t m_sources[SOURCE_COUNT] = {
+    [SOURCE_ALS]    = { "als",      20000 },
+    [SOURCE_RELAY1] = { "relay1",   250 },
+    [SOURCE_RELAY2] = { "relay2",   250 },
+    [SOURCE_TIGHT]  = { "tight",    0 },
+    [SOURCE_EDGE]   = { "edge",     WAKE_US },
+};
+
+static power_sched_t m_sched;
+
+static uint32_t random32(void)
+{
+    return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+static int64_t random_between(int64_t lo, int64_t hi)
+{
+    return lo + (int64_t)(random32() % (uint32_t)(hi - lo + 1));
+}
+
+static void test_roomy(void)
+{
+    int64_t wake_at;
+
+    power_sched_init(&m_sched, m_sources, SOURCE_COUNT, WAKE_US);
+    power_sched_arm(&m_sched, SOURCE_ALS, 1000000);
+    power_sched_arm(&m_sched, SOURCE_EDGE, 1000000);
+
+    // Slack at least the wake time: the plain timer wake is soon enough, whenever it is:
+    CHECK(!power_sched_plan(&m_sched, 0, &wake_at));
+    CHECK_EQ(wake_at, POWER_SCHED_NEVER);
+    CHECK(!power_sched_plan(&m_sched, 999999, &wake_at));
+    CHECK(power_sched_done(&m_sched, SOURCE_ALS, 1000000 + 20000));
+    CHECK(!power_sched_done(&m_sched, SOURCE_EDGE, 1000000 + WAKE_US + 1));
+    CHECK_EQ(m_sched.entries[SOURCE_ALS].stats.kept_awake, 0);
+    CHECK_EQ(m_sched.entries[SOURCE_EDGE].stats.missed, 1);
+    CHECK_EQ(m_sched.entries[SOURCE_EDGE].stats.worst_late_us, WAKE_US + 1);
+}
+
+static void test_tight(void)
+{
+    const int64_t deadline = 5000000;
+    const int64_t awake_from = deadline + 250 - WAKE_US;
+    int64_t wake_at;
+
+    power_sched_init(&m_sched, m_sources, SOURCE_COUNT, WAKE_US);
+    power_sched_arm(&m_sched, SOURCE_RELAY1, deadline);
+
+    CHECK(!power_sched_plan(&m_sched, 0, &wake_at));
+    CHECK_EQ(wake_at, awake_from);
+    CHECK(!power_sched_plan(&m_sched, awake_from - 1, &wake_at));
+
+    // From then on it stays awake, counted once however often it's asked:
+    CHECK(power_sched_plan(&m_sched, awake_from, &wake_at));
+    CHECK(power_sched_plan(&m_sched, deadline, &wake_at));
+    CHECK_EQ(m_sched.entries[SOURCE_RELAY1].stats.kept_awake, 1);
+
+    CHECK(power_sched_done(&m_sched, SOURCE_RELAY1, deadline + 250));
+    CHECK(!power_sched_plan(&m_sched, deadline + 250, &wake_at));
+    CHECK_EQ(wake_at, POWER_SCHED_NEVER);
+
+    // Seeing to it again, or to one that was never armed, changes nothing:
+    CHECK(power_sched_done(&m_sched, SOURCE_RELAY1, deadline + 10000));
+    CHECK(power_sched_done(&m_sched, SOURCE_RELAY2, deadline + 10000));
+    CHECK_EQ(m_sched.entries[SOURCE_RELAY1].stats.met, 1);
+    CHECK_EQ(m_sched.entries[SOURCE_RELAY2].stats.met, 0);
+}
+
+static void test_rearm_and_disarm(void)
+{
+    int64_t wake_at;
+
+    power_sched_init(&m_sched, m_sources, SOURCE_COUNT, WAKE_US);
+    power_sched_arm(&m_sched, SOURCE_RELAY1, 10000);
+    power_sched_arm(&m_sched, SOURCE_RELAY2, 30000);
+    CHECK(power_sched_plan(&m_sched, 9000, &wake_at));
+
+    // Moved later: the hold that was taken stays until it's done or disarmed...
+    power_sched_arm(&m_sched, SOURCE_RELAY1, 20000);
+    CHECK(power_sched_plan(&m_sched, 9000, &wake_at));
+    power_sched_disarm(&m_sched, SOURCE_RELAY1);
+
+    // ...and then the earliest of what's left is when to wake:
+    CHECK(!power_sched_plan(&m_sched, 9000, &wake_at));
+    CHECK_EQ(wake_at, 30000 + 250 - WAKE_US);
+
+    // Sources past the end are ignored:
+    power_sched_arm(&m_sched, SOURCE_COUNT, 0);
+    CHECK(power_sched_done(&m_sched, SOURCE_COUNT, 1000000));
+    CHECK_EQ(m_sched.entries[SOURCE_RELAY2].stats.arms, 1);
+
+    power_sched_init(&m_sched, m_sources, POWER_SCHED_SOURCES_MAX + 4, WAKE_US);
+    CHECK_EQ(m_sched.count, POWER_SCHED_SOURCES_MAX);
+}
+
+typedef struct {
+    bool use_plan;              // false: sleep through to the next deadline, as plain tickless idle would
+    int64_t now;
+    int64_t asleep_us;
+    uint32_t wakes;
+    uint32_t deadlines;
+    int64_t next_input;
+} model_t;
+
+// When each source's next deadline comes, after the one seen to at 'now':
+static int64_t next_deadline(uint32_t source, int64_t last, int64_t now)
+{
+    switch (source) {
+    case SOURCE_ALS:
+        return last + 1000000;                                      // the als primary cycle
+    case SOURCE_RELAY1:
+    case SOURCE_RELAY2:
+        return now + random_between(20000, 30 * 1000000);           // a relay's next coil pulse
+    case SOURCE_TIGHT:
+        return now + random_between(1000, 2 * 1000000);
+    default:
+        return now + random_between(100, 5 * 1000000);
+    }
+}
+
+/*
+ * The chip: awake, it sees to each deadline as it comes; asleep, it's
+ * woken by the next deadline's timer, the scheduler's wake timer or an
+ * input, and runs again up to WAKE_US after that. Each source has its
+ * own timer or task, as on the board, so one deadline doesn't wait on
+ * another's work. Deadlines are re-armed as they're seen to.
+ */
+static void model_run(model_t *m, int64_t until)
+{
+    int64_t deadline[SOURCE_COUNT];
+
+    power_sched_init(&m_sched, m_sources, SOURCE_COUNT, WAKE_US);
+    for (uint32_t i = 0; i < SOURCE_COUNT; i++) {
+        deadline[i] = next_deadline(i, 0, m->now);
+        power_sched_arm(&m_sched, i, deadline[i]);
+    }
+    m->next_input = m->now + random_between(0, 60 * 1000000);
+
+    while (m->now < until) {
+        for (uint32_t i = 0; i < SOURCE_COUNT; i++) {
+            if (deadline[i] <= m->now) {
+                power_sched_done(&m_sched, i, m->now);
+                m->deadlines++;
+                deadline[i] = next_deadline(i, deadline[i], m->now);
+                power_sched_arm(&m_sched, i, deadline[i]);
+            }
+        }
+
+        int64_t wake_at = POWER_SCHED_NEVER;
+        bool stay = (m->use_plan ? power_sched_plan(&m_sched, m->now, &wake_at) : false);
+        int64_t next = m->next_input;
+
+        for (uint32_t i = 0; i < SOURCE_COUNT; i++) {
+            next = (deadline[i] < next ? deadline[i] : next);
+        }
+        if (next <= m->now) {
+            continue;
+        }
+        if (stay) {
+            m->now = next;
+        } else {
+            next = (wake_at < next ? (wake_at > m->now ? wake_at : m->now) : next);
+            m->asleep_us += next - m->now;
+            m->now = next + random_between(0, WAKE_US);
+            m->wakes++;
+        }
+        if (m->now >= m->next_input) {
+            m->next_input = m->now + random_between(0, 60 * 1000000);
+        }
+    }
+}
+
+static uint32_t missed(void)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < SOURCE_COUNT; i++) {
+        count += m_sched.entries[i].stats.missed;
+    }
+    return count;
+}
+
+static void test_model(void)
+{
+    model_t m = { .use_plan = true };
+    const int64_t hours = (int64_t) MODEL_HOURS * 3600 * 1000000;
+
+    srand(4046);
+    model_run(&m, hours);
+
+    CHECK_EQ(missed(), 0);
+    for (uint32_t i = 0; i < SOURCE_COUNT; i++) {
+        const power_sched_stats_t *stats = &m_sched.entries[i].stats;
+
+        CHECK(stats->worst_late_us <= m_sources[i].slack_us);
+        CHECK(stats->met > 1000);
+        printf("    %-8s slack %5u usec: %6u met, %u missed, %6u kept awake for, worst %4u usec late\n",
+               m_sources[i].name, m_sources[i].slack_us, stats->met, stats->missed,
+               stats->kept_awake, stats->worst_late_us);
+    }
+    CHECK(m_sched.entries[SOURCE_RELAY1].stats.kept_awake > 0);
+    CHECK_EQ(m_sched.entries[SOURCE_ALS].stats.kept_awake, 0);
+
+    // Staying awake for the tight ones costs very little of the sleep:
+    CHECK(m.asleep_us > hours * 99 / 100);
+    printf("    %d hours: asleep %.3f%% of the time, %u wakes, %u deadlines\n",
+           MODEL_HOURS, 100.0 * m.asleep_us / m.now, m.wakes, m.deadlines);
+}
+
+// The same chip sleeping through to each deadline misses the tight ones, so the model can tell:
+static void test_model_without_plan(void)
+{
+    model_t m = { .use_plan = false };
+
+    srand(4046);
+    model_run(&m, (int64_t) 3600 * 1000000);
+
+    CHECK(m_sched.entries[SOURCE_RELAY1].stats.missed > 0);
+    CHECK(m_sched.entries[SOURCE_TIGHT].stats.missed > 0);
+    CHECK_EQ(m_sched.entries[SOURCE_ALS].stats.missed, 0);
+    CHECK_EQ(m_sched.entries[SOURCE_EDGE].stats.missed, 0);
+    printf("    without the plan: %u of %u deadlines missed\n", missed(), m.deadlines);
+}
+
+int main(void)
+{
+    RUN(test_roomy);
+    RUN(test_tight);
+    RUN(test_rearm_and_disarm);
+    RUN(test_model);
+    RUN(test_model_without_plan);
+
+    return unit_done();
+}
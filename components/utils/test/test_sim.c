@@ -0,0 +1,334 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_sim.c - the discrete-event simulator itself: which event runs
+ * when, what a wait and sim_busy() let in, the lateness it keeps, real
+ * tasks blocking and waking on it, and that a seed always plays out the
+ * same way
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "unit.h"
+#include "sim.h"
+
+#define LOG_MAX             (64)
+
+typedef struct {
+    char tag;
+    int64_t at;
+} log_entry_t;
+
+static log_entry_t m_log[LOG_MAX];
+static uint32_t m_log_count;
+
+static const sim_kind_t m_isr = { "isr", 0, true, 50 };
+static const sim_kind_t m_high = { "high", 10, false, 0 };
+static const sim_kind_t m_low = { "low", 1, false, 0 };
+
+static int m_isr_id;
+static int m_high_id;
+static int m_low_id;
+
+static void setup(uint64_t seed)
+{
+    sim_init(seed, 1000);
+    m_isr_id = sim_add_kind(&m_isr);
+    m_high_id = sim_add_kind(&m_high);
+    m_low_id = sim_add_kind(&m_low);
+    m_log_count = 0;
+}
+
+static void note(void *arg)
+{
+    if (m_log_count < LOG_MAX) {
+        m_log[m_log_count++] = (log_entry_t) { (char)(intptr_t) arg, sim_now() };
+    }
+}
+
+static void test_order(void)
+{
+    setup(1);
+
+    // Scheduled out of order, with ties at 2000:
+    sim_at(3000, m_low_id, note, (void *) 'c');
+    sim_at(2000, m_low_id, note, (void *) 'a');
+    sim_at(2000, m_low_id, note, (void *) 'b');
+    sim_at(2000, m_high_id, note, (void *) 'H');
+    sim_at(2500, m_isr_id, note, (void *) 'I');
+
+    CHECK_EQ(sim_run(10000), 5);
+    CHECK_EQ(sim_now(), 10000);
+    CHECK_EQ(m_log_count, 5);
+
+    // At 2000, priority first and then the order they were scheduled in:
+    const char *expect = "HabIc";
+    const int64_t when[] = { 2000, 2000, 2000, 2500, 3000 };
+
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK_EQ(m_log[i].tag, expect[i]);
+        CHECK_EQ(m_log[i].at, when[i]);
+    }
+
+    // Nothing past 'until' runs:
+    sim_at(20001, m_low_id, note, (void *) 'x');
+    CHECK_EQ(sim_run(20000), 0);
+    CHECK_EQ(sim_run(20001), 1);
+}
+
+static void waiter(void *arg)
+{
+    (void) arg;
+    note((void *) 'w');
+    vTaskDelay(pdMS_TO_TICKS(10));
+    note((void *) 'W');
+}
+
+static void again(void *arg)
+{
+    (void) arg;
+    note((void *) 'L');
+    sim_after(1000, m_low_id, note, (void *) 'l');
+}
+
+static void test_wait(void)
+{
+    setup(1);
+
+    // While the waiter waits, the low one and an isr run, but not another of its own kind:
+    sim_at(2000, m_low_id, waiter, NULL);
+    sim_at(3000, m_low_id, note, (void *) 's');
+    sim_at(4000, m_high_id, again, NULL);
+    sim_at(5000, m_isr_id, note, (void *) 'I');
+
+    sim_run(100000);
+
+    const char *expect = "wLIWsl";
+    const int64_t when[] = { 2000, 4000, 5000, 12000, 12000, 12000 };
+
+    CHECK_EQ(m_log_count, 6);
+    for (uint32_t i = 0; i < 6; i++) {
+        CHECK_EQ(m_log[i].tag, expect[i]);
+        CHECK_EQ(m_log[i].at, when[i]);
+    }
+
+    // Both of the low kind's that waited on the waiter started 9 ms late:
+    const sim_track_t *low = sim_get_track(m_low_id);
+
+    CHECK_EQ(low->hist.count, 3);
+    CHECK_EQ(low->hist.max, 9000);
+}
+
+static void worker(void *arg)
+{
+    (void) arg;
+    note((void *) 'b');
+    sim_busy(5000);
+    note((void *) 'B');
+}
+
+static void isr_busy(void *arg)
+{
+    (void) arg;
+    note((void *) 'I');
+    sim_busy(100);
+    sim_after(0, m_high_id, note, (void *) 'h');
+}
+
+static void test_busy(void)
+{
+    setup(1);
+
+    // Busy lets in isrs and higher priorities, and ends later by the time they take:
+    sim_at(2000, m_low_id, worker, NULL);
+    sim_at(3000, m_high_id, note, (void *) 'h');
+    sim_at(3000, m_low_id, note, (void *) 'l');
+    sim_at(4000, m_isr_id, isr_busy, NULL);
+    sim_at(4010, m_isr_id, note, (void *) 'i');
+
+    sim_run(100000);
+
+    // An isr keeps the cpu until it's done:
+    const char *expect = "bhIihBl";
+    const int64_t when[] = { 2000, 3000, 4000, 4100, 4100, 7100, 7100 };
+
+    CHECK_EQ(m_log_count, 7);
+    for (uint32_t i = 0; i < 7; i++) {
+        CHECK_EQ(m_log[i].tag, expect[i]);
+        CHECK_EQ(m_log[i].at, when[i]);
+    }
+
+    // The second isr was 90 us late, against a budget of 50:
+    const sim_track_t *isr = sim_get_track(m_isr_id);
+
+    CHECK_EQ(isr->hist.count, 2);
+    CHECK_EQ(isr->hist.max, 90);
+    CHECK_EQ(isr->over_budget, 1);
+    CHECK(!sim_report());
+}
+
+static void test_probe(void)
+{
+    setup(1);
+
+    int probe = sim_add_probe("probe", 1000);
+
+    CHECK(probe >= 0);
+    sim_record(probe, 10);
+    sim_record(probe, 1000);
+    sim_record(probe, 1001);
+    sim_record(probe, -5);
+
+    const sim_track_t *track = sim_get_track(probe);
+
+    CHECK_EQ(track->hist.count, 4);
+    CHECK_EQ(track->hist.min, 0);
+    CHECK_EQ(track->hist.max, 1001);
+    CHECK_EQ(track->over_budget, 1);
+    CHECK(sim_get_track(SIM_TRACKS_MAX) == NULL);
+}
+
+static void test_full(void)
+{
+    setup(1);
+
+    for (uint32_t i = 0; i < SIM_EVENTS_MAX; i++) {
+        CHECK(sim_at(2000 + i, m_low_id, note, (void *) '.'));
+    }
+    CHECK(!sim_at(2000, m_low_id, note, (void *) '.'));
+    CHECK(!sim_at(2000, SIM_TRACKS_MAX, note, (void *) '.'));
+    CHECK_EQ(sim_run(2000 + SIM_EVENTS_MAX), SIM_EVENTS_MAX);
+}
+
+// Random arrivals, random work and random waits, all from the seed:
+static void chaos(void *arg)
+{
+    int kind = (int)(intptr_t) arg;
+
+    if (kind != m_isr_id) {
+        if (sim_random() & 1) {
+            vTaskDelay(sim_random_between(1, 3));
+        } else {
+            sim_busy(sim_random_between(0, 500));
+        }
+    }
+    sim_after(sim_random_between(0, 20000), kind, chaos, arg);
+}
+
+static uint64_t play(uint64_t seed)
+{
+    setup(seed);
+    sim_at(1000, m_isr_id, chaos, (void *)(intptr_t) m_isr_id);
+    sim_at(1000, m_high_id, chaos, (void *)(intptr_t) m_high_id);
+    sim_at(1000, m_low_id, chaos, (void *)(intptr_t) m_low_id);
+    CHECK(sim_run(60 * 1000000LL) > 3000);
+    return sim_digest();
+}
+
+static QueueHandle_t m_high_queue;
+static QueueHandle_t m_low_queue;
+
+static void high_task(void *arg)
+{
+    char tag;
+
+    (void) arg;
+    while (xQueueReceive(m_high_queue, &tag, portMAX_DELAY) == pdTRUE) {
+        note((void *)(intptr_t) tag);
+    }
+}
+
+static void low_task(void *arg)
+{
+    char tag;
+
+    (void) arg;
+    while (1) {
+        if (xQueueReceive(m_low_queue, &tag, pdMS_TO_TICKS(20)) != pdTRUE) {
+            note((void *) 't');
+            continue;
+        }
+        note((void *)(intptr_t) tag);
+        vTaskDelay(pdMS_TO_TICKS(10));
+        note((void *) 'd');
+    }
+}
+
+static void send_both(void *arg)
+{
+    char low = 'l';
+    char high = 'h';
+
+    (void) arg;
+    xQueueSend(m_low_queue, &low, 0);
+    xQueueSend(m_high_queue, &high, 0);
+}
+
+static void send_isr(void *arg)
+{
+    char high = 'I';
+
+    (void) arg;
+    xQueueSendFromISR(m_high_queue, &high, NULL);
+}
+
+static void test_tasks(void)
+{
+    setup(1);
+    m_high_queue = xQueueCreate(4, sizeof(char));
+    m_low_queue = xQueueCreate(4, sizeof(char));
+    xTaskCreate(low_task, "low_task", 2048, NULL, 2, NULL);
+    xTaskCreate(high_task, "high_task", 2048, NULL, 6, NULL);
+
+    // Both woken by the one event, the higher priority first; the isr's send wakes the high one while the low one sleeps:
+    sim_at(4000, m_low_id, send_both, NULL);
+    sim_at(6000, m_isr_id, send_isr, NULL);
+
+    sim_run(100000);
+
+    const char *expect = "hlIdt";
+    const int64_t when[] = { 4000, 4000, 6000, 14000, 34000 };
+
+    CHECK_EQ(m_log_count, 8);
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK_EQ(m_log[i].tag, expect[i]);
+        CHECK_EQ(m_log[i].at, when[i]);
+    }
+
+    // From then on the low one times out every 20 ms:
+    CHECK_EQ(m_log[7].tag, 't');
+    CHECK_EQ(m_log[7].at, 94000);
+}
+
+static void test_determinism(void)
+{
+    uint64_t first = play(42);
+
+    CHECK_EQ(play(42), first);
+    CHECK(play(43) != first);
+
+    for (int64_t i = 0; i < 1000; i++) {
+        int64_t r = sim_random_between(-3, 3);
+
+        CHECK(r >= -3 && r <= 3);
+    }
+}
+
+int main(void)
+{
+    RUN(test_order);
+    RUN(test_wait);
+    RUN(test_busy);
+    RUN(test_probe);
+    RUN(test_full);
+    RUN(test_determinism);
+    RUN(test_tasks);        // last: its tasks outlive it
+
+    return unit_done();
+}
@@ -0,0 +1,741 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_sim_device.c - hours of the whole device on the simulator
+ * (sim.h), running the real drivers and tasks: the als cycle and
+ * captures on the timer group and adc, the relays' coil pulses against
+ * 60Hz zero crossings, bouncing presses through omar_input, the
+ * thermal task and the eeprom on a timed i2c bus, the meter over spi
+ * for the telemetry frames, the energy log, and stdout through
+ * console_out to a uart at its baud rate, all on one virtual clock
+ * with seeded randomness, and every task held to a latency budget
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/adc.h"
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "driver/uart.h"
+
+#include "unit.h"
+#include "host.h"
+#include "sim.h"
+#include "i2c.h"
+#include "i2c_bus.h"
+#include "s24c08.h"
+#include "i2c_slaves.h"
+#include "adi_spi.h"
+#include "ade7953_model.h"
+#include "hw_setup.h"
+#include "omar_als_timer.h"
+#include "omar_led.h"
+#include "omar_power.h"
+#include "omar_relay.h"
+#include "omar_thermal.h"
+#include "omar_sample.h"
+#include "omar_input.h"
+#include "console_out.h"
+#include "temp_history.h"
+#include "telem_codec.h"
+#include "telem_queue.h"
+#include "energy_log.h"
+
+#define DEVICE_HOURS            (6)
+#define HOUR_USEC               (3600 * 1000000LL)
+#define DRAIN_USEC              (60 * 1000000LL)            // run on after the stimulus stops
+
+// Every ten minutes the console turns the als cycle on for four, and then takes a capture:
+#define ALS_SLOT_USEC           (10 * 60 * 1000000LL)
+#define ALS_CYCLE_USEC          (4 * 60 * 1000000LL)
+#define ALS_REPORT_AT_USEC      (295 * 1000000LL)
+#define ALS_CAPTURE_AT_USEC     (300 * 1000000LL)
+#define ALS_CAPTURE_USEC        ((ALS_SAMPLE_COUNT + 1) * (int64_t)(OMAR_ALS_SAMPLER_INTERVAL * 1000000.0) + 100000)
+#define LED0_CHANNEL            (0)
+#define LED1_CHANNEL            (1)
+
+// ZX toggles at every crossing of 60Hz mains, give or take:
+#define HALF_PERIOD_USEC        (8333)
+#define ZX_JITTER_USEC          (20)
+
+#define INPUT_BOUNCE_USEC       (3000)
+
+#define ROOM_PERIOD_USEC        (10 * 1000000LL)
+#define EEPROM_PERIOD_USEC      (10 * 60 * 1000000LL)
+
+#define METER_PERIOD_USEC       (100000)                    // OMAR_TELEMETRY_POLL_MS
+#define TELEM_ENCODE_USEC       (200)
+#define TELEM_SEND_USEC         (1500)
+#define TELEM_QUEUE_SIZE        (4096)
+#define TELEM_CHANNELS          (STREAM_CHANNEL_BIT(STREAM_VRMS) | STREAM_CHANNEL_BIT(STREAM_AWATT) | \
+                                 STREAM_CHANNEL_BIT(STREAM_TEMP))
+
+#define ENERGY_PERIOD_USEC      (60 * 1000000LL)            // CONFIG_ENERGY_LOG_PERIOD_S
+#define ENERGY_FLUSH_PERIODS    (15)
+#define ENERGY_SLOTS            (16)
+
+/*
+ * What's left of the device that isn't the real code: the console
+ * (the main task, at ESP_TASK_MAIN_PRIO) typing commands, an eeprom
+ * writer, telemetry's framing and sends (the real task needs
+ * sockets), the energy log task, and the world outside the chip.
+ */
+static const sim_kind_t m_console = { "console", 1, false, 0 };
+static const sim_kind_t m_eeprom = { "eeprom", 1, false, 100000 };
+static const sim_kind_t m_telemetry = { "telemetry", 3, false, 5000 };
+static const sim_kind_t m_energy = { "energy_log", 1, false, 1000000 };
+static const sim_kind_t m_world = { "world", 0, true, 0 };
+
+// How late the real tasks and peripherals may start, by name:
+static const struct {
+    const char *name;
+    uint32_t budget_usec;
+} m_budgets[] = {
+    { "timer_isr",      50 },
+    { "gpio_isr",       50 },
+    { "esp_timer",      250 },
+    { "i2c_bus_task",   1000 },
+    { "thermal_task",   1000 },
+    { "led_task",       1000 },
+    { "timer_evt_task", 1000 },
+    { "input_task",     1000 },
+};
+
+static int m_console_id;
+static int m_eeprom_id;
+static int m_telemetry_id;
+static int m_energy_id;
+static int m_world_id;
+static int m_push_probe;
+static int m_zx_probe;
+
+static const input_timing_t m_timing = {
+    .debounce_ms = 20,
+    .long_press_ms = 1000,
+    .serial_ms = 200,
+};
+
+/*
+ * Each run is a child process of its own, as the drivers' tasks and
+ * statics can't be put back to power-on; what it found comes back in
+ * a shared mapping.
+ */
+typedef struct {
+    int64_t end;                // no new stimulus after this
+    bool reports;               // dump each capture to the console before the next
+
+    uint32_t slots;
+    uint32_t captures;
+    int64_t capture_at;
+    uint32_t capture_reads;
+    uint32_t captures_short;    // that didn't read exactly ALS_SAMPLE_COUNT samples
+    uint32_t cycle_reads;
+    uint32_t reads_lit;         // cycle readings taken with an led on
+    uint32_t als_dropped;
+    bool als_held;
+    uint32_t wake_arms;
+    uint32_t wakes_missed;
+    uint32_t wdt_timeouts;
+
+    uint32_t relay_commands;
+    uint32_t relay_pulses;
+    int64_t zx_last;
+    int64_t zx_next;
+    uint32_t zx_level;
+
+    int64_t pressed_at;
+    uint32_t presses;
+    uint32_t pushes;
+    uint32_t taps;
+    uint32_t releases;
+    uint32_t input_overflows;
+
+    float celsius;
+    bool temperature_ok;
+    uint32_t history;
+    uint32_t i2c_errors;
+    uint16_t eeprom_address;
+    uint32_t eeprom_writes;
+    uint32_t eeprom_errors;
+
+    omar_sample_ctx_t sample_ctx;
+    uint32_t meter_reads;
+    uint32_t meter_bad;
+    telem_batch_t batch;
+    uint8_t frame[TELEM_FRAME_MAX];
+    uint8_t sent[TELEM_FRAME_MAX];
+    uint8_t queue_buf[TELEM_QUEUE_SIZE];
+    telem_queue_t queue;
+    int64_t meter_next;
+    uint32_t frames;
+    uint32_t frames_refused;
+    uint32_t frames_sent;
+    uint32_t frames_bad;
+
+    energy_log_t log;
+    energy_log_index_t index[ENERGY_SLOTS];
+    uint32_t periods;
+    uint32_t log_records;
+    uint32_t log_errors;
+
+    uint32_t console_dropped;
+    bool in_budget;
+    uint64_t digest;
+    bool finished;
+} device_t;
+
+static device_t *m_dev;
+static ade7953_model_t m_chip;
+static char m_dir[] = "/tmp/sim_device.XXXXXX";
+static char m_path[64];
+
+/*
+ * The light sensor: a capture's samples are the reads in the few
+ * seconds after it's started (the cycle's off by then), and every
+ * other read is the cycle's, which must find both leds off.
+ */
+static int als_sensor(int channel, void *ctx)
+{
+    (void) channel;
+    (void) ctx;
+
+    if (m_dev->captures > 0 && sim_now() - m_dev->capture_at < ALS_CAPTURE_USEC) {
+        m_dev->capture_reads++;
+    } else {
+        m_dev->cycle_reads++;
+        m_dev->reads_lit += (host_ledc_duty(LED0_CHANNEL) != 0 || host_ledc_duty(LED1_CHANNEL) != 0);
+    }
+    return (int) sim_random_between(900, 3900);
+}
+
+static void capture_check(void)
+{
+    if (m_dev->captures > 0 && m_dev->capture_reads != ALS_SAMPLE_COUNT) {
+        m_dev->captures_short++;
+    }
+}
+
+static void als_off(void *arg)
+{
+    (void) arg;
+    enable_als_timer(false);
+}
+
+static void als_report(void *arg)
+{
+    (void) arg;
+    report_als_samples(SINGLECOLUMNDECIMAL_REPORT_FORMAT);
+}
+
+static void als_capture(void *arg)
+{
+    (void) arg;
+    capture_check();
+    m_dev->captures++;
+    m_dev->capture_at = sim_now();
+    m_dev->capture_reads = 0;
+    start_als_sample_capture();
+}
+
+static void als_slot(void *arg)
+{
+    int64_t start = sim_now();
+
+    (void) arg;
+    if (start >= m_dev->end) {
+        return;
+    }
+    m_dev->slots++;
+    enable_als_timer(true);
+    sim_at(start + ALS_CYCLE_USEC, m_console_id, als_off, NULL);
+    if (m_dev->reports) {
+        sim_at(start + ALS_REPORT_AT_USEC, m_console_id, als_report, NULL);
+    }
+    sim_at(start + ALS_CAPTURE_AT_USEC, m_console_id, als_capture, NULL);
+    sim_at(start + ALS_SLOT_USEC, m_console_id, als_slot, NULL);
+}
+
+/*
+ * Mains: ZX toggles at each crossing, a little early or late, and
+ * runs on after the stimulus stops so the relays keep their lock.
+ */
+static void mains_edge(void *arg)
+{
+    (void) arg;
+    m_dev->zx_level = !m_dev->zx_level;
+    m_dev->zx_last = sim_now();
+    m_dev->zx_next = sim_now() + HALF_PERIOD_USEC + sim_random_between(-ZX_JITTER_USEC, ZX_JITTER_USEC);
+    host_gpio_input(ADE7953_ZX_GPIO, m_dev->zx_level);
+    sim_at(m_dev->zx_next, sim_peripheral(SIM_GPIO_ISR), mains_edge, NULL);
+}
+
+static bool is_coil(int gpio)
+{
+    return (gpio == OMAR_COIL_1_SET_GPIO || gpio == OMAR_COIL_1_RESET_GPIO ||
+            gpio == OMAR_COIL_2_SET_GPIO || gpio == OMAR_COIL_2_RESET_GPIO);
+}
+
+static int64_t distance(int64_t a, int64_t b)
+{
+    return (a > b ? a - b : b - a);
+}
+
+// Where each pulse's contacts land, against the crossing nearest them:
+static void coil_watch(int gpio, uint32_t level, void *ctx)
+{
+    (void) ctx;
+    if (!is_coil(gpio) || level == 0) {
+        return;
+    }
+
+    int64_t landing = sim_now() + OMAR_RELAY_CONTACT_DELAY_USEC - OMAR_RELAY_ZX_OFFSET_USEC;
+    int64_t error = distance(landing, m_dev->zx_last);
+
+    error = (distance(landing, m_dev->zx_next) < error ? distance(landing, m_dev->zx_next) : error);
+    error = (distance(landing, m_dev->zx_next + HALF_PERIOD_USEC) < error
+             ? distance(landing, m_dev->zx_next + HALF_PERIOD_USEC) : error);
+    sim_record(m_zx_probe, error);
+}
+
+// Either relay, either way; an idle relay pulses even when it's asked for what it's in:
+static void relay_command(void *arg)
+{
+    (void) arg;
+    if (sim_now() >= m_dev->end) {
+        return;
+    }
+    m_dev->relay_commands++;
+    relay_set((omar_relay_t)(sim_random() % OMAR_RELAY_COUNT), sim_random() & 1);
+    sim_after(sim_random_between(30, 300) * 1000000LL, m_console_id, relay_command, NULL);
+}
+
+static void input_cb(input_event_t event, void *arg)
+{
+    (void) arg;
+    switch (event) {
+    case INPUT_EVENT_PUSH:
+        m_dev->pushes++;
+        sim_record(m_push_probe, sim_now() - m_dev->pressed_at);
+        break;
+    case INPUT_EVENT_TAP:
+        m_dev->taps++;
+        break;
+    case INPUT_EVENT_RELEASE:
+        m_dev->releases++;
+        break;
+    default:
+        break;
+    }
+}
+
+// Edges that end up at 'level', after up to three bounces:
+static int64_t bounce(int64_t at, uint32_t level)
+{
+    uint32_t bounces = sim_random() % 4;
+
+    sim_gpio(at, OMAR_SWITCH_INT0, level);
+    for (uint32_t i = 0; i < bounces; i++) {
+        at += sim_random_between(100, INPUT_BOUNCE_USEC / 4);
+        sim_gpio(at, OMAR_SWITCH_INT0, !level);
+        at += sim_random_between(100, INPUT_BOUNCE_USEC / 4);
+        sim_gpio(at, OMAR_SWITCH_INT0, level);
+    }
+    return at;
+}
+
+// A press on the active low switch, held for less than a long press:
+static void button_press(void *arg)
+{
+    (void) arg;
+    if (sim_now() >= m_dev->end) {
+        return;
+    }
+    m_dev->presses++;
+    m_dev->pressed_at = sim_now();
+
+    int64_t pressed = bounce(sim_now(), 0);
+
+    bounce(pressed + sim_random_between(80000, 600000), 1);
+    sim_after(sim_random_between(20, 120) * 1000000LL, sim_peripheral(SIM_GPIO_ISR), button_press, NULL);
+}
+
+// A slow wander between 20C and 40C, a quarter degree at a time:
+static void room(void *arg)
+{
+    (void) arg;
+    if (sim_now() >= m_dev->end) {
+        return;
+    }
+    m_dev->celsius += 0.25f * (float) sim_random_between(-1, 1);
+    m_dev->celsius = (m_dev->celsius < 20.0f ? 20.0f : (m_dev->celsius > 40.0f ? 40.0f : m_dev->celsius));
+    slave_s5852a_temperature(&m_s5852a, m_dev->celsius);
+    sim_after(ROOM_PERIOD_USEC, m_world_id, room, NULL);
+}
+
+// A page written and read back, sharing the bus with the thermal task:
+static void eeprom_write(void *arg)
+{
+    uint8_t data[MAX_PAGE_WRITE];
+    uint8_t back[MAX_PAGE_WRITE];
+
+    (void) arg;
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) sim_random();
+    }
+    if (s24c08_write(m_dev->eeprom_address, data, sizeof(data)) != ESP_OK
+        || s24c08_read(m_dev->eeprom_address, back, sizeof(back)) != ESP_OK
+        || memcmp(data, back, sizeof(data)) != 0) {
+        m_dev->eeprom_errors++;
+    }
+    m_dev->eeprom_writes++;
+    m_dev->eeprom_address = (m_dev->eeprom_address + MAX_PAGE_WRITE) % OMAR_EEPROM_SIZE;
+
+    if (sim_now() < m_dev->end) {
+        sim_after(EEPROM_PERIOD_USEC, m_eeprom_id, eeprom_write, NULL);
+    }
+}
+
+// A meter reading every poll, and a telemetry frame out every TELEM_BATCH_MAX of them:
+static void telemetry_poll(void *arg)
+{
+    int32_t vrms = (int32_t) sim_random_between(3900000, 4100000);
+
+    (void) arg;
+    m_dev->meter_next += METER_PERIOD_USEC;
+    ade7953_model_set(&m_chip, ADE7953_VRMS, vrms);
+
+    telem_sample_t *sample = &m_dev->batch.samples[m_dev->batch.count++];
+
+    memset(sample, 0, sizeof(*sample));
+    omar_sample_read(&m_dev->sample_ctx, TELEM_CHANNELS, sample->values);
+    sample->msec = (uint32_t)(sim_now() / 1000);
+    m_dev->meter_reads++;
+    m_dev->meter_bad += (sample->values[STREAM_VRMS] != vrms);
+
+    if (m_dev->batch.count == TELEM_BATCH_MAX) {
+        uint32_t len = telem_frame_encode(&m_dev->batch, m_dev->frame, sizeof(m_dev->frame));
+
+        sim_busy(TELEM_ENCODE_USEC);
+        if (telem_queue_push(&m_dev->queue, m_dev->frame, len)) {
+            m_dev->frames++;
+        } else {
+            m_dev->frames_refused++;
+        }
+        m_dev->batch.seq++;
+        m_dev->batch.count = 0;
+
+        // What went out has to be what came in:
+        while ((len = telem_queue_pop(&m_dev->queue, m_dev->sent, sizeof(m_dev->sent))) > 0) {
+            telem_batch_t back;
+
+            host_sleep_usec(TELEM_SEND_USEC);
+            m_dev->frames_sent++;
+            m_dev->frames_bad += !telem_frame_decode(m_dev->sent, len, &back) || back.count != TELEM_BATCH_MAX;
+        }
+    }
+
+    // vTaskDelayUntil(), so the polls don't drift:
+    if (m_dev->meter_next < m_dev->end) {
+        sim_at(m_dev->meter_next, m_telemetry_id, telemetry_poll, NULL);
+    }
+}
+
+static void energy_task(void *arg)
+{
+    energy_log_record_t record = {
+        .time = (uint32_t)(sim_now() / 1000000),
+        .aenergy = (int32_t) sim_random_between(0, 20000),
+        .benergy = (int32_t) sim_random_between(0, 20000),
+        .renergy = (int32_t) sim_random_between(-500, 500),
+        .vpeak = (int32_t) sim_random_between(5500000, 5700000),
+        .temperature = TEMP_HISTORY_TO_QUARTERS(m_dev->celsius),
+    };
+
+    (void) arg;
+    m_dev->periods++;
+    m_dev->log_errors += !energy_log_append(&m_dev->log, &record);
+    if (m_dev->periods % ENERGY_FLUSH_PERIODS == 0) {
+        m_dev->log_errors += !energy_log_flush(&m_dev->log);
+    }
+
+    if (sim_now() < m_dev->end) {
+        sim_after(ENERGY_PERIOD_USEC, m_energy_id, energy_task, NULL);
+    }
+}
+
+// Brings the device up as app_main() would, on the simulator's clock, with stdout on a uart at 'baud':
+static void device_setup(uint64_t seed, uint32_t baud)
+{
+    sim_init(seed, 0);
+    for (size_t i = 0; i < sizeof(m_budgets) / sizeof(m_budgets[0]); i++) {
+        sim_budget(m_budgets[i].name, m_budgets[i].budget_usec);
+    }
+    m_console_id = sim_add_kind(&m_console);
+    m_eeprom_id = sim_add_kind(&m_eeprom);
+    m_telemetry_id = sim_add_kind(&m_telemetry);
+    m_energy_id = sim_add_kind(&m_energy);
+    m_world_id = sim_add_kind(&m_world);
+
+    // From the first edge to PUSH: the bounce, the debounce and a tick:
+    m_push_probe = sim_add_probe("press_to_push", 3000 + m_timing.debounce_ms * 1000 + portTICK_PERIOD_MS * 1000);
+    m_zx_probe = sim_add_probe("zx_error", 250);
+
+    host_uart_attach(UART_NUM_0, open("/dev/null", O_WRONLY));
+    host_uart_baud(UART_NUM_0, baud);
+    console_out_init(UART_NUM_0);
+    omar_power_init();
+
+    slaves_attach();
+    host_i2c_timing(true);
+    i2c_init();
+
+    ade7953_model_reset(&m_chip);
+    ade7953_model_attach(&m_chip, HSPI_HOST);
+    host_spi_timing(true);
+    adi_spi_init();
+
+    host_adc_source(VOUT_LGHT_SNSR__ADC_CHANNEL, als_sensor, NULL);
+    adc1_config_channel_atten(VOUT_LGHT_SNSR__ADC_CHANNEL, ADC_ATTEN_DB_11);
+    led_setup();
+    led_set_brightness(OMAR_WHITE_LED0, OMAR_LED_MAX_DUTY / 2);
+    led_set_brightness(OMAR_WHITE_LED1, OMAR_LED_MAX_DUTY / 2);
+    timer_setup();
+
+    thermal_setup();
+    slave_s5852a_temperature(&m_s5852a, m_dev->celsius);
+
+    host_gpio_watch(coil_watch, NULL);
+    relay_setup();
+    omar_input_init();
+    omar_input_add(OMAR_SWITCH_INT0, 0, &m_timing, input_cb, NULL);
+}
+
+static void device_results(void)
+{
+    omar_power_status_t power;
+    omar_input_stats_t input;
+    temp_history_t history;
+    console_out_stats_t console;
+    energy_log_summary_t summary;
+    float celsius;
+
+    capture_check();
+    m_dev->als_dropped = als_get_dropped_events();
+    omar_power_get_status(&power);
+    m_dev->als_held = power.holds[OMAR_POWER_ALS].held;
+    for (int i = 0; i < OMAR_WAKE_COUNT; i++) {
+        m_dev->wake_arms += power.wakes[i].arms;
+        m_dev->wakes_missed += power.wakes[i].missed;
+    }
+    m_dev->wdt_timeouts = host_task_wdt_timeouts();
+
+    for (int i = 0; i < OMAR_RELAY_COUNT; i++) {
+        omar_relay_info_t info;
+
+        relay_get_info(i, &info);
+        m_dev->relay_pulses += info.pulses;
+    }
+
+    omar_input_get_stats(&input);
+    m_dev->input_overflows = input.overflows;
+
+    thermal_get_history(&history);
+    thermal_get_state(&celsius);
+    m_dev->history = history.sample_count;
+    m_dev->temperature_ok = (celsius == m_dev->celsius);
+    for (int i = 0; i < I2C_BUS_DEV_COUNT; i++) {
+        i2c_bus_dev_stats_t stats;
+
+        i2c_bus_get_stats(i, &stats);
+        m_dev->i2c_errors += stats.errors + stats.deadline_misses;
+    }
+
+    m_dev->log_errors += !energy_log_flush(&m_dev->log);
+    energy_log_get_summary(&m_dev->log, &summary);
+    m_dev->log_records = summary.records;
+
+    console_out_get_stats(&console);
+    m_dev->console_dropped = console.dropped;
+    m_dev->digest = sim_digest();
+}
+
+/*
+ * The child: everything from power-on, the stimulus for 'hours', and
+ * then DRAIN_USEC more so whatever was started gets to finish; with
+ * 'table' it prints how late everything ran against its budget.
+ */
+static void device_child(uint64_t seed, int64_t hours, uint32_t baud, bool reports, bool table)
+{
+    // console_out_init() takes over stdout; keep the real one for the results:
+    FILE *results = stdout;
+
+    memset(m_dev, 0, sizeof(*m_dev));
+    m_dev->end = hours * HOUR_USEC;
+    m_dev->reports = reports;
+    m_dev->celsius = 30.0f;
+    m_dev->zx_level = 1;
+    m_dev->batch.mask = TELEM_CHANNELS;
+    telem_queue_init(&m_dev->queue, m_dev->queue_buf, sizeof(m_dev->queue_buf));
+    remove(m_path);
+    if (!energy_log_init(&m_dev->log, m_path, m_dev->index, ENERGY_SLOTS)) {
+        return;
+    }
+
+    device_setup(seed, baud);
+
+    int64_t start = sim_now();
+
+    sim_at(start, m_console_id, als_slot, NULL);
+    sim_at(start + sim_random_between(0, 60) * 1000000LL, m_console_id, relay_command, NULL);
+    sim_at(start + 1000, sim_peripheral(SIM_GPIO_ISR), mains_edge, NULL);
+    sim_at(start + sim_random_between(0, 60) * 1000000LL, sim_peripheral(SIM_GPIO_ISR), button_press, NULL);
+    sim_at(start + ROOM_PERIOD_USEC / 2, m_world_id, room, NULL);
+    sim_at(start + sim_random_between(0, 600) * 1000000LL, m_eeprom_id, eeprom_write, NULL);
+    m_dev->meter_next = start;
+    sim_at(start, m_telemetry_id, telemetry_poll, NULL);
+    sim_at(start + ENERGY_PERIOD_USEC, m_energy_id, energy_task, NULL);
+    m_dev->end += start;
+
+    sim_run(m_dev->end + DRAIN_USEC);
+    device_results();
+
+    stdout = results;
+    if (table) {
+        m_dev->in_budget = sim_report();
+    }
+    m_dev->finished = true;
+}
+
+static bool device_play(uint64_t seed, int64_t hours, uint32_t baud, bool reports, bool table)
+{
+    int status;
+
+    fflush(stdout);
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        device_child(seed, hours, baud, reports, table);
+        fflush(stdout);
+        _exit(0);
+    }
+    return (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && m_dev->finished);
+}
+
+// Real time, for saying how long the simulation took:
+static int64_t wall_usec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void test_hours(void)
+{
+    int64_t started = wall_usec();
+
+    CHECK(device_play(2019, DEVICE_HOURS, CONFIG_CONSOLE_RUNTIME_BAUDRATE, false, true));
+    printf("    %d hours of device time in %.1f s\n", DEVICE_HOURS,
+           (double)(wall_usec() - started) / 1000000.0);
+
+    // Every capture read every sample, without losing an event, and every cycle reading was taken dark:
+    CHECK_EQ(m_dev->slots, DEVICE_HOURS * HOUR_USEC / ALS_SLOT_USEC);
+    CHECK_EQ(m_dev->captures, m_dev->slots);
+    CHECK_EQ(m_dev->captures_short, 0);
+    CHECK(m_dev->cycle_reads > m_dev->slots * (ALS_CYCLE_USEC / 2000000) * 9 / 10);
+    CHECK_EQ(m_dev->reads_lit, 0);
+    CHECK_EQ(m_dev->als_dropped, 0);
+    CHECK(!m_dev->als_held);
+    CHECK(m_dev->wake_arms > 0);
+    CHECK_EQ(m_dev->wakes_missed, 0);
+    CHECK_EQ(m_dev->wdt_timeouts, 0);
+
+    // A pulse for every command, each landing on a crossing (see zx_error below):
+    CHECK(m_dev->relay_commands > DEVICE_HOURS * 3600 / 300);
+    CHECK_EQ(m_dev->relay_pulses, m_dev->relay_commands);
+
+    // One PUSH, TAP and RELEASE for every press:
+    CHECK(m_dev->presses > DEVICE_HOURS * 3600 / 120);
+    CHECK_EQ(m_dev->pushes, m_dev->presses);
+    CHECK_EQ(m_dev->taps, m_dev->presses);
+    CHECK_EQ(m_dev->releases, m_dev->presses);
+    CHECK_EQ(m_dev->input_overflows, 0);
+
+    CHECK_EQ(m_dev->history, TEMP_HISTORY_SAMPLES);
+    CHECK(m_dev->temperature_ok);
+    CHECK_EQ(m_dev->i2c_errors, 0);
+    CHECK(m_dev->eeprom_writes >= DEVICE_HOURS * 6);
+    CHECK_EQ(m_dev->eeprom_errors, 0);
+
+    CHECK_EQ(m_dev->meter_reads, DEVICE_HOURS * 3600 * 10);
+    CHECK_EQ(m_dev->meter_bad, 0);
+    CHECK_EQ(m_dev->frames, DEVICE_HOURS * 3600 * 10 / TELEM_BATCH_MAX);
+    CHECK_EQ(m_dev->frames_refused, 0);
+    CHECK_EQ(m_dev->frames_sent, m_dev->frames);
+    CHECK_EQ(m_dev->frames_bad, 0);
+
+    CHECK_EQ(m_dev->periods, DEVICE_HOURS * 60);
+    CHECK_EQ(m_dev->log_records, m_dev->periods);
+    CHECK_EQ(m_dev->log_errors, 0);
+
+    CHECK(m_dev->in_budget);
+}
+
+/*
+ * A console far too slow for what's printed: each capture dumped as
+ * 4096 lines at 9600 baud, the last still going out when the next
+ * capture starts. console_out drops lines rather than hold anyone
+ * up, so the als task, printing a line per progress event, loses
+ * none of them.
+ */
+static void test_console_flood(void)
+{
+    CHECK(device_play(2019, 1, 9600, true, false));
+
+    CHECK(m_dev->console_dropped > 0);
+    CHECK_EQ(m_dev->captures, 6);
+    CHECK_EQ(m_dev->captures_short, 0);
+    CHECK_EQ(m_dev->als_dropped, 0);
+    CHECK(!m_dev->als_held);
+    CHECK_EQ(m_dev->wakes_missed, 0);
+    printf("    %u console lines dropped, no als events\n", m_dev->console_dropped);
+}
+
+static void test_replay(void)
+{
+    CHECK(device_play(1, 1, CONFIG_CONSOLE_RUNTIME_BAUDRATE, false, false));
+
+    uint64_t first = m_dev->digest;
+
+    CHECK(device_play(1, 1, CONFIG_CONSOLE_RUNTIME_BAUDRATE, false, false));
+    CHECK_EQ(m_dev->digest, first);
+
+    CHECK(device_play(2, 1, CONFIG_CONSOLE_RUNTIME_BAUDRATE, false, false));
+    CHECK(m_dev->digest != first);
+}
+
+int main(void)
+{
+    m_dev = mmap(NULL, sizeof(*m_dev), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (m_dev == MAP_FAILED || mkdtemp(m_dir) == NULL) {
+        return 1;
+    }
+    snprintf(m_path, sizeof(m_path), "%s/energy.log", m_dir);
+
+    RUN(test_hours);
+    RUN(test_console_flood);
+    RUN(test_replay);
+
+    remove(m_path);
+    rmdir(m_dir);
+    return unit_done();
+}
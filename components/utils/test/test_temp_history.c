@@ -0,0 +1,190 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_temp_history.c - the sample ring and the per-minute and
+ * per-hour rollups, including ring wraparound and gaps
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "unit.h"
+#include "temp_history.h"
+
+static temp_history_t m_history;
+
+static void test_samples_wrap(void)
+{
+    int16_t quarters;
+
+    temp_history_reset(&m_history);
+    CHECK(!temp_history_sample(&m_history, 0, &quarters));
+
+    for (int i = 0; i < TEMP_HISTORY_SAMPLES + 40; i++) {
+        temp_history_record(&m_history, i * 10, (int16_t) i);
+    }
+
+    // Newest first, and only the last TEMP_HISTORY_SAMPLES of them:
+    CHECK(temp_history_sample(&m_history, 0, &quarters));
+    CHECK_EQ(quarters, TEMP_HISTORY_SAMPLES + 39);
+    CHECK(temp_history_sample(&m_history, TEMP_HISTORY_SAMPLES - 1, &quarters));
+    CHECK_EQ(quarters, 40);
+    CHECK(!temp_history_sample(&m_history, TEMP_HISTORY_SAMPLES, &quarters));
+}
+
+static void test_minute_buckets(void)
+{
+    const int16_t minute0[] = { 100, 96, 104, 101, 99, 100 };
+    temp_bucket_t bucket;
+
+    temp_history_reset(&m_history);
+    CHECK(!temp_history_current(&m_history, &bucket));
+
+    for (int i = 0; i < 6; i++) {
+        temp_history_record(&m_history, i * 10, minute0[i]);
+    }
+
+    // Nothing's complete until a sample from the next minute shows up:
+    CHECK(!temp_history_minute(&m_history, 0, &bucket));
+    CHECK(temp_history_current(&m_history, &bucket));
+    CHECK_EQ(bucket.start, 0);
+    CHECK_EQ(bucket.count, 6);
+    CHECK_EQ(bucket.min, 96);
+    CHECK_EQ(bucket.max, 104);
+    CHECK_EQ(bucket.mean, 100);
+
+    temp_history_record(&m_history, 60, -8);
+    CHECK(temp_history_minute(&m_history, 0, &bucket));
+    CHECK_EQ(bucket.start, 0);
+    CHECK_EQ(bucket.count, 6);
+    CHECK_EQ(bucket.min, 96);
+    CHECK_EQ(bucket.max, 104);
+    CHECK_EQ(bucket.mean, 100);
+    CHECK(!temp_history_minute(&m_history, 1, &bucket));
+
+    CHECK(temp_history_current(&m_history, &bucket));
+    CHECK_EQ(bucket.start, 1);
+    CHECK_EQ(bucket.count, 1);
+    CHECK_EQ(bucket.min, -8);
+    CHECK_EQ(bucket.max, -8);
+}
+
+static void test_mean_rounding(void)
+{
+    temp_bucket_t bucket;
+
+    // Halves round away from zero, on either side of it:
+    temp_history_reset(&m_history);
+    temp_history_record(&m_history, 0, 1);
+    temp_history_record(&m_history, 10, 2);
+    CHECK(temp_history_current(&m_history, &bucket));
+    CHECK_EQ(bucket.mean, 2);
+
+    temp_history_reset(&m_history);
+    temp_history_record(&m_history, 0, -1);
+    temp_history_record(&m_history, 10, -2);
+    CHECK(temp_history_current(&m_history, &bucket));
+    CHECK_EQ(bucket.mean, -2);
+
+    temp_history_reset(&m_history);
+    temp_history_record(&m_history, 0, -1);
+    temp_history_record(&m_history, 10, -1);
+    temp_history_record(&m_history, 20, -2);
+    CHECK(temp_history_current(&m_history, &bucket));
+    CHECK_EQ(bucket.mean, -1);
+}
+
+static void test_gaps(void)
+{
+    temp_bucket_t bucket;
+
+    // Minutes without a sample don't get a bucket:
+    temp_history_reset(&m_history);
+    temp_history_record(&m_history, 0, 10);
+    temp_history_record(&m_history, 5 * 60, 20);
+    temp_history_record(&m_history, 9 * 60 + 59, 30);
+    CHECK(temp_history_minute(&m_history, 0, &bucket));
+    CHECK_EQ(bucket.start, 5);
+    CHECK_EQ(bucket.mean, 20);
+    CHECK(temp_history_minute(&m_history, 1, &bucket));
+    CHECK_EQ(bucket.start, 0);
+    CHECK(!temp_history_minute(&m_history, 2, &bucket));
+    CHECK(temp_history_current(&m_history, &bucket));
+    CHECK_EQ(bucket.start, 9);
+}
+
+static void test_hour_mean_over_samples(void)
+{
+    temp_bucket_t bucket;
+
+    // Six samples of 0 in minute 0 and one of 100 in minute 1:
+    temp_history_reset(&m_history);
+    for (int i = 0; i < 6; i++) {
+        temp_history_record(&m_history, i * 10, 0);
+    }
+    temp_history_record(&m_history, 60, 100);
+    temp_history_record(&m_history, 3600, 50);
+
+    // 100 / 7, where the mean of the minute means would be 50:
+    CHECK(temp_history_hour(&m_history, 0, &bucket));
+    CHECK_EQ(bucket.start, 0);
+    CHECK_EQ(bucket.count, 7);
+    CHECK_EQ(bucket.min, 0);
+    CHECK_EQ(bucket.max, 100);
+    CHECK_EQ(bucket.mean, 14);
+    CHECK(!temp_history_hour(&m_history, 1, &bucket));
+}
+
+static void test_buckets_wrap(void)
+{
+    temp_bucket_t bucket;
+    uint32_t minutes = 2 * TEMP_HISTORY_MINUTES + 10;
+    uint32_t hours = TEMP_HISTORY_HOURS + 5;
+
+    temp_history_reset(&m_history);
+    for (uint32_t m = 0; m < minutes; m++) {
+        temp_history_record(&m_history, m * 60, (int16_t) m);
+    }
+
+    // The newest completed minute is the one before the minute in progress:
+    CHECK(temp_history_minute(&m_history, 0, &bucket));
+    CHECK_EQ(bucket.start, minutes - 2);
+    CHECK_EQ(bucket.mean, minutes - 2);
+    CHECK(temp_history_minute(&m_history, TEMP_HISTORY_MINUTES - 1, &bucket));
+    CHECK_EQ(bucket.start, minutes - 1 - TEMP_HISTORY_MINUTES);
+    CHECK(!temp_history_minute(&m_history, TEMP_HISTORY_MINUTES, &bucket));
+
+    temp_history_reset(&m_history);
+    for (uint32_t h = 0; h < hours; h++) {
+        temp_history_record(&m_history, h * 3600, (int16_t) -h);
+    }
+    CHECK(temp_history_hour(&m_history, 0, &bucket));
+    CHECK_EQ(bucket.start, hours - 2);
+    CHECK_EQ(bucket.mean, -(int32_t)(hours - 2));
+    CHECK(temp_history_hour(&m_history, TEMP_HISTORY_HOURS - 1, &bucket));
+    CHECK_EQ(bucket.start, hours - 1 - TEMP_HISTORY_HOURS);
+    CHECK(!temp_history_hour(&m_history, TEMP_HISTORY_HOURS, &bucket));
+}
+
+static void test_conversions(void)
+{
+    CHECK_EQ(TEMP_HISTORY_TO_QUARTERS(25.5f), 102);
+    CHECK_EQ(TEMP_HISTORY_TO_QUARTERS(-40.0f), -160);
+    CHECK(TEMP_HISTORY_TO_FLOAT(-1) == -0.25f);
+
+    // "A few KB":
+    CHECK(sizeof(temp_history_t) <= 3 * 1024);
+}
+
+int main(void)
+{
+    RUN(test_samples_wrap);
+    RUN(test_minute_buckets);
+    RUN(test_mean_rounding);
+    RUN(test_gaps);
+    RUN(test_hour_mean_over_samples);
+    RUN(test_buckets_wrap);
+    RUN(test_conversions);
+
+    return unit_done();
+}
@@ -0,0 +1,236 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_trace_ring.c - the trace ring and its decoder: ordering, wrap,
+ * clear, formatting, and snapshots taken while a writer is running
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "unit.h"
+#include "trace.h"
+#include "trace_ring.h"
+
+#define TEST_SLOTS          (8)
+
+static trace_record_t m_records[TEST_SLOTS];
+static trace_ring_t m_ring;
+
+static void put_seq(trace_ring_t *ring, uint32_t seq)
+{
+    // Every field follows from seq, so a torn record is easy to spot:
+    trace_ring_put(ring, seq * 160, (uint16_t)(seq % TRACE_EVENT_COUNT), TRACE_MAX_ARGS,
+                   seq, ~seq, seq * 3, seq ^ 0x5a5a5a5a);
+}
+
+static bool record_is(const trace_record_t *record, uint32_t seq)
+{
+    return (record->timestamp == seq * 160 &&
+            record->id == seq % TRACE_EVENT_COUNT &&
+            record->nargs == TRACE_MAX_ARGS &&
+            record->args[0] == seq &&
+            record->args[1] == ~seq &&
+            record->args[2] == seq * 3 &&
+            record->args[3] == (seq ^ 0x5a5a5a5a));
+}
+
+static void test_oldest_first(void)
+{
+    trace_record_t out[TEST_SLOTS];
+
+    trace_ring_init(&m_ring, m_records, TEST_SLOTS);
+    CHECK_EQ(trace_ring_snapshot(&m_ring, out, TEST_SLOTS), 0);
+
+    for (uint32_t seq = 0; seq < 3; seq++) {
+        put_seq(&m_ring, seq);
+    }
+    CHECK_EQ(trace_ring_snapshot(&m_ring, out, TEST_SLOTS), 3);
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK(record_is(&out[i], i));
+    }
+
+    // Asking for fewer gets the newest ones:
+    CHECK_EQ(trace_ring_snapshot(&m_ring, out, 2), 2);
+    CHECK(record_is(&out[0], 1));
+    CHECK(record_is(&out[1], 2));
+}
+
+static void test_wrap(void)
+{
+    trace_record_t out[TEST_SLOTS];
+
+    trace_ring_init(&m_ring, m_records, TEST_SLOTS);
+    for (uint32_t seq = 0; seq < 5 * TEST_SLOTS + 3; seq++) {
+        put_seq(&m_ring, seq);
+    }
+
+    // The slot the writer fills next is never handed out:
+    CHECK_EQ(m_ring.head, 5 * TEST_SLOTS + 3);
+    CHECK_EQ(trace_ring_snapshot(&m_ring, out, TEST_SLOTS), TEST_SLOTS - 1);
+    for (uint32_t i = 0; i < TEST_SLOTS - 1; i++) {
+        CHECK(record_is(&out[i], 5 * TEST_SLOTS + 3 - (TEST_SLOTS - 1) + i));
+    }
+}
+
+static void test_clear(void)
+{
+    trace_record_t out[TEST_SLOTS];
+
+    trace_ring_init(&m_ring, m_records, TEST_SLOTS);
+    for (uint32_t seq = 0; seq < 20; seq++) {
+        put_seq(&m_ring, seq);
+    }
+    trace_ring_clear(&m_ring);
+    CHECK_EQ(trace_ring_snapshot(&m_ring, out, TEST_SLOTS), 0);
+
+    // The count of records ever written carries on:
+    put_seq(&m_ring, 20);
+    put_seq(&m_ring, 21);
+    CHECK_EQ(m_ring.head, 22);
+    CHECK_EQ(trace_ring_snapshot(&m_ring, out, TEST_SLOTS), 2);
+    CHECK(record_is(&out[0], 20));
+    CHECK(record_is(&out[1], 21));
+}
+
+static void test_format(void)
+{
+    trace_record_t record = { 0 };
+    char buf[96];
+
+    record.id = TRACE_S5852A_RAW;
+    record.nargs = 2;
+    record.args[0] = 0xe1;
+    record.args[1] = 0x90;
+    int len = trace_format(&record, buf, sizeof(buf));
+
+    CHECK_EQ(len, strlen(buf));
+    CHECK(strcmp(buf, "s5852a_get(): raw[0] = 0xe1, raw[1] = 0x90") == 0);
+
+    record.id = TRACE_ALS_READING;
+    record.nargs = 1;
+    record.args[0] = (uint32_t) -12;
+    trace_format(&record, buf, sizeof(buf));
+    CHECK(strcmp(buf, "als: [als=-12]") == 0);
+
+    record.id = TRACE_ALS_PRIMARY;
+    record.nargs = 0;
+    trace_format(&record, buf, sizeof(buf));
+    CHECK(strcmp(buf, "als: <primary>") == 0);
+
+    record.id = TRACE_LOCK_CROSS_CORE;
+    record.nargs = 2;
+    record.args[0] = 3;
+    record.args[1] = 1;
+    trace_format(&record, buf, sizeof(buf));
+    CHECK(strcmp(buf, "lock 3: waiting on a holder pinned to cpu 1") == 0);
+
+    // An id from a newer build still shows its arguments:
+    record.id = TRACE_EVENT_COUNT + 5;
+    record.args[0] = 0xabc;
+    trace_format(&record, buf, sizeof(buf));
+    CHECK(strncmp(buf, "unknown event", 13) == 0);
+    CHECK(strstr(buf, "0xabc") != NULL);
+
+    // Truncated like snprintf():
+    record.id = TRACE_ALS_PRIMARY;
+    CHECK_EQ(trace_format(&record, buf, 5), strlen("als: <primary>"));
+    CHECK(strcmp(buf, "als:") == 0);
+}
+
+static void test_names(void)
+{
+    CHECK(strcmp(trace_event_name(TRACE_SPI_READ), "TRACE_SPI_READ") == 0);
+    CHECK(strcmp(trace_event_name(TRACE_LOCK_CROSS_CORE), "TRACE_LOCK_CROSS_CORE") == 0);
+    CHECK(strcmp(trace_event_name(TRACE_EVENT_COUNT), "?") == 0);
+
+    // Every event has a format, and only uses the args a record can carry:
+    for (uint16_t id = 0; id < TRACE_EVENT_COUNT; id++) {
+        trace_record_t record = { .id = id };
+        char buf[96];
+
+        CHECK(trace_format(&record, buf, sizeof(buf)) > 0);
+    }
+}
+
+static volatile bool m_writing;
+static trace_ring_t m_shared;
+static trace_record_t m_shared_records[64];
+
+static void *writer(void *arg)
+{
+    (void) arg;
+
+    for (uint32_t seq = 0; m_writing; seq++) {
+        put_seq(&m_shared, seq);
+    }
+    return NULL;
+}
+
+static void test_snapshot_while_writing(void)
+{
+    pthread_t thread;
+    trace_record_t out[64];
+    uint32_t torn = 0;
+    uint32_t gaps = 0;
+    uint32_t records = 0;
+
+    trace_ring_init(&m_shared, m_shared_records, 64);
+    m_writing = true;
+    pthread_create(&thread, NULL, writer, NULL);
+
+    // Not until the writer's going, and has been round the ring:
+    while (m_shared.head < 2 * 64) {
+        sched_yield();
+    }
+
+    // Whatever a snapshot returns is whole, and consecutive:
+    for (int i = 0; i < 20000; i++) {
+        uint32_t count = trace_ring_snapshot(&m_shared, out, 64);
+
+        for (uint32_t n = 0; n < count; n++) {
+            if (!record_is(&out[n], out[n].args[0])) {
+                torn++;
+            } else if (n > 0 && out[n].args[0] != out[n - 1].args[0] + 1) {
+                gaps++;
+            }
+        }
+        records += count;
+    }
+
+    m_writing = false;
+    pthread_join(thread, NULL);
+
+    CHECK(records > 0);
+    CHECK_EQ(torn, 0);
+    CHECK_EQ(gaps, 0);
+}
+
+static void test_trace_event(void)
+{
+    uint32_t count = trace_count(0);
+
+    TRACE0(TRACE_ALS_PRIMARY);
+    TRACE2(TRACE_SPI_READ, 4, 3);
+    CHECK_EQ(trace_count(0), count + 2);
+    CHECK_EQ(trace_count(7), 0);
+
+    trace_clear();
+    CHECK_EQ(trace_count(0), count + 2);
+}
+
+int main(void)
+{
+    RUN(test_oldest_first);
+    RUN(test_wrap);
+    RUN(test_clear);
+    RUN(test_format);
+    RUN(test_names);
+    RUN(test_snapshot_while_writing);
+    RUN(test_trace_event);
+
+    return unit_done();
+}
@@ -0,0 +1,50 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * unit.h - just enough of a test framework for the host build: each
+ * test_*.c is a program that RUN()s its tests and returns unit_done()
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+static int unit_checks = 0;
+static int unit_failures = 0;
+
+static inline bool unit_check(bool ok, const char *file, int line, const char *what)
+{
+    unit_checks++;
+    if (!ok) {
+        unit_failures++;
+        printf("%s:%d: CHECK(%s) failed\n", file, line, what);
+    }
+    return ok;
+}
+
+static inline bool unit_check_eq(long long a, long long b, const char *file, int line, const char *what_a, const char *what_b)
+{
+    unit_checks++;
+    if (a != b) {
+        unit_failures++;
+        printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", file, line, what_a, what_b, a, b);
+    }
+    return (a == b);
+}
+
+#define CHECK(cond)                 unit_check((cond), __FILE__, __LINE__, #cond)
+#define CHECK_EQ(a, b)              unit_check_eq((long long)(a), (long long)(b), __FILE__, __LINE__, #a, #b)
+
+#define RUN(test) do {                                                      \
+        int failures = unit_failures;                                       \
+        test();                                                             \
+        printf("  %-40s %s\n", #test, (unit_failures == failures ? "ok" : "FAILED")); \
+    } while (0)
+
+static inline int unit_done(void)
+{
+    printf("  %d checks, %d failed\n", unit_checks, unit_failures);
+    return (unit_failures == 0 ? 0 : 1);
+}
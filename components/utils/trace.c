@@ -0,0 +1,101 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * trace.c - always-on binary tracing for driver hot paths
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#include "trace.h"
+
+static trace_record_t m_records[portNUM_PROCESSORS][TRACE_RING_SLOTS];
+static trace_ring_t m_rings[portNUM_PROCESSORS] = {
+    { .records = m_records[0], .slots = TRACE_RING_SLOTS },
+#if portNUM_PROCESSORS > 1
+    { .records = m_records[1], .slots = TRACE_RING_SLOTS },
+#endif
+};
+static postmortem_ring_t *m_mirrors[portNUM_PROCESSORS];
+
+/*
+ * Masking interrupts on this core keeps both an ISR and the
+ * scheduler (and with it, migration to the other core) out while
+ * the record goes in; the other core has its own ring. Records are
+ * stamped in esp_timer microseconds, not cycles: under DFS the cpu
+ * clock changes with the pm locks, and stops in light sleep.
+ */
+void IRAM_ATTR trace_event(uint16_t id, uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    uint32_t state = portENTER_CRITICAL_NESTED();
+    int core = xPortGetCoreID();
+    uint32_t now = (uint32_t) esp_timer_get_time();
+
+    trace_ring_put(&m_rings[core], now, id, nargs, a0, a1, a2, a3);
+    if (m_mirrors[core] != NULL) {
+        postmortem_ring_put(m_mirrors[core], now, id, nargs, a0, a1, a2, a3);
+    }
+
+    portEXIT_CRITICAL_NESTED(state);
+}
+
+void trace_dump(uint32_t max)
+{
+    trace_record_t *records = malloc(TRACE_RING_SLOTS * sizeof(*records));
+
+    if (records == NULL) {
+        printf("%s(): out of memory\n", __func__);
+        return;
+    }
+
+    if (max == 0 || max > TRACE_RING_SLOTS) {
+        max = TRACE_RING_SLOTS;
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t count = trace_ring_snapshot(&m_rings[core], records, max);
+
+        printf("core %d: showing %u of %u events\n", core, count, m_rings[core].head);
+        if (count == 0) {
+            continue;
+        }
+
+        // The timestamps wrap every 2^32 usec (71 minutes), so times are shown relative to the core's newest record:
+        uint32_t newest = records[count - 1].timestamp;
+
+        for (uint32_t i = 0; i < count; i++) {
+            char message[96];
+            uint32_t ago = newest - records[i].timestamp;
+
+            trace_format(&records[i], message, sizeof(message));
+            printf("  -%10u us  %s\n", ago, message);
+        }
+    }
+
+    free(records);
+}
+
+void trace_clear(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        trace_ring_clear(&m_rings[core]);
+    }
+}
+
+uint32_t trace_count(int core)
+{
+    return (core >= 0 && core < portNUM_PROCESSORS ? m_rings[core].head : 0);
+}
+
+void trace_mirror(int core, postmortem_ring_t *ring)
+{
+    if (core >= 0 && core < portNUM_PROCESSORS) {
+        m_mirrors[core] = ring;
+    }
+}
@@ -0,0 +1,114 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * trace_ring.c - fixed-size ring of binary trace records, decoded
+ * against the format strings in trace_events.h after the fact
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "trace_ring.h"
+
+#define TRACE_EVENT_FORMAT(id, fmt) fmt,
+#define TRACE_EVENT_NAME(id, fmt)   #id,
+
+static const char *const m_formats[TRACE_EVENT_COUNT] = {
+    TRACE_EVENTS(TRACE_EVENT_FORMAT)
+};
+
+static const char *const m_names[TRACE_EVENT_COUNT] = {
+    TRACE_EVENTS(TRACE_EVENT_NAME)
+};
+
+void trace_ring_init(trace_ring_t *ring, trace_record_t *records, uint32_t slots)
+{
+    memset(records, 0, slots * sizeof(*records));
+    ring->records = records;
+    ring->slots = slots;
+    ring->head = 0;
+    ring->floor = 0;
+}
+
+void trace_ring_clear(trace_ring_t *ring)
+{
+    ring->floor = ring->head;
+}
+
+void trace_ring_put(trace_ring_t *ring, uint32_t timestamp, uint16_t id,
+                    uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    uint32_t head = ring->head;
+    trace_record_t *record = &ring->records[head & (ring->slots - 1)];
+
+    record->timestamp = timestamp;
+    record->id = id;
+    record->nargs = nargs;
+    record->args[0] = a0;
+    record->args[1] = a1;
+    record->args[2] = a2;
+    record->args[3] = a3;
+
+    // The record has to be complete before a reader can see it:
+    __asm__ __volatile__ ("" ::: "memory");
+    ring->head = head + 1;
+}
+
+uint32_t trace_ring_snapshot(const trace_ring_t *ring, trace_record_t *out, uint32_t max)
+{
+    uint32_t head = ring->head;
+    uint32_t count = head - ring->floor;
+
+    // The oldest slot is the one the writer fills next, so leave it be:
+    if (count > ring->slots - 1) {
+        count = ring->slots - 1;
+    }
+
+    if (count > max) {
+        count = max;
+    }
+
+    uint32_t first = head - count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = ring->records[(first + i) & (ring->slots - 1)];
+    }
+    __asm__ __volatile__ ("" ::: "memory");
+
+    /*
+     * Meanwhile the writer may have moved on. Record n is gone once
+     * record n + slots has started, and the writer may be part way
+     * through record 'head', so only records after head - slots are
+     * known to be intact:
+     */
+    uint32_t now = ring->head;
+    uint32_t lost = 0;
+
+    if (now - first >= ring->slots) {
+        lost = now - first - ring->slots + 1;
+        if (lost > count) {
+            lost = count;
+        }
+        memmove(out, out + lost, (count - lost) * sizeof(*out));
+    }
+
+    return count - lost;
+}
+
+int trace_format(const trace_record_t *record, char *buf, uint32_t len)
+{
+    if (record->id >= TRACE_EVENT_COUNT) {
+        return snprintf(buf, len, "unknown event %u (0x%x 0x%x 0x%x 0x%x)", record->id,
+                        record->args[0], record->args[1], record->args[2], record->args[3]);
+    }
+
+    // Unused trailing arguments are harmless to printf:
+    return snprintf(buf, len, m_formats[record->id],
+                    record->args[0], record->args[1], record->args[2], record->args[3]);
+}
+
+const char *trace_event_name(uint16_t id)
+{
+    return (id < TRACE_EVENT_COUNT ? m_names[id] : "?");
+}
@@ -0,0 +1,33 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * varint.c - zigzag varints for the telemetry frames and the energy
+ * log
+ */
+
+#include <stdint.h>
+
+#include "varint.h"
+
+uint32_t varint_put(uint8_t *out, uint32_t value)
+{
+    uint32_t len = 0;
+
+    while (value >= 0x80) {
+        out[len++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    out[len++] = value;
+    return len;
+}
+
+uint32_t varint_get(const uint8_t *in, uint32_t len, uint32_t *value)
+{
+    *value = 0;
+    for (uint32_t i = 0; i < len && i < VARINT_MAX; i++) {
+        *value |= (uint32_t)(in[i] & 0x7f) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,335 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * cmd_bench.c - the 'bench' command: times the driver paths that run all
+ * the time, and prints the results one csv line per case
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "argtable3/argtable3.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_console.h"
+#include "esp_err.h"
+#include "esp_pm.h"
+#include "xtensa/hal.h"
+#include "soc/timer_group_struct.h"
+#include "sdkconfig.h"
+
+#include "hw_setup.h"
+#include "adi_spi.h"
+#include "utils.h"
+#include "bench.h"
+#include "cmd_decl.h"
+
+#if defined(HW_OMAR)
+#include "s5852a.h"
+#include "s24c08.h"
+#include "omar_led.h"
+#include "omar_adc.h"
+#include "omar_als_timer.h"
+
+#define BENCH_REPS_DEFAULT      (200)
+#define BENCH_REPS_MAX          (2000)
+#define BENCH_WARMUP            (10)
+
+// An eeprom page write waits S24C08_WRITE_DELAY, so those cases only get a few runs:
+#define BENCH_WRITE_REPS        (5)
+#define BENCH_WRITE_WARMUP      (1)
+
+// Well clear of address 0, which the 'eeprom' command's tests use:
+#define BENCH_EEPROM_BASE       (0x200)
+
+typedef struct {
+    SpiCmdNameT reg;
+    uint8_t buff[4];
+} bench_spi_arg_t;
+
+typedef struct {
+    uint16_t address;
+    uint16_t count;
+} bench_eeprom_arg_t;
+
+// The same as omar_als_timer.c's timer_event_t:
+typedef struct {
+    int type;
+    int timer_group;
+    int timer_idx;
+    uint64_t timer_counter_value;
+    int als_reading;
+} bench_als_event_t;
+
+typedef struct {
+    const char *name;
+    bench_fn_t fn;
+    void *arg;
+    void (*setup)(void *arg);   // run once first, untimed; may be NULL
+    bool writes;                // writes a device (with what's already there), so only with --write
+} bench_case_t;
+
+static uint32_t m_samples[BENCH_REPS_MAX];
+static uint8_t m_eeprom_buf[OMAR_EEPROM_PAGE_SIZE];
+static uint8_t m_adi_buff[3] = { 0x80, 0x12, 0x34 };
+static uint8_t m_s5852a_raw[2] = { 0xe1, 0x94 };   // +25.25C
+static QueueHandle_t m_als_queue = NULL;
+static volatile int32_t m_sink;
+
+static uint32_t bench_ccount(void)
+{
+    return xthal_get_ccount();
+}
+
+static void bench_spi_read(void *arg)
+{
+    bench_spi_arg_t *spi = arg;
+
+    spi_read_reg(spi->reg, spi->buff);
+}
+
+static void bench_spi_write(void *arg)
+{
+    bench_spi_arg_t *spi = arg;
+
+    spi_write_reg(spi->reg, spi->buff);
+}
+
+static void bench_adi_3byte_to_int(void *arg)
+{
+    m_sink = adi_3byte_to_int(m_adi_buff);
+}
+
+static void bench_int_to_adi_3byte(void *arg)
+{
+    int_to_adi_3byte(m_sink, m_adi_buff);
+}
+
+static void bench_s5852a_raw_to_float(void *arg)
+{
+    m_sink = (int32_t) s5852a_raw_to_float(m_s5852a_raw);
+}
+
+static void bench_eeprom_read(void *arg)
+{
+    bench_eeprom_arg_t *eeprom = arg;
+
+    s24c08_read(eeprom->address, m_eeprom_buf, eeprom->count);
+}
+
+static void bench_eeprom_write(void *arg)
+{
+    bench_eeprom_arg_t *eeprom = arg;
+
+    s24c08_write(eeprom->address, m_eeprom_buf, eeprom->count);
+}
+
+static void bench_led_set_brightness(void *arg)
+{
+    led_set_brightness(OMAR_WHITE_LED0, led_get_brightness(OMAR_WHITE_LED0));
+}
+
+/*
+ * What timer_group0_isr() does for an als reading, less the alarm
+ * bookkeeping: latch and read the counter, read the adc, and queue
+ * the event for the als task (here a queue of our own, overwritten).
+ */
+static void bench_als_isr(void *arg)
+{
+    bench_als_event_t evt = { .type = OMAR_ALS_SECONDARY_TIMER, .timer_idx = OMAR_ALS_SECONDARY_TIMER };
+
+    TIMERG0.hw_timer[OMAR_ALS_SECONDARY_TIMER].update = 1;
+    evt.timer_counter_value =
+        ((uint64_t) TIMERG0.hw_timer[OMAR_ALS_SECONDARY_TIMER].cnt_high) << 32
+        | TIMERG0.hw_timer[OMAR_ALS_SECONDARY_TIMER].cnt_low;
+    evt.als_reading = als_raw();
+
+    xQueueOverwriteFromISR(m_als_queue, &evt, NULL);
+}
+
+static void bench_als_mv(void *arg)
+{
+    m_sink = omar_adc_raw_to_mv(OMAR_ADC_ALS, als_raw());
+}
+
+static void bench_spi_setup(void *arg)
+{
+    bench_spi_arg_t *spi = arg;
+
+    spi_read_reg(spi->reg, spi->buff);
+}
+
+static void bench_eeprom_setup(void *arg)
+{
+    bench_eeprom_arg_t *eeprom = arg;
+
+    s24c08_read(eeprom->address, m_eeprom_buf, eeprom->count);
+}
+
+static void bench_als_setup(void *arg)
+{
+    if (m_als_queue == NULL) {
+        m_als_queue = xQueueCreate(1, sizeof(bench_als_event_t));
+    }
+}
+
+/*
+ * A register of each width; the writes put back what the setup read,
+ * so the meter's configuration doesn't change.
+ */
+static bench_spi_arg_t m_spi_args[] = {
+    { .reg = PGA_V },
+    { .reg = LINECYC },
+    { .reg = AIGAIN },
+    { .reg = AP_NOLOAD },
+};
+
+// Each size page aligned, then starting part way into a page (and for 256, into the next block):
+static bench_eeprom_arg_t m_eeprom_args[] = {
+    { BENCH_EEPROM_BASE,        1 },
+    { BENCH_EEPROM_BASE,        16 },
+    { BENCH_EEPROM_BASE,        64 },
+    { BENCH_EEPROM_BASE,        256 },
+    { BENCH_EEPROM_BASE + 7,    1 },
+    { BENCH_EEPROM_BASE + 7,    16 },
+    { BENCH_EEPROM_BASE + 7,    64 },
+    { BENCH_EEPROM_BASE + 7,    256 },
+};
+
+static const bench_case_t m_cases[] = {
+    { "spi_read_reg_8",         bench_spi_read,             &m_spi_args[0],     NULL,               false },
+    { "spi_read_reg_16",        bench_spi_read,             &m_spi_args[1],     NULL,               false },
+    { "spi_read_reg_24",        bench_spi_read,             &m_spi_args[2],     NULL,               false },
+    { "spi_read_reg_32",        bench_spi_read,             &m_spi_args[3],     NULL,               false },
+    { "spi_write_reg_8",        bench_spi_write,            &m_spi_args[0],     bench_spi_setup,    true },
+    { "spi_write_reg_16",       bench_spi_write,            &m_spi_args[1],     bench_spi_setup,    true },
+    { "spi_write_reg_24",       bench_spi_write,            &m_spi_args[2],     bench_spi_setup,    true },
+    { "spi_write_reg_32",       bench_spi_write,            &m_spi_args[3],     bench_spi_setup,    true },
+    { "adi_3byte_to_int",       bench_adi_3byte_to_int,     NULL,               NULL,               false },
+    { "int_to_adi_3byte",       bench_int_to_adi_3byte,     NULL,               NULL,               false },
+    { "s5852a_raw_to_float",    bench_s5852a_raw_to_float,  NULL,               NULL,               false },
+    { "s24c08_read_1@0",        bench_eeprom_read,          &m_eeprom_args[0],  NULL,               false },
+    { "s24c08_read_16@0",       bench_eeprom_read,          &m_eeprom_args[1],  NULL,               false },
+    { "s24c08_read_64@0",       bench_eeprom_read,          &m_eeprom_args[2],  NULL,               false },
+    { "s24c08_read_256@0",      bench_eeprom_read,          &m_eeprom_args[3],  NULL,               false },
+    { "s24c08_read_1@7",        bench_eeprom_read,          &m_eeprom_args[4],  NULL,               false },
+    { "s24c08_read_16@7",       bench_eeprom_read,          &m_eeprom_args[5],  NULL,               false },
+    { "s24c08_read_64@7",       bench_eeprom_read,          &m_eeprom_args[6],  NULL,               false },
+    { "s24c08_read_256@7",      bench_eeprom_read,          &m_eeprom_args[7],  NULL,               false },
+    { "s24c08_write_1@0",       bench_eeprom_write,         &m_eeprom_args[0],  bench_eeprom_setup, true },
+    { "s24c08_write_16@0",      bench_eeprom_write,         &m_eeprom_args[1],  bench_eeprom_setup, true },
+    { "s24c08_write_64@0",      bench_eeprom_write,         &m_eeprom_args[2],  bench_eeprom_setup, true },
+    { "s24c08_write_256@0",     bench_eeprom_write,         &m_eeprom_args[3],  bench_eeprom_setup, true },
+    { "s24c08_write_1@7",       bench_eeprom_write,         &m_eeprom_args[4],  bench_eeprom_setup, true },
+    { "s24c08_write_16@7",      bench_eeprom_write,         &m_eeprom_args[5],  bench_eeprom_setup, true },
+    { "s24c08_write_64@7",      bench_eeprom_write,         &m_eeprom_args[6],  bench_eeprom_setup, true },
+    { "s24c08_write_256@7",     bench_eeprom_write,         &m_eeprom_args[7],  bench_eeprom_setup, true },
+    { "led_set_brightness",     bench_led_set_brightness,   NULL,               NULL,               false },
+    { "als_isr",                bench_als_isr,              NULL,               bench_als_setup,    false },
+    { "als_raw_to_mv",          bench_als_mv,               NULL,               NULL,               false },
+};
+
+#define BENCH_CASE_COUNT        (sizeof(m_cases) / sizeof(m_cases[0]))
+
+static struct {
+    struct arg_str *filter;
+    struct arg_int *reps;
+    struct arg_lit *write;
+    struct arg_lit *list;
+    struct arg_end *end;
+} bench_args;
+
+static int run_bench(int argc, char** argv)
+{
+    int nerrors = arg_parse(argc, argv, (void**) &bench_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, bench_args.end, argv[0]);
+        return 1;
+    }
+
+    if (bench_args.list->count != 0) {
+        for (uint32_t i = 0; i < BENCH_CASE_COUNT; i++) {
+            printf("%s%s\n", m_cases[i].name, (m_cases[i].writes ? " (--write)" : ""));
+        }
+        return 0;
+    }
+
+    const char *filter = (bench_args.filter->count != 0 ? bench_args.filter->sval[0] : "");
+    uint32_t reps = (bench_args.reps->count != 0 ? bench_args.reps->ival[0] : BENCH_REPS_DEFAULT);
+
+    if (reps == 0 || reps > BENCH_REPS_MAX) {
+        printf("%s(): the number of runs has to be 1 to %d\n", __func__, BENCH_REPS_MAX);
+        return 1;
+    }
+
+#if CONFIG_PM_ENABLE
+    /*
+     * The cycle counter runs at the cpu clock, so hold that at full
+     * speed. The console runs in the main task, which the IDF pins
+     * to the pro cpu, so every run reads the same core's counter.
+     */
+    static esp_pm_lock_handle_t lock = NULL;
+
+    if (lock == NULL) {
+        ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "bench", &lock));
+    }
+    esp_pm_lock_acquire(lock);
+#endif
+
+    bench_t b;
+
+    bench_init(&b, bench_ccount, m_samples, BENCH_REPS_MAX);
+
+    printf("# bench version=%s mhz=%d overhead=%u unit=cycles\n",
+           OMAR_VERSION, CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, b.overhead);
+    printf("case,reps,min,p50,p90,p99,max,mean\n");
+
+    for (uint32_t i = 0; i < BENCH_CASE_COUNT; i++) {
+        const bench_case_t *c = &m_cases[i];
+        bench_result_t result;
+
+        if (strstr(c->name, filter) == NULL || (c->writes && bench_args.write->count == 0)) {
+            continue;
+        }
+        if (c->setup) {
+            c->setup(c->arg);
+        }
+
+        bool eeprom_write = (c->fn == bench_eeprom_write);
+
+        if (bench_run(&b, c->fn, c->arg,
+                      (eeprom_write ? BENCH_WRITE_WARMUP : BENCH_WARMUP),
+                      (eeprom_write && reps > BENCH_WRITE_REPS ? BENCH_WRITE_REPS : reps),
+                      &result)) {
+            printf("%s,%u,%u,%u,%u,%u,%u,%u\n",
+                   c->name, result.reps, result.min, result.p50, result.p90, result.p99, result.max, result.mean);
+        }
+    }
+
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_release(lock);
+#endif
+
+    return 0;
+}
+
+void register_bench()
+{
+    bench_args.filter = arg_str0("f", "filter", "<text>", "Only the cases with this in their name");
+    bench_args.reps = arg_int0("n", "reps", "<n>", "Timed runs of each case (default 200; the eeprom writes get 5 at most)");
+    bench_args.write = arg_lit0("w", "write", "Include the cases that write the meter and eeprom (with what's already there)");
+    bench_args.list = arg_lit0("l", "list", "List the cases");
+    bench_args.end = arg_end(4);
+
+    const esp_console_cmd_t cmd = {
+        .command = "bench",
+        .help = "Time the driver hot paths in cpu cycles; prints min, p50, p90, p99, max and mean per case as csv",
+        .hint = NULL,
+        .func = &run_bench,
+        .argtable = &bench_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+#endif // HW_OMAR
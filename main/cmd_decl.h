@@ -17,4 +17,7 @@ void register_wifi();
 // Register omar-specific functions
 void register_omar();
 
+// Register the driver benchmarks
+void register_bench();
+
 void initialise_wifi(void);
@@ -4,6 +4,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <ctype.h>
@@ -16,9 +17,20 @@
 
 #include "esp_log.h"
 #include "esp_console.h"
+#include "esp_timer.h"
 #include "hw_setup.h"
 #include "omar_als_timer.h"
+#include "omar_thermal.h"
+#include "omar_relay.h"
+#include "omar_led.h"
+#include "omar_stream.h"
+#include "omar_telemetry.h"
+#include "omar_energy_log.h"
+#include "omar_boot.h"
+#include "omar_adc.h"
 #include "adi_spi.h"
+#include "trace.h"
+#include "rpc_server.h"
 #include "sdkconfig.h"
 #if defined(HW_OMAR) || defined(HW_ESP32_PICOKIT)
 #include "s5852a.h"
@@ -26,6 +38,8 @@
 
 #if defined(HW_OMAR)
 #include "s24c08.h"
+#include "i2c.h"
+#include "i2c_bus.h"
 #endif //defined(HW_OMAR) 
 
 static void register_version_info();
@@ -46,13 +60,22 @@ static void register_temperature();
 
 #if defined(HW_OMAR)
 static void register_hw_detect();
+static void register_adc();
+static void register_i2c();
+static void register_relay();
 static void register_als();
 static void register_temperature();
 static void register_eeprom();
 static void register_ledpwm();
+static void register_stream();
+static void register_telemetry();
+static void register_log();
 #endif
 
 static void register_7953();
+static void register_trace();
+static void register_rpc();
+static void register_boot();
 
 void register_omar()
 {
@@ -69,15 +92,24 @@ void register_omar()
 #endif //HW_ESP32_PICOKIT
 
     register_7953();
+    register_trace();
+    register_rpc();
+    register_boot();
 
 #if defined(HW_OMAR)
     register_toggle_white_led0();
     register_toggle_white_led1();
     register_hw_detect();
+    register_adc();
+    register_i2c();
+    register_relay();
     register_als();
     register_temperature();
     register_eeprom();
     register_ledpwm();
+    register_stream();
+    register_telemetry();
+    register_log();
 #endif
 
 }
@@ -146,23 +178,118 @@ static void register_toggle()
 #endif //HW_ESP32_PICOKIT
 
 #if defined(HW_OMAR) || defined(HW_ESP32_PICOKIT)
+static struct {
+    struct arg_lit *history;
+    struct arg_end *end;
+} temp_args;
+
+#if defined(HW_OMAR)
+/*
+ * How many of the most recent raw samples 'temp --history' shows;
+ * the rest of the sample ring is summarized by the minute buckets.
+ */
+#define TEMP_HISTORY_RECENT_SAMPLES     (12)
+
+static void print_temp_bucket(char const *label, uint32_t age, temp_bucket_t *bucket)
+{
+    printf("  %4d%s ago:  min %7.2f  max %7.2f  mean %7.2f  (%d samples)\n",
+           age,
+           label,
+           TEMP_HISTORY_TO_FLOAT(bucket->min),
+           TEMP_HISTORY_TO_FLOAT(bucket->max),
+           TEMP_HISTORY_TO_FLOAT(bucket->mean),
+           bucket->count);
+}
+
+static void print_temp_history(void)
+{
+    temp_history_t *history = malloc(sizeof(temp_history_t));
+
+    if (history == NULL) {
+        printf("%s(): Couldn't allocate %d bytes for a copy of the history\n", __func__, sizeof(temp_history_t));
+        return;
+    }
+
+    if (!thermal_get_history(history)) {
+        printf("The thermal supervisor isn't running, so there's no temperature history\n");
+        free(history);
+        return;
+    }
+
+    uint32_t now_minute = (uint32_t)(esp_timer_get_time() / 1000000) / 60;
+    temp_bucket_t bucket;
+    int16_t quarters;
+
+    printf("Most recent samples (every %d seconds, newest first):\n ", OMAR_THERMAL_SAMPLE_INTERVAL_MS/1000);
+    for (int i = 0; i < TEMP_HISTORY_RECENT_SAMPLES && temp_history_sample(history, i, &quarters); i++) {
+        printf(" %.2f", TEMP_HISTORY_TO_FLOAT(quarters));
+    }
+    printf("\n");
+
+    printf("Per minute:\n");
+    if (temp_history_current(history, &bucket)) {
+        printf("  (current):  min %7.2f  max %7.2f  mean %7.2f  (%d samples)\n",
+               TEMP_HISTORY_TO_FLOAT(bucket.min),
+               TEMP_HISTORY_TO_FLOAT(bucket.max),
+               TEMP_HISTORY_TO_FLOAT(bucket.mean),
+               bucket.count);
+    }
+    for (int i = 0; temp_history_minute(history, i, &bucket); i++) {
+        print_temp_bucket("m", now_minute - bucket.start, &bucket);
+    }
+
+    printf("Per hour:\n");
+    for (int i = 0; temp_history_hour(history, i, &bucket); i++) {
+        print_temp_bucket("h", now_minute / 60 - bucket.start, &bucket);
+    }
+
+    free(history);
+}
+#endif //defined(HW_OMAR)
+
 static int print_temp(int argc, char** argv)
 {
+    int nerrors = arg_parse(argc, argv, (void**) &temp_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, temp_args.end, argv[0]);
+        return 1;
+    }
+
+    if (temp_args.history->count != 0) {
+#if defined(HW_OMAR)
+        print_temp_history();
+#else
+        printf("Temperature history is only kept on omar hardware\n");
+#endif
+        return 0;
+    }
+
     float temp; 
 
     s5852a_get(&temp);
 
     printf("Current temperature is %02.2f\n", temp);
+#if defined(HW_OMAR)
+    printf("Thermal supervisor state is %s\n", thermal_state_name(thermal_get_state(NULL)));
+#endif
     return 0;
 }
 
 static void register_temperature()
 {
+    temp_args.history = arg_lit0(
+        "h", 
+        "history", 
+        "Print the temperature history: recent samples plus per-minute and per-hour min/max/mean");
+
+    temp_args.end = arg_end(1);
+
     const esp_console_cmd_t cmd = {
         .command = "temp",
         .help = "Print out the current temperature reading from the S-5852A temp sensor",
         .hint = NULL,
         .func = &print_temp,
+        .argtable = &temp_args
     };
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
 }
@@ -274,11 +401,6 @@ static int access_eeprom(int argc, char** argv)
         count = OMAR_EEPROM_SIZE;
         address = 0;
 
-#if defined(MEASURE_EEPROM_WRITE_TIME)
-        int startTime, finishTime;
-        startTime = xTaskGetTickCount();
-#endif
-
         esp_err_t ret = s24c08_read((uint16_t )0, buf, count);
 
         if (ret != ESP_OK) {
@@ -286,14 +408,6 @@ static int access_eeprom(int argc, char** argv)
             return 1;
         }
 
-#if defined(MEASURE_EEPROM_WRITE_TIME)
-        finishTime = xTaskGetTickCount();
-        printf("%s(): Reading all 1024 bytes of eeprom took %d ticks (that's about %d milliseconds, since 1 tick is 10 milliseconds)\n", 
-               __func__, 
-               finishTime - startTime,
-               (finishTime - startTime) * 10);
-#endif
-
         for (int i=0; i<=count/16; i++) {
             if (i*16 == count) {
                 break;
@@ -332,11 +446,6 @@ static int access_eeprom(int argc, char** argv)
 
         memset(buf, write_value, OMAR_EEPROM_SIZE);
 
-#if defined(MEASURE_EEPROM_WRITE_TIME)
-        int startTime, finishTime;
-        startTime = xTaskGetTickCount();
-#endif
-
         esp_err_t ret = s24c08_write(0, buf, count);
 
         if (ret != ESP_OK) {
@@ -344,14 +453,6 @@ static int access_eeprom(int argc, char** argv)
             return 1;
         }
 
-#if defined(MEASURE_EEPROM_WRITE_TIME)
-        finishTime = xTaskGetTickCount();
-        printf("%s(): Erasing all 1024 bytes of eeprom took %d ticks (that's about %d milliseconds, since 1 tick is 10 milliseconds)\n", 
-               __func__, 
-               finishTime - startTime,
-               (finishTime - startTime) * 10);
-#endif
-
         goto finish;
     }
 
@@ -693,8 +794,11 @@ static struct {
     struct arg_int *led;        // specify the led to dim/brighten - "1" or "2"
     struct arg_lit *getduty;    // return the current duty cycle in effect for the specified led
     struct arg_int *setduty;    // set the pwm duty cycle for the led (maximum is OMAR_LED_MAX_DUTY or 8191)
-    struct arg_int *brighten;   // increase the pwm duty cycle by the specified amount
-    struct arg_int *dim;        // decrease the pwm duty cycle by the specified amount
+    struct arg_int *level;      // set the perceptual brightness level (maximum is OMAR_LED_LEVEL_MAX or 1000)
+    struct arg_int *brighten;   // increase the perceptual brightness level by the specified amount
+    struct arg_int *dim;        // decrease the perceptual brightness level by the specified amount
+    struct arg_int *fade;       // fade to the new duty cycle over this many milliseconds
+    struct arg_int *blink;      // blink at the current duty cycle, this many milliseconds on and off
     struct arg_end *end;
 } ledpwm_args;
 
@@ -732,7 +836,21 @@ static int led_pwm(int argc, char** argv)
     bool getset = 
       (ledpwm_args.getduty->count == 1)
       ||
-      (ledpwm_args.setduty->count == 1);
+      (ledpwm_args.setduty->count == 1)
+      ||
+      (ledpwm_args.level->count == 1);
+
+    if (ledpwm_args.level->count == 1
+        &&
+        (ledpwm_args.getduty->count == 1 || ledpwm_args.setduty->count == 1)) {
+        printf("%s(): the \"--level\", \"--get\" and \"--set\" options are mutually exclusive - pick one\n", __func__);
+        return 1;
+    }
+
+    if (ledpwm_args.blink->count == 1 && (brightdim || getset)) {
+        printf("%s(): \"--blink\" can't be combined with \"--get\", \"--set\", \"--level\", \"--brighten\" or \"--dim\"\n", __func__);
+        return 1;
+    }
 
     if (brightdim && getset) {
         printf("%s(): the \"--get\"/\"--set\" apis, and the \"--brighten\"/\"--dim\" apis are mutually exclusive - pick one\n", __func__);
@@ -746,8 +864,22 @@ static int led_pwm(int argc, char** argv)
         return 1;
     }
 
+    uint8_t led_gpio = (led == 1 ? OMAR_WHITE_LED0 : OMAR_WHITE_LED1);
+    uint32_t fade_msec = (ledpwm_args.fade->count == 1 ? ledpwm_args.fade->ival[0] : 0);
+
+    if (ledpwm_args.blink->count == 1) {
+        uint32_t duty = led_get_brightness(led_gpio);
+
+        led_blink(led_gpio, 
+                  (duty != 0 ? duty : OMAR_LED_MAX_DUTY), 
+                  ledpwm_args.blink->ival[0], 
+                  ledpwm_args.blink->ival[0], 
+                  0);
+        return 0;
+    }
+
     if (!(brightdim || getset)) {
-        printf("%s(): Pick something you want to do -- either \"--get\", \"--set\", \"--brighten\" or \"--dim\"\n", __func__);
+        printf("%s(): Pick something you want to do -- either \"--get\", \"--set\", \"--level\", \"--brighten\" or \"--dim\"\n", __func__);
         return 1;
     }
 
@@ -755,36 +887,55 @@ static int led_pwm(int argc, char** argv)
     if (brightdim) {
         operation = (ledpwm_args.brighten->count == 0 ? 'd' : 'b');
     } else if (getset) {
-        operation = (ledpwm_args.getduty->count == 0 ? 's' : 'g');
+        operation = (ledpwm_args.getduty->count == 1 
+                     ? 'g' 
+                     : (ledpwm_args.level->count == 1 ? 'l' : 's'));
     }
 
-    uint8_t led_gpio = (led == 1 ? OMAR_WHITE_LED0 : OMAR_WHITE_LED1);
-    uint32_t new_duty_cycle = led_get_brightness(led_gpio);
+    uint32_t new_duty_cycle;
 
     if (brightdim) {
+        /*
+         * Steps are in perceptual levels, so each one looks like
+         * the same change in brightness wherever on the curve the
+         * led happens to be:
+         */
+        int new_level = led_get_level(led_gpio);
+
         if (operation == 'd') {
-            new_duty_cycle -= ledpwm_args.dim->ival[0];
+            new_level -= ledpwm_args.dim->ival[0];
         } else {
-            new_duty_cycle += ledpwm_args.brighten->ival[0];
+            new_level += ledpwm_args.brighten->ival[0];
         }
 
-        led_set_brightness(led_gpio, new_duty_cycle);
+        if (new_level < 0) {
+            new_level = 0;
+        } else if (new_level > OMAR_LED_LEVEL_MAX) {
+            new_level = OMAR_LED_LEVEL_MAX;
+        }
+
+        led_set_level(led_gpio, new_level, fade_msec);
 
-        printf("%s(): %s's new duty cycle is %d\n",
+        printf("%s(): %s's new level is %d (duty cycle %.3f)\n",
                __func__,
                (led == 1 ? "OMAR_WHITE_LED0" : "OMAR_WHITE_LED1"),
-               led_get_brightness(led_gpio));
+               new_level,
+               led_level_to_duty_q3(new_level) / (float)(1 << OMAR_LED_DUTY_Q3_SHIFT));
 
     } else if (getset) {
         if (operation == 'g') {
-            printf("%s(): %s's current duty cycle is %d\n",
+            printf("%s(): %s's current duty cycle is %d (level %d)\n",
                    __func__,
                    (led == 1 ? "OMAR_WHITE_LED0" : "OMAR_WHITE_LED1"),
-                   led_get_brightness(led_gpio));
+                   led_get_brightness(led_gpio),
+                   led_get_level(led_gpio));
+
+        } else if (operation == 'l') {
+            led_set_level(led_gpio, ledpwm_args.level->ival[0], fade_msec);
 
         } else if (operation == 's') {
             new_duty_cycle = ledpwm_args.setduty->ival[0];
-            led_set_brightness(led_gpio, new_duty_cycle);
+            led_fade_brightness(led_gpio, new_duty_cycle, fade_msec);
 
         }
 
@@ -815,24 +966,42 @@ static void register_ledpwm()
         "<int>", 
         "Specify the pwm duty cycle for the led (min is 0, max is 8191)");
 
+    ledpwm_args.level = arg_int0(
+        "v", 
+        "level", 
+        "<int>", 
+        "Specify the perceptual brightness level for the led (min is 0, max is 1000)");
+
     ledpwm_args.brighten = arg_int0(
         "b", 
         "brighten", 
         "<int>", 
-        "Brighten the led by increasing the pwm duty cycle by the specified amount");
+        "Brighten the led by the specified number of perceptual levels");
 
 
     ledpwm_args.dim = arg_int0(
         "d", 
         "dim", 
         "<int>", 
-        "Dim the led by decreasing the pwm duty cycle by the specified amount");
+        "Dim the led by the specified number of perceptual levels");
+
+    ledpwm_args.fade = arg_int0(
+        "f", 
+        "fade", 
+        "<msec>", 
+        "Fade to the new duty cycle over this many milliseconds instead of jumping straight to it");
+
+    ledpwm_args.blink = arg_int0(
+        "k", 
+        "blink", 
+        "<msec>", 
+        "Blink the led (on and off for this many milliseconds each) until the next --set/--brighten/--dim");
 
     ledpwm_args.end = arg_end(3);
 
     const esp_console_cmd_t pwm_cmd = {
         .command = "pwm",
-        .help = "Dim or brighten the leds; get/set the current pwm duty cycle for each led",
+        .help = "Dim, brighten, fade or blink the leds; get/set the current pwm duty cycle for each led",
         .hint = NULL,
         .func = &led_pwm,
         .argtable = &ledpwm_args
@@ -882,6 +1051,139 @@ static void register_hw_detect()
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
 }
 
+static int print_adc(int argc, char** argv)
+{
+    printf("input    characterized  raw   min   max   mV     table error\n");
+
+    for (int channel = 0; channel < OMAR_ADC_COUNT; channel++) {
+        omar_adc_reading_t reading;
+        uint32_t worst_raw;
+
+        if (omar_adc_read(channel, OMAR_ADC_SAMPLES, &reading) != ESP_OK) {
+            printf("%s(): %s couldn't be read\n", __func__, omar_adc_name(channel));
+            return 1;
+        }
+
+        uint32_t worst = omar_adc_check(channel, &worst_raw);
+
+        printf("%-8s %-14s %-5u %-5u %-5u %-6u %umV at %u\n",
+               omar_adc_name(channel),
+               omar_adc_cal_name(channel),
+               reading.raw,
+               reading.raw_min,
+               reading.raw_max,
+               reading.mv,
+               worst,
+               worst_raw);
+    }
+
+    return 0;
+}
+
+static void register_adc()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "adc",
+        .help = "Print out calibrated readings of the als and hw detect inputs, and how far the conversion table is from esp_adc_cal",
+        .hint = NULL,
+        .func = &print_adc,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+static struct {
+    struct arg_lit *reset;
+    struct arg_end *end;
+} i2c_args;
+
+static int print_i2c_stats(int argc, char** argv)
+{
+    int nerrors = arg_parse(argc, argv, (void**) &i2c_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, i2c_args.end, argv[0]);
+        return 1;
+    }
+
+    if (i2c_args.reset->count != 0) {
+        i2c_bus_reset_stats();
+        return 0;
+    }
+
+    i2c_stats_t stats;
+
+    i2c_get_stats(&stats);
+
+    printf("I2C transactions:\t%u (%u errors)\n", stats.transactions, stats.errors);
+    printf("Command link nodes:\t%u (%u per transaction max)\n", stats.cmd_nodes, stats.max_cmd_nodes);
+    printf("Free heap low-water:\t%u bytes\n", stats.min_free_heap);
+    printf("Bus recoveries:\t\t%u\n", i2c_bus_get_recoveries());
+
+    printf("\nDevice\tCount\tErrors\tMissed\tp50(us)\tp90(us)\tp99(us)\tmax(us)\n");
+    for (int dev = 0; dev < I2C_BUS_DEV_COUNT; dev++) {
+        i2c_bus_dev_stats_t dev_stats;
+        i2c_bus_get_stats(dev, &dev_stats);
+        printf("%s\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n",
+               i2c_bus_dev_name(dev),
+               dev_stats.count,
+               dev_stats.errors,
+               dev_stats.deadline_misses,
+               dev_stats.p50_usec,
+               dev_stats.p90_usec,
+               dev_stats.p99_usec,
+               dev_stats.max_usec);
+    }
+
+    return 0;
+}
+
+static void register_i2c()
+{
+    i2c_args.reset = arg_lit0(
+        "r", 
+        "reset", 
+        "Reset the per-device latency statistics");
+
+    i2c_args.end = arg_end(1);
+
+    const esp_console_cmd_t cmd = {
+        .command = "i2c",
+        .help = "Print out I2C transaction, heap and per-device latency statistics",
+        .hint = NULL,
+        .func = &print_i2c_stats,
+        .argtable = &i2c_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+static int print_relay_info(int argc, char** argv)
+{
+    printf("relay  state   pulses  zx half period(usec)\n");
+
+    for (int relay = 0; relay < OMAR_RELAY_COUNT; relay++) {
+        omar_relay_info_t info;
+
+        relay_get_info(relay, &info);
+        printf("#%d     %-6s  %6d  %d\n",
+               relay + 1,
+               (info.closed ? "closed" : "open"),
+               info.pulses,
+               info.zx_half_period_usec);
+    }
+
+    return 0;
+}
+
+static void register_relay()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "relay",
+        .help = "Print out relay state, pulse counts and the zero-cross period",
+        .hint = NULL,
+        .func = &print_relay_info,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
 static struct {
     struct arg_lit *timer_off;
     struct arg_lit *timer_on;
@@ -953,10 +1255,18 @@ static int print_als(int argc, char** argv)
         als_args.timer_on->count == 0
         &&
         als_args.secondarytimer_period->count == 0) {
-        int adc = als_raw();
+        omar_adc_reading_t reading;
 
-        printf("Ambient light sensor reading is %d (0x%02x)\n", 
-               adc, adc);
+        if (omar_adc_read(OMAR_ADC_ALS, OMAR_ADC_SAMPLES, &reading) != ESP_OK) {
+            printf("%s(): The ambient light sensor couldn't be read\n", __func__);
+            return 1;
+        }
+
+        printf("Ambient light sensor reading is %u (0x%02x), %umV\n", 
+               reading.raw, reading.raw, reading.mv);
+        if (als_get_dropped_events() != 0) {
+            printf("(%u timer events have been dropped; the event queue was full)\n", als_get_dropped_events());
+        }
         return 0;
     }
 
@@ -1217,6 +1527,471 @@ static void register_7953(void)
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
 }
 
+static struct {
+    struct arg_str *cmd;
+    struct arg_int *count;
+    struct arg_end *end;
+} trace_args;
+
+
+static int trace(int argc, char** argv)
+{
+    int nerrors = arg_parse(argc, argv, (void**) &trace_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, trace_args.end, argv[0]);
+        return 1;
+    }
+
+    char const *cmd = trace_args.cmd->sval[0];
+
+    if (strcmp(cmd, "dump") == 0) {
+        trace_dump(trace_args.count->count == 1 ? trace_args.count->ival[0] : 0);
+    } else if (strcmp(cmd, "clear") == 0) {
+        trace_clear();
+    } else if (strcmp(cmd, "stats") == 0) {
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            printf("core %d: %u events recorded\n", core, trace_count(core));
+        }
+    } else {
+        printf("%s(): '%s' is not a recognized trace command - please enter \"dump\", \"clear\" or \"stats\"\n",
+               __func__, cmd);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void register_trace(void)
+{
+    trace_args.cmd = arg_str1(
+        NULL, 
+        NULL, 
+        "<dump|clear|stats>", 
+        "dump -- decode and print the trace rings; clear -- forget them; stats -- count events per core");
+
+    trace_args.count = arg_int0(
+        "n", 
+        "count", 
+        "<int>", 
+        "With dump, only print the newest <int> events from each core");
+
+    trace_args.end = arg_end(2);
+
+    const esp_console_cmd_t cmd = {
+        .command = "trace",
+        .help = "Dump the driver event trace",
+        .hint = NULL,
+        .func = &trace,
+        .argtable = &trace_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+#if defined(HW_OMAR)
+static struct {
+    struct arg_int *rate;
+    struct arg_str *channels;
+    struct arg_end *end;
+} stream_args;
+
+
+static int stream(int argc, char** argv)
+{
+    int nerrors = arg_parse(argc, argv, (void**) &stream_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, stream_args.end, argv[0]);
+        return 1;
+    }
+
+    uint32_t hz = (stream_args.rate->count == 1 ? stream_args.rate->ival[0] : 10);
+    uint32_t mask = 
+        (stream_args.channels->count == 1 
+         ? stream_channel_mask(stream_args.channels->sval[0]) 
+         : STREAM_ALL_CHANNELS);
+
+    if (hz < 1 || hz > OMAR_STREAM_MAX_HZ) {
+        printf("%s(): the rate must be between 1 and %d Hz\n", __func__, OMAR_STREAM_MAX_HZ);
+        return 1;
+    }
+
+    if (mask == 0) {
+        printf("%s(): unrecognized channel in \"%s\" - pick from:", __func__, stream_args.channels->sval[0]);
+        for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+            printf(" %s", stream_channel_name(ch));
+        }
+        printf(" (or all)\n");
+        return 1;
+    }
+
+    if (!omar_stream_start(hz, mask)) {
+        printf("%s(): couldn't start the stream\n", __func__);
+        return 1;
+    }
+
+    // Any key stops it:
+    getchar();
+
+    omar_stream_stats_t stats;
+
+    omar_stream_stop(&stats);
+    printf("# stream stopped: %u records, %u missed\n", stats.records, stats.missed);
+
+    return 0;
+}
+
+static void register_stream(void)
+{
+    stream_args.rate = arg_int0(
+        "r", 
+        "rate", 
+        "<hz>", 
+        "Records per second (1 to 100, default 10)");
+
+    stream_args.channels = arg_str0(
+        "c", 
+        "channels", 
+        "<list>", 
+        "Comma-separated channels: vrms,irmsa,irmsb,awatt,bwatt,aenergy,benergy,als,temp (default all)");
+
+    stream_args.end = arg_end(2);
+
+    const esp_console_cmd_t cmd = {
+        .command = "stream",
+        .help = "Print fixed-width, sequence-numbered meter/als/temperature records until a key is pressed",
+        .hint = NULL,
+        .func = &stream,
+        .argtable = &stream_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+static struct {
+    struct arg_str *action;
+    struct arg_str *addr;
+    struct arg_int *port;
+    struct arg_lit *tcp;
+    struct arg_int *rate;
+    struct arg_str *channels;
+    struct arg_end *end;
+} telemetry_args;
+
+
+// Hundredths, for the rates below:
+static void print_ratio(uint64_t num, uint64_t den)
+{
+    uint64_t hundredths = (den != 0 ? num * 100 / den : 0);
+
+    printf("%u.%02u", (uint32_t)(hundredths / 100), (uint32_t)(hundredths % 100));
+}
+
+static void print_telemetry_status(void)
+{
+    omar_telemetry_status_t status;
+
+    omar_telemetry_get_status(&status);
+    if (status.hz == 0) {
+        printf("telemetry: never started\n");
+        return;
+    }
+
+    const telem_pub_stats_t *stats = &status.stats;
+    uint32_t channels = 0;
+
+    printf("telemetry: %s, %s to %s:%u at %u Hz, channels:", 
+           (status.running ? "running" : "stopped"), (status.cfg.tcp ? "tcp" : "udp"), 
+           status.cfg.host, status.cfg.port, status.hz);
+    for (int ch = 0; ch < STREAM_CHANNEL_COUNT; ch++) {
+        if (status.cfg.mask & STREAM_CHANNEL_BIT(ch)) {
+            printf(" %s", stream_channel_name(ch));
+            channels++;
+        }
+    }
+    printf("\n");
+
+    // Raw is a 4-byte time and 4 bytes a channel:
+    printf("  %u samples in %u frames: ", stats->samples, stats->frames);
+    print_ratio(stats->frame_bytes, stats->samples);
+    printf(" bytes/sample (raw %u), ", 4 * (1 + channels));
+    print_ratio((uint64_t) stats->frames * 1000, status.uptime_ms);
+    printf(" frames/sec\n");
+
+    printf("  sent %u frames (%u bytes), %u connects, %u busy, %u errors\n", 
+           stats->sent, stats->sent_bytes, stats->connects, stats->busy, stats->errors);
+    printf("  waiting: %u bytes in ram, %u in the spill file; spilled %u, unspilled %u, dropped %u\n", 
+           status.queued, status.spill_pending, stats->spilled, stats->unspilled, stats->dropped);
+}
+
+static int telemetry(int argc, char** argv)
+{
+    int nerrors = arg_parse(argc, argv, (void**) &telemetry_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, telemetry_args.end, argv[0]);
+        return 1;
+    }
+
+    const char *action = telemetry_args.action->sval[0];
+
+    if (strcmp(action, "stats") == 0) {
+        print_telemetry_status();
+        return 0;
+    }
+
+    if (strcmp(action, "stop") == 0) {
+        omar_telemetry_stop();
+        print_telemetry_status();
+        return 0;
+    }
+
+    if (strcmp(action, "start") != 0) {
+        printf("%s(): \"%s\" isn't start, stop or stats\n", __func__, action);
+        return 1;
+    }
+
+    telem_pub_config_t cfg = {
+        .port = (telemetry_args.port->count == 1 ? telemetry_args.port->ival[0] : CONFIG_TELEMETRY_PORT),
+        .tcp = (telemetry_args.tcp->count != 0),
+        .mask = 
+            (telemetry_args.channels->count == 1 
+             ? stream_channel_mask(telemetry_args.channels->sval[0]) 
+             : STREAM_ALL_CHANNELS),
+    };
+    uint32_t hz = (telemetry_args.rate->count == 1 ? telemetry_args.rate->ival[0] : CONFIG_TELEMETRY_HZ);
+
+    strlcpy(cfg.host, 
+            (telemetry_args.addr->count == 1 ? telemetry_args.addr->sval[0] : CONFIG_TELEMETRY_COLLECTOR), 
+            sizeof(cfg.host));
+
+    if (hz < 1 || hz > OMAR_TELEMETRY_MAX_HZ) {
+        printf("%s(): the rate must be between 1 and %d Hz\n", __func__, OMAR_TELEMETRY_MAX_HZ);
+        return 1;
+    }
+
+    if (cfg.mask == 0) {
+        printf("%s(): unrecognized channel in \"%s\"\n", __func__, telemetry_args.channels->sval[0]);
+        return 1;
+    }
+
+    if (!omar_telemetry_start(&cfg, hz)) {
+        printf("%s(): couldn't start telemetry to \"%s\" port %u (already running?)\n", __func__, cfg.host, cfg.port);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void register_telemetry(void)
+{
+    telemetry_args.action = arg_str1(
+        NULL, 
+        NULL, 
+        "<start|stop|stats>", 
+        "Start or stop publishing, or show what's been sent");
+
+    telemetry_args.addr = arg_str0(
+        "a", 
+        "addr", 
+        "<a.b.c.d>", 
+        "Collector address (default " CONFIG_TELEMETRY_COLLECTOR ")");
+
+    telemetry_args.port = arg_int0(
+        "p", 
+        "port", 
+        "<port>", 
+        "Collector port");
+
+    telemetry_args.tcp = arg_lit0(
+        NULL, 
+        "tcp", 
+        "Use tcp rather than udp");
+
+    telemetry_args.rate = arg_int0(
+        "r", 
+        "rate", 
+        "<hz>", 
+        "Samples per second (1 to 10)");
+
+    telemetry_args.channels = arg_str0(
+        "c", 
+        "channels", 
+        "<list>", 
+        "Comma-separated channels, as for 'stream' (default all)");
+
+    telemetry_args.end = arg_end(6);
+
+    const esp_console_cmd_t cmd = {
+        .command = "telemetry",
+        .help = "Publish batched, compressed meter/als/temperature frames to a udp or tcp collector",
+        .hint = NULL,
+        .func = &telemetry,
+        .argtable = &telemetry_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+static struct {
+    struct arg_str *action;
+    struct arg_int *from;
+    struct arg_int *to;
+    struct arg_int *max;
+    struct arg_end *end;
+} log_args;
+
+typedef struct {
+    uint32_t printed;
+    uint32_t max;
+} log_query_ctx_t;
+
+
+static bool print_log_record(const energy_log_record_t *record, void *arg)
+{
+    log_query_ctx_t *ctx = arg;
+
+    printf("%10u %9d %9d %9d %9d %7.2f\n", 
+           record->time, record->aenergy, record->benergy, record->renergy, record->vpeak, 
+           record->temperature / 4.0);
+    return (++ctx->printed < ctx->max);
+}
+
+static int energy_log(int argc, char** argv)
+{
+    int nerrors = arg_parse(argc, argv, (void**) &log_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, log_args.end, argv[0]);
+        return 1;
+    }
+
+    const char *action = log_args.action->sval[0];
+    energy_log_summary_t summary;
+    energy_log_stats_t stats;
+
+    if (!omar_energy_log_get_summary(&summary, &stats)) {
+        printf("%s(): the energy log isn't running (it needs CONFIG_STORE_HISTORY)\n", __func__);
+        return 1;
+    }
+
+    if (strcmp(action, "stats") == 0) {
+        printf("%u records in %u blocks, times %u to %u\n", summary.records, summary.blocks, summary.t_min, summary.t_max);
+        printf("%u appended, %u block writes (%u failed), %u blocks read by queries (%u bad)\n", 
+               stats.appended, stats.writes, stats.write_errors, stats.blocks_read, stats.bad_blocks);
+        return 0;
+    }
+
+    if (strcmp(action, "flush") == 0) {
+        return (omar_energy_log_flush() == ESP_OK ? 0 : 1);
+    }
+
+    if (strcmp(action, "query") != 0) {
+        printf("%s(): \"%s\" isn't query, stats or flush\n", __func__, action);
+        return 1;
+    }
+
+    uint32_t from = (log_args.from->count == 1 ? (uint32_t) log_args.from->ival[0] : 0);
+    uint32_t to = (log_args.to->count == 1 ? (uint32_t) log_args.to->ival[0] : UINT32_MAX);
+    log_query_ctx_t ctx = {
+        .max = (log_args.max->count == 1 && log_args.max->ival[0] > 0 ? log_args.max->ival[0] : 50),
+    };
+    uint32_t blocks_read = stats.blocks_read;
+    int64_t start = esp_timer_get_time();
+
+    printf("# %8s %9s %9s %9s %9s %7s\n", "time", "aenergy", "benergy", "renergy", "vpeak", "temp");
+    uint32_t matched = omar_energy_log_query(from, to, print_log_record, &ctx);
+    uint32_t usec = (uint32_t)(esp_timer_get_time() - start);
+
+    omar_energy_log_get_summary(&summary, &stats);
+    printf("# %u records, %u blocks read, %u.%03u msec%s\n", 
+           matched, stats.blocks_read - blocks_read, usec / 1000, usec % 1000, 
+           (ctx.printed == ctx.max ? " (stopped at -n; there may be more)" : ""));
+    return 0;
+}
+
+static void register_log(void)
+{
+    log_args.action = arg_str1(
+        NULL, 
+        NULL, 
+        "<query|stats|flush>", 
+        "Print records, say how full the log is, or write out the block still filling up");
+
+    log_args.from = arg_int0(
+        NULL, 
+        "from", 
+        "<sec>", 
+        "Earliest record time (default the start)");
+
+    log_args.to = arg_int0(
+        NULL, 
+        "to", 
+        "<sec>", 
+        "Latest record time (default the end)");
+
+    log_args.max = arg_int0(
+        "n", 
+        NULL, 
+        "<count>", 
+        "Most records to print (default 50, which fits the console's output ring)");
+
+    log_args.end = arg_end(4);
+
+    const esp_console_cmd_t cmd = {
+        .command = "log",
+        .help = "Query the on-flash energy log (energy, reactive energy, voltage peak, temperature per period)",
+        .hint = NULL,
+        .func = &energy_log,
+        .argtable = &log_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+#endif //defined(HW_OMAR)
+
+static struct {
+    struct arg_lit *timing;
+    struct arg_end *end;
+} boot_args;
+
+
+static int boot(int argc, char** argv)
+{
+    int nerrors = arg_parse(argc, argv, (void**) &boot_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, boot_args.end, argv[0]);
+        return 1;
+    }
+
+    omar_boot_report(boot_args.timing->count == 1);
+    return 0;
+}
+
+static void register_boot(void)
+{
+    boot_args.timing = arg_lit0("t", "timing", "Show when each setup stage ran, how long it took, and the critical path");
+    boot_args.end = arg_end(1);
+
+    const esp_console_cmd_t cmd = {
+        .command = "boot",
+        .help = "Report how long the hardware setup took to reach ready and to finish",
+        .hint = NULL,
+        .func = &boot,
+        .argtable = &boot_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+static int rpc(int argc, char** argv)
+{
+    return rpc_server_run();
+}
+
+static void register_rpc(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "rpc",
+        .help = "Switch the console to binary rpc frames until the host says bye (or sends ^C^C^C)",
+        .hint = NULL,
+        .func = &rpc,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
 static int omar_version(int argc, char** argv)
 {
     printf("Verion %s on branch \"%s\", built on %s\n", OMAR_VERSION, OMAR_BRANCH, OMAR_TIMESTAMP);
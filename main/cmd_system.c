@@ -14,10 +14,18 @@
 #include "esp_console.h"
 #include "esp_system.h"
 #include "esp_sleep.h"
+#include "esp_pm.h"
 #include "driver/rtc_io.h"
 #include "driver/uart.h"
 #include "argtable3/argtable3.h"
 #include "cmd_decl.h"
+#include "console_out.h"
+#include "console_history.h"
+#include "console_prof.h"
+#include "omar_tasks.h"
+#include "omar_postmortem.h"
+#include "omar_power.h"
+#include "trace.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "soc/rtc_cntl_reg.h"
@@ -29,10 +37,14 @@
 #endif
 
 static void register_free();
+static void register_console();
+static void register_prof();
 static void register_restart();
 static void register_deep_sleep();
 static void register_light_sleep();
 static void register_make();
+static void register_postmortem();
+static void register_power();
 #if WITH_TASKS_INFO
 static void register_tasks();
 #endif
@@ -40,10 +52,14 @@ static void register_tasks();
 void register_system()
 {
     register_free();
+    register_console();
+    register_prof();
     register_restart();
     register_deep_sleep();
     register_light_sleep();
     register_make();
+    register_postmortem();
+    register_power();
 #if WITH_TASKS_INFO
     register_tasks();
 #endif
@@ -87,11 +103,285 @@ static void register_free()
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
 }
 
+/** 'postmortem' command prints what the last run left in rtc memory */
+
+static int postmortem(int argc, char** argv)
+{
+    const omar_postmortem_t *pm = omar_postmortem_get();
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        printf("core %d reset: %s (%d)\n", core, omar_postmortem_reset_name(pm->reset_reason[core]), pm->reset_reason[core]);
+    }
+
+    if (!pm->survived) {
+        printf("nothing survived the reset (a power cycle, or new firmware)\n");
+        return 0;
+    }
+    printf("%u resets since the last power cycle\n", pm->resets);
+
+    if (pm->have_state) {
+        const postmortem_state_t *state = &pm->state;
+
+        printf("state saved %u ms into the last run:\n", state->uptime_ms);
+        printf("  energy: a %lld, b %lld, reactive a %lld, b %lld\n",
+               state->energy[0], state->energy[1], state->energy[2], state->energy[3]);
+        printf("  relays: 1 %s, 2 %s\n",
+               (state->relays & 1 ? "closed" : "open"), (state->relays & 2 ? "closed" : "open"));
+    } else {
+        printf("no state was saved\n");
+    }
+
+    for (int core = 0; core < POSTMORTEM_CORES; core++) {
+        uint32_t count = pm->trace_count[core];
+
+        printf("core %d: last %u events (%u damaged)\n", core, count, pm->trace_bad[core]);
+        if (count == 0) {
+            continue;
+        }
+
+        // Relative to the newest, as in 'trace':
+        uint32_t newest = pm->trace[core][count - 1].timestamp;
+
+        for (uint32_t i = 0; i < count; i++) {
+            char message[96];
+            uint32_t ago = newest - pm->trace[core][i].timestamp;
+
+            trace_format(&pm->trace[core][i], message, sizeof(message));
+            printf("  -%10u us  %s\n", ago, message);
+        }
+    }
+    return 0;
+}
+
+static void register_postmortem()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "postmortem",
+        .help = "Show why we reset, and the energy totals, relays and trace events the last run left in rtc memory",
+        .hint = NULL,
+        .func = &postmortem,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+/** 'power' command shows what's kept the chip awake, and the pm locks */
+
+static int power(int argc, char** argv)
+{
+    omar_power_status_t status;
+
+    omar_power_get_status(&status);
+    printf("light sleep: %s, wake allowed for %u usec, %u uart wakes\n",
+           (status.light_sleep ? "on" : "off"), status.wake_us, status.uart_wakes);
+
+    printf("%-10s %8s %12s\n", "hold", "taken", "held (ms)");
+    for (int i = 0; i < OMAR_POWER_HOLD_COUNT; i++) {
+        const omar_power_hold_stats_t *hold = &status.holds[i];
+        printf("%-10s %8u %12llu%s\n", omar_power_hold_name(i), hold->count, hold->held_us / 1000,
+               (hold->held ? " (held)" : ""));
+    }
+
+    printf("%-10s %8s %8s %8s %10s %10s\n", "deadline", "armed", "met", "missed", "kept awake", "worst (us)");
+    for (int i = 0; i < OMAR_WAKE_COUNT; i++) {
+        const power_sched_stats_t *wake = &status.wakes[i];
+        printf("%-10s %8u %8u %8u %10u %10u\n", omar_power_wake_name(i), wake->arms, wake->met, wake->missed,
+               wake->kept_awake, wake->worst_late_us);
+    }
+
+#if CONFIG_PM_ENABLE
+    /* The pm locks, and only with CONFIG_PM_PROFILING the time in each mode (SLEEP is light sleep) */
+    esp_pm_dump_locks(stdout);
+#if !CONFIG_PM_PROFILING
+    printf("(time in each power mode needs CONFIG_PM_PROFILING)\n");
+#endif
+#endif
+    return 0;
+}
+
+static void register_power()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "power",
+        .help = "Show the power manager's holds and deadlines, and the pm locks held",
+        .hint = NULL,
+        .func = &power,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+/** 'console' command prints the console output ring statistics */
+
+static int console_stats(int argc, char** argv)
+{
+    console_out_stats_t stats;
+
+    console_out_get_stats(&stats);
+    printf("tx ring: %u of %u bytes in use, high water %u\n", stats.used, stats.size, stats.high_water);
+    printf("lines:   %u written, %u dropped (%u bytes)\n", stats.written, stats.dropped, stats.dropped_bytes);
+
+#if CONFIG_STORE_HISTORY
+    console_history_stats_t history;
+
+    console_history_get_stats(&history);
+    printf("history: %u commands, %u saves, %u compactions, %u dropped, %u errors\n",
+           history.commands, history.saves, history.compactions, history.dropped, history.errors);
+#endif
+    return 0;
+}
+
+static void register_console()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "console",
+        .help = "Get console output and history statistics",
+        .hint = NULL,
+        .func = &console_stats,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+/** 'prof' command prints how long each console command has taken */
+
+static struct {
+    struct arg_lit *reset;
+    struct arg_end *end;
+} prof_args;
+
+static int prof(int argc, char** argv)
+{
+    int nerrors = arg_parse(argc, argv, (void**) &prof_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, prof_args.end, argv[0]);
+        return 1;
+    }
+
+    if (prof_args.reset->count == 1) {
+        console_prof_reset();
+        return 0;
+    }
+
+    const cmd_prof_t *p = console_prof_get();
+    uint8_t order[CMD_PROF_MAX_COMMANDS];
+
+    // Most expensive (by total time) first:
+    for (uint32_t i = 0; i < p->used; i++) {
+        uint32_t j = i;
+
+        while (j > 0 && p->entries[order[j - 1]].usec.total < p->entries[i].usec.total) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    printf("%-16s %7s %12s %10s %10s %10s %9s %11s\n",
+           "command", "count", "total us", "mean us", "p99 us", "max us", "heap", "heap total");
+    for (uint32_t i = 0; i < p->used; i++) {
+        const cmd_prof_entry_t *e = &p->entries[order[i]];
+
+        printf("%-16s %7u %12llu %10llu %10u %10u %9d %11lld\n",
+               e->name,
+               e->usec.count,
+               e->usec.total,
+               e->usec.total / e->usec.count,
+               latency_hist_percentile(&e->usec, 99),
+               e->usec.max,
+               e->heap_last,
+               e->heap_total);
+    }
+
+    if (p->overflow) {
+        printf("(%u runs of other commands weren't recorded; the table is full)\n", p->overflow);
+    }
+    return 0;
+}
+
+static void register_prof()
+{
+    prof_args.reset = arg_lit0("r", "reset", "Forget everything recorded so far");
+    prof_args.end = arg_end(1);
+
+    const esp_console_cmd_t cmd = {
+        .command = "prof",
+        .help = "Get per-command run time (count, total, mean, p99, max) and heap kept by the last and all runs",
+        .hint = NULL,
+        .func = &prof,
+        .argtable = &prof_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
 /** 'tasks' command prints the list of tasks and related information */
 #if WITH_TASKS_INFO
 
+static struct {
+    struct arg_lit *cpu;
+    struct arg_end *end;
+} tasks_args;
+
+static int tasks_cpu(void)
+{
+    task_load_t *load = malloc(sizeof(task_load_t));
+    uint16_t busy[portNUM_PROCESSORS];
+
+    if (load == NULL) {
+        ESP_LOGE(__func__, "failed to allocate a copy of the task load");
+        return 1;
+    }
+    if (!omar_task_mon_get(load, busy)) {
+        printf("No samples yet, try again in %d sec\n", OMAR_TASK_MON_PERIOD_MS / 1000);
+        free(load);
+        return 1;
+    }
+
+    task_load_sort(load);
+
+    printf("Last %u.%03u sec:", load->window / 1000000, (load->window / 1000) % 1000);
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++) {
+        printf(" cpu%d %u.%u%% busy%s", cpu, busy[cpu] / 10, busy[cpu] % 10, (cpu + 1 < portNUM_PROCESSORS ? "," : "\n"));
+    }
+
+    printf("%-16s %4s %4s %6s %10s\n", "task", "core", "prio", "cpu %", "stack free");
+    for (uint32_t i = 0; i < load->count; i++) {
+        const task_load_entry_t *e = &load->entries[i];
+
+        if (e->core == TASK_LOAD_NO_CORE) {
+            printf("%-16s %4s", e->name, "-");
+        } else {
+            printf("%-16s %4d", e->name, e->core);
+        }
+        printf(" %4u %4u.%u %10u\n", e->prio, e->share / 10, e->share % 10, e->stack_free);
+    }
+
+    if (load->overflows) {
+        printf("(%u samples missed tasks; there were more than %d)\n", load->overflows, TASK_LOAD_MAX);
+    }
+
+    const omar_lock_stats_t *lock;
+    for (uint32_t i = 0; (lock = omar_task_get_lock(i)) != NULL; i++) {
+        printf("%s lock: %u waits, %u on the other cpu\n", lock->name, lock->waits, lock->cross_core);
+    }
+
+#if !CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    printf("(cpu shares need CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)\n");
+#endif
+
+    free(load);
+    return 0;
+}
+
 static int tasks_info(int argc, char** argv)
 {
+    int nerrors = arg_parse(argc, argv, (void**) &tasks_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, tasks_args.end, argv[0]);
+        return 1;
+    }
+
+    if (tasks_args.cpu->count == 1) {
+        return tasks_cpu();
+    }
+
     const size_t bytes_per_task = 40; /* see vTaskList description */
     char* task_list_buffer = malloc(uxTaskGetNumberOfTasks() * bytes_per_task);
     if (task_list_buffer == NULL) {
@@ -111,11 +401,15 @@ static int tasks_info(int argc, char** argv)
 
 static void register_tasks()
 {
+    tasks_args.cpu = arg_lit0("c", "cpu", "Show each task's share of its cpu and stack high water mark, sampled every few seconds");
+    tasks_args.end = arg_end(1);
+
     const esp_console_cmd_t cmd = {
         .command = "tasks",
         .help = "Get information about running tasks",
         .hint = NULL,
         .func = &tasks_info,
+        .argtable = &tasks_args
     };
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
 }
@@ -257,6 +551,10 @@ static int light_sleep(int argc, char** argv)
             printf("%d\n", cause);
     }
     ESP_LOGI(__func__, "Woke up from: %s", cause_str);
+
+    /* Put back the wake sources the power manager relies on */
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+    omar_power_restore_wakeups();
     return 0;
 }
 
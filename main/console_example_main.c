@@ -22,6 +22,14 @@
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "hw_setup.h"
+#include "console_out.h"
+#include "console_history.h"
+#include "console_prof.h"
+#include "omar_tasks.h"
+#include "omar_telemetry.h"
+#include "omar_energy_log.h"
+#include "omar_postmortem.h"
+#include "omar_power.h"
 
 static const char* TAG = "example";
 
@@ -33,6 +41,9 @@ static const char* TAG = "example";
 
 #define MOUNT_PATH "/data"
 #define HISTORY_PATH MOUNT_PATH "/history.txt"
+#define HISTORY_TMP_PATH MOUNT_PATH "/history.tmp"
+#define TELEMETRY_SPILL_PATH MOUNT_PATH "/telem.bin"
+#define ENERGY_LOG_PATH MOUNT_PATH "/energy.log"
 
 static void initialize_filesystem()
 {
@@ -61,24 +72,30 @@ static void initialize_nvs()
 
 static void initialize_console()
 {
-    /* Disable buffering on stdin and stdout */
+    /* Disable buffering on stdin; stdout is replaced below */
     setvbuf(stdin, NULL, _IONBF, 0);
-    setvbuf(stdout, NULL, _IONBF, 0);
 
     /* Minicom, screen, idf_monitor send CR when ENTER key is pressed */
     esp_vfs_dev_uart_set_rx_line_endings(ESP_LINE_ENDINGS_CR);
     /* Move the caret to the beginning of the next line on '\n' */
     esp_vfs_dev_uart_set_tx_line_endings(ESP_LINE_ENDINGS_CRLF);
 
-    /* Configure UART. Note that REF_TICK is used so that the baud rate remains
-     * correct while APB frequency is changing in light sleep mode.
+    /* Configure UART. With power management on, REF_TICK is used so that
+     * the baud rate remains correct while APB frequency is changing in light
+     * sleep mode; it's 1MHz, so that caps the rate (see Kconfig.projbuild).
+     * The bootloader and the ROM always talk at CONFIG_CONSOLE_UART_BAUDRATE;
+     * we switch to CONFIG_CONSOLE_RUNTIME_BAUDRATE from here on.
      */
     const uart_config_t uart_config = {
-            .baud_rate = CONFIG_CONSOLE_UART_BAUDRATE,
+            .baud_rate = CONFIG_CONSOLE_RUNTIME_BAUDRATE,
             .data_bits = UART_DATA_8_BITS,
             .parity = UART_PARITY_DISABLE,
             .stop_bits = UART_STOP_BITS_1,
+#if CONFIG_PM_ENABLE
             .use_ref_tick = true
+#else
+            .use_ref_tick = false
+#endif
     };
     ESP_ERROR_CHECK( uart_param_config(CONFIG_CONSOLE_UART_NUM, &uart_config) );
 
@@ -89,6 +106,11 @@ static void initialize_console()
     /* Tell VFS to use UART driver */
     esp_vfs_dev_uart_use_driver(CONFIG_CONSOLE_UART_NUM);
 
+    /* Route stdout through a line-buffered ring drained by its own task,
+     * so printf() from the drivers never waits on the UART
+     */
+    ESP_ERROR_CHECK( console_out_init(CONFIG_CONSOLE_UART_NUM) );
+
     /* Initialize the console */
     esp_console_config_t console_config = {
             .max_cmdline_args = 8,
@@ -113,26 +135,80 @@ static void initialize_console()
     linenoiseHistorySetMaxLen(100);
 
 #if CONFIG_STORE_HISTORY
-    /* Load command history from filesystem */
-    linenoiseHistoryLoad(HISTORY_PATH);
+    /* Load command history from filesystem, and save new commands
+     * to it in the background
+     */
+    console_history_init(HISTORY_PATH, HISTORY_TMP_PATH);
 #endif
 }
 
+#if defined(HW_OMAR)
+/* Frames the collector hasn't taken wait in flash, next to the history,
+ * and go out first once it's back
+ */
+static void initialize_telemetry()
+{
+#if CONFIG_STORE_HISTORY
+    omar_telemetry_init(TELEMETRY_SPILL_PATH);
+#else
+    omar_telemetry_init(NULL);
+#endif
+
+    if (strlen(CONFIG_TELEMETRY_COLLECTOR) == 0) {
+        return;
+    }
+
+    /* Wifi may not be up yet; the publisher keeps trying */
+    telem_pub_config_t cfg = {
+        .port = CONFIG_TELEMETRY_PORT,
+        .mask = STREAM_ALL_CHANNELS,
+    };
+    strlcpy(cfg.host, CONFIG_TELEMETRY_COLLECTOR, sizeof(cfg.host));
+#if CONFIG_TELEMETRY_TCP
+    cfg.tcp = true;
+#endif
+    if (!omar_telemetry_start(&cfg, CONFIG_TELEMETRY_HZ)) {
+        ESP_LOGE(TAG, "Failed to start telemetry to %s:%d", CONFIG_TELEMETRY_COLLECTOR, CONFIG_TELEMETRY_PORT);
+    }
+}
+#endif // defined(HW_OMAR)
+
 void app_main()
 {
+    /* Pick up what the last run left in rtc memory before anything traces over it */
+    omar_postmortem_init();
+
     initialize_nvs();
 
 #if CONFIG_STORE_HISTORY
     initialize_filesystem();
 #endif
 
+    /* Set up the console first, so the tasks omar_setup() starts
+     * inherit the buffered stdout
+     */
+    initialize_console();
+
     omar_setup();
 
+    /* Let the chip slow down and light sleep whenever it's idle; the
+     * setup stages ran at full speed
+     */
+    omar_power_init();
+
+    /* Sample cpu shares and stack use in the background, for 'tasks --cpu' */
+    omar_task_mon_start();
+
 #if !defined(HW_ESP32_PICOKIT)
     initialise_wifi();
 #endif // !defined(HW_ESP32_PICOKIT)
 
-    initialize_console();
+#if defined(HW_OMAR)
+    initialize_telemetry();
+#if CONFIG_STORE_HISTORY
+    omar_energy_log_start(ENERGY_LOG_PATH);
+#endif
+#endif
 
     /* Register commands */
     esp_console_register_help_command();
@@ -144,6 +220,10 @@ void app_main()
 
     register_omar();
 
+#if defined(HW_OMAR)
+    register_bench();
+#endif
+
     /* Prompt to be printed before each line.
      * This can be customized, made dynamic, etc.
      */
@@ -177,19 +257,24 @@ void app_main()
          * The line is returned when ENTER is pressed.
          */
         char* line = linenoise(prompt);
+        /* Stay awake for the next line; a keystroke that has to wake
+         * the chip is lost
+         */
+        omar_power_hold_for(OMAR_POWER_CONSOLE, CONFIG_POWER_CONSOLE_AWAKE_S * 1000);
         if (line == NULL) { /* Ignore empty lines */
             continue;
         }
         /* Add the command to the history */
-        linenoiseHistoryAdd(line);
 #if CONFIG_STORE_HISTORY
-        /* Save command history to filesystem */
-        linenoiseHistorySave(HISTORY_PATH);
+        /* ... which is saved to the filesystem later, off this path */
+        console_history_add(line);
+#else
+        linenoiseHistoryAdd(line);
 #endif
 
-        /* Try to run the command */
+        /* Try to run the command, timing it for 'prof' */
         int ret;
-        esp_err_t err = esp_console_run(line, &ret);
+        esp_err_t err = console_prof_run(line, &ret);
         if (err == ESP_ERR_NOT_FOUND) {
             printf("Unrecognized command\n");
         } else if (err == ESP_ERR_INVALID_ARG) {
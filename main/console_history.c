@@ -0,0 +1,161 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * console_history.c - saves console history in the background
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "linenoise/linenoise.h"
+
+#include "history_file.h"
+#include "console_history.h"
+#include "omar_tasks.h"
+
+#define CONSOLE_HISTORY_MAX_LINES       (100)   // matches linenoiseHistorySetMaxLen()
+#define CONSOLE_HISTORY_QUEUE_LEN       (16)
+
+/*
+ * Lines are saved once the console has been quiet for IDLE_MS, or
+ * MAX_DELAY_MS after the oldest unsaved one if it never goes quiet,
+ * so a burst of commands costs a single append:
+ */
+#define CONSOLE_HISTORY_IDLE_MS         (5000)
+#define CONSOLE_HISTORY_MAX_DELAY_MS    (60000)
+
+static const char *m_path;
+static const char *m_tmp_path;
+static QueueHandle_t m_queue = NULL;
+static int m_file_lines = 0;
+static console_history_stats_t m_stats;
+
+static void console_history_save(char **lines, uint32_t count)
+{
+    if (history_file_append(m_path, lines, count)) {
+        m_stats.saves++;
+        m_file_lines += count;
+    } else {
+        printf("%s(): couldn't append to %s\n", __func__, m_path);
+        m_stats.errors++;
+        m_stats.dropped += count;
+    }
+
+    // Let the file run to twice the size linenoise keeps before paying for a rewrite:
+    if (m_file_lines > 2 * CONSOLE_HISTORY_MAX_LINES) {
+        int lines = history_file_compact(m_path, m_tmp_path, CONSOLE_HISTORY_MAX_LINES);
+
+        if (lines < 0) {
+            printf("%s(): couldn't compact %s\n", __func__, m_path);
+            m_stats.errors++;
+        } else {
+            m_stats.compactions++;
+            m_file_lines = lines;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        free(lines[i]);
+    }
+}
+
+static void console_history_task(void *arg)
+{
+    char *pending[CONSOLE_HISTORY_QUEUE_LEN];
+    uint32_t count = 0;
+    TickType_t first = 0;
+
+    (void) arg;
+
+    while (true) {
+        TickType_t wait = portMAX_DELAY;
+
+        if (count > 0) {
+            TickType_t waited = xTaskGetTickCount() - first;
+            TickType_t left = pdMS_TO_TICKS(CONSOLE_HISTORY_MAX_DELAY_MS);
+
+            left = (waited < left ? left - waited : 0);
+            wait = pdMS_TO_TICKS(CONSOLE_HISTORY_IDLE_MS);
+            if (left < wait) {
+                wait = left;
+            }
+        }
+
+        char *line;
+
+        if (xQueueReceive(m_queue, &line, wait) == pdTRUE) {
+            if (count == 0) {
+                first = xTaskGetTickCount();
+            }
+            pending[count++] = line;
+
+            if (count < CONSOLE_HISTORY_QUEUE_LEN
+                &&
+                xTaskGetTickCount() - first < pdMS_TO_TICKS(CONSOLE_HISTORY_MAX_DELAY_MS)) {
+                continue;
+            }
+        }
+
+        if (count > 0) {
+            console_history_save(pending, count);
+            count = 0;
+        }
+    }
+}
+
+void console_history_init(const char *path, const char *tmp_path)
+{
+    m_path = path;
+    m_tmp_path = tmp_path;
+
+    m_file_lines = history_file_recover(path, tmp_path);
+    if (m_file_lines < 0) {
+        printf("%s(): couldn't recover %s\n", __func__, path);
+        m_file_lines = 0;
+    }
+    linenoiseHistoryLoad(path);
+
+    m_queue = xQueueCreate(CONSOLE_HISTORY_QUEUE_LEN, sizeof(char *));
+    if (m_queue == NULL) {
+        printf("%s(): xQueueCreate() failed, history won't be saved\n", __func__);
+        return;
+    }
+
+    if (omar_task_create(OMAR_TASK_HISTORY, console_history_task, NULL, NULL) != ESP_OK) {
+        printf("%s(): omar_task_create() failed, history won't be saved\n", __func__);
+        vQueueDelete(m_queue);
+        m_queue = NULL;
+    }
+}
+
+void console_history_add(const char *line)
+{
+    // linenoise skips repeats of the previous line, and so do we:
+    if (!linenoiseHistoryAdd(line)) {
+        return;
+    }
+
+    m_stats.commands++;
+    if (m_queue == NULL) {
+        m_stats.dropped++;
+        return;
+    }
+
+    char *copy = strdup(line);
+
+    if (copy == NULL || xQueueSend(m_queue, &copy, 0) != pdTRUE) {
+        free(copy);
+        m_stats.dropped++;
+    }
+}
+
+void console_history_get_stats(console_history_stats_t *stats)
+{
+    *stats = m_stats;
+}
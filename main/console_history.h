@@ -0,0 +1,28 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * console_history.h - saves console history in the background
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t commands;      // lines handed to console_history_add()
+    uint32_t saves;         // appends to the history file
+    uint32_t compactions;
+    uint32_t dropped;       // lines that never made it to the file
+    uint32_t errors;
+} console_history_stats_t;
+
+/*
+ * Recovers the history file from an interrupted save, loads it
+ * into linenoise and starts the task that saves new lines; call
+ * once linenoiseHistorySetMaxLen() has been set.
+ */
+void console_history_init(const char *path, const char *tmp_path);
+
+// Adds the line to linenoise's history and queues it to be saved; never touches flash:
+void console_history_add(const char *line);
+
+void console_history_get_stats(console_history_stats_t *stats);
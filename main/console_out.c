@@ -0,0 +1,165 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * console_out.c - buffered, non-blocking stdout for the uart console
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/reent.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "driver/uart.h"
+#include "sdkconfig.h"
+
+#include "log_ring.h"
+#include "console_out.h"
+#include "omar_tasks.h"
+
+#define CONSOLE_OUT_LINE_MAX        (256)
+
+#if (CONFIG_CONSOLE_TX_RING_SIZE & (CONFIG_CONSOLE_TX_RING_SIZE - 1)) != 0
+#error "CONFIG_CONSOLE_TX_RING_SIZE must be a power of two"
+#endif
+
+static uint8_t m_ring_buf[CONFIG_CONSOLE_TX_RING_SIZE];
+static log_ring_t m_ring;
+static portMUX_TYPE m_ring_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t m_drain_task = NULL;
+static int m_uart_num;
+
+/*
+ * stdio calls this with a whole line (or a full line buffer) while
+ * holding the FILE lock; all we do is copy it in and poke the drain
+ * task. When the uart can't keep up the line is dropped and counted
+ * so the caller is never held up.
+ */
+static int console_out_write(void *cookie, const char *data, int len)
+{
+    bool was_empty;
+
+    portENTER_CRITICAL(&m_ring_lock);
+    was_empty = (log_ring_used(&m_ring) == 0);
+    log_ring_put(&m_ring, data, len);
+    portEXIT_CRITICAL(&m_ring_lock);
+
+    if (was_empty) {
+        xTaskNotifyGive(m_drain_task);
+    }
+
+    // Dropped lines still count as written, otherwise stdio flags an error:
+    return len;
+}
+
+// The uart vfs used to turn '\n' into "\r\n"; the drain task takes that over:
+static void console_out_send(const uint8_t *data, uint32_t len)
+{
+    uint32_t start = 0;
+
+    for (uint32_t i = 0; i < len; i++) {
+        if (data[i] == '\n') {
+            if (i > start) {
+                uart_write_bytes(m_uart_num, (const char *)&data[start], i - start);
+            }
+            uart_write_bytes(m_uart_num, "\r\n", 2);
+            start = i + 1;
+        }
+    }
+
+    if (len > start) {
+        uart_write_bytes(m_uart_num, (const char *)&data[start], len - start);
+    }
+}
+
+static void console_out_task(void *arg)
+{
+    uint32_t reported = 0;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (true) {
+            const uint8_t *data;
+            uint32_t len;
+            uint32_t dropped;
+
+            portENTER_CRITICAL(&m_ring_lock);
+            len = log_ring_peek(&m_ring, &data);
+            dropped = m_ring.dropped;
+            portEXIT_CRITICAL(&m_ring_lock);
+
+            if (len == 0) {
+                break;
+            }
+
+            // Only we consume, so the bytes at 'data' stay put while we send them:
+            console_out_send(data, len);
+
+            portENTER_CRITICAL(&m_ring_lock);
+            log_ring_consume(&m_ring, len);
+            portEXIT_CRITICAL(&m_ring_lock);
+
+            if (dropped != reported) {
+                char note[48];
+                int n = snprintf(note, sizeof(note), "\r\n[console dropped %u lines]\r\n", dropped - reported);
+
+                uart_write_bytes(m_uart_num, note, n);
+                reported = dropped;
+            }
+        }
+    }
+}
+
+esp_err_t console_out_init(int uart_num)
+{
+    static char line_buf[CONSOLE_OUT_LINE_MAX];
+
+    if (m_drain_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    m_uart_num = uart_num;
+    log_ring_init(&m_ring, m_ring_buf, sizeof(m_ring_buf));
+
+    if (omar_task_create(OMAR_TASK_CONSOLE_OUT, console_out_task, NULL, &m_drain_task) != ESP_OK) {
+        printf("%s(): omar_task_create() failed\n", __func__);
+        return ESP_ERR_NO_MEM;
+    }
+
+    FILE *out = funopen(NULL, NULL, console_out_write, NULL, NULL);
+
+    if (out == NULL) {
+        printf("%s(): funopen() failed\n", __func__);
+        vTaskDelete(m_drain_task);
+        m_drain_task = NULL;
+        return ESP_FAIL;
+    }
+    setvbuf(out, line_buf, _IOLBF, sizeof(line_buf));
+
+    /*
+     * Tasks copy their stdout from the global reent when they're
+     * created, so set it there too; anything created after this
+     * point (and this task) picks up the buffered stream:
+     */
+    fflush(stdout);
+    _GLOBAL_REENT->_stdout = out;
+    stdout = out;
+
+    return ESP_OK;
+}
+
+void console_out_get_stats(console_out_stats_t *stats)
+{
+    portENTER_CRITICAL(&m_ring_lock);
+    stats->size = m_ring.size;
+    stats->used = log_ring_used(&m_ring);
+    stats->high_water = m_ring.high_water;
+    stats->written = m_ring.written;
+    stats->dropped = m_ring.dropped;
+    stats->dropped_bytes = m_ring.dropped_bytes;
+    portEXIT_CRITICAL(&m_ring_lock);
+}
@@ -0,0 +1,29 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * console_out.h - buffered, non-blocking stdout for the uart console
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct {
+    uint32_t size;          // bytes in the tx ring
+    uint32_t used;          // bytes waiting right now
+    uint32_t high_water;
+    uint32_t written;       // lines (or buffer-fulls) accepted
+    uint32_t dropped;       // ... and refused because the ring was full
+    uint32_t dropped_bytes;
+} console_out_stats_t;
+
+/*
+ * Replaces stdout with a line-buffered stream that copies each
+ * line into a ring and returns; a low priority task drains the
+ * ring to the uart, so only that task ever waits on the baud rate.
+ * The uart driver must already be installed on 'uart_num'.
+ */
+esp_err_t console_out_init(int uart_num);
+
+void console_out_get_stats(console_out_stats_t *stats);
@@ -0,0 +1,52 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * console_prof.c - profiles every command the console runs
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "esp_console.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "console_prof.h"
+
+// Only the console task touches this: commands (including 'prof') run in it, one at a time
+static cmd_prof_t m_prof;
+
+esp_err_t console_prof_run(const char *line, int *ret)
+{
+    uint32_t heap_before = esp_get_free_heap_size();
+    /*
+     * Timed with esp_timer rather than the cycle counter: with DFS the
+     * cpu clock drops to 80 or 40MHz (or stops, in light sleep) whenever
+     * the command waits, so cycles don't turn back into microseconds.
+     */
+    int64_t start_us = esp_timer_get_time();
+
+    esp_err_t err = esp_console_run(line, ret);
+
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    uint32_t heap_after = esp_get_free_heap_size();
+
+    // Empty lines and unknown commands didn't run anything:
+    if (err == ESP_ERR_NOT_FOUND || err == ESP_ERR_INVALID_ARG) {
+        return err;
+    }
+
+    uint32_t usec = (elapsed_us > UINT32_MAX ? UINT32_MAX : (uint32_t) elapsed_us);
+
+    cmd_prof_record(&m_prof, line, usec, (int32_t)(heap_before - heap_after));
+    return err;
+}
+
+const cmd_prof_t *console_prof_get(void)
+{
+    return &m_prof;
+}
+
+void console_prof_reset(void)
+{
+    cmd_prof_reset(&m_prof);
+}
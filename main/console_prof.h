@@ -0,0 +1,15 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * console_prof.h - profiles every command the console runs
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "cmd_prof.h"
+
+// Drop-in for esp_console_run() that records how long the command took and what it did to the heap:
+esp_err_t console_prof_run(const char *line, int *ret);
+
+const cmd_prof_t *console_prof_get(void);
+void console_prof_reset(void);
@@ -0,0 +1,306 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * rpc_server.c - binary rpc mode on the console uart
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "hw_setup.h"
+#include "adi_spi.h"
+#include "rpc_frame.h"
+#include "rpc_proto.h"
+#include "rpc_server.h"
+#if defined(HW_OMAR)
+#include "omar_led.h"
+#include "omar_thermal.h"
+#include "omar_energy_log.h"
+#include "s24c08.h"
+#endif //defined(HW_OMAR)
+
+#define RPC_SERVER_UART             (CONFIG_CONSOLE_UART_NUM)
+#define RPC_SERVER_ABORT_CHAR       (0x03)      // ^C
+#define RPC_SERVER_ABORT_COUNT      (3)
+
+static rpc_decoder_t m_decoder;
+static uint8_t m_frame[RPC_FRAME_MAX];
+static uint8_t m_reply[RPC_FRAME_PAYLOAD_MAX];
+
+/*
+ * Frames go straight to the uart driver rather than through stdout,
+ * which would turn every 0x0a into "\r\n"; the driver writes each
+ * call whole, so console text from other tasks can only land
+ * between frames, where the host's decoder skips it.
+ */
+static void rpc_send(uint8_t type, uint8_t seq, const void *payload, uint16_t len)
+{
+    uint32_t n = rpc_frame_encode(type, seq, payload, len, m_frame);
+
+    uart_write_bytes(RPC_SERVER_UART, (const char *)m_frame, n);
+}
+
+static bool rpc_snapshot(rpc_meter_snapshot_t *snapshot)
+{
+    adi_snapshot_t adi;
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->msec = (uint32_t)(esp_timer_get_time() / 1000);
+
+    if (adi_read_snapshot(&adi) != ESP_OK) {
+        return false;
+    }
+    snapshot->vrms = adi.vrms;
+    snapshot->irmsa = adi.irmsa;
+    snapshot->irmsb = adi.irmsb;
+    snapshot->awatt = adi.awatt;
+    snapshot->bwatt = adi.bwatt;
+    snapshot->avar = adi.avar;
+    snapshot->bvar = adi.bvar;
+    snapshot->ava = adi.ava;
+    snapshot->bva = adi.bva;
+
+#if defined(HW_OMAR)
+    float temperature = 0.0;
+
+    snapshot->thermal_state = thermal_get_state(&temperature);
+    snapshot->temperature = (int16_t)(temperature * 4.0f);
+#endif //defined(HW_OMAR)
+
+    return true;
+}
+
+#if defined(HW_OMAR)
+typedef struct {
+    rpc_log_record_t *records;
+    uint32_t count;
+} rpc_log_ctx_t;
+
+static bool rpc_log_record(const energy_log_record_t *record, void *arg)
+{
+    rpc_log_ctx_t *ctx = arg;
+    rpc_log_record_t *out = &ctx->records[ctx->count++];
+
+    out->time = record->time;
+    out->aenergy = record->aenergy;
+    out->benergy = record->benergy;
+    out->renergy = record->renergy;
+    out->vpeak = record->vpeak;
+    out->temperature = (int16_t) record->temperature;
+    out->reserved = 0;
+    return (ctx->count < RPC_LOG_RECORDS_MAX);
+}
+#endif //defined(HW_OMAR)
+
+/*
+ * Handles one request; fills in m_reply (status byte first) and
+ * returns its length. *stream_msec and *bye are how a request
+ * changes what the server loop does next.
+ */
+static uint16_t rpc_handle(uint8_t type, const uint8_t *payload, uint16_t len,
+                           uint32_t *stream_msec, bool *bye)
+{
+    uint8_t *status = &m_reply[0];
+    uint8_t *data = &m_reply[1];
+    uint16_t data_len = 0;
+
+    *status = RPC_STATUS_OK;
+
+    switch (type) {
+    case RPC_PING:
+        if (len > sizeof(m_reply) - 1) {
+            len = sizeof(m_reply) - 1;
+        }
+        memcpy(data, payload, len);
+        data_len = len;
+        break;
+
+    case RPC_METER_SNAPSHOT:
+        if (rpc_snapshot((rpc_meter_snapshot_t *)data)) {
+            data_len = sizeof(rpc_meter_snapshot_t);
+        } else {
+            *status = RPC_STATUS_FAILED;
+        }
+        break;
+
+    case RPC_READ_REG: {
+        const rpc_read_reg_t *req = (const rpc_read_reg_t *)payload;
+
+        if (len != sizeof(*req) || req->reg > AP_NOLOAD) {
+            *status = RPC_STATUS_BAD_ARGS;
+            break;
+        }
+        data_len = spi_read_reg(req->reg, data);
+        break;
+    }
+
+#if defined(HW_OMAR)
+    case RPC_SET_LED: {
+        const rpc_set_led_t *req = (const rpc_set_led_t *)payload;
+
+        if (len != sizeof(*req) || (req->led != 1 && req->led != 2) || req->level > OMAR_LED_LEVEL_MAX) {
+            *status = RPC_STATUS_BAD_ARGS;
+            break;
+        }
+        led_set_level((req->led == 1 ? OMAR_WHITE_LED0 : OMAR_WHITE_LED1), req->level, req->fade_msec);
+        break;
+    }
+
+    case RPC_READ_EEPROM: {
+        const rpc_read_eeprom_t *req = (const rpc_read_eeprom_t *)payload;
+
+        if (len != sizeof(*req)
+            ||
+            req->count == 0
+            ||
+            req->address + req->count > OMAR_EEPROM_SIZE) {
+            *status = RPC_STATUS_BAD_ARGS;
+            break;
+        }
+
+        if (s24c08_read(req->address, data, req->count) == ESP_OK) {
+            data_len = req->count;
+        } else {
+            *status = RPC_STATUS_FAILED;
+        }
+        break;
+    }
+
+    case RPC_LOG_QUERY: {
+        const rpc_log_query_t *req = (const rpc_log_query_t *)payload;
+        rpc_log_ctx_t ctx = { (rpc_log_record_t *)data, 0 };
+        energy_log_summary_t summary;
+        energy_log_stats_t stats;
+
+        if (len != sizeof(*req) || req->from > req->to) {
+            *status = RPC_STATUS_BAD_ARGS;
+            break;
+        }
+        if (!omar_energy_log_get_summary(&summary, &stats)) {
+            *status = RPC_STATUS_UNSUPPORTED;
+            break;
+        }
+        omar_energy_log_query(req->from, req->to, rpc_log_record, &ctx);
+        data_len = ctx.count * sizeof(rpc_log_record_t);
+        break;
+    }
+#else
+    case RPC_SET_LED:
+    case RPC_READ_EEPROM:
+    case RPC_LOG_QUERY:
+        *status = RPC_STATUS_UNSUPPORTED;
+        break;
+#endif //defined(HW_OMAR)
+
+    case RPC_STREAM: {
+        const rpc_stream_t *req = (const rpc_stream_t *)payload;
+
+        if (len != sizeof(*req)) {
+            *status = RPC_STATUS_BAD_ARGS;
+            break;
+        }
+        *stream_msec = req->period_msec;
+        break;
+    }
+
+    case RPC_BYE:
+        *bye = true;
+        break;
+
+    default:
+        *status = RPC_STATUS_UNKNOWN_TYPE;
+        break;
+    }
+
+    return 1 + data_len;
+}
+
+int rpc_server_run(void)
+{
+    uint32_t stream_msec = 0;
+    int64_t next_telemetry = 0;
+    int64_t last_frame = esp_timer_get_time();
+    int aborts = 0;
+    bool bye = false;
+
+    rpc_decoder_init(&m_decoder);
+
+    // Whatever linenoise left behind is text, not frames:
+    fflush(stdout);
+    uart_flush_input(RPC_SERVER_UART);
+
+    while (!bye) {
+        TickType_t wait = pdMS_TO_TICKS(100);
+        int64_t now = esp_timer_get_time();
+
+        if (stream_msec > 0) {
+            if (now >= next_telemetry) {
+                rpc_meter_snapshot_t snapshot;
+
+                if (rpc_snapshot(&snapshot)) {
+                    rpc_send(RPC_TELEMETRY, 0, &snapshot, sizeof(snapshot));
+                }
+                next_telemetry = now + (int64_t)stream_msec * 1000;
+            }
+            wait = pdMS_TO_TICKS((next_telemetry - now) / 1000);
+        } else if (now - last_frame > (int64_t)RPC_SERVER_IDLE_MS * 1000) {
+            break;
+        }
+
+        /*
+         * uart_read_bytes() only returns early when 'wait' passes with
+         * nothing new, so asking for a buffer's worth would hold every
+         * short request back by a whole 'wait'. Block for one byte,
+         * then take whatever else is already there:
+         */
+        uint8_t rx[64];
+        int n = uart_read_bytes(RPC_SERVER_UART, rx, 1, wait);
+
+        if (n == 1) {
+            int more = uart_read_bytes(RPC_SERVER_UART, &rx[1], sizeof(rx) - 1, 0);
+
+            n += (more > 0 ? more : 0);
+        }
+
+        for (int i = 0; i < n && !bye; i++) {
+            if (m_decoder.state == RPC_DECODE_SOF) {
+                aborts = (rx[i] == RPC_SERVER_ABORT_CHAR ? aborts + 1 : 0);
+                if (aborts == RPC_SERVER_ABORT_COUNT) {
+                    bye = true;
+                    break;
+                }
+            }
+
+            if (!rpc_decoder_feed(&m_decoder, rx[i])) {
+                continue;
+            }
+
+            last_frame = esp_timer_get_time();
+            if (m_decoder.type & RPC_RESPONSE) {
+                // Not a request; nothing to answer:
+                continue;
+            }
+
+            uint32_t old_stream_msec = stream_msec;
+            uint16_t reply_len = rpc_handle(m_decoder.type, m_decoder.payload, m_decoder.len, &stream_msec, &bye);
+
+            rpc_send(m_decoder.type | RPC_RESPONSE, m_decoder.seq, m_reply, reply_len);
+
+            if (stream_msec != old_stream_msec) {
+                next_telemetry = esp_timer_get_time();
+            }
+        }
+    }
+
+    printf("\n%s(): back to the console (%u frames, %u crc errors, %u bytes skipped)\n",
+           __func__, m_decoder.frames, m_decoder.crc_errors, m_decoder.skipped);
+    return 0;
+}
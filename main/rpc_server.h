@@ -0,0 +1,18 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * rpc_server.h - binary rpc mode on the console uart
+ */
+
+#pragma once
+
+/*
+ * Typing "rpc" at the console prompt is the escape into binary
+ * mode: from then on the console task serves rpc frames (see
+ * rpc_frame.h and rpc_proto.h) until the host sends RPC_BYE, three
+ * ^C bytes arrive outside a frame, or RPC_SERVER_IDLE_MS passes
+ * without a good frame while no stream is running. Then the
+ * linenoise prompt comes back.
+ */
+#define RPC_SERVER_IDLE_MS          (30000)
+
+int rpc_server_run(void);
@@ -0,0 +1,124 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * bench_console_out.c - what a log line costs the task printing it,
+ * through console_out's ring and drain task to a uart that takes as
+ * long as the baud rate says, against the unbuffered stdout it replaced
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/reent.h>
+
+#include "host.h"
+#include "driver/uart.h"
+#include "sdkconfig.h"
+#include "console_out.h"
+#include "host_bench.h"
+
+#define LINE                "s5852a_get(): raw[0] = 0x%02x, raw[1] = 0x%02x\n"
+#define LINE_BYTES          (43)
+
+// As many lines as the ring holds, give or take:
+#define ROOM_LINES          ((CONFIG_CONSOLE_TX_RING_SIZE / LINE_BYTES) * 9 / 10)
+
+static FILE *m_console;
+static FILE *m_direct;
+static uint32_t m_arg;
+
+// The far end of the uart, which just throws it all away:
+static void *sink(void *arg)
+{
+    char buf[256];
+
+    while (read((int)(intptr_t) arg, buf, sizeof(buf)) > 0) {
+    }
+    return NULL;
+}
+
+static void console_line(void *arg)
+{
+    (void) arg;
+    fprintf(m_console, LINE, m_arg & 0xff, (m_arg + 1) & 0xff);
+    m_arg++;
+}
+
+static void direct_line(void *arg)
+{
+    (void) arg;
+    fprintf(m_direct, LINE, m_arg & 0xff, (m_arg + 1) & 0xff);
+    m_arg++;
+}
+
+// What the uart vfs did for the old stdout: straight to the driver, in the caller's task
+static int direct_write(void *cookie, const char *data, int len)
+{
+    (void) cookie;
+    return uart_write_bytes(UART_NUM_0, data, len);
+}
+
+// Waits for the drain task to empty the ring, so each case starts the same way:
+static void drained(void)
+{
+    console_out_stats_t stats;
+
+    do {
+        host_sleep_usec(1000);
+        console_out_get_stats(&stats);
+    } while (stats.used != 0);
+}
+
+static void report(const char *name, console_out_stats_t *before)
+{
+    console_out_stats_t after;
+
+    console_out_get_stats(&after);
+    printf("# %s: %u lines written, %u dropped, high water %u of %u bytes\n", name,
+           after.written - before->written, after.dropped - before->dropped,
+           after.high_water, after.size);
+    *before = after;
+}
+
+int main(void)
+{
+    bench_t bench;
+    console_out_stats_t stats;
+    pthread_t thread;
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        return 1;
+    }
+    host_uart_attach(UART_NUM_0, fds[1]);
+    host_uart_baud(UART_NUM_0, CONFIG_CONSOLE_RUNTIME_BAUDRATE);
+    pthread_create(&thread, NULL, sink, (void *)(intptr_t) fds[0]);
+
+    // console_out_init() takes over stdout; keep the real one for the results:
+    FILE *results = stdout;
+    console_out_init(UART_NUM_0);
+    m_console = stdout;
+    stdout = results;
+    console_out_get_stats(&stats);
+
+    host_bench_init(&bench, "console_out");
+
+    // A burst the ring has room for: a format and a copy
+    drained();
+    host_bench_run(&bench, "printf (ring has room)", console_line, NULL, ROOM_LINES * 10 / 11);
+    report("ring has room", &stats);
+
+    // Far more than the uart can take: once the ring's full the lines are dropped, just as quickly
+    drained();
+    host_bench_run(&bench, "printf (ring full)", console_line, NULL, 10000);
+    report("ring full", &stats);
+
+    // The old stdout, which waited for every byte to go out:
+    drained();
+    m_direct = funopen(NULL, NULL, direct_write, NULL, NULL);
+    setvbuf(m_direct, NULL, _IONBF, 0);
+    host_bench_run(&bench, "printf (unbuffered)", direct_line, NULL, 100);
+
+    return 0;
+}
@@ -0,0 +1,191 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_console_history.c - how many file writes a command costs once
+ * saving is batched by the history task, and that what's saved is what
+ * was typed
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unit.h"
+#include "host.h"
+#include "linenoise/linenoise.h"
+#include "history_file.h"
+#include "console_history.h"
+
+#define BATCH_MAX           (16)        // CONSOLE_HISTORY_QUEUE_LEN
+#define IDLE_USEC           (5000000)   // CONSOLE_HISTORY_IDLE_MS
+#define KEEP_LINES          (100)       // CONSOLE_HISTORY_MAX_LINES
+#define PRELOADED           (3)         // complete lines in the file at boot
+
+static char m_dir[] = "/tmp/console_history.XXXXXX";
+static char m_path[64];
+static char m_tmp_path[64];
+static uint32_t m_typed = 0;
+
+static void type_commands(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        char line[32];
+
+        snprintf(line, sizeof(line), "led --level %u", m_typed++);
+        console_history_add(line);
+    }
+}
+
+// Waits (in real time) for the history task to have made 'saves' appends:
+static bool wait_for_saves(uint32_t saves)
+{
+    console_history_stats_t stats;
+
+    for (int i = 0; i < 2000; i++) {
+        console_history_get_stats(&stats);
+        if (stats.saves >= saves) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+static int file_lines(void)
+{
+    char line[HISTORY_FILE_LINE_MAX];
+    FILE *f = fopen(m_path, "r");
+    int lines = 0;
+
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lines++;
+    }
+    fclose(f);
+    return lines;
+}
+
+static bool last_line_is(uint32_t n)
+{
+    char line[HISTORY_FILE_LINE_MAX], last[HISTORY_FILE_LINE_MAX] = "";
+    char want[32];
+    FILE *f = fopen(m_path, "r");
+
+    if (f == NULL) {
+        return false;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        strcpy(last, line);
+    }
+    fclose(f);
+
+    snprintf(want, sizeof(want), "led --level %u\n", n);
+    return (strcmp(last, want) == 0);
+}
+
+static void test_recovered_at_init(void)
+{
+    // The last save before the reset was cut off part way through a line:
+    CHECK_EQ(host_linenoise_loaded(), PRELOADED);
+    CHECK_EQ(file_lines(), PRELOADED);
+}
+
+static void test_burst_is_one_write(void)
+{
+    console_history_stats_t stats;
+    int64_t start = host_time_usec();
+
+    // Nothing's written while commands are coming in...
+    type_commands(10);
+    console_history_get_stats(&stats);
+    CHECK_EQ(stats.commands, 10);
+
+    // ...then one append for all of them, once the console's been idle:
+    CHECK(wait_for_saves(1));
+    console_history_get_stats(&stats);
+    CHECK_EQ(stats.saves, 1);
+    CHECK(host_time_usec() - start >= IDLE_USEC);
+    CHECK_EQ(file_lines(), PRELOADED + 10);
+    CHECK(last_line_is(9));
+}
+
+static void test_repeats_skipped(void)
+{
+    console_history_stats_t before, after;
+
+    console_history_get_stats(&before);
+    console_history_add("led --level 9");
+    console_history_get_stats(&after);
+    CHECK_EQ(after.commands, before.commands);
+}
+
+static void test_full_queue_is_one_write(void)
+{
+    console_history_stats_t stats;
+
+    // A full batch goes out without waiting for the console to go idle:
+    type_commands(BATCH_MAX);
+    CHECK(wait_for_saves(2));
+    console_history_get_stats(&stats);
+    CHECK_EQ(stats.saves, 2);
+    CHECK_EQ(stats.dropped, 0);
+    CHECK_EQ(file_lines(), PRELOADED + 10 + BATCH_MAX);
+}
+
+static void test_compaction(void)
+{
+    console_history_stats_t stats;
+    uint32_t saves;
+
+    console_history_get_stats(&stats);
+    saves = stats.saves;
+
+    // Past twice what linenoise keeps, the file is cut back to it:
+    while (PRELOADED + m_typed <= 2 * KEEP_LINES) {
+        type_commands(BATCH_MAX);
+        CHECK(wait_for_saves(++saves));
+    }
+
+    console_history_get_stats(&stats);
+    CHECK_EQ(stats.compactions, 1);
+    CHECK_EQ(stats.errors, 0);
+    CHECK_EQ(file_lines(), KEEP_LINES);
+    CHECK(last_line_is(m_typed - 1));
+
+    printf("    %u commands, %u appends, %u compaction(s): %.3f file writes per command\n",
+           stats.commands, stats.saves, stats.compactions,
+           (double)(stats.saves + stats.compactions) / stats.commands);
+}
+
+int main(void)
+{
+    if (mkdtemp(m_dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(m_path, sizeof(m_path), "%s/history.txt", m_dir);
+    snprintf(m_tmp_path, sizeof(m_tmp_path), "%s/history.tmp", m_dir);
+
+    FILE *f = fopen(m_path, "w");
+
+    fputs("help\nfree\nrelay --on 1\nrelay --o", f);
+    fclose(f);
+
+    host_clock_virtual(0);
+    console_history_init(m_path, m_tmp_path);
+
+    RUN(test_recovered_at_init);
+    RUN(test_burst_is_one_write);
+    RUN(test_repeats_skipped);
+    RUN(test_full_queue_is_one_write);
+    RUN(test_compaction);
+
+    remove(m_path);
+    remove(m_tmp_path);
+    rmdir(m_dir);
+
+    return unit_done();
+}
@@ -0,0 +1,224 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_console_prof.c - the statistics the console's dispatcher keeps,
+ * from fake commands whose run time and heap use are set by the test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "unit.h"
+#include "host.h"
+#include "esp_console.h"
+#include "esp_system.h"
+#include "esp_pm.h"
+#include "xtensa/hal.h"
+#include "console_prof.h"
+
+#define CCOUNT_WRAP_USEC    (4294967296LL / 160)    // at CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+
+// "sleep <usec> [heap bytes kept]": takes that long and keeps that much heap
+static int cmd_sleep(int argc, char **argv)
+{
+    int64_t usec = (argc > 1 ? strtoll(argv[1], NULL, 0) : 0);
+    int32_t kept = (argc > 2 ? (int32_t) strtol(argv[2], NULL, 0) : 0);
+
+    host_clock_advance(usec);
+    host_heap_set(esp_get_free_heap_size() - kept);
+    return 0;
+}
+
+// "fail <ret>": returns 'ret' straight away
+static int cmd_fail(int argc, char **argv)
+{
+    return (argc > 1 ? atoi(argv[1]) : 1);
+}
+
+static void register_command(const char *name, esp_console_cmd_func_t func)
+{
+    const esp_console_cmd_t cmd = { .command = name, .help = "", .func = func };
+
+    esp_console_cmd_register(&cmd);
+}
+
+static const cmd_prof_entry_t *entry(const char *name)
+{
+    const cmd_prof_t *prof = console_prof_get();
+
+    for (uint32_t i = 0; i < prof->used; i++) {
+        if (strcmp(prof->entries[i].name, name) == 0) {
+            return &prof->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t run(const char *line)
+{
+    int ret = -1;
+
+    return console_prof_run(line, &ret);
+}
+
+static void test_count_total_max(void)
+{
+    console_prof_reset();
+
+    CHECK_EQ(run("sleep 100"), ESP_OK);
+    CHECK_EQ(run("sleep 300"), ESP_OK);
+    CHECK_EQ(run("  sleep   200  "), ESP_OK);
+
+    const cmd_prof_entry_t *sleep = entry("sleep");
+
+    CHECK(sleep != NULL);
+    CHECK_EQ(console_prof_get()->used, 1);
+    CHECK_EQ(sleep->usec.count, 3);
+    CHECK_EQ(sleep->usec.total, 600);
+    CHECK_EQ(sleep->usec.min, 100);
+    CHECK_EQ(sleep->usec.max, 300);
+}
+
+static void test_p99(void)
+{
+    console_prof_reset();
+
+    // 990 quick runs and 10 slow ones: p99 is the quick ones', p100 the slow ones':
+    for (uint32_t i = 0; i < 1000; i++) {
+        run(i % 100 == 99 ? "sleep 50000" : "sleep 1000");
+    }
+
+    const cmd_prof_entry_t *sleep = entry("sleep");
+    uint32_t p99 = latency_hist_percentile(&sleep->usec, 99);
+    uint32_t p100 = latency_hist_percentile(&sleep->usec, 100);
+
+    CHECK_EQ(sleep->usec.count, 1000);
+    CHECK_EQ(sleep->usec.total, 990 * 1000 + 10 * 50000);
+    CHECK(p99 >= 1000 && p99 <= 1250);
+    CHECK(p100 >= 50000 && p100 <= 62500);
+    CHECK_EQ(sleep->usec.max, 50000);
+}
+
+static void test_heap_delta(void)
+{
+    console_prof_reset();
+    host_heap_set(100000);
+
+    run("sleep 10 64");
+    run("sleep 10 32");
+    run("sleep 10 -16");
+
+    const cmd_prof_entry_t *sleep = entry("sleep");
+
+    CHECK_EQ(sleep->heap_last, -16);
+    CHECK_EQ(sleep->heap_total, 80);
+    CHECK_EQ(esp_get_free_heap_size(), 100000 - 80);
+}
+
+static void test_long_runs(void)
+{
+    console_prof_reset();
+
+    // Past a wrap of the cycle counter, which would come out as ~3.2s:
+    int64_t usec = CCOUNT_WRAP_USEC + 3200000;
+    char line[32];
+
+    snprintf(line, sizeof(line), "sleep %lld", (long long) usec);
+    run(line);
+    CHECK_EQ(entry("sleep")->usec.max, usec);
+}
+
+/*
+ * With DFS on and nothing holding the cpu at full speed, the cycle
+ * counter runs at the minimum; commands are still timed in real time.
+ */
+static void test_dfs(void)
+{
+    esp_pm_config_esp32_t config = { .max_freq_mhz = 160, .min_freq_mhz = 40, .light_sleep_enable = false };
+
+    console_prof_reset();
+    CHECK_EQ(esp_pm_configure(&config), ESP_OK);
+    CHECK_EQ(host_pm_cpu_freq_mhz(), 40);
+
+    uint32_t start_cycles = xthal_get_ccount();
+    run("sleep 5000");
+    CHECK_EQ(xthal_get_ccount() - start_cycles, 5000 * 40);
+    CHECK_EQ(entry("sleep")->usec.max, 5000);
+
+    host_pm_reset();
+}
+
+static void test_not_recorded(void)
+{
+    int ret = 12345;
+
+    console_prof_reset();
+
+    CHECK_EQ(console_prof_run("", &ret), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(console_prof_run("   ", &ret), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(console_prof_run("nosuch --flag", &ret), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(ret, 12345);
+    CHECK_EQ(console_prof_get()->used, 0);
+
+    // A command that fails still ran, and its return value comes through:
+    CHECK_EQ(console_prof_run("fail 7", &ret), ESP_OK);
+    CHECK_EQ(ret, 7);
+    CHECK_EQ(entry("fail")->usec.count, 1);
+}
+
+static void test_table_full(void)
+{
+    char name[CMD_PROF_NAME_MAX];
+
+    console_prof_reset();
+
+    for (uint32_t i = 0; i < CMD_PROF_MAX_COMMANDS + 3; i++) {
+        snprintf(name, sizeof(name), "cmd%u", i);
+        register_command(strdup(name), cmd_sleep);
+        run(name);
+    }
+    run("cmd0");
+    run(name);
+
+    CHECK_EQ(console_prof_get()->used, CMD_PROF_MAX_COMMANDS);
+    CHECK_EQ(console_prof_get()->overflow, 4);
+    CHECK_EQ(entry("cmd0")->usec.count, 2);
+    CHECK(entry(name) == NULL);
+
+    console_prof_reset();
+    CHECK_EQ(console_prof_get()->used, 0);
+    CHECK_EQ(console_prof_get()->overflow, 0);
+}
+
+static void test_long_name(void)
+{
+    console_prof_reset();
+    register_command("a_very_long_command_name", cmd_sleep);
+
+    // Truncated to CMD_PROF_NAME_MAX - 1, which is still unique enough to count on:
+    run("a_very_long_command_name 5");
+    run("a_very_long_command_name 7");
+    CHECK_EQ(console_prof_get()->used, 1);
+    CHECK_EQ(console_prof_get()->entries[0].usec.count, 2);
+    CHECK_EQ(strlen(console_prof_get()->entries[0].name), CMD_PROF_NAME_MAX - 1);
+}
+
+int main(void)
+{
+    host_clock_virtual(0);
+    register_command("sleep", cmd_sleep);
+    register_command("fail", cmd_fail);
+
+    RUN(test_count_total_max);
+    RUN(test_p99);
+    RUN(test_heap_delta);
+    RUN(test_long_runs);
+    RUN(test_dfs);
+    RUN(test_not_recorded);
+    RUN(test_table_full);
+    RUN(test_long_name);
+
+    return unit_done();
+}
@@ -0,0 +1,295 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * omar_rpc.c - command line front end to rpc_client, for poking at a
+ * board on a serial port and for scripts
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "rpc_client.h"
+
+#define OMAR_RPC_BAUD               (115200)
+#define OMAR_RPC_ENTER_MS           (3000)
+#define OMAR_RPC_BENCH_PINGS        (1000)
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: omar_rpc [-b baud] <device> <command> [args]\n"
+            "  ping [bytes]                  round trip, with that much payload\n"
+            "  snapshot                      one set of meter readings\n"
+            "  reg <n>                       an ADE7953 register, by SpiCmdNameT\n"
+            "  led <1|2> <level> [fade_ms]   perceptual level, 0..1000\n"
+            "  eeprom <address> <count>      hex dump\n"
+            "  stream <period_ms> [secs]     telemetry as csv, until ^C or secs\n"
+            "  log <from> <to>               energy log records as csv\n"
+            "  bench [pings]                 round-trip times and throughput\n");
+}
+
+static const char *error_name(const rpc_client_t *client, int ret)
+{
+    static const char *statuses[] = { "ok", "unknown type", "bad args", "failed", "unsupported" };
+    static char buf[64];
+
+    switch (ret) {
+    case RPC_CLIENT_ERR_IO:
+        return strerror(errno);
+    case RPC_CLIENT_ERR_TIMEOUT:
+        return "timed out";
+    case RPC_CLIENT_ERR_SIZE:
+        return "response the wrong size";
+    case RPC_CLIENT_ERR_STATUS:
+        if (client->status < sizeof(statuses) / sizeof(statuses[0])) {
+            return statuses[client->status];
+        }
+        snprintf(buf, sizeof(buf), "status %u", client->status);
+        return buf;
+    default:
+        return "?";
+    }
+}
+
+static double now_msec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+static void print_snapshot_header(void)
+{
+    printf("msec,vrms,irmsa,irmsb,awatt,bwatt,avar,bvar,ava,bva,temperature,thermal_state\n");
+}
+
+static void print_snapshot(const rpc_meter_snapshot_t *s, void *arg)
+{
+    (void) arg;
+    printf("%u,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.2f,%u\n", s->msec, s->vrms, s->irmsa, s->irmsb,
+           s->awatt, s->bwatt, s->avar, s->bvar, s->ava, s->bva, s->temperature / 4.0, s->thermal_state);
+    fflush(stdout);
+}
+
+static int cmd_ping(rpc_client_t *client, int argc, char **argv)
+{
+    uint8_t data[RPC_FRAME_PAYLOAD_MAX - 1];
+    uint32_t len = (argc > 0 ? strtoul(argv[0], NULL, 0) : 0);
+
+    if (len > sizeof(data)) {
+        fprintf(stderr, "at most %u bytes\n", (unsigned) sizeof(data));
+        return RPC_CLIENT_ERR_SIZE;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        data[i] = (uint8_t) i;
+    }
+
+    double start = now_msec();
+    int ret = rpc_client_ping(client, data, len);
+
+    if (ret == 0) {
+        printf("%u bytes: %.3f ms\n", len, now_msec() - start);
+    }
+    return ret;
+}
+
+static int cmd_reg(rpc_client_t *client, int argc, char **argv)
+{
+    uint8_t value[8];
+
+    if (argc < 1) {
+        usage();
+        return RPC_CLIENT_ERR_SIZE;
+    }
+
+    int ret = rpc_client_read_reg(client, strtoul(argv[0], NULL, 0), value, sizeof(value));
+
+    if (ret < 0) {
+        return ret;
+    }
+    printf("0x");
+    for (int i = 0; i < ret; i++) {
+        printf("%02x", value[i]);
+    }
+    printf("\n");
+    return 0;
+}
+
+static int cmd_eeprom(rpc_client_t *client, int argc, char **argv)
+{
+    uint8_t data[0x400];
+
+    if (argc < 2) {
+        usage();
+        return RPC_CLIENT_ERR_SIZE;
+    }
+
+    uint32_t address = strtoul(argv[0], NULL, 0);
+    uint32_t count = strtoul(argv[1], NULL, 0);
+
+    if (count > sizeof(data) || address + count > sizeof(data)) {
+        fprintf(stderr, "the eeprom is %u bytes\n", (unsigned) sizeof(data));
+        return RPC_CLIENT_ERR_SIZE;
+    }
+
+    int ret = rpc_client_read_eeprom(client, address, data, count);
+
+    if (ret < 0) {
+        return ret;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (i % 16 == 0) {
+            printf("%s%03x:", (i > 0 ? "\n" : ""), address + i);
+        }
+        printf(" %02x", data[i]);
+    }
+    if (count > 0) {
+        printf("\n");
+    }
+    return ret;
+}
+
+static int cmd_stream(rpc_client_t *client, int argc, char **argv)
+{
+    if (argc < 1) {
+        usage();
+        return RPC_CLIENT_ERR_SIZE;
+    }
+
+    uint32_t secs = (argc > 1 ? strtoul(argv[1], NULL, 0) : 0);
+    int ret = rpc_client_stream(client, strtoul(argv[0], NULL, 0));
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    print_snapshot_header();
+    rpc_client_on_telemetry(client, print_snapshot, NULL);
+    for (double end = now_msec() + secs * 1000.0; secs == 0 || now_msec() < end; ) {
+        if ((ret = rpc_client_poll(client, 1000)) < 0) {
+            return ret;
+        }
+    }
+    return rpc_client_stream(client, 0);
+}
+
+static int cmd_log(rpc_client_t *client, int argc, char **argv)
+{
+    static rpc_log_record_t records[10000];
+
+    if (argc < 2) {
+        usage();
+        return RPC_CLIENT_ERR_SIZE;
+    }
+
+    int count = rpc_client_log_query(client, strtoul(argv[0], NULL, 0), strtoul(argv[1], NULL, 0),
+                                     records, sizeof(records) / sizeof(records[0]));
+
+    if (count < 0) {
+        return count;
+    }
+    printf("time,aenergy,benergy,renergy,vpeak,temperature\n");
+    for (int i = 0; i < count; i++) {
+        printf("%u,%d,%d,%d,%d,%.2f\n", records[i].time, records[i].aenergy, records[i].benergy,
+               records[i].renergy, records[i].vpeak, records[i].temperature / 4.0);
+    }
+    return 0;
+}
+
+static int cmd_bench(rpc_client_t *client, int argc, char **argv)
+{
+    static const uint16_t sizes[] = { 0, 16, 64, 255 };
+    uint32_t pings = (argc > 0 ? strtoul(argv[0], NULL, 0) : OMAR_RPC_BENCH_PINGS);
+    uint8_t data[RPC_FRAME_PAYLOAD_MAX - 1] = { 0 };
+
+    printf("bytes,pings,msec_per_ping,calls_per_sec,payload_bytes_per_sec\n");
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double start = now_msec();
+
+        for (uint32_t i = 0; i < pings; i++) {
+            int ret = rpc_client_ping(client, data, sizes[s]);
+
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        double msec = (now_msec() - start) / pings;
+
+        printf("%u,%u,%.3f,%.0f,%.0f\n", sizes[s], pings, msec, 1000.0 / msec, sizes[s] * 1000.0 / msec);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    rpc_client_t client;
+    uint32_t baud = OMAR_RPC_BAUD;
+    int ret;
+
+    if (argc > 2 && strcmp(argv[1], "-b") == 0) {
+        baud = strtoul(argv[2], NULL, 0);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+
+    const char *device = argv[1];
+    const char *cmd = argv[2];
+
+    argc -= 3;
+    argv += 3;
+
+    if (rpc_client_open(&client, device, baud) != 0) {
+        fprintf(stderr, "%s: %s\n", device, strerror(errno));
+        return 1;
+    }
+    if ((ret = rpc_client_enter(&client, OMAR_RPC_ENTER_MS)) != 0) {
+        fprintf(stderr, "%s: no rpc server: %s\n", device, error_name(&client, ret));
+        return 1;
+    }
+
+    if (strcmp(cmd, "ping") == 0) {
+        ret = cmd_ping(&client, argc, argv);
+    } else if (strcmp(cmd, "snapshot") == 0) {
+        rpc_meter_snapshot_t snapshot;
+
+        if ((ret = rpc_client_meter_snapshot(&client, &snapshot)) == 0) {
+            print_snapshot_header();
+            print_snapshot(&snapshot, NULL);
+        }
+    } else if (strcmp(cmd, "reg") == 0) {
+        ret = cmd_reg(&client, argc, argv);
+    } else if (strcmp(cmd, "led") == 0 && argc >= 2) {
+        ret = rpc_client_set_led(&client, strtoul(argv[0], NULL, 0), strtoul(argv[1], NULL, 0),
+                                 (argc > 2 ? strtoul(argv[2], NULL, 0) : 0));
+    } else if (strcmp(cmd, "eeprom") == 0) {
+        ret = cmd_eeprom(&client, argc, argv);
+    } else if (strcmp(cmd, "stream") == 0) {
+        ret = cmd_stream(&client, argc, argv);
+    } else if (strcmp(cmd, "log") == 0) {
+        ret = cmd_log(&client, argc, argv);
+    } else if (strcmp(cmd, "bench") == 0) {
+        ret = cmd_bench(&client, argc, argv);
+    } else {
+        usage();
+        ret = RPC_CLIENT_ERR_SIZE;
+    }
+
+    if (ret < 0) {
+        fprintf(stderr, "%s: %s\n", cmd, error_name(&client, ret));
+    }
+
+    // Leave the console as we found it:
+    rpc_client_bye(&client);
+    rpc_client_close(&client);
+    return (ret < 0 ? 1 : 0);
+}
@@ -0,0 +1,386 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * rpc_client.c - host side of the binary rpc mode on the console uart,
+ * for fleet tooling that would otherwise scrape the text console
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rpc_client.h"
+
+#define RPC_CLIENT_ENTER_PING_MS    (200)       // per ping while waiting for binary mode
+
+static const struct {
+    uint32_t baud;
+    speed_t speed;
+} m_speeds[] = {
+    { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+    { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 },
+#if defined(B500000)
+    { 500000, B500000 },
+#endif
+#if defined(B921600)
+    { 921600, B921600 },
+#endif
+#if defined(B1000000)
+    { 1000000, B1000000 },
+#endif
+};
+
+static int64_t now_msec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int write_all(int fd, const uint8_t *data, uint32_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return RPC_CLIENT_ERR_IO;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int rpc_client_open(rpc_client_t *client, const char *device, uint32_t baud)
+{
+    struct termios tio;
+    speed_t speed = 0;
+
+    for (size_t i = 0; i < sizeof(m_speeds) / sizeof(m_speeds[0]); i++) {
+        if (m_speeds[i].baud == baud) {
+            speed = m_speeds[i].speed;
+        }
+    }
+    if (speed == 0) {
+        errno = EINVAL;
+        return RPC_CLIENT_ERR_IO;
+    }
+
+    int fd = open(device, O_RDWR | O_NOCTTY);
+
+    if (fd < 0) {
+        return RPC_CLIENT_ERR_IO;
+    }
+
+    if (tcgetattr(fd, &tio) != 0) {
+        close(fd);
+        return RPC_CLIENT_ERR_IO;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        close(fd);
+        return RPC_CLIENT_ERR_IO;
+    }
+
+    rpc_client_attach(client, fd);
+    return 0;
+}
+
+void rpc_client_attach(rpc_client_t *client, int fd)
+{
+    memset(client, 0, sizeof(*client));
+    client->fd = fd;
+    rpc_decoder_init(&client->decoder);
+}
+
+void rpc_client_close(rpc_client_t *client)
+{
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+}
+
+void rpc_client_on_telemetry(rpc_client_t *client, rpc_client_telemetry_fn_t fn, void *arg)
+{
+    client->telemetry = fn;
+    client->telemetry_arg = arg;
+}
+
+/*
+ * Feeds whatever arrives before 'deadline' to the decoder, a byte at
+ * a time, until a frame completes; telemetry is handed off here and
+ * never returned. Returns 1 with the frame in the decoder, 0 at the
+ * deadline.
+ */
+static int rpc_client_receive(rpc_client_t *client, int64_t deadline)
+{
+    uint8_t byte;
+
+    while (true) {
+        int64_t left = deadline - now_msec();
+        struct pollfd pfd = { .fd = client->fd, .events = POLLIN };
+
+        if (left < 0) {
+            return 0;
+        }
+
+        int ready = poll(&pfd, 1, (int) left);
+
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return RPC_CLIENT_ERR_IO;
+        }
+        if (ready == 0) {
+            return 0;
+        }
+
+        /*
+         * One byte per read() costs a syscall per byte, but it means
+         * nothing past the end of a frame is ever taken out of the
+         * kernel's buffer, so there's no state to carry between calls:
+         */
+        ssize_t n = read(client->fd, &byte, 1);
+
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0) {
+                errno = EIO;
+            }
+            return RPC_CLIENT_ERR_IO;
+        }
+
+        if (!rpc_decoder_feed(&client->decoder, byte)) {
+            continue;
+        }
+
+        if (client->decoder.type == RPC_TELEMETRY && client->decoder.seq == 0) {
+            client->telemetry_frames++;
+            if (client->telemetry != NULL && client->decoder.len == sizeof(rpc_meter_snapshot_t)) {
+                rpc_meter_snapshot_t snapshot;
+
+                memcpy(&snapshot, client->decoder.payload, sizeof(snapshot));
+                client->telemetry(&snapshot, client->telemetry_arg);
+            }
+            continue;
+        }
+        return 1;
+    }
+}
+
+int rpc_client_call(rpc_client_t *client, uint8_t type, const void *req, uint16_t req_len,
+                    void *resp, uint16_t resp_max, uint32_t timeout_ms)
+{
+    uint8_t frame[RPC_FRAME_MAX];
+    int64_t deadline = now_msec() + timeout_ms;
+
+    if (req_len > RPC_FRAME_PAYLOAD_MAX) {
+        return RPC_CLIENT_ERR_SIZE;
+    }
+
+    client->seq = (client->seq == UINT8_MAX ? 1 : client->seq + 1);
+    client->requests++;
+
+    uint32_t len = rpc_frame_encode(type, client->seq, req, req_len, frame);
+
+    if (write_all(client->fd, frame, len) != 0) {
+        return RPC_CLIENT_ERR_IO;
+    }
+
+    while (true) {
+        int ret = rpc_client_receive(client, deadline);
+
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret == 0) {
+            client->timeouts++;
+            return RPC_CLIENT_ERR_TIMEOUT;
+        }
+
+        const rpc_decoder_t *d = &client->decoder;
+
+        if (d->type != (type | RPC_RESPONSE) || d->seq != client->seq) {
+            // An answer to something we've already given up on:
+            client->stale++;
+            continue;
+        }
+        if (d->len < 1) {
+            return RPC_CLIENT_ERR_SIZE;
+        }
+
+        client->status = d->payload[0];
+        if (client->status != RPC_STATUS_OK) {
+            return RPC_CLIENT_ERR_STATUS;
+        }
+        if (d->len - 1 > resp_max) {
+            return RPC_CLIENT_ERR_SIZE;
+        }
+        if (d->len > 1) {
+            memcpy(resp, &d->payload[1], d->len - 1);
+        }
+        return d->len - 1;
+    }
+}
+
+int rpc_client_poll(rpc_client_t *client, uint32_t timeout_ms)
+{
+    uint32_t before = client->telemetry_frames;
+    int64_t deadline = now_msec() + timeout_ms;
+    int ret;
+
+    // Anything other than telemetry here is a late response; drop it:
+    while ((ret = rpc_client_receive(client, deadline)) > 0) {
+        client->stale++;
+    }
+    return (ret < 0 ? ret : (int)(client->telemetry_frames - before));
+}
+
+int rpc_client_enter(rpc_client_t *client, uint32_t timeout_ms)
+{
+    static const uint8_t escape[] = "\r\nrpc\r\n";
+    int64_t deadline = now_msec() + timeout_ms;
+    int ret = RPC_CLIENT_ERR_TIMEOUT;
+
+    // A line of its own, whatever had been typed at the prompt before us:
+    if (write_all(client->fd, escape, sizeof(escape) - 1) != 0) {
+        return RPC_CLIENT_ERR_IO;
+    }
+
+    /*
+     * The device throws away what's in its uart buffer as it switches,
+     * so the first ping or two can go missing; keep asking:
+     */
+    while (now_msec() < deadline) {
+        ret = rpc_client_call(client, RPC_PING, NULL, 0, NULL, 0, RPC_CLIENT_ENTER_PING_MS);
+        if (ret != RPC_CLIENT_ERR_TIMEOUT) {
+            return (ret < 0 ? ret : 0);
+        }
+    }
+    return ret;
+}
+
+int rpc_client_ping(rpc_client_t *client, const void *data, uint16_t len)
+{
+    uint8_t echo[RPC_FRAME_PAYLOAD_MAX];
+    int ret = rpc_client_call(client, RPC_PING, data, len, echo, sizeof(echo), RPC_CLIENT_TIMEOUT_MS);
+
+    if (ret < 0) {
+        return ret;
+    }
+    return (ret == len && memcmp(echo, data, len) == 0 ? 0 : RPC_CLIENT_ERR_SIZE);
+}
+
+int rpc_client_meter_snapshot(rpc_client_t *client, rpc_meter_snapshot_t *snapshot)
+{
+    int ret = rpc_client_call(client, RPC_METER_SNAPSHOT, NULL, 0,
+                              snapshot, sizeof(*snapshot), RPC_CLIENT_TIMEOUT_MS);
+
+    return (ret < 0 ? ret : (ret == sizeof(*snapshot) ? 0 : RPC_CLIENT_ERR_SIZE));
+}
+
+int rpc_client_read_reg(rpc_client_t *client, uint8_t reg, uint8_t *value, uint16_t max)
+{
+    rpc_read_reg_t req = { .reg = reg };
+
+    return rpc_client_call(client, RPC_READ_REG, &req, sizeof(req), value, max, RPC_CLIENT_TIMEOUT_MS);
+}
+
+int rpc_client_set_led(rpc_client_t *client, uint8_t led, uint16_t level, uint16_t fade_msec)
+{
+    rpc_set_led_t req = { .led = led, .level = level, .fade_msec = fade_msec };
+    int ret = rpc_client_call(client, RPC_SET_LED, &req, sizeof(req), NULL, 0, RPC_CLIENT_TIMEOUT_MS);
+
+    return (ret < 0 ? ret : 0);
+}
+
+int rpc_client_read_eeprom(rpc_client_t *client, uint16_t address, uint8_t *data, uint16_t count)
+{
+    // As many requests as it takes, each as big as a response can carry:
+    while (count > 0) {
+        rpc_read_eeprom_t req = {
+            .address = address,
+            .count = (count > RPC_FRAME_PAYLOAD_MAX - 1 ? RPC_FRAME_PAYLOAD_MAX - 1 : count),
+        };
+        int ret = rpc_client_call(client, RPC_READ_EEPROM, &req, sizeof(req),
+                                  data, req.count, RPC_CLIENT_TIMEOUT_MS);
+
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret != req.count) {
+            return RPC_CLIENT_ERR_SIZE;
+        }
+        address += req.count;
+        data += req.count;
+        count -= req.count;
+    }
+    return 0;
+}
+
+int rpc_client_stream(rpc_client_t *client, uint16_t period_msec)
+{
+    rpc_stream_t req = { .period_msec = period_msec };
+    int ret = rpc_client_call(client, RPC_STREAM, &req, sizeof(req), NULL, 0, RPC_CLIENT_TIMEOUT_MS);
+
+    return (ret < 0 ? ret : 0);
+}
+
+int rpc_client_log_query(rpc_client_t *client, uint32_t from, uint32_t to,
+                         rpc_log_record_t *records, uint32_t max)
+{
+    uint32_t count = 0;
+
+    while (count < max && from <= to) {
+        rpc_log_record_t batch[RPC_LOG_RECORDS_MAX];
+        rpc_log_query_t req = { .from = from, .to = to };
+        int ret = rpc_client_call(client, RPC_LOG_QUERY, &req, sizeof(req),
+                                  batch, sizeof(batch), RPC_CLIENT_TIMEOUT_MS);
+
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret % sizeof(rpc_log_record_t) != 0) {
+            return RPC_CLIENT_ERR_SIZE;
+        }
+
+        uint32_t got = ret / sizeof(rpc_log_record_t);
+
+        for (uint32_t i = 0; i < got && count < max; i++) {
+            records[count++] = batch[i];
+        }
+
+        // A short batch is the last one (see rpc_log_query_t):
+        if (got < RPC_LOG_RECORDS_MAX || batch[got - 1].time == UINT32_MAX) {
+            break;
+        }
+        from = batch[got - 1].time + 1;
+    }
+    return (int) count;
+}
+
+int rpc_client_bye(rpc_client_t *client)
+{
+    int ret = rpc_client_call(client, RPC_BYE, NULL, 0, NULL, 0, RPC_CLIENT_TIMEOUT_MS);
+
+    return (ret < 0 ? ret : 0);
+}
@@ -0,0 +1,75 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * rpc_client.h - host side of the binary rpc mode on the console uart,
+ * for fleet tooling that would otherwise scrape the text console
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rpc_frame.h"
+#include "rpc_proto.h"
+
+#define RPC_CLIENT_TIMEOUT_MS       (1000)      // default wait for a response
+
+// What the calls return when they fail:
+#define RPC_CLIENT_ERR_IO           (-1)        // errno says why
+#define RPC_CLIENT_ERR_TIMEOUT      (-2)
+#define RPC_CLIENT_ERR_STATUS       (-3)        // the device answered, but not with RPC_STATUS_OK (see 'status')
+#define RPC_CLIENT_ERR_SIZE         (-4)        // the response wasn't the size it should be
+
+typedef void (*rpc_client_telemetry_fn_t)(const rpc_meter_snapshot_t *snapshot, void *arg);
+
+typedef struct {
+    int fd;
+    uint8_t seq;                            // of the last request; never 0, which is telemetry's
+    uint8_t status;                         // rpc_status_t of the last response
+    rpc_decoder_t decoder;
+
+    rpc_client_telemetry_fn_t telemetry;    // called for each telemetry frame, if set
+    void *telemetry_arg;
+
+    uint32_t requests;
+    uint32_t timeouts;
+    uint32_t stale;                         // responses that turned up after we'd given up on them
+    uint32_t telemetry_frames;
+} rpc_client_t;
+
+/*
+ * rpc_client_open() opens the console's serial port raw at 'baud';
+ * rpc_client_attach() takes an fd that's already set up. Either way,
+ * rpc_client_enter() then types the "rpc" escape at the console and
+ * pings until the device answers in binary, skipping whatever console
+ * text comes back first.
+ */
+int rpc_client_open(rpc_client_t *client, const char *device, uint32_t baud);
+void rpc_client_attach(rpc_client_t *client, int fd);
+int rpc_client_enter(rpc_client_t *client, uint32_t timeout_ms);
+void rpc_client_close(rpc_client_t *client);
+
+void rpc_client_on_telemetry(rpc_client_t *client, rpc_client_telemetry_fn_t fn, void *arg);
+
+/*
+ * Sends a request and waits up to 'timeout_ms' for its response,
+ * handing any telemetry that arrives meanwhile to the callback.
+ * Returns the length of the response's data (what follows the
+ * status byte), copied to 'resp', or one of RPC_CLIENT_ERR_*.
+ */
+int rpc_client_call(rpc_client_t *client, uint8_t type, const void *req, uint16_t req_len,
+                    void *resp, uint16_t resp_max, uint32_t timeout_ms);
+
+// Handles telemetry frames for 'timeout_ms'; returns how many there were, or RPC_CLIENT_ERR_IO:
+int rpc_client_poll(rpc_client_t *client, uint32_t timeout_ms);
+
+// The requests in rpc_proto.h; each returns 0 (or a count, where there is one) or RPC_CLIENT_ERR_*:
+int rpc_client_ping(rpc_client_t *client, const void *data, uint16_t len);
+int rpc_client_meter_snapshot(rpc_client_t *client, rpc_meter_snapshot_t *snapshot);
+int rpc_client_read_reg(rpc_client_t *client, uint8_t reg, uint8_t *value, uint16_t max);
+int rpc_client_set_led(rpc_client_t *client, uint8_t led, uint16_t level, uint16_t fade_msec);
+int rpc_client_read_eeprom(rpc_client_t *client, uint16_t address, uint8_t *data, uint16_t count);
+int rpc_client_stream(rpc_client_t *client, uint16_t period_msec);
+int rpc_client_log_query(rpc_client_t *client, uint32_t from, uint32_t to,
+                         rpc_log_record_t *records, uint32_t max);
+int rpc_client_bye(rpc_client_t *client);
@@ -0,0 +1,91 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * bench_rpc_client.c - round trips through the rpc server over a pty,
+ * by request and payload size, and the throughput that makes. A pty
+ * moves bytes as fast as they're written, so this is the cost of the
+ * code on both ends; on a board the uart's baud rate comes on top.
+ */
+
+#include "rpc_loopback.h"
+#include "host_bench.h"
+
+#define BENCH_REPS          (2000)
+
+static rpc_client_t m_client;
+
+typedef struct {
+    uint16_t len;
+    uint8_t data[RPC_FRAME_PAYLOAD_MAX];
+} ping_case_t;
+
+static void bench_ping(void *arg)
+{
+    ping_case_t *ping = arg;
+
+    rpc_client_ping(&m_client, ping->data, ping->len);
+}
+
+static void bench_snapshot(void *arg)
+{
+    rpc_meter_snapshot_t snapshot;
+
+    (void) arg;
+    rpc_client_meter_snapshot(&m_client, &snapshot);
+}
+
+static void bench_eeprom(void *arg)
+{
+    static uint8_t data[OMAR_EEPROM_SIZE];
+
+    (void) arg;
+    rpc_client_read_eeprom(&m_client, 0, data, sizeof(data));
+}
+
+// Frame bytes both ways per second, for a request carrying 'len' bytes and echoing them back:
+static void throughput(uint16_t len, uint32_t reps)
+{
+    ping_case_t ping = { .len = len };
+    uint32_t start = host_bench_clock();
+
+    for (uint32_t i = 0; i < reps; i++) {
+        bench_ping(&ping);
+    }
+
+    double secs = (uint32_t)(host_bench_clock() - start) / 1e9;
+    uint32_t wire = 2 * (RPC_FRAME_HEADER_LEN + RPC_FRAME_CRC_LEN) + 1 + 2 * len;
+
+    printf("# ping %u bytes: %.0f calls/s, %.0f bytes/s on the wire, %.0f payload bytes/s each way"
+           " (115200 baud would allow %.0f calls/s)\n",
+           len, reps / secs, reps * wire / secs, reps * len / secs, 11520.0 / wire);
+}
+
+int main(void)
+{
+    bench_t bench;
+    static ping_case_t pings[] = { { .len = 0 }, { .len = 16 }, { .len = 64 }, { .len = 255 } };
+
+    loopback_start();
+    if (rpc_client_open(&m_client, m_device, 115200) != 0 || rpc_client_enter(&m_client, 2000) != 0) {
+        printf("couldn't get the rpc server's attention\n");
+        return 1;
+    }
+
+    host_bench_init(&bench, "rpc_client");
+    for (uint32_t i = 0; i < sizeof(pings) / sizeof(pings[0]); i++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "ping_%u", pings[i].len);
+        host_bench_run(&bench, name, bench_ping, &pings[i], BENCH_REPS);
+    }
+    host_bench_run(&bench, "meter_snapshot", bench_snapshot, NULL, BENCH_REPS);
+    host_bench_run(&bench, "read_eeprom_1k", bench_eeprom, NULL, BENCH_REPS / 10);
+
+    throughput(16, BENCH_REPS);
+    throughput(255, BENCH_REPS);
+    printf("# %u requests, %u timeouts\n", m_client.requests, m_client.timeouts);
+
+    rpc_client_bye(&m_client);
+    rpc_client_close(&m_client);
+    loopback_stop();
+    return 0;
+}
@@ -0,0 +1,214 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * rpc_loopback.h - the real rpc server on one end of a pty, behind a
+ * stand-in for the console's line editor, with rpc_client on the other
+ * end; shared by the rpc tests and benches
+ */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "host.h"
+#include "driver/uart.h"
+#include "sdkconfig.h"
+#include "hw_setup.h"
+#include "adi_spi.h"
+#include "omar_led.h"
+#include "omar_thermal.h"
+#include "omar_energy_log.h"
+#include "s24c08.h"
+#include "i2c.h"
+#include "rpc_server.h"
+#include "rpc_client.h"
+#include "../../../components/i2c/test/i2c_slaves.h"
+
+#define LOOPBACK_PROMPT             "omar> "
+#define LOOPBACK_LOG_RECORDS        (25)        // two full RPC_LOG_QUERY replies and a short one
+#define LOOPBACK_LOG_START          (1546300800)
+#define LOOPBACK_LOG_PERIOD         (60)
+
+static int m_master = -1;
+static char m_device[64];
+static pthread_t m_console;
+static volatile bool m_console_stop = false;
+static volatile uint32_t m_rpc_sessions = 0;
+
+/*
+ * What the server's handlers reach for, standing in for the drivers:
+ * a meter whose readings count up with each snapshot, a register
+ * that reads back as its own number, and an energy log of
+ * LOOPBACK_LOG_RECORDS records a minute apart. The eeprom is the
+ * s24c08 model, through the real driver.
+ */
+static volatile bool m_adi_fail = false;
+static volatile uint32_t m_adi_snapshots = 0;
+static volatile uint8_t m_led_last = 0;
+static volatile uint32_t m_led_level = 0;
+static volatile uint32_t m_led_fade_msec = 0;
+
+esp_err_t adi_read_snapshot(adi_snapshot_t *snapshot)
+{
+    if (m_adi_fail) {
+        return ESP_FAIL;
+    }
+
+    int32_t n = (int32_t) m_adi_snapshots++;
+
+    snapshot->vrms = 1000000 + n;
+    snapshot->irmsa = 2000 + n;
+    snapshot->irmsb = 3000 + n;
+    snapshot->awatt = -4000 - n;
+    snapshot->bwatt = 5000 + n;
+    snapshot->avar = 6000 + n;
+    snapshot->bvar = -7000 - n;
+    snapshot->ava = 8000 + n;
+    snapshot->bva = 9000 + n;
+    return ESP_OK;
+}
+
+uint32_t spi_read_reg(SpiCmdNameT reg, uint8_t *buff)
+{
+    buff[0] = 0xa5;
+    buff[1] = (uint8_t) reg;
+    buff[2] = 0x5a;
+    return 3;
+}
+
+void led_set_level(uint8_t led, uint32_t level, uint32_t fade_msec)
+{
+    m_led_last = led;
+    m_led_level = level;
+    m_led_fade_msec = fade_msec;
+}
+
+thermal_state_t thermal_get_state(float *temperature)
+{
+    *temperature = 31.25f;
+    return THERMAL_STATE_DERATED;
+}
+
+bool omar_energy_log_get_summary(energy_log_summary_t *summary, energy_log_stats_t *stats)
+{
+    memset(summary, 0, sizeof(*summary));
+    memset(stats, 0, sizeof(*stats));
+    return true;
+}
+
+uint32_t omar_energy_log_query(uint32_t from, uint32_t to, energy_log_fn_t fn, void *arg)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < LOOPBACK_LOG_RECORDS; i++) {
+        energy_log_record_t record;
+
+        memset(&record, 0, sizeof(record));
+        record.time = LOOPBACK_LOG_START + i * LOOPBACK_LOG_PERIOD;
+        record.aenergy = (int32_t) i * 100;
+        record.benergy = -(int32_t) i;
+        record.vpeak = 170000;
+        record.temperature = 100 + (int32_t) i;
+
+        if (record.time < from || record.time > to) {
+            continue;
+        }
+        count++;
+        if (!fn(&record, arg)) {
+            break;
+        }
+    }
+    return count;
+}
+
+static void console_write(const char *text)
+{
+    uart_write_bytes(CONFIG_CONSOLE_UART_NUM, text, strlen(text));
+}
+
+/*
+ * The console task, as far as the host can tell: characters are
+ * echoed as they're typed, and a line of "rpc" hands the uart to the
+ * rpc server until it returns.
+ */
+static void *console_task(void *arg)
+{
+    char line[64];
+    size_t len = 0;
+
+    (void) arg;
+
+    console_write(LOOPBACK_PROMPT);
+    while (!m_console_stop) {
+        uint8_t c;
+
+        if (uart_read_bytes(CONFIG_CONSOLE_UART_NUM, &c, 1, pdMS_TO_TICKS(20)) != 1) {
+            continue;
+        }
+        if (c == '\n') {
+            continue;
+        }
+        if (c != '\r') {
+            if (len < sizeof(line) - 1) {
+                line[len++] = (char) c;
+                uart_write_bytes(CONFIG_CONSOLE_UART_NUM, (const char *) &c, 1);
+            }
+            continue;
+        }
+
+        line[len] = '\0';
+        len = 0;
+        console_write("\r\n");
+        if (strcmp(line, "rpc") == 0) {
+            rpc_server_run();
+            m_rpc_sessions++;
+        } else if (line[0] != '\0') {
+            console_write("Unrecognized command\r\n");
+        }
+        console_write(LOOPBACK_PROMPT);
+    }
+    return NULL;
+}
+
+static void loopback_start(void)
+{
+    m_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (m_master < 0 || grantpt(m_master) != 0 || unlockpt(m_master) != 0) {
+        perror("posix_openpt");
+        exit(1);
+    }
+    snprintf(m_device, sizeof(m_device), "%s", ptsname(m_master));
+
+    // Raw from the start, so the prompt isn't echoed back before the client opens its end:
+    struct termios tio;
+
+    tcgetattr(m_master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(m_master, TCSANOW, &tio);
+
+    for (uint16_t i = 0; i < SLAVE_S24C08_SIZE; i++) {
+        m_s24c08.mem[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+    slaves_attach();
+    i2c_init();
+
+    host_uart_attach(CONFIG_CONSOLE_UART_NUM, m_master);
+    pthread_create(&m_console, NULL, console_task, NULL);
+}
+
+static void loopback_stop(void)
+{
+    m_console_stop = true;
+    pthread_join(m_console, NULL);
+    close(m_master);
+}
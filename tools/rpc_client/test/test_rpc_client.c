@@ -0,0 +1,300 @@
+/* Copyright (c) 2019 Currant Inc. All Rights Reserved.
+ *
+ * test_rpc_client.c - rpc_client against the real rpc server over a
+ * pty: entering and leaving binary mode, every request, telemetry
+ * interleaved with calls, recovering from junk, and round-trip time
+ */
+
+#include "rpc_loopback.h"
+#include "unit.h"
+
+#define ENTER_MS            (2000)
+#define LATENCY_PINGS       (200)
+#define LATENCY_MEAN_MAX_MS (20.0)      // a 100ms uart_read_bytes() wait per request is way past this
+
+static rpc_client_t m_client;
+static uint32_t m_telemetry = 0;
+static rpc_meter_snapshot_t m_telemetry_last;
+
+static void on_telemetry(const rpc_meter_snapshot_t *snapshot, void *arg)
+{
+    (void) arg;
+    m_telemetry++;
+    m_telemetry_last = *snapshot;
+}
+
+static double now_msec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+static void test_crc_check_value(void)
+{
+    static const uint8_t check[] = "123456789";
+
+    // The CRC-16/CCITT-FALSE check value:
+    CHECK_EQ(rpc_crc16(RPC_CRC16_INIT, check, 9), 0x29b1);
+    CHECK_EQ(rpc_crc16(RPC_CRC16_INIT, check, 0), RPC_CRC16_INIT);
+}
+
+static void test_open_and_enter(void)
+{
+    CHECK_EQ(rpc_client_open(&m_client, m_device, 12345), RPC_CLIENT_ERR_IO);
+    CHECK_EQ(rpc_client_open(&m_client, m_device, 115200), 0);
+    rpc_client_on_telemetry(&m_client, on_telemetry, NULL);
+
+    int ret = rpc_client_enter(&m_client, ENTER_MS);
+
+    CHECK_EQ(ret, 0);
+    CHECK_EQ(m_rpc_sessions, 0);
+
+    // The prompt and the echo of "rpc" came first, and weren't frames:
+    CHECK(m_client.decoder.skipped >= strlen(LOOPBACK_PROMPT "rpc"));
+}
+
+static void test_ping_every_size(void)
+{
+    uint8_t data[RPC_FRAME_PAYLOAD_MAX];
+    uint32_t timeouts = m_client.timeouts;
+    uint32_t failed = 0;
+
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i ^ RPC_FRAME_SOF);
+    }
+
+    // Including payloads full of 0x7e, which aren't escaped:
+    for (uint32_t len = 0; len < sizeof(data); len++) {
+        failed += (rpc_client_ping(&m_client, data, len) != 0);
+    }
+    CHECK_EQ(failed, 0);
+    memset(data, RPC_FRAME_SOF, sizeof(data));
+    CHECK_EQ(rpc_client_ping(&m_client, data, sizeof(data) - 1), 0);
+
+    // The echo can only hold RPC_FRAME_PAYLOAD_MAX - 1 after the status byte:
+    CHECK_EQ(rpc_client_ping(&m_client, data, sizeof(data)), RPC_CLIENT_ERR_SIZE);
+    CHECK_EQ(m_client.timeouts, timeouts);
+}
+
+static void test_meter_snapshot(void)
+{
+    rpc_meter_snapshot_t snapshot;
+    uint32_t n = m_adi_snapshots;
+
+    CHECK_EQ(rpc_client_meter_snapshot(&m_client, &snapshot), 0);
+    CHECK_EQ(snapshot.vrms, 1000000 + n);
+    CHECK_EQ(snapshot.irmsa, 2000 + n);
+    CHECK_EQ(snapshot.awatt, -4000 - (int32_t) n);
+    CHECK_EQ(snapshot.bvar, -7000 - (int32_t) n);
+    CHECK_EQ(snapshot.bva, 9000 + n);
+    CHECK_EQ(snapshot.temperature, 125);
+    CHECK_EQ(snapshot.thermal_state, THERMAL_STATE_DERATED);
+
+    m_adi_fail = true;
+    CHECK_EQ(rpc_client_meter_snapshot(&m_client, &snapshot), RPC_CLIENT_ERR_STATUS);
+    CHECK_EQ(m_client.status, RPC_STATUS_FAILED);
+    m_adi_fail = false;
+}
+
+static void test_read_reg(void)
+{
+    uint8_t value[4] = { 0 };
+
+    CHECK_EQ(rpc_client_read_reg(&m_client, AP_NOLOAD, value, sizeof(value)), 3);
+    CHECK_EQ(value[0], 0xa5);
+    CHECK_EQ(value[1], AP_NOLOAD);
+    CHECK_EQ(value[2], 0x5a);
+
+    CHECK_EQ(rpc_client_read_reg(&m_client, AP_NOLOAD + 1, value, sizeof(value)), RPC_CLIENT_ERR_STATUS);
+    CHECK_EQ(m_client.status, RPC_STATUS_BAD_ARGS);
+
+    // Too small a buffer for the answer:
+    CHECK_EQ(rpc_client_read_reg(&m_client, AP_NOLOAD, value, 2), RPC_CLIENT_ERR_SIZE);
+}
+
+static void test_set_led(void)
+{
+    CHECK_EQ(rpc_client_set_led(&m_client, 2, 750, 400), 0);
+    CHECK_EQ(m_led_last, OMAR_WHITE_LED1);
+    CHECK_EQ(m_led_level, 750);
+    CHECK_EQ(m_led_fade_msec, 400);
+
+    CHECK_EQ(rpc_client_set_led(&m_client, 3, 750, 0), RPC_CLIENT_ERR_STATUS);
+    CHECK_EQ(m_client.status, RPC_STATUS_BAD_ARGS);
+    CHECK_EQ(rpc_client_set_led(&m_client, 1, OMAR_LED_LEVEL_MAX + 1, 0), RPC_CLIENT_ERR_STATUS);
+    CHECK_EQ(m_led_last, OMAR_WHITE_LED1);
+}
+
+static void test_read_eeprom(void)
+{
+    static uint8_t data[OMAR_EEPROM_SIZE];
+
+    // Five requests' worth, across all four blocks:
+    CHECK_EQ(rpc_client_read_eeprom(&m_client, 0, data, sizeof(data)), 0);
+    CHECK(memcmp(data, m_s24c08.mem, sizeof(data)) == 0);
+
+    memset(data, 0, sizeof(data));
+    CHECK_EQ(rpc_client_read_eeprom(&m_client, 0x3f0, data, 16), 0);
+    CHECK(memcmp(data, &m_s24c08.mem[0x3f0], 16) == 0);
+
+    CHECK_EQ(rpc_client_read_eeprom(&m_client, 0x3f0, data, 17), RPC_CLIENT_ERR_STATUS);
+    CHECK_EQ(m_client.status, RPC_STATUS_BAD_ARGS);
+}
+
+static void test_log_query(void)
+{
+    rpc_log_record_t records[LOOPBACK_LOG_RECORDS + 5];
+    uint32_t last = LOOPBACK_LOG_START + (LOOPBACK_LOG_RECORDS - 1) * LOOPBACK_LOG_PERIOD;
+
+    // Three replies: two full, then a short one that says that's all:
+    uint32_t requests = m_client.requests;
+    int count = rpc_client_log_query(&m_client, 0, UINT32_MAX, records, LOOPBACK_LOG_RECORDS + 5);
+
+    CHECK_EQ(count, LOOPBACK_LOG_RECORDS);
+    CHECK_EQ(m_client.requests - requests, 3);
+    CHECK_EQ(records[0].time, LOOPBACK_LOG_START);
+    CHECK_EQ(records[count - 1].time, last);
+    CHECK_EQ(records[7].aenergy, 700);
+    CHECK_EQ(records[7].benergy, -7);
+    CHECK_EQ(records[7].vpeak, 170000);
+    CHECK_EQ(records[7].temperature, 107);
+
+    // A window, and a short buffer:
+    count = rpc_client_log_query(&m_client, LOOPBACK_LOG_START + 1, LOOPBACK_LOG_START + 3 * LOOPBACK_LOG_PERIOD,
+                                 records, LOOPBACK_LOG_RECORDS);
+    CHECK_EQ(count, 3);
+    CHECK_EQ(records[0].time, LOOPBACK_LOG_START + LOOPBACK_LOG_PERIOD);
+    count = rpc_client_log_query(&m_client, 0, UINT32_MAX, records, 4);
+    CHECK_EQ(count, 4);
+
+    CHECK_EQ(rpc_client_log_query(&m_client, last + 1, UINT32_MAX, records, 4), 0);
+}
+
+static void test_unknown_type(void)
+{
+    CHECK_EQ(rpc_client_call(&m_client, 0x33, NULL, 0, NULL, 0, RPC_CLIENT_TIMEOUT_MS), RPC_CLIENT_ERR_STATUS);
+    CHECK_EQ(m_client.status, RPC_STATUS_UNKNOWN_TYPE);
+
+    rpc_stream_t short_req = { 0 };
+
+    CHECK_EQ(rpc_client_call(&m_client, RPC_STREAM, &short_req, 1, NULL, 0, RPC_CLIENT_TIMEOUT_MS),
+             RPC_CLIENT_ERR_STATUS);
+    CHECK_EQ(m_client.status, RPC_STATUS_BAD_ARGS);
+}
+
+static void test_stream(void)
+{
+    uint32_t failed = 0;
+
+    m_telemetry = 0;
+    CHECK_EQ(rpc_client_stream(&m_client, 20), 0);
+
+    // Calls go on working with telemetry turning up in between:
+    for (uint32_t i = 0; i < 50; i++) {
+        uint8_t byte = (uint8_t) i;
+
+        failed += (rpc_client_ping(&m_client, &byte, 1) != 0);
+        usleep(2000);
+    }
+    CHECK_EQ(failed, 0);
+    CHECK(rpc_client_poll(&m_client, 200) > 0);
+    CHECK(m_telemetry >= 5);
+    CHECK(m_telemetry_last.vrms >= 1000000);
+    CHECK_EQ(m_telemetry_last.thermal_state, THERMAL_STATE_DERATED);
+
+    CHECK_EQ(rpc_client_stream(&m_client, 0), 0);
+    rpc_client_poll(&m_client, 50);
+    CHECK_EQ(rpc_client_poll(&m_client, 200), 0);
+    CHECK_EQ(m_client.stale, 0);
+}
+
+static void test_resync_after_junk(void)
+{
+    uint8_t frame[RPC_FRAME_MAX];
+    uint32_t len = rpc_frame_encode(RPC_PING, 99, "abc", 3, frame);
+    static const char text[] = "I (1234) omar: console text from another task\n";
+
+    // A frame with a bad crc and console text, then a good request:
+    frame[len - 1] ^= 0x01;
+    CHECK_EQ(write(m_client.fd, frame, len), len);
+    CHECK_EQ(write(m_client.fd, text, strlen(text)), strlen(text));
+    CHECK_EQ(rpc_client_ping(&m_client, "ok", 2), 0);
+
+    // The same from the device's side:
+    CHECK_EQ(write(m_master, text, strlen(text)), strlen(text));
+    CHECK_EQ(write(m_master, frame, len), len);
+    uint32_t crc_errors = m_client.decoder.crc_errors;
+
+    CHECK_EQ(rpc_client_ping(&m_client, "ok", 2), 0);
+    CHECK_EQ(m_client.decoder.crc_errors, crc_errors + 1);
+}
+
+static void test_bye_and_reenter(void)
+{
+    CHECK_EQ(rpc_client_bye(&m_client), 0);
+    usleep(50000);
+    CHECK_EQ(m_rpc_sessions, 1);
+
+    // Back at the prompt, a frame is just something typed:
+    CHECK_EQ(rpc_client_call(&m_client, RPC_PING, NULL, 0, NULL, 0, 100), RPC_CLIENT_ERR_TIMEOUT);
+
+    CHECK_EQ(rpc_client_enter(&m_client, ENTER_MS), 0);
+    CHECK_EQ(rpc_client_ping(&m_client, "again", 5), 0);
+}
+
+static void test_abort(void)
+{
+    static const uint8_t aborts[] = { 0x03, 0x03, 0x03 };
+    uint32_t sessions = m_rpc_sessions;
+
+    CHECK_EQ(write(m_client.fd, aborts, sizeof(aborts)), sizeof(aborts));
+    usleep(50000);
+    CHECK_EQ(m_rpc_sessions, sessions + 1);
+
+    CHECK_EQ(rpc_client_enter(&m_client, ENTER_MS), 0);
+}
+
+static void test_latency(void)
+{
+    uint8_t data[16] = "0123456789abcdef";
+    uint32_t failed = 0;
+    double start = now_msec();
+
+    for (uint32_t i = 0; i < LATENCY_PINGS; i++) {
+        failed += (rpc_client_ping(&m_client, data, sizeof(data)) != 0);
+    }
+
+    double mean = (now_msec() - start) / LATENCY_PINGS;
+
+    printf("  %u pings of %u bytes: %.3f ms round trip\n", LATENCY_PINGS, (unsigned) sizeof(data), mean);
+    CHECK_EQ(failed, 0);
+    CHECK(mean < LATENCY_MEAN_MAX_MS);
+}
+
+int main(void)
+{
+    loopback_start();
+
+    RUN(test_crc_check_value);
+    RUN(test_open_and_enter);
+    RUN(test_ping_every_size);
+    RUN(test_meter_snapshot);
+    RUN(test_read_reg);
+    RUN(test_set_led);
+    RUN(test_read_eeprom);
+    RUN(test_log_query);
+    RUN(test_unknown_type);
+    RUN(test_stream);
+    RUN(test_resync_after_junk);
+    RUN(test_bye_and_reenter);
+    RUN(test_abort);
+    RUN(test_latency);
+
+    rpc_client_bye(&m_client);
+    rpc_client_close(&m_client);
+    loopback_stop();
+
+    return unit_done();
+}